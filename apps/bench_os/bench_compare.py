@@ -0,0 +1,127 @@
+#!/usr/bin/env python
+#
+# Copyright 2016, Data61
+# Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+# ABN 41 687 119 230.
+#
+# This software may be distributed and modified according to the terms of
+# the BSD 2-Clause license. Note that NO WARRANTY is provided.
+# See "LICENSE_BSD2.txt" for details.
+#
+# @TAG(D61_BSD)
+#
+
+'''
+Extract and compare RefOS benchmark results.
+
+bench_os prints one "BENCH | <name> unit <unit> n <n> min <v> p50 <v> ..." line per benchmark,
+or "BENCH | <name> skipped <reason>" for one that could not run. This script pulls those lines out
+of a serial log (ignoring everything else, including colour escape codes), and either writes them
+out as a baseline, or compares them against a baseline. A benchmark skipped in the baseline has
+nothing to compare against, so it is listed but never counted as a regression.
+
+ # Record a baseline from a QEMU serial log.
+ bench_compare.py --extract refos.log > baseline.txt
+ # Compare a new run against it, failing if any median got more than 10% slower.
+ bench_compare.py --baseline baseline.txt --threshold 10 refos.log
+'''
+
+from __future__ import print_function
+import argparse
+import re
+import sys
+
+BENCH_LINE = re.compile(r'BENCH \| (\S+) unit (\S+) ((?:\S+ \d+ ?)+)')
+SKIPPED_LINE = re.compile(r'BENCH \| (\S+) skipped (\S+)')
+COMPARE_KEYS = ['p50', 'p90']
+
+
+def parse(lines):
+    '''Parse benchmark lines into an ordered list of (name, unit, {key: value}). Skipped benchmarks
+    have a unit of None, and their reason as the only value.'''
+    results = []
+    for line in lines:
+        m = BENCH_LINE.search(line)
+        if m:
+            fields = m.group(3).split()
+            values = dict((k, int(v)) for k, v in zip(fields[0::2], fields[1::2]))
+            results.append((m.group(1), m.group(2), values))
+            continue
+        m = SKIPPED_LINE.search(line)
+        if m:
+            results.append((m.group(1), None, {'reason': m.group(2)}))
+    return results
+
+
+def format_line(name, unit, values):
+    if unit is None:
+        return 'BENCH | %s skipped %s' % (name, values['reason'])
+    keys = ['n', 'min', 'p50', 'p90', 'p99', 'max', 'mean']
+    return 'BENCH | %s unit %s %s' % (name, unit,
+            ' '.join('%s %d' % (k, values[k]) for k in keys if k in values))
+
+
+def compare(baseline, current, threshold):
+    '''Print a comparison table. Returns the number of regressions.'''
+    base = dict((name, (unit, values)) for name, unit, values in baseline)
+    regressions = 0
+    print('%-22s %-7s %12s %12s %8s' % ('benchmark', 'stat', 'baseline', 'current', 'delta'))
+    for name, unit, values in current:
+        if name not in base:
+            print('%-22s %-7s %12s %12s %8s' % (name, '-', 'missing', '-', '-'))
+            continue
+        bunit, bvalues = base.pop(name)
+        if bunit is None or unit is None:
+            reason = bvalues['reason'] if bunit is None else values['reason']
+            print('%-22s %-7s %12s %12s %8s' % (name, '-', 'skipped' if bunit is None else '-',
+                                                'skipped' if unit is None else '-', reason))
+            continue
+        if bunit != unit:
+            print('%-22s unit changed from %s to %s' % (name, bunit, unit))
+            continue
+        for key in COMPARE_KEYS:
+            if key not in values or key not in bvalues:
+                continue
+            old, new = bvalues[key], values[key]
+            delta = (100.0 * (new - old) / old) if old else 0.0
+            mark = ''
+            if key == 'p50' and delta > threshold:
+                mark = ' REGRESSION'
+                regressions += 1
+            print('%-22s %-7s %12d %12d %+7.1f%%%s' % (name, key, old, new, delta, mark))
+    for name in base:
+        print('%-22s %-7s %12s %12s %8s' % (name, '-', '-', 'missing', '-'))
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Extract and compare RefOS benchmark results.')
+    parser.add_argument('log', help='Serial log of a bench_os run, or - for stdin.')
+    parser.add_argument('--extract', action='store_true',
+                        help='Print the benchmark lines of the log in baseline format.')
+    parser.add_argument('--baseline', help='Baseline file to compare against.')
+    parser.add_argument('--threshold', type=float, default=10.0,
+                        help='Percentage a median may grow by before it is a regression.')
+    args = parser.parse_args()
+
+    log = sys.stdin if args.log == '-' else open(args.log)
+    current = parse(log)
+    if not current:
+        print('%s: no benchmark results found.' % args.log, file=sys.stderr)
+        return 2
+
+    if args.extract or not args.baseline:
+        for name, unit, values in current:
+            print(format_line(name, unit, values))
+        return 0
+
+    with open(args.baseline) as f:
+        baseline = parse(f)
+    if not any(unit is not None for _, unit, _ in baseline):
+        print('%s: baseline has no measured results; record one with make bench-baseline.'
+              % args.baseline, file=sys.stderr)
+    return 1 if compare(baseline, current, args.threshold) else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
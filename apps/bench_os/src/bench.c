@@ -0,0 +1,113 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+#include <autoconf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "bench.h"
+
+/*! @file
+    @brief RefOS benchmark sample collection and reporting. */
+
+#if defined(CONFIG_ARCH_X86)
+    #define BENCH_ARCH "x86"
+#else
+    #define BENCH_ARCH "arm"
+#endif
+
+void
+bench_init(void)
+{
+    /* The x86 TSC is readable from user level without any set up. The ARM cycle counter has to
+       be enabled, either by the kernel or by code libsel4bench injects into it. */
+#if defined(CONFIG_DANGEROUS_CODE_INJECTION) || defined(CONFIG_EXPORT_PMU_USER)
+    sel4bench_init();
+#endif
+}
+
+void
+bench_reset(struct bench_result *r, const char *name, const char *unit)
+{
+    assert(r && name && unit);
+    r->magic = BENCH_MAGIC;
+    r->name = name;
+    r->unit = unit;
+    r->n = 0;
+}
+
+void
+bench_add(struct bench_result *r, uint64_t sample)
+{
+    assert(r && r->magic == BENCH_MAGIC);
+    if (r->n >= BENCH_MAX_SAMPLES) {
+        return;
+    }
+    r->samples[r->n++] = sample;
+}
+
+static int
+bench_sample_compare(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t*) a;
+    uint64_t y = *(const uint64_t*) b;
+    return (x > y) - (x < y);
+}
+
+/*! @brief Nearest-rank percentile of a sorted result. */
+static uint64_t
+bench_percentile(struct bench_result *r, uint32_t percent)
+{
+    assert(r->n > 0 && percent <= 100);
+    uint32_t rank = (percent * r->n + 99) / 100;
+    return r->samples[rank > 0 ? rank - 1 : 0];
+}
+
+void
+bench_begin_report(void)
+{
+    printf("BENCH | begin format %d arch %s counter cycles\n", BENCH_FORMAT_VERSION, BENCH_ARCH);
+}
+
+void
+bench_report(struct bench_result *r)
+{
+    assert(r && r->magic == BENCH_MAGIC);
+    if (r->n == 0) {
+        bench_report_skipped(r->name, "no_samples");
+        return;
+    }
+
+    qsort(r->samples, r->n, sizeof(uint64_t), bench_sample_compare);
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < r->n; i++) {
+        total += r->samples[i];
+    }
+
+    printf("BENCH | %s unit %s n %u min %llu p50 %llu p90 %llu p99 %llu max %llu mean %llu\n",
+           r->name, r->unit, r->n, r->samples[0], bench_percentile(r, 50),
+           bench_percentile(r, 90), bench_percentile(r, 99), r->samples[r->n - 1],
+           total / r->n);
+}
+
+void
+bench_report_skipped(const char *name, const char *reason)
+{
+    printf("BENCH | %s skipped %s\n", name, reason);
+}
+
+void
+bench_end_report(void)
+{
+    printf("BENCH | end\n");
+}
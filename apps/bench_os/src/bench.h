@@ -0,0 +1,99 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+#ifndef _REFOS_BENCH_OS_BENCH_H_
+#define _REFOS_BENCH_OS_BENCH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sel4bench/sel4bench.h>
+
+/*! @file
+    @brief RefOS benchmark sample collection and reporting.
+
+    Each benchmark collects up to BENCH_MAX_SAMPLES samples of one operation into a bench_result,
+    and then reports it as a single line of the form
+
+        BENCH | <name> unit <unit> n <n> min <v> p50 <v> p90 <v> p99 <v> max <v> mean <v>
+
+    between a "BENCH | begin" and a "BENCH | end" line. Benchmarks always run in the same order
+    and print the same keys in the same order, so the output of two runs may be diffed or fed to
+    apps/bench_os/bench_compare.py.
+*/
+
+#define BENCH_FORMAT_VERSION 1
+#define BENCH_MAX_SAMPLES 512
+#define BENCH_MAGIC 0x6E7C3B10
+
+#define BENCH_UNIT_CYCLES "cycles"
+#define BENCH_UNIT_NS "ns"
+#define BENCH_UNIT_KB "kb"
+
+/*! @brief The samples of a single benchmark. */
+struct bench_result {
+    uint32_t magic;
+    const char *name;
+    const char *unit;
+    uint32_t n;
+    uint64_t samples[BENCH_MAX_SAMPLES];
+};
+
+/*! @brief Initialise the cycle counter. Must be called before bench_cycles(). */
+void bench_init(void);
+
+/*! @brief Read the cycle counter. */
+static inline ccnt_t
+bench_cycles(void)
+{
+    return sel4bench_get_cycle_count();
+}
+
+/*! @brief Cycles elapsed between two cycle counter reads. Handles a single counter wrap. */
+static inline uint64_t
+bench_cycles_since(ccnt_t start)
+{
+    ccnt_t end = sel4bench_get_cycle_count();
+    return (uint64_t) (ccnt_t) (end - start);
+}
+
+/*! @brief Reset a result to hold the samples of a new benchmark.
+    @param r The result to reset.
+    @param name The benchmark name. Must not contain spaces. (No ownership)
+    @param unit The sample unit, BENCH_UNIT_CYCLES, BENCH_UNIT_NS or BENCH_UNIT_KB.
+                (No ownership)
+*/
+void bench_reset(struct bench_result *r, const char *name, const char *unit);
+
+/*! @brief Add a sample to a result. Samples past BENCH_MAX_SAMPLES are dropped.
+    @param r The result.
+    @param sample The sample value.
+*/
+void bench_add(struct bench_result *r, uint64_t sample);
+
+/*! @brief Print the header line of a benchmark run. */
+void bench_begin_report(void);
+
+/*! @brief Print the summary line of a result. Sorts the samples of the result.
+    @param r The result to report.
+*/
+void bench_report(struct bench_result *r);
+
+/*! @brief Print a line saying that a benchmark could not be run, in place of its summary line.
+    @param name The benchmark name.
+    @param reason Short reason, without spaces.
+*/
+void bench_report_skipped(const char *name, const char *reason);
+
+/*! @brief Print the footer line of a benchmark run. */
+void bench_end_report(void);
+
+#endif /* _REFOS_BENCH_OS_BENCH_H_ */
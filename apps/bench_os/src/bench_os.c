@@ -0,0 +1,1244 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+#include <autoconf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#ifdef CONFIG_LIB_VTERM
+#include <vterm/vterm.h>
+#endif
+
+#include <refos/refos.h>
+#include <refos/error.h>
+#include <refos/vmlayout.h>
+#include <refos/sync.h>
+#include <refos-io/stdio.h>
+#include <refos-util/init.h>
+#include <refos-util/cspace.h>
+#include <refos-util/walloc.h>
+#include <refos-rpc/proc_client.h>
+#include <refos-rpc/proc_client_helper.h>
+#include <refos-rpc/data_client.h>
+#include <refos-rpc/data_client_helper.h>
+#include <refos-rpc/serv_client.h>
+#include <refos-rpc/serv_client_helper.h>
+#include <refos-rpc/name_client.h>
+#include <refos-rpc/name_client_helper.h>
+
+#include "bench.h"
+
+/*! @file
+    @brief RefOS OS level benchmarks.
+
+    Times a fixed set of core OS paths with the cycle counter. See bench.h for the output format.
+    The process spawn benchmark runs this same program as the child; a child is started with the
+    "--child" argument, and exits straight away. The concurrent spawn benchmark
+    keeps its children alive while it measures their memory use: it sets a hold file in the file
+    server's RAM filesystem, and each child checks in through a ready file of its own, then waits
+    for the hold to be lifted before exiting. The exit benchmark works the same way through its own
+    file: a child that finds it set maps a large sparse heap, and stamps the file just before it
+    exits. The network benchmark's child listens on the loopback interface, and marks its file once
+    it is ready for the parent to connect.
+*/
+
+#define BENCH_APPNAME "/fileserv/bench_os"
+#define BENCH_FILE "fileserv/bench_4mb"
+#define BENCH_FILE_DSPACE "bench_4mb"
+#define BENCH_FILE_SIZE 0x400000
+#define BENCH_SPAWN_EXIT_STATUS 0xBE7C
+#define BENCH_CHILD_ARG "--child"
+
+#define BENCH_WARMUP 8
+#define BENCH_RPC_ITERATIONS 512
+#define BENCH_FAULT_PAGES 256
+#define BENCH_DATASPACE_ITERATIONS 64
+#define BENCH_READ_ITERATIONS 128
+#define BENCH_SLEEP_ITERATIONS 16
+#define BENCH_MALLOC_ITERATIONS 128
+#define BENCH_MALLOC_SIZE 0x4000
+#define BENCH_MEMOPS_ITERATIONS 64
+#define BENCH_SYNC_ITERATIONS 256
+#define BENCH_WINDOW_COUNT 1536
+#define BENCH_MEMOPS_MAX_SIZE 0x10000
+#define BENCH_SPAWN_ITERATIONS 8
+#define BENCH_SPAWN_CONCURRENT 4
+#define BENCH_SPAWN_CONCURRENT_ITERATIONS 4
+#define BENCH_SPAWN_HOLD_FILE "fileserv/bench_spawn_hold"
+#define BENCH_SPAWN_READY_FILE "fileserv/bench_spawn_ready_%u"
+#define BENCH_SPAWN_POLL_NS 1000000ULL
+#define BENCH_SPAWN_POLL_TRIES 5000
+#define BENCH_EXIT_FILE "fileserv/bench_exit_sparse"
+#define BENCH_EXIT_ITERATIONS 8
+#define BENCH_EXIT_HEAP_SIZE 0x4000000
+#define BENCH_EXIT_HEAP_STRIDE 0x10000
+#define BENCH_CONSOLE_ITERATIONS 128
+#define BENCH_CONSOLE_LINE_LEN 64
+#define BENCH_CONSOLE_FLOOD_LINES 64
+#define BENCH_CONSOLE_FLOOD_ITERATIONS 8
+#define BENCH_NET_FILE "fileserv/bench_net"
+#define BENCH_NET_PORT 7200
+#define BENCH_NET_MSG_LEN 64
+#define BENCH_NET_ITERATIONS 256
+#define BENCH_NET_STREAM_SIZE 0x100000
+#define BENCH_NET_STREAM_CHUNK 0x4000
+#define BENCH_NET_STREAM_ITERATIONS 4
+#define BENCH_VTERM_ROWS 25
+#define BENCH_VTERM_COLS 80
+#define BENCH_VTERM_TEXT_SIZE 0x40000
+#define BENCH_VTERM_CHUNK 1024
+#define BENCH_VTERM_ITERATIONS 8
+
+static struct bench_result benchResult;
+static struct bench_result benchResult2;
+static char benchReadBuffer[0x8000];
+static char benchMemopsSrc[BENCH_MEMOPS_MAX_SIZE + 64];
+static char benchMemopsDest[BENCH_MEMOPS_MAX_SIZE + 64];
+static seL4_Word benchWindowAddr[BENCH_WINDOW_COUNT];
+static char benchNetBuffer[BENCH_NET_STREAM_CHUNK];
+
+/* ------------------------------------ Null RPC ------------------------------------------------ */
+
+static void
+bench_rpc_procserv(void)
+{
+    struct bench_result *r = &benchResult;
+    bench_reset(r, "rpc_null_procserv", BENCH_UNIT_CYCLES);
+    for (int i = 0; i < BENCH_WARMUP + BENCH_RPC_ITERATIONS; i++) {
+        ccnt_t start = bench_cycles();
+        int error = proc_ping();
+        uint64_t t = bench_cycles_since(start);
+        assert(error == ESUCCESS);
+        (void) error;
+        if (i >= BENCH_WARMUP) {
+            bench_add(r, t);
+        }
+    }
+    bench_report(r);
+}
+
+/*! @brief Time a serv_ping to the server mounted at the given path.
+    @param name The benchmark name.
+    @param path The server mount path, eg. "fileserv/*".
+*/
+static void
+bench_rpc_server(const char *name, char *path)
+{
+    struct bench_result *r = &benchResult;
+    nsv_mountpoint_t mp = nsv_resolve(path);
+    if (!mp.success || !mp.serverAnon) {
+        bench_report_skipped(name, "server_not_found");
+        return;
+    }
+
+    bench_reset(r, name, BENCH_UNIT_CYCLES);
+    for (int i = 0; i < BENCH_WARMUP + BENCH_RPC_ITERATIONS; i++) {
+        ccnt_t start = bench_cycles();
+        int error = serv_ping(mp.serverAnon);
+        uint64_t t = bench_cycles_since(start);
+        if (error != ESUCCESS) {
+            break;
+        }
+        if (i >= BENCH_WARMUP) {
+            bench_add(r, t);
+        }
+    }
+    nsv_mountpoint_release(&mp);
+    bench_report(r);
+}
+
+/* ------------------------------------ Page faults --------------------------------------------- */
+
+static void
+bench_fault_anon(void)
+{
+    struct bench_result *r = &benchResult;
+    data_mapping_t anon = data_open_map(REFOS_PROCSERV_EP, "anon", 0x0, 0,
+            BENCH_FAULT_PAGES * REFOS_PAGE_SIZE, -1);
+    if (anon.err != ESUCCESS) {
+        bench_report_skipped("fault_anon", "data_open_map_failed");
+        return;
+    }
+
+    /* Every first touch of a page is a VM fault resolved by the process server. */
+    bench_reset(r, "fault_anon", BENCH_UNIT_CYCLES);
+    for (int i = 0; i < BENCH_FAULT_PAGES; i++) {
+        volatile char *p = anon.vaddr + i * REFOS_PAGE_SIZE;
+        ccnt_t start = bench_cycles();
+        *p = (char) i;
+        bench_add(r, bench_cycles_since(start));
+    }
+    data_mapping_release(anon);
+    bench_report(r);
+}
+
+static void
+bench_fault_file(void)
+{
+    struct bench_result *r = &benchResult;
+    int fd = open(BENCH_FILE, O_RDONLY);
+    if (fd < 0) {
+        bench_report_skipped("fault_file", "no_bench_file");
+        return;
+    }
+    char *data = mmap(NULL, BENCH_FAULT_PAGES * REFOS_PAGE_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        close(fd);
+        bench_report_skipped("fault_file", "mmap_failed");
+        return;
+    }
+
+    /* Every first touch of a page is a VM fault forwarded to the file server's pager. */
+    bench_reset(r, "fault_file", BENCH_UNIT_CYCLES);
+    uint32_t sum = 0;
+    for (int i = 0; i < BENCH_FAULT_PAGES; i++) {
+        volatile char *p = data + i * REFOS_PAGE_SIZE;
+        ccnt_t start = bench_cycles();
+        sum += *p;
+        bench_add(r, bench_cycles_since(start));
+    }
+    (void) sum;
+    munmap(data, BENCH_FAULT_PAGES * REFOS_PAGE_SIZE);
+    close(fd);
+    bench_report(r);
+}
+
+/* ------------------------------------ Dataspaces ---------------------------------------------- */
+
+static void
+bench_dataspace_open_map(void)
+{
+    struct bench_result *ro = &benchResult;
+    struct bench_result *rm = &benchResult2;
+    serv_connection_t c = serv_connect_no_pbuffer("/fileserv/*");
+    if (c.error != ESUCCESS) {
+        bench_report_skipped("data_open", "connect_failed");
+        bench_report_skipped("data_datamap", "connect_failed");
+        return;
+    }
+    seL4_CPtr window = 0;
+    seL4_Word vaddr = walloc(1, &window);
+    if (!vaddr || !window) {
+        serv_disconnect(&c);
+        bench_report_skipped("data_open", "walloc_failed");
+        bench_report_skipped("data_datamap", "walloc_failed");
+        return;
+    }
+
+    bench_reset(ro, "data_open", BENCH_UNIT_CYCLES);
+    bench_reset(rm, "data_datamap", BENCH_UNIT_CYCLES);
+    for (int i = 0; i < BENCH_WARMUP + BENCH_DATASPACE_ITERATIONS; i++) {
+        int error = EINVALID;
+        ccnt_t start = bench_cycles();
+        seL4_CPtr dspace = data_open(c.serverSession, BENCH_FILE_DSPACE, O_RDONLY, O_RDONLY, 0,
+                                     &error);
+        uint64_t topen = bench_cycles_since(start);
+        if (error != ESUCCESS || !dspace) {
+            break;
+        }
+
+        start = bench_cycles();
+        error = data_datamap(c.serverSession, dspace, window, 0);
+        uint64_t tmap = bench_cycles_since(start);
+
+        if (error == ESUCCESS) {
+            data_dataunmap(c.serverSession, window);
+        }
+        data_close(c.serverSession, dspace);
+        csfree_delete(dspace);
+        if (error != ESUCCESS) {
+            break;
+        }
+        if (i >= BENCH_WARMUP) {
+            bench_add(ro, topen);
+            bench_add(rm, tmap);
+        }
+    }
+
+    walloc_free(vaddr, 1);
+    serv_disconnect(&c);
+    bench_report(ro);
+    bench_report(rm);
+}
+
+/* ------------------------------------ File IO ------------------------------------------------- */
+
+/*! @brief Time read() calls of a given size, sequentially through the benchmark file.
+    @param name The benchmark name.
+    @param size The size of each read.
+*/
+static void
+bench_read_size(const char *name, size_t size)
+{
+    struct bench_result *r = &benchResult;
+    assert(size <= sizeof(benchReadBuffer));
+    int fd = open(BENCH_FILE, O_RDONLY);
+    if (fd < 0) {
+        bench_report_skipped(name, "no_bench_file");
+        return;
+    }
+
+    bench_reset(r, name, BENCH_UNIT_CYCLES);
+    for (int i = 0; i < BENCH_WARMUP + BENCH_READ_ITERATIONS; i++) {
+        ccnt_t start = bench_cycles();
+        int n = read(fd, benchReadBuffer, size);
+        uint64_t t = bench_cycles_since(start);
+        if (n < (int) size) {
+            /* Wrapped around the end of the file; this sample is short, so drop it. */
+            lseek(fd, 0, SEEK_SET);
+            continue;
+        }
+        if (i >= BENCH_WARMUP) {
+            bench_add(r, t);
+        }
+    }
+    close(fd);
+    bench_report(r);
+}
+
+static void
+bench_read(void)
+{
+    bench_read_size("read_64", 64);
+    bench_read_size("read_512", 512);
+    bench_read_size("read_4096", 4096);
+    bench_read_size("read_32768", 32768);
+}
+
+/* ------------------------------------ Timer --------------------------------------------------- */
+
+static uint64_t
+bench_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec * 1000000000ULL) + (uint64_t) ts.tv_nsec;
+}
+
+/*! @brief Measure how long nanosleep() actually sleeps for, in nanoseconds, as seen by the timer
+           server's monotonic clock.
+    @param name The benchmark name.
+    @param ns The requested sleep length.
+*/
+static void
+bench_nanosleep_ns(const char *name, uint64_t ns)
+{
+    struct bench_result *r = &benchResult;
+    struct timespec req = { .tv_sec = ns / 1000000000ULL, .tv_nsec = ns % 1000000000ULL };
+
+    bench_reset(r, name, BENCH_UNIT_NS);
+    for (int i = 0; i < BENCH_SLEEP_ITERATIONS; i++) {
+        uint64_t start = bench_time_ns();
+        nanosleep(&req, NULL);
+        bench_add(r, bench_time_ns() - start);
+    }
+    bench_report(r);
+}
+
+static void
+bench_nanosleep(void)
+{
+    bench_nanosleep_ns("nanosleep_1ms", 1000000ULL);
+    bench_nanosleep_ns("nanosleep_10ms", 10000000ULL);
+}
+
+/* ------------------------------------ Heap ---------------------------------------------------- */
+
+static void
+bench_malloc_growth(void)
+{
+    struct bench_result *r = &benchResult;
+    static char *blocks[BENCH_MALLOC_ITERATIONS];
+
+    /* Each block is allocated without freeing the last, so the heap keeps growing. Touch each
+       block so the cost of faulting the new heap pages in is part of the sample. */
+    bench_reset(r, "malloc_16k_grow", BENCH_UNIT_CYCLES);
+    for (int i = 0; i < BENCH_MALLOC_ITERATIONS; i++) {
+        ccnt_t start = bench_cycles();
+        blocks[i] = malloc(BENCH_MALLOC_SIZE);
+        if (blocks[i]) {
+            memset(blocks[i], 0, BENCH_MALLOC_SIZE);
+        }
+        uint64_t t = bench_cycles_since(start);
+        if (!blocks[i]) {
+            break;
+        }
+        bench_add(r, t);
+    }
+    for (int i = 0; i < BENCH_MALLOC_ITERATIONS; i++) {
+        free(blocks[i]);
+        blocks[i] = NULL;
+    }
+    bench_report(r);
+}
+
+/* ------------------------------------ Windows ------------------------------------------------- */
+
+static void
+bench_window_many(void)
+{
+    struct bench_result *rc = &benchResult;
+    struct bench_result *rd = &benchResult2;
+    int n = 0;
+
+    /* Every window is a reservation in our vspace on the process server. Time creating and
+       deleting windows once thousands of them exist, which is where the cost of looking up
+       reservations shows. Windows are deleted every other one first, so lookups don't just hit
+       one end of the vspace. */
+    bench_reset(rc, "window_create_many", BENCH_UNIT_CYCLES);
+    bench_reset(rd, "window_delete_many", BENCH_UNIT_CYCLES);
+    for (; n < BENCH_WINDOW_COUNT; n++) {
+        seL4_CPtr window = 0;
+        ccnt_t start = bench_cycles();
+        benchWindowAddr[n] = walloc(1, &window);
+        uint64_t t = bench_cycles_since(start);
+        if (!benchWindowAddr[n]) {
+            break;
+        }
+        if (n >= BENCH_WINDOW_COUNT - BENCH_MAX_SAMPLES) {
+            bench_add(rc, t);
+        }
+    }
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = pass; i < n; i += 2) {
+            ccnt_t start = bench_cycles();
+            walloc_free(benchWindowAddr[i], 1);
+            uint64_t t = bench_cycles_since(start);
+            if (pass == 0) {
+                bench_add(rd, t);
+            }
+        }
+    }
+    if (n != BENCH_WINDOW_COUNT) {
+        bench_report_skipped("window_create_many", "walloc_failed");
+        bench_report_skipped("window_delete_many", "walloc_failed");
+        return;
+    }
+    bench_report(rc);
+    bench_report(rd);
+}
+
+/* ------------------------------------ Memory copies ------------------------------------------- */
+
+enum bench_memop {
+    BENCH_MEMCPY,
+    BENCH_MEMMOVE,
+    BENCH_MEMSET
+};
+
+/*! @brief Time a libc memory operation, warm in the cache.
+    @param name The benchmark name.
+    @param op The operation to time.
+    @param size The number of bytes per call.
+    @param srcOffset Source offset from a 64 byte boundary. For memmove, the source is the
+                     destination buffer, so that the two overlap.
+    @param destOffset Destination offset from a 64 byte boundary.
+*/
+static void
+bench_memop(const char *name, enum bench_memop op, size_t size, int srcOffset, int destOffset)
+{
+    struct bench_result *r = &benchResult;
+    char *dest = benchMemopsDest + destOffset;
+    char *src = (op == BENCH_MEMMOVE ? benchMemopsDest : benchMemopsSrc) + srcOffset;
+    assert(size + srcOffset <= sizeof(benchMemopsSrc));
+    assert(size + destOffset <= sizeof(benchMemopsDest));
+
+    bench_reset(r, name, BENCH_UNIT_CYCLES);
+    for (int i = 0; i < BENCH_WARMUP + BENCH_MEMOPS_ITERATIONS; i++) {
+        ccnt_t start = bench_cycles();
+        switch (op) {
+        case BENCH_MEMCPY:
+            memcpy(dest, src, size);
+            break;
+        case BENCH_MEMMOVE:
+            memmove(dest, src, size);
+            break;
+        case BENCH_MEMSET:
+            memset(dest, i, size);
+            break;
+        }
+        uint64_t t = bench_cycles_since(start);
+        if (i >= BENCH_WARMUP) {
+            bench_add(r, t);
+        }
+    }
+    bench_report(r);
+}
+
+static void
+bench_memops(void)
+{
+    /* Build once with and once without CONFIG_LIB_MUSL_C_NEON_MEMOPS and compare the two runs
+       with bench_compare.py to compare the libc variants. */
+    memset(benchMemopsSrc, 0x5A, sizeof(benchMemopsSrc));
+    bench_memop("memcpy_64", BENCH_MEMCPY, 64, 0, 0);
+    bench_memop("memcpy_1k", BENCH_MEMCPY, 1024, 0, 0);
+    bench_memop("memcpy_4k", BENCH_MEMCPY, 4096, 0, 0);
+    bench_memop("memcpy_4k_unaligned", BENCH_MEMCPY, 4096, 3, 9);
+    bench_memop("memcpy_64k", BENCH_MEMCPY, BENCH_MEMOPS_MAX_SIZE, 0, 0);
+    bench_memop("memmove_4k_overlap", BENCH_MEMMOVE, 4096, 0, 32);
+    bench_memop("memset_64", BENCH_MEMSET, 64, 0, 0);
+    bench_memop("memset_4k", BENCH_MEMSET, 4096, 0, 0);
+    bench_memop("memset_64k", BENCH_MEMSET, BENCH_MEMOPS_MAX_SIZE, 0, 0);
+}
+
+/* ------------------------------------ Synchronisation ----------------------------------------- */
+
+static sync_mutex_t benchSyncMutex;
+static sync_sem_t benchSyncPing;
+static sync_sem_t benchSyncPong;
+static volatile int benchSyncStop;
+
+/*! @brief Helper thread which answers every ping with a pong. */
+static void *
+bench_sync_pong_func(void *arg)
+{
+    for (int i = 0; i < BENCH_WARMUP + BENCH_SYNC_ITERATIONS; i++) {
+        sync_sem_wait(benchSyncPing);
+        sync_sem_post(benchSyncPong);
+    }
+    return arg;
+}
+
+/*! @brief Helper thread which keeps taking the mutex, and yields while holding it. */
+static void *
+bench_sync_hog_func(void *arg)
+{
+    while (!benchSyncStop) {
+        sync_acquire(benchSyncMutex);
+        sched_yield();
+        sync_release(benchSyncMutex);
+    }
+    return arg;
+}
+
+static void
+bench_sync(void)
+{
+    struct bench_result *r = &benchResult;
+    pthread_t thread;
+
+    benchSyncMutex = sync_create_mutex();
+    benchSyncPing = sync_create_sem(0);
+    benchSyncPong = sync_create_sem(0);
+    if (!benchSyncMutex || !benchSyncPing || !benchSyncPong) {
+        bench_report_skipped("sync_mutex_uncontended", "no_sync");
+        bench_report_skipped("sync_sem_uncontended", "no_sync");
+        bench_report_skipped("sync_sem_pingpong", "no_sync");
+        bench_report_skipped("sync_mutex_contended", "no_sync");
+        return;
+    }
+
+    /* An acquire and release pair nobody else wants; should never enter the kernel. */
+    bench_reset(r, "sync_mutex_uncontended", BENCH_UNIT_CYCLES);
+    for (int i = 0; i < BENCH_WARMUP + BENCH_SYNC_ITERATIONS; i++) {
+        ccnt_t start = bench_cycles();
+        sync_acquire(benchSyncMutex);
+        sync_release(benchSyncMutex);
+        uint64_t t = bench_cycles_since(start);
+        if (i >= BENCH_WARMUP) {
+            bench_add(r, t);
+        }
+    }
+    bench_report(r);
+
+    bench_reset(r, "sync_sem_uncontended", BENCH_UNIT_CYCLES);
+    for (int i = 0; i < BENCH_WARMUP + BENCH_SYNC_ITERATIONS; i++) {
+        ccnt_t start = bench_cycles();
+        sync_sem_post(benchSyncPing);
+        sync_sem_wait(benchSyncPing);
+        uint64_t t = bench_cycles_since(start);
+        if (i >= BENCH_WARMUP) {
+            bench_add(r, t);
+        }
+    }
+    bench_report(r);
+
+    /* A round trip to another thread through two semaphores, blocking on both. */
+    bench_reset(r, "sync_sem_pingpong", BENCH_UNIT_CYCLES);
+    if (pthread_create(&thread, NULL, bench_sync_pong_func, NULL) == 0) {
+        for (int i = 0; i < BENCH_WARMUP + BENCH_SYNC_ITERATIONS; i++) {
+            ccnt_t start = bench_cycles();
+            sync_sem_post(benchSyncPing);
+            sync_sem_wait(benchSyncPong);
+            uint64_t t = bench_cycles_since(start);
+            if (i >= BENCH_WARMUP) {
+                bench_add(r, t);
+            }
+        }
+        pthread_join(thread, NULL);
+    }
+    bench_report(r);
+
+    /* Taking the mutex from another thread that holds it, so every acquire blocks and every
+       release hands the lock over. */
+    bench_reset(r, "sync_mutex_contended", BENCH_UNIT_CYCLES);
+    benchSyncStop = 0;
+    if (pthread_create(&thread, NULL, bench_sync_hog_func, NULL) == 0) {
+        for (int i = 0; i < BENCH_WARMUP + BENCH_SYNC_ITERATIONS; i++) {
+            ccnt_t start = bench_cycles();
+            sync_acquire(benchSyncMutex);
+            sync_release(benchSyncMutex);
+            uint64_t t = bench_cycles_since(start);
+            if (i >= BENCH_WARMUP) {
+                bench_add(r, t);
+            }
+            sched_yield();
+        }
+        benchSyncStop = 1;
+        pthread_join(thread, NULL);
+    }
+    bench_report(r);
+
+    sync_destroy_sem(benchSyncPong);
+    sync_destroy_sem(benchSyncPing);
+    sync_destroy_mutex(benchSyncMutex);
+}
+
+/* ------------------------------------ Processes ----------------------------------------------- */
+
+static void
+bench_spawn(void)
+{
+    struct bench_result *r = &benchResult;
+
+    /* Each sample covers loading, running and tearing down a whole child process. */
+    bench_reset(r, "proc_spawn", BENCH_UNIT_CYCLES);
+    for (int i = 0; i < BENCH_SPAWN_ITERATIONS; i++) {
+        int32_t status = 0;
+        ccnt_t start = bench_cycles();
+        int error = proc_new_proc(BENCH_APPNAME, BENCH_CHILD_ARG, true, 70, &status);
+        uint64_t t = bench_cycles_since(start);
+        if (error != ESUCCESS || status != BENCH_SPAWN_EXIT_STATUS) {
+            break;
+        }
+        bench_add(r, t);
+    }
+    bench_report(r);
+}
+
+/*! @brief Replace the contents of a file on the file server. */
+static int
+bench_file_put(const char *path, const char *str)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC);
+    if (fd < 0) {
+        return EFILENOTFOUND;
+    }
+    int n = write(fd, str, strlen(str));
+    close(fd);
+    return (n == (int) strlen(str)) ? ESUCCESS : EINVALID;
+}
+
+/*! @brief Read a small file from the file server into a NULL terminated buffer.
+    @return The number of bytes read, or -1 if the file could not be opened.
+*/
+static int
+bench_file_get(const char *path, char *buf, int len)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    int n = read(fd, buf, len - 1);
+    close(fd);
+    buf[(n > 0) ? n : 0] = '\0';
+    return n;
+}
+
+/*! @brief Whether the concurrent spawn benchmark is holding its children. */
+static bool
+bench_spawn_held(void)
+{
+    char buf[4];
+    return bench_file_get(BENCH_SPAWN_HOLD_FILE, buf, sizeof(buf)) > 0 && buf[0] == '1';
+}
+
+/*! @brief Run by a spawn child. If the concurrent spawn benchmark is holding its children, check
+           in with the time this child got to run, then wait for the hold to be lifted. */
+static void
+bench_spawn_child_hold(void)
+{
+    refos_mem_stats_t self;
+    char path[64];
+    char buf[32];
+    if (!bench_spawn_held() || proc_get_mem_stats(0, &self) != ESUCCESS) {
+        return;
+    }
+
+    snprintf(path, sizeof(path), BENCH_SPAWN_READY_FILE, self.pid);
+    snprintf(buf, sizeof(buf), "%llu", (unsigned long long) bench_time_ns());
+    if (bench_file_put(path, buf) != ESUCCESS) {
+        return;
+    }
+    struct timespec req = { .tv_sec = 0, .tv_nsec = BENCH_SPAWN_POLL_NS };
+    for (int i = 0; i < BENCH_SPAWN_POLL_TRIES && bench_spawn_held(); i++) {
+        nanosleep(&req, NULL);
+    }
+}
+
+/*! @brief Wait for a held spawn child to check in.
+    @return The time the child got to run, or 0 if it never checked in.
+*/
+static uint64_t
+bench_spawn_wait_ready(uint32_t pid)
+{
+    char path[64];
+    char buf[32];
+    struct timespec req = { .tv_sec = 0, .tv_nsec = BENCH_SPAWN_POLL_NS };
+    snprintf(path, sizeof(path), BENCH_SPAWN_READY_FILE, pid);
+    for (int i = 0; i < BENCH_SPAWN_POLL_TRIES; i++) {
+        if (bench_file_get(path, buf, sizeof(buf)) > 0) {
+            uint64_t t = strtoull(buf, NULL, 10);
+            if (t != 0) {
+                bench_file_put(path, "0");
+                return t;
+            }
+        }
+        nanosleep(&req, NULL);
+    }
+    return 0;
+}
+
+/*! @brief Find the live spawn children of this process.
+    @return The number of children found, at most max.
+*/
+static int
+bench_spawn_find_children(refos_mem_stats_t *self, refos_mem_stats_t *children, int max)
+{
+    int n = 0;
+    for (int pid = 1; pid < PROCSERV_MAX_PROCESSES && n < max; pid++) {
+        if (pid == self->pid || proc_get_mem_stats(pid, &children[n]) != ESUCCESS) {
+            continue;
+        }
+        if (children[n].parentPID == self->pid &&
+                !strncmp(children[n].name, self->name, REFOS_MEM_STATS_NAME_LEN)) {
+            n++;
+        }
+    }
+    return n;
+}
+
+static void
+bench_spawn_concurrent(void)
+{
+    struct bench_result *rt = &benchResult;
+    struct bench_result *rm = &benchResult2;
+    refos_mem_stats_t self;
+    refos_mem_stats_t children[BENCH_SPAWN_CONCURRENT];
+
+    if (proc_get_mem_stats(0, &self) != ESUCCESS ||
+            bench_file_put(BENCH_SPAWN_HOLD_FILE, "0") != ESUCCESS) {
+        bench_report_skipped("proc_spawn_concurrent", "no_ramfs");
+        bench_report_skipped("proc_spawn_concurrent_rss", "no_ramfs");
+        return;
+    }
+
+    /* Each time sample covers starting several copies of the same program at once, until the
+       last of them runs. The memory sample is what those copies hold resident between them, so
+       it shows how much of a program instances share. */
+    bench_reset(rt, "proc_spawn_concurrent", BENCH_UNIT_NS);
+    bench_reset(rm, "proc_spawn_concurrent_rss", BENCH_UNIT_KB);
+    for (int i = 0; i < BENCH_SPAWN_CONCURRENT_ITERATIONS; i++) {
+        if (bench_file_put(BENCH_SPAWN_HOLD_FILE, "1") != ESUCCESS) {
+            break;
+        }
+        uint64_t start = bench_time_ns();
+        int spawned = 0;
+        for (; spawned < BENCH_SPAWN_CONCURRENT; spawned++) {
+            int32_t status = 0;
+            if (proc_new_proc(BENCH_APPNAME, BENCH_CHILD_ARG, false, 70, &status) != ESUCCESS) {
+                break;
+            }
+        }
+
+        int n = bench_spawn_find_children(&self, children, BENCH_SPAWN_CONCURRENT);
+        uint64_t last = 0;
+        for (int j = 0; j < n; j++) {
+            uint64_t t = bench_spawn_wait_ready(children[j].pid);
+            last = (t > last) ? t : last;
+        }
+        uint32_t residentFrames = 0;
+        for (int j = 0; j < n; j++) {
+            if (proc_get_mem_stats(children[j].pid, &children[j]) == ESUCCESS) {
+                residentFrames += children[j].residentFrames;
+            }
+        }
+
+        /* Let the children go, and wait for them to exit before the next round. */
+        bench_file_put(BENCH_SPAWN_HOLD_FILE, "0");
+        struct timespec req = { .tv_sec = 0, .tv_nsec = BENCH_SPAWN_POLL_NS };
+        for (int j = 0; j < BENCH_SPAWN_POLL_TRIES &&
+                bench_spawn_find_children(&self, children, BENCH_SPAWN_CONCURRENT) > 0; j++) {
+            nanosleep(&req, NULL);
+        }
+
+        if (spawned != BENCH_SPAWN_CONCURRENT || n != spawned || last < start) {
+            break;
+        }
+        bench_add(rt, last - start);
+        bench_add(rm, residentFrames * (REFOS_PAGE_SIZE / 1024));
+    }
+    bench_report(rt);
+    bench_report(rm);
+}
+
+/*! @brief Run by a spawn child. If the exit benchmark is running, touch a sparse set of pages in
+           a large anonymous heap, then record the time this child is about to exit. The heap is
+           left mapped, for process teardown to clean up. */
+static void
+bench_exit_child_sparse(void)
+{
+    char buf[32];
+    if (bench_file_get(BENCH_EXIT_FILE, buf, sizeof(buf)) <= 0 || buf[0] != '1') {
+        return;
+    }
+    data_mapping_t heap = data_open_map(REFOS_PROCSERV_EP, "anon", 0x0, 0,
+            BENCH_EXIT_HEAP_SIZE, -1);
+    if (heap.err != ESUCCESS) {
+        return;
+    }
+    for (uint32_t off = 0; off < BENCH_EXIT_HEAP_SIZE; off += BENCH_EXIT_HEAP_STRIDE) {
+        volatile char *p = heap.vaddr + off;
+        *p = (char) off;
+    }
+    snprintf(buf, sizeof(buf), "%llu", (unsigned long long) bench_time_ns());
+    bench_file_put(BENCH_EXIT_FILE, buf);
+}
+
+static void
+bench_exit_sparse(void)
+{
+    struct bench_result *r = &benchResult;
+    char buf[32];
+
+    if (bench_file_put(BENCH_EXIT_FILE, "0") != ESUCCESS) {
+        bench_report_skipped("proc_exit_sparse", "no_ramfs");
+        return;
+    }
+
+    /* Each sample runs from a child with a large sparse heap stamping its exit, until the process
+       server has finished tearing it down. The process server handles one request at a time, so
+       once a ping gets through after the child is reaped, the teardown is done. */
+    bench_reset(r, "proc_exit_sparse", BENCH_UNIT_NS);
+    for (int i = 0; i < BENCH_EXIT_ITERATIONS; i++) {
+        int32_t status = 0;
+        if (bench_file_put(BENCH_EXIT_FILE, "1") != ESUCCESS) {
+            break;
+        }
+        int error = proc_new_proc(BENCH_APPNAME, BENCH_CHILD_ARG, true, 70, &status);
+        proc_ping();
+        uint64_t end = bench_time_ns();
+        if (error != ESUCCESS || status != BENCH_SPAWN_EXIT_STATUS ||
+                bench_file_get(BENCH_EXIT_FILE, buf, sizeof(buf)) <= 0) {
+            break;
+        }
+        uint64_t start = strtoull(buf, NULL, 10);
+        if (start <= 1 || start > end) {
+            break;
+        }
+        bench_add(r, end - start);
+    }
+    bench_file_put(BENCH_EXIT_FILE, "0");
+    bench_report(r);
+}
+
+/* ------------------------------------ Network ------------------------------------------------- */
+
+#ifdef CONFIG_APP_NET_SERVER
+
+static void
+bench_net_addr(struct sockaddr_in *sin)
+{
+    memset(sin, 0, sizeof(struct sockaddr_in));
+    sin->sin_family = AF_INET;
+    sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sin->sin_port = htons(BENCH_NET_PORT);
+}
+
+/*! @brief Write all of a buffer to a stream socket.
+    @return 0 on success, -1 if the connection broke.
+*/
+static int
+bench_net_write_all(int fd, const char *buf, int len)
+{
+    for (int off = 0; off < len;) {
+        int n = write(fd, buf + off, len - off);
+        if (n <= 0) {
+            return -1;
+        }
+        off += n;
+    }
+    return 0;
+}
+
+/*! @brief Read exactly len bytes from a stream socket.
+    @return 0 on success, -1 if the connection broke.
+*/
+static int
+bench_net_read_all(int fd, char *buf, int len)
+{
+    for (int off = 0; off < len;) {
+        int n = read(fd, buf + off, len - off);
+        if (n <= 0) {
+            return -1;
+        }
+        off += n;
+    }
+    return 0;
+}
+
+/*! @brief Run by a spawn child. If the network benchmark is running, serve one echo connection,
+           then BENCH_NET_STREAM_ITERATIONS sink connections, which are acknowledged with a single
+           byte once the parent has shut down its side. */
+static void
+bench_net_child(void)
+{
+    char buf[BENCH_NET_MSG_LEN];
+    struct sockaddr_in addr;
+    if (bench_file_get(BENCH_NET_FILE, buf, sizeof(buf)) <= 0 || buf[0] != '1') {
+        return;
+    }
+
+    bench_net_addr(&addr);
+    int ls = socket(AF_INET, SOCK_STREAM, 0);
+    if (ls < 0 || bind(ls, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(ls, 1) != 0) {
+        return;
+    }
+    bench_file_put(BENCH_NET_FILE, "2");
+
+    int s = accept(ls, NULL, NULL);
+    if (s >= 0) {
+        int n;
+        while ((n = read(s, buf, sizeof(buf))) > 0 && bench_net_write_all(s, buf, n) == 0);
+        close(s);
+    }
+    for (int i = 0; i < BENCH_NET_STREAM_ITERATIONS; i++) {
+        s = accept(ls, NULL, NULL);
+        if (s < 0) {
+            break;
+        }
+        while (read(s, benchNetBuffer, BENCH_NET_STREAM_CHUNK) > 0);
+        write(s, "k", 1);
+        close(s);
+    }
+    close(ls);
+}
+
+static int
+bench_net_connect(void)
+{
+    struct sockaddr_in addr;
+    bench_net_addr(&addr);
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+    if (s < 0) {
+        return -1;
+    }
+    if (connect(s, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+        close(s);
+        return -1;
+    }
+    return s;
+}
+
+static void
+bench_net(void)
+{
+    struct bench_result *r = &benchResult;
+    refos_mem_stats_t self;
+    refos_mem_stats_t child;
+    char buf[BENCH_NET_MSG_LEN];
+    int32_t status = 0;
+
+    if (proc_get_mem_stats(0, &self) != ESUCCESS ||
+            bench_file_put(BENCH_NET_FILE, "1") != ESUCCESS) {
+        bench_report_skipped("net_stream_rtt_64", "no_ramfs");
+        bench_report_skipped("net_stream_1mb", "no_ramfs");
+        return;
+    }
+
+    /* Start the peer, and wait for it to be listening. */
+    bool ready = false;
+    struct timespec req = { .tv_sec = 0, .tv_nsec = BENCH_SPAWN_POLL_NS };
+    if (proc_new_proc(BENCH_APPNAME, BENCH_CHILD_ARG, false, 70, &status) == ESUCCESS) {
+        for (int i = 0; i < BENCH_SPAWN_POLL_TRIES && !ready; i++) {
+            ready = bench_file_get(BENCH_NET_FILE, buf, sizeof(buf)) > 0 && buf[0] == '2';
+            if (!ready) {
+                nanosleep(&req, NULL);
+            }
+        }
+    }
+    int s = ready ? bench_net_connect() : -1;
+    if (s < 0) {
+        bench_file_put(BENCH_NET_FILE, "0");
+        bench_report_skipped("net_stream_rtt_64", "no_netserv");
+        bench_report_skipped("net_stream_1mb", "no_netserv");
+        return;
+    }
+
+    /* Round trip of a small message through the peer process and back. Each direction goes
+       through both processes' rings and one doorbell to the network server. */
+    memset(buf, 'n', sizeof(buf));
+    bench_reset(r, "net_stream_rtt_64", BENCH_UNIT_CYCLES);
+    for (int i = 0; i < BENCH_WARMUP + BENCH_NET_ITERATIONS; i++) {
+        ccnt_t start = bench_cycles();
+        if (bench_net_write_all(s, buf, BENCH_NET_MSG_LEN) != 0 ||
+                bench_net_read_all(s, buf, BENCH_NET_MSG_LEN) != 0) {
+            break;
+        }
+        uint64_t t = bench_cycles_since(start);
+        if (i >= BENCH_WARMUP) {
+            bench_add(r, t);
+        }
+    }
+    bench_report(r);
+    close(s);
+
+    /* Bulk transfer to the peer, timed until it has seen all of it. */
+    memset(benchNetBuffer, 'b', BENCH_NET_STREAM_CHUNK);
+    bench_reset(r, "net_stream_1mb", BENCH_UNIT_NS);
+    for (int i = 0; i < BENCH_NET_STREAM_ITERATIONS; i++) {
+        s = bench_net_connect();
+        if (s < 0) {
+            break;
+        }
+        uint64_t start = bench_time_ns();
+        int error = 0;
+        for (int off = 0; off < BENCH_NET_STREAM_SIZE && !error; off += BENCH_NET_STREAM_CHUNK) {
+            error = bench_net_write_all(s, benchNetBuffer, BENCH_NET_STREAM_CHUNK);
+        }
+        if (!error) {
+            shutdown(s, SHUT_WR);
+            error = bench_net_read_all(s, buf, 1);
+        }
+        uint64_t t = bench_time_ns() - start;
+        close(s);
+        if (error) {
+            break;
+        }
+        bench_add(r, t);
+    }
+    bench_report(r);
+
+    /* Wait for the peer to exit before moving on. */
+    bench_file_put(BENCH_NET_FILE, "0");
+    for (int i = 0; i < BENCH_SPAWN_POLL_TRIES &&
+            bench_spawn_find_children(&self, &child, 1) > 0; i++) {
+        nanosleep(&req, NULL);
+    }
+}
+
+#else
+
+static void
+bench_net_child(void)
+{
+}
+
+static void
+bench_net(void)
+{
+    bench_report_skipped("net_stream_rtt_64", "no_netserv");
+    bench_report_skipped("net_stream_1mb", "no_netserv");
+}
+
+#endif /* CONFIG_APP_NET_SERVER */
+
+/* ------------------------------------ Console ------------------------------------------------- */
+
+/*! @brief Fill a console line, numbered so that dropped or mixed up lines can be spotted. */
+static void
+bench_console_line(char *line, int n)
+{
+    memset(line, '.', BENCH_CONSOLE_LINE_LEN);
+    snprintf(line, BENCH_CONSOLE_LINE_LEN, "bench_os console %05d ", n);
+    line[strlen(line)] = '.';
+    line[BENCH_CONSOLE_LINE_LEN - 1] = '\n';
+}
+
+static void
+bench_console(void)
+{
+    struct bench_result *r = &benchResult;
+    char line[BENCH_CONSOLE_LINE_LEN];
+
+    /* Client-visible latency of writing a single line to stdout. */
+    bench_reset(r, "console_write_64", BENCH_UNIT_CYCLES);
+    for (int i = 0; i < BENCH_WARMUP + BENCH_CONSOLE_ITERATIONS; i++) {
+        bench_console_line(line, i);
+        ccnt_t start = bench_cycles();
+        int n = write(STDOUT_FILENO, line, BENCH_CONSOLE_LINE_LEN);
+        uint64_t t = bench_cycles_since(start);
+        if (n != BENCH_CONSOLE_LINE_LEN) {
+            break;
+        }
+        if (i >= BENCH_WARMUP) {
+            bench_add(r, t);
+        }
+    }
+    bench_report(r);
+
+    /* Flood stdout with bursts of lines larger than the Console server will buffer, so this
+       measures how fast output actually reaches the serial device. */
+    bench_reset(r, "console_flood_4k", BENCH_UNIT_CYCLES);
+    for (int i = 0; i < BENCH_CONSOLE_FLOOD_ITERATIONS; i++) {
+        ccnt_t start = bench_cycles();
+        for (int j = 0; j < BENCH_CONSOLE_FLOOD_LINES; j++) {
+            bench_console_line(line, j);
+            write(STDOUT_FILENO, line, BENCH_CONSOLE_LINE_LEN);
+        }
+        bench_add(r, bench_cycles_since(start));
+    }
+    bench_report(r);
+}
+
+/* ------------------------------------ Virtual terminal ---------------------------------------- */
+
+#ifdef CONFIG_LIB_VTERM
+
+static char benchVTermText[BENCH_VTERM_TEXT_SIZE];
+
+/*! @brief Fill the text buffer with lines of printable ASCII, some of them coloured, much like the
+           output the Console server has to render. Returns the length used. */
+static int
+bench_vterm_text(void)
+{
+    uint32_t seed = 1;
+    int len = 0;
+    while (len < BENCH_VTERM_TEXT_SIZE - BENCH_VTERM_COLS * 2) {
+        seed = seed * 1103515245 + 12345;
+        if ((seed >> 16) % 4 == 0) {
+            len += sprintf(benchVTermText + len, "\x1b[3%dm", (int) ((seed >> 20) % 8));
+        }
+        int n = 20 + (seed >> 16) % (BENCH_VTERM_COLS + 20);
+        for (int i = 0; i < n; i++) {
+            seed = seed * 1103515245 + 12345;
+            benchVTermText[len++] = 0x20 + (seed >> 16) % 95;
+        }
+        if ((seed >> 24) % 4 == 0) {
+            len += sprintf(benchVTermText + len, "\x1b[0m");
+        }
+        benchVTermText[len++] = '\r';
+        benchVTermText[len++] = '\n';
+    }
+    return len;
+}
+
+static void
+bench_vterm_run(const char *name, int len, bool fastPath)
+{
+    struct bench_result *r = &benchResult;
+    VTerm *vt = vterm_new(BENCH_VTERM_ROWS, BENCH_VTERM_COLS);
+    if (!vt) {
+        bench_report_skipped(name, "vterm_new_failed");
+        return;
+    }
+    vterm_parser_set_utf8(vt, true);
+    VTermScreen *vts = vterm_obtain_screen(vt);
+    vterm_state_set_text_fastpath(vterm_obtain_state(vt), fastPath);
+    vterm_screen_reset(vts, 1);
+
+    bench_reset(r, name, BENCH_UNIT_NS);
+    for (int i = 0; i < 1 + BENCH_VTERM_ITERATIONS; i++) {
+        uint64_t start = bench_time_ns();
+        for (int pos = 0; pos < len; pos += BENCH_VTERM_CHUNK) {
+            int n = len - pos < BENCH_VTERM_CHUNK ? len - pos : BENCH_VTERM_CHUNK;
+            vterm_push_bytes(vt, benchVTermText + pos, n);
+        }
+        uint64_t t = bench_time_ns() - start;
+        if (i >= 1) {
+            bench_add(r, t);
+        }
+    }
+    bench_report(r);
+    vterm_free(vt);
+}
+
+/*! @brief Time libvterm parsing and rendering a block of mostly plain text into its screen buffer,
+           with and without the ASCII text fast path. No terminal I/O is involved. */
+static void
+bench_vterm(void)
+{
+    int len = bench_vterm_text();
+    bench_vterm_run("vterm_text_256k_slow", len, false);
+    bench_vterm_run("vterm_text_256k", len, true);
+}
+
+#else
+
+static void
+bench_vterm(void)
+{
+    bench_report_skipped("vterm_text_256k_slow", "no_libvterm");
+    bench_report_skipped("vterm_text_256k", "no_libvterm");
+}
+
+#endif /* CONFIG_LIB_VTERM */
+
+/* ------------------------------------ Main ---------------------------------------------------- */
+
+static void
+bench_run(void)
+{
+    bench_begin_report();
+    bench_rpc_procserv();
+    bench_rpc_server("rpc_null_fileserv", "fileserv/*");
+    bench_rpc_server("rpc_null_conserv", "dev_console/*");
+    bench_rpc_server("rpc_null_timeserv", "dev_timer/*");
+    bench_fault_anon();
+    bench_fault_file();
+    bench_dataspace_open_map();
+    bench_window_many();
+    bench_read();
+    bench_nanosleep();
+    bench_malloc_growth();
+    bench_memops();
+    bench_sync();
+    bench_spawn();
+    bench_spawn_concurrent();
+    bench_exit_sparse();
+    bench_net();
+    bench_console();
+    bench_vterm();
+    bench_end_report();
+}
+
+int
+main(int argc, char **argv)
+{
+    /* Future Work 3:
+       How the selfloader bootstraps user processes needs to be modified further. See
+       test_user for details. */
+    uintptr_t address = strtoll(getenv("SYSTABLE"), NULL, 16);
+    refos_init_selfload_child(address);
+    refos_initialise();
+
+    if (argc > 1 && !strcmp(argv[1], BENCH_CHILD_ARG)) {
+        bench_spawn_child_hold();
+        bench_exit_child_sparse();
+        bench_net_child();
+        return BENCH_SPAWN_EXIT_STATUS;
+    }
+
+    bench_init();
+    bench_run();
+    return 0;
+}
@@ -114,6 +114,7 @@ console_server_mainloop(void)
     while (1) {
         msg.message = seL4_Recv(conServCommon->anonEP, &msg.badge);
         console_server_handle_message(s, &msg);
+        output_poll(&s->devOutput);
         client_table_postaction(&conServCommon->clientTable);
     }
 }
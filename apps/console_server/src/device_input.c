@@ -14,6 +14,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 #include <assert.h>
 #include <autoconf.h>
 
@@ -37,15 +38,43 @@
     to be recieved, the Console server must block the calling client until an RX irq comes in from the
     input device. This is implemented using seL4_SaveCaller functionality, saving the reply endpoint
     capability into a 'waiting list'. Whenever we recieve an IRQ, we go through this waiting list
-    and reply to any waiters, unblocking their syscall.
+    and reply to any waiters, unblocking their syscall. A read() waiter is replied to with as many
+    characters as are available, up to the size of its buffer.
+
+    Clients which would rather not block in here (to wait on several things at once) use
+    data_poll() instead, which puts a notification endpoint on the polling list. Once there is
+    input left over after the waiters have had theirs, every poller is signalled and dropped.
+
+    The line discipline is a small subset of a UNIX tty's, set with data_ioctl(). In raw mode
+    (the default) characters go straight into the backlog. In canonical mode (REFOS_LFLAG_ICANON)
+    characters are collected into a line, which may be edited with backspace, and only become
+    readable once return is pressed; read() then returns no more than one line at a time. With
+    REFOS_LFLAG_ECHO set, typed characters are echoed back out through the device_output module.
 */
 
-/*! @brief Add a new character onto the getchar queue.
+#define INPUT_CHAR_BACKSPACE '\b'
+#define INPUT_CHAR_DELETE 0x7F
+
+/*! @brief Echo input back to the console. */
+static void
+input_echo(struct input_state *s, const char *str, uint32_t len)
+{
+    if (!(s->lflag & REFOS_LFLAG_ECHO)) {
+        return;
+    }
+    uint32_t n = output_write(&conServ.devOutput, NULL, str, len);
+    if (n < len) {
+        output_flush_anon(&conServ.devOutput, len - n);
+        output_write(&conServ.devOutput, NULL, str + n, len - n);
+    }
+}
+
+/*! @brief Add a new character onto the getchar queue, in raw mode.
     @param s The input state structure (struct input_state*)
     @param c The new character to push.
 */
 static void
-input_push_char(struct input_state *s, int c)
+input_push_raw_char(struct input_state *s, int c)
 {
     /* If backlog is too big, prune it. */
     while (cqueue_size(&s->inputBacklog) >= CONSERV_DEVICE_INPUT_BACKLOG_MAXSIZE) {
@@ -60,49 +89,118 @@ input_push_char(struct input_state *s, int c)
     }
 }
 
-/*! @brief The IRQ handling callback function.
-   
-    This callback function gets called from the interrupt dispatcher module to handle RX irqs.
-    It adds the inputted character to the backlog, and then goes through the waiting list and
-    replies to any waiters.
-
-    @param cookie The input state structure (struct input_state*)
-    @param irq The IRQ number.
+/*! @brief Feed a new character through the line discipline.
+    @param s The input state structure (struct input_state*)
+    @param c The new character.
 */
 static void
-input_handle_irq(void *cookie, uint32_t irq)
+input_push_char(struct input_state *s, int c)
 {
-    struct input_state *s = (struct input_state *) cookie;
-    assert(s && s->magic == CONSERV_DEVICE_INPUT_MAGIC);
-    ps_cdev_handle_irq(&conServ.devSerial, irq);
+    char ch = (char) c;
+    if (!(s->lflag & REFOS_LFLAG_ICANON)) {
+        input_push_raw_char(s, c);
+        input_echo(s, &ch, 1);
+        return;
+    }
 
-    while (1) {
-        int c = ps_cdev_getchar(&conServ.devSerial);
-        if (c == -1) {
-            break;
+    switch (ch) {
+    case INPUT_CHAR_BACKSPACE:
+    case INPUT_CHAR_DELETE:
+        if (s->lineLength > 0) {
+            s->lineLength--;
+            input_echo(s, "\b \b", 3);
         }
-        dvprintf("You typed [%c]\n", c);
-        input_push_char(s, c);
+        return;
+    case '\r':
+    case '\n':
+        /* Line finished. Make it readable, if there's room. */
+        s->line[s->lineLength++] = '\n';
+        if (s->cookedLength + s->lineLength <= CONSERV_DEVICE_INPUT_COOKED_MAXSIZE) {
+            memcpy(s->cooked + s->cookedLength, s->line, s->lineLength);
+            s->cookedLength += s->lineLength;
+        } else {
+            ROS_WARNING("Console input line dropped; nobody is reading stdin.");
+        }
+        s->lineLength = 0;
+        input_echo(s, "\n", 1);
+        return;
+    default:
+        /* Leave room for the newline. */
+        if (s->lineLength >= CONSERV_DEVICE_INPUT_LINE_MAXLEN - 1) {
+            return;
+        }
+        s->line[s->lineLength++] = ch;
+        input_echo(s, &ch, 1);
+        return;
     }
+}
 
-    #ifdef PLAT_PC99
-    while (conServ.keyboardEnabled) {
-        int c = ps_cdev_getchar(&conServ.devKeyboard);
-        if (c == -1) {
-            break;
+/*! @brief Whether there is any input which can be read right now. */
+static bool
+input_available(struct input_state *s)
+{
+    return s->cookedLength > 0 || cqueue_size(&s->inputBacklog) > 0;
+}
+
+/*! @brief Release a poller, deleting its notification endpoint. */
+static void
+input_poller_release(struct input_poller *poller)
+{
+    assert(poller && poller->magic == CONSERV_DEVICE_INPUT_POLLER_MAGIC);
+    csfree_delete(poller->notifyEP);
+    poller->magic = 0x0;
+    free(poller);
+}
+
+/*! @brief Remove any of the given client's pollers from the polling list.
+    @param s The input state structure (struct input_state*)
+    @param deathID The death ID of the client whose pollers to remove.
+*/
+static void
+input_remove_pollers(struct input_state *s, int32_t deathID)
+{
+    for (int i = 0; i < cvector_count(&s->pollerList); i++) {
+        struct input_poller *poller = (struct input_poller*) cvector_get(&s->pollerList, i);
+        assert(poller && poller->magic == CONSERV_DEVICE_INPUT_POLLER_MAGIC);
+        if (poller->client->deathID != deathID) {
+            continue;
         }
-        dvprintf("You typed on keyboard [%c]\n", c);
-        input_push_char(s, c);
+        input_poller_release(poller);
+        cvector_delete(&s->pollerList, i);
+        i--;
     }
-    #endif
+}
 
-    /* Notify any waiters. */
+/*! @brief Signal and drop every poller, if there is input for them.
+    @param s The input state structure (struct input_state*)
+*/
+static void
+input_notify_pollers(struct input_state *s)
+{
+    if (!input_available(s)) {
+        return;
+    }
+    int count = cvector_count(&s->pollerList);
+    for (int i = 0; i < count; i++) {
+        struct input_poller *poller = (struct input_poller*) cvector_get(&s->pollerList, i);
+        seL4_Signal(poller->notifyEP);
+        input_poller_release(poller);
+    }
+    cvector_reset(&s->pollerList);
+}
+
+/*! @brief Go through the waiting list, and reply to as many waiters as there is input for.
+    @param s The input state structure (struct input_state*)
+*/
+static void
+input_notify_waiters(struct input_state *s)
+{
     for (int i = 0; i < cvector_count(&s->waiterList); i++) {
         struct input_waiter *waiter = (struct input_waiter*) cvector_get(&s->waiterList, i);
         assert(waiter && waiter->magic == CONSERV_DEVICE_INPUT_WAITER_MAGIC);
         assert(waiter->reply && waiter->client);
 
-        if (cqueue_size(&s->inputBacklog) <= 0) {
+        if (!input_available(s)) {
             /* No more backlog to reply to. Cannot reply to more waiters. */
             break;
         }
@@ -112,10 +210,14 @@ input_handle_irq(void *cookie, uint32_t irq)
 
         /* Reply to the waiter. */
         if (waiter->type == INPUT_WAITERTYPE_GETC) {
-            int ch = (int) cqueue_pop(&s->inputBacklog);
+            int ch = -1;
+            input_read(s, &ch, 1);
             reply_data_getc((void*) waiter->client, ch);
         } else {
-            assert(!"Not implemented.");
+            char buf[CONSERV_DEVICE_INPUT_COOKED_MAXSIZE];
+            int n = input_read_bytes(s, buf, MIN(waiter->count, sizeof(buf)));
+            rpc_buffer_t rbuf = { .data = buf, .count = n };
+            reply_data_read((void*) waiter->client, rbuf, n);
         }
 
         /* Delete the saved reply cap, and free the structure. */
@@ -129,6 +231,46 @@ input_handle_irq(void *cookie, uint32_t irq)
     }
 }
 
+/*! @brief The IRQ handling callback function.
+   
+    This callback function gets called from the interrupt dispatcher module to handle RX irqs.
+    It adds the inputted character to the backlog, and then goes through the waiting list and
+    replies to any waiters.
+
+    @param cookie The input state structure (struct input_state*)
+    @param irq The IRQ number.
+*/
+static void
+input_handle_irq(void *cookie, uint32_t irq)
+{
+    struct input_state *s = (struct input_state *) cookie;
+    assert(s && s->magic == CONSERV_DEVICE_INPUT_MAGIC);
+    ps_cdev_handle_irq(&conServ.devSerial, irq);
+
+    while (1) {
+        int c = ps_cdev_getchar(&conServ.devSerial);
+        if (c == -1) {
+            break;
+        }
+        dvprintf("You typed [%c]\n", c);
+        input_push_char(s, c);
+    }
+
+    #ifdef PLAT_PC99
+    while (conServ.keyboardEnabled) {
+        int c = ps_cdev_getchar(&conServ.devKeyboard);
+        if (c == -1) {
+            break;
+        }
+        dvprintf("You typed on keyboard [%c]\n", c);
+        input_push_char(s, c);
+    }
+    #endif
+
+    input_notify_waiters(s);
+    input_notify_pollers(s);
+}
+
 void
 input_init(struct input_state *s)
 {
@@ -138,6 +280,11 @@ input_init(struct input_state *s)
     /* Initialise the input backlog and waiting list. */
     cqueue_init(&s->inputBacklog, CONSERV_DEVICE_INPUT_BACKLOG_MAXSIZE);
     cvector_init(&s->waiterList);
+    cvector_init(&s->pollerList);
+    s->lflag = CONSERV_DEVICE_INPUT_DEFAULT_LFLAG;
+    s->lflagOwner = -1;
+    s->lineLength = 0;
+    s->cookedLength = 0;
 
     /* Loop through every possible IRQ, and get the ones that the input device needs to
        listen to. */
@@ -165,26 +312,50 @@ input_read(struct input_state *s, int *dest, uint32_t count)
         return 0;
     }
 
-    if (cqueue_size(&s->inputBacklog) == 0) {
-        /* Nothing in the backlog. We're going to have to block. */
+    int i = 0;
+    for (; i < count; i++) {
+        char c;
+        if (input_read_bytes(s, &c, 1) == 0) {
+            break;
+        }
+        dest[i] = (int) c;
+    }
+    return i;
+}
+
+int
+input_read_bytes(struct input_state *s, char *dest, uint32_t count)
+{
+    assert(s && s->magic == CONSERV_DEVICE_INPUT_MAGIC);
+    if (!dest || count == 0) {
         return 0;
     }
 
-    /* Read in from backlog. */
-    int i = 0;
-    while (cqueue_size(&s->inputBacklog) > 0) {
-        int c = (int) cqueue_pop(&s->inputBacklog);
-        dest[i++] = c;
-        if (i >= count) {
-            break;
+    /* Finished lines first, even if canonical mode has since been turned off. One at a time. */
+    if (s->cookedLength > 0) {
+        uint32_t n = 0;
+        while (n < count && n < s->cookedLength) {
+            dest[n] = s->cooked[n];
+            if (dest[n++] == '\n') {
+                break;
+            }
         }
+        memmove(s->cooked, s->cooked + n, s->cookedLength - n);
+        s->cookedLength -= n;
+        return n;
     }
 
+    /* Read in from backlog. If it's empty, we're going to have to block. */
+    int i = 0;
+    while (i < count && cqueue_size(&s->inputBacklog) > 0) {
+        dest[i++] = (char) (int) cqueue_pop(&s->inputBacklog);
+    }
     return i;
 }
 
 int
-input_save_caller_as_waiter(struct input_state *s, struct srv_client *c, bool type)
+input_save_caller_as_waiter(struct input_state *s, struct srv_client *c, bool type,
+                            uint32_t count)
 {
     assert(s && s->magic == CONSERV_DEVICE_INPUT_MAGIC);
     assert(c && c->magic == CONSERV_CLIENT_MAGIC);
@@ -199,6 +370,7 @@ input_save_caller_as_waiter(struct input_state *s, struct srv_client *c, bool ty
     waiter->magic = CONSERV_DEVICE_INPUT_WAITER_MAGIC;
     waiter->client = c;
     waiter->type = type;
+    waiter->count = count;
 
     /* Allocate a cslot to save the reply cap into. */
     waiter->reply = csalloc();
@@ -230,8 +402,81 @@ exit1:
     return error;
 }
 
+int
+input_poll(struct input_state *s, struct srv_client *c, seL4_CPtr notifyEP, bool *ready)
+{
+    assert(s && s->magic == CONSERV_DEVICE_INPUT_MAGIC);
+    assert(c && c->magic == CONSERV_CLIENT_MAGIC);
+    assert(ready);
+
+    input_remove_pollers(s, c->deathID);
+    (*ready) = input_available(s);
+    if ((*ready) || !notifyEP) {
+        if (notifyEP) {
+            csfree_delete(notifyEP);
+        }
+        return ESUCCESS;
+    }
+
+    /* Allocate and fill out poller structure. */
+    struct input_poller *poller = malloc(sizeof(struct input_poller));
+    if (!poller) {
+        ROS_ERROR("input_poll failed to alloc poller struct.");
+        csfree_delete(notifyEP);
+        return ENOMEM;
+    }
+    poller->magic = CONSERV_DEVICE_INPUT_POLLER_MAGIC;
+    poller->notifyEP = notifyEP;
+    poller->client = c;
+
+    /* Add to polling list. (Takes ownership) */
+    cvector_add(&s->pollerList, (cvector_item_t) poller);
+    return ESUCCESS;
+}
+
+void
+input_set_lflag(struct input_state *s, struct srv_client *c, uint32_t lflag)
+{
+    assert(s && s->magic == CONSERV_DEVICE_INPUT_MAGIC);
+    lflag &= (REFOS_LFLAG_ICANON | REFOS_LFLAG_ECHO);
+    bool wasCanonical = (s->lflag & REFOS_LFLAG_ICANON);
+    s->lflag = lflag;
+    s->lflagOwner = (c && c->magic == CONSERV_CLIENT_MAGIC) ? c->deathID : -1;
+
+    if (!wasCanonical && (lflag & REFOS_LFLAG_ICANON)) {
+        /* Run any typed-ahead raw input through the line editor. */
+        while (cqueue_size(&s->inputBacklog) > 0) {
+            input_push_char(s, (int) cqueue_pop(&s->inputBacklog));
+        }
+    } else if (wasCanonical && !(lflag & REFOS_LFLAG_ICANON)) {
+        /* Any half-typed line is passed through as raw input. */
+        for (uint32_t i = 0; i < s->lineLength; i++) {
+            input_push_raw_char(s, s->line[i]);
+        }
+        s->lineLength = 0;
+    }
+}
+
 void
-input_purge_client(struct srv_client *client)
+input_purge_client(struct input_state *s, int32_t deathID)
 {
-    assert(!"not implemented.");
+    assert(s && s->magic == CONSERV_DEVICE_INPUT_MAGIC);
+    for (int i = 0; i < cvector_count(&s->waiterList); i++) {
+        struct input_waiter *waiter = (struct input_waiter*) cvector_get(&s->waiterList, i);
+        assert(waiter && waiter->magic == CONSERV_DEVICE_INPUT_WAITER_MAGIC);
+        if (waiter->client->deathID != deathID) {
+            continue;
+        }
+        csfree_delete(waiter->reply);
+        waiter->magic = 0x0;
+        free(waiter);
+        cvector_delete(&s->waiterList, i);
+        i--;
+    }
+    input_remove_pollers(s, deathID);
+
+    /* Don't leave the console in a mode set by a program which has gone away. */
+    if (s->lflagOwner == deathID) {
+        input_set_lflag(s, NULL, CONSERV_DEVICE_INPUT_DEFAULT_LFLAG);
+    }
 }
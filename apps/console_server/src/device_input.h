@@ -26,6 +26,10 @@
 #define CONSERV_DEVICE_INPUT_MAGIC 0x54F1A770
 #define CONSERV_DEVICE_INPUT_BACKLOG_MAXSIZE 2
 #define CONSERV_DEVICE_INPUT_WAITER_MAGIC 0x341A8321
+#define CONSERV_DEVICE_INPUT_POLLER_MAGIC 0x341A8B0E
+#define CONSERV_DEVICE_INPUT_LINE_MAXLEN 256
+#define CONSERV_DEVICE_INPUT_COOKED_MAXSIZE 512
+#define CONSERV_DEVICE_INPUT_DEFAULT_LFLAG 0
 
 #define INPUT_WAITERTYPE_GETC 0x0
 #define INPUT_WAITERTYPE_READ 0x1
@@ -37,12 +41,29 @@ struct input_waiter {
     seL4_CPtr reply;
     struct srv_client *client; /*!< No ownership, Weak Reference. */
     bool type; /*!< Whether getc or read. */
+    uint32_t count; /*!< Maximum number of bytes to read, for read waiters. */
+};
+
+/*! @brief A client waiting to be told that there is input, without being blocked. */
+struct input_poller {
+    uint32_t magic;
+    seL4_CPtr notifyEP; /*!< Has ownership. */
+    struct srv_client *client; /*!< No ownership, Weak Reference. */
 };
 
 struct input_state {
     uint32_t magic;
-    cqueue_t inputBacklog; /*!< char */
+    cqueue_t inputBacklog; /*!< char, raw mode input. */
     cvector_t waiterList; /*!< input_waiter */
+    cvector_t pollerList; /*!< input_poller */
+
+    /* Line discipline. */
+    uint32_t lflag; /*!< REFOS_LFLAG_* */
+    int32_t lflagOwner; /*!< deathID of the client which set lflag, or -1. */
+    char line[CONSERV_DEVICE_INPUT_LINE_MAXLEN]; /*!< Line being edited, in canonical mode. */
+    uint32_t lineLength;
+    char cooked[CONSERV_DEVICE_INPUT_COOKED_MAXSIZE]; /*!< Finished lines waiting to be read. */
+    uint32_t cookedLength;
 };
 
 /*! @brief Initialise input state manager and waiter list.
@@ -60,17 +81,48 @@ void input_init(struct input_state *s);
 */
 int input_read(struct input_state *s, int *dest, uint32_t count);
 
+/*! @brief Read bytes from the input device backlog. In canonical mode, reads no further than the
+           end of the next line.
+    @param s The input state structure. (No ownership transfer)
+    @param dest Output buffer which the inputted bytes will be written to. (No ownership transfer)
+    @param count Maximum output buffer length in bytes.
+    @return Number of bytes read. 0 means nothing to be read; see input_read().
+*/
+int input_read_bytes(struct input_state *s, char *dest, uint32_t count);
+
 /*! @brief Block current calling client and save its reply cap for when there is input available.
     @param s The input state structure. (No ownership transfer)
     @param c The client to be blocked. (No ownership transfer)
-    @param type The syscall type. Currently must be INPUT_WAITERTYPE_GETC.
+    @param type The syscall type, INPUT_WAITERTYPE_GETC or INPUT_WAITERTYPE_READ.
+    @param count Maximum number of bytes to read, for INPUT_WAITERTYPE_READ.
     @return ESUCCESS on success, refos_err_t otherwise.
 */
-int input_save_caller_as_waiter(struct input_state *s, struct srv_client *c, bool type);
+int input_save_caller_as_waiter(struct input_state *s, struct srv_client *c, bool type,
+                                uint32_t count);
 
-/*! @brief Purge all weak references to client form waiting list. Used when client dies.
-    @param client The dying client to be purged.
+/*! @brief Check whether there is input to be read, and if not, arm a readiness notification which
+           is signalled once there is. Replaces the client's earlier notification, if any.
+    @param s The input state structure. (No ownership transfer)
+    @param c The polling client. (No ownership transfer)
+    @param notifyEP The async endpoint to signal, or 0 to only cancel the client's earlier
+                    notification. (Takes ownership)
+    @param ready Output whether there is input now. If so, nothing is armed.
+    @return ESUCCESS on success, refos_err_t otherwise.
+*/
+int input_poll(struct input_state *s, struct srv_client *c, seL4_CPtr notifyEP, bool *ready);
+
+/*! @brief Set the line discipline mode.
+    @param s The input state structure. (No ownership transfer)
+    @param c The client setting the mode. The mode goes back to the default when it dies.
+    @param lflag The new mode, a combination of REFOS_LFLAG_* flags.
+*/
+void input_set_lflag(struct input_state *s, struct srv_client *c, uint32_t lflag);
+
+/*! @brief Purge all weak references to client form waiting and polling lists. Used when client
+           dies.
+    @param s The input state structure. (No ownership transfer)
+    @param deathID The death ID of the dying client to be purged.
 */
-void input_purge_client(struct srv_client *client);
+void input_purge_client(struct input_state *s, int32_t deathID);
 
 #endif /* _CONSOLE_SERVER_DEVICE_INPUT_H_ */
\ No newline at end of file
@@ -0,0 +1,375 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <autoconf.h>
+
+#include "device_output.h"
+#include "state.h"
+
+#include <refos-util/serv_connect.h>
+#include <refos-rpc/data_server.h>
+
+/*! @file
+    @brief Console Server buffered serial output.
+
+    Writing to the UART is slow; at 115200 baud every byte takes around 87us. Rather than have
+    every client wait on the UART while its data_write() is handled, each client gets an output
+    ring buffer here. A write is copied into the client's buffer and replied to straight away.
+
+    The buffers are drained to the serial device one line at a time, going round-robin between
+    clients, so lines from different clients do not get mixed up with each other. Where the serial
+    driver supports it (see CONSERV_DEVICE_OUTPUT_IRQ_DRIVEN), a chunk is handed to the driver's
+    asynchronous write, which feeds the TX FIFO from the TX empty interrupt and calls us back when
+    done. Otherwise the buffers are written out by polling after each message has been replied to.
+
+    A client whose buffer is full gets blocked, using the same seL4_SaveCaller method as the input
+    device's waiting list, and is replied to once its buffer has drained enough to take the write.
+    Anonymous clients can't be blocked, so the Console server flushes for them instead.
+*/
+
+/* ---- Ring buffer helpers ---- */
+
+static uint32_t
+output_buffer_push(struct output_buffer *b, const char *data, uint32_t count)
+{
+    uint32_t n = MIN(count, CONSERV_DEVICE_OUTPUT_BUFFER_SIZE - b->count);
+    for (uint32_t i = 0; i < n; i++) {
+        b->data[(b->head + b->count + i) % CONSERV_DEVICE_OUTPUT_BUFFER_SIZE] = data[i];
+    }
+    b->count += n;
+    return n;
+}
+
+/*! @brief Take up to one line out of a buffer.
+    @param b The buffer.
+    @param dest Output for the line. (No ownership transfer)
+    @param max Maximum number of bytes to take.
+    @param midLine Output, set if the bytes taken end in the middle of a line which the buffer
+                   still holds the rest of.
+    @return Number of bytes taken.
+*/
+static uint32_t
+output_buffer_take_line(struct output_buffer *b, char *dest, uint32_t max, bool *midLine)
+{
+    uint32_t n = 0;
+    bool newline = false;
+    while (n < max && n < b->count && !newline) {
+        dest[n] = b->data[(b->head + n) % CONSERV_DEVICE_OUTPUT_BUFFER_SIZE];
+        newline = (dest[n++] == '\n');
+    }
+    b->head = (b->head + n) % CONSERV_DEVICE_OUTPUT_BUFFER_SIZE;
+    b->count -= n;
+    *midLine = !newline && b->count > 0;
+    return n;
+}
+
+static int
+output_slot(struct srv_client *c)
+{
+    if (!c || c->magic != CONSERV_CLIENT_MAGIC) {
+        return CONSERV_DEVICE_OUTPUT_ANON_SLOT;
+    }
+    assert(c->cID + 1 < CONSERV_DEVICE_OUTPUT_MAX_BUFFERS);
+    return c->cID + 1;
+}
+
+/*! @brief Get the output buffer of a client, allocating it if needed. Returns NULL if out of
+           memory. */
+static struct output_buffer*
+output_get_buffer(struct output_state *s, struct srv_client *c)
+{
+    int slot = output_slot(c);
+    struct output_buffer *b = s->buffer[slot];
+    if (!b) {
+        b = malloc(sizeof(struct output_buffer));
+        if (!b) {
+            ROS_ERROR("output_get_buffer failed to alloc buffer.");
+            return NULL;
+        }
+        memset(b, 0, sizeof(struct output_buffer));
+        b->magic = CONSERV_DEVICE_OUTPUT_BUFFER_MAGIC;
+        s->buffer[slot] = b;
+    }
+    assert(b->magic == CONSERV_DEVICE_OUTPUT_BUFFER_MAGIC);
+    if (slot != CONSERV_DEVICE_OUTPUT_ANON_SLOT) {
+        /* A new client may reuse the ID of a dead one whose output is still draining. */
+        b->client = c;
+    }
+    return b;
+}
+
+/* ---- Transmit ---- */
+
+#ifdef CONSERV_DEVICE_OUTPUT_IRQ_DRIVEN
+/*! @brief Serial driver write completion callback.
+
+    May be called from the driver's IRQ handler, or from inside the driver's write function when
+    the Console server's own stdout is polling on it. So this must not start another write itself;
+    output_poll() does that.
+*/
+static void
+output_tx_complete(ps_chardevice_t *d, enum chardev_status stat, size_t bytes, void *token)
+{
+    struct output_state *s = (struct output_state *) token;
+    assert(s && s->magic == CONSERV_DEVICE_OUTPUT_MAGIC);
+    if (stat != CHARDEV_STAT_COMPLETE) {
+        ROS_WARNING("Serial write completed with status %d after %d bytes.", stat, (int) bytes);
+    }
+    s->txBusy = false;
+}
+#endif
+
+/*! @brief Pick the buffer to transmit from next.
+    @return The buffer slot, or -1 if all buffers are empty.
+*/
+static int
+output_next_buffer(struct output_state *s)
+{
+    if (s->txMidLine && s->txBuffer >= 0 && s->buffer[s->txBuffer] &&
+            s->buffer[s->txBuffer]->count > 0) {
+        /* Finish off the line we're in the middle of first. */
+        return s->txBuffer;
+    }
+    for (int i = 0; i < CONSERV_DEVICE_OUTPUT_MAX_BUFFERS; i++) {
+        int slot = (s->nextBuffer + i) % CONSERV_DEVICE_OUTPUT_MAX_BUFFERS;
+        if (s->buffer[slot] && s->buffer[slot]->count > 0) {
+            s->nextBuffer = (slot + 1) % CONSERV_DEVICE_OUTPUT_MAX_BUFFERS;
+            return slot;
+        }
+    }
+    return -1;
+}
+
+/*! @brief Start transmitting the next line, if the serial device is idle.
+    @return true if a line was started, false if the device is busy or there is nothing to send.
+*/
+static bool
+output_tx_start(struct output_state *s)
+{
+    if (s->txBusy) {
+        return false;
+    }
+    int slot = output_next_buffer(s);
+    if (slot < 0) {
+        return false;
+    }
+
+    uint32_t n = output_buffer_take_line(s->buffer[slot], s->txData,
+                                         CONSERV_DEVICE_OUTPUT_TX_CHUNK, &s->txMidLine);
+    s->txBuffer = slot;
+    s->nBytesWritten += n;
+
+#ifdef CONSERV_DEVICE_OUTPUT_IRQ_DRIVEN
+    s->txBusy = true;
+    if (ps_cdev_write(&conServ.devSerial, s->txData, n, output_tx_complete, (void*) s) >= 0) {
+        return true;
+    }
+    ROS_WARNING("Serial device refused async write. Falling back to polling.");
+    s->txBusy = false;
+#endif
+
+    for (uint32_t i = 0; i < n; i++) {
+        ps_cdev_putchar(&conServ.devSerial, s->txData[i]);
+    }
+    return true;
+}
+
+/* ---- Waiters ---- */
+
+static void
+output_waiter_release(struct output_waiter *w)
+{
+    assert(w->reply);
+    csfree_delete(w->reply);
+    free(w->data);
+    memset(w, 0, sizeof(struct output_waiter));
+}
+
+/*! @brief Reply to every blocked client whose buffer now has room for (some of) its write. */
+static void
+output_notify_waiters(struct output_state *s)
+{
+    for (int i = 0; i < CONSERV_DEVICE_OUTPUT_MAX_BUFFERS; i++) {
+        struct output_buffer *b = s->buffer[i];
+        if (!b || !b->waiter.reply) {
+            continue;
+        }
+        assert(b->magic == CONSERV_DEVICE_OUTPUT_BUFFER_MAGIC && b->client);
+
+        uint32_t n = output_buffer_push(b, b->waiter.data, b->waiter.count);
+        if (n == 0) {
+            continue;
+        }
+
+        b->client->rpcClient.skip_reply = false;
+        b->client->rpcClient.reply = b->waiter.reply;
+        if (b->waiter.type == OUTPUT_WAITERTYPE_WRITE) {
+            /* A short count makes the client write the rest. */
+            reply_data_write((void*) b->client, (int) n);
+        } else {
+            reply_data_putc((void*) b->client, ESUCCESS);
+        }
+        b->client->rpcClient.reply = 0;
+        output_waiter_release(&b->waiter);
+    }
+}
+
+/* ---- Interface ---- */
+
+void
+output_init(struct output_state *s)
+{
+    assert(s);
+    memset(s, 0, sizeof(struct output_state));
+    s->magic = CONSERV_DEVICE_OUTPUT_MAGIC;
+    s->txBuffer = -1;
+}
+
+uint32_t
+output_write(struct output_state *s, struct srv_client *c, const char *data, uint32_t count)
+{
+    assert(s && s->magic == CONSERV_DEVICE_OUTPUT_MAGIC);
+    if (!data || count == 0) {
+        return 0;
+    }
+    struct output_buffer *b = output_get_buffer(s, c);
+    if (!b) {
+        return 0;
+    }
+    uint32_t n = output_buffer_push(b, data, count);
+#ifdef CONSERV_DEVICE_OUTPUT_IRQ_DRIVEN
+    /* Get the FIFO going now; output_poll() picks up from here once the reply has gone out. */
+    output_tx_start(s);
+#endif
+    return n;
+}
+
+int
+output_save_caller_as_waiter(struct output_state *s, struct srv_client *c, int type,
+                             const char *data, uint32_t count)
+{
+    assert(s && s->magic == CONSERV_DEVICE_OUTPUT_MAGIC);
+    assert(c && c->magic == CONSERV_CLIENT_MAGIC);
+    int error = EINVALID;
+
+    struct output_buffer *b = output_get_buffer(s, c);
+    if (!b) {
+        return ENOMEM;
+    }
+    struct output_waiter *w = &b->waiter;
+    assert(!w->reply);
+
+    /* The IPC buffer will be long gone by the time we reply, so keep a copy of the data. */
+    w->data = malloc(count);
+    if (!w->data) {
+        ROS_ERROR("output_save_caller_as_waiter failed to alloc data.");
+        return ENOMEM;
+    }
+    memcpy(w->data, data, count);
+    w->count = count;
+    w->type = type;
+
+    /* Allocate a cslot to save the reply cap into. */
+    w->reply = csalloc();
+    if (!w->reply) {
+        ROS_ERROR("output_save_caller_as_waiter failed to alloc cslot.");
+        error = ENOMEM;
+        goto exit1;
+    }
+
+    /* Save current caller into the reply cap. */
+    error = seL4_CNode_SaveCaller(REFOS_CSPACE, w->reply, REFOS_CDEPTH);
+    if (error != seL4_NoError) {
+        ROS_ERROR("output_save_caller_as_waiter failed to save caller.");
+        error = EINVALID;
+        goto exit2;
+    }
+
+    s->nWaits++;
+    return ESUCCESS;
+
+    /* Exit stack. */
+exit2:
+    csfree(w->reply);
+exit1:
+    free(w->data);
+    memset(w, 0, sizeof(struct output_waiter));
+    return error;
+}
+
+void
+output_flush_anon(struct output_state *s, uint32_t count)
+{
+    assert(s && s->magic == CONSERV_DEVICE_OUTPUT_MAGIC);
+    struct output_buffer *b = output_get_buffer(s, NULL);
+    if (!b) {
+        return;
+    }
+    count = MIN(count, CONSERV_DEVICE_OUTPUT_BUFFER_SIZE);
+    while (CONSERV_DEVICE_OUTPUT_BUFFER_SIZE - b->count < count) {
+        if (s->txBusy) {
+            /* Not in an IRQ, but the driver is happy to be polled. */
+            ps_cdev_handle_irq(&conServ.devSerial, 0);
+        }
+        output_tx_start(s);
+    }
+}
+
+void
+output_poll(struct output_state *s)
+{
+    assert(s && s->magic == CONSERV_DEVICE_OUTPUT_MAGIC);
+
+#ifdef CONSERV_DEVICE_OUTPUT_IRQ_DRIVEN
+    output_tx_start(s);
+    output_notify_waiters(s);
+    output_tx_start(s);
+#else
+    /* Replies for this message have gone out already, so write everything out now. */
+    do {
+        while (output_tx_start(s));
+        output_notify_waiters(s);
+    } while (output_next_buffer(s) >= 0);
+#endif
+
+    /* Free drained buffers of dead clients. */
+    for (int i = CONSERV_DEVICE_OUTPUT_ANON_SLOT + 1; i < CONSERV_DEVICE_OUTPUT_MAX_BUFFERS; i++) {
+        struct output_buffer *b = s->buffer[i];
+        if (b && !b->client && b->count == 0) {
+            b->magic = 0;
+            free(b);
+            s->buffer[i] = NULL;
+        }
+    }
+}
+
+void
+output_purge_client(struct output_state *s, int32_t deathID)
+{
+    assert(s && s->magic == CONSERV_DEVICE_OUTPUT_MAGIC);
+    for (int i = CONSERV_DEVICE_OUTPUT_ANON_SLOT + 1; i < CONSERV_DEVICE_OUTPUT_MAX_BUFFERS; i++) {
+        struct output_buffer *b = s->buffer[i];
+        if (!b || !b->client || b->client->deathID != deathID) {
+            continue;
+        }
+        if (b->waiter.reply) {
+            output_waiter_release(&b->waiter);
+        }
+        b->client = NULL;
+    }
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+#ifndef _CONSOLE_SERVER_DEVICE_OUTPUT_H_
+#define _CONSOLE_SERVER_DEVICE_OUTPUT_H_
+
+#include <autoconf.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sel4/sel4.h>
+#include <refos-util/serv_common.h>
+
+/*! @file
+    @brief Console Server buffered serial output. */
+
+#define CONSERV_DEVICE_OUTPUT_MAGIC 0x0D7B0F11
+#define CONSERV_DEVICE_OUTPUT_BUFFER_MAGIC 0x0D7B0F22
+#define CONSERV_DEVICE_OUTPUT_BUFFER_SIZE 2048
+#define CONSERV_DEVICE_OUTPUT_TX_CHUNK 256
+
+/*! @brief Buffer slot for anonymous (sessionless) writers. Session clients use slot cID + 1. */
+#define CONSERV_DEVICE_OUTPUT_ANON_SLOT 0
+#define CONSERV_DEVICE_OUTPUT_MAX_BUFFERS (SRV_DEFAULT_MAX_CLIENTS + 1)
+
+/* Only these serial drivers transmit from the TX FIFO empty interrupt. Everywhere else, output is
+   still buffered, but drained by polling in between messages. */
+#if defined(PLAT_PC99) || defined(CONFIG_PLAT_IMX6)
+    #define CONSERV_DEVICE_OUTPUT_IRQ_DRIVEN 1
+#endif
+
+#define OUTPUT_WAITERTYPE_WRITE 0x0
+#define OUTPUT_WAITERTYPE_PUTC 0x1
+
+struct srv_client;
+
+/*! @brief A client blocked on a full output buffer. */
+struct output_waiter {
+    seL4_CPtr reply;
+    int type; /*!< Whether write or putc. */
+    char *data; /*!< The data the client was trying to write. (Has ownership) */
+    uint32_t count;
+};
+
+/*! @brief Output ring buffer of one client. */
+struct output_buffer {
+    uint32_t magic;
+    struct srv_client *client; /*!< No ownership, Weak Reference. NULL once the client has died. */
+    char data[CONSERV_DEVICE_OUTPUT_BUFFER_SIZE];
+    uint32_t head;
+    uint32_t count;
+    struct output_waiter waiter; /*!< Valid if waiter.reply is set. */
+};
+
+struct output_state {
+    uint32_t magic;
+    struct output_buffer *buffer[CONSERV_DEVICE_OUTPUT_MAX_BUFFERS];
+    uint32_t nextBuffer; /*!< Round-robin drain position. */
+
+    /* The chunk currently being transmitted by the serial driver. */
+    char txData[CONSERV_DEVICE_OUTPUT_TX_CHUNK];
+    bool txBusy;
+    int txBuffer; /*!< The buffer the chunk came from, or -1. */
+    bool txMidLine; /*!< The chunk ended mid-line, so stay on the same buffer. */
+
+    /* Statistics. */
+    uint32_t nBytesWritten;
+    uint32_t nWaits;
+};
+
+/*! @brief Initialise the output state.
+    @param s The output state structure. (No ownership transfer)
+*/
+void output_init(struct output_state *s);
+
+/*! @brief Queue data written by a client for output on serial.
+    @param s The output state structure. (No ownership transfer)
+    @param c The writing client, which may be anonymous. (No ownership transfer)
+    @param data The data to write. (No ownership transfer)
+    @param count The number of bytes to write.
+    @return Number of bytes queued. May be less than count when the client's buffer fills up. 0
+            means the buffer was full; session clients should then be blocked using
+            output_save_caller_as_waiter().
+*/
+uint32_t output_write(struct output_state *s, struct srv_client *c, const char *data,
+                      uint32_t count);
+
+/*! @brief Block the calling client until its output buffer has room for its write.
+    @param s The output state structure. (No ownership transfer)
+    @param c The client to be blocked. (No ownership transfer)
+    @param type OUTPUT_WAITERTYPE_WRITE or OUTPUT_WAITERTYPE_PUTC.
+    @param data The data the client is writing. (No ownership transfer)
+    @param count The number of bytes the client is writing.
+    @return ESUCCESS on success, refos_err_t otherwise.
+*/
+int output_save_caller_as_waiter(struct output_state *s, struct srv_client *c, int type,
+                                 const char *data, uint32_t count);
+
+/*! @brief Push data through to the serial device until at least count bytes are free in the
+           anonymous buffer. Used for writers which cannot be blocked.
+    @param s The output state structure. (No ownership transfer)
+    @param count The number of bytes of room needed.
+*/
+void output_flush_anon(struct output_state *s, uint32_t count);
+
+/*! @brief Make progress on output. Starts transmitting the next chunk if the serial device is
+           idle, and unblocks any waiters whose buffers have drained. Called after every message.
+    @param s The output state structure. (No ownership transfer)
+*/
+void output_poll(struct output_state *s);
+
+/*! @brief Drop all references to a dying client. Its remaining output is still drained.
+    @param s The output state structure. (No ownership transfer)
+    @param deathID The death ID of the client.
+*/
+void output_purge_client(struct output_state *s, int32_t deathID);
+
+#endif /* _CONSOLE_SERVER_DEVICE_OUTPUT_H_ */
@@ -34,6 +34,10 @@ handle_conserver_death_notification(struct proc_notification *notification)
     dprintf("     Label: PROCSERV_NOTIFY_DEATH\n");
     dprintf("     deathID: %d\n", notification->arg[0]);
 
+    /* Drop the client's blocked input and output, if any. */
+    input_purge_client(&conServ.devInput, notification->arg[0]);
+    output_purge_client(&conServ.devOutput, notification->arg[0]);
+
     /* Find the client and queue it for deletion. */
     int error = client_queue_delete_deathID(&conServCommon->clientTable, notification->arg[0]);
 
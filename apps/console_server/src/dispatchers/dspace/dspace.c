@@ -83,14 +83,11 @@ data_read_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , uint32_t rpc_off
         return -EINVALIDPARAM;
     }
 
-    /* Handle read from stdio / serial dataspaces. */
-    if (rpc_dspace_fd == CONSERV_DSPACE_BADGE_STDIO) {
-        return -EACCESSDENIED;
-    }
-
-    /* Handle read from screen dataspaces. */
-    if (rpc_dspace_fd == CONSERV_DSPACE_BADGE_SCREEN) {
-        return -EACCESSDENIED;
+    /* Handle read from stdio / serial dataspaces. Screen input comes from the same input
+       device, as with getc. */
+    if (rpc_dspace_fd == CONSERV_DSPACE_BADGE_STDIO ||
+            rpc_dspace_fd == CONSERV_DSPACE_BADGE_SCREEN) {
+        return serial_read_handler(rpc_userptr, rpc_dspace_fd, rpc_offset, rpc_buf, rpc_count);
     }
 
     return -EFILENOTFOUND;
@@ -177,6 +174,27 @@ data_putc_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , int rpc_c)
     return EFILENOTFOUND;
 }
 
+int
+data_ioctl_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , int rpc_request ,
+                   uint32_t rpc_arg)
+{
+    struct srv_client *c = (struct srv_client *) rpc_userptr;
+    srv_msg_t *m = (srv_msg_t *) c->rpcClient.userptr;
+    assert(c && (c->magic == CONSERV_DISPATCH_ANON_CLIENT_MAGIC || c->magic == CONSERV_CLIENT_MAGIC));
+
+    if (!srv_check_dispatch_caps(m, 0x00000001, 1)) {
+        return -EINVALIDPARAM;
+    }
+
+    /* The stdio and screen dataspaces share one line discipline. */
+    if (rpc_dspace_fd == CONSERV_DSPACE_BADGE_STDIO ||
+            rpc_dspace_fd == CONSERV_DSPACE_BADGE_SCREEN) {
+        return serial_ioctl_handler(rpc_userptr, rpc_dspace_fd, rpc_request, rpc_arg);
+    }
+
+    return -EFILENOTFOUND;
+}
+
 off_t
 data_lseek_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , off_t rpc_offset , int rpc_whence)
 {
@@ -236,6 +254,40 @@ data_provide_data_from_parambuffer_handler(void *rpc_userptr , seL4_CPtr rpc_dsp
     return EUNIMPLEMENTED;
 }
 
+int
+data_poll_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , seL4_CPtr rpc_notifyEP ,
+                  int rpc_events , uint32_t rpc_arg)
+{
+    struct srv_client *c = (struct srv_client *) rpc_userptr;
+    srv_msg_t *m = (srv_msg_t *) c->rpcClient.userptr;
+    assert(c && (c->magic == CONSERV_DISPATCH_ANON_CLIENT_MAGIC || c->magic == CONSERV_CLIENT_MAGIC));
+
+    if (!srv_check_dispatch_caps(m, 0x00000001, 2)) {
+        return -EINVALIDPARAM;
+    }
+
+    /* Copyout the notification EP. Do not printf before the copyout. */
+    seL4_CPtr notifyEP = rpc_copyout_cptr(rpc_notifyEP);
+    if (!notifyEP) {
+        return -EINVALIDPARAM;
+    }
+
+    /* Anonymous clients can't be tracked, so they can't be notified. */
+    if (c->magic == CONSERV_DISPATCH_ANON_CLIENT_MAGIC) {
+        csfree_delete(notifyEP);
+        return -EINVALIDPARAM;
+    }
+
+    /* The stdio and screen dataspaces share one input device. */
+    if (rpc_dspace_fd == CONSERV_DSPACE_BADGE_STDIO ||
+            rpc_dspace_fd == CONSERV_DSPACE_BADGE_SCREEN) {
+        return serial_poll_handler(rpc_userptr, rpc_dspace_fd, notifyEP, rpc_events, rpc_arg);
+    }
+
+    csfree_delete(notifyEP);
+    return -EFILENOTFOUND;
+}
+
 int
 check_dispatch_data(srv_msg_t *m, void **userptr)
 {
@@ -12,6 +12,7 @@
 
 #include "../../state.h"
 #include "../../device_input.h"
+#include "../../device_output.h"
 #include "../dispatch.h"
 #include "stdio_dspace.h"
 
@@ -22,8 +23,8 @@
     for serial devices. The common dataspace dispatcher module delegates calls to us if it has
     decided that the recieved message is a serial dataspace call.
 
-    This is a thin layer basically wrapping the device_input module, which has the concrete
-    implementations.
+    This is a thin layer basically wrapping the device_input and device_output modules, which have
+    the concrete implementations.
 */
 
 seL4_CPtr
@@ -40,11 +41,59 @@ int
 serial_write_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , uint32_t rpc_offset ,
                      rpc_buffer_t rpc_buf , uint32_t rpc_count)
 {
+    struct srv_client *c = (struct srv_client *) rpc_userptr;
     assert(rpc_dspace_fd == CONSERV_DSPACE_BADGE_STDIO);
-    for (int i = 0; i < rpc_buf.count; i++) {
-        ps_cdev_putchar(&conServ.devSerial, ((char*) rpc_buf.data)[i]);
+    if (rpc_buf.count == 0) {
+        return 0;
+    }
+
+    int n = output_write(&conServ.devOutput, c, (char*) rpc_buf.data, rpc_buf.count);
+    if (n > 0) {
+        return n;
+    }
+
+    /* Output buffer is full. */
+    if (c->magic == CONSERV_CLIENT_MAGIC) {
+        int error = output_save_caller_as_waiter(&conServ.devOutput, c, OUTPUT_WAITERTYPE_WRITE,
+                                                 (char*) rpc_buf.data, rpc_buf.count);
+        if (error == ESUCCESS) {
+            c->rpcClient.skip_reply = true;
+            return 0;
+        }
+        ROS_ERROR("Could not save caller.");
     }
-    return rpc_buf.count;
+    output_flush_anon(&conServ.devOutput, rpc_buf.count);
+    return output_write(&conServ.devOutput, NULL, (char*) rpc_buf.data, rpc_buf.count);
+}
+
+int
+serial_read_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , uint32_t rpc_offset ,
+                    rpc_buffer_t rpc_buf , uint32_t rpc_count)
+{
+    struct srv_client *c = (struct srv_client *) rpc_userptr;
+    assert(rpc_dspace_fd == CONSERV_DSPACE_BADGE_STDIO ||
+           rpc_dspace_fd == CONSERV_DSPACE_BADGE_SCREEN);
+    if (c->magic != CONSERV_CLIENT_MAGIC) {
+        /* Anonymous clients can't be blocked. */
+        return -EACCESSDENIED;
+    }
+    if (rpc_buf.count == 0) {
+        return 0;
+    }
+
+    int nread = input_read_bytes(&conServ.devInput, (char*) rpc_buf.data, rpc_buf.count);
+    if (nread == 0) {
+        /* Reads from stdin always block until there is something to return. */
+        int error = input_save_caller_as_waiter(&conServ.devInput, c, INPUT_WAITERTYPE_READ,
+                                                rpc_buf.count);
+        if (error != ESUCCESS) {
+            ROS_ERROR("Could not save caller.");
+            return -error;
+        }
+        c->rpcClient.skip_reply = true;
+        return 0;
+    }
+    return nread;
 }
 
 int
@@ -60,7 +109,7 @@ serial_getc_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , int rpc_block)
     if (nread == 0) {
         if (rpc_block) {
             c->rpcClient.skip_reply = true;
-            int error = input_save_caller_as_waiter(&conServ.devInput, c, INPUT_WAITERTYPE_GETC);
+            int error = input_save_caller_as_waiter(&conServ.devInput, c, INPUT_WAITERTYPE_GETC, 1);
             if (error != ESUCCESS) {
                 ROS_ERROR("Could not save caller.");
             }
@@ -76,7 +125,71 @@ serial_getc_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , int rpc_block)
 refos_err_t
 serial_putc_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , int rpc_c)
 {
+    struct srv_client *c = (struct srv_client *) rpc_userptr;
     assert(rpc_dspace_fd == CONSERV_DSPACE_BADGE_STDIO);
-    ps_cdev_putchar(&conServ.devSerial, rpc_c);
+    char ch = (char) rpc_c;
+
+    if (output_write(&conServ.devOutput, c, &ch, 1) > 0) {
+        return ESUCCESS;
+    }
+
+    /* Output buffer is full. */
+    if (c->magic == CONSERV_CLIENT_MAGIC) {
+        int error = output_save_caller_as_waiter(&conServ.devOutput, c, OUTPUT_WAITERTYPE_PUTC,
+                                                 &ch, 1);
+        if (error == ESUCCESS) {
+            c->rpcClient.skip_reply = true;
+            return ESUCCESS;
+        }
+        ROS_ERROR("Could not save caller.");
+    }
+    output_flush_anon(&conServ.devOutput, 1);
+    output_write(&conServ.devOutput, NULL, &ch, 1);
     return ESUCCESS;
-}
\ No newline at end of file
+}
+
+int
+serial_ioctl_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , int rpc_request ,
+                     uint32_t rpc_arg)
+{
+    struct srv_client *c = (struct srv_client *) rpc_userptr;
+    assert(rpc_dspace_fd == CONSERV_DSPACE_BADGE_STDIO ||
+           rpc_dspace_fd == CONSERV_DSPACE_BADGE_SCREEN);
+
+    switch (rpc_request) {
+    case REFOS_IOCTL_GET_LFLAG:
+        return (int) conServ.devInput.lflag;
+    case REFOS_IOCTL_SET_LFLAG:
+        input_set_lflag(&conServ.devInput, c, rpc_arg);
+        return (int) conServ.devInput.lflag;
+    default:
+        return -EINVALIDPARAM;
+    }
+}
+
+int
+serial_poll_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , seL4_CPtr notifyEP ,
+                    int rpc_events , uint32_t rpc_arg)
+{
+    struct srv_client *c = (struct srv_client *) rpc_userptr;
+    assert(c && c->magic == CONSERV_CLIENT_MAGIC);
+    assert(rpc_dspace_fd == CONSERV_DSPACE_BADGE_STDIO ||
+           rpc_dspace_fd == CONSERV_DSPACE_BADGE_SCREEN);
+
+    /* Output never blocks the client for long, so only input is ever waited on. */
+    int ready = rpc_events & REFOS_POLL_WRITE;
+    seL4_CPtr armEP = ((rpc_events & REFOS_POLL_READ) && !ready) ? notifyEP : 0;
+    if (!armEP) {
+        csfree_delete(notifyEP);
+    }
+
+    bool inputReady = false;
+    int error = input_poll(&conServ.devInput, c, armEP, &inputReady);
+    if (error != ESUCCESS) {
+        return -error;
+    }
+    if (inputReady && (rpc_events & REFOS_POLL_READ)) {
+        ready |= REFOS_POLL_READ;
+    }
+    return ready;
+}
@@ -26,10 +26,23 @@ seL4_CPtr serial_open_handler(void *rpc_userptr , char* rpc_name , int rpc_flags
 int serial_write_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , uint32_t rpc_offset ,
                          rpc_buffer_t rpc_buf , uint32_t rpc_count);
 
+/*! @brief Similar to data_read_handler, for serial dataspaces. */
+int serial_read_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , uint32_t rpc_offset ,
+                        rpc_buffer_t rpc_buf , uint32_t rpc_count);
+
 /*! @brief Similar to data_getc_handler, for serial dataspaces. */
 int serial_getc_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , int rpc_block);
 
 /*! @brief Similar to data_putc_handler, for serial dataspaces. */
 refos_err_t serial_putc_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , int rpc_c);
 
+/*! @brief Similar to data_ioctl_handler, for serial dataspaces. */
+int serial_ioctl_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , int rpc_request ,
+                         uint32_t rpc_arg);
+
+/*! @brief Similar to data_poll_handler, for serial dataspaces. Takes ownership of the already
+           copied out notifyEP. */
+int serial_poll_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , seL4_CPtr notifyEP ,
+                        int rpc_events , uint32_t rpc_arg);
+
 #endif /* _CONSOLE_SERVER_DISPATCHER_DSPACE_STDIO_H_ */
\ No newline at end of file
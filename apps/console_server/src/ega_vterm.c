@@ -149,14 +149,20 @@ void
 vterm_write(vterm_state_t *s, char *buffer, int len)
 {
     assert(s && s->magic == VTERM_MAGIC);
+    /* Push whole lines at a time, so runs of plain text reach libvterm's text fast path. */
+    int start = 0;
     for (int i = 0; i < len; i++) {
-        vterm_push_bytes(s->vt, &buffer[i], 1);
         if (buffer[i] == '\n') {
             char cr = '\r';
             /* Convert \n to \n\r. */
+            vterm_push_bytes(s->vt, &buffer[start], i + 1 - start);
             vterm_push_bytes(s->vt, &cr, 1);
+            start = i + 1;
         }
     }
+    if (start < len) {
+        vterm_push_bytes(s->vt, &buffer[start], len - start);
+    }
     if (s->autoRenderUpdate) {
         vterm_render_buffer(s);
     }
@@ -136,6 +136,9 @@ conserv_init(void)
     conServ.keyboardEnabled = true;
     #endif
 
+    /* Set up buffered serial output. Input echoes through it, so this goes first. */
+    output_init(&conServ.devOutput);
+
     /* Set up input device. */
     input_init(&conServ.devInput);
 
@@ -25,6 +25,7 @@
 #include <platsupport/chardev.h>
 #include <platsupport/serial.h>
 #include "device_input.h"
+#include "device_output.h"
 #include "device_screen.h"
 #include "badge.h"
 
@@ -70,6 +71,7 @@ struct conserv_state {
     dev_io_ops_t devIO;
     ps_chardevice_t devSerial;
     struct input_state devInput;
+    struct output_state devOutput;
     struct device_screen_state devScreen;
 
     #ifdef PLAT_PC99
@@ -12,8 +12,11 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#include <fcntl.h>
 #include <sel4/sel4.h>
+#include <utils/arith.h>
 #include <refos/refos.h>
 #include <refos/vmlayout.h>
 #include "badge.h"
@@ -33,8 +36,8 @@
 /*! @brief Dataspace object OAT creation function.
 
     This is called by coat helper library to create a new structure. The first argument is the
-    client's DeathID, second argument is the fileData pointer, 3rd argument is the fileData size,
-    and 4th argument the permissions mask.
+    client's DeathID, second argument is the fileData pointer (NULL for a RamFS file), 3rd argument
+    is the fileData size, and 4th argument the permissions mask.
 
     Allocates and fills in a new dataspace structure with the given arguments, and mints a new cap
     representing this new dataspace.
@@ -63,11 +66,11 @@ dspace_oat_create(coat_t *oat, int id, uint32_t arg[COAT_ARGS])
     ndspace->fileData = (char*) arg[1];
     ndspace->fileDataSize = arg[2];
     ndspace->permissions = arg[3];
-    ndspace->fileCreated = false;
+    ndspace->ramFile = NULL;
+    ndspace->seekOffset = 0;
 
-    /* Check that the dataspace cap cslot has been successfully allocated, and that
-       the given pointer is valid. */
-    if (!ndspace->dataspaceCap || !ndspace->fileData) {
+    /* Check that the dataspace cap cslot has been successfully allocated. */
+    if (!ndspace->dataspaceCap) {
         free(ndspace);
         return NULL;
     }
@@ -189,6 +192,32 @@ dspace_delete(struct fs_dataspace_table *dt, int id)
     coat_free(&dt->allocTable, id);
 }
 
+size_t
+dspace_get_size(struct fs_dataspace *dspace)
+{
+    assert(dspace && dspace->magic == FS_DATASPACE_MAGIC);
+    if (dspace->ramFile) {
+        return dspace->ramFile->size;
+    }
+    return dspace->fileDataSize;
+}
+
+int
+dspace_read(struct fs_dataspace *dspace, size_t offset, char *buf, size_t count)
+{
+    assert(dspace && dspace->magic == FS_DATASPACE_MAGIC);
+    if (dspace->ramFile) {
+        return ramfs_read(dspace->ramFile, offset, buf, count);
+    }
+    assert(dspace->fileData);
+    if (offset >= dspace->fileDataSize) {
+        return 0;
+    }
+    count = MIN(dspace->fileDataSize - offset, count);
+    memcpy(buf, dspace->fileData + offset, count);
+    return (int) count;
+}
+
 /* ----------------------------- CPIO Dataspace Functions --------------------------------------- */
 
 /*! @brief Internal unassociation helper function. */
@@ -202,6 +231,24 @@ dspace_externalID_unassociate(chash_t *ht, int objID)
         return;
     }
     chash_set(ht, objID, (chash_item_t) NULL);
+
+    /* Return any pager frames mapped into the associated window. */
+    int c = cvector_count(&di->frames);
+    for (int i = 0; i < c; i++) {
+        pager_free_frame(&fileServ.pageFrameBlock, (vaddr_t) cvector_get(&di->frames, i));
+    }
+    cvector_free(&di->frames);
+
+    if (di->ramFile) {
+        assert(di->ramFile->mapCount > 0);
+        di->ramFile->mapCount--;
+
+        /* Writes through the window never went through ramfs_write(). */
+        if (di->ramFileWritable) {
+            ramfs_file_changed(&fileServ.ramfs, di->ramFile);
+        }
+    }
+
     if (di->objectCap) {
         seL4_CNode_Revoke(REFOS_CSPACE, di->objectCap, REFOS_CDEPTH);
         seL4_CNode_Delete(REFOS_CSPACE, di->objectCap, REFOS_CDEPTH);
@@ -223,6 +270,9 @@ dspace_externalID_associate(chash_t *ht, int objID, int dsID, int dsOffset,
     di->dataspaceID = dsID;
     di->dataspaceOffset = dsOffset;
     di->objectCap = cap;
+    cvector_init(&di->frames);
+    di->ramFile = NULL;
+    di->ramFileWritable = false;
     chash_set(ht, objID, (chash_item_t) di);
     return ESUCCESS;
 }
@@ -231,7 +281,22 @@ int
 dspace_window_associate(struct fs_dataspace_table *dt, int winID, int dsID, int dsOffset,
                               seL4_CPtr windowCap)
 {
-    return dspace_externalID_associate(&dt->windowAssocTable, winID, dsID, dsOffset, windowCap);
+    int error = dspace_externalID_associate(&dt->windowAssocTable, winID, dsID, dsOffset,
+                                            windowCap);
+    if (error != ESUCCESS) {
+        return error;
+    }
+
+    /* RamFS extents may be paged directly into this window, so pin them until unassociation. */
+    struct fs_dataspace *dspace = dspace_get(dt, dsID);
+    if (dspace && dspace->ramFile) {
+        struct dataspace_association_info *di = dspace_window_find(dt, winID);
+        assert(di);
+        di->ramFile = dspace->ramFile;
+        di->ramFile->mapCount++;
+        di->ramFileWritable = (dspace->permissions & O_ACCMODE) != O_RDONLY;
+    }
+    return ESUCCESS;
 }
 
 struct dataspace_association_info *
@@ -26,6 +26,7 @@
 #include <data_struct/chash.h>
 #include <refos/refos.h>
 #include <refos-rpc/rpc.h>
+#include "ramfs.h"
 
 /*! @file
     @brief File server CPIO dataspace object allocation and management. */  
@@ -38,7 +39,8 @@
 /*! @brief File server dataspace
 
     File server dataspace structure. Dataspace cap is a badged endpoint cap of the file server.
-    The structure has no ownership of the actual file data.
+    The structure has no ownership of the actual file data. A dataspace refers to either a
+    read-only CPIO file (fileData) or a writable RAM filesystem file (ramFile).
  */
 struct fs_dataspace {
     uint32_t magic;
@@ -46,11 +48,12 @@ struct fs_dataspace {
     uint32_t deathID;
 
     seL4_CPtr dataspaceCap;
-    seL4_Word permissions;
+    seL4_Word permissions; /* The O_ACCMODE flags it was opened with. */
 
     char *fileData; /* Not owned. */
     size_t fileDataSize;
-    bool fileCreated;
+    struct fs_ramfs_file *ramFile; /* Not owned. */
+    uint32_t seekOffset;
 };
 
 /*! @brief File server CPIO dataspace association
@@ -66,6 +69,10 @@ struct dataspace_association_info {
     int dataspaceID;         /*!< The internal dataspace ID being associated to. */
     int dataspaceOffset;     /*!< Offset into the internal dataspace ID. */
     seL4_CPtr objectCap;     /*!< The associated object's capability; window cap or dspace cap. */
+    cvector_t frames;        /*!< Pager frames mapped into an associated window. (vaddr_t) */
+    struct fs_ramfs_file *ramFile; /*!< RamFS file whose extents are paged into the window. */
+    bool ramFileWritable;    /*!< The file was opened for writing, so may change through the
+                                  window. */
 };
 
 struct fs_dataspace_table {
@@ -92,7 +99,8 @@ void dspace_table_release(struct fs_dataspace_table *dt);
 /*! @brief Assigns an dataspace ID and creates a fs_dataspace structure.
     @param dt The dspace table to allocate from.
     @param deathID The dspace table to allocate from.
-    @param fileData The CPIO file data pointer. (No ownership passed)
+    @param fileData The CPIO file data pointer, or NULL for a RamFS file, in which case the caller
+                    sets the ramFile field of the returned dataspace. (No ownership passed)
     @param fileDataSize The CPIO file data size.
     @param permissions The dataspace permissions mask.
     @return Weak pointer to created dataspace. (ie. No ownership)
@@ -121,6 +129,21 @@ struct fs_dataspace* dspace_get_badge(struct fs_dataspace_table *dt, int badge);
 void dspace_delete(struct fs_dataspace_table *dt, int id);
 
 
+/*! @brief Get the current size of the file behind a dataspace.
+    @param dspace The dataspace.
+    @return The size of the CPIO or RamFS file in bytes.
+*/
+size_t dspace_get_size(struct fs_dataspace *dspace);
+
+/*! @brief Read the contents of the file behind a dataspace.
+    @param dspace The dataspace to read.
+    @param offset The offset into the file to read at.
+    @param buf The destination buffer.
+    @param count The maximum number of bytes to read.
+    @return The number of bytes read, which is short at end of file.
+*/
+int dspace_read(struct fs_dataspace *dspace, size_t offset, char *buf, size_t count);
+
 /* ----------------------------- CPIO Dataspace Functions --------------------------------------- */
 
 /*! @brief Associate given window with the dataspace.
@@ -141,6 +164,10 @@ int dspace_window_associate(struct fs_dataspace_table *dt, int winID, int dsID,
                             seL4_CPtr windowCap);
 
 /*! @brief Un-associate given window with previously associated dataspace.
+
+    Any pager frames which were mapped into the window are returned to the pager frame block, so
+    the window must have been unmapped (ie. proc_unregister_as_pager) beforehand.
+
     @param dt The dspace table.
     @param winID The window ID to unassociate.
 */
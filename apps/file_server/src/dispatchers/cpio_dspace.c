@@ -32,29 +32,6 @@
   refos-rpc/data_server.h.
 */
 
-#define CPIO_RAMFS_MAX_CREATED_FILES 64
-#define CPIO_RAMFS_MAX_FILESSIZE 40960
-#define CPIO_RAMFS_MAX_FILENAME 32
-
-/*! @brief Forward declaration of the CPIO archive.
-
-    The CPIO archive is a simple format file archive stored inside a parent program's ELF section.
-    This is a similar idea to something like creating a
-    > const char data[] = { 0x3F, 0xFF, 0x23 ...etc}
-*/
-extern char _cpio_archive[];
-
-/*! @brief Rather hacky minimal ramfs created files.
-    
-    This is a rather terrible hack to allow creation of writable files in CPIO fileserver as a sort
-    of minimal crude RamFS. The functionality is nice for portability, although in the future a
-    much better way to do this should be implemented.
-*/
-static char _ramfs_archive[CPIO_RAMFS_MAX_CREATED_FILES][CPIO_RAMFS_MAX_FILESSIZE];
-static char _ramfs_filename[CPIO_RAMFS_MAX_CREATED_FILES][CPIO_RAMFS_MAX_FILENAME];
-static int _ramfs_filesz[CPIO_RAMFS_MAX_CREATED_FILES];
-static int _ramfs_curfile = 0; /* Incrementally allocated files. */
-
 seL4_CPtr
 data_open_handler(void *rpc_userptr , char* rpc_name , int rpc_flags , int rpc_mode , int rpc_size ,
                   int* rpc_errno)
@@ -67,11 +44,11 @@ data_open_handler(void *rpc_userptr , char* rpc_name , int rpc_flags , int rpc_m
         return 0;
     }
 
-    /* Find file data in CPIO. */
+    /* Find file data in CPIO, using the name index built at startup. */
     dprintf("Opening %s...\n", rpc_name);
     unsigned long fileDataSize = 0;
-    char *fileData = cpio_get_file(_cpio_archive, rpc_name, &fileDataSize);
-    bool fileCreated = false;
+    char *fileData = cpio_index_get_file(&fileServ.cpioIndex, rpc_name, &fileDataSize);
+    struct fs_ramfs_file *ramFile = NULL;
 
     if (fileData && (rpc_flags & O_ACCMODE) != O_RDONLY) {
         /* CPIO dataspaces require read only. */
@@ -80,50 +57,37 @@ data_open_handler(void *rpc_userptr , char* rpc_name , int rpc_flags , int rpc_m
     }
 
     if (!fileData) {
-        for (int i = 0; i < _ramfs_curfile; i++) {
-            if (!strcmp(rpc_name, _ramfs_filename[i])) {
-                if ((rpc_flags & O_CREAT)) {
-                    /* Re-create this file. */
-                    memset(_ramfs_archive[i], 0, CPIO_RAMFS_MAX_FILESSIZE);
-                    _ramfs_filesz[i] = 0;
-                }
-                fileData = _ramfs_archive[i];
-                fileDataSize = _ramfs_filesz[i];
-                fileCreated = true;
-                break;
+        ramFile = ramfs_find(&fileServ.ramfs, rpc_name);
+        if (!ramFile) {
+            if ((rpc_flags & O_CREAT) == 0) {
+                dprintf("File %s not found!\n", rpc_name);
+                SET_ERRNO_PTR(rpc_errno, EFILENOTFOUND);
+                return 0;
             }
+            /* Create new blank RamFS file. */
+            dvprintf("Creating new file %s...\n", rpc_name);
+            ramFile = ramfs_create(&fileServ.ramfs, rpc_name);
+            if (!ramFile) {
+                SET_ERRNO_PTR(rpc_errno, ENOMEM);
+                return 0;
+            }
+        } else if ((rpc_flags & O_TRUNC) || (rpc_flags & O_CREAT)) {
+            /* Re-create this file. */
+            ramfs_truncate(&fileServ.ramfs, ramFile, 0);
         }
     }
 
-    if (!fileData) {
-        if ((rpc_flags & O_CREAT) == 0) {
-            dprintf("File %s not found!\n", rpc_name);
-            SET_ERRNO_PTR(rpc_errno, EFILENOTFOUND);
-            return 0;
-        }
-        /* Assign new blank RAMFS file. */
-        if (_ramfs_curfile >= CPIO_RAMFS_MAX_CREATED_FILES) {
-            SET_ERRNO_PTR(rpc_errno, EACCESSDENIED);
-            return 0;
-        }
-        dvprintf("Creating new file %s...\n", rpc_name);
-        strncpy(_ramfs_filename[_ramfs_curfile], rpc_name, CPIO_RAMFS_MAX_FILENAME);
-        fileData = _ramfs_archive[_ramfs_curfile++];
-        fileDataSize = 0;
-        fileCreated = true;
-    }
-
     /* Allocate new dataspace structure. */
     struct fs_dataspace* nds = dspace_alloc(&fileServ.dspaceTable, c->deathID, fileData,
-        (size_t) fileDataSize, O_RDONLY);
+        (size_t) fileDataSize, ramFile ? (rpc_flags & O_ACCMODE) : O_RDONLY);
     if (!nds) {
         ROS_ERROR("data_open_handler failed to allocate dataspace.");
         SET_ERRNO_PTR(rpc_errno, ENOMEM);
         return 0;
     }
-    nds->fileCreated = fileCreated;
+    nds->ramFile = ramFile;
 
-    dvprintf("%s file %s OK ID %d...\n", fileCreated ? "Created" : "Opened", rpc_name, nds->dID);
+    dvprintf("%s file %s OK ID %d...\n", ramFile ? "Created" : "Opened", rpc_name, nds->dID);
     SET_ERRNO_PTR(rpc_errno, ESUCCESS);
     assert(nds->dataspaceCap);
     return nds->dataspaceCap;
@@ -175,14 +139,8 @@ data_read_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , uint32_t rpc_off
         return 0;
     }
     assert(dspace->magic == FS_DATASPACE_MAGIC);
-    assert(dspace->fileData);
 
-    if (rpc_offset >= dspace->fileDataSize) {
-        return 0;
-    }
-    uint32_t count = MIN(dspace->fileDataSize - rpc_offset, rpc_buf.count);
-    memcpy(rpc_buf.data, dspace->fileData + rpc_offset, count);
-    return count;
+    return dspace_read(dspace, rpc_offset, rpc_buf.data, rpc_buf.count);
 }
 
 int
@@ -206,29 +164,15 @@ data_write_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , uint32_t rpc_of
         return 0;
     }
     assert(dspace->magic == FS_DATASPACE_MAGIC);
-    assert(dspace->fileData);
 
-    if (!dspace->fileCreated) {
+    if (!dspace->ramFile) {
         /* Tried to write to a read only CPIO file. */
         ROS_WARNING("data_write_handler: Tried to write to a read only CPIO file %d.", dspace->dID);
         return -EACCESSDENIED;
     }
 
-    if (rpc_offset + rpc_buf.count > dspace->fileDataSize) {
-        if (rpc_offset + rpc_buf.count > CPIO_RAMFS_MAX_FILESSIZE) {
-            assert(!"File maxsize overflow.");
-            return -ENOMEM;
-        }
-        dspace->fileDataSize = rpc_offset + rpc_buf.count;
-    }
-    for (int i = 0; i < _ramfs_curfile; i++) {
-        if (_ramfs_archive[i] == dspace->fileData) {
-            _ramfs_filesz[i] = dspace->fileDataSize;
-            break;
-        }
-    }
-    memcpy(dspace->fileData + rpc_offset, rpc_buf.data, rpc_buf.count);
-    return rpc_buf.count;
+    return ramfs_write(&fileServ.ramfs, dspace->ramFile, rpc_offset, rpc_buf.data,
+                       rpc_buf.count);
 }
 
 int
@@ -238,11 +182,78 @@ data_getc_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , int rpc_block)
     return EUNIMPLEMENTED;
 }
 
+int
+data_ioctl_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , int rpc_request ,
+                   uint32_t rpc_arg)
+{
+    struct srv_client *c = (struct srv_client *) rpc_userptr;
+    srv_msg_t *m = (srv_msg_t *) c->rpcClient.userptr;
+    assert(c->magic == FS_CLIENT_MAGIC);
+
+    if (rpc_request != REFOS_IOCTL_GET_GENERATION) {
+        return -EINVALIDPARAM;
+    }
+
+    /* Sanity check the dataspace cap. */
+    if (seL4_MessageInfo_get_capsUnwrapped(m->message) != 0x00000001 ||
+        seL4_MessageInfo_get_extraCaps(m->message) != 1) {
+        dprintf("data_ioctl_handler EINVALIDPARAM: bad caps.\n");
+        return -EINVALIDPARAM;
+    }
+
+    struct fs_dataspace* dspace = dspace_get_badge(&fileServ.dspaceTable, rpc_dspace_fd);
+    if (!dspace) {
+        ROS_WARNING("data_ioctl_handler: no such dataspace.");
+        return -EINVALIDPARAM;
+    }
+    assert(dspace->magic == FS_DATASPACE_MAGIC);
+
+    /* CPIO files never change. */
+    return dspace->ramFile ? (int) dspace->ramFile->generation : 0;
+}
+
 off_t
 data_lseek_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , off_t rpc_offset , int rpc_whence)
 {
-    assert(!"data_lseek_handler not implemented");
-    return 0;
+    struct srv_client *c = (struct srv_client *) rpc_userptr;
+    srv_msg_t *m = (srv_msg_t *) c->rpcClient.userptr;
+    assert(c->magic == FS_CLIENT_MAGIC);
+
+    /* Sanity check the dataspace cap. */
+    if (seL4_MessageInfo_get_capsUnwrapped(m->message) != 0x00000001 ||
+        seL4_MessageInfo_get_extraCaps(m->message) != 1) {
+        dprintf("data_lseek_handler EINVALIDPARAM: bad caps.\n");
+        return -EINVALIDPARAM;
+    }
+
+    struct fs_dataspace* dspace = dspace_get_badge(&fileServ.dspaceTable, rpc_dspace_fd);
+    if (!dspace) {
+        ROS_WARNING("data_lseek_handler: no such dataspace.");
+        return -EINVALIDPARAM;
+    }
+    assert(dspace->magic == FS_DATASPACE_MAGIC);
+
+    off_t offset;
+    switch (rpc_whence) {
+        case SEEK_SET:
+            offset = rpc_offset;
+            break;
+        case SEEK_CUR:
+            offset = (off_t) dspace->seekOffset + rpc_offset;
+            break;
+        case SEEK_END:
+            offset = (off_t) dspace_get_size(dspace) + rpc_offset;
+            break;
+        default:
+            return -EINVALIDPARAM;
+    }
+
+    /* Seeking past the end is allowed; a later write leaves a hole. */
+    if (offset < 0) {
+        return -EINVALIDPARAM;
+    }
+    dspace->seekOffset = (uint32_t) offset;
+    return offset;
 }
 
 uint32_t
@@ -266,13 +277,41 @@ data_get_size_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd)
     }
     assert(dspace->magic == FS_DATASPACE_MAGIC);
 
-    return (uint32_t) dspace->fileDataSize;
+    return (uint32_t) dspace_get_size(dspace);
 }
 
 refos_err_t
 data_expand_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , uint32_t rpc_size)
 {
-    return EUNIMPLEMENTED;
+    struct srv_client *c = (struct srv_client *) rpc_userptr;
+    srv_msg_t *m = (srv_msg_t *) c->rpcClient.userptr;
+    assert(c->magic == FS_CLIENT_MAGIC);
+
+    /* Sanity check the dataspace cap. */
+    if (seL4_MessageInfo_get_capsUnwrapped(m->message) != 0x00000001 ||
+        seL4_MessageInfo_get_extraCaps(m->message) != 1) {
+        dprintf("data_expand_handler EINVALIDPARAM: bad caps.\n");
+        return EINVALIDPARAM;
+    }
+
+    struct fs_dataspace* dspace = dspace_get_badge(&fileServ.dspaceTable, rpc_dspace_fd);
+    if (!dspace) {
+        ROS_WARNING("data_expand_handler: no such dataspace.");
+        return EINVALIDPARAM;
+    }
+    assert(dspace->magic == FS_DATASPACE_MAGIC);
+
+    if (!dspace->ramFile) {
+        /* CPIO files are read only. */
+        return EACCESSDENIED;
+    }
+    if (rpc_size < dspace->ramFile->size) {
+        return EINVALIDPARAM;
+    }
+
+    /* Expanding only records the new size; extents are allocated when the hole is written. */
+    ramfs_truncate(&fileServ.ramfs, dspace->ramFile, rpc_size);
+    return ESUCCESS;
 }
 
 refos_err_t
@@ -353,11 +392,16 @@ data_dataunmap_handler(void *rpc_userptr , seL4_CPtr rpc_memoryWindow)
         return EINVALIDPARAM;
     }
 
-    // TODO: proc_unregister_as_pager
+    /* Stop paging this window. This unmaps every frame we have mapped into it, so they may be
+       safely recycled by the window unassociation below. */
+    int error = proc_unregister_as_pager(memoryWindow);
+    if (error != ESUCCESS) {
+        ROS_WARNING("data_dataunmap_handler: failed to unregister as pager.");
+    }
 
     /* Clear any fileserver window ID bookkeeping. */
     dspace_window_unassociate(&fileServ.dspaceTable, winID);
-    csfree(memoryWindow);
+    csfree_delete(memoryWindow);
     return ESUCCESS;
 }
 
@@ -438,6 +482,37 @@ data_provide_data_from_parambuffer_handler(void *rpc_userptr , seL4_CPtr rpc_dsp
     return EUNIMPLEMENTED;
 }
 
+int
+data_poll_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , seL4_CPtr rpc_notifyEP ,
+                  int rpc_events , uint32_t rpc_arg)
+{
+    struct srv_client *c = (struct srv_client *) rpc_userptr;
+    srv_msg_t *m = (srv_msg_t *) c->rpcClient.userptr;
+    assert(c->magic == FS_CLIENT_MAGIC);
+
+    if (seL4_MessageInfo_get_capsUnwrapped(m->message) != 0x00000001 ||
+        seL4_MessageInfo_get_extraCaps(m->message) != 2) {
+        dprintf("data_poll_handler EINVALIDPARAM: bad caps.\n");
+        return -EINVALIDPARAM;
+    }
+
+    /* CPIO files never block, so there is nothing to notify about. Do not printf before the
+       copyout. */
+    seL4_CPtr notifyEP = rpc_copyout_cptr(rpc_notifyEP);
+    if (notifyEP) {
+        csfree_delete(notifyEP);
+    }
+
+    struct fs_dataspace* dspace = dspace_get_badge(&fileServ.dspaceTable, rpc_dspace_fd);
+    if (!dspace) {
+        ROS_WARNING("data_poll_handler: no such dataspace.");
+        return -EINVALIDPARAM;
+    }
+    assert(dspace->magic == FS_DATASPACE_MAGIC);
+
+    return rpc_events & (REFOS_POLL_READ | REFOS_POLL_WRITE);
+}
+
 int
 check_dispatch_data(srv_msg_t *m, void **userptr)
 {
@@ -32,11 +32,135 @@
     an anonymous memory dataspace (ie. the notification buffer).
 */
 
+/*! @brief Fill a pager frame with the window's content at a faulting address.
+
+    The frame is zeroed, and then any CPIO or RamFS file content for the page containing
+    faultAddr is copied in.
+
+    @param dspace The dataspace the window maps.
+    @param dwa The window's dataspace association.
+    @param winBase The window's base address in the client's vspace.
+    @param winSize The window's size.
+    @param faultAddr The faulting address, or the start of a page further into the window.
+    @param pframe The pager frame to fill.
+    @return ESUCCESS if success, refos_err_t otherwise.
+*/
+static int
+fileserv_fill_frame(struct fs_dataspace *dspace, struct dataspace_association_info *dwa,
+                    seL4_Word winBase, seL4_Word winSize, seL4_Word faultAddr, vaddr_t pframe)
+{
+    memset((void*) pframe, 0, REFOS_PAGE_SIZE);
+    if (!dspace->fileData && !dspace->ramFile) {
+        return ESUCCESS;
+    }
+    size_t fileSize = dspace_get_size(dspace);
+
+    /* Round faulting address down to page. */
+    seL4_Word alignedFaultAddr = REFOS_PAGE_ALIGN(faultAddr);
+
+    /* initFrameSkip is to compensate for the case where the window base is not page aligned,
+       and the faulting address is the first page of the window, resulting in a region of
+       page overlap that we can't avoid. Illustration:
+
+                                  winBase   faultAddr
+                                        ▼   ▼
+             |_______|_______|_______|__[―――◯|―――――――|―――――――]_______|_______|
+                                     ▲  ◀――――― window ―――――――▶
+                      alignedFaultAddr  
+                                     ◀――▶ initFrameSkip = (winBase - alignedFaultAddr)
+    */ 
+    size_t initFrameSkip = (winBase > alignedFaultAddr) ? (winBase - alignedFaultAddr) : 0;
+
+    /* dataspaceSkipWinOffset is for all cases except the (unsigned window base addr &
+       first page fault) special case. Illustration:
+       
+                                  winBase                faultAddr
+                                        ▼                ▼
+             |_______|_______|_______|__[――――|―――――――|―――◯―――]_______|_______|
+                                     ▲  ◀――――― window ―――――――▶
+                      alignedFaultAddr  
+                                        ◀――――――――――――――――▶ dataspaceSkipWinOffset
+                                          = (alignedFaultAddr - winBase)
+    */ 
+    size_t dataspaceSkipWinOffset = (winBase > alignedFaultAddr) ?
+            0 : (alignedFaultAddr - winBase);
+
+    /* nbytes is the number of bytes from the offset dataspace start that we should copy into
+       the frame. There are 4 cases here:
+
+        Case 1:
+             |_______|_______|_______|__[――――|―――――――|―――◯―――]_______|_______| 
+                                        ◀――――▶ nbytes = (REFOS_PAGE_SIZE - initFrameSkip)
+
+        Case 2:
+             |_______|_______|_______[―――――――|―――◯―――|―――――――]_______|_______| 
+                                             ◀―――――――▶ nbytes = REFOS_PAGE_SIZE
+
+        Case 3:
+             |_______|_______|_______[―――――――|―――――――|―◯―××××]_______|_______| 
+                                                     ◀―――▶ nbytes = fileDataSize -
+                                                        dataspaceSkipWinOffset - dataspaceOffset
+                    (× = indicates there is no more CPIO file data here)
+
+        Case 3:
+             |_______|_______|_______[―――――――|―――――――|―◯――]__|_______|_______| 
+                                                     ◀――――▶ nbytes =
+                                                            winSize - dataspaceSkipWinOffset
+    */
+    size_t nbytes = MIN(REFOS_PAGE_SIZE - initFrameSkip,
+            fileSize - dataspaceSkipWinOffset - dwa->dataspaceOffset);
+    nbytes = MIN(nbytes, winSize - dataspaceSkipWinOffset);
+
+    /* Check if nbytes is sane. A RamFS file may have been truncated since it was mapped, so
+       faults past its end simply get a zero frame. */
+    if ((fileSize - dataspaceSkipWinOffset - dwa->dataspaceOffset > fileSize) ||
+        (fileSize - dataspaceSkipWinOffset > fileSize) ||
+        (fileSize - dwa->dataspaceOffset > fileSize)) {
+        if (!dspace->ramFile) {
+            ROS_ERROR("nbytes overflowed.\n");
+            assert(!"nbytes overflowed. Fileserver bug.");
+            return EINVALID;
+        }
+        nbytes = 0;
+    }
+
+    dspace_read(dspace, dwa->dataspaceOffset + dataspaceSkipWinOffset,
+                (char*) (pframe + initFrameSkip), nbytes);
+    return ESUCCESS;
+}
+
+/*! @brief Count the pages following a faulting page that are worth reading ahead.
+
+    These are the whole pages still inside the window which hold file content, up to
+    FILESERVER_FAULT_READAHEAD_PAGES. Anything past the end of the file is left to fault in
+    on its own.
+*/
+static uint32_t
+fileserv_readahead_pages(struct fs_dataspace *dspace, struct dataspace_association_info *dwa,
+                         seL4_Word winBase, seL4_Word winSize, seL4_Word faultAddr)
+{
+    if (!dspace->fileData && !dspace->ramFile) {
+        return 0;
+    }
+    size_t fileSize = dspace_get_size(dspace);
+    seL4_Word page = REFOS_PAGE_ALIGN(faultAddr);
+    uint32_t n = 0;
+    for (; n < FILESERVER_FAULT_READAHEAD_PAGES; n++) {
+        page += REFOS_PAGE_SIZE;
+        if (page + REFOS_PAGE_SIZE > winBase + winSize ||
+                dwa->dataspaceOffset + (page - winBase) >= fileSize) {
+            break;
+        }
+    }
+    return n;
+}
+
 /*! @brief Handles client page fault notifications.
     
     This function handles client page fault notifications from the process server. When we act as
     the pager, the process server delegates all page faults to us via this notification.
-    We then choose a page to map, and map it.
+    We then choose a page to map, along with a few pages of read-ahead following it, and map them
+    all with a single batched call.
 
     @param notification Structure containing the notification message, read from the notification
                         ring buffer.
@@ -45,8 +169,6 @@
 static int
 handle_fileserver_fault(struct proc_notification *notification)
 {
-    int error;
-
     dvprintf(COLOUR_M "## Fileserv Handling Notification VM fault delegation...\n" COLOUR_RESET);
     dvprintf("     Label: PROCSERV_NOTIFY_FAULT_DELEGATION\n");
     dvprintf("     winID: %d\n", notification->arg[0]);
@@ -82,107 +204,96 @@ handle_fileserver_fault(struct proc_notification *notification)
         return DISPATCH_ERROR;
     }
     size_t faultAddrWinOffset = faultAddr - winBase;
+    uint32_t nReadAhead = fileserv_readahead_pages(dspace, dwa, winBase, winSize, faultAddr);
+    seL4_Word frames[PROCSERV_WINDOW_MAP_BATCH_MAX];
+    uint32_t nFrames = 0;
+    int nMapped;
+
+    /* RamFS files are paged with their own extents when the window and dataspace offset are page
+       aligned, so client writes through the mapping land in the file without copying. The
+       extents stay owned by the file, and are not book-kept as window frames. Read-ahead only
+       maps extents which already exist, rather than filling in holes. */
+    if (dspace->ramFile && (winBase % REFOS_PAGE_SIZE) == 0 &&
+            (dwa->dataspaceOffset % REFOS_PAGE_SIZE) == 0) {
+        uint32_t page = (dwa->dataspaceOffset + REFOS_PAGE_ALIGN(faultAddrWinOffset)) /
+                        REFOS_PAGE_SIZE;
+        for (; nFrames <= nReadAhead; nFrames++) {
+            frames[nFrames] = ramfs_get_extent(&fileServ.ramfs, dspace->ramFile, page + nFrames,
+                                               nFrames == 0);
+            if (!frames[nFrames]) {
+                break;
+            }
+        }
+        if (nFrames == 0) {
+            ROS_ERROR("File Server Out of memory handling VM fault. Paging not implemented.");
+            ROS_ERROR("  Try increasing FILESERVER_MAX_FRAME_CHUNKS.");
+            ROS_ERROR("  Faulting client will be permanently blocked.");
+            return DISPATCH_ERROR;
+        }
+        dvprintf("    Mapping %u extents at  0x%x ―――▶ client 0x%x\n", nFrames,
+                (uint32_t) frames[0], (uint32_t) faultAddr);
+        nMapped = proc_window_map_batch(dwa->objectCap, faultAddrWinOffset, frames, nFrames);
+        if (nMapped <= 0) {
+            ROS_ERROR("File Server Unexpected error while mapping extent!");
+            ROS_ERROR("  Most likely a file server bug.");
+            assert(!"proc_window_map_batch error. Fileserver bug.");
+            return DISPATCH_ERROR;
+        }
+        return DISPATCH_SUCCESS;
+    }
 
-    /* Allocate a frame to page client with. */
-    vaddr_t pframe = pager_alloc_frame(&fileServ.pageFrameBlock);
-    if (!pframe) {
+    /* Allocate and fill frames to page the client with. Read-ahead stops quietly if the frame
+       pool runs low; only the faulting page itself must have a frame. */
+    for (; nFrames <= nReadAhead; nFrames++) {
+        frames[nFrames] = pager_alloc_frame(&fileServ.pageFrameBlock);
+        if (!frames[nFrames]) {
+            break;
+        }
+        seL4_Word pageAddr = nFrames == 0 ? faultAddr :
+                             REFOS_PAGE_ALIGN(faultAddr) + nFrames * REFOS_PAGE_SIZE;
+        if (fileserv_fill_frame(dspace, dwa, winBase, winSize, pageAddr,
+                                frames[nFrames]) != ESUCCESS) {
+            nFrames++;
+            goto exit1;
+        }
+    }
+    if (nFrames == 0) {
         ROS_ERROR("File Server Out of memory handling VM fault. Paging not implemented.");
-        ROS_ERROR("  Try increasing FILESERVER_MAX_PAGE_FRAMES.");
+        ROS_ERROR("  Try increasing FILESERVER_MAX_FRAME_CHUNKS.");
         ROS_ERROR("  Faulting client will be permanently blocked.");
         return DISPATCH_ERROR;
     }
-    memset((void*) pframe, 0, REFOS_PAGE_SIZE);
-
-    /* Copy any CPIO file content if there is data. */
-    if (dspace->fileData) {
-        /* Round faulting address down to page. */
-        seL4_Word alignedFaultAddr = REFOS_PAGE_ALIGN(faultAddr);
-
-        /* initFrameSkip is to compensate for the case where the window base is not page aligned,
-           and the faulting address is the first page of the window, resulting in a region of
-           page overlap that we can't avoid. Illustration:
-
-                                      winBase   faultAddr
-                                            ▼   ▼
-                 |_______|_______|_______|__[―――◯|―――――――|―――――――]_______|_______|
-                                         ▲  ◀――――― window ―――――――▶
-                          alignedFaultAddr  
-                                         ◀――▶ initFrameSkip = (winBase - alignedFaultAddr)
-        */ 
-        size_t initFrameSkip = (winBase > alignedFaultAddr) ? (winBase - alignedFaultAddr) : 0;
-
-        /* dataspaceSkipWinOffset is for all cases except the (unsigned window base addr &
-           first page fault) special case. Illustration:
-           
-                                      winBase                faultAddr
-                                            ▼                ▼
-                 |_______|_______|_______|__[――――|―――――――|―――◯―――]_______|_______|
-                                         ▲  ◀――――― window ―――――――▶
-                          alignedFaultAddr  
-                                            ◀――――――――――――――――▶ dataspaceSkipWinOffset
-                                              = (alignedFaultAddr - winBase)
-        */ 
-        size_t dataspaceSkipWinOffset = (winBase > alignedFaultAddr) ?
-                0 : (alignedFaultAddr - winBase);
-
-        /* nbytes is the number of bytes from the offset dataspace start that we should copy into
-           the frame. There are 4 cases here:
-
-            Case 1:
-                 |_______|_______|_______|__[――――|―――――――|―――◯―――]_______|_______| 
-                                            ◀――――▶ nbytes = (REFOS_PAGE_SIZE - initFrameSkip)
-
-            Case 2:
-                 |_______|_______|_______[―――――――|―――◯―――|―――――――]_______|_______| 
-                                                 ◀―――――――▶ nbytes = REFOS_PAGE_SIZE
-
-            Case 3:
-                 |_______|_______|_______[―――――――|―――――――|―◯―××××]_______|_______| 
-                                                         ◀―――▶ nbytes = fileDataSize -
-                                                            dataspaceSkipWinOffset - dataspaceOffset
-                        (× = indicates there is no more CPIO file data here)
-
-            Case 3:
-                 |_______|_______|_______[―――――――|―――――――|―◯――]__|_______|_______| 
-                                                         ◀――――▶ nbytes =
-                                                                winSize - dataspaceSkipWinOffset
-        */
-        size_t nbytes = MIN(REFOS_PAGE_SIZE - initFrameSkip,
-                dspace->fileDataSize - dataspaceSkipWinOffset - dwa->dataspaceOffset);
-        nbytes = MIN(nbytes, winSize - dataspaceSkipWinOffset);
-
-        /* Check if nbytes is sane. */
-        if ((dspace->fileDataSize - dataspaceSkipWinOffset - dwa->dataspaceOffset >
-                dspace->fileDataSize) ||
-            (dspace->fileDataSize - dataspaceSkipWinOffset > dspace->fileDataSize) ||
-            (dspace->fileDataSize - dwa->dataspaceOffset > dspace->fileDataSize)) {
-            ROS_ERROR("nbytes overflowed.\n");
-            assert(!"nbytes overflowed. Fileserver bug.");
-            pager_free_frame(&fileServ.pageFrameBlock, pframe);
-            return DISPATCH_ERROR;
-        }
-
-        memcpy (
-                (void*) (pframe + initFrameSkip),
-                dspace->fileData + dwa->dataspaceOffset + dataspaceSkipWinOffset,
-                nbytes
-        );
-    }
 
-    /* Now map the frame into the client's vspace window. */
-    dvprintf("    Mapping frame at  0x%x ―――▶ client 0x%x\n", (uint32_t) pframe,
+    /* Now map the frames into the client's vspace window. */
+    dvprintf("    Mapping %u frames at  0x%x ―――▶ client 0x%x\n", nFrames, (uint32_t) frames[0],
             (uint32_t) faultAddr);
-    error = proc_window_map(dwa->objectCap, faultAddrWinOffset, (seL4_Word) pframe);
-    if (error) {
+    nMapped = proc_window_map_batch(dwa->objectCap, faultAddrWinOffset, frames, nFrames);
+    if (nMapped <= 0) {
         ROS_ERROR("File Server Unexpected error while mapping frame!");
         ROS_ERROR("  Most likely a file server bug.");
-        assert(!"proc_window_map error. Fileserver bug.");
-        pager_free_frame(&fileServ.pageFrameBlock, pframe);
-        return DISPATCH_ERROR;
+        assert(!"proc_window_map_batch error. Fileserver bug.");
+        goto exit1;
     }
 
-    dvprintf("    Successfully mapped frame...\n");
+    /* Book-keep the mapped frames, so they may be returned to the pool when the window is
+       unmapped. Read-ahead frames which didn't get mapped go straight back. */
+    for (uint32_t i = 0; i < nFrames; i++) {
+        if ((int) i < nMapped) {
+            cvector_add(&dwa->frames, (cvector_item_t) frames[i]);
+        } else {
+            pager_free_frame(&fileServ.pageFrameBlock, frames[i]);
+        }
+    }
+
+    dvprintf("    Successfully mapped %d frames...\n", nMapped);
     return DISPATCH_SUCCESS;
+
+    /* Exit stack. */
+exit1:
+    for (uint32_t i = 0; i < nFrames; i++) {
+        pager_free_frame(&fileServ.pageFrameBlock, frames[i]);
+    }
+    return DISPATCH_ERROR;
 }
 
 /*! @brief Handles client content init notifications.
@@ -231,15 +342,24 @@ handle_fileserver_content_init(struct proc_notification *notification)
 
     /* Check the content size to copy. There are 2 cases here: either the size to copy ends
        with the next page boundary, or is cut short because we've ran out of file data. */
-    size_t contentSize = MIN(dspace->fileDataSize - dataspaceOffset, REFOS_PAGE_SIZE);
+    size_t fileSize = dspace_get_size(dspace);
+    size_t contentSize = MIN(fileSize - dataspaceOffset, REFOS_PAGE_SIZE);
     dvprintf("    Fault file source = 0x%x\n", (uint32_t) dataspaceOffset);
 
-    /* Provide the data back to the process server who notified us. */
-    assert(dataspaceOffset < dspace->fileDataSize);
-    if (dspace->fileData) {
+    /* Provide the data back to the process server who notified us. RamFS content may be split
+       across extents, so gather it into a bounce page first. */
+    assert(dataspaceOffset < fileSize);
+    if (dspace->fileData || dspace->ramFile) {
+        static char contentPage[REFOS_PAGE_SIZE];
+        char *content = contentPage;
+        if (dspace->ramFile) {
+            contentSize = dspace_read(dspace, dataspaceOffset, contentPage, contentSize);
+        } else {
+            content = dspace->fileData + dataspaceOffset;
+        }
         int error = data_provide_data(
                 REFOS_PROCSERV_EP, dda->objectCap,
-                destDataspaceOffset, (char*)dspace->fileData + dataspaceOffset,
+                destDataspaceOffset, content,
                 contentSize, &fileServCommon->procServParamBuffer
         );
         if (error != ESUCCESS) {
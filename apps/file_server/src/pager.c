@@ -18,6 +18,10 @@
     (cpool_t structure), with the big dataspace mapped into a window. We then call data_datamap
     in order to page frames into faulting clients, after initialising them with the requested
     CPIO contents.
+
+    The frame block is made of chunks, each its own dataspace and window. When every chunk is
+    full, another one is created, so ramfs files are not limited to the size of the first chunk.
+    Chunks are never given back until the frame block is released.
 */
 
 #include <stdlib.h>
@@ -38,46 +42,101 @@
 #include "pager.h"
 #include "state.h"
 
-void
-pager_init(struct fs_frame_block* fb, uint32_t framesSize)
+/*! @brief Create a new chunk and add it to the frame block.
+    @param fb The frame block to grow.
+    @return The new chunk if success, NULL otherwise. (No ownership)
+*/
+static struct fs_frame_chunk *
+pager_add_chunk(struct fs_frame_block *fb)
 {
-    assert(fb);
-    fb->initialised = false;
-
-    /* Initialise the frame pool allocator. */
-    dprintf("        Initialising frame block allocator pool...\n");
-    assert(framesSize % REFOS_PAGE_SIZE == 0);
-    fb->frameBlockNumPages = framesSize / REFOS_PAGE_SIZE;
-    cpool_init(&fb->framePool, 1, fb->frameBlockNumPages);
+    uint32_t framesSize = fb->chunkNumPages * REFOS_PAGE_SIZE;
+    struct fs_frame_chunk *chunk = malloc(sizeof(struct fs_frame_chunk));
+    if (!chunk) {
+        ROS_ERROR("pager_add_chunk out of memory.");
+        return NULL;
+    }
+    chunk->frameBlockNumPages = fb->chunkNumPages;
 
     /* Initialise the anonymouse RAM dataspace to allocate from. */
-    dprintf("        Creating pager frame block...\n");
+    dprintf("        Creating pager frame block chunk %d...\n", cvector_count(&fb->chunks));
     int error = EINVALID;
-    fb->dataspace = data_open(REFOS_PROCSERV_EP, "anon", O_CREAT | O_WRONLY  |O_TRUNC, O_RDWR,
+    chunk->dataspace = data_open(REFOS_PROCSERV_EP, "anon", O_CREAT | O_WRONLY  |O_TRUNC, O_RDWR,
         framesSize, &error);
-    if (error != ESUCCESS || !fb->dataspace) {
-        ROS_ERROR("page_init failed to open anon dataspace.");
-        assert(!"page_init failed to open anon dataspace.");
-        return;
+    if (error != ESUCCESS || !chunk->dataspace) {
+        ROS_ERROR("pager_add_chunk failed to open anon dataspace.");
+        goto exit1;
     }
 
     /* Allocate the window to map things into. */
     dprintf("        Allocating frame block window...\n");
-    fb->frameBlockVAddr = walloc(fb->frameBlockNumPages, &fb->window);
-    if (!fb->frameBlockVAddr || !fb->window) {
-        ROS_ERROR("page_init failed to allocate window.");
-        assert(!"page_init failed to allocate window.");
-        return;
+    chunk->frameBlockVAddr = walloc(chunk->frameBlockNumPages, &chunk->window);
+    if (!chunk->frameBlockVAddr || !chunk->window) {
+        ROS_ERROR("pager_add_chunk failed to allocate window.");
+        goto exit2;
     }
     dprintf("        Allocated frame block window 0x%x --> 0x%x...\n",
-        fb->frameBlockVAddr, fb->frameBlockVAddr + framesSize);
+        chunk->frameBlockVAddr, chunk->frameBlockVAddr + framesSize);
 
     /* Map the dataspace into the window. */
     dprintf("        Datamapping frame block...\n");
-    error = data_datamap(REFOS_PROCSERV_EP, fb->dataspace, fb->window, 0);
+    error = data_datamap(REFOS_PROCSERV_EP, chunk->dataspace, chunk->window, 0);
     if (error != ESUCCESS) {
-        ROS_ERROR("page_init failed to datamap dataspace to window.");
-        assert(!"page_init failed to datamap dataspace to window.");
+        ROS_ERROR("pager_add_chunk failed to datamap dataspace to window.");
+        goto exit3;
+    }
+
+    /* Frame 0 is never handed out, as cpool_alloc() uses 0 for failure. */
+    cpool_init(&chunk->framePool, 1, chunk->frameBlockNumPages - 1);
+    cvector_add(&fb->chunks, (cvector_item_t) chunk);
+    return chunk;
+
+    /* Exit stack. */
+exit3:
+    walloc_free(chunk->frameBlockVAddr, chunk->frameBlockNumPages);
+exit2:
+    data_close(REFOS_PROCSERV_EP, chunk->dataspace);
+    seL4_CNode_Delete(REFOS_CSPACE, chunk->dataspace, seL4_WordBits);
+    csfree(chunk->dataspace);
+exit1:
+    free(chunk);
+    return NULL;
+}
+
+/*! @brief Find the chunk a frame belongs to.
+    @param fb The frame block to search.
+    @param frame VAddr of the frame.
+    @return The chunk containing the frame if found, NULL otherwise. (No ownership)
+*/
+static struct fs_frame_chunk *
+pager_find_chunk(struct fs_frame_block *fb, vaddr_t frame)
+{
+    int c = cvector_count(&fb->chunks);
+    for (int i = 0; i < c; i++) {
+        struct fs_frame_chunk *chunk = (struct fs_frame_chunk *) cvector_get(&fb->chunks, i);
+        assert(chunk);
+        if (frame >= chunk->frameBlockVAddr &&
+            frame < chunk->frameBlockVAddr + chunk->frameBlockNumPages * REFOS_PAGE_SIZE) {
+            return chunk;
+        }
+    }
+    return NULL;
+}
+
+void
+pager_init(struct fs_frame_block* fb, uint32_t framesSize, uint32_t maxChunks)
+{
+    assert(fb);
+    fb->initialised = false;
+
+    /* Initialise the chunk list, and the first chunk to allocate from. */
+    dprintf("        Initialising frame block allocator pool...\n");
+    assert(framesSize % REFOS_PAGE_SIZE == 0 && framesSize > REFOS_PAGE_SIZE);
+    assert(maxChunks >= 1);
+    fb->chunkNumPages = framesSize / REFOS_PAGE_SIZE;
+    fb->maxChunks = maxChunks;
+    cvector_init(&fb->chunks);
+    if (!pager_add_chunk(fb)) {
+        assert(!"page_init failed to create the first frame block chunk.");
         return;
     }
 
@@ -89,17 +148,24 @@ pager_release(struct fs_frame_block* fb)
 {
     fb->initialised = false;
 
-    /* Destroy the dataspace and memory window. */
-    data_close(REFOS_PROCSERV_EP, fb->dataspace);
-    seL4_CNode_Delete(REFOS_CSPACE, fb->dataspace, seL4_WordBits);
-    proc_delete_mem_window(fb->window);
-    csfree(fb->dataspace);
-    csfree(fb->window);
-
-    /* Release the allocator pool. */
-    fb->frameBlockVAddr = 0;
-    fb->frameBlockNumPages = 0;
-    cpool_release(&fb->framePool);
+    /* Destroy the dataspaces and memory windows. */
+    int c = cvector_count(&fb->chunks);
+    for (int i = 0; i < c; i++) {
+        struct fs_frame_chunk *chunk = (struct fs_frame_chunk *) cvector_get(&fb->chunks, i);
+        assert(chunk);
+        data_close(REFOS_PROCSERV_EP, chunk->dataspace);
+        seL4_CNode_Delete(REFOS_CSPACE, chunk->dataspace, seL4_WordBits);
+        proc_delete_mem_window(chunk->window);
+        csfree(chunk->dataspace);
+        csfree(chunk->window);
+        cpool_release(&chunk->framePool);
+        free(chunk);
+    }
+
+    /* Release the chunk list. */
+    cvector_free(&fb->chunks);
+    fb->chunkNumPages = 0;
+    fb->maxChunks = 0;
 }
 
 vaddr_t
@@ -109,30 +175,48 @@ pager_alloc_frame(struct fs_frame_block *fb)
     if (!fb->initialised) {
         return (vaddr_t) 0;
     }
-    vaddr_t pagen = (vaddr_t) cpool_alloc(&fb->framePool);
-    if (pagen == 0 || pagen >= fb->frameBlockNumPages) {
-        /* Allocation failed. */
+
+    /* Try the newest chunk first, since older chunks are usually full. */
+    int c = cvector_count(&fb->chunks);
+    for (int i = c - 1; i >= 0; i--) {
+        struct fs_frame_chunk *chunk = (struct fs_frame_chunk *) cvector_get(&fb->chunks, i);
+        assert(chunk);
+        vaddr_t pagen = (vaddr_t) cpool_alloc(&chunk->framePool);
+        if (pagen != 0 && pagen < chunk->frameBlockNumPages) {
+            return (vaddr_t) (chunk->frameBlockVAddr + (pagen * REFOS_PAGE_SIZE));
+        }
+    }
+
+    /* Every chunk is full, so grow the frame block. */
+    if (c >= fb->maxChunks) {
+        return (vaddr_t) 0;
+    }
+    struct fs_frame_chunk *chunk = pager_add_chunk(fb);
+    if (!chunk) {
         return (vaddr_t) 0;
     }
-    return (vaddr_t) (fb->frameBlockVAddr + (pagen * REFOS_PAGE_SIZE));
+    vaddr_t pagen = (vaddr_t) cpool_alloc(&chunk->framePool);
+    assert(pagen != 0);
+    return (vaddr_t) (chunk->frameBlockVAddr + (pagen * REFOS_PAGE_SIZE));
 }
 
 void
 pager_free_frame(struct fs_frame_block *fb, vaddr_t frame)
 {
     assert(fb && fb->initialised);
-    if (frame < fb->frameBlockVAddr) {
+    struct fs_frame_chunk *chunk = pager_find_chunk(fb, frame);
+    if (!chunk) {
         ROS_WARNING("pager_free_frame: invalid frame vaddr.");
         return;
     }
-    int pagen = (frame - fb->frameBlockVAddr) / REFOS_PAGE_SIZE;
-    if (pagen <= 0 || pagen >= fb->frameBlockNumPages) {
+    int pagen = (frame - chunk->frameBlockVAddr) / REFOS_PAGE_SIZE;
+    if (pagen <= 0) {
         ROS_WARNING("pager_free_frame: invalid frame vaddr.");
         return;
     }
-    if (cpool_check(&fb->framePool, pagen)) {
+    if (cpool_check(&chunk->framePool, pagen)) {
         ROS_WARNING("pager_free_frame: frame already freed.");
         return;
     }
-    cpool_free(&fb->framePool, pagen);
+    cpool_free(&chunk->framePool, pagen);
 }
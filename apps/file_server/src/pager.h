@@ -20,37 +20,47 @@
 #include <sel4/types.h>
 #include <sel4/sel4.h>
 #include <data_struct/cpool.h>
+#include <data_struct/cvector.h>
 
 typedef seL4_Word vaddr_t;
 
+/*! @brief A chunk of the pager frame block: one anon RAM dataspace mapped into one window. */
+struct fs_frame_chunk {
+    cpool_t framePool;
+    seL4_CPtr dataspace;
+    seL4_CPtr window;
+    vaddr_t frameBlockVAddr;
+    uint32_t frameBlockNumPages;
+};
+
 /*! @brief CPIO File server RAM frame block
 
     CPIO Fileserver frame block structure, stores book-keeping data for allocation of frames used
-    for paging clients.
+    for paging clients and for ramfs file extents. The block starts out as a single chunk, and
+    grows by another chunk of the same size whenever every existing chunk is full, up to
+    maxChunks chunks.
  */
 struct fs_frame_block {
     bool initialised;
-    cpool_t framePool;
-    seL4_CPtr dataspace;
-    seL4_CPtr window;
-    vaddr_t frameBlockVAddr;
-    uint32_t frameBlockNumPages;
+    cvector_t chunks;            /*!< The chunks allocated so far. (struct fs_frame_chunk*) */
+    uint32_t chunkNumPages;      /*!< Number of pages in each chunk. */
+    uint32_t maxChunks;          /*!< Most chunks the block may grow to. */
 };
 
 /*! @brief Initialises pager frame block table.
     @param fb The frame block to initialise.
-    @param framesSize The size of the pager frame block in bytes. This number must be a multiple
-                      of PAGE_SIZE (4k).
-    @return A pager frame block if success, NULL otherwise.
+    @param framesSize The size of each chunk of the pager frame block in bytes. This number must
+                      be a multiple of PAGE_SIZE (4k).
+    @param maxChunks The most chunks the frame block may grow to. Must be at least 1.
  */
-void pager_init(struct fs_frame_block* fb, uint32_t framesSize);
+void pager_init(struct fs_frame_block* fb, uint32_t framesSize, uint32_t maxChunks);
 
 /*! @brief Tear downs a pager frame block table and releases all associated memory.
     @param fb The frame block to de-initialise.
 */
 void pager_release(struct fs_frame_block* fb);
 
-/*! @brief Allocates a frame from the pager frame block.
+/*! @brief Allocates a frame from the pager frame block, growing the block if it is full.
     @param fb Pager frame block table to allocate from.
     @return Virtual addr of a pager frame if success, NULL otherwise.
  */
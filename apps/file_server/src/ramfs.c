@@ -0,0 +1,262 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+#include <utils/arith.h>
+#include <refos/refos.h>
+#include <refos/error.h>
+#include "ramfs.h"
+#include "state.h"
+
+/*! @file
+    @brief CPIO Fileserver writable RAM filesystem.
+
+    See ramfs.h for an overview. Extents are never shared between files, and files are never
+    deleted, so weak pointers to files stay valid for the lifetime of the file server.
+*/
+
+#define RAMFS_NPAGES(sz) (((sz) + REFOS_PAGE_SIZE - 1) / REFOS_PAGE_SIZE)
+
+/* ------------------------------------ Internal helpers ---------------------------------------- */
+
+/*! @brief Zero a byte range of a file, skipping over holes.
+    @param f The file.
+    @param start Start offset of the range.
+    @param end End offset of the range (exclusive).
+*/
+static void
+ramfs_zero_range(struct fs_ramfs_file *f, size_t start, size_t end)
+{
+    while (start < end) {
+        uint32_t page = start / REFOS_PAGE_SIZE;
+        size_t pageOffset = start % REFOS_PAGE_SIZE;
+        size_t n = MIN(REFOS_PAGE_SIZE - pageOffset, end - start);
+        if (page >= cvector_count(&f->extents)) {
+            return;
+        }
+        vaddr_t extent = (vaddr_t) cvector_get(&f->extents, page);
+        if (extent) {
+            memset((void*) (extent + pageOffset), 0, n);
+        }
+        start += n;
+    }
+}
+
+/* ------------------------------------ RamFS functions ----------------------------------------- */
+
+void
+ramfs_init(struct fs_ramfs *fs, struct fs_frame_block *frameBlock)
+{
+    assert(fs && frameBlock);
+    fs->frameBlock = frameBlock;
+    fs->generation = 0;
+    cvector_init(&fs->files);
+}
+
+void
+ramfs_release(struct fs_ramfs *fs)
+{
+    assert(fs);
+    int c = cvector_count(&fs->files);
+    for (int i = 0; i < c; i++) {
+        struct fs_ramfs_file *f = (struct fs_ramfs_file *) cvector_get(&fs->files, i);
+        assert(f && f->magic == FS_RAMFS_FILE_MAGIC);
+        f->mapCount = 0;
+        ramfs_truncate(fs, f, 0);
+        cvector_free(&f->extents);
+        free(f->name);
+        free(f);
+    }
+    cvector_free(&fs->files);
+}
+
+struct fs_ramfs_file *
+ramfs_find(struct fs_ramfs *fs, const char *name)
+{
+    assert(fs);
+    if (!name) {
+        return NULL;
+    }
+    int c = cvector_count(&fs->files);
+    for (int i = 0; i < c; i++) {
+        struct fs_ramfs_file *f = (struct fs_ramfs_file *) cvector_get(&fs->files, i);
+        assert(f && f->magic == FS_RAMFS_FILE_MAGIC);
+        if (!strcmp(f->name, name)) {
+            return f;
+        }
+    }
+    return NULL;
+}
+
+struct fs_ramfs_file *
+ramfs_create(struct fs_ramfs *fs, const char *name)
+{
+    assert(fs && name);
+    assert(!ramfs_find(fs, name));
+
+    struct fs_ramfs_file *f = malloc(sizeof(struct fs_ramfs_file));
+    if (!f) {
+        ROS_ERROR("ramfs_create out of memory.");
+        return NULL;
+    }
+    f->name = strdup(name);
+    if (!f->name) {
+        ROS_ERROR("ramfs_create out of memory.");
+        free(f);
+        return NULL;
+    }
+    f->magic = FS_RAMFS_FILE_MAGIC;
+    f->size = 0;
+    f->mapCount = 0;
+    cvector_init(&f->extents);
+    ramfs_file_changed(fs, f);
+    cvector_add(&fs->files, (cvector_item_t) f);
+    return f;
+}
+
+void
+ramfs_file_changed(struct fs_ramfs *fs, struct fs_ramfs_file *f)
+{
+    assert(fs && f && f->magic == FS_RAMFS_FILE_MAGIC);
+    /* Kept positive, so that data_ioctl() can return it. */
+    fs->generation = (fs->generation % INT_MAX) + 1;
+    f->generation = fs->generation;
+}
+
+void
+ramfs_truncate(struct fs_ramfs *fs, struct fs_ramfs_file *f, size_t size)
+{
+    assert(fs && f && f->magic == FS_RAMFS_FILE_MAGIC);
+    ramfs_file_changed(fs, f);
+
+    if (size > f->size) {
+        /* Expanding. The new range is a hole, except for the tail of the old last page which may
+           hold stale bytes written through a mapping past the old end of file. */
+        ramfs_zero_range(f, f->size, MIN(size, RAMFS_NPAGES(f->size) * REFOS_PAGE_SIZE));
+        f->size = size;
+        return;
+    }
+
+    /* Truncating. Zero the tail of the new last page. */
+    ramfs_zero_range(f, size, RAMFS_NPAGES(size) * REFOS_PAGE_SIZE);
+
+    /* Release any extents wholly past the new end of file. Mapped extents are zeroed instead,
+       as they may still be paged into a client window. */
+    uint32_t npages = RAMFS_NPAGES(size);
+    if (f->mapCount > 0) {
+        ramfs_zero_range(f, npages * REFOS_PAGE_SIZE, cvector_count(&f->extents) * REFOS_PAGE_SIZE);
+    } else {
+        while (cvector_count(&f->extents) > npages) {
+            int last = cvector_count(&f->extents) - 1;
+            vaddr_t extent = (vaddr_t) cvector_get(&f->extents, last);
+            if (extent) {
+                pager_free_frame(fs->frameBlock, extent);
+            }
+            cvector_delete(&f->extents, last);
+        }
+    }
+    f->size = size;
+}
+
+vaddr_t
+ramfs_get_extent(struct fs_ramfs *fs, struct fs_ramfs_file *f, uint32_t page, bool alloc)
+{
+    assert(fs && f && f->magic == FS_RAMFS_FILE_MAGIC);
+    if (page < cvector_count(&f->extents)) {
+        vaddr_t extent = (vaddr_t) cvector_get(&f->extents, page);
+        if (extent || !alloc) {
+            return extent;
+        }
+    } else if (!alloc) {
+        return (vaddr_t) 0;
+    }
+
+    /* Allocate a fresh zeroed extent for this hole. */
+    vaddr_t extent = pager_alloc_frame(fs->frameBlock);
+    if (!extent) {
+        ROS_WARNING("ramfs_get_extent: out of pager frames.");
+        return (vaddr_t) 0;
+    }
+    memset((void*) extent, 0, REFOS_PAGE_SIZE);
+    while (cvector_count(&f->extents) <= page) {
+        cvector_add(&f->extents, (cvector_item_t) 0);
+    }
+    cvector_set(&f->extents, page, (cvector_item_t) extent);
+    return extent;
+}
+
+int
+ramfs_read(struct fs_ramfs_file *f, size_t offset, char *buf, size_t count)
+{
+    assert(f && f->magic == FS_RAMFS_FILE_MAGIC);
+    if (offset >= f->size) {
+        return 0;
+    }
+    count = MIN(count, f->size - offset);
+
+    size_t done = 0;
+    while (done < count) {
+        uint32_t page = (offset + done) / REFOS_PAGE_SIZE;
+        size_t pageOffset = (offset + done) % REFOS_PAGE_SIZE;
+        size_t n = MIN(REFOS_PAGE_SIZE - pageOffset, count - done);
+        vaddr_t extent = (page < cvector_count(&f->extents)) ?
+                (vaddr_t) cvector_get(&f->extents, page) : 0;
+        if (extent) {
+            memcpy(buf + done, (void*) (extent + pageOffset), n);
+        } else {
+            memset(buf + done, 0, n);
+        }
+        done += n;
+    }
+    return (int) done;
+}
+
+int
+ramfs_write(struct fs_ramfs *fs, struct fs_ramfs_file *f, size_t offset, const char *buf,
+            size_t count)
+{
+    assert(fs && f && f->magic == FS_RAMFS_FILE_MAGIC);
+    if (offset + count < offset) {
+        return -EINVALIDPARAM;
+    }
+    if (offset > f->size) {
+        /* Writing past end of file leaves a hole. */
+        ramfs_truncate(fs, f, offset);
+    }
+
+    size_t done = 0;
+    while (done < count) {
+        uint32_t page = (offset + done) / REFOS_PAGE_SIZE;
+        size_t pageOffset = (offset + done) % REFOS_PAGE_SIZE;
+        size_t n = MIN(REFOS_PAGE_SIZE - pageOffset, count - done);
+        vaddr_t extent = ramfs_get_extent(fs, f, page, true);
+        if (!extent) {
+            break;
+        }
+        memcpy((void*) (extent + pageOffset), buf + done, n);
+        done += n;
+    }
+
+    if (offset + done > f->size) {
+        f->size = offset + done;
+    }
+    if (done > 0) {
+        ramfs_file_changed(fs, f);
+    }
+    if (done == 0 && count > 0) {
+        return -ENOMEM;
+    }
+    return (int) done;
+}
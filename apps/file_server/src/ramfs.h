@@ -0,0 +1,134 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+#ifndef _FILE_SERVER_RAMFS_H_
+#define _FILE_SERVER_RAMFS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <data_struct/cvector.h>
+#include <refos/refos.h>
+#include "pager.h"
+
+/*! @file
+    @brief CPIO Fileserver writable RAM filesystem.
+
+    Files created through the file server live in a simple RAM filesystem. File content is stored
+    in page-sized extents allocated on demand from the pager frame block, so a file takes only as
+    many frames as it has touched pages, and holes read back as zero. Because each extent is a
+    whole pager frame, a mapped file's extents can be paged directly into a client's window, so
+    writes through the mapping land in the file without copying.
+
+    The frame block is shared with the frames the file server pages into client windows for CPIO
+    files. It grows by a chunk at a time as files need more extents, up to
+    FILESERVER_MAX_FRAME_CHUNKS chunks; a write that needs a new extent after that, or when the
+    process server is out of RAM, fails with ENOMEM. Truncating a file returns its extents to the
+    frame block.
+*/
+
+#define FS_RAMFS_FILE_MAGIC 0x7A3F11E5
+
+/*! @brief A single RAM filesystem file. */
+struct fs_ramfs_file {
+    uint32_t magic;
+    char *name;            /*!< The file name. (Owned) */
+    size_t size;           /*!< The file size in bytes. */
+    cvector_t extents;     /*!< Page extents, indexed by file page. 0 for holes. (vaddr_t) */
+    int mapCount;          /*!< Number of windows this file's extents are paged into. */
+    uint32_t generation;   /*!< Content generation; see ramfs_file_changed(). Never 0. */
+};
+
+/*! @brief The RAM filesystem. */
+struct fs_ramfs {
+    struct fs_frame_block *frameBlock; /*!< Pool to allocate extents from. (No ownership) */
+    cvector_t files;                   /*!< The list of files. (struct fs_ramfs_file*) */
+    uint32_t generation;               /*!< The last content generation given out. */
+};
+
+/*! @brief Initialise an empty RAM filesystem.
+    @param fs The ramfs to initialise.
+    @param frameBlock The pager frame block to allocate file extents from. (No ownership)
+*/
+void ramfs_init(struct fs_ramfs *fs, struct fs_frame_block *frameBlock);
+
+/*! @brief Release a RAM filesystem, freeing every file and returning all extents.
+    @param fs The ramfs to release.
+*/
+void ramfs_release(struct fs_ramfs *fs);
+
+/*! @brief Find a file by name.
+    @param fs The ramfs to search.
+    @param name The name of the file.
+    @return Weak pointer to the file if found, NULL otherwise. (No ownership)
+*/
+struct fs_ramfs_file *ramfs_find(struct fs_ramfs *fs, const char *name);
+
+/*! @brief Create a new empty file.
+    @param fs The ramfs to create the file in.
+    @param name The name of the file. Must not already exist.
+    @return Weak pointer to the new file if success, NULL if out of memory. (No ownership)
+*/
+struct fs_ramfs_file *ramfs_create(struct fs_ramfs *fs, const char *name);
+
+/*! @brief Give a file a new content generation, after its content has changed.
+
+    Generations are unique across the filesystem, so a file which is deleted and created again
+    never gets a generation it had before. They never reach 0, which is the generation of CPIO
+    files.
+
+    @param fs The ramfs the file is in.
+    @param f The file which changed.
+*/
+void ramfs_file_changed(struct fs_ramfs *fs, struct fs_ramfs_file *f);
+
+/*! @brief Set the size of a file, either expanding it with a hole or truncating it.
+
+    Truncating returns the extents past the new end of file to the frame pool. If the file is
+    currently paged into any window those extents are only zeroed, as they may still be mapped.
+
+    @param fs The ramfs the file belongs to.
+    @param f The file to resize.
+    @param size The new file size in bytes.
+*/
+void ramfs_truncate(struct fs_ramfs *fs, struct fs_ramfs_file *f, size_t size);
+
+/*! @brief Get the extent backing a given file page.
+    @param fs The ramfs the file belongs to.
+    @param f The file.
+    @param page The page index into the file.
+    @param alloc Whether to allocate a zeroed extent if the page is a hole.
+    @return VAddr of the extent, or 0 if the page is a hole (and alloc is false) or out of memory.
+*/
+vaddr_t ramfs_get_extent(struct fs_ramfs *fs, struct fs_ramfs_file *f, uint32_t page, bool alloc);
+
+/*! @brief Read from a file. Holes read as zero.
+    @param f The file to read from.
+    @param offset The offset into the file to read at.
+    @param buf The destination buffer.
+    @param count The maximum number of bytes to read.
+    @return The number of bytes read, which is short at end of file.
+*/
+int ramfs_read(struct fs_ramfs_file *f, size_t offset, char *buf, size_t count);
+
+/*! @brief Write to a file, allocating extents and growing the file as needed.
+    @param fs The ramfs the file belongs to.
+    @param f The file to write to.
+    @param offset The offset into the file to write at. May be past end of file.
+    @param buf The source buffer.
+    @param count The number of bytes to write.
+    @return The number of bytes written if success, -ENOMEM if out of extents.
+*/
+int ramfs_write(struct fs_ramfs *fs, struct fs_ramfs_file *f, size_t offset, const char *buf,
+                size_t count);
+
+#endif /* _FILE_SERVER_RAMFS_H_ */
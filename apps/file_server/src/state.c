@@ -24,15 +24,54 @@
 #include "state.h"
 #include "dataspace.h"
 #include "pager.h"
+#include "ramfs.h"
 
  /*! @file
      @brief CPIO Fileserver global state & helper functions. */
 
+/*! @brief The CPIO archive linked into the file server image. */
+extern char _cpio_archive[];
+extern char _cpio_archive_end[];
+
 struct fs_state fileServ;
 srv_common_t *fileServCommon;
 const char* dprintfServerName = "FILESERV";
 int dprintfServerColour = 35;
 
+/*! @brief Parse the CPIO archive once into a name index, so that opening a file does not need to
+           walk every header in the archive.
+    @param s The global file server state.
+*/
+static void
+fileserv_init_cpio_index(struct fs_state *s)
+{
+    unsigned long len = _cpio_archive_end - _cpio_archive;
+    struct cpio_info info;
+    int error = cpio_info(_cpio_archive, len, &info);
+    if (error) {
+        ROS_ERROR("Failed to parse CPIO archive.");
+        assert(!"Failed to parse CPIO archive.");
+        return;
+    }
+
+    unsigned long tableSize = cpio_index_table_size(info.file_count);
+    struct cpio_index_entry *table = malloc(tableSize * sizeof(struct cpio_index_entry));
+    if (!table) {
+        ROS_ERROR("Failed to allocate CPIO index table.");
+        assert(!"Failed to allocate CPIO index table.");
+        return;
+    }
+
+    error = cpio_index_build(_cpio_archive, len, &s->cpioIndex, table, tableSize);
+    if (error) {
+        ROS_ERROR("Failed to build CPIO index.");
+        assert(!"Failed to build CPIO index.");
+        free(table);
+        return;
+    }
+    dvprintf("    indexed %u CPIO files.\n", s->cpioIndex.file_count);
+}
+
 void
 fileserv_init(void) {
     dprintf("RefOS Fileserver initialising...\n");
@@ -58,8 +97,15 @@ fileserv_init(void) {
     /* Set up file server book keeping data structures. */
 
     dprintf("    initialising pager frame block...\n");
-    pager_init(&s->pageFrameBlock, FILESERVER_MAX_PAGE_FRAMES * REFOS_PAGE_SIZE);
+    pager_init(&s->pageFrameBlock, FILESERVER_MAX_PAGE_FRAMES * REFOS_PAGE_SIZE,
+               FILESERVER_MAX_FRAME_CHUNKS);
 
     dprintf("    initialising dataspace allocation table...\n");
     dspace_table_init(&s->dspaceTable);
+
+    dprintf("    initialising RAM filesystem...\n");
+    ramfs_init(&s->ramfs, &s->pageFrameBlock);
+
+    dprintf("    indexing CPIO archive...\n");
+    fileserv_init_cpio_index(s);
 }
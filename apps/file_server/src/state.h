@@ -38,7 +38,12 @@
 /* Debug printing. */
 #include <refos-util/dprintf.h>
 
-#define FILESERVER_MAX_PAGE_FRAMES 128
+/* The pager frame pool, shared by ramfs file extents and frames paged into client windows. It
+   grows in chunks of FILESERVER_MAX_PAGE_FRAMES frames, each faulted in lazily, up to
+   FILESERVER_MAX_FRAME_CHUNKS chunks (128MB), which keeps it well inside the walloc region. */
+#define FILESERVER_MAX_PAGE_FRAMES 2048
+#define FILESERVER_MAX_FRAME_CHUNKS 16
+#define FILESERVER_FAULT_READAHEAD_PAGES 7 /* Must be under PROCSERV_WINDOW_MAP_BATCH_MAX. */
 #define FILESERVER_NOTIFICATION_BUFFER_SIZE 0x2000 /* 2 Frames. */
 #define FILESERVER_MOUNTPOINT "fileserv"
 #define FS_CLIENT_MAGIC 0x3FA3EF6E
@@ -50,6 +55,10 @@ struct fs_state {
     /* Main file server data structures. */
     struct fs_frame_block pageFrameBlock;
     struct fs_dataspace_table dspaceTable;
+    struct fs_ramfs ramfs;
+
+    /* Name index over the CPIO archive, built once at startup. */
+    struct cpio_index cpioIndex;
 };
 
 /*! @brief Global CPIO file server state. */
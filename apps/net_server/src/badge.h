@@ -0,0 +1,34 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+#ifndef _NET_SERVER_BADGE_H_
+#define _NET_SERVER_BADGE_H_
+
+#include <refos/refos.h>
+
+/*! @file
+    @brief Network Server badge space definitions.
+
+    The network server has no device IRQs, so its badge space is simpler than the timer server's:
+    client sessions, and the single asynchronous death notification badge. Please look in
+    @ref console_server/src/badge.h for a more detailed explanation.
+*/
+
+/* ---- BadgeID 48 to 4143 : Clients ---- */
+#define NETSERV_CLIENT_BADGE_BASE 0x30
+
+/* ---- Async BadgeIDs  ---- */
+
+#define NETSERV_ASYNC_BADGE_MASK (1 << 19)
+#define NETSERV_ASYNC_NOTIFY_BADGE (1 << 0)
+
+#endif /* _NET_SERVER_BADGE_H_ */
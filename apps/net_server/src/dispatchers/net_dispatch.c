@@ -0,0 +1,229 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+#include "dispatch.h"
+#include "net_dispatch.h"
+#include "../state.h"
+#include "../socket.h"
+#include <refos-rpc/net_server.h>
+
+/* Included last, as its error macros would clash with the refos_error enum. */
+#include <errno.h>
+
+/*! @file
+    @brief Handles socket syscalls.
+
+    This file contains the handlers for net interface syscalls. It should implement the
+    declarations in the generated <refos-rpc/net_server.h>. Socket data does not pass through here;
+    these only set sockets up, and ring the doorbell once a client has touched its rings.
+*/
+
+/*! @brief Helper to look up the calling client's socket. */
+static struct net_socket *
+net_dispatch_get_socket(void *rpc_userptr, int sock)
+{
+    struct srv_client *c = (struct srv_client *) rpc_userptr;
+    assert(c->magic == NETSERV_CLIENT_MAGIC);
+    return sock_get(c, sock);
+}
+
+/*! @brief Helper to copy out a socket buffer dataspace cap sent along with a syscall.
+    @return The copied out cap (gives ownership), or 0 on failure.
+*/
+static seL4_CPtr
+net_dispatch_copyout_buffer(struct srv_client *c, seL4_CPtr bufferDataspace)
+{
+    srv_msg_t *m = (srv_msg_t *) c->rpcClient.userptr;
+    if (!srv_check_dispatch_caps(m, 0x00000000, 1)) {
+        return 0;
+    }
+    /* Do not printf before the copyout. */
+    return rpc_copyout_cptr(bufferDataspace);
+}
+
+int
+net_socket_handler(void *rpc_userptr , int rpc_type , seL4_CPtr rpc_buffer_dataspace ,
+                   uint32_t rpc_buffer_size)
+{
+    struct srv_client *c = (struct srv_client *) rpc_userptr;
+    assert(c->magic == NETSERV_CLIENT_MAGIC);
+
+    seL4_CPtr buffer = net_dispatch_copyout_buffer(c, rpc_buffer_dataspace);
+    if (!buffer) {
+        return -EINVAL;
+    }
+
+    struct net_socket *s = NULL;
+    int error = sock_create(c, rpc_type, buffer, rpc_buffer_size, &s);
+    if (error) {
+        csfree_delete(buffer);
+        return error;
+    }
+    return s->id;
+}
+
+int
+net_bind_handler(void *rpc_userptr , int rpc_sock , uint32_t rpc_addr , uint32_t rpc_port)
+{
+    struct net_socket *s = net_dispatch_get_socket(rpc_userptr, rpc_sock);
+    if (!s) {
+        return -EBADF;
+    }
+    return sock_bind(s, rpc_addr, rpc_port);
+}
+
+int
+net_listen_handler(void *rpc_userptr , int rpc_sock , int rpc_backlog)
+{
+    struct net_socket *s = net_dispatch_get_socket(rpc_userptr, rpc_sock);
+    if (!s) {
+        return -EBADF;
+    }
+    return sock_listen(s, rpc_backlog);
+}
+
+int
+net_accept_handler(void *rpc_userptr , int rpc_sock , seL4_CPtr rpc_buffer_dataspace ,
+                   uint32_t rpc_buffer_size , uint32_t* rpc_addr , uint32_t* rpc_port)
+{
+    struct srv_client *c = (struct srv_client *) rpc_userptr;
+    struct net_socket *s = net_dispatch_get_socket(rpc_userptr, rpc_sock);
+    seL4_CPtr buffer = net_dispatch_copyout_buffer(c, rpc_buffer_dataspace);
+    if (!buffer) {
+        return -EINVAL;
+    }
+    if (!s) {
+        csfree_delete(buffer);
+        return -EBADF;
+    }
+    if (s->state != NETSERV_SOCKET_LISTEN) {
+        csfree_delete(buffer);
+        return -EINVAL;
+    }
+    if (s->backlogCount == 0) {
+        csfree_delete(buffer);
+        return -EAGAIN;
+    }
+
+    struct net_socket *newSock = NULL;
+    int error = sock_create(c, NETSERV_SOCK_STREAM, buffer, rpc_buffer_size, &newSock);
+    if (error) {
+        csfree_delete(buffer);
+        return error;
+    }
+    error = sock_accept(s, newSock);
+    if (error) {
+        sock_close(newSock);
+        return error;
+    }
+
+    (*rpc_addr) = newSock->peerAddr;
+    (*rpc_port) = newSock->peerPort;
+    return newSock->id;
+}
+
+int
+net_connect_handler(void *rpc_userptr , int rpc_sock , uint32_t rpc_addr , uint32_t rpc_port)
+{
+    struct net_socket *s = net_dispatch_get_socket(rpc_userptr, rpc_sock);
+    if (!s) {
+        return -EBADF;
+    }
+    return sock_connect(s, rpc_addr, rpc_port);
+}
+
+int
+net_getname_handler(void *rpc_userptr , int rpc_sock , int rpc_peer , uint32_t* rpc_addr ,
+                    uint32_t* rpc_port)
+{
+    struct net_socket *s = net_dispatch_get_socket(rpc_userptr, rpc_sock);
+    if (!s) {
+        return -EBADF;
+    }
+    if (rpc_peer) {
+        if (s->state != NETSERV_SOCKET_CONNECTED) {
+            return -ENOTCONN;
+        }
+        (*rpc_addr) = s->peerAddr;
+        (*rpc_port) = s->peerPort;
+        return 0;
+    }
+    (*rpc_addr) = s->localAddr;
+    (*rpc_port) = s->localPort;
+    return 0;
+}
+
+int
+net_notify_handler(void *rpc_userptr , int rpc_sock)
+{
+    struct net_socket *s = net_dispatch_get_socket(rpc_userptr, rpc_sock);
+    if (!s) {
+        return -EBADF;
+    }
+    /* Move everything that can move now, so the events we hand back are up to date. */
+    sock_service();
+    return sock_events(s);
+}
+
+int
+net_wait_handler(void *rpc_userptr , int rpc_sock , int rpc_events)
+{
+    struct srv_client *c = (struct srv_client *) rpc_userptr;
+    struct net_socket *s = net_dispatch_get_socket(rpc_userptr, rpc_sock);
+    if (!s) {
+        return -EBADF;
+    }
+
+    /* Don't block if what the client wants is already here. */
+    int events = sock_events(s) & (rpc_events | NETSERV_EVENT_HUP);
+    if (events) {
+        return events;
+    }
+
+    int error = sock_wait(s, c, rpc_events);
+    if (error) {
+        return error;
+    }
+    c->rpcClient.skip_reply = true;
+    return 0;
+}
+
+int
+net_shutdown_handler(void *rpc_userptr , int rpc_sock)
+{
+    struct net_socket *s = net_dispatch_get_socket(rpc_userptr, rpc_sock);
+    if (!s) {
+        return -EBADF;
+    }
+    return sock_shutdown(s);
+}
+
+int
+net_close_handler(void *rpc_userptr , int rpc_sock)
+{
+    struct net_socket *s = net_dispatch_get_socket(rpc_userptr, rpc_sock);
+    if (!s) {
+        return -EBADF;
+    }
+    sock_close(s);
+    return 0;
+}
+
+int
+check_dispatch_net(srv_msg_t *m, void **userptr)
+{
+    if (m->badge == 0) {
+        /* Socket syscalls need an established session. */
+        return DISPATCH_PASS;
+    }
+    return check_dispatch_interface(m, userptr, RPC_NET_LABEL_MIN, RPC_NET_LABEL_MAX);
+}
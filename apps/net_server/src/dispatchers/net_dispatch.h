@@ -0,0 +1,31 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+#ifndef _NET_SERVER_DISPATCHER_NET_INTERFACE_H_
+#define _NET_SERVER_DISPATCHER_NET_INTERFACE_H_
+
+#include "../state.h"
+#include "dispatch.h"
+
+/*! @file
+    @brief Handles socket syscalls. */
+
+int rpc_sv_net_dispatcher(void *rpc_userptr, uint32_t label);
+
+/*! @brief Check whether the given recieved message is a socket syscall.
+    @param m Struct containing info about the recieved message.
+    @param userptr Output user pointer. Pass this into the generated dispatcher function.
+    @return DISPATCH_SUCCESS if message is a socket syscall, DISPATCH_PASS otherwise.
+*/
+int check_dispatch_net(srv_msg_t *m, void **userptr);
+
+#endif /* _NET_SERVER_DISPATCHER_NET_INTERFACE_H_ */
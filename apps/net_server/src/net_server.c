@@ -0,0 +1,115 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+#include <stdio.h>
+#include <assert.h>
+#include <refos/refos.h>
+#include <refos-util/init.h>
+#include <refos-io/morecore.h>
+#include "state.h"
+#include "socket.h"
+#include "dispatchers/serv_dispatch.h"
+#include "dispatchers/net_dispatch.h"
+#include "dispatchers/client_watch.h"
+
+/*! @file
+    @brief Network Server main source file.
+
+    The RefOS Network server provides TCP-like stream sockets and UDP-like datagram sockets to
+    other RefOS processes, with no network hardware required. The socket syscalls in librefossys
+    are implemented on top of it. There is no TCP/IP stack: no packets are built, and nothing
+    leaves the machine. Stream data is copied between the two sockets' rings in order and without
+    loss, so there is no segmentation, retransmission or congestion control.
+
+    The Network server:
+    <ul>
+        <li>Does NOT support providing pager service to clients.</li>
+        <li>Does NOT implement the dataspace interface. Sockets are created through the net
+            interface instead (see net_interface.xml).</li>
+        <li>Does NOT use parameter buffers. Each socket has its own shared buffer holding a
+            receive and a transmit ring, provided by the client when the socket is created.</li>
+    </ul>
+
+    Two interfaces are up from boot: the loopback interface `lo` at 127.0.0.1, and the in-memory
+    virtual NIC `vnic0` at 10.0.2.15. See netif.h.
+*/
+
+/*! @brief Network server's static morecore region. */
+static char netServMMapRegion[NETSERV_MMAP_REGION_SIZE];
+
+/*! @brief Handle messages recieved by the network server.
+    @param s The global network server state. (No ownership transfer)
+    @param msg The recieved message. (No ownership transfer)
+    @return DISPATCH_SUCCESS if message dispatched, DISPATCH_ERROR if unknown message.
+*/
+static int
+net_server_handle_message(struct netserv_state *s, srv_msg_t *msg)
+{
+    int result = DISPATCH_PASS;
+    int label = seL4_GetMR(0);
+    void *userptr;
+
+    if (dispatch_client_watch(msg) == DISPATCH_SUCCESS) {
+        return DISPATCH_SUCCESS;
+    }
+
+    if (check_dispatch_net(msg, &userptr) == DISPATCH_SUCCESS) {
+        result = rpc_sv_net_dispatcher(userptr, label);
+        assert(result == DISPATCH_SUCCESS);
+        return DISPATCH_SUCCESS;
+    }
+
+    if (check_dispatch_serv(msg, &userptr) == DISPATCH_SUCCESS) {
+        result = rpc_sv_serv_dispatcher(userptr, label);
+        assert(result == DISPATCH_SUCCESS);
+        return DISPATCH_SUCCESS;
+    }
+
+    dprintf("Unknown message (badge = %d msgInfo = %d label = %d).\n",
+            msg->badge, seL4_MessageInfo_get_label(msg->message), label);
+    ROS_ERROR("net server unknown message.");
+    assert(!"net server unknown message.");
+
+    return DISPATCH_ERROR;
+}
+
+/*! @brief Main network server message loop. Recieves and dispatches messages, then moves any data
+           the message made ready and wakes up the clients waiting for it. */
+static void
+net_server_mainloop(void)
+{
+    struct netserv_state *s = &netServ;
+    srv_msg_t msg;
+
+    while (1) {
+        msg.message = seL4_Recv(s->commonState.anonEP, &msg.badge);
+        net_server_handle_message(s, &msg);
+        sock_service();
+        client_table_postaction(&s->commonState.clientTable);
+    }
+}
+
+/*! @brief Main network server entry point. */
+int
+main()
+{
+    uintptr_t address = strtoll(getenv("SYSTABLE"), NULL, 16);
+    refos_init_selfload_child(address);
+    dprintf("Initialising RefOS network server.\n");
+    refosio_setup_morecore_override(netServMMapRegion, NETSERV_MMAP_REGION_SIZE);
+    refos_initialise_timer();
+    netserv_init();
+
+    net_server_mainloop();
+
+    return 0;
+}
@@ -0,0 +1,144 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+#include <string.h>
+#include <refos-rpc/net_common.h>
+#include "netif.h"
+#include "socket.h"
+#include "state.h"
+
+/*! @file
+    @brief Network server interfaces. */
+
+#define NETIF_LOOPBACK_NET_MASK 0xFF000000
+
+/* ----------------------------------- Loopback interface --------------------------------------- */
+
+static bool
+netif_loopback_ready(struct netif *nif)
+{
+    return true;
+}
+
+static void
+netif_loopback_output(struct netif *nif, struct netif_frame *frame)
+{
+    /* Nothing to queue; the frame arrives straight back on the same interface. */
+    nif->rxFrames++;
+    sock_input(nif, frame);
+}
+
+/* ------------------------------------ Virtual NIC --------------------------------------------- */
+
+static bool
+netif_vnic_ready(struct netif *nif)
+{
+    struct netif_vnic *vnic = (struct netif_vnic *) nif;
+    return vnic->queueCount < NETIF_VNIC_QUEUE_LEN;
+}
+
+static void
+netif_vnic_output(struct netif *nif, struct netif_frame *frame)
+{
+    struct netif_vnic *vnic = (struct netif_vnic *) nif;
+    assert(vnic->queueCount < NETIF_VNIC_QUEUE_LEN);
+    assert(frame->len <= NETIF_VNIC_MTU);
+
+    int tail = (vnic->queueHead + vnic->queueCount) % NETIF_VNIC_QUEUE_LEN;
+    struct netif_vnic_slot *slot = &vnic->queue[tail];
+    slot->frame = *frame;
+    slot->frame.data = slot->data;
+    if (frame->len > 0) {
+        memcpy(slot->data, frame->data, frame->len);
+    }
+    vnic->queueCount++;
+}
+
+static int
+netif_vnic_poll(struct netif_vnic *vnic)
+{
+    int count = 0;
+
+    /* Only deliver what was queued on entry. Sockets receiving these frames may well queue more,
+       which the next poll picks up. */
+    int n = vnic->queueCount;
+    while (n-- > 0) {
+        struct netif_vnic_slot *slot = &vnic->queue[vnic->queueHead];
+        vnic->queueHead = (vnic->queueHead + 1) % NETIF_VNIC_QUEUE_LEN;
+        vnic->queueCount--;
+        vnic->nif.rxFrames++;
+        sock_input(&vnic->nif, &slot->frame);
+        count++;
+    }
+    return count;
+}
+
+/* ---------------------------------- Interface functions --------------------------------------- */
+
+void
+netif_init(void)
+{
+    struct netif *lo = &netServ.loopback;
+    memset(lo, 0, sizeof(struct netif));
+    lo->magic = NETIF_MAGIC;
+    lo->name = "lo";
+    lo->addr = NETSERV_ADDR_LOOPBACK;
+    lo->mtu = NETIF_LOOPBACK_MTU;
+    lo->output = netif_loopback_output;
+    lo->ready = netif_loopback_ready;
+
+    struct netif_vnic *vnic = &netServ.vnic;
+    memset(vnic, 0, sizeof(struct netif_vnic));
+    vnic->nif.magic = NETIF_MAGIC;
+    vnic->nif.name = "vnic0";
+    vnic->nif.addr = NETSERV_ADDR_VNIC;
+    vnic->nif.mtu = NETIF_VNIC_MTU;
+    vnic->nif.output = netif_vnic_output;
+    vnic->nif.ready = netif_vnic_ready;
+
+    dprintf("    netif %s up, mtu %d.\n", lo->name, lo->mtu);
+    dprintf("    netif %s up, mtu %d.\n", vnic->nif.name, vnic->nif.mtu);
+}
+
+struct netif *
+netif_route(uint32_t addr)
+{
+    if ((addr & NETIF_LOOPBACK_NET_MASK) == (NETSERV_ADDR_LOOPBACK & NETIF_LOOPBACK_NET_MASK)) {
+        return &netServ.loopback;
+    }
+    if (addr == netServ.vnic.nif.addr) {
+        return &netServ.vnic.nif;
+    }
+    return NULL;
+}
+
+bool
+netif_ready(struct netif *nif)
+{
+    assert(nif && nif->magic == NETIF_MAGIC);
+    return nif->ready(nif);
+}
+
+void
+netif_output(struct netif *nif, struct netif_frame *frame)
+{
+    assert(nif && nif->magic == NETIF_MAGIC);
+    assert(frame && frame->len <= nif->mtu);
+    nif->txFrames++;
+    nif->output(nif, frame);
+}
+
+int
+netif_poll(void)
+{
+    return netif_vnic_poll(&netServ.vnic);
+}
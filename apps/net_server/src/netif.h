@@ -0,0 +1,114 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+#ifndef _NET_SERVER_NETIF_H_
+#define _NET_SERVER_NETIF_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*! @file
+    @brief Network server interfaces.
+
+    The sockets module hands every packet it sends to a netif, chosen by destination address, and
+    the netif hands it back to the sockets module on the receiving end. Two interfaces exist:
+
+    <ul>
+        <li>`lo` (127.0.0.0/8), which delivers a frame to the destination socket immediately.</li>
+        <li>`vnic0` (10.0.2.15), an in-memory virtual NIC. Frames are limited to an ethernet MTU
+            and queued on a fixed size transmit queue, which is wired back into the same
+            interface's receive path and drained by netif_poll(). This exercises the
+            segmentation and queue-full paths that a real ethernet driver would.</li>
+    </ul>
+*/
+
+#define NETIF_MAGIC 0x4E371F0A
+
+#define NETIF_LOOPBACK_MTU 0x4000
+#define NETIF_VNIC_MTU 1500
+#define NETIF_VNIC_QUEUE_LEN 64
+
+/*! @brief Marks the last frame of a stream; the receiving socket sees end of stream. */
+#define NETIF_FRAME_FIN (1 << 0)
+
+/*! @brief A packet travelling between two sockets. */
+struct netif_frame {
+    uint32_t proto; /* NETSERV_SOCK_STREAM or NETSERV_SOCK_DGRAM. */
+    uint32_t flags;
+    uint32_t srcAddr;
+    uint32_t srcPort;
+    uint32_t dstAddr;
+    uint32_t dstPort;
+    uint32_t len;
+    char *data; /* No ownership. */
+};
+
+struct netif;
+typedef void (*netif_output_fn_t)(struct netif *nif, struct netif_frame *frame);
+typedef bool (*netif_ready_fn_t)(struct netif *nif);
+
+/*! @brief Network interface structure. */
+struct netif {
+    uint32_t magic;
+    const char *name;
+    uint32_t addr;
+    uint32_t mtu;
+
+    netif_output_fn_t output;
+    netif_ready_fn_t ready;
+
+    uint32_t txFrames;
+    uint32_t rxFrames;
+};
+
+/*! @brief A frame sitting on the virtual NIC queue, with its own copy of the payload. */
+struct netif_vnic_slot {
+    struct netif_frame frame;
+    char data[NETIF_VNIC_MTU];
+};
+
+/*! @brief Virtual NIC structure. */
+struct netif_vnic {
+    struct netif nif; /* Inherited, must be first. */
+    struct netif_vnic_slot queue[NETIF_VNIC_QUEUE_LEN];
+    int queueHead;
+    int queueCount;
+};
+
+/*! @brief Initialise the loopback and virtual NIC interfaces. */
+void netif_init(void);
+
+/*! @brief Find the interface which reaches the given address.
+    @param addr The destination address, in host byte order.
+    @return The interface to send through, or NULL if the address is unreachable.
+*/
+struct netif *netif_route(uint32_t addr);
+
+/*! @brief Check whether the interface can take another frame right now.
+    @param nif The interface. (No ownership)
+    @return true if netif_output() would not have to drop the frame, false otherwise.
+*/
+bool netif_ready(struct netif *nif);
+
+/*! @brief Send a frame out of an interface. The caller should check netif_ready() first, and
+           must not exceed the interface MTU.
+    @param nif The interface to send through. (No ownership)
+    @param frame The frame to send. Its data is copied out before returning. (No ownership)
+*/
+void netif_output(struct netif *nif, struct netif_frame *frame);
+
+/*! @brief Deliver the frames queued on the virtual NIC.
+    @return The number of frames delivered.
+*/
+int netif_poll(void);
+
+#endif /* _NET_SERVER_NETIF_H_ */
@@ -0,0 +1,821 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+#include <string.h>
+#include <utils/arith.h>
+#include <refos-util/walloc.h>
+#include <refos-rpc/data_client.h>
+#include <refos-rpc/net_server.h>
+#include "socket.h"
+#include "state.h"
+
+/* Included last, as its error macros would clash with the refos_error enum. */
+#include <errno.h>
+
+/*! @file
+    @brief Network server socket module. */
+
+#define NETSERV_SOCKET_BUFFER_NPAGES (NETSERV_SOCKET_BUFFER_SIZE / REFOS_PAGE_SIZE)
+
+/*! @brief Staging buffer for a frame on its way from a transmit ring to an interface. Also used to
+           assemble a datagram record, so that it lands in a receive ring with a single write. */
+static char sockScratch[NETIF_LOOPBACK_MTU];
+
+/* --------------------------------------- Ring helpers ----------------------------------------- */
+
+/* The rings use the refos_share layout: a start and an end index, then the data. The client
+   writes the receive ring's start and the transmit ring's end, so those two are untrusted. They
+   are read once per pass by sock_ring_sync(), checked, and only the checked copies are used; the
+   indices we own are kept on our side, and only ever written out to the client. */
+#define NETSERV_RING_META_SIZE (sizeof(seL4_Word) * 2)
+#define NETSERV_RING_DATA_SIZE (NETSERV_RING_SIZE - NETSERV_RING_META_SIZE)
+
+static inline size_t
+sock_rx_space(struct net_socket *s)
+{
+    return s->rxStart > s->rxEnd ? (s->rxStart - s->rxEnd) - 1 :
+                                   (NETSERV_RING_DATA_SIZE - 1) - (s->rxEnd - s->rxStart);
+}
+
+static inline size_t
+sock_rx_pending(struct net_socket *s)
+{
+    return (NETSERV_RING_DATA_SIZE - 1) - sock_rx_space(s);
+}
+
+static inline size_t
+sock_tx_pending(struct net_socket *s)
+{
+    return s->txStart <= s->txEnd ? s->txEnd - s->txStart :
+                                    (NETSERV_RING_DATA_SIZE - s->txStart) + s->txEnd;
+}
+
+static inline size_t
+sock_tx_space(struct net_socket *s)
+{
+    return (NETSERV_RING_DATA_SIZE - 1) - sock_tx_pending(s);
+}
+
+/*! @brief Copy out of a ring from the given index, without moving anything. */
+static void
+sock_ring_peek(char *ring, unsigned int start, char *data, size_t len)
+{
+    char *base = ring + NETSERV_RING_META_SIZE;
+    size_t n = MIN(len, NETSERV_RING_DATA_SIZE - start);
+    memcpy(data, base + start, n);
+    memcpy(data + n, base, len - n);
+}
+
+/*! @brief Write into the receive ring. The caller has checked there is room, against the last
+           sync. */
+static void
+sock_rx_write(struct net_socket *s, char *data, size_t len)
+{
+    assert(len <= sock_rx_space(s));
+    char *base = s->rx + NETSERV_RING_META_SIZE;
+    size_t n = MIN(len, NETSERV_RING_DATA_SIZE - s->rxEnd);
+    memcpy(base + s->rxEnd, data, n);
+    memcpy(base, data + n, len - n);
+    s->rxEnd = (s->rxEnd + len) % NETSERV_RING_DATA_SIZE;
+    __sync_synchronize();
+    *((seL4_Word*) (s->rx + sizeof(seL4_Word))) = s->rxEnd;
+}
+
+/*! @brief Read from the transmit ring. The caller has checked there is this much pending, against
+           the last sync. */
+static void
+sock_tx_read(struct net_socket *s, char *data, size_t len)
+{
+    assert(len <= sock_tx_pending(s));
+    sock_ring_peek(s->tx, s->txStart, data, len);
+    s->txStart = (s->txStart + len) % NETSERV_RING_DATA_SIZE;
+    *((seL4_Word*) s->tx) = s->txStart;
+}
+
+/* -------------------------------------- Table helpers ----------------------------------------- */
+
+static bool
+sock_port_in_use(int type, uint32_t addr, uint32_t port)
+{
+    for (int i = 0; i < NETSERV_MAX_SOCKETS; i++) {
+        struct net_socket *s = netServ.sockets[i];
+        /* Accepted sockets share their listener's port, and don't own it. */
+        if (!s || s->type != type || s->localPort != port || s->accepted) {
+            continue;
+        }
+        if (addr == NETSERV_ADDR_ANY || s->localAddr == NETSERV_ADDR_ANY || s->localAddr == addr) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint32_t
+sock_ephemeral_port(int type)
+{
+    int range = NETSERV_EPHEMERAL_PORT_MAX - NETSERV_EPHEMERAL_PORT_MIN + 1;
+    for (int i = 0; i < range; i++) {
+        uint32_t port = netServ.nextEphemeralPort++;
+        if (netServ.nextEphemeralPort > NETSERV_EPHEMERAL_PORT_MAX) {
+            netServ.nextEphemeralPort = NETSERV_EPHEMERAL_PORT_MIN;
+        }
+        if (!sock_port_in_use(type, NETSERV_ADDR_ANY, port)) {
+            return port;
+        }
+    }
+    return 0;
+}
+
+static struct net_socket *
+sock_find_listener(uint32_t addr, uint32_t port)
+{
+    for (int i = 0; i < NETSERV_MAX_SOCKETS; i++) {
+        struct net_socket *s = netServ.sockets[i];
+        if (!s || s->type != NETSERV_SOCK_STREAM || s->state != NETSERV_SOCKET_LISTEN) {
+            continue;
+        }
+        if (s->localPort == port &&
+                (s->localAddr == NETSERV_ADDR_ANY || s->localAddr == addr)) {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+static void
+sock_backlog_remove(struct net_socket *listener, struct net_socket *s)
+{
+    for (int i = 0; i < listener->backlogCount; i++) {
+        if (listener->backlog[i] != s) {
+            continue;
+        }
+        memmove(&listener->backlog[i], &listener->backlog[i + 1],
+                (listener->backlogCount - i - 1) * sizeof(struct net_socket *));
+        listener->backlogCount--;
+        break;
+    }
+    s->listener = NULL;
+}
+
+/*! @brief The other end of a connection went away; anything sent from now on is dropped.
+    @param s The socket left behind.
+    @param hangup Whether to signal end of stream now, rather than after frames in flight.
+*/
+static void
+sock_peer_closed(struct net_socket *s, bool hangup)
+{
+    s->ctrl->peerClosed = 1;
+    if (hangup) {
+        s->ctrl->hangup = 1;
+    }
+    s->peer = NULL;
+}
+
+/*! @brief Reply to a socket's waiter, if any. */
+static void
+sock_wake(struct net_socket *s, int events)
+{
+    if (!s->waiter) {
+        return;
+    }
+    struct srv_client *c = s->waiter;
+    assert(c->magic == NETSERV_CLIENT_MAGIC);
+
+    c->rpcClient.skip_reply = false;
+    c->rpcClient.reply = s->waitReply;
+    reply_net_wait((void*) c, events);
+    c->rpcClient.reply = 0;
+
+    csfree_delete(s->waitReply);
+    s->waitReply = 0;
+    s->waiter = NULL;
+    s->waitEvents = 0;
+}
+
+/*! @brief Throw away everything in a socket's rings, after its client broke them.
+
+    A stream has lost bytes it can't get back, so the connection is hung up in both directions.
+    A datagram socket only loses the records that were in its rings.
+*/
+static void
+sock_ring_reset(struct net_socket *s)
+{
+    ROS_WARNING("Socket %d has corrupt ring indices. Resetting.", s->id);
+    s->rxStart = s->rxEnd = 0;
+    s->txStart = s->txEnd = 0;
+    memset(s->rx, 0, NETSERV_RING_META_SIZE);
+    memset(s->tx, 0, NETSERV_RING_META_SIZE);
+    if (s->type != NETSERV_SOCK_STREAM) {
+        return;
+    }
+    if (s->peer) {
+        sock_peer_closed(s->peer, true);
+    }
+    sock_peer_closed(s, true);
+    s->txShutdown = true;
+    s->finSent = true;
+}
+
+/*! @brief Take a checked snapshot of the ring indices the client writes.
+    @return true if they were in range, false if the socket had to be reset.
+*/
+static bool
+sock_ring_sync(struct net_socket *s)
+{
+    unsigned int rxStart = *((volatile seL4_Word*) s->rx);
+    unsigned int txEnd = *((volatile seL4_Word*) (s->tx + sizeof(seL4_Word)));
+    if (rxStart >= NETSERV_RING_DATA_SIZE || txEnd >= NETSERV_RING_DATA_SIZE) {
+        sock_ring_reset(s);
+        return false;
+    }
+    s->rxStart = rxStart;
+    s->txEnd = txEnd;
+    return true;
+}
+
+/* ------------------------------------ Socket functions ---------------------------------------- */
+
+int
+sock_create(struct srv_client *owner, int type, seL4_CPtr bufferDataspace, uint32_t bufferSize,
+            struct net_socket **out)
+{
+    assert(owner && out);
+    if (type != NETSERV_SOCK_STREAM && type != NETSERV_SOCK_DGRAM) {
+        return -EPROTONOSUPPORT;
+    }
+    if (!bufferDataspace || bufferSize < NETSERV_SOCKET_BUFFER_SIZE) {
+        return -EINVAL;
+    }
+
+    /* Find a free socket ID. */
+    int id = -1;
+    for (int i = 0; i < NETSERV_MAX_SOCKETS; i++) {
+        if (!netServ.sockets[i]) {
+            id = i;
+            break;
+        }
+    }
+    if (id < 0) {
+        return -ENFILE;
+    }
+
+    struct net_socket *s = malloc(sizeof(struct net_socket));
+    if (!s) {
+        ROS_ERROR("sock_create failed to allocate socket structure.");
+        return -ENOMEM;
+    }
+    memset(s, 0, sizeof(struct net_socket));
+
+    /* Map the client's buffer on our side. */
+    seL4_Word vaddr = walloc(NETSERV_SOCKET_BUFFER_NPAGES, &s->bufferWindow);
+    if (!vaddr || !s->bufferWindow) {
+        ROS_ERROR("sock_create failed to allocate buffer window.");
+        free(s);
+        return -ENOMEM;
+    }
+    int error = data_datamap(REFOS_PROCSERV_EP, bufferDataspace, s->bufferWindow, 0);
+    if (error != ESUCCESS) {
+        ROS_WARNING("sock_create failed to map the socket buffer.");
+        walloc_free(vaddr, NETSERV_SOCKET_BUFFER_NPAGES);
+        free(s);
+        return -EINVAL;
+    }
+
+    s->magic = NETSERV_SOCKET_MAGIC;
+    s->id = id;
+    s->type = type;
+    s->state = NETSERV_SOCKET_OPEN;
+    s->owner = owner;
+    s->bufferDataspace = bufferDataspace;
+    s->buffer = (char*) vaddr;
+    s->ctrl = (struct net_socket_control *) s->buffer;
+    s->rx = NETSERV_SOCKET_RX_RING(s->buffer);
+    s->tx = NETSERV_SOCKET_TX_RING(s->buffer);
+
+    /* Start from clean rings, whatever the client left in the buffer. */
+    memset(s->buffer, 0, NETSERV_SOCKET_CONTROL_SIZE);
+    memset(s->rx, 0, sizeof(seL4_Word) * 2);
+    memset(s->tx, 0, sizeof(seL4_Word) * 2);
+    s->ctrl->magic = NETSERV_SOCKET_CONTROL_MAGIC;
+
+    netServ.sockets[id] = s;
+    (*out) = s;
+    return 0;
+}
+
+struct net_socket *
+sock_get(struct srv_client *owner, int id)
+{
+    if (id < 0 || id >= NETSERV_MAX_SOCKETS) {
+        return NULL;
+    }
+    struct net_socket *s = netServ.sockets[id];
+    if (!s || s->owner != owner) {
+        return NULL;
+    }
+    assert(s->magic == NETSERV_SOCKET_MAGIC);
+    return s;
+}
+
+void
+sock_close(struct net_socket *s)
+{
+    assert(s && s->magic == NETSERV_SOCKET_MAGIC);
+
+    /* Flush whatever the client managed to send, followed by the end of stream. If the end of
+       stream couldn't be queued behind the data, the peer has to be told straight away. */
+    if (s->peer) {
+        s->txShutdown = true;
+        sock_pump(s);
+        if (s->peer) {
+            /* Still there, unless the pump found our rings broken and hung up already. */
+            sock_peer_closed(s->peer, !s->finSent);
+        }
+    }
+    if (s->listener) {
+        sock_backlog_remove(s->listener, s);
+    }
+    for (int i = 0; i < s->backlogCount; i++) {
+        s->backlog[i]->listener = NULL;
+        sock_peer_closed(s->backlog[i], true);
+    }
+    s->backlogCount = 0;
+
+    /* A client blocked on this socket can't be woken up by anything any more. */
+    if (s->waiter) {
+        csfree_delete(s->waitReply);
+        s->waiter = NULL;
+    }
+
+    /* Unmap the shared buffer. */
+    data_dataunmap(REFOS_PROCSERV_EP, s->bufferWindow);
+    walloc_free((uint32_t) s->buffer, NETSERV_SOCKET_BUFFER_NPAGES);
+    csfree_delete(s->bufferDataspace);
+
+    netServ.sockets[s->id] = NULL;
+    s->magic = 0x0;
+    free(s);
+}
+
+void
+sock_purge_client(struct srv_client *owner)
+{
+    for (int i = 0; i < NETSERV_MAX_SOCKETS; i++) {
+        struct net_socket *s = netServ.sockets[i];
+        if (s && s->owner == owner) {
+            sock_close(s);
+        }
+    }
+}
+
+int
+sock_bind(struct net_socket *s, uint32_t addr, uint32_t port)
+{
+    assert(s && s->magic == NETSERV_SOCKET_MAGIC);
+    if (s->localPort) {
+        return -EINVAL;
+    }
+    if (addr != NETSERV_ADDR_ANY && !netif_route(addr)) {
+        return -EADDRNOTAVAIL;
+    }
+    if (port == 0) {
+        port = sock_ephemeral_port(s->type);
+        if (!port) {
+            return -EADDRINUSE;
+        }
+    } else if (sock_port_in_use(s->type, addr, port)) {
+        return -EADDRINUSE;
+    }
+    s->localAddr = addr;
+    s->localPort = port;
+    return 0;
+}
+
+int
+sock_listen(struct net_socket *s, int backlog)
+{
+    assert(s && s->magic == NETSERV_SOCKET_MAGIC);
+    if (s->type != NETSERV_SOCK_STREAM) {
+        return -EOPNOTSUPP;
+    }
+    if (s->state == NETSERV_SOCKET_CONNECTED) {
+        return -EISCONN;
+    }
+    if (!s->localPort) {
+        int error = sock_bind(s, NETSERV_ADDR_ANY, 0);
+        if (error) {
+            return error;
+        }
+    }
+    if (backlog <= 0 || backlog > NETSERV_MAX_BACKLOG) {
+        backlog = NETSERV_MAX_BACKLOG;
+    }
+    s->backlogMax = backlog;
+    s->state = NETSERV_SOCKET_LISTEN;
+    return 0;
+}
+
+int
+sock_connect(struct net_socket *s, uint32_t addr, uint32_t port)
+{
+    assert(s && s->magic == NETSERV_SOCKET_MAGIC);
+    if (s->state == NETSERV_SOCKET_LISTEN) {
+        return -EINVAL;
+    }
+    if (s->type == NETSERV_SOCK_STREAM && s->state == NETSERV_SOCKET_CONNECTED) {
+        return -EISCONN;
+    }
+    struct netif *nif = netif_route(addr);
+    if (!nif || port == 0) {
+        return -ENETUNREACH;
+    }
+
+    /* Pick our side of the connection. */
+    if (!s->localPort) {
+        int error = sock_bind(s, nif->addr, 0);
+        if (error) {
+            return error;
+        }
+    } else if (s->localAddr == NETSERV_ADDR_ANY) {
+        s->localAddr = nif->addr;
+    }
+
+    if (s->type == NETSERV_SOCK_STREAM) {
+        /* Queue ourselves on the listener. The connection is usable straight away; data we send
+           sits in our transmit ring until the listener accepts and we have a peer. */
+        struct net_socket *listener = sock_find_listener(addr, port);
+        if (!listener || listener->backlogCount >= listener->backlogMax) {
+            return -ECONNREFUSED;
+        }
+        listener->backlog[listener->backlogCount++] = s;
+        s->listener = listener;
+    }
+
+    s->peerAddr = addr;
+    s->peerPort = port;
+    s->state = NETSERV_SOCKET_CONNECTED;
+    return 0;
+}
+
+int
+sock_accept(struct net_socket *s, struct net_socket *newSock)
+{
+    assert(s && s->magic == NETSERV_SOCKET_MAGIC);
+    assert(newSock && newSock->magic == NETSERV_SOCKET_MAGIC);
+    if (s->state != NETSERV_SOCKET_LISTEN) {
+        return -EINVAL;
+    }
+    if (s->backlogCount == 0) {
+        return -EAGAIN;
+    }
+    struct net_socket *client = s->backlog[0];
+    sock_backlog_remove(s, client);
+
+    /* Wire the new socket up as the other end of the connection. */
+    newSock->type = NETSERV_SOCK_STREAM;
+    newSock->accepted = true;
+    newSock->state = NETSERV_SOCKET_CONNECTED;
+    newSock->localAddr = client->peerAddr;
+    newSock->localPort = client->peerPort;
+    newSock->peerAddr = client->localAddr;
+    newSock->peerPort = client->localPort;
+    newSock->peer = client;
+    client->peer = newSock;
+
+    /* Anything the client sent before we accepted can go now. */
+    sock_pump(client);
+    return 0;
+}
+
+int
+sock_shutdown(struct net_socket *s)
+{
+    assert(s && s->magic == NETSERV_SOCKET_MAGIC);
+    if (s->type != NETSERV_SOCK_STREAM || s->state != NETSERV_SOCKET_CONNECTED) {
+        return -ENOTCONN;
+    }
+    s->txShutdown = true;
+    sock_pump(s);
+    return 0;
+}
+
+static int
+sock_pump_stream(struct net_socket *s)
+{
+    if (!sock_ring_sync(s) || !s->peer || !sock_ring_sync(s->peer)) {
+        return 0;
+    }
+    struct net_socket *peer = s->peer;
+    struct netif *nif = netif_route(s->peerAddr);
+    assert(nif);
+
+    int moved = 0;
+    size_t space = sock_rx_space(peer);
+    size_t credit = space > peer->inflight ? space - peer->inflight : 0;
+    size_t pending = sock_tx_pending(s);
+
+    while (pending > 0 && credit > 0 && netif_ready(nif)) {
+        size_t len = MIN(MIN(pending, credit), nif->mtu);
+        sock_tx_read(s, sockScratch, len);
+
+        struct netif_frame frame = {
+            .proto = NETSERV_SOCK_STREAM,
+            .flags = 0,
+            .srcAddr = s->localAddr,
+            .srcPort = s->localPort,
+            .dstAddr = s->peerAddr,
+            .dstPort = s->peerPort,
+            .len = len,
+            .data = sockScratch
+        };
+        peer->inflight += len;
+        netif_output(nif, &frame);
+
+        pending -= len;
+        credit -= len;
+        moved += len;
+    }
+
+    if (pending > 0 && credit == 0) {
+        /* The peer's receive ring is full. Get its client to ring the doorbell once it has made
+           some room, so the rest can follow. */
+        peer->ctrl->rxBlocked = 1;
+        __sync_synchronize();
+        if (sock_ring_sync(peer) && sock_rx_space(peer) > peer->inflight) {
+            /* The client read before it could have seen the flag, so it won't ring. Go again. */
+            return moved + sock_pump_stream(s);
+        }
+    }
+
+    /* Once everything before the shutdown has been sent, follow it with the end of stream. */
+    if (pending == 0 && s->txShutdown && !s->finSent && netif_ready(nif)) {
+        struct netif_frame frame = {
+            .proto = NETSERV_SOCK_STREAM,
+            .flags = NETIF_FRAME_FIN,
+            .srcAddr = s->localAddr,
+            .srcPort = s->localPort,
+            .dstAddr = s->peerAddr,
+            .dstPort = s->peerPort,
+            .len = 0,
+            .data = NULL
+        };
+        s->finSent = true;
+        netif_output(nif, &frame);
+    }
+
+    return moved;
+}
+
+static int
+sock_pump_dgram(struct net_socket *s)
+{
+    int moved = 0;
+    struct net_dgram_header hdr;
+    if (!sock_ring_sync(s)) {
+        return 0;
+    }
+
+    while (sock_tx_pending(s) >= sizeof(hdr)) {
+        /* Peek at the destination before committing to anything. */
+        sock_ring_peek(s->tx, s->txStart, (char*) &hdr, sizeof(hdr));
+
+        uint32_t dstAddr = hdr.addr ? hdr.addr : s->peerAddr;
+        uint32_t dstPort = hdr.addr ? hdr.port : s->peerPort;
+        struct netif *nif = netif_route(dstAddr);
+        if (nif && !netif_ready(nif)) {
+            /* Interface queue full. Leave the datagram where it is and try again later. */
+            break;
+        }
+
+        if (hdr.len > NETSERV_DGRAM_MAX || sock_tx_pending(s) < sizeof(hdr) + hdr.len) {
+            /* The client broke the record framing. There is no way to resync the ring, so throw
+               away everything in it. */
+            ROS_WARNING("Socket %d has a malformed datagram ring.", s->id);
+            s->txStart = s->txEnd;
+            *((seL4_Word*) s->tx) = s->txStart;
+            break;
+        }
+        sock_tx_read(s, (char*) &hdr, sizeof(hdr));
+        sock_tx_read(s, sockScratch, hdr.len);
+        moved += hdr.len;
+
+        if (!nif || !dstPort || hdr.len > nif->mtu) {
+            /* Unreachable, or too large to go out without fragmentation. */
+            netServ.dgramDrops++;
+            continue;
+        }
+        if (!s->localPort) {
+            s->localPort = sock_ephemeral_port(NETSERV_SOCK_DGRAM);
+        }
+
+        struct netif_frame frame = {
+            .proto = NETSERV_SOCK_DGRAM,
+            .flags = 0,
+            .srcAddr = s->localAddr ? s->localAddr : nif->addr,
+            .srcPort = s->localPort,
+            .dstAddr = dstAddr,
+            .dstPort = dstPort,
+            .len = hdr.len,
+            .data = sockScratch
+        };
+        netif_output(nif, &frame);
+    }
+
+    return moved;
+}
+
+int
+sock_pump(struct net_socket *s)
+{
+    assert(s && s->magic == NETSERV_SOCKET_MAGIC);
+    if (s->type == NETSERV_SOCK_STREAM) {
+        return sock_pump_stream(s);
+    }
+    return sock_pump_dgram(s);
+}
+
+static void
+sock_input_stream(struct netif_frame *frame)
+{
+    struct net_socket *s = NULL;
+    for (int i = 0; i < NETSERV_MAX_SOCKETS; i++) {
+        struct net_socket *t = netServ.sockets[i];
+        if (t && t->type == NETSERV_SOCK_STREAM && t->state == NETSERV_SOCKET_CONNECTED &&
+                t->localPort == frame->dstPort && t->peerPort == frame->srcPort &&
+                t->peerAddr == frame->srcAddr) {
+            s = t;
+            break;
+        }
+    }
+    if (!s) {
+        /* The connection was closed while this was in flight. */
+        return;
+    }
+
+    if (frame->len > 0) {
+        assert(s->inflight >= frame->len);
+        s->inflight -= frame->len;
+        /* The sender only sent what fitted, so there's only no room if the client moved its read
+           index backwards. */
+        if (!sock_ring_sync(s)) {
+            return;
+        }
+        if (sock_rx_space(s) < frame->len) {
+            sock_ring_reset(s);
+            return;
+        }
+        sock_rx_write(s, frame->data, frame->len);
+    }
+    if (frame->flags & NETIF_FRAME_FIN) {
+        s->ctrl->hangup = 1;
+    }
+}
+
+static void
+sock_input_dgram(struct netif_frame *frame)
+{
+    struct net_socket *s = NULL;
+    for (int i = 0; i < NETSERV_MAX_SOCKETS; i++) {
+        struct net_socket *t = netServ.sockets[i];
+        if (t && t->type == NETSERV_SOCK_DGRAM && t->localPort == frame->dstPort &&
+                (t->localAddr == NETSERV_ADDR_ANY || t->localAddr == frame->dstAddr)) {
+            s = t;
+            break;
+        }
+    }
+    if (!s) {
+        netServ.dgramDrops++;
+        return;
+    }
+    if (s->state == NETSERV_SOCKET_CONNECTED &&
+            (s->peerAddr != frame->srcAddr || s->peerPort != frame->srcPort)) {
+        /* Connected datagram sockets only hear from their peer. */
+        netServ.dgramDrops++;
+        return;
+    }
+
+    struct net_dgram_header hdr = {
+        .len = frame->len,
+        .addr = frame->srcAddr,
+        .port = frame->srcPort
+    };
+    if (!sock_ring_sync(s) || sock_rx_space(s) < sizeof(hdr) + frame->len) {
+        netServ.dgramDrops++;
+        return;
+    }
+
+    /* The record must appear in the ring in one go, so assemble it first. The frame data may
+       already be sitting in the scratch buffer, so move it up rather than copying over it. */
+    memmove(sockScratch + sizeof(hdr), frame->data, frame->len);
+    memcpy(sockScratch, &hdr, sizeof(hdr));
+    sock_rx_write(s, sockScratch, sizeof(hdr) + frame->len);
+}
+
+void
+sock_input(struct netif *nif, struct netif_frame *frame)
+{
+    assert(nif && frame);
+    if (frame->proto == NETSERV_SOCK_STREAM) {
+        sock_input_stream(frame);
+    } else {
+        sock_input_dgram(frame);
+    }
+}
+
+int
+sock_events(struct net_socket *s)
+{
+    assert(s && s->magic == NETSERV_SOCKET_MAGIC);
+    int events = 0;
+
+    if (s->state == NETSERV_SOCKET_LISTEN) {
+        return s->backlogCount > 0 ? NETSERV_EVENT_READ : 0;
+    }
+    sock_ring_sync(s);
+    if (sock_rx_pending(s) > 0 || s->ctrl->hangup) {
+        events |= NETSERV_EVENT_READ;
+    }
+    size_t minSpace = (s->type == NETSERV_SOCK_DGRAM) ? sizeof(struct net_dgram_header) : 0;
+    if (sock_tx_space(s) > minSpace || s->ctrl->peerClosed) {
+        events |= NETSERV_EVENT_WRITE;
+    }
+    if (s->ctrl->hangup || s->ctrl->peerClosed) {
+        events |= NETSERV_EVENT_HUP;
+    }
+    return events;
+}
+
+int
+sock_wait(struct net_socket *s, struct srv_client *c, int events)
+{
+    assert(s && s->magic == NETSERV_SOCKET_MAGIC);
+    assert(c && c->magic == NETSERV_CLIENT_MAGIC);
+    if (s->waiter) {
+        return -EBUSY;
+    }
+
+    /* Save the caller so we can reply once the events arrive. */
+    s->waitReply = csalloc();
+    if (!s->waitReply) {
+        ROS_ERROR("sock_wait failed to alloc cslot.");
+        return -ENOMEM;
+    }
+    int error = seL4_CNode_SaveCaller(REFOS_CSPACE, s->waitReply, REFOS_CDEPTH);
+    if (error != seL4_NoError) {
+        ROS_ERROR("sock_wait failed to save caller.");
+        csfree(s->waitReply);
+        s->waitReply = 0;
+        return -EINVAL;
+    }
+
+    s->waiter = c;
+    s->waitEvents = events | NETSERV_EVENT_HUP;
+    return 0;
+}
+
+void
+sock_service(void)
+{
+    /* Keep going until the data stops moving. Each round drains the vnic queue, which frees up
+       room for sockets that were held back by it. */
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        for (int i = 0; i < NETSERV_MAX_SOCKETS; i++) {
+            struct net_socket *s = netServ.sockets[i];
+            if (!s || !sock_ring_sync(s)) {
+                continue;
+            }
+            if (sock_tx_pending(s) > 0 && sock_pump(s) > 0) {
+                progress = true;
+            } else if (s->txShutdown && !s->finSent) {
+                /* The end of stream may have been held back by a full interface queue. */
+                sock_pump(s);
+            }
+        }
+        if (netif_poll() > 0) {
+            progress = true;
+        }
+    }
+
+    /* Now wake up everyone who has something to do. */
+    for (int i = 0; i < NETSERV_MAX_SOCKETS; i++) {
+        struct net_socket *s = netServ.sockets[i];
+        if (!s || !s->waiter) {
+            continue;
+        }
+        int events = sock_events(s) & s->waitEvents;
+        if (events) {
+            sock_wake(s, events);
+        }
+    }
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+#ifndef _NET_SERVER_SOCKET_H_
+#define _NET_SERVER_SOCKET_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sel4/sel4.h>
+#include <refos-rpc/net_common.h>
+#include <refos-util/serv_connect.h>
+#include "netif.h"
+
+/*! @file
+    @brief Network server socket module.
+
+    Keeps the socket table, and moves data between the sockets' shared rings and the network
+    interfaces. Each socket's transmit ring is drained by sock_pump(), which splits the data into
+    frames and hands them to the netif routing to the destination. Frames arriving from a netif go
+    through sock_input(), which finds the destination socket and writes into its receive ring.
+
+    Stream sockets never drop data. Before a frame is sent, the sender takes credit for it out of
+    the space left in the peer's receive ring (minus what is already in flight on the vnic queue).
+    When there is no credit left, the peer's control block is flagged as rxBlocked so its client
+    rings the doorbell once it has read some data. Datagram sockets drop a datagram if the
+    receiving ring is full, as UDP would.
+*/
+
+#define NETSERV_SOCKET_MAGIC 0x50C4E7A1
+#define NETSERV_MAX_SOCKETS 64
+#define NETSERV_MAX_BACKLOG 16
+#define NETSERV_EPHEMERAL_PORT_MIN 49152
+#define NETSERV_EPHEMERAL_PORT_MAX 65535
+
+enum net_socket_state {
+    NETSERV_SOCKET_OPEN,
+    NETSERV_SOCKET_LISTEN,
+    NETSERV_SOCKET_CONNECTED
+};
+
+/*! @brief Network server socket structure. */
+struct net_socket {
+    uint32_t magic;
+    int id;
+    int type;
+    enum net_socket_state state;
+    bool accepted;
+    struct srv_client *owner; /* No ownership. */
+
+    /* Shared buffer, mapped from the client's dataspace. */
+    seL4_CPtr bufferDataspace; /* Has ownership. */
+    seL4_CPtr bufferWindow; /* Has ownership. */
+    char *buffer;
+    struct net_socket_control *ctrl;
+    char *rx;
+    char *tx;
+    unsigned int rxEnd;
+    unsigned int txStart;
+    unsigned int rxStart; /* Client written. Checked copy, as of the last sync. */
+    unsigned int txEnd; /* Client written. Checked copy, as of the last sync. */
+
+    /* Addressing, all in host byte order. */
+    uint32_t localAddr;
+    uint32_t localPort;
+    uint32_t peerAddr;
+    uint32_t peerPort;
+
+    /* Stream connection state. */
+    struct net_socket *peer; /* No ownership. */
+    struct net_socket *listener; /* No ownership. Set until the listener accepts us. */
+    uint32_t inflight;
+    bool txShutdown;
+    bool finSent;
+
+    /* Listening sockets only. Connections waiting to be accepted. */
+    struct net_socket *backlog[NETSERV_MAX_BACKLOG]; /* No ownership. */
+    int backlogCount;
+    int backlogMax;
+
+    /* A client blocked in net_wait() on this socket. */
+    struct srv_client *waiter; /* No ownership. */
+    seL4_CPtr waitReply; /* Has ownership. */
+    int waitEvents;
+};
+
+/*! @brief Create a socket, mapping its shared buffer.
+    @param owner The client creating the socket. (No ownership)
+    @param type NETSERV_SOCK_STREAM or NETSERV_SOCK_DGRAM.
+    @param bufferDataspace Copied out dataspace cap holding the shared rings. (Takes ownership on
+                           success only)
+    @param bufferSize The size of the dataspace.
+    @param out Output socket. (No ownership)
+    @return 0 on success, negative errno value otherwise.
+*/
+int sock_create(struct srv_client *owner, int type, seL4_CPtr bufferDataspace, uint32_t bufferSize,
+                struct net_socket **out);
+
+/*! @brief Look up a socket, checking that the given client owns it.
+    @return The socket, or NULL if it does not exist or belongs to someone else.
+*/
+struct net_socket *sock_get(struct srv_client *owner, int id);
+
+/*! @brief Close a socket, detaching it from its peer, its listener and any waiter. */
+void sock_close(struct net_socket *s);
+
+/*! @brief Close every socket owned by the given client. */
+void sock_purge_client(struct srv_client *owner);
+
+/*! @brief Bind a socket to a local address and port. Port 0 picks an ephemeral port.
+    @return 0 on success, negative errno value otherwise.
+*/
+int sock_bind(struct net_socket *s, uint32_t addr, uint32_t port);
+
+/*! @brief Start accepting connections on a bound stream socket.
+    @return 0 on success, negative errno value otherwise.
+*/
+int sock_listen(struct net_socket *s, int backlog);
+
+/*! @brief Connect a stream socket to a listener, or set a datagram socket's default peer.
+    @return 0 on success, negative errno value otherwise.
+*/
+int sock_connect(struct net_socket *s, uint32_t addr, uint32_t port);
+
+/*! @brief Accept the oldest connection waiting on a listening socket.
+    @param s The listening socket.
+    @param newSock The newly created socket for the connection, whose buffer is already mapped.
+                   (No ownership)
+    @return 0 on success, negative errno value otherwise.
+*/
+int sock_accept(struct net_socket *s, struct net_socket *newSock);
+
+/*! @brief Stop sending on a stream socket. The peer sees end of stream after pending data.
+    @return 0 on success, negative errno value otherwise.
+*/
+int sock_shutdown(struct net_socket *s);
+
+/*! @brief Move as much data as possible out of a socket's transmit ring.
+    @return The number of bytes moved.
+*/
+int sock_pump(struct net_socket *s);
+
+/*! @brief Deliver a frame that arrived on an interface to its destination socket.
+    @param nif The interface the frame arrived on. (No ownership)
+    @param frame The arrived frame. (No ownership)
+*/
+void sock_input(struct netif *nif, struct netif_frame *frame);
+
+/*! @brief Get the NETSERV_EVENT mask of events pending on a socket. */
+int sock_events(struct net_socket *s);
+
+/*! @brief Park the current caller until the socket has one of the given events pending.
+    @return 0 on success, negative errno value otherwise.
+*/
+int sock_wait(struct net_socket *s, struct srv_client *c, int events);
+
+/*! @brief Service all sockets after a message has been handled. Pumps pending transmit data,
+           drains the vnic queue, and replies to any waiters whose events have arrived. */
+void sock_service(void);
+
+#endif /* _NET_SERVER_SOCKET_H_ */
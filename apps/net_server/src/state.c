@@ -0,0 +1,53 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <refos-util/cspace.h>
+#include <refos/vmlayout.h>
+#include <refos/refos.h>
+#include "state.h"
+#include "badge.h"
+
+/*! @file
+    @brief Network server global state & helper functions. */
+
+struct netserv_state netServ;
+srv_common_t *netServCommon;
+const char* dprintfServerName = "NETSERV";
+int dprintfServerColour = 36;
+
+void
+netserv_init(void)
+{
+    /* Set up the server common config. */
+    srv_common_config_t cfg = {
+        .maxClients = SRV_DEFAULT_MAX_CLIENTS,
+        .clientBadgeBase = NETSERV_CLIENT_BADGE_BASE,
+        .clientMagic = NETSERV_CLIENT_MAGIC,
+        .notificationBufferSize = SRV_DEFAULT_NOTIFICATION_BUFFER_SIZE,
+        .paramBufferSize = SRV_DEFAULT_PARAM_BUFFER_SIZE,
+        .serverName = "netserver",
+        .mountPointPath = NETSERV_MOUNTPOINT,
+        .nameServEP = REFOS_NAMESERV_EP,
+        .faultDeathNotifyBadge = NETSERV_ASYNC_NOTIFY_BADGE | NETSERV_ASYNC_BADGE_MASK
+    };
+
+    /* Set up net server common state. */
+    netServCommon = &netServ.commonState;
+    srv_common_init(netServCommon, cfg);
+
+    /* Bring up the network interfaces. */
+    netServ.nextEphemeralPort = NETSERV_EPHEMERAL_PORT_MIN;
+    netif_init();
+}
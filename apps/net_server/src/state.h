@@ -0,0 +1,66 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+#ifndef _NET_SERVER_STATE_H_
+#define _NET_SERVER_STATE_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <sel4/sel4.h>
+#include <refos/vmlayout.h>
+#include <refos-rpc/rpc.h>
+
+#include "badge.h"
+#include "netif.h"
+#include "socket.h"
+
+#include <refos-util/serv_connect.h>
+#include <refos-util/serv_common.h>
+#include <refos-util/cspace.h>
+#include <refos/refos.h>
+
+/*! @file
+    @brief Network server global state & helper functions. */
+
+// Debug printing.
+#include <refos-util/dprintf.h>
+
+#ifndef CONFIG_REFOS_DEBUG
+    #define printf(x,...)
+#endif /* CONFIG_REFOS_DEBUG */
+
+#define NETSERV_MMAP_REGION_SIZE 0x64000
+#define NETSERV_MOUNTPOINT "net"
+#define NETSERV_CLIENT_MAGIC 0x3E7C11E4
+
+/*! @brief Network server global state. */
+struct netserv_state {
+    srv_common_t commonState;
+
+    struct netif loopback;
+    struct netif_vnic vnic;
+
+    struct net_socket *sockets[NETSERV_MAX_SOCKETS];
+    uint32_t nextEphemeralPort;
+    uint32_t dgramDrops;
+};
+
+extern struct netserv_state netServ;
+extern srv_common_t *netServCommon;
+
+/*! @brief Initialise network server state. */
+void netserv_init(void);
+
+#endif /* _NET_SERVER_STATE_H_ */
@@ -72,6 +72,11 @@ data_open_handler(void *rpc_userptr , char* rpc_name , int rpc_flags , int rpc_m
         }
     }
 
+    /* Anonymous frames are charged to the opening process; device frames are not. */
+    if (!newDataspace->physicalAddrEnabled) {
+        newDataspace->ownerPID = pcb->pid;
+    }
+
     SET_ERRNO_PTR(rpc_errno, ESUCCESS);
     assert(newDataspace->magic == RAM_DATASPACE_MAGIC);
     return newDataspace->capability.capPtr;
@@ -99,6 +104,9 @@ data_close_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd)
         ROS_ERROR("EINVALIDPARAM: dataspace not found.\n");
         return EINVALIDPARAM;
     }
+    if (dspace->readOnly) {
+        return EACCESSDENIED;
+    }
 
     /* Purge the dataspace from all windows, unmapping every instance of it. */
     w_purge_dspace(&procServ.windowList, dspace);
@@ -125,6 +133,17 @@ data_getc_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , int rpc_block)
     return EUNIMPLEMENTED;
 }
 
+int
+data_ioctl_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , int rpc_request ,
+                   uint32_t rpc_arg)
+{
+    (void) rpc_userptr;
+    (void) rpc_dspace_fd;
+    (void) rpc_request;
+    (void) rpc_arg;
+    return -EUNIMPLEMENTED;
+}
+
 off_t
 data_lseek_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , off_t rpc_offset ,
                    int rpc_whence)
@@ -184,6 +203,10 @@ data_expand_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , uint32_t rpc_s
         return EINVALIDPARAM;
     }
 
+    if (dspace->readOnly) {
+        return EACCESSDENIED;
+    }
+
     return ram_dspace_expand(dspace, rpc_size);
 }
 
@@ -225,6 +248,11 @@ data_datamap_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , seL4_CPtr rpc
         return EINVALIDPARAM;
     }
 
+    /* Shared read-only content must never be writable through the window. */
+    if (dspace->readOnly && (window->permissions & W_PERMISSION_WRITE)) {
+        return EACCESSDENIED;
+    }
+
     /* Associate the dataspace with the window. This will release whatever the window was associated
        with beforehand. */
     w_set_anon_dspace(window, dspace, rpc_offset);
@@ -310,6 +338,11 @@ data_have_data_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , seL4_CPtr r
         return EINVALIDPARAM;
     }
 
+    /* Shared read-only content has its content initialiser set exactly once. */
+    if (dspace->readOnly && dspace->contentInitEnabled) {
+        return EACCESSDENIED;
+    }
+
     /* Special case - no fault notify EP, means unset content-init mode. */
     if (!rpc_faultNotifyEP) {
         cspacepath_t path;
@@ -395,6 +428,36 @@ data_provide_data_from_parambuffer_handler(void *rpc_userptr , seL4_CPtr rpc_dsp
     return ESUCCESS;
 }
 
+/*! \brief RAM dataspaces never block, so they are always ready and nothing ever gets armed. */
+int
+data_poll_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , seL4_CPtr rpc_notifyEP ,
+                  int rpc_events , uint32_t rpc_arg)
+{
+    struct proc_pcb *pcb = (struct proc_pcb*) rpc_userptr;
+    struct procserv_msg *m = (struct procserv_msg*) pcb->rpcClient.userptr;
+    assert(pcb && pcb->magic == REFOS_PCB_MAGIC);
+
+    if (!check_dispatch_caps(m, 0x00000001, 2)) {
+        return -EINVALIDPARAM;
+    }
+
+    /* We have no use for the notification EP. */
+    dispatcher_release_copyout_cptr(dispatcher_copyout_cptr(rpc_notifyEP));
+
+    /* Verify and find the RAM dataspace. */
+    if (!dispatcher_badge_dspace(rpc_dspace_fd)) {
+        ROS_ERROR("EINVALIDPARAM: invalid RAM dataspace badge..\n");
+        return -EINVALIDPARAM;
+    }
+    struct ram_dspace *dspace = ram_dspace_get_badge(&procServ.dspaceList, rpc_dspace_fd);
+    if (!dspace) {
+        ROS_ERROR("EINVALIDPARAM: dataspace not found.\n");
+        return -EINVALIDPARAM;
+    }
+
+    return rpc_events & (REFOS_POLL_READ | REFOS_POLL_WRITE);
+}
+
 int
 check_dispatch_dataspace(struct procserv_msg *m, void **userptr)
 {
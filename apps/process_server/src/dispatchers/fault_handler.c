@@ -96,9 +96,14 @@ fault_delegate_notification(struct procserv_vmfault_msg *f, struct proc_pcb *del
         }
     }
 
-    /* Append notification to pager's notification buffer. */
+    /* Append notification to pager's notification buffer. Faults from other clients may be
+       delegated to the same pager at the same time, so the buffer is written under the lock of
+       its dataspace. */
+    struct ram_dspace *notifyDspace = delegationPCB->notificationBuffer->dataspace;
+    lock_dspace_acquire(&procServ.locks, notifyDspace);
     int error = rb_write(delegationPCB->notificationBuffer, (char*)(&vmFaultNotification),
             sizeof(vmFaultNotification));
+    lock_dspace_release(&procServ.locks, notifyDspace);
     if (error) {
         output_segmentation_fault("Failed to write VM fault notification to buffer.", f);
         return;
@@ -110,6 +115,28 @@ fault_delegate_notification(struct procserv_vmfault_msg *f, struct proc_pcb *del
 
 /* ----------------------------- Proc Server fault handler functions ---------------------------- */
 
+/*! @brief Whether the faulting address is a copy-on-write page which has not been copied yet.
+    @param f The VM fault message info struct.
+    @param aw Found associated window of the faulting address & client.
+    @param window The window structure of the faulting address & client.
+    @return true if the page is still shared with the copy-on-write source.
+*/
+static bool
+fault_is_cow_page(struct procserv_vmfault_msg *f, struct w_associated_window *aw,
+                  struct w_window *window)
+{
+    if (window->mode != W_MODE_ANONYMOUS || !window->ramDataspace ||
+            !window->ramDataspace->cowSource) {
+        return false;
+    }
+    vaddr_t dspaceOffset = (f->faultAddr + window->ramDataspaceOffset) -
+                           REFOS_PAGE_ALIGN(aw->offset);
+    lock_dspace_acquire(&procServ.locks, window->ramDataspace);
+    bool cow = ram_dspace_check_page(window->ramDataspace, dspaceOffset) == 0;
+    lock_dspace_release(&procServ.locks, window->ramDataspace);
+    return cow;
+}
+
 /*! @brief Handles faults on windows mapped to anonymous memory.
 
     This function is responsible for handling VM faults on windows which have been mapped to the
@@ -140,15 +167,20 @@ handle_vm_fault_dspace(struct procserv_msg *m, struct procserv_vmfault_msg *f,
     dvprintf("# PID %d VM fault ―――――▶ anon RAM dspace %d\n", f->pcb->pid, dspace->ID);
 
     if (dspace->contentInitEnabled) {
-        /* Data space is backed by external content. Content initialisation delegation. */
+        /* Data space is backed by external content. Content initialisation delegation. The
+           content-init state and waiter list may also be changed by faults from other clients
+           sharing this dataspace. */
+        lock_dspace_acquire(&procServ.locks, dspace);
         int contentInitState =  ram_dspace_need_content_init(dspace, dspaceOffset);
         if (contentInitState < 0) {
+            lock_dspace_release(&procServ.locks, dspace);
             output_segmentation_fault("Failed to retrieve content-init state.", f);
             return EINVALID;
         }
         if (contentInitState == true) {
             /* Content has not yet been initialised so we delegate. */
             if (f->faultAddr + window->ramDataspaceOffset >= aw->offset + aw->size) {
+                lock_dspace_release(&procServ.locks, dspace);
                 output_segmentation_fault("Fault address out of range!", f);
                 return EINVALID;
             }
@@ -157,10 +189,12 @@ handle_vm_fault_dspace(struct procserv_msg *m, struct procserv_vmfault_msg *f,
             assert(dspace->contentInitPID != PID_NULL);
             struct proc_pcb* cinitPCB = pid_get_pcb(&procServ.PIDList, dspace->contentInitPID);
             if (!cinitPCB) {
+                lock_dspace_release(&procServ.locks, dspace);
                 output_segmentation_fault("Invalid content initialiser PID.", f);
                 return EINVALID;
             }
             if (!dspace->contentInitEP.capPtr) {
+                lock_dspace_release(&procServ.locks, dspace);
                 output_segmentation_fault("Invalid content-init endpoint!", f);
                 return EINVALID;
             }
@@ -168,6 +202,7 @@ handle_vm_fault_dspace(struct procserv_msg *m, struct procserv_vmfault_msg *f,
             /* Save the reply endpoint. */
             int error = ram_dspace_add_content_init_waiter_save_current_caller(dspace,
                     dspaceOffset);
+            lock_dspace_release(&procServ.locks, dspace);
             if (error != ESUCCESS) {
                 output_segmentation_fault("Failed to save reply cap as dspace waiter!", f);
                 return EINVALID;
@@ -186,19 +221,26 @@ handle_vm_fault_dspace(struct procserv_msg *m, struct procserv_vmfault_msg *f,
             /* Return an error here to avoid resuming the client. */
             return EDELEGATED;
         }
+        lock_dspace_release(&procServ.locks, dspace);
 
         /* Fallthrough to normal dspace mapping if content-init state is set to already provided. */
     }
 
-    /* Get the page at the dataspaceOffset into the dataspace. */
-    seL4_CPtr frame = ram_dspace_get_page(dspace, dspaceOffset);
+    /* Get the page at the dataspaceOffset into the dataspace. A read of a copy-on-write page
+       that hasn't been written yet maps the source's page read-only instead of copying it. */
+    bool shared = false;
+    lock_dspace_acquire(&procServ.locks, dspace);
+    seL4_CPtr frame = f->read ? ram_dspace_get_page_shared(dspace, dspaceOffset, &shared) :
+                                ram_dspace_get_page(dspace, dspaceOffset);
+    lock_dspace_release(&procServ.locks, dspace);
     if (!frame) {
         output_segmentation_fault("Out of memory to allocate page or read off end of dspace.", f);
         return ENOMEM;
     }
 
     /* Map this frame into the client process's page directory. */
-    int error = vs_map(&f->pcb->vspace, f->faultAddr, &frame, 1);
+    int error = shared ? vs_map_read_only(&f->pcb->vspace, f->faultAddr, frame) :
+                         vs_map(&f->pcb->vspace, f->faultAddr, &frame, 1);
     if (error != ESUCCESS) {
         output_segmentation_fault("Failed to map frame into client's vspace at faultAddr.", f);
         return error;
@@ -307,11 +349,16 @@ handle_vm_fault(struct procserv_msg *m, struct procserv_vmfault_msg *f)
         return;
     }
 
-    /* Check that there isn't a page entry already mapped. */
+    /* Check that there isn't a page entry already mapped. The exception is a write to a
+       copy-on-write page which is still mapped read-only from its source; unmap it so it can be
+       copied and mapped writable below. */
     cspacepath_t pageEntry = vs_get_frame(&f->pcb->vspace, f->faultAddr);
     if (pageEntry.capPtr != 0) {
-        output_segmentation_fault("entry already occupied; book-keeping error.", f);
-        return;
+        if (f->read || !fault_is_cow_page(f, aw, window)) {
+            output_segmentation_fault("entry already occupied; book-keeping error.", f);
+            return;
+        }
+        vs_unmap(&f->pcb->vspace, REFOS_PAGE_ALIGN(f->faultAddr), 1);
     }
 
     /* Handle the dispatch request depending on window mode. */
@@ -59,10 +59,17 @@ proc_create_mem_window_internal_handler(void *rpc_userptr , uint32_t rpc_vaddr ,
         return 0;
     }
 
+    /* Enforce the process' window limit. */
+    int error = proc_mem_check_window(pcb);
+    if (error != ESUCCESS) {
+        SET_ERRNO_PTR(rpc_errno, error);
+        return 0;
+    }
+
     /* Create the window. */
     int windowID = W_INVALID_WINID;
     bool cached = (flags & W_FLAGS_UNCACHED) ? false : true;
-    int error = vs_create_window(&pcb->vspace, rpc_vaddr, rpc_size, rpc_permissions, cached,
+    error = vs_create_window(&pcb->vspace, rpc_vaddr, rpc_size, rpc_permissions, cached,
             &windowID);
     if (error != ESUCCESS || windowID == W_INVALID_WINID) {
         dvprintf("Could not create window.\n");
@@ -341,6 +348,49 @@ proc_window_map_handler(void *rpc_userptr , seL4_CPtr rpc_window , uint32_t rpc_
     return ESUCCESS;
 }
 
+/*! @brief Handles dataspace server batched frame mapping syscalls. */
+int
+proc_window_map_batch_handler(void *rpc_userptr , seL4_CPtr rpc_window ,
+                              uint32_t rpc_windowOffset , rpc_buffer_t rpc_srcAddrs ,
+                              uint32_t rpc_count)
+{
+    struct proc_pcb *pcb = (struct proc_pcb*) rpc_userptr;
+    struct procserv_msg *m = (struct procserv_msg*) pcb->rpcClient.userptr;
+    assert(pcb && pcb->magic == REFOS_PCB_MAGIC);
+
+    if (!check_dispatch_caps(m, 0x00000001, 1)) {
+        return -EINVALIDPARAM;
+    }
+    if (rpc_srcAddrs.count != rpc_count || rpc_count == 0 ||
+            rpc_count > PROCSERV_WINDOW_MAP_BATCH_MAX) {
+        return -EINVALIDPARAM;
+    }
+
+    /* Retrieve and verify the window cap. */
+    if (!dispatcher_badge_window(rpc_window)) {
+        return -EINVALIDPARAM;
+    }
+    struct w_window *window = w_get_window(&procServ.windowList, rpc_window - W_BADGE_BASE);
+    if (!window) {
+        ROS_ERROR("window does not exist!\n");
+        return -EINVALIDWINDOW;
+    }
+
+    /* Map the frames from src vspace to dest vspace. */
+    struct proc_pcb *clientPCB = NULL;
+    int nMapped = vs_map_batch_across_vspace(&pcb->vspace, (vaddr_t*) rpc_srcAddrs.data,
+                                             rpc_count, window, rpc_windowOffset, &clientPCB);
+    if (nMapped <= 0) {
+        return nMapped;
+    }
+    assert(clientPCB != NULL && clientPCB->magic == REFOS_PCB_MAGIC);
+
+    /* Resume the blocked faulting thread if there is one. */
+    assert(procServ.unblockClientFaultPID == PID_NULL);
+    procServ.unblockClientFaultPID = clientPCB->pid;
+    return nMapped;
+}
+
 /*! @brief Handles device server device map syscalls. */
 refos_err_t
 proc_device_map_handler(void *rpc_userptr , seL4_CPtr rpc_window , uint32_t rpc_windowOffset ,
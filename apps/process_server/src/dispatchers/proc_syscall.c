@@ -19,6 +19,8 @@
 #include "../system/process/pid.h"
 #include "../system/process/process.h"
 #include "../system/process/proc_client_watch.h"
+#include "../system/process/cpu_usage.h"
+#include "../system/process/profile.h"
 #include "../system/addrspace/vspace.h"
 #include "../system/memserv/window.h"
 #include "../system/memserv/dataspace.h"
@@ -54,7 +56,11 @@ proc_syscall_allocate_endpoint(struct proc_pcb *pcb, kobject_t type)
 
     /* Allocate the kernel object. */
     vka_object_t endpoint;
-    int error = -1;
+    int error = proc_mem_check_kernel_objects(pcb, 1);
+    if (error) {
+        return 0;
+    }
+    error = -1;
     if (type == KOBJECT_ENDPOINT) {
         error = vka_alloc_endpoint(&procServ.vka, &endpoint);
     } else if (type == KOBJECT_NOTIFICATION) {
@@ -256,8 +262,14 @@ proc_new_proc_handler(void *rpc_userptr , char* rpc_name , char* rpc_params , bo
         return EINVALIDPARAM;
     }
 
+    /* A process can't start a child above its own priority ceiling. */
+    if (rpc_priority < 0 || rpc_priority > pcb->sched.maxPriority) {
+        return EINVALIDPARAM;
+    }
+
     /* Kick off an instance of selfloader, which will do the actual process loading work. */
-    int error = proc_load_direct("selfloader", rpc_priority, rpc_name, pcb->pid, 0x0);
+    int error = proc_load_direct("selfloader", rpc_priority, rpc_name, rpc_params, pcb->pid,
+                                 0x0);
     if (error != ESUCCESS) {
         ROS_WARNING("failed to run selfloader for new process [%s].", rpc_name);
         return error;
@@ -291,17 +303,32 @@ proc_exit_handler(void *rpc_userptr , int32_t rpc_status)
 
 int
 proc_clone_internal_handler(void *rpc_userptr , seL4_Word rpc_entryPoint , seL4_Word rpc_childStack
-        , int rpc_flags , seL4_Word rpc_arg , refos_err_t* rpc_errno)
+        , int rpc_flags , seL4_Word rpc_arg , seL4_Word rpc_tls , refos_err_t* rpc_errno)
 {
     struct proc_pcb *pcb = (struct proc_pcb*) rpc_userptr;
     assert(pcb->magic == REFOS_PCB_MAGIC);
 
     int threadID = -1;
-    int error = proc_clone(pcb, &threadID, (vaddr_t) rpc_childStack, (vaddr_t) rpc_entryPoint);
+    int error = proc_clone(pcb, &threadID, (vaddr_t) rpc_childStack, (vaddr_t) rpc_entryPoint,
+                           rpc_arg, rpc_tls);
     SET_ERRNO_PTR(rpc_errno, error);
     return threadID;
 }
 
+/*! @brief Exits and deletes the thread which made this call. */
+refos_err_t
+proc_thread_exit_handler(void *rpc_userptr , int rpc_threadID , seL4_Word rpc_clearTID)
+{
+    struct proc_pcb *pcb = (struct proc_pcb*) rpc_userptr;
+    assert(pcb->magic == REFOS_PCB_MAGIC);
+
+    /* The threads of a process share one cspace, so their calls all arrive on the same PID badge
+       and we can't tell which of them made this one. The ID is only trusted to name a thread of
+       the calling process. We always reply: when the caller was the thread that exited, its reply
+       cap went with its TCB and the reply is dropped, and any other caller is not left blocked. */
+    return proc_thread_exit(pcb, rpc_threadID, (vaddr_t) rpc_clearTID);
+}
+
 refos_err_t
 proc_nice_handler(void *rpc_userptr , int rpc_threadID , int rpc_priority)
 {
@@ -322,6 +349,325 @@ proc_get_irq_handler_handler(void *rpc_userptr , int rpc_irq)
     return procserv_get_irq_handler(rpc_irq);
 }
 
+/*! @brief Look up the target process of a memory or CPU accounting syscall.
+    @param pcb The calling process.
+    @param pid The target PID, or 0 for the calling process.
+    @return The target PCB if found, NULL otherwise. (No ownership)
+*/
+static struct proc_pcb *
+proc_syscall_mem_target(struct proc_pcb *pcb, int32_t pid)
+{
+    if (pid == 0) {
+        return pcb;
+    }
+    struct proc_pcb *target = pid_get_pcb(&procServ.PIDList, (uint32_t) pid);
+    if (!target || target->magic != REFOS_PCB_MAGIC) {
+        return NULL;
+    }
+    return target;
+}
+
+/*! @brief Handles memory statistics query syscalls. */
+refos_err_t
+proc_get_mem_stats_handler(void *rpc_userptr , int32_t rpc_pid , refos_mem_stats_t* rpc_stats)
+{
+    struct proc_pcb *pcb = (struct proc_pcb*) rpc_userptr;
+    assert(pcb->magic == REFOS_PCB_MAGIC);
+    if (!rpc_stats) {
+        return EINVALIDPARAM;
+    }
+    struct proc_pcb *target = proc_syscall_mem_target(pcb, rpc_pid);
+    if (!target) {
+        return EINVALIDPARAM;
+    }
+    proc_get_mem_stats(target, rpc_stats);
+    return ESUCCESS;
+}
+
+/*! @brief Returns whether a new memory limit is no looser than the old one. 0 means no limit. */
+static inline bool
+proc_syscall_mem_limit_tightens(uint32_t old, uint32_t new)
+{
+    return new == old || (new != 0 && (old == 0 || new <= old));
+}
+
+/*! @brief Handles memory limit syscalls.
+
+    A parent may set any limit on its children. A process may tighten, but never loosen, its own
+    limits, so a limit set by the parent stays in force.
+*/
+refos_err_t
+proc_set_mem_limits_handler(void *rpc_userptr , int32_t rpc_pid , uint32_t rpc_maxFrames ,
+                            uint32_t rpc_maxWindows , uint32_t rpc_maxKernelObjects)
+{
+    struct proc_pcb *pcb = (struct proc_pcb*) rpc_userptr;
+    assert(pcb->magic == REFOS_PCB_MAGIC);
+    struct proc_pcb *target = proc_syscall_mem_target(pcb, rpc_pid);
+    if (!target) {
+        return EINVALIDPARAM;
+    }
+
+    if (target == pcb) {
+        if (!proc_syscall_mem_limit_tightens(target->mem.maxFrames, rpc_maxFrames) ||
+            !proc_syscall_mem_limit_tightens(target->mem.maxWindows, rpc_maxWindows) ||
+            !proc_syscall_mem_limit_tightens(target->mem.maxKernelObjects,
+                                             rpc_maxKernelObjects)) {
+            return EACCESSDENIED;
+        }
+    } else if (target->parentPID != pcb->pid) {
+        return EACCESSDENIED;
+    }
+
+    target->mem.maxFrames = rpc_maxFrames;
+    target->mem.maxWindows = rpc_maxWindows;
+    target->mem.maxKernelObjects = rpc_maxKernelObjects;
+    return ESUCCESS;
+}
+
+/*! @brief Handles CPU time statistics query syscalls. */
+refos_err_t
+proc_get_cpu_stats_handler(void *rpc_userptr , int32_t rpc_pid , int rpc_threadID ,
+                           refos_cpu_stats_t* rpc_stats)
+{
+    struct proc_pcb *pcb = (struct proc_pcb*) rpc_userptr;
+    assert(pcb->magic == REFOS_PCB_MAGIC);
+    if (!rpc_stats) {
+        return EINVALIDPARAM;
+    }
+#ifndef CONFIG_KERNEL_MCS
+    return EUNIMPLEMENTED;
+#endif
+    struct proc_pcb *target = proc_syscall_mem_target(pcb, rpc_pid);
+    if (!target) {
+        return EINVALIDPARAM;
+    }
+    return proc_get_cpu_stats(target, rpc_threadID, rpc_stats);
+}
+
+/*! @brief Handles scheduling parameter syscalls.
+
+    A parent may set any parameters on its children. A process may lower, but never raise, its own
+    share of the CPU (budget / period).
+*/
+refos_err_t
+proc_set_sched_params_handler(void *rpc_userptr , int32_t rpc_pid , uint32_t rpc_budgetUS ,
+                              uint32_t rpc_periodUS)
+{
+    struct proc_pcb *pcb = (struct proc_pcb*) rpc_userptr;
+    assert(pcb->magic == REFOS_PCB_MAGIC);
+    struct proc_pcb *target = proc_syscall_mem_target(pcb, rpc_pid);
+    if (!target) {
+        return EINVALIDPARAM;
+    }
+
+    if (target == pcb) {
+        uint64_t share = (uint64_t) rpc_budgetUS * target->sched.periodUS;
+        uint64_t oldShare = (uint64_t) target->sched.budgetUS * rpc_periodUS;
+        if (share > oldShare) {
+            return EACCESSDENIED;
+        }
+    } else if (target->parentPID != pcb->pid) {
+        return EACCESSDENIED;
+    }
+    return proc_set_sched_params(target, rpc_budgetUS, rpc_periodUS);
+}
+
+/*! @brief Handles system CPU utilisation sampling syscalls. */
+refos_err_t
+proc_cpu_sample_handler(void *rpc_userptr , refos_cpu_sample_t* rpc_sample)
+{
+    struct proc_pcb *pcb = (struct proc_pcb*) rpc_userptr;
+    assert(pcb->magic == REFOS_PCB_MAGIC);
+    if (!rpc_sample) {
+        return EINVALIDPARAM;
+    }
+    return cpu_usage_sample(&procServ.cpuUsage, rpc_sample);
+}
+
+/*! @brief Handles process CPU utilisation query syscalls. */
+refos_err_t
+proc_get_cpu_usage_handler(void *rpc_userptr , int32_t rpc_pid , refos_cpu_usage_t* rpc_usage)
+{
+    struct proc_pcb *pcb = (struct proc_pcb*) rpc_userptr;
+    assert(pcb->magic == REFOS_PCB_MAGIC);
+    if (!rpc_usage || rpc_pid < 0) {
+        return EINVALIDPARAM;
+    }
+    return cpu_usage_get(&procServ.cpuUsage, (uint32_t) rpc_pid, rpc_usage);
+}
+
+/*! @brief Handles profiler start syscalls. */
+refos_err_t
+proc_profile_start_handler(void *rpc_userptr , int32_t rpc_pid)
+{
+    struct proc_pcb *pcb = (struct proc_pcb*) rpc_userptr;
+    assert(pcb->magic == REFOS_PCB_MAGIC);
+    struct proc_pcb *target = proc_syscall_mem_target(pcb, rpc_pid);
+    if (!target) {
+        return EINVALIDPARAM;
+    }
+    return proc_profile_start(&procServ.profileList, target->pid, pcb->pid);
+}
+
+/*! @brief Handles profiler stop syscalls. */
+refos_err_t
+proc_profile_stop_handler(void *rpc_userptr , int32_t rpc_pid)
+{
+    struct proc_pcb *pcb = (struct proc_pcb*) rpc_userptr;
+    assert(pcb->magic == REFOS_PCB_MAGIC);
+    struct proc_pcb *target = proc_syscall_mem_target(pcb, rpc_pid);
+    if (!target) {
+        return EINVALIDPARAM;
+    }
+    return proc_profile_stop(&procServ.profileList, target->pid);
+}
+
+/*! @brief Handles profiler histogram read syscalls. The histogram of a process which has exited
+           may only be read by the process which started profiling it. */
+refos_err_t
+proc_profile_read_handler(void *rpc_userptr , int32_t rpc_pid , uint32_t rpc_start ,
+                          refos_profile_chunk_t* rpc_chunk)
+{
+    struct proc_pcb *pcb = (struct proc_pcb*) rpc_userptr;
+    assert(pcb->magic == REFOS_PCB_MAGIC);
+    if (!rpc_chunk) {
+        return EINVALIDPARAM;
+    }
+    uint32_t pid;
+    struct proc_pcb *target = proc_syscall_mem_target(pcb, rpc_pid);
+    if (target) {
+        pid = target->pid;
+    } else if (rpc_pid > 0 &&
+               proc_profile_owner(&procServ.profileList, (uint32_t) rpc_pid) == pcb->pid) {
+        pid = (uint32_t) rpc_pid;
+    } else {
+        return EINVALIDPARAM;
+    }
+    return proc_profile_read(&procServ.profileList, pid, rpc_start, rpc_chunk);
+}
+
+/*! @brief Handles profiler tick syscalls from the timer server. */
+int
+proc_profile_tick_handler(void *rpc_userptr)
+{
+    struct proc_pcb *pcb = (struct proc_pcb*) rpc_userptr;
+    assert(pcb->magic == REFOS_PCB_MAGIC);
+    if ((pcb->systemCapabilitiesMask & PROCESS_PERMISSION_DEVICE_IRQ) == 0) {
+        return -EACCESSDENIED;
+    }
+    return proc_profile_tick(&procServ.profileList);
+}
+
+/*! @brief Loads the calling selfloader's program from its process template. */
+refos_err_t
+proc_template_load_handler(void *rpc_userptr , int rpc_generation)
+{
+    struct proc_pcb *pcb = (struct proc_pcb*) rpc_userptr;
+    assert(pcb->magic == REFOS_PCB_MAGIC);
+    if (!pcb->segmentLoader) {
+        return EACCESSDENIED;
+    }
+    return proc_load_template(pcb, rpc_generation);
+}
+
+/*! @brief Copies a loaded ELF segment into the template the calling selfloader is capturing. */
+refos_err_t
+proc_template_add_segment_handler(void *rpc_userptr , seL4_CPtr rpc_dataspace ,
+                                  seL4_Word rpc_vaddr , seL4_Word rpc_fileSize ,
+                                  seL4_Word rpc_segmentSize)
+{
+    struct proc_pcb *pcb = (struct proc_pcb*) rpc_userptr;
+    struct procserv_msg *m = (struct procserv_msg*) pcb->rpcClient.userptr;
+    assert(pcb->magic == REFOS_PCB_MAGIC);
+    if (!pcb->templateLoader) {
+        return EACCESSDENIED;
+    }
+
+    struct ram_dspace *dataspace = NULL;
+    if (check_dispatch_caps(m, 0x00000001, 1) && dispatcher_badge_dspace(rpc_dataspace)) {
+        dataspace = ram_dspace_get_badge(&procServ.dspaceList, rpc_dataspace);
+    }
+    if (!dataspace || dataspace->ownerPID != pcb->pid) {
+        proc_template_purge_pid(&procServ.templateList, pcb->pid);
+        pcb->templateLoader = false;
+        return EINVALIDPARAM;
+    }
+
+    int error = proc_template_add_segment(&procServ.templateList, pcb->pid, dataspace, rpc_vaddr,
+                                          rpc_fileSize, rpc_segmentSize);
+    if (error != ESUCCESS) {
+        pcb->templateLoader = false;
+    }
+    return error;
+}
+
+/*! @brief Finishes the template the calling selfloader is capturing. */
+refos_err_t
+proc_template_commit_handler(void *rpc_userptr , seL4_Word rpc_entryPoint ,
+                             seL4_Word rpc_endOfProgram , int rpc_generation)
+{
+    struct proc_pcb *pcb = (struct proc_pcb*) rpc_userptr;
+    assert(pcb->magic == REFOS_PCB_MAGIC);
+    if (!pcb->templateLoader) {
+        return EACCESSDENIED;
+    }
+    pcb->templateLoader = false;
+    return proc_template_commit(&procServ.templateList, pcb->pid, rpc_entryPoint,
+                                rpc_endOfProgram, rpc_generation);
+}
+
+/*! @brief Gets the shared dataspace for a read-only ELF segment of the selfloader's program. */
+seL4_CPtr
+proc_shared_segment_open_handler(void *rpc_userptr , char* rpc_name , uint32_t rpc_generation ,
+                                 seL4_Word rpc_source , seL4_Word rpc_vaddr ,
+                                 seL4_Word rpc_fileSize , int* rpc_create ,
+                                 refos_err_t* rpc_errno)
+{
+    struct proc_pcb *pcb = (struct proc_pcb*) rpc_userptr;
+    assert(pcb->magic == REFOS_PCB_MAGIC);
+    if (!pcb->segmentLoader) {
+        SET_ERRNO_PTR(rpc_errno, EACCESSDENIED);
+        return 0;
+    }
+    if (!rpc_name || !rpc_create) {
+        SET_ERRNO_PTR(rpc_errno, EINVALIDPARAM);
+        return 0;
+    }
+
+    bool create = false;
+    int error = EINVALID;
+    struct ram_dspace *dspace = proc_segment_lookup(&procServ.segmentList, rpc_name,
+                                                    rpc_generation, rpc_source, rpc_vaddr,
+                                                    rpc_fileSize, pcb->pid, &create, &error);
+    (*rpc_create) = create ? 1 : 0;
+    if (!dspace) {
+        SET_ERRNO_PTR(rpc_errno, error);
+        return 0;
+    }
+    assert(dspace->magic == RAM_DATASPACE_MAGIC && dspace->readOnly);
+    SET_ERRNO_PTR(rpc_errno, ESUCCESS);
+    return dspace->capability.capPtr;
+}
+
+/*! @brief Drops the selfloader privileges of the calling process. */
+refos_err_t
+proc_selfload_done_handler(void *rpc_userptr)
+{
+    struct proc_pcb *pcb = (struct proc_pcb*) rpc_userptr;
+    assert(pcb->magic == REFOS_PCB_MAGIC);
+    if (!pcb->segmentLoader) {
+        return EACCESSDENIED;
+    }
+
+    /* Abandon any template capture the selfloader never committed. */
+    if (pcb->templateLoader) {
+        proc_template_purge_pid(&procServ.templateList, pcb->pid);
+    }
+    pcb->templateLoader = false;
+    pcb->templatePending = false;
+    pcb->segmentLoader = false;
+    return ESUCCESS;
+}
 
 /* ------------------------------------ Dispatcher functions ------------------------------------ */
 
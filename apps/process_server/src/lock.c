@@ -0,0 +1,582 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+#include <string.h>
+#include "lock.h"
+#include "state.h"
+#include "common.h"
+#include "system/memserv/dataspace.h"
+
+/*! @file
+    @brief Process server locking. */
+
+/*! @brief The address of this is unique to each thread, so it identifies the allocator lock's
+           owner. */
+static __thread char lockOwnerTag;
+
+/*! @brief The vka and vspace operations wrapped by lock_wrap_vka() and lock_wrap_vspace(). */
+static vka_t lockVka;
+static vspace_t lockVspace;
+
+/*! @brief The locks the C heap takes, set by lock_wrap_heap(). */
+static struct procserv_locks *lockHeap;
+
+/* --------------------------------------- Basic locks ------------------------------------------ */
+
+static void
+lock_init_sem(struct procserv_lock *lk, vka_t *vka, int value)
+{
+    memset(lk, 0, sizeof(struct procserv_lock));
+    int error = vka_alloc_notification(vka, &lk->notification);
+    assert(!error);
+    (void) error;
+    lk->value = value;
+}
+
+/*! @brief Wake a waiter, if there are any. A notification only holds one signal, so a waiter that
+           finds more than one unit free passes the wakeup on (see lock_acquire()). */
+static void
+lock_wake(struct procserv_lock *lk)
+{
+    if (lk->waiters > 0) {
+        seL4_Signal(lk->notification.cptr);
+    }
+}
+
+void
+lock_acquire(struct procserv_lock *lk)
+{
+    assert(lk);
+    while (true) {
+        int value = lk->value;
+        if (value > 0) {
+            if (__sync_bool_compare_and_swap(&lk->value, value, value - 1)) {
+                if (value > 1) {
+                    lock_wake(lk);
+                }
+                return;
+            }
+            continue;
+        }
+
+        /* The waiter count goes up before the value is checked again, so a release either sees
+           this waiter and signals, or happened before the check. */
+        __sync_fetch_and_add(&lk->waiters, 1);
+        if (lk->value <= 0) {
+            seL4_Wait(lk->notification.cptr, NULL);
+        }
+        __sync_fetch_and_sub(&lk->waiters, 1);
+    }
+}
+
+void
+lock_release(struct procserv_lock *lk)
+{
+    assert(lk);
+    __sync_fetch_and_add(&lk->value, 1);
+    lock_wake(lk);
+}
+
+/* --------------------------------------- Table locks ------------------------------------------ */
+
+static void
+lock_rw_init(struct procserv_rwlock *rw, vka_t *vka)
+{
+    lock_init_sem(&rw->turnstile, vka, 1);
+    lock_init_sem(&rw->readerLock, vka, 1);
+    lock_init_sem(&rw->roomEmpty, vka, 1);
+    rw->readers = 0;
+}
+
+static void
+lock_rw_read_acquire(struct procserv_rwlock *rw)
+{
+    lock_acquire(&rw->turnstile);
+    lock_release(&rw->turnstile);
+    lock_acquire(&rw->readerLock);
+    if (++rw->readers == 1) {
+        lock_acquire(&rw->roomEmpty);
+    }
+    lock_release(&rw->readerLock);
+}
+
+static void
+lock_rw_read_release(struct procserv_rwlock *rw)
+{
+    lock_acquire(&rw->readerLock);
+    assert(rw->readers > 0);
+    if (--rw->readers == 0) {
+        lock_release(&rw->roomEmpty);
+    }
+    lock_release(&rw->readerLock);
+}
+
+static void
+lock_rw_write_acquire(struct procserv_rwlock *rw)
+{
+    lock_acquire(&rw->turnstile);
+    lock_acquire(&rw->roomEmpty);
+}
+
+static void
+lock_rw_write_release(struct procserv_rwlock *rw)
+{
+    lock_release(&rw->turnstile);
+    lock_release(&rw->roomEmpty);
+}
+
+void
+lock_init(struct procserv_locks *l, vka_t *vka)
+{
+    assert(l && vka);
+    for (int i = 0; i < PROCSERV_NUM_TABLES; i++) {
+        lock_rw_init(&l->table[i], vka);
+    }
+    for (int i = 0; i < PROCSERV_LOCK_STRIPES; i++) {
+        lock_init_sem(&l->client[i], vka, 1);
+        lock_init_sem(&l->dspace[i], vka, 1);
+    }
+    lock_init_sem(&l->alloc.lock, vka, 1);
+    l->alloc.owner = NULL;
+    l->alloc.depth = 0;
+}
+
+void
+lock_set_acquire(struct procserv_locks *l, struct procserv_lockset *ls)
+{
+    assert(l && ls);
+    for (int i = 0; i < PROCSERV_NUM_TABLES; i++) {
+        if (ls->tables & PROCSERV_LOCK_WRITE(i)) {
+            lock_rw_write_acquire(&l->table[i]);
+        } else if (ls->tables & PROCSERV_LOCK_READ(i)) {
+            lock_rw_read_acquire(&l->table[i]);
+        }
+    }
+    if (ls->clientPID != PID_NULL) {
+        lock_acquire(&l->client[ls->clientPID % PROCSERV_LOCK_STRIPES]);
+    }
+}
+
+void
+lock_set_release(struct procserv_locks *l, struct procserv_lockset *ls)
+{
+    assert(l && ls);
+    if (ls->clientPID != PID_NULL) {
+        lock_release(&l->client[ls->clientPID % PROCSERV_LOCK_STRIPES]);
+    }
+    for (int i = PROCSERV_NUM_TABLES - 1; i >= 0; i--) {
+        if (ls->tables & PROCSERV_LOCK_WRITE(i)) {
+            lock_rw_write_release(&l->table[i]);
+        } else if (ls->tables & PROCSERV_LOCK_READ(i)) {
+            lock_rw_read_release(&l->table[i]);
+        }
+    }
+}
+
+/* -------------------------------------- Dataspace locks --------------------------------------- */
+
+/*! @brief The dataspace lock for a dataspace. A copy-on-write clone reads its source's pages, so
+           a whole copy-on-write family shares its root's lock. */
+static struct procserv_lock *
+lock_dspace_get(struct procserv_locks *l, struct ram_dspace *dspace)
+{
+    assert(dspace && dspace->magic == RAM_DATASPACE_MAGIC);
+    while (dspace->cowSource) {
+        dspace = dspace->cowSource;
+    }
+    return &l->dspace[dspace->ID % PROCSERV_LOCK_STRIPES];
+}
+
+void
+lock_dspace_acquire(struct procserv_locks *l, struct ram_dspace *dspace)
+{
+    lock_acquire(lock_dspace_get(l, dspace));
+}
+
+void
+lock_dspace_release(struct procserv_locks *l, struct ram_dspace *dspace)
+{
+    lock_release(lock_dspace_get(l, dspace));
+}
+
+/* -------------------------------------- Allocator lock ---------------------------------------- */
+
+void
+lock_alloc_acquire(struct procserv_locks *l)
+{
+    if (l->alloc.owner == &lockOwnerTag) {
+        l->alloc.depth++;
+        return;
+    }
+    lock_acquire(&l->alloc.lock);
+    l->alloc.owner = &lockOwnerTag;
+    l->alloc.depth = 1;
+}
+
+void
+lock_alloc_release(struct procserv_locks *l)
+{
+    assert(l->alloc.owner == &lockOwnerTag && l->alloc.depth > 0);
+    if (--l->alloc.depth == 0) {
+        l->alloc.owner = NULL;
+        lock_release(&l->alloc.lock);
+    }
+}
+
+/* ---------------------------------------- Locked vka ------------------------------------------ */
+
+static int
+lock_vka_cspace_alloc(void *data, seL4_CPtr *res)
+{
+    lock_alloc_acquire(&procServ.locks);
+    int error = lockVka.cspace_alloc(data, res);
+    lock_alloc_release(&procServ.locks);
+    return error;
+}
+
+static void
+lock_vka_cspace_free(void *data, seL4_CPtr slot)
+{
+    lock_alloc_acquire(&procServ.locks);
+    lockVka.cspace_free(data, slot);
+    lock_alloc_release(&procServ.locks);
+}
+
+static int
+lock_vka_utspace_alloc(void *data, const cspacepath_t *dest, seL4_Word type, seL4_Word sizeBits,
+                       seL4_Word *res)
+{
+    lock_alloc_acquire(&procServ.locks);
+    int error = lockVka.utspace_alloc(data, dest, type, sizeBits, res);
+    lock_alloc_release(&procServ.locks);
+    return error;
+}
+
+static int
+lock_vka_utspace_alloc_maybe_device(void *data, const cspacepath_t *dest, seL4_Word type,
+                                    seL4_Word sizeBits, bool canUseDev, seL4_Word *res)
+{
+    lock_alloc_acquire(&procServ.locks);
+    int error = lockVka.utspace_alloc_maybe_device(data, dest, type, sizeBits, canUseDev, res);
+    lock_alloc_release(&procServ.locks);
+    return error;
+}
+
+static int
+lock_vka_utspace_alloc_at(void *data, const cspacepath_t *dest, seL4_Word type,
+                          seL4_Word sizeBits, uintptr_t paddr, seL4_Word *cookie)
+{
+    lock_alloc_acquire(&procServ.locks);
+    int error = lockVka.utspace_alloc_at(data, dest, type, sizeBits, paddr, cookie);
+    lock_alloc_release(&procServ.locks);
+    return error;
+}
+
+static void
+lock_vka_utspace_free(void *data, seL4_Word type, seL4_Word sizeBits, seL4_Word target)
+{
+    lock_alloc_acquire(&procServ.locks);
+    lockVka.utspace_free(data, type, sizeBits, target);
+    lock_alloc_release(&procServ.locks);
+}
+
+static uintptr_t
+lock_vka_utspace_paddr(void *data, seL4_Word target, seL4_Word type, seL4_Word sizeBits)
+{
+    lock_alloc_acquire(&procServ.locks);
+    uintptr_t paddr = lockVka.utspace_paddr(data, target, type, sizeBits);
+    lock_alloc_release(&procServ.locks);
+    return paddr;
+}
+
+void
+lock_wrap_vka(vka_t *vka)
+{
+    assert(vka && !lockVka.cspace_alloc);
+    lockVka = *vka;
+
+    /* cspace_make_path only computes a path from the cspace layout, so it is left unlocked. */
+    vka->cspace_alloc = lock_vka_cspace_alloc;
+    vka->cspace_free = lock_vka_cspace_free;
+    vka->utspace_alloc = lock_vka_utspace_alloc;
+    vka->utspace_alloc_maybe_device = lock_vka_utspace_alloc_maybe_device;
+    vka->utspace_alloc_at = lockVka.utspace_alloc_at ? lock_vka_utspace_alloc_at : NULL;
+    vka->utspace_free = lock_vka_utspace_free;
+    vka->utspace_paddr = lockVka.utspace_paddr ? lock_vka_utspace_paddr : NULL;
+}
+
+/* --------------------------------------- Locked vspace ---------------------------------------- */
+
+static void *
+lock_vspace_new_pages(vspace_t *vspace, seL4_CapRights_t rights, size_t numPages,
+                      size_t sizeBits)
+{
+    lock_alloc_acquire(&procServ.locks);
+    void *vaddr = lockVspace.new_pages(vspace, rights, numPages, sizeBits);
+    lock_alloc_release(&procServ.locks);
+    return vaddr;
+}
+
+static void *
+lock_vspace_map_pages(vspace_t *vspace, seL4_CPtr caps[], uintptr_t cookies[],
+                      seL4_CapRights_t rights, size_t numPages, size_t sizeBits, int cacheable)
+{
+    lock_alloc_acquire(&procServ.locks);
+    void *vaddr = lockVspace.map_pages(vspace, caps, cookies, rights, numPages, sizeBits,
+                                       cacheable);
+    lock_alloc_release(&procServ.locks);
+    return vaddr;
+}
+
+static int
+lock_vspace_new_pages_at_vaddr(vspace_t *vspace, void *vaddr, size_t numPages, size_t sizeBits,
+                               reservation_t reservation, bool canUseDev)
+{
+    lock_alloc_acquire(&procServ.locks);
+    int error = lockVspace.new_pages_at_vaddr(vspace, vaddr, numPages, sizeBits, reservation,
+                                              canUseDev);
+    lock_alloc_release(&procServ.locks);
+    return error;
+}
+
+static int
+lock_vspace_map_pages_at_vaddr(vspace_t *vspace, seL4_CPtr caps[], uintptr_t cookies[],
+                               void *vaddr, size_t numPages, size_t sizeBits,
+                               reservation_t reservation)
+{
+    lock_alloc_acquire(&procServ.locks);
+    int error = lockVspace.map_pages_at_vaddr(vspace, caps, cookies, vaddr, numPages, sizeBits,
+                                              reservation);
+    lock_alloc_release(&procServ.locks);
+    return error;
+}
+
+static int
+lock_vspace_deferred_rights_map_pages_at_vaddr(vspace_t *vspace, seL4_CPtr caps[],
+        uintptr_t cookies[], void *vaddr, size_t numPages, size_t sizeBits,
+        seL4_CapRights_t rights, reservation_t reservation)
+{
+    lock_alloc_acquire(&procServ.locks);
+    int error = lockVspace.deferred_rights_map_pages_at_vaddr(vspace, caps, cookies, vaddr,
+            numPages, sizeBits, rights, reservation);
+    lock_alloc_release(&procServ.locks);
+    return error;
+}
+
+static void
+lock_vspace_unmap_pages(vspace_t *vspace, void *vaddr, size_t numPages, size_t sizeBits,
+                        vka_t *free)
+{
+    lock_alloc_acquire(&procServ.locks);
+    lockVspace.unmap_pages(vspace, vaddr, numPages, sizeBits, free);
+    lock_alloc_release(&procServ.locks);
+}
+
+static void
+lock_vspace_tear_down(vspace_t *vspace, vka_t *free)
+{
+    lock_alloc_acquire(&procServ.locks);
+    lockVspace.tear_down(vspace, free);
+    lock_alloc_release(&procServ.locks);
+}
+
+static reservation_t
+lock_vspace_reserve_range_aligned(vspace_t *vspace, size_t bytes, size_t sizeBits,
+                                  seL4_CapRights_t rights, int cacheable, void **vaddr)
+{
+    lock_alloc_acquire(&procServ.locks);
+    reservation_t res = lockVspace.reserve_range_aligned(vspace, bytes, sizeBits, rights,
+                                                         cacheable, vaddr);
+    lock_alloc_release(&procServ.locks);
+    return res;
+}
+
+static reservation_t
+lock_vspace_reserve_range_at(vspace_t *vspace, void *vaddr, size_t bytes,
+                             seL4_CapRights_t rights, int cacheable)
+{
+    lock_alloc_acquire(&procServ.locks);
+    reservation_t res = lockVspace.reserve_range_at(vspace, vaddr, bytes, rights, cacheable);
+    lock_alloc_release(&procServ.locks);
+    return res;
+}
+
+static reservation_t
+lock_vspace_reserve_deferred_rights_range_at(vspace_t *vspace, void *vaddr, size_t bytes,
+                                             int cacheable)
+{
+    lock_alloc_acquire(&procServ.locks);
+    reservation_t res = lockVspace.reserve_deferred_rights_range_at(vspace, vaddr, bytes,
+                                                                    cacheable);
+    lock_alloc_release(&procServ.locks);
+    return res;
+}
+
+static void
+lock_vspace_free_reservation(vspace_t *vspace, reservation_t reservation)
+{
+    lock_alloc_acquire(&procServ.locks);
+    lockVspace.free_reservation(vspace, reservation);
+    lock_alloc_release(&procServ.locks);
+}
+
+static void
+lock_vspace_free_reservation_by_vaddr(vspace_t *vspace, void *vaddr)
+{
+    lock_alloc_acquire(&procServ.locks);
+    lockVspace.free_reservation_by_vaddr(vspace, vaddr);
+    lock_alloc_release(&procServ.locks);
+}
+
+static seL4_CPtr
+lock_vspace_get_cap(vspace_t *vspace, void *vaddr)
+{
+    lock_alloc_acquire(&procServ.locks);
+    seL4_CPtr cap = lockVspace.get_cap(vspace, vaddr);
+    lock_alloc_release(&procServ.locks);
+    return cap;
+}
+
+static uintptr_t
+lock_vspace_get_cookie(vspace_t *vspace, void *vaddr)
+{
+    lock_alloc_acquire(&procServ.locks);
+    uintptr_t cookie = lockVspace.get_cookie(vspace, vaddr);
+    lock_alloc_release(&procServ.locks);
+    return cookie;
+}
+
+static int
+lock_vspace_share_mem_at_vaddr(vspace_t *from, vspace_t *to, void *start, int numPages,
+                               size_t sizeBits, void *vaddr, reservation_t res)
+{
+    lock_alloc_acquire(&procServ.locks);
+    int error = lockVspace.share_mem_at_vaddr(from, to, start, numPages, sizeBits, vaddr, res);
+    lock_alloc_release(&procServ.locks);
+    return error;
+}
+
+void
+lock_wrap_vspace(vspace_t *vspace)
+{
+    assert(vspace && !lockVspace.new_pages);
+    lockVspace = *vspace;
+
+    /* get_root only reads the page directory cap, so it is left unlocked. */
+    vspace->new_pages = lock_vspace_new_pages;
+    vspace->map_pages = lock_vspace_map_pages;
+    vspace->new_pages_at_vaddr = lock_vspace_new_pages_at_vaddr;
+    vspace->map_pages_at_vaddr = lock_vspace_map_pages_at_vaddr;
+    vspace->deferred_rights_map_pages_at_vaddr = lock_vspace_deferred_rights_map_pages_at_vaddr;
+    vspace->unmap_pages = lock_vspace_unmap_pages;
+    vspace->tear_down = lock_vspace_tear_down;
+    vspace->reserve_range_aligned = lock_vspace_reserve_range_aligned;
+    vspace->reserve_range_at = lock_vspace_reserve_range_at;
+    vspace->reserve_deferred_rights_range_at = lock_vspace_reserve_deferred_rights_range_at;
+    vspace->free_reservation = lock_vspace_free_reservation;
+    vspace->free_reservation_by_vaddr = lock_vspace_free_reservation_by_vaddr;
+    vspace->get_cap = lock_vspace_get_cap;
+    vspace->get_cookie = lock_vspace_get_cookie;
+    vspace->share_mem_at_vaddr = lock_vspace_share_mem_at_vaddr;
+}
+
+/* ---------------------------------------- Locked heap ----------------------------------------- */
+
+/* The process server is linked with --wrap for each of these, so every call to them, from the
+   process server, its libraries and libc itself, lands in the __wrap_ function, and the real
+   one is __real_. musl calls malloc() and free() inside realloc(), calloc() and memalign(),
+   which the recursive allocator lock allows. */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+void *__real_memalign(size_t alignment, size_t size);
+int __real_posix_memalign(void **res, size_t alignment, size_t size);
+
+void
+lock_wrap_heap(struct procserv_locks *l)
+{
+    assert(l && !lockHeap);
+    lockHeap = l;
+}
+
+void *
+__wrap_malloc(size_t size)
+{
+    if (!lockHeap) {
+        return __real_malloc(size);
+    }
+    lock_alloc_acquire(lockHeap);
+    void *p = __real_malloc(size);
+    lock_alloc_release(lockHeap);
+    return p;
+}
+
+void *
+__wrap_calloc(size_t nmemb, size_t size)
+{
+    if (!lockHeap) {
+        return __real_calloc(nmemb, size);
+    }
+    lock_alloc_acquire(lockHeap);
+    void *p = __real_calloc(nmemb, size);
+    lock_alloc_release(lockHeap);
+    return p;
+}
+
+void *
+__wrap_realloc(void *ptr, size_t size)
+{
+    if (!lockHeap) {
+        return __real_realloc(ptr, size);
+    }
+    lock_alloc_acquire(lockHeap);
+    void *p = __real_realloc(ptr, size);
+    lock_alloc_release(lockHeap);
+    return p;
+}
+
+void
+__wrap_free(void *ptr)
+{
+    if (!lockHeap) {
+        __real_free(ptr);
+        return;
+    }
+    lock_alloc_acquire(lockHeap);
+    __real_free(ptr);
+    lock_alloc_release(lockHeap);
+}
+
+void *
+__wrap_memalign(size_t alignment, size_t size)
+{
+    if (!lockHeap) {
+        return __real_memalign(alignment, size);
+    }
+    lock_alloc_acquire(lockHeap);
+    void *p = __real_memalign(alignment, size);
+    lock_alloc_release(lockHeap);
+    return p;
+}
+
+int
+__wrap_posix_memalign(void **res, size_t alignment, size_t size)
+{
+    if (!lockHeap) {
+        return __real_posix_memalign(res, alignment, size);
+    }
+    lock_alloc_acquire(lockHeap);
+    int error = __real_posix_memalign(res, alignment, size);
+    lock_alloc_release(lockHeap);
+    return error;
+}
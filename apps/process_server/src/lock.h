@@ -0,0 +1,176 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+#ifndef _REFOS_PROCESS_SERVER_LOCK_H_
+#define _REFOS_PROCESS_SERVER_LOCK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sel4/sel4.h>
+#include <vka/vka.h>
+#include <vka/object.h>
+#include <vspace/vspace.h>
+
+/*! @file
+    @brief Process server locking.
+
+    Each worker takes only the locks the message it is handling needs, in this order:
+
+    <ul>
+        <li>The table locks, in the order of enum procserv_table. These are readers-writer locks.
+            The PID table lock also covers the process server's other process-wide state (the IRQ
+            handler table, process templates, shared segments, the PD pool, CPU usage and
+            profiling), and the postaction globals in struct procserv_state.</li>
+        <li>One client lock, picked by the PID of the client which sent the message. Handlers
+            which only hold table read locks may change their own client's PCB, vspace and RPC
+            state under it.</li>
+        <li>One dataspace lock, picked by a RAM dataspace's copy-on-write root. Page allocation and
+            content-init waiters of a dataspace are changed under it when its table is only held
+            for reading. At most one is held at a time.</li>
+        <li>The allocator lock, a recursive lock around the vka, the process server's own vspace
+            and the C heap. The process server's vka and vspace take it themselves; see
+            lock_wrap_vka() and lock_wrap_vspace(). The worker threads are not pthreads, so musl
+            never locks its heap; malloc() and friends are wrapped at link time instead (see the
+            process server Makefile and lock_wrap_heap()).</li>
+    </ul>
+
+    A message which holds every table for writing excludes all other handlers, so it needs no
+    client or dataspace lock; this is the default for any message not known to need less.
+*/
+
+#define PROCSERV_LOCK_STRIPES 16
+
+/*! @brief The process server tables, in lock order. */
+enum procserv_table {
+    PROCSERV_TABLE_PID = 0,
+    PROCSERV_TABLE_WINDOW,
+    PROCSERV_TABLE_DSPACE,
+    PROCSERV_TABLE_NAME,
+    PROCSERV_NUM_TABLES
+};
+
+#define PROCSERV_LOCK_READ(table) (1 << (table))
+#define PROCSERV_LOCK_WRITE(table) (1 << ((table) + PROCSERV_NUM_TABLES))
+#define PROCSERV_LOCK_EXCLUSIVE ((1 << (2 * PROCSERV_NUM_TABLES)) - \
+                                 (1 << PROCSERV_NUM_TABLES))
+
+struct ram_dspace;
+
+/*! @brief Counting semaphore with an atomic fast path, falling back to a notification object
+           when contended. Used as a mutex when initialised to 1. */
+struct procserv_lock {
+    vka_object_t notification;
+    volatile int value;
+    volatile int waiters;
+};
+
+/*! @brief Readers-writer lock. Waiting writers hold the turnstile, so new readers queue behind
+           them and writers are not starved. */
+struct procserv_rwlock {
+    struct procserv_lock turnstile;
+    struct procserv_lock readerLock;
+    struct procserv_lock roomEmpty;
+    int readers;
+};
+
+/*! @brief Recursive mutex, owned by a single thread. */
+struct procserv_rlock {
+    struct procserv_lock lock;
+    void * volatile owner;
+    int depth;
+};
+
+/*! @brief The locks a worker holds while handling one message. */
+struct procserv_lockset {
+    uint32_t tables;    /*!< PROCSERV_LOCK_READ and PROCSERV_LOCK_WRITE bits. */
+    uint32_t clientPID; /*!< Client to lock, PID_NULL for none. */
+};
+
+/*! @brief All the process server locks. */
+struct procserv_locks {
+    struct procserv_rwlock table[PROCSERV_NUM_TABLES];
+    struct procserv_lock client[PROCSERV_LOCK_STRIPES];
+    struct procserv_lock dspace[PROCSERV_LOCK_STRIPES];
+    struct procserv_rlock alloc;
+};
+
+/*! @brief Initialise the process server locks.
+    @param l The locks to initialise.
+    @param vka The allocator to allocate the lock notification objects from. This must not be a
+               vka wrapped by lock_wrap_vka(), as the allocator lock doesn't exist yet.
+*/
+void lock_init(struct procserv_locks *l, vka_t *vka);
+
+/*! @brief Acquire a lock, blocking until it is free. */
+void lock_acquire(struct procserv_lock *lk);
+
+/*! @brief Release a lock, waking a waiter if there is one. */
+void lock_release(struct procserv_lock *lk);
+
+/*! @brief Acquire the table and client locks a message needs.
+    @param l The process server locks.
+    @param ls The lockset to acquire.
+*/
+void lock_set_acquire(struct procserv_locks *l, struct procserv_lockset *ls);
+
+/*! @brief Release the locks taken by lock_set_acquire().
+    @param l The process server locks.
+    @param ls The lockset to release.
+*/
+void lock_set_release(struct procserv_locks *l, struct procserv_lockset *ls);
+
+/*! @brief Whether a lockset excludes every other handler. */
+static inline bool
+lock_set_exclusive(struct procserv_lockset *ls)
+{
+    return (ls->tables & PROCSERV_LOCK_EXCLUSIVE) == PROCSERV_LOCK_EXCLUSIVE;
+}
+
+/*! @brief Lock a RAM dataspace, along with every dataspace sharing its copy-on-write root.
+    @param l The process server locks.
+    @param dspace The dataspace to lock. (No ownership)
+*/
+void lock_dspace_acquire(struct procserv_locks *l, struct ram_dspace *dspace);
+
+/*! @brief Unlock a RAM dataspace locked by lock_dspace_acquire().
+    @param l The process server locks.
+    @param dspace The dataspace to unlock. (No ownership)
+*/
+void lock_dspace_release(struct procserv_locks *l, struct ram_dspace *dspace);
+
+/*! @brief Acquire the allocator lock. May be taken again by the thread holding it. */
+void lock_alloc_acquire(struct procserv_locks *l);
+
+/*! @brief Release the allocator lock. */
+void lock_alloc_release(struct procserv_locks *l);
+
+/*! @brief Make a vka take the allocator lock around every allocation. The vka is changed in
+           place, so copies of it made earlier are not locked.
+    @param vka The vka to wrap. Only one vka may be wrapped.
+*/
+void lock_wrap_vka(vka_t *vka);
+
+/*! @brief Make a vspace take the allocator lock around every operation. The vspace is changed in
+           place, and its data is left as it is, so other vspaces may still be given it as a
+           loader or as the other side of a share.
+    @param vspace The vspace to wrap. Only one vspace may be wrapped.
+*/
+void lock_wrap_vspace(vspace_t *vspace);
+
+/*! @brief Make malloc(), free() and the rest of the C heap take the allocator lock. Until this is
+           called, they don't, as the lock doesn't exist yet. Must be called before any worker
+           thread is started.
+    @param l The process server locks, initialised by lock_init().
+*/
+void lock_wrap_heap(struct procserv_locks *l);
+
+#endif /* _REFOS_PROCESS_SERVER_LOCK_H_ */
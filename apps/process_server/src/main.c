@@ -47,8 +47,14 @@
 
 #include <sel4platsupport/bootinfo.h>
 
+#include <refos-rpc/proc_server.h>
+#include <refos-rpc/name_server.h>
+
 #include "common.h"
 #include "state.h"
+#include "worker.h"
+#include "lock.h"
+#include "badge.h"
 #include "test/test.h"
 #include "dispatchers/proc_syscall.h"
 #include "dispatchers/mem_syscall.h"
@@ -57,6 +63,64 @@
 #include "dispatchers/fault_handler.h"
 #include "system/process/process.h"
 
+/*! @brief Pick the locks needed to handle a message.
+
+    Faults and the syscalls here only change their own client's state, and allocate through the
+    locked vka and vspace, so they take the tables they look things up in for reading, and their
+    client's lock. Everything else changes shared state, and takes every table for writing.
+
+    @param msg The process server recieved message info.
+    @param ls Output lockset.
+ */
+static void
+proc_server_message_lockset(struct procserv_msg *msg, struct procserv_lockset *ls)
+{
+    ls->tables = PROCSERV_LOCK_EXCLUSIVE;
+    ls->clientPID = PID_NULL;
+    if (!dispatcher_badge_PID(msg->badge)) {
+        return;
+    }
+    uint32_t shared = 0;
+    switch (seL4_MessageInfo_get_label(msg->message)) {
+        case seL4_Fault_VMFault:
+            shared = PROCSERV_LOCK_READ(PROCSERV_TABLE_PID) |
+                     PROCSERV_LOCK_READ(PROCSERV_TABLE_WINDOW) |
+                     PROCSERV_LOCK_READ(PROCSERV_TABLE_DSPACE);
+            break;
+        case seL4_Fault_NullFault:
+            switch (seL4_GetMR(0)) {
+                case RPC_PROC_PING:
+                case RPC_PROC_NEW_ENDPOINT_INTERNAL:
+                case RPC_PROC_NEW_ASYNC_ENDPOINT_INTERNAL:
+                case RPC_PROC_NICE:
+                    shared = PROCSERV_LOCK_READ(PROCSERV_TABLE_PID);
+                    break;
+                case RPC_PROC_GET_MEM_WINDOW:
+                    shared = PROCSERV_LOCK_READ(PROCSERV_TABLE_PID) |
+                             PROCSERV_LOCK_READ(PROCSERV_TABLE_WINDOW);
+                    break;
+                case RPC_NSV_RESOLVE_SEGMENT_INTERNAL:
+                    shared = PROCSERV_LOCK_READ(PROCSERV_TABLE_PID) |
+                             PROCSERV_LOCK_READ(PROCSERV_TABLE_NAME);
+                    break;
+                case RPC_NSV_REGISTER:
+                case RPC_NSV_UNREGISTER:
+                    shared = PROCSERV_LOCK_READ(PROCSERV_TABLE_PID) |
+                             PROCSERV_LOCK_WRITE(PROCSERV_TABLE_NAME);
+                    break;
+                default:
+                    break;
+            }
+            break;
+        default:
+            break;
+    }
+    if (shared) {
+        ls->tables = shared;
+        ls->clientPID = msg->badge - PID_BADGE_BASE;
+    }
+}
+
 /*! @brief Process server IPC message handler.
     
     Handles dispatching of all process server IPC messages. Calls each individual dispatcher until
@@ -64,9 +128,12 @@
 
     @param s The process server global state.
     @param msg The process server recieved message info.
+    @param ls The locks held while handling the message. Postactions are only run when every
+              table is held for writing, as only those handlers set them up.
  */
 static void
-proc_server_handle_message(struct procserv_state *s, struct procserv_msg *msg)
+proc_server_handle_message(struct procserv_state *s, struct procserv_msg *msg,
+                           struct procserv_lockset *ls)
 {
     int result;
     int label = seL4_GetMR(0);
@@ -77,8 +144,10 @@ proc_server_handle_message(struct procserv_state *s, struct procserv_msg *msg)
     if (check_dispatch_syscall(msg, &userptr) == DISPATCH_SUCCESS) {
         result = rpc_sv_proc_dispatcher(userptr, label);
         assert(result == DISPATCH_SUCCESS);
-        mem_syscall_postaction();
-        proc_syscall_postaction();
+        if (lock_set_exclusive(ls)) {
+            mem_syscall_postaction();
+            proc_syscall_postaction();
+        }
         return;
     }
 
@@ -93,7 +162,9 @@ proc_server_handle_message(struct procserv_state *s, struct procserv_msg *msg)
     if (check_dispatch_dataspace(msg, &userptr) == DISPATCH_SUCCESS) {
         result = rpc_sv_data_dispatcher(userptr, label);
         assert(result == DISPATCH_SUCCESS);
-        mem_syscall_postaction();
+        if (lock_set_exclusive(ls)) {
+            mem_syscall_postaction();
+        }
         return;
     }
 
@@ -112,29 +183,59 @@ proc_server_handle_message(struct procserv_state *s, struct procserv_msg *msg)
 
 /*! @brief Main process server loop.
 
-    The main loop that the process server goes into and keeps looping until the process server
-    is to exit and the whole system is to by shut down (which is possibly never). It blocks on the
-    process server endpoint and waits for an IPC message, and then handles the dispatching of
-    the message when it recieves one, before looping around and waiting for the next IPC message.
+    The main loop that each process server worker goes into and keeps looping until the process
+    server is to exit and the whole system is to by shut down (which is possibly never). It blocks
+    on the worker's endpoint and waits for an IPC message, and then takes the locks the message
+    needs and handles the dispatching of the message when it recieves one, before looping around
+    and waiting for the next IPC message.
 
+    @param w The worker running this loop.
     @return Does not return, runs endlessly.
 */
 static int
-proc_server_loop(void)
+proc_server_loop(struct procserv_worker *w)
 {
     struct procserv_state *s = &procServ;
     struct procserv_msg msg = { .state = s };
+    struct procserv_lockset ls;
+    assert(w && w->magic == PROCSERV_WORKER_MAGIC);
+    worker_thread_init(w);
+
+    /* The cap receive path lives in this thread's IPC buffer. */
+    seL4_SetCapReceivePath(w->IPCCapRecv.root, w->IPCCapRecv.capPtr, w->IPCCapRecv.capDepth);
 
     while (1) {
-        dvprintf("procserv blocking for new message...\n");
-        msg.message = seL4_Recv(s->endpoint.cptr, &msg.badge);
-        proc_server_handle_message(s, &msg);
-        s->faketime++;
+        msg.message = seL4_Recv(w->endpoint, &msg.badge);
+        proc_server_message_lockset(&msg, &ls);
+        lock_set_acquire(&s->locks, &ls);
+        dvprintf("procserv core %u handling new message...\n", w->core);
+        w->nMessages++;
+        proc_server_handle_message(s, &msg, &ls);
+        __sync_fetch_and_add(&s->faketime, 1);
+
+        /* The client has had its reply, so now is a good time to top up the PD pool. */
+        if (lock_set_exclusive(&ls)) {
+            pd_replenish(&s->PDList);
+        }
+        lock_set_release(&s->locks, &ls);
     }
 
     return 0;
 }
 
+/*! @brief Entry point of the process server worker threads on secondary cores.
+    @param arg0 The struct procserv_worker of this thread.
+    @param arg1 Unused.
+    @param ipcBuffer Unused.
+*/
+static void
+proc_server_worker_entry(void *arg0, void *arg1, void *ipcBuffer)
+{
+    (void) arg1;
+    (void) ipcBuffer;
+    proc_server_loop((struct procserv_worker *) arg0);
+}
+
 /*! @brief Process server main entry point. */
 int
 main(void)
@@ -150,7 +251,7 @@ main(void)
     // -----> Start RefOS system processes.
     int error;
 
-    error = proc_load_direct("console_server", 252, "", PID_NULL, 
+    error = proc_load_direct("console_server", 252, "", NULL, PID_NULL, 
             PROCESS_PERMISSION_DEVICE_IRQ | PROCESS_PERMISSION_DEVICE_MAP |
             PROCESS_PERMISSION_DEVICE_IOPORT);
     if (error) {
@@ -158,7 +259,7 @@ main(void)
         assert(!"RefOS system startup error.");
     }
 
-    error = proc_load_direct("file_server", 250, "", PID_NULL, 0x0);
+    error = proc_load_direct("file_server", 250, "", NULL, PID_NULL, 0x0);
     if (error) {
         ROS_WARNING("Procserv could not start file_server.");
         assert(!"RefOS system startup error.");
@@ -166,7 +267,7 @@ main(void)
 
     // -----> Start OS level tests.
     #ifdef CONFIG_REFOS_RUN_TESTS
-        error = proc_load_direct("test_os", 245, "", PID_NULL, 0x0);
+        error = proc_load_direct("test_os", 245, "", NULL, PID_NULL, 0x0);
         if (error) {
             ROS_WARNING("Procserv could not start test_os.");
             assert(!"RefOS system startup error.");
@@ -174,7 +275,7 @@ main(void)
     #endif
 
     // -----> Start RefOS timer server.
-    error = proc_load_direct("selfloader", 245, "fileserv/timer_server", PID_NULL,
+    error = proc_load_direct("selfloader", 245, "fileserv/timer_server", NULL, PID_NULL,
             PROCESS_PERMISSION_DEVICE_IRQ | PROCESS_PERMISSION_DEVICE_MAP |
             PROCESS_PERMISSION_DEVICE_IOPORT);
     if (error) {
@@ -182,15 +283,27 @@ main(void)
         assert(!"RefOS system startup error.");
     }
 
+    // -----> Start RefOS network server.
+    #ifdef CONFIG_APP_NET_SERVER
+        error = proc_load_direct("selfloader", 245, "fileserv/net_server", NULL, PID_NULL, 0x0);
+        if (error) {
+            ROS_WARNING("Procserv could not start net_server.");
+            assert(!"RefOS system startup error.");
+        }
+    #endif
+
     // -----> Start initial task.
     if (strlen(CONFIG_REFOS_INIT_TASK) > 0) {
         error = proc_load_direct("selfloader", CONFIG_REFOS_INIT_TASK_PRIO, CONFIG_REFOS_INIT_TASK,
-                                 PID_NULL, 0x0);
+                                 NULL, PID_NULL, 0x0);
         if (error) {
             ROS_WARNING("Procserv could not start initial task.");
             assert(!"RefOS system startup error.");
         }
     }
 
-    return proc_server_loop();
+    // -----> Start the worker threads on the other cores.
+    worker_start(&procServ.workers, proc_server_worker_entry);
+
+    return proc_server_loop(&procServ.workers.syscall[0]);
 }
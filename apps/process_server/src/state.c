@@ -36,7 +36,7 @@ const char* dprintfServerName = "PROCSERV";
 int dprintfServerColour = 32;
 
 uint32_t faketime() {
-    return procServ.faketime++;
+    return __sync_fetch_and_add(&procServ.faketime, 1);
 }
 
 static void procserv_nameserv_callback_free_cap(seL4_CPtr cap);
@@ -102,11 +102,36 @@ initialise_modules(struct procserv_state *s)
 {
     pd_init(&s->PDList);
     pid_init(&s->PIDList);
+    client_watch_index_init(&s->watchIndex);
     w_init(&s->windowList);
     ram_dspace_init(&s->dspaceList);
+    proc_template_init(&s->templateList);
+    proc_segment_init(&s->segmentList);
+    proc_profile_init(&s->profileList);
     nameserv_init(&s->nameServRegList, procserv_nameserv_callback_free_cap);
 }
 
+/*! @brief Build the name index over the process server's CPIO archive, so that loading a boot
+           image does not walk every header in the archive.
+    @param s The process server global state.
+ */
+static void
+initialise_cpio_index(struct procserv_state *s)
+{
+    unsigned long len = _cpio_archive_end - _cpio_archive;
+    struct cpio_info info;
+    int error = cpio_info(_cpio_archive, len, &info);
+    assert(!error);
+
+    unsigned long tableSize = cpio_index_table_size(info.file_count);
+    struct cpio_index_entry *table = kmalloc(tableSize * sizeof(struct cpio_index_entry));
+    assert(table);
+
+    error = cpio_index_build(_cpio_archive, len, &s->cpioIndex, table, tableSize);
+    assert(!error);
+    (void) error;
+}
+
 #ifdef CONFIG_ARCH_ARM
 /*! @brief Wrapper function for allocating a portion of an untyped into an object.
     @param data cookie for the underlying allocator.
@@ -162,6 +187,14 @@ initialise(seL4_BootInfo *info, struct procserv_state *s)
     int error;
     (void) error;
 
+    /* Every worker allocates from the same vka, maps into the same vspace and shares the C heap,
+       so they are made to take the allocator lock. The locks themselves come from the vka before
+       it is wrapped. */
+    lock_init(&s->locks, &s->vka);
+    lock_wrap_vka(&s->vka);
+    lock_wrap_vspace(&s->vspace);
+    lock_wrap_heap(&s->locks);
+
     vka_t serial_vka = s->vka;
 
 #ifdef CONFIG_ARCH_ARM
@@ -200,6 +233,15 @@ initialise(seL4_BootInfo *info, struct procserv_state *s)
     chash_init(&s->irqHandlerList, PROCSERV_IRQ_HANDLER_HASHTABLE_SIZE);
     s->unblockClientFaultPID = PID_NULL;
 
+    dprintf("Indexing boot CPIO archive...\n");
+    initialise_cpio_index(s);
+
+    dprintf("Configuring process server workers for %d core(s)...\n", PROCSERV_NUM_CORES);
+    worker_init(&s->workers);
+
+    dprintf("Starting CPU utilisation tracking...\n");
+    cpu_usage_init(&s->cpuUsage);
+
     /* Procserv initialised OK. */
     dprintf("PROCSERV initialised.\n");
     dprintf("==========================================\n\n");
@@ -305,10 +347,15 @@ procserv_find_device(void *paddr, int size)
         return path;
     }
 
+    /* The device lookup goes through the allocator underneath the vka, so it is locked as a
+       whole. */
+    lock_alloc_acquire(&procServ.locks);
+
     /* Allocate a cslot. */
     int error = vka_cspace_alloc_path(&procServ.vka, &path);
     if (error) {
         ROS_ERROR("procserv_find_device failed to allocate cslot.");
+        lock_alloc_release(&procServ.locks);
         path.capPtr = 0;
         return path;
     }
@@ -317,10 +364,12 @@ procserv_find_device(void *paddr, int size)
     error = simple_get_frame_cap(&procServ.simpleEnv, paddr, sizeBits, &path);
     if (error) {
         vka_cspace_free(&procServ.vka, path.capPtr);
+        lock_alloc_release(&procServ.locks);
         path.capPtr = 0;
         return path;
     }
 
+    lock_alloc_release(&procServ.locks);
     assert(path.capPtr);
     return path;
 }
@@ -34,11 +34,18 @@
 #include <simple-default/simple-default.h>
 
 #include "common.h"
+#include "worker.h"
+#include "lock.h"
 #include "system/process/pid.h"
+#include "system/process/proc_client_watch.h"
 #include "system/addrspace/vspace.h"
 #include "system/addrspace/pagedir.h"
 #include "system/memserv/window.h"
 #include "system/memserv/dataspace.h"
+#include "system/process/template.h"
+#include "system/process/segment.h"
+#include "system/process/cpu_usage.h"
+#include "system/process/profile.h"
 
 /*! @file
     @brief Global environment struct & helper functions for process server. */
@@ -64,15 +71,32 @@ struct procserv_state {
     vka_object_t                       endpoint;
     cspacepath_t                       IPCCapRecv;
 
+    /* Per-core worker threads and fault endpoints, and the locks they take. */
+    struct procserv_worker_list        workers;
+    struct procserv_locks              locks;
+
     /* Process server global lists. */
     struct pid_list                    PIDList;
+    struct proc_watch_index            watchIndex;
     struct pd_list                     PDList;
     struct w_list                      windowList;
     struct ram_dspace_list             dspaceList;
     nameserv_state_t                   nameServRegList;
     chash_t                            irqHandlerList;
+    struct proc_template_list          templateList;
+    struct proc_segment_list           segmentList;
+
+    /* Name index over the boot CPIO archive. */
+    struct cpio_index                  cpioIndex;
+
+    /* Kernel utilisation tracker samples. */
+    struct cpu_usage_state             cpuUsage;
+
+    /* Sampling profiler histograms. */
+    struct proc_profile_list           profileList;
 
-    /* Misc states. */
+    /* Misc states. The postaction PIDs are only set and read by handlers holding every table
+       for writing. */
     uint32_t                           faketime;
     uint32_t                           unblockClientFaultPID;
     uint32_t                           exitProcessPID;
@@ -86,7 +110,8 @@ struct procserv_msg {
 };
 
 /*! @brief Process server CPIO archive. */
-extern char _refos_process_server_archive[];
+extern char _cpio_archive[];
+extern char _cpio_archive_end[];
 
 /*! @brief Process server global state. */
 extern struct procserv_state procServ;
@@ -13,57 +13,90 @@
 #include "../../common.h"
 #include "../../state.h"
 #include "pagedir.h"
+#include <string.h>
 #include <sel4utils/mapping.h>
 
 /*! @file
-    @brief Static page directory allocator.
+    @brief Page directory pool.
 
     This procserv module is responsible for allocation and deallocation of client kernel page
     directory objects, and root cnode objects. Because these objects are really big, continually
-    allocating and re-allocating them could fail due to memory fragmentation.
+    allocating and re-allocating them could fail due to memory fragmentation, so freed ones are
+    kept on a free-list and reused. The free-list is kept warm by pd_replenish() so that creating a
+    process does not normally have to wait for the kernel allocator.
 */
 
-#define PD_ID_BASE 1
+/*! @brief Allocate a new kernel PD and root CNode pair.
+    @return The new pool entry (Ownership transferred), or NULL if out of memory.
+*/
+static struct pd_entry *
+pd_entry_create(struct pd_list *pdlist)
+{
+    struct pd_entry *entry = kmalloc(sizeof(struct pd_entry));
+    if (!entry) {
+        ROS_ERROR("Failed to allocate page directory entry structure.");
+        return NULL;
+    }
+    memset(entry, 0, sizeof(struct pd_entry));
+
+    /* Allocate the kernel vspace_root. */
+    int error = vka_alloc_vspace_root(&procServ.vka, &entry->pd);
+    if (error) {
+        ROS_ERROR("Failed to allocate vspace root. error %d\n", error);
+        goto exit1;
+    }
+    assert(entry->pd.cptr != 0);
+
+    /* If we are on mainline, we need to assign a kernel ASID. ASID Pools have been removed
+       from the newer experimental kernels. */
+    #ifndef CONFIG_KERNEL_STABLE
+    #ifndef CONFIG_X86_64
+        error = seL4_ARCH_ASIDPool_Assign(seL4_CapInitThreadASIDPool, entry->pd.cptr);
+        if (error != seL4_NoError) {
+            ROS_ERROR("Failed to assign ASID to vspace root. error %d\n", error);
+            goto exit2;
+        }
+    #endif
+    #endif
+
+    /* Allocate the kernel Root CNode object. */
+    error = vka_alloc_cnode_object(&procServ.vka, REFOS_CSPACE_RADIX, &entry->cnode);
+    if (error) {
+        ROS_ERROR("Failed to allocate Root CNode. error %d\n", error);
+        goto exit2;
+    }
+    assert(entry->cnode.cptr != 0);
+
+    entry->magic = PD_ENTRY_MAGIC;
+    pdlist->numCreated++;
+    return entry;
+
+    /* Exit stack. */
+exit2:
+    vka_free_object(&procServ.vka, &entry->pd);
+exit1:
+    kfree(entry);
+    return NULL;
+}
+
+/*! @brief Give a PD and root CNode pair back to the kernel allocator. */
+static void
+pd_entry_destroy(struct pd_list *pdlist, struct pd_entry *entry)
+{
+    assert(entry && entry->magic == PD_ENTRY_MAGIC);
+    vka_free_object(&procServ.vka, &entry->cnode);
+    vka_free_object(&procServ.vka, &entry->pd);
+    entry->magic = 0;
+    kfree(entry);
+    pdlist->numDestroyed++;
+}
 
 void
 pd_init(struct pd_list *pdlist)
 {
     assert(pdlist);
-
-    /* Initialise the allocation pool. */
-    dprintf("Initialising static Page Directory pool (sized %d)...\n", PD_MAX);
-    cpool_init(&pdlist->PDpool, PD_ID_BASE, PD_ID_BASE + PD_MAX);
-
-    /* Statically allocate the page directories. */
-    for (int i = 0; i < PD_MAX; i++) {
-
-        /* Allocate the kernel vspace_root. */
-        int error = vka_alloc_vspace_root(&procServ.vka, &pdlist->pd[i]);
-        if (error) {
-            ROS_ERROR("Failed to allocate vspace root. error %d\n", error);
-            assert(!"Procserv initialisation failed. Try lowering CONFIG_PROCSERV_MAX_VSPACES.");
-            return;
-        }
-        assert(pdlist->pd[i].cptr != 0);
-
-        /* If we are on mainline, we need to assign a kernel ASID. ASID Pools have been removed
-           from the newer experimental kernels. */
-        #ifndef CONFIG_KERNEL_STABLE
-        #ifndef CONFIG_X86_64
-            error = seL4_ARCH_ASIDPool_Assign(seL4_CapInitThreadASIDPool, pdlist->pd[i].cptr);
-            assert(error == seL4_NoError);
-        #endif
-        #endif
-
-        /* Allocate the kernel Root CNode object. */
-        error = vka_alloc_cnode_object(&procServ.vka, REFOS_CSPACE_RADIX, &pdlist->cnode[i]);
-        if (error) {
-            ROS_ERROR("Failed to allocate Root CNode. error %d\n", error);
-            assert(!"Procserv initialisation failed. Try lowering CONFIG_PROCSERV_MAX_VSPACES.");
-            return;
-        }
-        assert(pdlist->cnode[i].cptr != 0);
-    }
+    dprintf("Initialising Page Directory pool (reserve %d)...\n", PD_RESERVE);
+    memset(pdlist, 0, sizeof(struct pd_list));
 }
 
 struct pd_info 
@@ -71,61 +104,98 @@ pd_assign(struct pd_list *pdlist)
 {
     assert(pdlist);
     struct pd_info info;
-    uint32_t pdID = cpool_alloc(&pdlist->PDpool);
-    if (!pdID) {
-        info.kpdObject = 0;
-        info.kcnodeObject = 0;
-        return info;
+    struct pd_entry *entry = pdlist->freeList;
+
+    if (entry) {
+        /* Pop off the free-list. */
+        pdlist->freeList = entry->next;
+        pdlist->numFree--;
+    } else {
+        /* Reserve has run dry, allocate one right now. */
+        pdlist->numOnDemand++;
+        entry = pd_entry_create(pdlist);
+        if (!entry) {
+            info.kpdObject = 0;
+            info.kcnodeObject = 0;
+            info.entry = NULL;
+            return info;
+        }
     }
-    info.kpdObject = pdlist->pd[pdID - 1].cptr;
-    info.kcnodeObject = pdlist->cnode[pdID - 1].cptr;
+
+    assert(entry->magic == PD_ENTRY_MAGIC && !entry->assigned);
+    entry->next = NULL;
+    entry->assigned = true;
+    pdlist->numAssigned++;
+
+    info.kpdObject = entry->pd.cptr;
+    info.kcnodeObject = entry->cnode.cptr;
+    info.entry = entry;
     return info;
 }
 
 void
-pd_free(struct pd_list *pdlist, seL4_CPtr pdPtr)
+pd_free(struct pd_list *pdlist, struct pd_entry *entry)
 {
     assert(pdlist);
-
-    /* First, we loop through our list and find the associated vka object with this given cptr. */
-    int idx = -1;
-    for (int i = 0; i < PD_MAX; i++) {
-        if (pdlist->pd[i].cptr == pdPtr) {
-            idx = i;
-            break;
-        }
-    }
-
-    if (idx == -1) {
-        /* Could not find the given cptr. */
-        ROS_WARNING("pd_free failed: no such page directory cptr %d\n", pdPtr);
+    if (!entry || entry->magic != PD_ENTRY_MAGIC) {
+        ROS_WARNING("pd_free failed: invalid page directory entry.\n");
         return;
     }
-
-    if (cpool_check(&pdlist->PDpool, idx + 1)) {
-        /* Already free. */
-        ROS_WARNING("pd_free failed: page directory cptr %d is already free.\n", pdPtr);
+    if (!entry->assigned) {
+        ROS_WARNING("pd_free failed: page directory cptr %d is already free.\n", entry->pd.cptr);
         return;
     }
+    entry->assigned = false;
+    pdlist->numAssigned--;
 
     /* Delete all derived caps from this PD. */
     cspacepath_t cpath;
-    vka_cspace_make_path(&procServ.vka, pdPtr, &cpath);
+    vka_cspace_make_path(&procServ.vka, entry->pd.cptr, &cpath);
     vka_cnode_revoke(&cpath);
 
     /* Delete this PD's associated root CNode. */
-    vka_cspace_make_path(&procServ.vka, pdlist->cnode[idx].cptr, &cpath);
+    vka_cspace_make_path(&procServ.vka, entry->cnode.cptr, &cpath);
     vka_cnode_revoke(&cpath);
+
+    if (pdlist->numFree >= PD_RESERVE_MAX) {
+        /* We have plenty spare already; give the memory back. */
+        pd_entry_destroy(pdlist, entry);
+        return;
+    }
+
     vka_cnode_delete(&cpath);
-    vka_free_object(&procServ.vka, &pdlist->cnode[idx]);
+    vka_free_object(&procServ.vka, &entry->cnode);
 
     /* Allocate a new kernel Root CNode object. */
-    int error = vka_alloc_cnode_object(&procServ.vka, REFOS_CSPACE_RADIX, &pdlist->cnode[idx]);
+    int error = vka_alloc_cnode_object(&procServ.vka, REFOS_CSPACE_RADIX, &entry->cnode);
     if (error) {
         ROS_ERROR("Failed to re-allocate Root CNode. error %d\n", error);
+        vka_free_object(&procServ.vka, &entry->pd);
+        entry->magic = 0;
+        kfree(entry);
+        pdlist->numDestroyed++;
         return;
     }
 
-    /* Put it back into the allocation pool. */
-    cpool_free(&pdlist->PDpool, idx + 1);
+    /* Put it back onto the free-list. */
+    entry->next = pdlist->freeList;
+    pdlist->freeList = entry;
+    pdlist->numFree++;
+}
+
+void
+pd_replenish(struct pd_list *pdlist)
+{
+    assert(pdlist);
+    if (pdlist->numFree >= PD_RESERVE) {
+        return;
+    }
+    struct pd_entry *entry = pd_entry_create(pdlist);
+    if (!entry) {
+        /* Out of memory. Try again later; pd_assign will still allocate on demand. */
+        return;
+    }
+    entry->next = pdlist->freeList;
+    pdlist->freeList = entry;
+    pdlist->numFree++;
 }
@@ -11,15 +11,21 @@
  */
 
 /*! @file
-    @brief Static page directory allocator.
+    @brief Page directory pool.
 
-    Pre-allocates a static array of PDs, and provides interface to allocate and reuse them as
-    needed. This is done to avoid fragmentation as kernel PD objects are quite big. Also manages
-    root CNodes objects associated with the PDs address spaces, as they are quite big and also cause
-    fragmentation.
+    Provides an interface to allocate and reuse PDs as needed. Also manages root CNodes objects
+    associated with the PDs address spaces, as they are quite big too. A PD and its root CNode are
+    allocated together as a pool entry, and freed entries go back onto a free-list to be reused
+    rather than back to the kernel allocator, which avoids fragmentation as kernel PD objects are
+    quite big.
+
+    Nothing is allocated at boot. The free-list is kept topped up to a small warm reserve by
+    pd_replenish(), which the process server calls in between messages, so that assigning a PD is
+    normally a free-list pop. If the reserve runs out, a PD is allocated on demand instead. There
+    is no upper bound on the number of PDs other than available memory.
 
     This module has ownership of the underlying PDs and CNodes, and will manage their creation /
-    deletion. Uses a free-list internally to bookkeep re-assignment of previously deleted PDs.
+    deletion.
 */
 
 #ifndef _REFOS_PROCESS_SERVER_SYSTEM_ADDRSPACE_PAGE_DIRECTORY_H_
@@ -27,7 +33,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <data_struct/cpool.h>
+#include <stdbool.h>
 #include <autoconf.h>
 #include <allocman/allocman.h>
 #include <allocman/vka.h>
@@ -38,19 +44,40 @@
 /*! @file
     @brief VSpace Page Directory module. */
 
-#define PD_MAX CONFIG_PROCSERV_MAX_VSPACES
+#define PD_ENTRY_MAGIC 0x7D0E11A5
+
+/*! @brief Number of free PDs pd_replenish() keeps ready. */
+#define PD_RESERVE CONFIG_PROCSERV_PD_RESERVE
+
+/*! @brief Number of free PDs kept for reuse. Any more freed than this are destroyed. */
+#define PD_RESERVE_MAX (PD_RESERVE * 2)
+
+/*! @brief A PD and its associated root CNode. */
+struct pd_entry {
+    uint32_t magic;
+    vka_object_t pd; /* Has ownership. */
+    vka_object_t cnode; /* Has ownership. */
+    struct pd_entry *next; /*!< Next entry in the free-list, if free. */
+    bool assigned;
+};
 
 /*! @brief Page directory list structure. */
 struct pd_list {
-    cpool_t PDpool;
-    vka_object_t pd[PD_MAX]; /* Has ownership. */
-    vka_object_t cnode[PD_MAX]; /* Has ownership. */
+    struct pd_entry *freeList; /* Has ownership. */
+    uint32_t numFree;
+    uint32_t numAssigned;
+
+    /* Statistics. */
+    uint32_t numCreated;
+    uint32_t numDestroyed;
+    uint32_t numOnDemand; /*!< Assignments which found the reserve empty. */
 };
 
 /*! @brief Page directory output structure. */
 struct pd_info {
     seL4_CPtr kpdObject;
     seL4_CPtr kcnodeObject;
+    struct pd_entry *entry; /*!< Handle to give back to pd_free(). (No ownership) */
 };
 
 /*! @brief Initialises a PD list.
@@ -61,16 +88,22 @@ void pd_init(struct pd_list *pdlist);
 /*! @brief Assigns a free PD to use.
     @param pdlist The PD list to assign from. (No ownership)
     @return pd_info struct containing: cptr to an empty PD (No ownership), 
-            cptr to empty Root CNode associated with the PD (No ownership), if success.
-            Returns NULL if no more PDs left.
+            cptr to empty Root CNode associated with the PD (No ownership), and the entry handle,
+            if success. Returns all zeros if a new PD could not be allocated.
  */
 struct pd_info pd_assign(struct pd_list *pdlist);
 
 /*! @brief Frees a previously assigned PD from use.
     @param pdlist The PD list to delete from. (No ownership)
-    @param pdPtr Reference to PD. Assumes the PD came from a pd_assign from the same list. 
+    @param entry The entry handle returned by pd_assign from the same list.
            (Keeps previous ownership)
  */
-void pd_free(struct pd_list *pdlist, seL4_CPtr pdPtr);
+void pd_free(struct pd_list *pdlist, struct pd_entry *entry);
+
+/*! @brief Top up the free-list towards PD_RESERVE. Allocates at most one PD per call, so it can
+           be called in between messages without holding up the process server for long.
+    @param pdlist The PD list to replenish. (No ownership)
+ */
+void pd_replenish(struct pd_list *pdlist);
 
 #endif /* _REFOS_PROCESS_SERVER_SYSTEM_ADDRSPACE_PAGE_DIRECTORY_H_ */
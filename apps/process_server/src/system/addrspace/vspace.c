@@ -76,6 +76,7 @@ vs_initialise(struct vs_vspace *vs, uint32_t pid)
         goto exit1;   
     }
     vs->kpd = pdi.kpdObject;
+    vs->kpdEntry = pdi.entry;
 
     /* Create the CSpace path associated with this address space's root CNode. */
     cspacepath_t pathTemp;
@@ -133,11 +134,30 @@ exit3:
     vka_cspace_free(&procServ.vka, vs->cspace.capPtr);
 exit2:
     vka_cnode_revoke(&pathTemp);
-    pd_free(&procServ.PDList, vs->kpd);
+    pd_free(&procServ.PDList, vs->kpdEntry);
 exit1:
     return error;
 }
 
+/*! @brief Release a frame cap mapped by vs_map(), while the vspace is being torn down. Frames
+           that the sel4utils vspace allocated itself carry a cookie, and are left to it. */
+static void
+vs_release_frame_callback(void *arg, uintptr_t vaddr, seL4_CPtr cap, uintptr_t cookie,
+                          size_t bytes)
+{
+    (void) arg;
+    (void) vaddr;
+    (void) bytes;
+    if (cookie) {
+        return;
+    }
+    cspacepath_t path;
+    vka_cspace_make_path(&procServ.vka, cap, &path);
+    vka_cnode_revoke(&path);
+    vka_cnode_delete(&path);
+    vka_cspace_free(&procServ.vka, cap);
+}
+
 static void
 vs_release(struct vs_vspace *vs)
 {
@@ -147,14 +167,8 @@ vs_release(struct vs_vspace *vs)
     dvprintf("     Releasing VSpace PID %d...\n", vs->pid);
     cspacepath_t pathTemp;
 
-    /* Clear the associated windows list. */
-    dvprintf("         Clearing VSpace associated window list...\n");
-    for (int i = 0; i < vs->windows.numIndex; i++) {
-        vs_unmap_window(vs, vs->windows.associated[i].winID);
-    }
-    w_associate_release_associated_all_windows(&procServ.windowList, &vs->windows);
-
-    /* Free the allocated vspace book-keeping objects. */
+    /* Revoke the kernel page tables first. Each one takes every frame mapped through it out of
+       the page directory at once, so the frames below don't need unmapping one at a time. */
     dvprintf("         Releasing VSpace list of vspace bookkeeping kobjs...\n");
     int c = cvector_count(&vs->kobjVSpaceAllocatedFreelist);
     for (int i = 0; i < c; i++) {
@@ -169,6 +183,23 @@ vs_release(struct vs_vspace *vs)
     }
     cvector_reset(&vs->kobjVSpaceAllocatedFreelist);
 
+    /* Release the frame caps we mapped. Only populated page tables are walked, so a large sparse
+       window costs no more than the frames actually mapped into it. */
+    dvprintf("         Releasing VSpace mapped frames...\n");
+    sel4utils_walk_mappings(&vs->vspace, vs_release_frame_callback, NULL);
+
+    /* Clear the associated windows list. The window reservations are dropped along with the rest
+       of the vspace book-keeping below, rather than being cleared a page at a time. */
+    dvprintf("         Clearing VSpace associated window list...\n");
+    for (int i = 0; i < vs->windows.numIndex; i++) {
+        struct w_window *window = w_get_window(&procServ.windowList, vs->windows.associated[i].winID);
+        if (window) {
+            assert(window->vspace == &vs->vspace);
+            window->reservation.res = NULL;
+        }
+    }
+    w_associate_release_associated_all_windows(&procServ.windowList, &vs->windows);
+
     /* Teardown the vspace. */
     vspace_tear_down(&vs->vspace, VSPACE_FREE);
 
@@ -181,7 +212,7 @@ vs_release(struct vs_vspace *vs)
     /* Note the unguarded original CNode capability belongs to the PD, we don't have ownership of
        that. pd_free here will release it back into the pool to be reused. */
     dvprintf("         Releasing PD kobjs...\n");
-    pd_free(&procServ.PDList, vs->kpd);
+    pd_free(&procServ.PDList, vs->kpdEntry);
     memset(vs, 0, sizeof(struct vs_vspace));
 }
 
@@ -361,8 +392,13 @@ vs_resize_window(struct vs_vspace *vs, int wID, vaddr_t size)
 
 /* ---------------------------------- VSpace mapping ---------------------------------------------*/
 
-int
-vs_map(struct vs_vspace *vs, vaddr_t vaddr, seL4_CPtr frames[], int nFrames)
+/*! @brief Map an array of frames into vspace, with the given rights on the frame caps. Mapping
+           rights are masked by the cap rights, so this can make the mapping more restrictive
+           than the window's reservation.
+*/
+static int
+vs_map_rights(struct vs_vspace *vs, vaddr_t vaddr, seL4_CPtr frames[], int nFrames,
+              seL4_CapRights_t rights)
 {
     assert(vs && vs->magic == REFOS_VSPACE_MAGIC);
     int error = EINVALID;
@@ -422,7 +458,7 @@ vs_map(struct vs_vspace *vs, vaddr_t vaddr, seL4_CPtr frames[], int nFrames)
         cspacepath_t pathDest, pathSrc;
         vka_cspace_make_path(&procServ.vka, frameCopy[i], &pathDest);
         vka_cspace_make_path(&procServ.vka, frames[i], &pathSrc);
-        vka_cnode_copy(&pathDest, &pathSrc, seL4_AllRights);
+        vka_cnode_copy(&pathDest, &pathSrc, rights);
     }
 
     /* Map pages at the vspace reservation. */
@@ -456,6 +492,18 @@ exit1:
     return error;
 }
 
+int
+vs_map(struct vs_vspace *vs, vaddr_t vaddr, seL4_CPtr frames[], int nFrames)
+{
+    return vs_map_rights(vs, vaddr, frames, nFrames, seL4_AllRights);
+}
+
+int
+vs_map_read_only(struct vs_vspace *vs, vaddr_t vaddr, seL4_CPtr frame)
+{
+    return vs_map_rights(vs, vaddr, &frame, 1, seL4_CanRead);
+}
+
 int
 vs_map_across_vspace(struct vs_vspace *vsSrc, vaddr_t vaddrSrc, struct w_window *windowDest,
                      uint32_t windowDestOffset, struct proc_pcb **outClientPCB)
@@ -497,6 +545,61 @@ vs_map_across_vspace(struct vs_vspace *vsSrc, vaddr_t vaddrSrc, struct w_window
     return vs_map(&clientPCB->vspace, wa->offset + windowDestOffset, &frameCap, 1);
 }
 
+int
+vs_map_batch_across_vspace(struct vs_vspace *vsSrc, vaddr_t vaddrSrc[], int nFrames,
+                           struct w_window *windowDest, uint32_t windowDestOffset,
+                           struct proc_pcb **outClientPCB)
+{
+    assert(vsSrc && vsSrc->magic == REFOS_VSPACE_MAGIC);
+    assert(windowDest && windowDest->magic == W_MAGIC);
+    if (nFrames <= 0 || nFrames > PROCSERV_WINDOW_MAP_BATCH_MAX) {
+        return -EINVALIDPARAM;
+    }
+
+    /* Verify that the offset is within the window limits. */
+    if (windowDestOffset >= windowDest->size) {
+        ROS_ERROR("invalid window offset address!\n");
+        return -EINVALIDPARAM;
+    }
+
+    /* Find the client which this window lives in, and check that it has its window mapped. */
+    struct proc_pcb *clientPCB = pid_get_pcb(&procServ.PIDList, windowDest->clientOwnerPID);
+    if (!clientPCB) {
+        ROS_ERROR("could not find window's corresponding client.\n");
+        return -EINVALIDWINDOW;
+    }
+    if (outClientPCB) {
+        (*outClientPCB) = clientPCB;
+    }
+    struct w_associated_window *wa = w_associate_find_winID(&clientPCB->vspace.windows,
+                                                            windowDest->wID);
+    if (!wa) {
+        ROS_ERROR("client did not map its window, so invalid map call.\n");
+        return -EINVALIDWINDOW;
+    }
+
+    /* Collect the source frame caps. Past the first frame, stop quietly at the end of the window
+       or at a page that's already there, leaving the rest of the frames to the caller. */
+    seL4_CPtr frameCaps[PROCSERV_WINDOW_MAP_BATCH_MAX];
+    vaddr_t vaddrDest = REFOS_PAGE_ALIGN(wa->offset + windowDestOffset);
+    int n = 0;
+    for (; n < nFrames; n++) {
+        vaddr_t va = vaddrDest + n * REFOS_PAGE_SIZE;
+        if (n > 0 && (va + REFOS_PAGE_SIZE > wa->offset + wa->size ||
+                vspace_get_cap(&clientPCB->vspace.vspace, (void*) va))) {
+            break;
+        }
+        frameCaps[n] = vspace_get_cap(&vsSrc->vspace, (void*) vaddrSrc[n]);
+        if (!frameCaps[n]) {
+            dvprintf("vs_map_batch_across_vspace could not find source frame.\n");
+            return -EINVALIDPARAM;
+        }
+    }
+
+    int error = vs_map(&clientPCB->vspace, vaddrDest, frameCaps, n);
+    return error == ESUCCESS ? n : -error;
+}
+
 int
 vs_map_device(struct vs_vspace *vs, struct w_window *window, uint32_t windowOffset,
               uint32_t paddr , uint32_t size, bool cached)
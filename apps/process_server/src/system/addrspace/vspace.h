@@ -52,6 +52,7 @@ struct vs_vspace {
 
     /* VSpace. */
     seL4_CPtr kpd;
+    struct pd_entry *kpdEntry; /* No ownership; owned by the PD pool. */
     vspace_t vspace;
     sel4utils_alloc_data_t vspaceData;
 
@@ -150,6 +151,15 @@ int vs_resize_window(struct vs_vspace *vs, int wID, vaddr_t size);
 */
 int vs_map(struct vs_vspace *vs, vaddr_t vaddr, seL4_CPtr frames[], int nFrames);
 
+/*! @brief Map a single frame into vspace read-only, regardless of the window's permissions. Used
+           for pages shared copy-on-write; writing to it will fault.
+    @param vs The vspace to map the frame into.
+    @param vaddr The destination vaddr into vspace to map the frame into.
+    @param frame The frame to map.
+    @return ESUCCESS on success, refos_err_t otherwise.
+*/
+int vs_map_read_only(struct vs_vspace *vs, vaddr_t vaddr, seL4_CPtr frame);
+
 /*! @brief Map an array of frames that have been mapped into one vspace, into another vspace.
     @param vsSrc The source vspace to map from.
     @param vaddrSrc The vaddr in the source vspace to map from.
@@ -161,6 +171,24 @@ int vs_map(struct vs_vspace *vs, vaddr_t vaddr, seL4_CPtr frames[], int nFrames)
 int vs_map_across_vspace(struct vs_vspace *vsSrc, vaddr_t vaddrSrc, struct w_window *windowDest,
                          uint32_t windowDestOffset, struct proc_pcb **outClientPCB);
 
+/*! @brief Map a batch of frames that have been mapped into one vspace, into consecutive pages of
+           a window in another vspace, with a single mapping operation.
+
+    The first frame is mapped to the page containing windowDestOffset. Later frames stop at the
+    end of the window, or at the first destination page that is already mapped.
+
+    @param vsSrc The source vspace to map from.
+    @param vaddrSrc The vaddrs in the source vspace to map from, one per frame.
+    @param nFrames The number of frames, at most PROCSERV_WINDOW_MAP_BATCH_MAX.
+    @param windowDest Destination window to map into.
+    @param windowDestOffset Offset into destination window of the first frame.
+    @param outClientPCB Optional destination client PCB which uses this vspace.
+    @return Number of frames mapped on success, -refos_err_t otherwise.
+*/
+int vs_map_batch_across_vspace(struct vs_vspace *vsSrc, vaddr_t vaddrSrc[], int nFrames,
+                               struct w_window *windowDest, uint32_t windowDestOffset,
+                               struct proc_pcb **outClientPCB);
+
 /*! @brief Find & map a device frame into client's vspace. 
     @param vs The vspace to map device frame into.
     @param window The window in which to map the device.
@@ -14,6 +14,7 @@
 #include "../../badge.h"
 #include "../../state.h"
 #include "../process/pid.h"
+#include "../process/process.h"
 #include <refos/refos.h>
 
 /*! @file
@@ -50,6 +51,7 @@ ram_dspace_oat_create(coat_t *oat, int id, uint32_t arg[COAT_ARGS])
     ndspace->contentInitBitmask = NULL;
     ndspace->contentInitEP.capPtr = 0;
     ndspace->contentInitPID = PID_NULL;
+    ndspace->ownerPID = PID_NULL;
     ndspace->parentList = (struct ram_dspace_list *) oat;
     assert(ndspace->parentList->magic == RAM_DATASPACE_LIST_MAGIC);
 
@@ -145,6 +147,12 @@ ram_dspace_oat_delete(coat_t *oat, cvector_item_t *obj)
     }
     cvector_free(&rds->contentInitWaitingList);
 
+    /* Drop the copy-on-write source. */
+    if (rds->cowSource) {
+        ram_dspace_unref(rds->parentList, rds->cowSource->ID);
+        rds->cowSource = NULL;
+    }
+
     /* Free the pages. */
     assert(rds->pages);
     for (int i = 0; i < rds->npages; i++) {
@@ -159,6 +167,7 @@ ram_dspace_oat_delete(coat_t *oat, cvector_item_t *obj)
             } else {
                 /* We do own this anonymous dataspace frame. */
                 vka_free_object(&procServ.vka, &rds->pages[i]);
+                proc_mem_uncharge_frame(rds->ownerPID);
             }
         }
     }
@@ -235,6 +244,37 @@ ram_dspace_create(struct ram_dspace_list *rdslist, size_t size)
     return dspace;
 }
 
+struct ram_dspace *
+ram_dspace_clone(struct ram_dspace_list *rdslist, struct ram_dspace *source)
+{
+    assert(rdslist);
+    assert(source && source->magic == RAM_DATASPACE_MAGIC);
+    if (source->physicalAddrEnabled || source->contentInitEnabled) {
+        /* Only plain anonymous memory may be cloned. */
+        return NULL;
+    }
+
+    struct ram_dspace *dspace = ram_dspace_create(rdslist, source->npages * REFOS_PAGE_SIZE);
+    if (!dspace) {
+        return NULL;
+    }
+    ram_dspace_ref(source->parentList, source->ID);
+    dspace->cowSource = source;
+    return dspace;
+}
+
+void
+ram_dspace_disown(struct ram_dspace_list *rdslist, uint32_t pid)
+{
+    assert(rdslist);
+    for (int i = 1; i < RAM_DATASPACE_MAX_NUM_DATASPACE; i++) {
+        struct ram_dspace *dspace = ram_dspace_get(rdslist, i);
+        if (dspace && dspace->ownerPID == pid) {
+            dspace->ownerPID = PID_NULL;
+        }
+    }
+}
+
 void
 ram_dspace_ref(struct ram_dspace_list *rdslist, int ID)
 {
@@ -277,6 +317,34 @@ ram_dspace_check_page(struct ram_dspace *dataspace, uint32_t offset)
     return dataspace->pages[idx].cptr;
 }
 
+/*! @brief Fill a newly allocated page of a copy-on-write clone from its source.
+    @param dataspace The clone dataspace, with its frame at idx just allocated.
+    @param idx The page index.
+    @return ESUCCESS on success, refos_err_t otherwise.
+*/
+static int
+ram_dspace_cow_copy(struct ram_dspace *dataspace, uint32_t idx)
+{
+    assert(dataspace->cowSource && dataspace->pages[idx].cptr);
+    seL4_CPtr source = ram_dspace_check_page(dataspace->cowSource, idx * REFOS_PAGE_SIZE);
+    if (!source) {
+        /* The source never had this page, so it's zero like any new frame. */
+        return ESUCCESS;
+    }
+
+    char *buf = kmalloc(REFOS_PAGE_SIZE);
+    if (!buf) {
+        ROS_ERROR("ram_dspace_cow_copy out of memory.");
+        return ENOMEM;
+    }
+    int error = procserv_frame_read(source, buf, REFOS_PAGE_SIZE, 0);
+    if (error == ESUCCESS) {
+        error = procserv_frame_write(dataspace->pages[idx].cptr, buf, REFOS_PAGE_SIZE, 0);
+    }
+    kfree(buf);
+    return error;
+}
+
 seL4_CPtr
 ram_dspace_get_page(struct ram_dspace *dataspace, uint32_t offset)
 {
@@ -298,10 +366,22 @@ ram_dspace_get_page(struct ram_dspace *dataspace, uint32_t offset)
             memset(&dataspace->pages[idx], 0, sizeof(vka_object_t));
             dataspace->pages[idx].cptr = deviceFrame.capPtr;
         } else {
-            /* Allocate a normal frame to fill this page. */
+            /* Allocate a normal frame to fill this page, charged to the dataspace owner. */
+            if (proc_mem_charge_frame(dataspace->ownerPID) != ESUCCESS) {
+                return (seL4_CPtr) 0;
+            }
             int error = vka_alloc_frame(&procServ.vka, seL4_PageBits, &dataspace->pages[idx]);
             if (error || !dataspace->pages[idx].cptr) {
                 ROS_ERROR("Could not allocate frame object. Procserv out of memory.");
+                proc_mem_uncharge_frame(dataspace->ownerPID);
+                return (seL4_CPtr) 0;
+            }
+
+            /* Copy-on-write clone page; fill the new frame with the source's content. */
+            if (dataspace->cowSource && ram_dspace_cow_copy(dataspace, idx) != ESUCCESS) {
+                vka_free_object(&procServ.vka, &dataspace->pages[idx]);
+                memset(&dataspace->pages[idx], 0, sizeof(vka_object_t));
+                proc_mem_uncharge_frame(dataspace->ownerPID);
                 return (seL4_CPtr) 0;
             }
         }
@@ -309,6 +389,27 @@ ram_dspace_get_page(struct ram_dspace *dataspace, uint32_t offset)
     return dataspace->pages[idx].cptr;
 }
 
+seL4_CPtr
+ram_dspace_get_page_shared(struct ram_dspace *dataspace, uint32_t offset, bool *shared)
+{
+    assert(dataspace && dataspace->magic == RAM_DATASPACE_MAGIC);
+    assert(shared);
+    *shared = false;
+    uint32_t idx = ram_dspace_get_index(offset);
+    if (idx >= dataspace->npages) {
+        /* Offset of of range. */
+        return (seL4_CPtr) 0;
+    }
+    if (!dataspace->pages[idx].cptr && dataspace->cowSource) {
+        seL4_CPtr frame = ram_dspace_check_page(dataspace->cowSource, offset);
+        if (frame) {
+            *shared = true;
+            return frame;
+        }
+    }
+    return ram_dspace_get_page(dataspace, offset);
+}
+
 struct ram_dspace *
 ram_dspace_get(struct ram_dspace_list *rdslist, int ID)
 {
@@ -444,7 +545,8 @@ ram_dspace_read_page(char *buf, size_t len, struct ram_dspace *dataspace, uint32
         dvprintf("WARNING: capping at len > PAGE_SIZE - skipBytes.\n");
         len = (REFOS_PAGE_SIZE - skipBytes);
     }
-    seL4_CPtr frame = ram_dspace_get_page(dataspace, offset);
+    bool shared;
+    seL4_CPtr frame = ram_dspace_get_page_shared(dataspace, offset, &shared);
     if (!frame) {
         ROS_ERROR("ram_dspace_read_page failed to allocate page. Procserv out of memory.");
         return ENOMEM;
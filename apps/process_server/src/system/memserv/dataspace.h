@@ -52,6 +52,13 @@ struct ram_dspace {
     vka_object_t *pages; /*< Has ownership. */
     uint32_t npages;
 
+    /* The process charged for this dataspace's frames, or PID_NULL. */
+    uint32_t ownerPID; /* No ownership. */
+
+    /*! Shared read-only content, such as program text. May only be mapped through read-only
+        windows, and may not be closed or resized by clients. */
+    bool readOnly;
+
     /* Content init state. */
     bool contentInitEnabled;
     cspacepath_t contentInitEP;
@@ -63,6 +70,10 @@ struct ram_dspace {
     bool physicalAddrEnabled;
     uint32_t physicalAddr;
 
+    /*! Copy-on-write source. Pages not yet present here are shared read-only from the source,
+        and copied when written to. */
+    struct ram_dspace *cowSource; /* Has a strong reference. */
+
     /*! Weak reference to this dataspace's parent. */
     struct ram_dspace_list *parentList; /* No ownership. */
 };
@@ -95,6 +106,13 @@ void ram_dspace_deinit(struct ram_dspace_list *rdslist);
  */
 struct ram_dspace *ram_dspace_create(struct ram_dspace_list *rdslist, size_t size);
 
+/*! @brief Stop charging a process for any dataspaces it owns. Called when the process exits, as
+           its dataspaces may still be shared with others.
+    @param rdslist The ram dataspace list.
+    @param pid The PID of the exiting process.
+ */
+void ram_dspace_disown(struct ram_dspace_list *rdslist, uint32_t pid);
+
 /*! @brief Adds a shared reference to ram dataspace from a ram dataspace list.
     @param rdslist The ram dataspace list to reference the dataspace from.
     @param ID The ID of target ram dataspace to be refed.
@@ -117,13 +135,38 @@ void ram_dspace_unref(struct ram_dspace_list *rdslist, int ID);
 seL4_CPtr ram_dspace_check_page(struct ram_dspace *dataspace, uint32_t offset);
 
 /*! @brief Retrieves a page at a given offset. If the page hasn't been created, it will be
-           allocated. Note that this does NOT perform content init.
+           allocated and charged to the dataspace owner. Note that this does NOT perform content
+           init. For a copy-on-write clone, a new page is filled with the source's content.
     @param dataspace The ram dataspace to get the page object from.
     @param offset Offset into the ram dataspace.
-    @return CPtr to frame if success, 0 if offset invalid or out of memory. No ownership transfer.
+    @return CPtr to frame if success, 0 if offset invalid, out of memory or the owner is at its
+            resident frame limit. No ownership transfer.
  */
 seL4_CPtr ram_dspace_get_page(struct ram_dspace *dataspace, uint32_t offset);
 
+/*! @brief Creates a copy-on-write clone of a ram dataspace.
+
+    The clone starts out sharing every page of the source. Shared pages are only ever mapped
+    read-only; writing to one makes a private copy. The source is kept alive as long as the clone
+    exists, and must not be written to afterwards, or the change shows through to its clones.
+
+    @param rdslist The ram dataspace list to allocate from.
+    @param source The dataspace to clone. (No ownership)
+    @return The newly created ram dataspace if success (No ownership), NULL otherwise.
+ */
+struct ram_dspace *ram_dspace_clone(struct ram_dspace_list *rdslist, struct ram_dspace *source);
+
+/*! @brief Retrieves a page at a given offset for read access. For a copy-on-write clone, a page
+           which has not been copied yet is shared from the clone's source instead of being copied.
+    @param dataspace The ram dataspace to get the page object from.
+    @param offset Offset into the ram dataspace.
+    @param shared Output flag, set to true if the page belongs to the copy-on-write source and
+                  must be mapped read-only.
+    @return CPtr to frame if success, 0 otherwise. No ownership transfer.
+ */
+seL4_CPtr ram_dspace_get_page_shared(struct ram_dspace *dataspace, uint32_t offset,
+                                     bool *shared);
+
 /*! @brief Finds a ram dataspace in a ram dataspace list by a dataspace ID.
     @param rdslist The source list of ram dataspaces. (No ownership)
     @param ID The dataspace ID to locate the ram dataspace in the list.
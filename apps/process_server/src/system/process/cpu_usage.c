@@ -0,0 +1,156 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+#include <string.h>
+#include <sel4/sel4.h>
+#include <sel4/benchmark_utilisation_types.h>
+#include "cpu_usage.h"
+#include "pid.h"
+#include "process.h"
+#include "thread.h"
+#include "../../state.h"
+
+/*! @file
+    @brief Per-process CPU utilisation, sampled from the kernel utilisation tracker. */
+
+void
+cpu_usage_init(struct cpu_usage_state *s)
+{
+    assert(s);
+    memset(s, 0, sizeof(struct cpu_usage_state));
+#ifdef CONFIG_BENCHMARK_TRACK_UTILISATION
+    seL4_BenchmarkResetLog();
+#endif
+}
+
+#ifdef CONFIG_BENCHMARK_TRACK_UTILISATION
+
+/*! @brief Read and clear the utilisation counters of a TCB. The kernel writes them into our IPC
+           buffer, which also holds the core-wide idle and total counters afterwards.
+    @param tcb The TCB to read.
+    @param schedules Optional output number of times the TCB was scheduled.
+    @return The cycles the TCB spent scheduled.
+*/
+static uint64_t
+cpu_usage_read_tcb(seL4_CPtr tcb, uint64_t *schedules)
+{
+    seL4_BenchmarkGetThreadUtilisation(tcb);
+    uint64_t *buffer = (uint64_t*) &seL4_GetIPCBuffer()->msg[0];
+    uint64_t cycles = buffer[BENCHMARK_TCB_UTILISATION];
+    if (schedules) {
+        *schedules = buffer[BENCHMARK_TCB_NUMBER_SCHEDULES];
+    }
+    seL4_BenchmarkResetThreadUtilisation(tcb);
+    return cycles;
+}
+
+/*! @brief PID iteration callback which attributes a process' thread counters to it. */
+static void
+cpu_usage_sample_process(struct proc_pcb *p, void *cookie)
+{
+    struct cpu_usage_state *s = (struct cpu_usage_state*) cookie;
+    assert(p && p->magic == REFOS_PCB_MAGIC);
+    memset(&p->usage, 0, sizeof(struct proc_cpu_usage));
+    p->usage.sequence = s->sequence;
+    int nthreads = cvector_count(&p->threads);
+    for (int i = 0; i < nthreads; i++) {
+        struct proc_tcb *t = proc_get_thread(p, i);
+        if (!t) {
+            continue;
+        }
+        uint64_t schedules = 0;
+        uint64_t cycles = cpu_usage_read_tcb(thread_tcb_obj(t), &schedules);
+        p->usage.cycles += cycles;
+        p->usage.schedules += schedules;
+        if (cycles > p->usage.busiestThreadCycles) {
+            p->usage.busiestThread = i;
+            p->usage.busiestThreadCycles = cycles;
+        }
+    }
+    s->sample.processes++;
+}
+
+#endif /* CONFIG_BENCHMARK_TRACK_UTILISATION */
+
+int
+cpu_usage_sample(struct cpu_usage_state *s, refos_cpu_sample_t *sample)
+{
+    assert(s);
+#ifdef CONFIG_BENCHMARK_TRACK_UTILISATION
+    /* Stop the tracker first, so the interval totals and every thread's counters cover the same
+       period. This also charges the time we have been running so far to our own TCB. */
+    seL4_BenchmarkFinalizeLog();
+
+    s->sequence++;
+    memset(&s->sample, 0, sizeof(refos_cpu_sample_t));
+    s->sample.sequence = s->sequence;
+    pid_iterate(&procServ.PIDList, cpu_usage_sample_process, (void*) s);
+
+    /* The process server's own threads. Read the initial thread last, so the IPC buffer is left
+       holding the core-wide counters. */
+    for (int i = 0; i < PROCSERV_NUM_CORES; i++) {
+        struct procserv_worker *w[2] = {&procServ.workers.syscall[i], &procServ.workers.fault[i]};
+        for (int j = 0; j < 2; j++) {
+            if (w[j]->hasThread) {
+                s->sample.procservCycles += cpu_usage_read_tcb(w[j]->thread.tcb.cptr, NULL);
+            }
+        }
+    }
+    s->sample.procservCycles += cpu_usage_read_tcb(seL4_CapInitThreadTCB, NULL);
+
+    uint64_t *buffer = (uint64_t*) &seL4_GetIPCBuffer()->msg[0];
+    s->sample.totalCycles = buffer[BENCHMARK_TOTAL_UTILISATION];
+    s->sample.idleCycles = buffer[BENCHMARK_IDLE_LOCALCPU_UTILISATION];
+    s->sample.kernelCycles = buffer[BENCHMARK_TOTAL_KERNEL_UTILISATION];
+    s->sample.kernelEntries = buffer[BENCHMARK_TOTAL_NUMBER_KERNEL_ENTRIES];
+    s->sample.schedules = buffer[BENCHMARK_TOTAL_NUMBER_SCHEDULES];
+
+    /* Start the next interval. */
+    seL4_BenchmarkResetLog();
+
+    if (sample) {
+        memcpy(sample, &s->sample, sizeof(refos_cpu_sample_t));
+    }
+    return ESUCCESS;
+#else
+    (void) sample;
+    return EUNIMPLEMENTED;
+#endif
+}
+
+int
+cpu_usage_get(struct cpu_usage_state *s, uint32_t pid, refos_cpu_usage_t *usage)
+{
+    assert(s && usage);
+    if (!CPU_USAGE_ENABLED) {
+        return EUNIMPLEMENTED;
+    }
+    for (; pid < PID_MAX; pid++) {
+        struct proc_pcb *p = pid_get_pcb(&procServ.PIDList, pid);
+        if (!p || p->magic != REFOS_PCB_MAGIC) {
+            continue;
+        }
+        memset(usage, 0, sizeof(refos_cpu_usage_t));
+        usage->pid = p->pid;
+        usage->parentPID = p->parentPID;
+        usage->threads = proc_num_threads(p);
+        strncpy(usage->name, p->debugProcessName, REFOS_MEM_STATS_NAME_LEN - 1);
+        if (s->sequence != 0 && p->usage.sequence == s->sequence) {
+            usage->cycles = p->usage.cycles;
+            usage->schedules = p->usage.schedules;
+            usage->busiestThread = p->usage.busiestThread;
+            usage->busiestThreadCycles = p->usage.busiestThreadCycles;
+        }
+        return ESUCCESS;
+    }
+    return EINVALIDPARAM;
+}
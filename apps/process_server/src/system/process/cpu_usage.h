@@ -0,0 +1,72 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+/*! @file
+    @brief Per-process CPU utilisation, sampled from the kernel utilisation tracker.
+
+    On kernels built with CONFIG_BENCHMARK_TRACK_UTILISATION (ia32_debug_defconfig turns it on;
+    the other default configurations leave it off), the kernel counts the cycles every TCB spends
+    scheduled, along with the idle thread and kernel time of the core. The process server turns
+    tracking on at startup. Taking a sample stops the tracker, reads and clears the counters
+    of every process thread and of the process server's own threads, records them in each PCB
+    tagged with the sample's sequence number, and starts the tracker again, so every sample covers
+    the interval since the previous one.
+
+    The process server has no timer of its own, so samples are paced by whoever asks for them
+    (see proc_cpu_sample()). The tracker is per-core and only runs on the core the sample is taken
+    on; on a multi-core kernel, threads pinned to other cores report no cycles.
+*/
+
+#ifndef _REFOS_PROCESS_SERVER_SYSTEM_PROCESS_CPU_USAGE_H_
+#define _REFOS_PROCESS_SERVER_SYSTEM_PROCESS_CPU_USAGE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <autoconf.h>
+#include <refos/refos.h>
+#include "../../common.h"
+
+#ifdef CONFIG_BENCHMARK_TRACK_UTILISATION
+    #define CPU_USAGE_ENABLED true
+#else
+    #define CPU_USAGE_ENABLED false
+#endif
+
+/*! @brief Global CPU utilisation sampling state. */
+struct cpu_usage_state {
+    uint32_t sequence; /*!< Sequence number of the latest sample, 0 before the first one. */
+    refos_cpu_sample_t sample;
+};
+
+/*! @brief Initialise CPU utilisation sampling, and start the kernel tracker.
+    @param s The sampling state to initialise.
+*/
+void cpu_usage_init(struct cpu_usage_state *s);
+
+/*! @brief End the current sampling interval, attribute it to processes, and start a new one.
+    @param s The sampling state.
+    @param sample Optional output summary of the sample.
+    @return ESUCCESS on success, EUNIMPLEMENTED if the kernel does not track utilisation.
+*/
+int cpu_usage_sample(struct cpu_usage_state *s, refos_cpu_sample_t *sample);
+
+/*! @brief Get the CPU utilisation of the first live process with PID no smaller than the given
+           one, over the latest sample interval.
+    @param s The sampling state.
+    @param pid The PID to start looking from.
+    @param usage Output usage structure.
+    @return ESUCCESS on success, EINVALIDPARAM if there is no such process, EUNIMPLEMENTED if the
+            kernel does not track utilisation.
+*/
+int cpu_usage_get(struct cpu_usage_state *s, uint32_t pid, refos_cpu_usage_t *usage);
+
+#endif /* _REFOS_PROCESS_SERVER_SYSTEM_PROCESS_CPU_USAGE_H_ */
@@ -11,6 +11,7 @@
  */
 
 #include "process.h"
+#include "pid.h"
 #include "proc_client_watch.h"
 #include "../../common.h"
 #include "../../state.h"
@@ -47,6 +48,36 @@ client_watch_find(struct proc_watch_list *wl, uint32_t pid)
     return -1;
 }
 
+/*! @brief Record in the reverse index that a process is watching the given PID. */
+static void
+client_watch_index_add(struct proc_watch_list *wl, uint32_t pid)
+{
+    if (!wl->index || pid >= PID_MAX) {
+        return;
+    }
+    assert(wl->index->magic == REFOS_WATCH_INDEX_MAGIC);
+    cvector_add(&wl->index->watchers[pid], (cvector_item_t) wl->ownerPID);
+}
+
+/*! @brief Remove a process's watch of the given PID from the reverse index. */
+static void
+client_watch_index_remove(struct proc_watch_list *wl, uint32_t pid)
+{
+    if (!wl->index || pid >= PID_MAX) {
+        return;
+    }
+    assert(wl->index->magic == REFOS_WATCH_INDEX_MAGIC);
+    cvector_t *watchers = &wl->index->watchers[pid];
+    int count = cvector_count(watchers);
+    for (int i = 0; i < count; i++) {
+        if ((uint32_t) cvector_get(watchers, i) == wl->ownerPID) {
+            cvector_delete(watchers, i);
+            return;
+        }
+    }
+    assert(!"Watch missing from the reverse index.");
+}
+
 /* --------------------------- Proc watch client interface functions ---------------------------- */
 
 void
@@ -54,21 +85,37 @@ client_watch_init(struct proc_watch_list *wl)
 {
     assert(wl);
     wl->magic = REFOS_PCB_WATCHLIST_MAGIC;
+    wl->ownerPID = 0;
+    wl->index = NULL;
+    wl->deathEP = NULL;
     cvector_init(&wl->clientList);
-    cvector_init(&wl->endpointNotifyList);
 }
 
 void
 client_watch_release(struct proc_watch_list *wl)
 {
     assert(wl && wl->magic == REFOS_PCB_WATCHLIST_MAGIC);
-    int count = cvector_count(&wl->endpointNotifyList);
+    int count = cvector_count(&wl->clientList);
     for (int i = 0; i < count; i++) {
-        cspacepath_t *ep = (cspacepath_t *) cvector_get(&wl->endpointNotifyList, i);
-        client_watch_free_ep_cslot(ep);
+        client_watch_index_remove(wl, (uint32_t) cvector_get(&wl->clientList, i));
+    }
+
+    /* A dying watcher can't be signalled any more. */
+    if (wl->index) {
+        cvector_t *pending = &wl->index->pendingPID;
+        for (int i = cvector_count(pending) - 1; i >= 0; i--) {
+            if ((uint32_t) cvector_get(pending, i) == wl->ownerPID) {
+                cvector_delete(pending, i);
+            }
+        }
+    }
+
+    if (wl->deathEP) {
+        client_watch_free_ep_cslot(wl->deathEP);
+        wl->deathEP = NULL;
     }
     cvector_free(&wl->clientList);
-    cvector_free(&wl->endpointNotifyList);
+    wl->index = NULL;
     wl->magic = 0;
 }
 
@@ -79,9 +126,8 @@ client_watch_get(struct proc_watch_list *wl, uint32_t pid)
     if (idx == -1) {
         return 0;
     }
-    cspacepath_t *ep = (cspacepath_t *) cvector_get(&wl->endpointNotifyList, idx);
-    assert(ep && ep->capPtr);
-    return ep->capPtr;
+    assert(wl->deathEP && wl->deathEP->capPtr);
+    return wl->deathEP->capPtr;
 }
 
 int
@@ -91,28 +137,36 @@ client_watch(struct proc_watch_list *wl, uint32_t pid, seL4_CPtr notifyEP)
         return EINVALIDPARAM;
     }
 
-    /* Allocate cspacepath_t structure. */
-    cspacepath_t *cslot = kmalloc(sizeof(cspacepath_t));
-    if (!cslot) {
-        ROS_ERROR("client_watch failed to malloc cslot structure. Procserv out of memory.");
-        return ENOMEM;
+    if (!wl->deathEP) {
+        /* This is our first watch. Take ownership of the given notify EP; every watch we make
+           from now on is signalled on it. */
+        cspacepath_t *cslot = kmalloc(sizeof(cspacepath_t));
+        if (!cslot) {
+            ROS_ERROR("client_watch failed to malloc cslot structure. Procserv out of memory.");
+            return ENOMEM;
+        }
+        memset(cslot, 0, sizeof(cspacepath_t));
+        vka_cspace_make_path(&procServ.vka, notifyEP, cslot);
+        wl->deathEP = cslot;
+    } else {
+        /* We already have our death EP. There's no telling whether this cap is another copy of
+           it, so it's released rather than kept alongside. */
+        cspacepath_t path;
+        vka_cspace_make_path(&procServ.vka, notifyEP, &path);
+        vka_cnode_delete(&path);
+        vka_cspace_free(&procServ.vka, notifyEP);
     }
-    memset(cslot, 0, sizeof(cspacepath_t));
-
-    /* Save the cap path, and take ownership of the given notify EP. */
-    vka_cspace_make_path(&procServ.vka, notifyEP, cslot);
 
     int idx = client_watch_find(wl, pid);
     if (idx != -1) {
-        /* We are already watching this client. Unwatch first. */
-        client_unwatch(wl, pid);
+        /* We are already watching this client. */
+        return ESUCCESS;
     }
 
     /* And finally, add to our watch list. */
-    dprintf("Adding client_watch pid %d notifyEP 0x%x\n", pid, notifyEP);
+    dprintf("Adding client_watch pid %d notifyEP 0x%x\n", pid, wl->deathEP->capPtr);
     cvector_add(&wl->clientList, (cvector_item_t) pid);
-    cvector_add(&wl->endpointNotifyList, (cvector_item_t) cslot);
-    assert(cvector_count(&wl->clientList) == cvector_count(&wl->endpointNotifyList));
+    client_watch_index_add(wl, pid);
 
     return ESUCCESS;
 }
@@ -126,38 +180,49 @@ client_unwatch(struct proc_watch_list *wl, uint32_t pid)
         return;
     }
 
-    /* Free the endpoint and remove from watch list. */
-    cspacepath_t *ep = (cspacepath_t *) cvector_get(&wl->endpointNotifyList, idx);
-    client_watch_free_ep_cslot(ep);
-    cvector_delete(&wl->endpointNotifyList, idx);
+    /* Remove from watch list. The death EP stays, for any other watches. */
     cvector_delete(&wl->clientList, idx);
+    client_watch_index_remove(wl, pid);
 }
 
+/* ------------------------------ Watcher reverse index functions ------------------------------- */
+
 void
-client_watch_notify_death_callback(struct proc_pcb *pcb, void *cookie)
+client_watch_index_init(struct proc_watch_index *wi)
 {
-    uint32_t deathPID = (int) cookie;
-    assert(pcb && pcb->magic == REFOS_PCB_MAGIC);
-
-    if (pcb->pid == deathPID) {
-        /* Skip this PID; no point notifying the dying process of its own death. */
-        return;
+    assert(wi);
+    memset(wi, 0, sizeof(struct proc_watch_index));
+    for (int i = 0; i < PID_MAX; i++) {
+        cvector_init(&wi->watchers[i]);
     }
+    cvector_init(&wi->pendingPID);
+    wi->magic = REFOS_WATCH_INDEX_MAGIC;
+}
 
-    /* Retrieve the watch notify endpoint, if any. */
-    seL4_CPtr ep = client_watch_get(&pcb->clientWatchList, deathPID);
-    if (!ep) {
-        /* This process isn't watching the dying client. */
-        return;
-    }
+void
+client_watch_index_attach(struct proc_watch_index *wi, struct proc_watch_list *wl,
+                          uint32_t ownerPID)
+{
+    assert(wi && wi->magic == REFOS_WATCH_INDEX_MAGIC);
+    assert(wl && wl->magic == REFOS_PCB_WATCHLIST_MAGIC);
+    assert(cvector_count(&wl->clientList) == 0);
+    wl->index = wi;
+    wl->ownerPID = ownerPID;
+}
 
-    dprintf("Notifying client %d [%s] of the death of %d with EP 0x%x...\n",
-        pcb->pid, pcb->debugProcessName, deathPID, ep);
+/*! @brief Write a death notification into a watcher's notification buffer.
+    @return true if the watcher should be signalled, false otherwise.
+*/
+static bool
+client_watch_write_death(struct proc_pcb *pcb, uint32_t deathPID)
+{
+    dvprintf("Notifying client %d [%s] of the death of %d...\n",
+        pcb->pid, pcb->debugProcessName, deathPID);
     if (!pcb->notificationBuffer) {
         ROS_WARNING("Process %d [%s] is watching client with no notification buffer!",
                 pcb->pid, pcb->debugProcessName);
         ROS_WARNING("This death notification will be ignored.");
-        return;
+        return false;
     }
 
     /* Construct the notification. */
@@ -171,10 +236,70 @@ client_watch_notify_death_callback(struct proc_pcb *pcb, void *cookie)
             sizeof(exitNotification));
     if (error) {
         ROS_WARNING("Failed to write death fault notification to buffer.");
+        return false;
+    }
+    return true;
+}
+
+/*! @brief Queue a watcher to be signalled on its death EP by the next flush, unless it already
+           is. */
+static void
+client_watch_queue_signal(struct proc_watch_index *wi, uint32_t watcherPID)
+{
+    int count = cvector_count(&wi->pendingPID);
+    for (int i = 0; i < count; i++) {
+        if ((uint32_t) cvector_get(&wi->pendingPID, i) == watcherPID) {
+            return;
+        }
+    }
+    cvector_add(&wi->pendingPID, (cvector_item_t) watcherPID);
+}
+
+void
+client_watch_notify_death(struct proc_watch_index *wi, uint32_t deathPID)
+{
+    assert(wi && wi->magic == REFOS_WATCH_INDEX_MAGIC);
+    if (deathPID >= PID_MAX) {
         return;
     }
 
-    /* Notify the pager of this fault. */
-    dispatcher_notify(ep);
-    client_unwatch(&pcb->clientWatchList, deathPID);
+    cvector_t *watchers = &wi->watchers[deathPID];
+    int count;
+    while ((count = cvector_count(watchers)) > 0) {
+        uint32_t watcherPID = (uint32_t) cvector_get(watchers, count - 1);
+        struct proc_pcb *pcb = pid_get_pcb(&procServ.PIDList, watcherPID);
+        assert(pcb && pcb->magic == REFOS_PCB_MAGIC);
+        struct proc_watch_list *wl = &pcb->clientWatchList;
+        assert(wl->magic == REFOS_PCB_WATCHLIST_MAGIC && wl->index == wi);
+
+        /* Take the watch out of the watcher's list and the index. */
+        int idx = client_watch_find(wl, deathPID);
+        assert(idx != -1);
+        cvector_delete(&wl->clientList, idx);
+        cvector_delete(watchers, count - 1);
+
+        /* No point notifying the dying process of its own death. */
+        if (watcherPID == deathPID || !client_watch_write_death(pcb, deathPID)) {
+            continue;
+        }
+        wi->numNotifications++;
+        client_watch_queue_signal(wi, watcherPID);
+    }
+}
+
+void
+client_watch_flush(struct proc_watch_index *wi)
+{
+    assert(wi && wi->magic == REFOS_WATCH_INDEX_MAGIC);
+    int count = cvector_count(&wi->pendingPID);
+    for (int i = 0; i < count; i++) {
+        uint32_t watcherPID = (uint32_t) cvector_get(&wi->pendingPID, i);
+        struct proc_pcb *pcb = pid_get_pcb(&procServ.PIDList, watcherPID);
+        assert(pcb && pcb->magic == REFOS_PCB_MAGIC);
+        struct proc_watch_list *wl = &pcb->clientWatchList;
+        assert(wl->magic == REFOS_PCB_WATCHLIST_MAGIC && wl->deathEP);
+        dispatcher_notify(wl->deathEP->capPtr);
+        wi->numSignals++;
+    }
+    cvector_reset(&wi->pendingPID);
 }
@@ -15,17 +15,48 @@
 
 #include <sel4/sel4.h>
 #include <data_struct/cvector.h>
+#include <vka/cspacepath_t.h>
+#include "../../badge.h"
 
 /*! @file
-    @brief Process server death notification book-keeping module. */
+    @brief Process server death notification book-keeping module.
+
+    Every process keeps a watch list of the clients it wants to be told about when they die. A
+    process has a single death notify EP, the one given with its first watch; the EPs given with
+    later watches are released, as there's no telling whether they are copies of the same one.
+    Watch lists of live processes are also entered
+    into a reverse index from watched PID to watching PIDs, so that a death only visits the
+    processes actually watching the dying one, instead of every watch list in the system.
+
+    Death notifications are written to each watcher's notification buffer straight away, but the
+    watchers are only signalled when the pending signals are flushed, once per watcher no matter
+    how many deaths it was told about since the last flush. */
 
 #define REFOS_PCB_WATCHLIST_MAGIC 0x191B44E7
+#define REFOS_WATCH_INDEX_MAGIC 0x3A7C81D5
+
+struct proc_watch_index;
 
 /*! @brief Client death notify watch list structure. */
 struct proc_watch_list {
     uint32_t magic;
+    uint32_t ownerPID; /*!< The watching process, if the list is indexed. */
+    struct proc_watch_index *index; /*!< No ownership. NULL if the list is not indexed. */
     cvector_t clientList; /* uint32_t PIDs, no ownership. */
-    cvector_t endpointNotifyList; /* cspacepath_t, has ownership. */
+    cspacepath_t *deathEP; /*!< Has ownership. NULL until the first watch. */
+};
+
+/*! @brief Reverse index from watched PID to the PIDs of the processes watching it. */
+struct proc_watch_index {
+    uint32_t magic;
+    cvector_t watchers[PID_MAX]; /* uint32_t watcher PIDs, no ownership. */
+
+    /* Watchers with death notifications waiting to be signalled. */
+    cvector_t pendingPID; /* uint32_t watcher PIDs, no ownership. */
+
+    /* Statistics. */
+    uint32_t numNotifications;
+    uint32_t numSignals;
 };
 
 struct proc_pcb;
@@ -51,10 +82,12 @@ void client_watch_release(struct proc_watch_list *wl);
 */
 seL4_CPtr client_watch_get(struct proc_watch_list *wl, uint32_t pid);
 
-/*! @brief Watch the given PID with the given notification async endpoint.
+/*! @brief Watch the given PID. The watcher is signalled on the notify EP it gave with its first
+           watch.
     @param wl The watch list to add to.
     @param pid The PID of client to watch.
-    @param notifyEP The watcher notify async EP.
+    @param notifyEP The watcher notify async EP. Takes ownership; released unless this is the
+                    first watch.
     @return ESUCCESS if success, refos_err_t otherwise.
 */
 int client_watch(struct proc_watch_list *wl, uint32_t pid, seL4_CPtr notifyEP);
@@ -65,11 +98,30 @@ int client_watch(struct proc_watch_list *wl, uint32_t pid, seL4_CPtr notifyEP);
 */
 void client_unwatch(struct proc_watch_list *wl, uint32_t pid);
 
-/*! @brief Notify listening watchers that a client has exited. This is a callback function intended
-           to be used with pid_iterate() in <process/pid.h>.
-    @param pcb The current iterating PCB containign watchlist to go through.
-    @param cookie The PID of dying client.
+/*! @brief Initialise an empty watcher reverse index.
+    @param wi The index to initialise. (No ownership transfer)
+*/
+void client_watch_index_init(struct proc_watch_index *wi);
+
+/*! @brief Enter a watch list, and every watch it makes from now on, into the reverse index. The
+           list must be empty. client_watch_release() takes it out of the index again.
+    @param wi The reverse index.
+    @param wl The watch list. (No ownership transfer)
+    @param ownerPID The PID of the process which owns the watch list.
+*/
+void client_watch_index_attach(struct proc_watch_index *wi, struct proc_watch_list *wl,
+                               uint32_t ownerPID);
+
+/*! @brief Notify the watchers of a dying client, and remove their watches of it. The watchers are
+           signalled by the next client_watch_flush().
+    @param wi The reverse index.
+    @param deathPID The PID of the dying client.
+*/
+void client_watch_notify_death(struct proc_watch_index *wi, uint32_t deathPID);
+
+/*! @brief Signal every watcher with pending death notifications, once each.
+    @param wi The reverse index.
 */
-void client_watch_notify_death_callback(struct proc_pcb *pcb, void *cookie);
+void client_watch_flush(struct proc_watch_index *wi);
 
 #endif /* _REFOS_PROCESS_SERVER_PROCESS_CLIENT_WATCH_H_ */
\ No newline at end of file
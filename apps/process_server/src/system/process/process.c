@@ -19,26 +19,49 @@
 #include <refos/vmlayout.h>
 #include <refos/refos.h>
 #include <refos-rpc/proc_server.h>
+#include <refos-util/init.h>
 #include <sel4utils/process.h>
+#include <sel4utils/helpers.h>
 
 #include "../../state.h"
 #include "pid.h"
 #include "process.h"
 #include "thread.h"
 #include "proc_client_watch.h"
+#include "template.h"
+#include "../memserv/window.h"
 #include <refos/refos.h>
 
 /*! @file
     @brief Process management module for process server. */
 
+/*! @brief First of the cslots a selfloader is given its program's stack and heap caps in, when the
+           process server has loaded the program from a template. The selfloader must have released
+           every cslot it allocated before asking for that. */
+#define PROC_TEMPLATE_CSLOT_START PROCCSPACE_SELFLOADER_CSPACE_START
+
 /* ------------------------------ Proc Helper functions ------------------------------------------*/
 
+/*! @brief Whether a static parameter and its arguments fit in front of the procinfo structure.
+    @param param The static parameter.
+    @param args The arguments, or NULL for none.
+    @return true if both strings and their terminators fit, false otherwise.
+*/
+static bool
+proc_staticparam_fits(char *param, char *args)
+{
+    size_t len = strlen(param) + 1 + (args ? strlen(args) : 0) + 1;
+    return len <= PROCESS_STATICPARAM_STR_SIZE;
+}
+
 static int
-proc_staticparam_create_and_set(struct proc_pcb *p, char *param)
+proc_staticparam_create_and_set(struct proc_pcb *p, char *param, char *args,
+                                sl_procinfo_t *procInfo)
 {
     assert(p && param);
+    assert(proc_staticparam_fits(param, args));
     size_t paramLen = strlen(param);
-    assert(paramLen <= PROCESS_STATICPARAM_SIZE && paramLen <= REFOS_PAGE_SIZE);
+    size_t argsLen = args ? strlen(args) : 0;
     struct vs_vspace *vs = &p->vspace;
     int error = EINVALID;
 
@@ -50,8 +73,16 @@ proc_staticparam_create_and_set(struct proc_pcb *p, char *param)
         return ENOMEM;
     }
 
-    /* Write param data to frame. */
+    /* Write param data to frame, followed by the arguments. The frame starts out zeroed, so both
+       strings are already terminated. */
     error = procserv_frame_write(frame.cptr, param, paramLen, 0);
+    if (!error && argsLen) {
+        error = procserv_frame_write(frame.cptr, args, argsLen, paramLen + 1);
+    }
+    if (!error && procInfo) {
+        error = procserv_frame_write(frame.cptr, (const char*) procInfo, sizeof(sl_procinfo_t),
+                                     PROCESS_STATICPARAM_STR_SIZE);
+    }
     if (error) {
         ROS_ERROR("Could not write to param frame.");
         error = ENOMEM;
@@ -124,12 +155,22 @@ proc_copy_badge(struct proc_pcb *p, seL4_CPtr destCSlot, seL4_CPtr ep, seL4_CapR
 }
 
 static void
-proc_setup_environment(struct proc_pcb *p, char *param)
+proc_delete_cslot(struct proc_pcb *p, seL4_CPtr cslot)
+{
+    cspacepath_t path;
+    path.root = p->vspace.cspace.capPtr;
+    path.capPtr = cslot;
+    path.capDepth = seL4_WordBits;
+    vka_cnode_delete(&path);
+}
+
+static void
+proc_setup_environment(struct proc_pcb *p, char *param, char *args, sl_procinfo_t *procInfo)
 {
     assert(p);
 
     /* Pass the process its static parameter contents. */
-    proc_staticparam_create_and_set(p, param);
+    proc_staticparam_create_and_set(p, param, args, procInfo);
 
     /* Tell the process about ourself, the process server. */
     proc_pass_badge (
@@ -138,6 +179,15 @@ proc_setup_environment(struct proc_pcb *p, char *param)
             seL4_CapData_Badge_new(pid_get_badge(p->pid))
     );
 
+    /* Give the process a fault endpoint for every core its threads may be placed on. */
+    for (uint32_t core = 0; core < PROCSERV_NUM_CORES; core++) {
+        proc_pass_badge (
+                p, PROCCSPACE_FAULT_EP_START + core,
+                worker_fault_endpoint(&procServ.workers, core), seL4_NoRead,
+                seL4_CapData_Badge_new(pid_get_badge(p->pid))
+        );
+    }
+
     /* Tell the process about its own liveness cap. */
     proc_pass_badge (
             p, REFOS_LIVENESS, procServ.endpoint.cptr,
@@ -160,11 +210,152 @@ proc_setup_environment(struct proc_pcb *p, char *param)
             p, REFOS_DEVICE_IO_PORTS, seL4_CapIOPort, seL4_AllRights
         );
     }
-    #else
-    (void) proc_copy_badge;
     #endif
 }
 
+/*! @brief Create a zeroed anonymous region in a process's vspace, and give the process its
+           dataspace and window caps, just as if it had created the region itself.
+    @param p The process. (No ownership)
+    @param vaddr The region's start address.
+    @param size The region's size.
+    @param destCSlot The first of two free cslots in the process's cspace, for the dataspace cap
+                     followed by the window cap.
+    @param region Output region description, in the process's terms.
+    @return ESUCCESS on success, refos_err_t otherwise.
+*/
+static int
+proc_create_anon_region(struct proc_pcb *p, seL4_Word vaddr, seL4_Word size, seL4_CPtr destCSlot,
+                        sl_dataspace_t *region)
+{
+    int error = proc_mem_check_window(p);
+    if (error != ESUCCESS) {
+        return error;
+    }
+
+    int windowID = W_INVALID_WINID;
+    error = vs_create_window(&p->vspace, vaddr, size, W_PERMISSION_WRITE | W_PERMISSION_READ,
+                             true, &windowID);
+    if (error != ESUCCESS || windowID == W_INVALID_WINID) {
+        return error != ESUCCESS ? error : EINVALID;
+    }
+    struct w_window *window = w_get_window(&procServ.windowList, windowID);
+    assert(window && window->magic == W_MAGIC);
+
+    /* The process owns the creation reference, as if it had opened the dataspace itself. */
+    struct ram_dspace *dspace = ram_dspace_create(&procServ.dspaceList, size);
+    if (!dspace) {
+        vs_delete_window(&p->vspace, windowID);
+        return ENOMEM;
+    }
+    dspace->ownerPID = p->pid;
+    w_set_anon_dspace(window, dspace, 0);
+
+    proc_copy_badge(p, destCSlot, dspace->capability.capPtr, seL4_AllRights);
+    proc_copy_badge(p, destCSlot + 1, window->capability.capPtr, seL4_AllRights);
+    region->dataspace = destCSlot;
+    region->window = destCSlot + 1;
+    region->vaddr = (uint32_t) vaddr;
+    region->size = (uint32_t) size;
+    return ESUCCESS;
+}
+
+/*! @brief Tell a selfloader about the process template for its program, if there is one.
+
+    On a template hit, procInfo tells the selfloader that it may ask for its program to be loaded
+    from the template, with proc_load_template(). Otherwise procInfo only tells the selfloader
+    whether to capture a template.
+
+    @param p The selfloader process, not yet started. (No ownership)
+    @param imageName The program's file path.
+    @param procInfo Output procinfo for the selfloader, zeroed by the caller.
+*/
+static void
+proc_template_preload(struct proc_pcb *p, char *imageName, sl_procinfo_t *procInfo)
+{
+    bool capture = false;
+    struct proc_template *t = proc_template_lookup(&procServ.templateList, imageName, p->pid,
+                                                   &capture);
+    p->templateLoader = capture;
+    p->templatePending = (t != NULL);
+    procInfo->templateCapture = capture ? 1 : 0;
+    procInfo->templateReady = t ? 1 : 0;
+}
+
+/*! @brief Write a selfloader's procinfo into its static parameter buffer.
+    @param p The selfloader process. (No ownership)
+    @param procInfo The procinfo to write.
+    @return ESUCCESS on success, refos_err_t otherwise.
+*/
+static int
+proc_staticparam_set_procinfo(struct proc_pcb *p, sl_procinfo_t *procInfo)
+{
+    cspacepath_t frame = vs_get_frame(&p->vspace, PROCESS_STATICPARAM_ADDR);
+    if (!frame.capPtr) {
+        return EINVALID;
+    }
+    return procserv_frame_write(frame.capPtr, (const char*) procInfo, sizeof(sl_procinfo_t),
+                                PROCESS_STATICPARAM_STR_SIZE);
+}
+
+int
+proc_load_template(struct proc_pcb *p, int generation)
+{
+    assert(p && p->magic == REFOS_PCB_MAGIC);
+    if (!p->templatePending) {
+        return EACCESSDENIED;
+    }
+    p->templatePending = false;
+
+    sl_procinfo_t procInfo;
+    memset(&procInfo, 0, sizeof(sl_procinfo_t));
+    bool capture = false;
+    struct proc_template *t = proc_template_validate(&procServ.templateList, p->debugProcessName,
+                                                     p->pid, generation, &capture);
+    if (!t) {
+        /* Stale or evicted. The selfloader loads the program itself, capturing a fresh template
+           if we asked it to. */
+        p->templateLoader = capture;
+        procInfo.templateCapture = capture ? 1 : 0;
+        int error = proc_staticparam_set_procinfo(p, &procInfo);
+        if (error != ESUCCESS && capture) {
+            proc_template_purge_pid(&procServ.templateList, p->pid);
+            p->templateLoader = false;
+        }
+        return EINVALIDPARAM;
+    }
+
+    /* Past this point, a failure may leave part of the template mapped in, and the selfloader
+       won't be able to load the program over it. */
+    int error = proc_template_instantiate(t, p);
+    if (error != ESUCCESS) {
+        ROS_WARNING("Failed to instantiate template for [%s].", p->debugProcessName);
+        return error;
+    }
+    error = proc_create_anon_region(p, PROCESS_STACK_BOT, PROCESS_RLIMIT_STACK,
+                                    PROC_TEMPLATE_CSLOT_START, &procInfo.stackRegion);
+    if (error != ESUCCESS) {
+        return error;
+    }
+    error = proc_create_anon_region(p, REFOS_PAGE_ALIGN(t->endOfProgram + 0x2800),
+                                    PROCESS_HEAP_INITIAL_SIZE, PROC_TEMPLATE_CSLOT_START + 2,
+                                    &procInfo.heapRegion);
+    if (error != ESUCCESS) {
+        return error;
+    }
+
+    procInfo.magic = SELFLOADER_PROCINFO_MAGIC;
+    procInfo.elfSegmentEnd = (uint32_t) t->endOfProgram;
+    procInfo.templateEntry = (uint32_t) t->entryPoint;
+    error = proc_staticparam_set_procinfo(p, &procInfo);
+    if (error != ESUCCESS) {
+        return error;
+    }
+
+    /* The selfloader has nothing left to load, so it needs none of its privileges. */
+    p->segmentLoader = false;
+    return ESUCCESS;
+}
+
 static void
 proc_purge_pid_callback(struct proc_pcb *pcb, void *cookie)
 {
@@ -201,6 +392,18 @@ proc_config_new(struct proc_pcb *p, uint32_t pid, uint8_t priority, char *imageN
     p->paramBuffer = NULL;
     p->notificationBuffer = NULL;
 
+    /* Processes with system capabilities (ie. servers) may use all of their period. */
+    p->sched.periodUS = CONFIG_PROCSERV_SCHED_PERIOD_US;
+    p->sched.budgetUS = systemCapabilitiesMask ? CONFIG_PROCSERV_SCHED_PERIOD_US :
+                        CONFIG_PROCSERV_SCHED_BUDGET_US;
+
+    /* Without budgets, the priority ceiling is what keeps user processes below the servers. */
+    p->sched.maxPriority = systemCapabilitiesMask ? priority : CONFIG_PROCSERV_USER_MAX_PRIO;
+    if (priority > p->sched.maxPriority) {
+        ROS_WARNING("Priority %d is above the ceiling of %s.", priority, imageName);
+        return EINVALIDPARAM;
+    }
+
     /* Allocate a vspace. */
     dvprintf("Initialising vspace for %s...\n", imageName);
     error = vs_initialise(&p->vspace, pid);
@@ -219,11 +422,21 @@ proc_config_new(struct proc_pcb *p, uint32_t pid, uint8_t priority, char *imageN
         goto exit1;
     }
 
+    /* Look up the ELF image in the CPIO archive index. */
+    unsigned long imageSize = 0;
+    void *image = cpio_index_get_file(&procServ.cpioIndex, imageName, &imageSize);
+    elf_t elf;
+    if (image == NULL || elf_newFile(image, imageSize, &elf) != 0) {
+        ROS_ERROR("Failed to find ELF file %s.", imageName);
+        error = EFILENOTFOUND;
+        goto exit2;
+    }
+
     /* Load ELF image from CPIO archive. */
     dvprintf("Loading ELF file %s...\n", imageName);
     void *entryPoint = sel4utils_elf_load (
             &p->vspace.vspace, &procServ.vspace, &procServ.vka,
-            &procServ.vka, imageName
+            &procServ.vka, &elf
     );
     if (entryPoint == NULL) {
         ROS_ERROR("Failed to load ELF file %s.", imageName);
@@ -231,11 +444,12 @@ proc_config_new(struct proc_pcb *p, uint32_t pid, uint8_t priority, char *imageN
         goto exit2;
     }
 
-    uintptr_t sysInfo = sel4utils_elf_get_vsyscall(imageName);
+    uintptr_t sysInfo = sel4utils_elf_get_vsyscall(&elf);
 
     /* Configure initial thread. Note that we do this after loading the ELF into vspace, to
        avoid potentially clobbering the vspace ELF regions. */
-    error = thread_config(thread, priority, (vaddr_t) entryPoint, &p->vspace);
+    error = thread_config(thread, priority, p->sched.maxPriority, p->sched.budgetUS,
+                          p->sched.periodUS, (vaddr_t) entryPoint, &p->vspace);
     if (error) {
         ROS_ERROR("Failed to configure thread for %s.", imageName);
         goto exit2;
@@ -274,6 +488,7 @@ proc_config_new(struct proc_pcb *p, uint32_t pid, uint8_t priority, char *imageN
 
     /* Initialise miscellaneous process state. */
     client_watch_init(&p->clientWatchList);
+    client_watch_index_attach(&procServ.watchIndex, &p->clientWatchList, pid);
     strcpy(p->debugProcessName, imageName);
 
     return ESUCCESS;
@@ -299,10 +514,16 @@ proc_start_thread(struct proc_pcb *p, int tindex, void* arg0, void* arg1)
     return thread_start(t, arg0, arg1);
 }
 
+static struct proc_pcb *proc_mem_get_pcb(uint32_t pid);
+
 int
-proc_load_direct(char *name, int priority, char *param, unsigned int parentPID,
+proc_load_direct(char *name, int priority, char *param, char *args, unsigned int parentPID,
                  uint32_t systemCapabilitiesMask)
 {
+    if (!proc_staticparam_fits(param, args)) {
+        return EINVALIDPARAM;
+    }
+
     /* Allocate a PID. */
     dprintf("Allocating PID and PCB...\n");
     uint32_t npid = pid_alloc(&procServ.PIDList);
@@ -323,15 +544,38 @@ proc_load_direct(char *name, int priority, char *param, unsigned int parentPID,
     }
     pcb->parentPID = parentPID;
 
+    /* Children inherit their parent's memory limits. */
+    struct proc_pcb *parentPCB = proc_mem_get_pcb(parentPID);
+    if (parentPCB) {
+        pcb->mem.maxFrames = parentPCB->mem.maxFrames;
+        pcb->mem.maxWindows = parentPCB->mem.maxWindows;
+        pcb->mem.maxKernelObjects = parentPCB->mem.maxKernelObjects;
+    }
+
+    /* Children without system capabilities inherit their parent's scheduling parameters. */
+    if (parentPCB && !systemCapabilitiesMask &&
+            (parentPCB->sched.budgetUS != pcb->sched.budgetUS ||
+             parentPCB->sched.periodUS != pcb->sched.periodUS)) {
+        error = proc_set_sched_params(pcb, parentPCB->sched.budgetUS, parentPCB->sched.periodUS);
+        if (error != ESUCCESS && error != EUNIMPLEMENTED) {
+            ROS_WARNING("Could not inherit scheduling parameters for PID %d.", npid);
+        }
+    }
+
     /* If we are selfloading this process, then the actual image name is in the param string.
        This is a bit of a hacky way, but the debug name is only used for debugging so its not too
        bad. */
-    if (!strcmp(name, "selfloader")) {
+    sl_procinfo_t procInfo;
+    memset(&procInfo, 0, sizeof(sl_procinfo_t));
+    bool selfload = !strcmp(name, "selfloader");
+    if (selfload) {
         strcpy(pcb->debugProcessName, param);
+        pcb->segmentLoader = true;
+        proc_template_preload(pcb, param, &procInfo);
     }
 
     /* Configure the process' vspace and cspace for the RefOS userland environment. */
-    proc_setup_environment(pcb, param);
+    proc_setup_environment(pcb, param, args, selfload ? &procInfo : NULL);
 
     /* Start the initial thread (thread 0). */
     error = proc_start_thread(pcb, 0, NULL, NULL);
@@ -348,19 +592,16 @@ int
 proc_nice(struct proc_pcb *p, int tindex, int priority)
 {
     assert(cvector_count(&p->threads) >= 1);
-    struct proc_tcb *t = (struct proc_tcb *) cvector_get(&p->threads, tindex);
+    struct proc_tcb *t = proc_get_thread(p, tindex);
     if (!t) {
         ROS_WARNING("proc_nice warning: no such thread %d!", tindex);
         return EINVALIDPARAM;
     }
-    assert(thread_tcb_obj(t));
-    int error = seL4_TCB_SetPriority(thread_tcb_obj(t), priority);
-    if (error) {
-        ROS_ERROR("proc_nice failed to set TCB priority.");
-        return EINVALID;
+    if (priority < 0 || priority > p->sched.maxPriority) {
+        return EINVALIDPARAM;
     }
-    t->priority = priority;
-    return ESUCCESS;
+    assert(thread_tcb_obj(t));
+    return thread_set_priority(t, priority, p->sched.maxPriority);
 }
 
 static void proc_parent_reply(struct proc_pcb *p);
@@ -371,8 +612,12 @@ proc_release(struct proc_pcb *p)
     assert(p && p->magic == REFOS_PCB_MAGIC);
     memset(&p->rpcClient, 0, sizeof(rpc_client_state_t));
 
-    /* For anybody that's watching us, they've got to be notified, and then unwatched. */
-    pid_iterate(&procServ.PIDList, client_watch_notify_death_callback, (void*) p->pid);
+    /* For anybody that's watching us, they've got to be notified, and then unwatched. Only the
+       processes in our reverse index entry are visited; they're signalled after we're gone. */
+    client_watch_notify_death(&procServ.watchIndex, p->pid);
+
+    /* And we stop watching everybody else. */
+    client_watch_release(&p->clientWatchList);
 
     /* For any children PID under us, they are now orphaned. */
     dvprintf("    orphaning children...\n");
@@ -384,6 +629,11 @@ proc_release(struct proc_pcb *p)
         proc_parent_reply(p);
     }
 
+    /* Abandon any process template this selfloader was capturing. */
+    proc_template_purge_pid(&procServ.templateList, p->pid);
+    proc_segment_purge_pid(&procServ.segmentList, p->pid);
+    proc_profile_purge_pid(&procServ.profileList, p->pid);
+
     /* Unreference the parameter buffer. */
     dvprintf("    unreffing parameter buffer...\n");
     if (p->paramBuffer) {
@@ -416,12 +666,19 @@ proc_release(struct proc_pcb *p)
     for (int i = 0; i < nthreads; i++) {
         dvprintf("       Cleaning up thread %d...\n", i);
         struct proc_tcb *thread = (struct proc_tcb *) cvector_get(&p->threads, i);
-        assert(thread && thread->magic == REFOS_PROCESS_THREAD_MAGIC);
+        if (!thread) {
+            /* Already exited. */
+            continue;
+        }
+        assert(thread->magic == REFOS_PROCESS_THREAD_MAGIC);
         thread_release(thread);
         kfree(thread);
     }
     cvector_free(&p->threads);
 
+    /* Any dataspaces this process opened which outlive it are no longer charged to anyone. */
+    ram_dspace_disown(&procServ.dspaceList, p->pid);
+
     dvprintf("    process released OK.\n");
     p->magic = 0;
     p->pid = 0;
@@ -507,15 +764,33 @@ struct proc_tcb *
 proc_get_thread(struct proc_pcb *p, int tindex)
 {
     assert(p && p->magic == REFOS_PCB_MAGIC);
-    if (tindex >= cvector_count(&p->threads)) {
+    if (tindex < 0 || tindex >= cvector_count(&p->threads)) {
         return NULL;
     }
     struct proc_tcb *t = (struct proc_tcb *) cvector_get(&p->threads, tindex);
-    assert(t && t->magic == REFOS_PROCESS_THREAD_MAGIC);
+    if (!t) {
+        /* The thread has exited, and its ID has not been given out again yet. */
+        return NULL;
+    }
+    assert(t->magic == REFOS_PROCESS_THREAD_MAGIC);
     assert(t->entryPoint);
     return t;
 }
 
+int
+proc_num_threads(struct proc_pcb *p)
+{
+    assert(p && p->magic == REFOS_PCB_MAGIC);
+    int nthreads = 0;
+    int nslots = cvector_count(&p->threads);
+    for (int i = 0; i < nslots; i++) {
+        if (cvector_get(&p->threads, i)) {
+            nthreads++;
+        }
+    }
+    return nthreads;
+}
+
 int
 proc_save_caller(struct proc_pcb *p)
 {
@@ -547,7 +822,8 @@ proc_save_caller(struct proc_pcb *p)
 }
 
 int
-proc_clone(struct proc_pcb *p, int *threadID, vaddr_t stackAddr, vaddr_t entryPoint)
+proc_clone(struct proc_pcb *p, int *threadID, vaddr_t stackAddr, vaddr_t entryPoint,
+           seL4_Word arg, seL4_Word tlsBase)
 {
     assert(p && p->magic == REFOS_PCB_MAGIC);
     if (threadID) {
@@ -566,6 +842,25 @@ proc_clone(struct proc_pcb *p, int *threadID, vaddr_t stackAddr, vaddr_t entryPo
         return EINVALID;
     }
 
+    /* A new thread needs at least a TCB, an IPC buffer frame and a notification, plus its
+       scheduling objects. */
+    int error = proc_mem_check_kernel_objects(p, 3 + THREAD_SCHED_KERNEL_OBJECTS);
+    if (error) {
+        return error;
+    }
+
+    /* Reuse the ID of a thread which has exited, if there is one. */
+    int tID = cvector_count(&p->threads);
+    for (int i = 1; i < cvector_count(&p->threads); i++) {
+        if (!cvector_get(&p->threads, i)) {
+            tID = i;
+            break;
+        }
+    }
+    if (tID >= PROCESS_MAX_THREADS) {
+        return ENOMEM;
+    }
+
     /* Create the TCB struct for the clone thread. */
     dvprintf("Allocating thread structure...\n");
     struct proc_tcb *thread = kmalloc(sizeof(struct proc_tcb));
@@ -575,7 +870,8 @@ proc_clone(struct proc_pcb *p, int *threadID, vaddr_t stackAddr, vaddr_t entryPo
     }
 
     /* Configure new thread, sharing the process's address space */
-    int error = thread_config(thread, t->priority, (vaddr_t) entryPoint, &p->vspace);
+    error = thread_config(thread, t->priority, p->sched.maxPriority, p->sched.budgetUS,
+                          p->sched.periodUS, (vaddr_t) entryPoint, &p->vspace);
     if (error) {
         ROS_ERROR("Failed to configure thread for new thread.");
         goto exit1;
@@ -607,27 +903,66 @@ proc_clone(struct proc_pcb *p, int *threadID, vaddr_t stackAddr, vaddr_t entryPo
 
     thread->sel4utilsThread = n_process.thread;
 
+    /* Give the thread its notification, which it blocks on in futex waits. */
+    error = vka_alloc_notification(&procServ.vka, &thread->notification);
+    if (error || !thread->notification.cptr) {
+        ROS_ERROR("Failed to allocate notification for new thread.");
+        error = ENOMEM;
+        goto exit2;
+    }
+    proc_copy_badge(p, PROCCSPACE_THREAD_NOTIFY_START + tID, thread->notification.cptr,
+                    seL4_AllRights);
+
+    /* Move the thread onto the stack it was given, passing it its argument, IPC buffer and ID. */
+    seL4_UserContext context = {0};
+    error = sel4utils_arch_init_context_with_args (
+            (sel4utils_thread_entry_fn) entryPoint, (void*) arg,
+            (void*) thread->sel4utilsThread.ipc_buffer_addr, (void*) tID, false,
+            (void*) stackAddr, &context, &procServ.vka, &procServ.vspace, &p->vspace.vspace
+    );
+    if (!error) {
+        error = seL4_TCB_WriteRegisters(thread_tcb_obj(thread), false, 0,
+                                        sizeof(seL4_UserContext) / sizeof(seL4_Word), &context);
+    }
+    if (!error && tlsBase) {
+        error = seL4_TCB_SetTLSBase(thread_tcb_obj(thread), tlsBase);
+    }
+    if (error) {
+        ROS_ERROR("Failed to set up context for new thread.");
+        error = EINVALID;
+        goto exit2;
+    }
+
     /* Add thread to list. */
     dvprintf("Adding to threads list...\n");
-    int tID = cvector_count(&p->threads);
     if (threadID) {
         (*threadID) = tID;
     }
-    cvector_add(&p->threads, (cvector_item_t) thread);
+    if (tID == cvector_count(&p->threads)) {
+        cvector_add(&p->threads, (cvector_item_t) thread);
+    } else {
+        cvector_set(&p->threads, tID, (cvector_item_t) thread);
+    }
     assert(cvector_count(&p->threads) >= 1);
 
     /* Start the new child thread. */
     error = proc_start_thread(p, tID, NULL, NULL);
     if (error) {
         ROS_ERROR("Could not start child thread %d!", tID);
-        goto exit2;
+        goto exit3;
     }
 
     return ESUCCESS;
 
     /* Exit stack. */
+exit3:
+    if (tID == cvector_count(&p->threads) - 1) {
+        cvector_delete(&p->threads, tID);
+    } else {
+        cvector_set(&p->threads, tID, NULL);
+    }
 exit2:
-    cvector_delete(&p->threads, tID);
+    proc_delete_cslot(p, PROCCSPACE_THREAD_NOTIFY_START + tID);
     thread_release(thread);
 exit1:
     kfree(thread);
@@ -635,6 +970,41 @@ exit1:
     return error;
 }
 
+int
+proc_thread_exit(struct proc_pcb *p, int tindex, vaddr_t clearTID)
+{
+    assert(p && p->magic == REFOS_PCB_MAGIC);
+
+    /* The main thread only goes away along with the whole process. */
+    if (tindex <= 0 || (clearTID % sizeof(int)) != 0) {
+        return EINVALIDPARAM;
+    }
+    struct proc_tcb *t = proc_get_thread(p, tindex);
+    if (!t) {
+        return EINVALIDPARAM;
+    }
+
+    /* Empty the thread's cslots, ready for the next thread to be given this ID. */
+    dvprintf("Releasing PID %d thread %d...\n", p->pid, tindex);
+    proc_delete_cslot(p, PROCCSPACE_THREAD_NOTIFY_START + tindex);
+    proc_delete_cslot(p, PROCCSPACE_THREAD_RECV_START + tindex);
+    thread_release(t);
+    kfree(t);
+    cvector_set(&p->threads, tindex, NULL);
+
+    /* Only now that the thread can no longer run may the process free its stack and TLS, so we
+       clear its TID word for it, rather than the thread clearing it on its way out. */
+    if (clearTID) {
+        cspacepath_t frame = vs_get_frame(&p->vspace, clearTID);
+        int zero = 0;
+        if (!frame.capPtr || procserv_frame_write(frame.capPtr, (const char*) &zero, sizeof(int),
+                                                  clearTID % REFOS_PAGE_SIZE) != ESUCCESS) {
+            ROS_WARNING("Could not clear TID of PID %d thread %d.", p->pid, tindex);
+        }
+    }
+    return ESUCCESS;
+}
+
 extern seL4_MessageInfo_t _dispatcherEmptyReply;
 
 void
@@ -679,6 +1049,175 @@ proc_parent_reply(struct proc_pcb *p)
     parentPCB->faultReply.capPtr = 0;
 }
 
+/* ------------------------------- Memory accounting functions ---------------------------------- */
+
+/*! @brief Get a live PCB from a PID, or NULL if there is no such process. */
+static struct proc_pcb *
+proc_mem_get_pcb(uint32_t pid)
+{
+    if (pid == PID_NULL) {
+        return NULL;
+    }
+    struct proc_pcb *p = pid_get_pcb(&procServ.PIDList, pid);
+    if (!p || p->magic != REFOS_PCB_MAGIC) {
+        return NULL;
+    }
+    return p;
+}
+
+/*! @brief Count the kernel objects held on behalf of a process: its page directory and CNode,
+           every object tracked by its vspace (page tables, stack & IPC buffer frames, endpoints),
+           and a TCB for each thread, with its scheduling context and reply on MCS kernels, and
+           its notification if it was cloned. */
+static uint32_t
+proc_mem_count_kernel_objects(struct proc_pcb *p)
+{
+    assert(p && p->magic == REFOS_PCB_MAGIC);
+    uint32_t n = 2 + cvector_count(&p->vspace.kobjVSpaceAllocatedFreelist);
+    int nslots = cvector_count(&p->threads);
+    for (int i = 0; i < nslots; i++) {
+        struct proc_tcb *t = proc_get_thread(p, i);
+        if (t) {
+            n += 1 + THREAD_SCHED_KERNEL_OBJECTS + (t->notification.cptr ? 1 : 0);
+        }
+    }
+    return n;
+}
+
+int
+proc_mem_charge_frame(uint32_t pid)
+{
+    struct proc_pcb *p = proc_mem_get_pcb(pid);
+    if (!p) {
+        return ESUCCESS;
+    }
+    /* Faults on dataspaces shared between clients may charge the same owner in parallel. */
+    uint32_t frames;
+    do {
+        frames = p->mem.residentFrames;
+        if (p->mem.maxFrames && frames >= p->mem.maxFrames) {
+            dprintf("PID %d [%s] hit its resident frame limit of %u.\n", p->pid,
+                    p->debugProcessName, p->mem.maxFrames);
+            return ENOMEM;
+        }
+    } while (!__sync_bool_compare_and_swap(&p->mem.residentFrames, frames, frames + 1));
+    return ESUCCESS;
+}
+
+void
+proc_mem_uncharge_frame(uint32_t pid)
+{
+    struct proc_pcb *p = proc_mem_get_pcb(pid);
+    if (!p) {
+        return;
+    }
+    assert(p->mem.residentFrames > 0);
+    __sync_fetch_and_sub(&p->mem.residentFrames, 1);
+}
+
+int
+proc_mem_check_kernel_objects(struct proc_pcb *p, uint32_t n)
+{
+    assert(p && p->magic == REFOS_PCB_MAGIC);
+    if (p->mem.maxKernelObjects &&
+            proc_mem_count_kernel_objects(p) + n > p->mem.maxKernelObjects) {
+        dprintf("PID %d [%s] hit its kernel object limit of %u.\n", p->pid,
+                p->debugProcessName, p->mem.maxKernelObjects);
+        return ENOMEM;
+    }
+    return ESUCCESS;
+}
+
+int
+proc_mem_check_window(struct proc_pcb *p)
+{
+    assert(p && p->magic == REFOS_PCB_MAGIC);
+    if (p->mem.maxWindows && p->vspace.windows.numIndex >= p->mem.maxWindows) {
+        dprintf("PID %d [%s] hit its window limit of %u.\n", p->pid,
+                p->debugProcessName, p->mem.maxWindows);
+        return ENOMEM;
+    }
+    return ESUCCESS;
+}
+
+void
+proc_get_mem_stats(struct proc_pcb *p, refos_mem_stats_t *stats)
+{
+    assert(p && p->magic == REFOS_PCB_MAGIC && stats);
+    memset(stats, 0, sizeof(refos_mem_stats_t));
+    stats->pid = p->pid;
+    stats->parentPID = p->parentPID;
+    stats->residentFrames = p->mem.residentFrames;
+    stats->windows = p->vspace.windows.numIndex;
+    stats->kernelObjects = proc_mem_count_kernel_objects(p);
+    stats->threads = proc_num_threads(p);
+    stats->maxFrames = p->mem.maxFrames;
+    stats->maxWindows = p->mem.maxWindows;
+    stats->maxKernelObjects = p->mem.maxKernelObjects;
+    strncpy(stats->name, p->debugProcessName, REFOS_MEM_STATS_NAME_LEN - 1);
+
+    /* Count windows with something behind them. */
+    for (int i = 0; i < p->vspace.windows.numIndex; i++) {
+        struct w_window *window = w_get_window(&procServ.windowList,
+                                               p->vspace.windows.associated[i].winID);
+        if (window && window->mode != W_MODE_EMPTY) {
+            stats->mappedWindows++;
+        }
+    }
+}
+
+/* ---------------------------------- CPU time functions ---------------------------------------- */
+
+int
+proc_set_sched_params(struct proc_pcb *p, uint32_t budgetUS, uint32_t periodUS)
+{
+    assert(p && p->magic == REFOS_PCB_MAGIC);
+    if (!budgetUS || budgetUS > periodUS) {
+        return EINVALIDPARAM;
+    }
+    int nthreads = cvector_count(&p->threads);
+    for (int i = 0; i < nthreads; i++) {
+        struct proc_tcb *t = proc_get_thread(p, i);
+        if (!t) {
+            continue;
+        }
+        int error = thread_set_sched_params(t, budgetUS, periodUS);
+        if (error != ESUCCESS) {
+            return error;
+        }
+    }
+    p->sched.budgetUS = budgetUS;
+    p->sched.periodUS = periodUS;
+    return ESUCCESS;
+}
+
+int
+proc_get_cpu_stats(struct proc_pcb *p, int tindex, refos_cpu_stats_t *stats)
+{
+    assert(p && p->magic == REFOS_PCB_MAGIC && stats);
+    memset(stats, 0, sizeof(refos_cpu_stats_t));
+    int nthreads = cvector_count(&p->threads);
+    if (tindex >= nthreads || !proc_get_thread(p, tindex)) {
+        return EINVALIDPARAM;
+    }
+    stats->pid = p->pid;
+    stats->threads = proc_num_threads(p);
+    stats->budgetUS = p->sched.budgetUS;
+    stats->periodUS = p->sched.periodUS;
+    for (int i = 0; i < nthreads; i++) {
+        struct proc_tcb *t = proc_get_thread(p, i);
+        if (!t) {
+            continue;
+        }
+        uint64_t timeUS = thread_cpu_time(t);
+        stats->processTimeUS += timeUS;
+        if (i == tindex) {
+            stats->threadTimeUS = timeUS;
+        }
+    }
+    return ESUCCESS;
+}
+
 void
 proc_syscall_postaction(void)
 {
@@ -701,6 +1240,9 @@ proc_syscall_postaction(void)
         pid_free(&procServ.PIDList, pid);
         dvprintf("    Process exit OK!\n");
 
+        /* Signal everyone who was told of the death, once each. */
+        client_watch_flush(&procServ.watchIndex);
+
         procServ.exitProcessPID = PID_NULL;
     }
 }
@@ -43,6 +43,35 @@
 #define PROCESS_PERMISSION_DEVICE_IRQ 0x0002
 #define PROCESS_PERMISSION_DEVICE_IOPORT 0x0004
 
+/*! @brief Per-process memory accounting state. Windows and kernel objects are counted from the
+           process' vspace when queried; only resident frames need a running count. Limits of 0
+           mean unlimited. */
+struct proc_mem_account {
+    uint32_t residentFrames;
+    uint32_t maxFrames;
+    uint32_t maxWindows;
+    uint32_t maxKernelObjects;
+};
+
+/*! @brief Scheduling parameters of a process' threads. The budget and period only take effect on
+           MCS kernels, where each thread has its own scheduling context. The priority ceiling is
+           held to on every kernel. */
+struct proc_sched_params {
+    uint32_t budgetUS;
+    uint32_t periodUS;
+    uint8_t maxPriority; /* Highest priority of any thread, and their kernel MCP. */
+};
+
+/*! @brief CPU utilisation of a process over the latest sampling interval. Only meaningful if
+           sequence matches the current sample; see cpu_usage.h. */
+struct proc_cpu_usage {
+    uint32_t sequence;
+    uint64_t cycles;
+    uint64_t schedules;
+    uint32_t busiestThread;
+    uint64_t busiestThreadCycles;
+};
+
 /*! @brief Process control block structure.
 
     It stores process related information. It is able to own up to PROCESS_MAX_THREADS threads
@@ -68,6 +97,13 @@ struct proc_pcb {
 
     uint32_t parentPID; /* No ownership. */
     bool parentWaiting;
+
+    struct proc_mem_account mem;
+    struct proc_sched_params sched;
+    struct proc_cpu_usage usage;
+    bool templateLoader; /*!< This is a selfloader, allowed to use process templates. */
+    bool templatePending; /*!< This is a selfloader, which may load its program from a template. */
+    bool segmentLoader; /*!< This is a selfloader, allowed to use shared ELF segments. */
 };
 
 /* ---------------------------------- Proc interface functions ---------------------------------- */
@@ -80,11 +116,14 @@ struct proc_pcb {
 
     @param p The process to configure (No ownership).
     @param pid The allocated PID of the process.
-    @param priority The priority that the process runs at.
+    @param priority The priority that the process runs at. This is also the priority ceiling of a
+                    process with system capabilities; other processes may not run above
+                    CONFIG_PROCSERV_USER_MAX_PRIO.
     @param imageName The ELF file name, in the process server's CPIO archive.
     @param systemCapabilitiesMask The system capabilities mask, which allows access to additional
                                   syscalls.
-    @return ESUCCESS on success, refos_err_t otherwise.
+    @return ESUCCESS on success, EINVALIDPARAM if the priority is above the process' ceiling,
+            refos_err_t otherwise.
 */
 int proc_config_new(struct proc_pcb *p, uint32_t pid, uint8_t priority, char *imageName,
                     uint32_t systemCapabilitiesMask);
@@ -106,12 +145,14 @@ int proc_start_thread(struct proc_pcb *p, int tindex, void* arg0, void* arg1);
     @param name The ELF file name, in the process server's CPIO archive.
     @param priority The priority of the initial thread of the process to load.
     @param param The static parameter to give to the process.
+    @param args The arguments to store after the static parameter, or NULL for none. The
+                selfloader passes them on to the program it loads in argv.
     @param parentPID The PId of the parent that has started this process.
     @param systemCapabilitiesMask The system capabilities mask, which allows access to additional
                                   syscalls.
     @return ESUCCESS on success, refos_err_t otherwise.
 */
-int proc_load_direct(char *name, int priority, char *param, unsigned int parentPID,
+int proc_load_direct(char *name, int priority, char *param, char *args, unsigned int parentPID,
                      uint32_t systemCapabilitiesMask);
 
 /*! @brief Release a process, and delete all its owned resources.
@@ -141,8 +182,9 @@ void proc_queue_release(struct proc_pcb *p);
 /*! @brief Change the priority for a given process' thread.
     @param p The process to change priority for.
     @param tindex The thread index to change priority for.
-    @param priority The new priority to change to.
-    @return ESUCCESS on success, refos_err_t otherwise.
+    @param priority The new priority to change to. May not be above the process' priority ceiling.
+    @return ESUCCESS on success, EINVALIDPARAM if no such thread or the priority is out of range,
+            refos_err_t otherwise.
 */
 int proc_nice(struct proc_pcb *p, int tindex, int priority);
 
@@ -174,10 +216,18 @@ void proc_dspace_delete_callback(struct proc_pcb *p, void *cookie);
 /*! @brief Get the thread TCB of process at the given threadID.
     @param p The process to get TCB from.
     @param tindex The thread index to of the thread TCB to get.
-    @returns TCB at the given threadID of the given process. (No ownership transfer)
+    @returns TCB at the given threadID of the given process, or NULL if there is no such thread
+             (No ownership transfer). Threads which have exited leave a gap, until their ID is
+             given to a new thread.
 */
 struct proc_tcb *proc_get_thread(struct proc_pcb *p, int tindex);
 
+/*! @brief Count the threads of a process which have not exited.
+    @param p The process.
+    @return The number of live threads.
+*/
+int proc_num_threads(struct proc_pcb *p);
+
 /*! @brief Save the current caller's reply cap. This should only be called when the current
            reply cap is for a message fro mthe given process.
     @param p The process to save current caller cap into.
@@ -189,16 +239,98 @@ int proc_save_caller(struct proc_pcb *p);
     @param p The process to clone another thread for.
     @param threadID Optional output pointer to store the created threadID in.
     @param stackAddr The stack address of the new thread, in the given process' vspace.
-    @param entryPoint The entry point of the new thread, in the given process' vspace.
+    @param entryPoint The entry point of the new thread, in the given process' vspace. It is called
+                      with the given argument, the thread's IPC buffer address and its thread ID.
+    @param arg The first argument to pass to the entry point.
+    @param tlsBase The TLS base of the new thread, or 0 to leave it unset.
     @return ESUCCESS on success, refos_err_t otherwise.
 */
-int proc_clone(struct proc_pcb *p, int *threadID, vaddr_t stackAddr, vaddr_t entryPoint);
+int proc_clone(struct proc_pcb *p, int *threadID, vaddr_t stackAddr, vaddr_t entryPoint,
+               seL4_Word arg, seL4_Word tlsBase);
+
+/*! @brief Release a thread created by proc_clone(), and free its ID for reuse.
+
+    The thread's TCB, IPC buffer and notification are released, and its cslots in the process'
+    cspace are emptied. Once the thread is gone, its TID word is cleared, so that the process
+    knows it may free the thread's stack.
+
+    @param p The process the thread belongs to.
+    @param tindex The ID of the thread to release. The main thread may not be released.
+    @param clearTID The vaddr of the thread's TID word in the process' vspace, or 0 for none.
+    @return ESUCCESS on success, refos_err_t otherwise.
+*/
+int proc_thread_exit(struct proc_pcb *p, int tindex, vaddr_t clearTID);
+
+/*! @brief Load a selfloader's program from its process template, if the template was captured
+           from the file as it is now.
+
+    Only a selfloader which was told at spawn that a template exists may ask, and only once. On
+    success, the program's segments, stack and heap are set up, and the selfloader's procinfo is
+    filled in for it to jump in. If the template is stale or gone, the selfloader's procinfo only
+    tells it whether to capture a new one.
+
+    @param p The selfloader process. (No ownership)
+    @param generation The current content generation of the program's file.
+    @return ESUCCESS if the program was loaded, refos_err_t otherwise.
+*/
+int proc_load_template(struct proc_pcb *p, int generation);
 
 /*! @brief Reply to the saved cap previous saved by proc_save_caller().
     @param p The process to reply to.
 */
 void proc_fault_reply(struct proc_pcb *p);
 
+/* ------------------------------- Memory accounting functions ---------------------------------- */
+
+/*! @brief Charge a newly allocated anonymous frame to a process.
+    @param pid The PID of the process to charge. PID_NULL or a dead PID charges nobody.
+    @return ESUCCESS if charged, ENOMEM if the process is at its resident frame limit.
+*/
+int proc_mem_charge_frame(uint32_t pid);
+
+/*! @brief Return a frame previously charged with proc_mem_charge_frame().
+    @param pid The PID of the process which was charged.
+*/
+void proc_mem_uncharge_frame(uint32_t pid);
+
+/*! @brief Check whether a process may allocate more kernel objects.
+    @param p The process.
+    @param n The number of kernel objects about to be allocated on its behalf.
+    @return ESUCCESS if allowed, ENOMEM if it would exceed the process' kernel object limit.
+*/
+int proc_mem_check_kernel_objects(struct proc_pcb *p, uint32_t n);
+
+/*! @brief Check whether a process may create another memory window.
+    @param p The process.
+    @return ESUCCESS if allowed, ENOMEM if it is at its window limit.
+*/
+int proc_mem_check_window(struct proc_pcb *p);
+
+/*! @brief Fill in the memory usage statistics of a process.
+    @param p The process.
+    @param stats Output statistics structure.
+*/
+void proc_get_mem_stats(struct proc_pcb *p, refos_mem_stats_t *stats);
+
+/* ---------------------------------- CPU time functions ---------------------------------------- */
+
+/*! @brief Set the scheduling context budget and period of every thread of a process, including
+           threads it creates later.
+    @param p The process.
+    @param budgetUS The new budget in microseconds. Must be no larger than the period.
+    @param periodUS The new period in microseconds.
+    @return ESUCCESS on success, EUNIMPLEMENTED on non-MCS kernels, refos_err_t otherwise.
+*/
+int proc_set_sched_params(struct proc_pcb *p, uint32_t budgetUS, uint32_t periodUS);
+
+/*! @brief Fill in the CPU time statistics of a process.
+    @param p The process.
+    @param tindex The thread to also report the CPU time of, or -1 for none.
+    @param stats Output statistics structure.
+    @return ESUCCESS on success, EINVALIDPARAM if there is no such thread.
+*/
+int proc_get_cpu_stats(struct proc_pcb *p, int tindex, refos_cpu_stats_t *stats);
+
 /*! @brief Perform any process book-kepping postactions.
     
     This is used to neatly release an exiting process, without leaving an inconsistent IPC state.
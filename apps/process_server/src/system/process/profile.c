@@ -0,0 +1,260 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+#include <string.h>
+#include <sel4/sel4.h>
+#include <sel4utils/util.h>
+#ifdef CONFIG_BENCHMARK_TRACK_UTILISATION
+#include <sel4/benchmark_utilisation_types.h>
+#endif
+#include "profile.h"
+#include "pid.h"
+#include "process.h"
+#include "thread.h"
+#include "../../state.h"
+
+/*! @file
+    @brief Statistical sampling profiler for user processes. */
+
+/*! @brief New program counters are dropped once this many buckets are used, to keep probe
+           sequences short. */
+#define PROC_PROFILE_MAX_LOAD ((PROC_PROFILE_BUCKETS * 3) / 4)
+
+void
+proc_profile_init(struct proc_profile_list *pl)
+{
+    assert(pl);
+    memset(pl, 0, sizeof(struct proc_profile_list));
+}
+
+/*! @brief Find the profile of the given process, if it has one. */
+static struct proc_profile *
+proc_profile_find(struct proc_profile_list *pl, uint32_t pid)
+{
+    for (int i = 0; i < PROC_PROFILE_MAX_ENTRIES; i++) {
+        if (pl->entry[i].magic == PROC_PROFILE_MAGIC && pl->entry[i].pid == pid) {
+            return &pl->entry[i];
+        }
+    }
+    return NULL;
+}
+
+int
+proc_profile_start(struct proc_profile_list *pl, uint32_t pid, uint32_t ownerPID)
+{
+    assert(pl);
+    if (!PROC_PROFILE_ENABLED) {
+        return EUNIMPLEMENTED;
+    }
+
+    /* Reuse the process' own profile, then an empty slot, then the least recently used stopped
+       profile. */
+    struct proc_profile *prof = proc_profile_find(pl, pid);
+    for (int i = 0; !prof && i < PROC_PROFILE_MAX_ENTRIES; i++) {
+        if (pl->entry[i].magic != PROC_PROFILE_MAGIC) {
+            prof = &pl->entry[i];
+        }
+    }
+    if (!prof) {
+        for (int i = 0; i < PROC_PROFILE_MAX_ENTRIES; i++) {
+            struct proc_profile *e = &pl->entry[i];
+            if (!e->active && (!prof || e->lastUsed < prof->lastUsed)) {
+                prof = e;
+            }
+        }
+    }
+    if (!prof) {
+        return ENOMEM;
+    }
+
+    if (!prof->bucket) {
+        prof->bucket = kmalloc(sizeof(struct proc_profile_bucket) * PROC_PROFILE_BUCKETS);
+        if (!prof->bucket) {
+            return ENOMEM;
+        }
+    }
+    memset(prof->bucket, 0, sizeof(struct proc_profile_bucket) * PROC_PROFILE_BUCKETS);
+    if (!prof->active) {
+        pl->numActive++;
+    }
+    prof->magic = PROC_PROFILE_MAGIC;
+    prof->pid = pid;
+    prof->ownerPID = ownerPID;
+    prof->active = true;
+    prof->lastUsed = pl->clock++;
+    prof->samples = 0;
+    prof->dropped = 0;
+    prof->entries = 0;
+    return ESUCCESS;
+}
+
+int
+proc_profile_stop(struct proc_profile_list *pl, uint32_t pid)
+{
+    assert(pl);
+    if (!PROC_PROFILE_ENABLED) {
+        return EUNIMPLEMENTED;
+    }
+    struct proc_profile *prof = proc_profile_find(pl, pid);
+    if (!prof || !prof->active) {
+        return EINVALIDPARAM;
+    }
+    prof->active = false;
+    prof->lastUsed = pl->clock++;
+    assert(pl->numActive > 0);
+    pl->numActive--;
+    return ESUCCESS;
+}
+
+uint32_t
+proc_profile_owner(struct proc_profile_list *pl, uint32_t pid)
+{
+    assert(pl);
+    struct proc_profile *prof = proc_profile_find(pl, pid);
+    return prof ? prof->ownerPID : 0;
+}
+
+int
+proc_profile_read(struct proc_profile_list *pl, uint32_t pid, uint32_t start,
+                  refos_profile_chunk_t *chunk)
+{
+    assert(pl && chunk);
+    if (!PROC_PROFILE_ENABLED) {
+        return EUNIMPLEMENTED;
+    }
+    struct proc_profile *prof = proc_profile_find(pl, pid);
+    if (!prof) {
+        return EINVALIDPARAM;
+    }
+    memset(chunk, 0, sizeof(refos_profile_chunk_t));
+    chunk->pid = prof->pid;
+    chunk->active = prof->active;
+    chunk->samples = prof->samples;
+    chunk->dropped = prof->dropped;
+    chunk->entries = prof->entries;
+
+    uint32_t i;
+    for (i = start; i < PROC_PROFILE_BUCKETS && chunk->count < REFOS_PROFILE_CHUNK_ENTRIES; i++) {
+        if (prof->bucket[i].hits) {
+            chunk->pc[chunk->count] = prof->bucket[i].pc;
+            chunk->hits[chunk->count] = prof->bucket[i].hits;
+            chunk->count++;
+        }
+    }
+    chunk->next = (i < PROC_PROFILE_BUCKETS) ? i : 0;
+    return ESUCCESS;
+}
+
+/*! @brief Count a sample at the given program counter. */
+static void
+proc_profile_record(struct proc_profile *prof, seL4_Word pc)
+{
+    prof->samples++;
+    uint32_t i = (uint32_t) (((pc >> 1) * 2654435761u) % PROC_PROFILE_BUCKETS);
+    for (uint32_t probe = 0; probe < PROC_PROFILE_BUCKETS; probe++) {
+        struct proc_profile_bucket *b = &prof->bucket[i];
+        if (b->hits && b->pc == pc) {
+            b->hits++;
+            return;
+        }
+        if (!b->hits) {
+            if (prof->entries >= PROC_PROFILE_MAX_LOAD) {
+                break;
+            }
+            b->pc = pc;
+            b->hits = 1;
+            prof->entries++;
+            return;
+        }
+        i = (i + 1) % PROC_PROFILE_BUCKETS;
+    }
+    prof->dropped++;
+}
+
+/*! @brief Returns whether a thread has used any CPU since the profiler last looked at it. Never
+           true where the kernel doesn't tell us, though the profiler isn't enabled there. */
+static bool
+proc_profile_thread_ran(struct proc_tcb *t)
+{
+#if defined(CONFIG_BENCHMARK_TRACK_UTILISATION)
+    seL4_BenchmarkGetThreadUtilisation(thread_tcb_obj(t));
+    uint64_t time = ((uint64_t*) &seL4_GetIPCBuffer()->msg[0])[BENCHMARK_TCB_UTILISATION];
+#elif defined(CONFIG_KERNEL_MCS)
+    uint64_t time = thread_cpu_time(t);
+#else
+    (void) t;
+    return false;
+#endif
+#if defined(CONFIG_BENCHMARK_TRACK_UTILISATION) || defined(CONFIG_KERNEL_MCS)
+    /* The utilisation tracker's counters are cleared by CPU usage samples, so look for any
+       change rather than an increase. */
+    bool ran = (time != t->profileTime);
+    t->profileTime = time;
+    return ran;
+#endif
+}
+
+/*! @brief Sample every thread of a profiled process. */
+static void
+proc_profile_sample(struct proc_profile *prof, struct proc_pcb *p)
+{
+    int nthreads = cvector_count(&p->threads);
+    for (int i = 0; i < nthreads; i++) {
+        struct proc_tcb *t = proc_get_thread(p, i);
+        if (!t || !proc_profile_thread_ran(t)) {
+            continue;
+        }
+        seL4_UserContext context;
+        int error = seL4_TCB_ReadRegisters(thread_tcb_obj(t), false, 0,
+                                           sizeof(seL4_UserContext) / sizeof(seL4_Word),
+                                           &context);
+        if (error != seL4_NoError) {
+            continue;
+        }
+        seL4_Word pc = sel4utils_get_instruction_pointer(context);
+        if (pc) {
+            proc_profile_record(prof, pc);
+        }
+    }
+}
+
+int
+proc_profile_tick(struct proc_profile_list *pl)
+{
+    assert(pl);
+    if (!pl->numActive) {
+        return 0;
+    }
+    pl->numTicks++;
+    for (int i = 0; i < PROC_PROFILE_MAX_ENTRIES; i++) {
+        struct proc_profile *prof = &pl->entry[i];
+        if (prof->magic != PROC_PROFILE_MAGIC || !prof->active) {
+            continue;
+        }
+        struct proc_pcb *p = pid_get_pcb(&procServ.PIDList, prof->pid);
+        if (!p || p->magic != REFOS_PCB_MAGIC) {
+            continue;
+        }
+        proc_profile_sample(prof, p);
+    }
+    return pl->numActive;
+}
+
+void
+proc_profile_purge_pid(struct proc_profile_list *pl, uint32_t pid)
+{
+    assert(pl);
+    struct proc_profile *prof = proc_profile_find(pl, pid);
+    if (prof && prof->active) {
+        proc_profile_stop(pl, pid);
+    }
+}
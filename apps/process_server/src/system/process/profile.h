@@ -0,0 +1,134 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+/*! @file
+    @brief Statistical sampling profiler for user processes.
+
+    The process server holds every thread's TCB cap, so it can read a thread's saved registers at
+    any time. The timer server calls proc_profile_tick() every few timer ticks; each tick reads the
+    program counter of the threads of every profiled process, and counts it in a per-process
+    histogram of program counters.
+
+    Only threads which have run since the previous tick are sampled, so the histogram shows where a
+    process spends CPU time. A thread which was preempted by the tick is sampled where it was
+    interrupted; one which ran and then blocked is sampled at the system call it blocked in. This
+    needs the kernel to tell how much CPU a thread has used, through the utilisation tracker or
+    scheduling context consumption on MCS kernels, so the profiler is only available on those.
+
+    Histograms are dumped by the terminal's profile command as one "0x<pc> <hits>" line per
+    program counter, which can be symbolised on the host with addr2line -f -e <ELF file>.
+*/
+
+#ifndef _REFOS_PROCESS_SERVER_SYSTEM_PROCESS_PROFILE_H_
+#define _REFOS_PROCESS_SERVER_SYSTEM_PROCESS_PROFILE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <autoconf.h>
+#include <refos/refos.h>
+#include "../../common.h"
+
+#define PROC_PROFILE_MAGIC 0x9F0F11E5
+#define PROC_PROFILE_MAX_ENTRIES 4
+
+#if defined(CONFIG_PROCSERV_PROFILER) && \
+    (defined(CONFIG_BENCHMARK_TRACK_UTILISATION) || defined(CONFIG_KERNEL_MCS))
+    #define PROC_PROFILE_ENABLED true
+    #define PROC_PROFILE_BUCKETS CONFIG_PROCSERV_PROFILER_BUCKETS
+#else
+    #define PROC_PROFILE_ENABLED false
+    #define PROC_PROFILE_BUCKETS 1
+#endif
+
+/*! @brief A program counter histogram bucket. Empty buckets have no hits. */
+struct proc_profile_bucket {
+    seL4_Word pc;
+    uint32_t hits;
+};
+
+/*! @brief The profile of a single process. */
+struct proc_profile {
+    uint32_t magic;
+    uint32_t pid; /* No ownership. */
+    uint32_t ownerPID; /*!< The process which started the profile. No ownership. */
+    bool active; /*!< Still being sampled. */
+    uint32_t lastUsed;
+
+    uint32_t samples;
+    uint32_t dropped;
+    uint32_t entries;
+    struct proc_profile_bucket *bucket; /* Has ownership. PROC_PROFILE_BUCKETS buckets. */
+};
+
+/*! @brief Profiler state structure. */
+struct proc_profile_list {
+    struct proc_profile entry[PROC_PROFILE_MAX_ENTRIES];
+    uint32_t clock;
+    uint32_t numActive;
+    uint32_t numTicks;
+};
+
+/*! @brief Initialise the profiler, with nothing being profiled.
+    @param pl The profiler state to initialise.
+*/
+void proc_profile_init(struct proc_profile_list *pl);
+
+/*! @brief Start profiling a process, clearing any histogram it had. Reuses the least recently
+           used stopped profile if every slot is taken.
+    @param pl The profiler state.
+    @param pid The PID of the process to profile.
+    @param ownerPID The PID of the process starting the profile.
+    @return ESUCCESS on success, ENOMEM if every slot is actively profiling, EUNIMPLEMENTED if the
+            profiler is not built in.
+*/
+int proc_profile_start(struct proc_profile_list *pl, uint32_t pid, uint32_t ownerPID);
+
+/*! @brief Stop profiling a process, keeping its histogram.
+    @param pl The profiler state.
+    @param pid The PID of the profiled process.
+    @return ESUCCESS on success, EINVALIDPARAM if the process is not being profiled,
+            EUNIMPLEMENTED if the profiler is not built in.
+*/
+int proc_profile_stop(struct proc_profile_list *pl, uint32_t pid);
+
+/*! @brief Get the process which started a process' profile.
+    @param pl The profiler state.
+    @param pid The PID of the profiled process.
+    @return The PID of the process which started the profile, 0 if there is no profile.
+*/
+uint32_t proc_profile_owner(struct proc_profile_list *pl, uint32_t pid);
+
+/*! @brief Read a chunk of a process's histogram.
+    @param pl The profiler state.
+    @param pid The PID of the profiled process.
+    @param start The bucket to start reading from.
+    @param chunk Output histogram chunk.
+    @return ESUCCESS on success, EINVALIDPARAM if the process has no histogram, EUNIMPLEMENTED if
+            the profiler is not built in.
+*/
+int proc_profile_read(struct proc_profile_list *pl, uint32_t pid, uint32_t start,
+                      refos_profile_chunk_t *chunk);
+
+/*! @brief Take a sample of every actively profiled process.
+    @param pl The profiler state.
+    @return The number of actively profiled processes.
+*/
+int proc_profile_tick(struct proc_profile_list *pl);
+
+/*! @brief Stop profiling an exiting process. Its histogram stays readable until the slot is
+           reused.
+    @param pl The profiler state.
+    @param pid The PID of the exiting process.
+*/
+void proc_profile_purge_pid(struct proc_profile_list *pl, uint32_t pid);
+
+#endif /* _REFOS_PROCESS_SERVER_SYSTEM_PROCESS_PROFILE_H_ */
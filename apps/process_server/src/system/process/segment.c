@@ -0,0 +1,168 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+#include <string.h>
+#include "segment.h"
+#include "pid.h"
+#include "../../state.h"
+
+/*! @file
+    @brief Shared read-only ELF segment cache. */
+
+/*! @brief Release a shared segment's dataspace, and set the entry back to empty. Windows still
+           mapping the dataspace keep it alive. */
+static void
+proc_segment_release(struct proc_segment *s)
+{
+    assert(s && s->magic == PROC_SEGMENT_MAGIC);
+    if (s->content) {
+        assert(s->content->magic == RAM_DATASPACE_MAGIC);
+        ram_dspace_unref(s->content->parentList, s->content->ID);
+    }
+    memset(s, 0, sizeof(struct proc_segment));
+    s->magic = PROC_SEGMENT_MAGIC;
+}
+
+/*! @brief Find a free entry, evicting the least recently used segment nobody has mapped if the
+           table is full.
+    @return The empty entry (No ownership), or NULL if every segment is in use.
+*/
+static struct proc_segment *
+proc_segment_get_free(struct proc_segment_list *sl)
+{
+    struct proc_segment *lru = NULL;
+    for (int i = 0; i < PROC_SEGMENT_MAX_ENTRIES; i++) {
+        struct proc_segment *s = &sl->entry[i];
+        if (s->state == PROC_SEGMENT_EMPTY) {
+            return s;
+        }
+        /* Only the cache's own reference left means no window maps the segment. */
+        if (s->state != PROC_SEGMENT_READY || s->content->ref > 1) {
+            continue;
+        }
+        if (!lru || (sl->clock - s->lastUsed) > (sl->clock - lru->lastUsed)) {
+            lru = s;
+        }
+    }
+    if (lru) {
+        sl->numEvictions++;
+        proc_segment_release(lru);
+    }
+    return lru;
+}
+
+void
+proc_segment_init(struct proc_segment_list *sl)
+{
+    assert(sl);
+    dprintf("Initialising shared segment cache (%d entries)...\n",
+            PROC_SEGMENT_ENABLED ? PROC_SEGMENT_MAX_ENTRIES : 0);
+    memset(sl, 0, sizeof(struct proc_segment_list));
+    for (int i = 0; i < PROC_SEGMENT_MAX_ENTRIES; i++) {
+        sl->entry[i].magic = PROC_SEGMENT_MAGIC;
+    }
+}
+
+struct ram_dspace *
+proc_segment_lookup(struct proc_segment_list *sl, const char *name, uint32_t generation,
+                    seL4_Word source, seL4_Word vaddr, seL4_Word fileSize, uint32_t pid,
+                    bool *createOut, int *errorOut)
+{
+    assert(sl && name && createOut && errorOut);
+    *createOut = false;
+    *errorOut = EUNIMPLEMENTED;
+    if (!PROC_SEGMENT_ENABLED) {
+        return NULL;
+    }
+    *errorOut = EINVALIDPARAM;
+    if (strlen(name) >= PROC_SEGMENT_NAME_LEN || fileSize == 0) {
+        return NULL;
+    }
+
+    for (int i = 0; i < PROC_SEGMENT_MAX_ENTRIES; i++) {
+        struct proc_segment *s = &sl->entry[i];
+        if (s->state == PROC_SEGMENT_EMPTY || strncmp(s->name, name, PROC_SEGMENT_NAME_LEN)) {
+            continue;
+        }
+
+        /* The file has changed since this segment was loaded. Drop it if nobody maps it. */
+        if (s->generation != generation) {
+            if (s->state == PROC_SEGMENT_READY && s->content->ref <= 1) {
+                sl->numEvictions++;
+                proc_segment_release(s);
+            }
+            continue;
+        }
+        if (s->source != source || s->vaddr != vaddr || s->fileSize != fileSize) {
+            continue;
+        }
+
+        /* The segment is ready once its creator has had it content initialised. */
+        if (s->state == PROC_SEGMENT_PENDING && s->content->contentInitEnabled) {
+            s->state = PROC_SEGMENT_READY;
+            s->creatorPID = PID_NULL;
+        }
+        if (s->state != PROC_SEGMENT_READY) {
+            *errorOut = ESERVICEUNAVAILABLE;
+            return NULL;
+        }
+        s->lastUsed = ++sl->clock;
+        sl->numShares++;
+        *errorOut = ESUCCESS;
+        return s->content;
+    }
+
+    /* Not seen this segment before. Create its dataspace for the caller to initialise. */
+    struct proc_segment *s = proc_segment_get_free(sl);
+    if (!s) {
+        *errorOut = ENOMEM;
+        return NULL;
+    }
+    s->content = ram_dspace_create(&procServ.dspaceList, fileSize);
+    if (!s->content) {
+        *errorOut = ENOMEM;
+        return NULL;
+    }
+    s->content->readOnly = true;
+    s->state = PROC_SEGMENT_PENDING;
+    strncpy(s->name, name, PROC_SEGMENT_NAME_LEN - 1);
+    s->name[PROC_SEGMENT_NAME_LEN - 1] = '\0';
+    s->generation = generation;
+    s->source = source;
+    s->vaddr = vaddr;
+    s->fileSize = fileSize;
+    s->creatorPID = pid;
+    s->lastUsed = ++sl->clock;
+    sl->numCreates++;
+
+    *createOut = true;
+    *errorOut = ESUCCESS;
+    return s->content;
+}
+
+void
+proc_segment_purge_pid(struct proc_segment_list *sl, uint32_t pid)
+{
+    assert(sl);
+    for (int i = 0; i < PROC_SEGMENT_MAX_ENTRIES; i++) {
+        struct proc_segment *s = &sl->entry[i];
+        if (s->state == PROC_SEGMENT_PENDING && s->creatorPID == pid) {
+            if (s->content->contentInitEnabled) {
+                /* Made it; the creator just never came back to look. */
+                s->state = PROC_SEGMENT_READY;
+                s->creatorPID = PID_NULL;
+                continue;
+            }
+            proc_segment_release(s);
+        }
+    }
+}
@@ -0,0 +1,115 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+/*! @file
+    @brief Shared read-only ELF segment cache.
+
+    Without sharing, every selfloader opens a private anonymous dataspace for each ELF segment and
+    has the file server content-initialise it, so N instances of a program hold N copies of its
+    text. This module keeps one RAM dataspace per read-only segment of a program instead, keyed by
+    file path, the file's content generation on the file server, and segment. The first selfloader to load the segment creates the dataspace and
+    content-initialises it as normal; later selfloaders map the same dataspace through a read-only
+    window, and fault straight onto the frames already there.
+
+    A shared dataspace is marked read-only, so it can not be mapped through a writable window. Its
+    frames are not charged to any process. Entries not mapped by anyone are kept around for the
+    next spawn, and evicted least recently used first when the table fills up. Once the file is
+    changed, its generation moves on, so the old entries are never handed out again; they are
+    dropped as soon as nobody maps them.
+*/
+
+#ifndef _REFOS_PROCESS_SERVER_SYSTEM_PROCESS_SEGMENT_H_
+#define _REFOS_PROCESS_SERVER_SYSTEM_PROCESS_SEGMENT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <autoconf.h>
+#include "../../common.h"
+#include "../memserv/dataspace.h"
+
+#define PROC_SEGMENT_MAGIC 0x5E65A7ED
+#define PROC_SEGMENT_MAX_ENTRIES 32
+#define PROC_SEGMENT_NAME_LEN 32
+
+#ifdef CONFIG_PROCSERV_SHARED_SEGMENTS
+    #define PROC_SEGMENT_ENABLED true
+#else
+    #define PROC_SEGMENT_ENABLED false
+#endif
+
+enum proc_segment_state {
+    PROC_SEGMENT_EMPTY = 0,
+    PROC_SEGMENT_PENDING, /*!< Created, but the creator hasn't set up content init yet. */
+    PROC_SEGMENT_READY
+};
+
+/*! @brief A shared read-only ELF segment. */
+struct proc_segment {
+    uint32_t magic;
+    enum proc_segment_state state;
+    char name[PROC_SEGMENT_NAME_LEN];
+    seL4_Word source;
+    seL4_Word vaddr;
+    seL4_Word fileSize;
+    uint32_t generation;
+    uint32_t creatorPID; /* No ownership. */
+    uint32_t lastUsed;
+    struct ram_dspace *content; /* Has a strong reference. */
+};
+
+/*! @brief Shared segment cache structure. */
+struct proc_segment_list {
+    struct proc_segment entry[PROC_SEGMENT_MAX_ENTRIES];
+    uint32_t clock;
+
+    /* Statistics. */
+    uint32_t numShares;
+    uint32_t numCreates;
+    uint32_t numEvictions;
+};
+
+/*! @brief Initialise an empty shared segment cache.
+    @param sl The shared segment cache to initialise.
+*/
+void proc_segment_init(struct proc_segment_list *sl);
+
+/*! @brief Look up the shared dataspace for a read-only ELF segment, creating it if there is none.
+
+    If the segment is not in the cache, a new read-only RAM dataspace is created for it, and
+    createOut is set; the caller must then content-initialise it from the ELF file. Until the
+    dataspace has a content initialiser, nobody else gets it, so other callers load the segment
+    privately in the meantime.
+
+    @param sl The shared segment cache.
+    @param name The program's file path.
+    @param generation The file's content generation, from REFOS_IOCTL_GET_GENERATION.
+    @param source The segment's offset into the ELF file.
+    @param vaddr The segment's vaddr.
+    @param fileSize The segment's file size.
+    @param pid The PID of the selfloader asking.
+    @param createOut Output flag, whether the caller created the dataspace.
+    @param errorOut Output error, set when NULL is returned.
+    @return The shared dataspace (No ownership), or NULL if the segment can't be shared right now.
+*/
+struct ram_dspace *proc_segment_lookup(struct proc_segment_list *sl, const char *name,
+                                       uint32_t generation, seL4_Word source, seL4_Word vaddr,
+                                       seL4_Word fileSize, uint32_t pid, bool *createOut,
+                                       int *errorOut);
+
+/*! @brief Drop any shared segment the given process created but never got content initialised.
+           Called when the process exits.
+    @param sl The shared segment cache.
+    @param pid The PID of the exiting process.
+*/
+void proc_segment_purge_pid(struct proc_segment_list *sl, uint32_t pid);
+
+#endif /* _REFOS_PROCESS_SERVER_SYSTEM_PROCESS_SEGMENT_H_ */
@@ -0,0 +1,400 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+#include <string.h>
+#include "template.h"
+#include "process.h"
+#include "pid.h"
+#include "../../state.h"
+#include "../addrspace/vspace.h"
+#include "../memserv/window.h"
+
+/*! @file
+    @brief Process image template cache. */
+
+/*! @brief Round up to the next page boundary. Matches the selfloader's segment layout. */
+static seL4_Word
+proc_template_roundup_page(seL4_Word addr)
+{
+    return REFOS_PAGE_ALIGN(addr) + ((addr % REFOS_PAGE_SIZE) ? REFOS_PAGE_SIZE : 0);
+}
+
+/*! @brief Release everything a template holds, and set it back to empty. */
+static void
+proc_template_release(struct proc_template_list *tl, struct proc_template *t)
+{
+    assert(t && t->magic == PROC_TEMPLATE_MAGIC);
+    for (uint32_t i = 0; i < t->numSegments; i++) {
+        struct ram_dspace *content = t->segment[i].content;
+        assert(content && content->magic == RAM_DATASPACE_MAGIC);
+        /* Any processes cloned from this template keep the content alive until they exit. */
+        ram_dspace_unref(content->parentList, content->ID);
+    }
+    assert(tl->npages >= t->npages);
+    tl->npages -= t->npages;
+    memset(t, 0, sizeof(struct proc_template));
+    t->magic = PROC_TEMPLATE_MAGIC;
+}
+
+/*! @brief Find the least recently used template which is not being captured.
+    @param tl The template cache.
+    @param readyOnly Only consider ready templates.
+    @param skip A template not to consider, or NULL. (No ownership)
+    @return The template (No ownership), or NULL if there's none.
+*/
+static struct proc_template *
+proc_template_find_lru(struct proc_template_list *tl, bool readyOnly, struct proc_template *skip)
+{
+    struct proc_template *lru = NULL;
+    for (int i = 0; i < PROC_TEMPLATE_MAX_ENTRIES; i++) {
+        struct proc_template *t = &tl->entry[i];
+        if (t == skip || t->state == PROC_TEMPLATE_EMPTY || t->state == PROC_TEMPLATE_CAPTURING) {
+            continue;
+        }
+        if (readyOnly && t->state != PROC_TEMPLATE_READY) {
+            continue;
+        }
+        if (!lru || (tl->clock - t->lastUsed) > (tl->clock - lru->lastUsed)) {
+            lru = t;
+        }
+    }
+    return lru;
+}
+
+/*! @brief Find the template for a name, or make room for one.
+    @return The template (No ownership), or NULL if every entry is being captured.
+*/
+static struct proc_template *
+proc_template_get_entry(struct proc_template_list *tl, const char *name)
+{
+    struct proc_template *empty = NULL;
+    for (int i = 0; i < PROC_TEMPLATE_MAX_ENTRIES; i++) {
+        struct proc_template *t = &tl->entry[i];
+        if (t->state == PROC_TEMPLATE_EMPTY) {
+            empty = empty ? empty : t;
+            continue;
+        }
+        if (!strncmp(t->name, name, PROC_TEMPLATE_NAME_LEN)) {
+            return t;
+        }
+    }
+
+    if (!empty) {
+        /* Table full. Recycle the least recently used entry. */
+        empty = proc_template_find_lru(tl, false, NULL);
+        if (!empty) {
+            return NULL;
+        }
+        if (empty->state == PROC_TEMPLATE_READY) {
+            tl->numEvictions++;
+        }
+        proc_template_release(tl, empty);
+    }
+
+    empty->state = PROC_TEMPLATE_COUNTING;
+    strncpy(empty->name, name, PROC_TEMPLATE_NAME_LEN - 1);
+    empty->name[PROC_TEMPLATE_NAME_LEN - 1] = '\0';
+    return empty;
+}
+
+/*! @brief Find the ready template for a name.
+    @return The template (No ownership), or NULL if there's none.
+*/
+static struct proc_template *
+proc_template_get_ready(struct proc_template_list *tl, const char *name)
+{
+    for (int i = 0; i < PROC_TEMPLATE_MAX_ENTRIES; i++) {
+        struct proc_template *t = &tl->entry[i];
+        if (t->state == PROC_TEMPLATE_READY && !strncmp(t->name, name, PROC_TEMPLATE_NAME_LEN)) {
+            return t;
+        }
+    }
+    return NULL;
+}
+
+/*! @brief Find the template a process is capturing. */
+static struct proc_template *
+proc_template_get_capture(struct proc_template_list *tl, uint32_t pid)
+{
+    for (int i = 0; i < PROC_TEMPLATE_MAX_ENTRIES; i++) {
+        struct proc_template *t = &tl->entry[i];
+        if (t->state == PROC_TEMPLATE_CAPTURING && t->capturePID == pid) {
+            return t;
+        }
+    }
+    return NULL;
+}
+
+/*! @brief Create a zero-filled anonymous window in a process's vspace.
+    @return ESUCCESS on success, refos_err_t otherwise.
+*/
+static int
+proc_template_map_dspace(struct proc_pcb *pcb, seL4_Word vaddr, seL4_Word size,
+                         struct ram_dspace *dspace)
+{
+    int error = proc_mem_check_window(pcb);
+    if (error != ESUCCESS) {
+        return error;
+    }
+
+    int windowID = W_INVALID_WINID;
+    error = vs_create_window(&pcb->vspace, vaddr, size, W_PERMISSION_WRITE | W_PERMISSION_READ,
+                             true, &windowID);
+    if (error != ESUCCESS || windowID == W_INVALID_WINID) {
+        return error != ESUCCESS ? error : EINVALID;
+    }
+    struct w_window *window = w_get_window(&procServ.windowList, windowID);
+    assert(window && window->magic == W_MAGIC);
+
+    /* The window takes its own reference; it will be the only one left once we return. */
+    w_set_anon_dspace(window, dspace, 0);
+    return ESUCCESS;
+}
+
+void
+proc_template_init(struct proc_template_list *tl)
+{
+    assert(tl);
+    dprintf("Initialising process template cache (budget %d pages)...\n",
+            PROC_TEMPLATE_BUDGET_PAGES);
+    memset(tl, 0, sizeof(struct proc_template_list));
+    for (int i = 0; i < PROC_TEMPLATE_MAX_ENTRIES; i++) {
+        tl->entry[i].magic = PROC_TEMPLATE_MAGIC;
+    }
+}
+
+struct proc_template *
+proc_template_lookup(struct proc_template_list *tl, const char *name, uint32_t pid,
+                     bool *captureOut)
+{
+    assert(tl && name && captureOut);
+    *captureOut = false;
+    if (PROC_TEMPLATE_BUDGET_PAGES == 0 || strlen(name) >= PROC_TEMPLATE_NAME_LEN) {
+        return NULL;
+    }
+
+    struct proc_template *t = proc_template_get_entry(tl, name);
+    if (!t) {
+        return NULL;
+    }
+    t->lastUsed = ++tl->clock;
+    t->numSpawns++;
+
+    if (t->state == PROC_TEMPLATE_READY) {
+        return t;
+    }
+    if (t->state == PROC_TEMPLATE_COUNTING && t->numSpawns >= PROC_TEMPLATE_THRESHOLD) {
+        t->state = PROC_TEMPLATE_CAPTURING;
+        t->capturePID = pid;
+        *captureOut = true;
+    }
+    return NULL;
+}
+
+struct proc_template *
+proc_template_validate(struct proc_template_list *tl, const char *name, uint32_t pid,
+                       int generation, bool *captureOut)
+{
+    assert(tl && name && captureOut);
+    *captureOut = false;
+    struct proc_template *t = proc_template_get_ready(tl, name);
+    if (!t) {
+        /* Evicted since the selfloader was spawned. */
+        return NULL;
+    }
+    if (generation >= 0 && t->generation == (uint32_t) generation) {
+        t->lastUsed = ++tl->clock;
+        tl->numHits++;
+        return t;
+    }
+
+    /* The file has changed since the template was captured. Drop the template, and have this
+       selfloader capture a new one from the file as it is now. */
+    dprintf("Template for [%s] is stale, recapturing.\n", name);
+    uint32_t numSpawns = t->numSpawns;
+    proc_template_release(tl, t);
+    tl->numStale++;
+    if (generation < 0) {
+        return NULL;
+    }
+    t->state = PROC_TEMPLATE_CAPTURING;
+    strncpy(t->name, name, PROC_TEMPLATE_NAME_LEN - 1);
+    t->name[PROC_TEMPLATE_NAME_LEN - 1] = '\0';
+    t->numSpawns = numSpawns;
+    t->lastUsed = ++tl->clock;
+    t->capturePID = pid;
+    *captureOut = true;
+    return NULL;
+}
+
+int
+proc_template_instantiate(struct proc_template *t, struct proc_pcb *pcb)
+{
+    assert(t && t->magic == PROC_TEMPLATE_MAGIC && t->state == PROC_TEMPLATE_READY);
+    assert(pcb && pcb->magic == REFOS_PCB_MAGIC);
+
+    for (uint32_t i = 0; i < t->numSegments; i++) {
+        struct proc_template_segment *s = &t->segment[i];
+
+        /* Clone the file-initialised part of the segment. */
+        struct ram_dspace *clone = ram_dspace_clone(&procServ.dspaceList, s->content);
+        if (!clone) {
+            return ENOMEM;
+        }
+        clone->ownerPID = pcb->pid;
+        seL4_Word windowSize = proc_template_roundup_page(s->vaddr + s->fileSize) - s->vaddr;
+        int error = proc_template_map_dspace(pcb, REFOS_PAGE_ALIGN(s->vaddr), windowSize, clone);
+        ram_dspace_unref(clone->parentList, clone->ID);
+        if (error != ESUCCESS) {
+            return error;
+        }
+        if (windowSize >= s->segmentSize) {
+            continue;
+        }
+
+        /* Fill out the remaining un-initialised portion of the segment with a zero dataspace. */
+        seL4_Word zeroSize = proc_template_roundup_page(s->segmentSize - windowSize);
+        struct ram_dspace *zero = ram_dspace_create(&procServ.dspaceList, zeroSize);
+        if (!zero) {
+            return ENOMEM;
+        }
+        zero->ownerPID = pcb->pid;
+        error = proc_template_map_dspace(pcb, s->vaddr + windowSize, zeroSize, zero);
+        ram_dspace_unref(zero->parentList, zero->ID);
+        if (error != ESUCCESS) {
+            return error;
+        }
+    }
+    return ESUCCESS;
+}
+
+int
+proc_template_add_segment(struct proc_template_list *tl, uint32_t pid,
+                          struct ram_dspace *source, seL4_Word vaddr, seL4_Word fileSize,
+                          seL4_Word segmentSize)
+{
+    assert(tl && source && source->magic == RAM_DATASPACE_MAGIC);
+    struct proc_template *t = proc_template_get_capture(tl, pid);
+    if (!t) {
+        return EACCESSDENIED;
+    }
+
+    int error = EINVALIDPARAM;
+    if (t->numSegments >= PROC_TEMPLATE_MAX_SEGMENTS || fileSize > segmentSize ||
+            source->physicalAddrEnabled) {
+        goto exit0;
+    }
+    if (t->npages + source->npages > PROC_TEMPLATE_BUDGET_PAGES) {
+        /* Larger than the whole cache; not worth keeping. Other templates are evicted to make room
+           for it on commit. */
+        error = ENOMEM;
+        goto exit0;
+    }
+
+    struct ram_dspace *content = ram_dspace_create(&procServ.dspaceList,
+                                                   source->npages * REFOS_PAGE_SIZE);
+    char *buf = kmalloc(REFOS_PAGE_SIZE);
+    if (!content || !buf) {
+        error = ENOMEM;
+        goto exit1;
+    }
+
+    /* Copy every page across. Pages the source has never had are left out, as they're zero. */
+    for (uint32_t i = 0; i < source->npages; i++) {
+        uint32_t offset = i * REFOS_PAGE_SIZE;
+        if (source->contentInitEnabled && ram_dspace_need_content_init(source, offset) == true) {
+            ROS_WARNING("Template segment page 0x%x is not loaded.", offset);
+            error = EINVALIDPARAM;
+            goto exit1;
+        }
+        seL4_CPtr frame = ram_dspace_check_page(source, offset);
+        if (!frame) {
+            continue;
+        }
+        error = procserv_frame_read(frame, buf, REFOS_PAGE_SIZE, 0);
+        if (error == ESUCCESS) {
+            error = ram_dspace_write(buf, REFOS_PAGE_SIZE, content, offset);
+        }
+        if (error != ESUCCESS) {
+            goto exit1;
+        }
+    }
+    kfree(buf);
+
+    struct proc_template_segment *s = &t->segment[t->numSegments++];
+    s->vaddr = vaddr;
+    s->fileSize = fileSize;
+    s->segmentSize = segmentSize;
+    s->content = content;
+    t->npages += content->npages;
+    tl->npages += content->npages;
+    return ESUCCESS;
+
+    /* Exit stack. */
+exit1:
+    if (buf) {
+        kfree(buf);
+    }
+    if (content) {
+        ram_dspace_unref(content->parentList, content->ID);
+    }
+exit0:
+    proc_template_release(tl, t);
+    return error;
+}
+
+int
+proc_template_commit(struct proc_template_list *tl, uint32_t pid, seL4_Word entryPoint,
+                     seL4_Word endOfProgram, int generation)
+{
+    assert(tl);
+    struct proc_template *t = proc_template_get_capture(tl, pid);
+    if (!t) {
+        return EACCESSDENIED;
+    }
+    if (t->numSegments == 0 || generation < 0) {
+        /* A template we can't check against the file later is no use. */
+        proc_template_release(tl, t);
+        return EINVALIDPARAM;
+    }
+
+    t->entryPoint = entryPoint;
+    t->endOfProgram = endOfProgram;
+    t->generation = (uint32_t) generation;
+    t->capturePID = PID_NULL;
+    t->state = PROC_TEMPLATE_READY;
+    t->lastUsed = ++tl->clock;
+    tl->numCaptures++;
+
+    /* Evict other least recently used templates until we're back within budget. This template fits
+       on its own, but templates still being captured can't be evicted, so we may end up over
+       budget until they are committed. */
+    while (tl->npages > PROC_TEMPLATE_BUDGET_PAGES) {
+        struct proc_template *lru = proc_template_find_lru(tl, true, t);
+        if (!lru) {
+            break;
+        }
+        tl->numEvictions++;
+        proc_template_release(tl, lru);
+    }
+    return ESUCCESS;
+}
+
+void
+proc_template_purge_pid(struct proc_template_list *tl, uint32_t pid)
+{
+    assert(tl);
+    struct proc_template *t = proc_template_get_capture(tl, pid);
+    if (t) {
+        proc_template_release(tl, t);
+    }
+}
@@ -0,0 +1,188 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+/*! @file
+    @brief Process image template cache.
+
+    Spawning a RefOS user program normally runs the selfloader, which opens the ELF file on its
+    file server and content-initialises every segment from it, page by page. For binaries which
+    are spawned over and over (terminal commands, test harnesses), this module keeps a template:
+    a fully loaded, never-run copy of the program's ELF segments, held in process server owned
+    RAM dataspaces.
+
+    Once a binary has been spawned PROC_TEMPLATE_THRESHOLD times, the next selfloader to load it
+    is asked to capture a template: after loading the segments as normal, it hands them to the
+    process server, which copies them, along with the file's content generation
+    (REFOS_IOCTL_GET_GENERATION). Later selfloaders for the same binary are told a template
+    exists. They only open the file to read its generation, and ask the process server to load
+    the program from the template: the segments are mapped in as copy-on-write clones of the
+    template, along with a fresh stack and heap. The selfloader then only pushes the arguments and
+    jumps in. The selfloader can't be skipped entirely yet, as the program borrows its system call
+    table.
+
+    Templates are looked up by file path. If the file's generation no longer matches, the file has
+    changed since the template was captured: the template is dropped, and the selfloader loads the
+    program from the file and captures a new one, as proc_segment_lookup() does for shared
+    segments. Templates are evicted least recently used first, to keep their total size within
+    CONFIG_PROCSERV_TEMPLATE_BUDGET_KB. Evicted and dropped templates still live on for as long as
+    a process cloned from them does.
+*/
+
+#ifndef _REFOS_PROCESS_SERVER_SYSTEM_PROCESS_TEMPLATE_H_
+#define _REFOS_PROCESS_SERVER_SYSTEM_PROCESS_TEMPLATE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <autoconf.h>
+#include "../../common.h"
+#include "../memserv/dataspace.h"
+
+#define PROC_TEMPLATE_MAGIC 0x7E3B1A7E
+#define PROC_TEMPLATE_MAX_ENTRIES 8
+#define PROC_TEMPLATE_MAX_SEGMENTS 4
+#define PROC_TEMPLATE_NAME_LEN 32
+
+#ifdef CONFIG_PROCSERV_TEMPLATES
+    #define PROC_TEMPLATE_THRESHOLD CONFIG_PROCSERV_TEMPLATE_THRESHOLD
+    #define PROC_TEMPLATE_BUDGET_PAGES ((CONFIG_PROCSERV_TEMPLATE_BUDGET_KB * 1024) / \
+                                        REFOS_PAGE_SIZE)
+#else
+    #define PROC_TEMPLATE_THRESHOLD 0
+    #define PROC_TEMPLATE_BUDGET_PAGES 0
+#endif
+
+struct proc_pcb;
+
+enum proc_template_state {
+    PROC_TEMPLATE_EMPTY = 0,
+    PROC_TEMPLATE_COUNTING,  /*!< Binary has been seen, but not often enough to keep a template. */
+    PROC_TEMPLATE_CAPTURING, /*!< A selfloader is handing us the segments. */
+    PROC_TEMPLATE_READY
+};
+
+/*! @brief A single file-initialised ELF segment of a template. */
+struct proc_template_segment {
+    seL4_Word vaddr;
+    seL4_Word fileSize;
+    seL4_Word segmentSize;
+    struct ram_dspace *content; /* Has a strong reference. */
+};
+
+/*! @brief A process image template. */
+struct proc_template {
+    uint32_t magic;
+    enum proc_template_state state;
+    char name[PROC_TEMPLATE_NAME_LEN];
+    uint32_t numSpawns;
+    uint32_t lastUsed;
+    uint32_t capturePID; /* No ownership. */
+
+    struct proc_template_segment segment[PROC_TEMPLATE_MAX_SEGMENTS];
+    uint32_t numSegments;
+    uint32_t npages;
+    seL4_Word entryPoint;
+    seL4_Word endOfProgram;
+    uint32_t generation; /*!< Content generation of the file the template was captured from. */
+};
+
+/*! @brief Template cache structure. */
+struct proc_template_list {
+    struct proc_template entry[PROC_TEMPLATE_MAX_ENTRIES];
+    uint32_t npages; /*!< Total pages held by templates. */
+    uint32_t clock;
+
+    /* Statistics. */
+    uint32_t numHits;
+    uint32_t numCaptures;
+    uint32_t numEvictions;
+    uint32_t numStale; /*!< Templates dropped because their file had changed. */
+};
+
+/*! @brief Initialise an empty template cache.
+    @param tl The template cache to initialise.
+*/
+void proc_template_init(struct proc_template_list *tl);
+
+/*! @brief Look up a ready template for the given binary, counting the spawn.
+
+    If there is no template yet but the binary has now been spawned often enough, it is marked as
+    being captured by the given process, and captureOut is set.
+
+    @param tl The template cache.
+    @param name The binary's file path.
+    @param pid The PID of the selfloader being spawned for it.
+    @param captureOut Output flag, whether the selfloader should capture a template.
+    @return The ready template (No ownership), or NULL if there isn't one.
+*/
+struct proc_template *proc_template_lookup(struct proc_template_list *tl, const char *name,
+                                           uint32_t pid, bool *captureOut);
+
+/*! @brief Check a ready template against the current generation of its file, before loading a
+           program from it.
+
+    If the generation doesn't match, the template is dropped. Unless the generation is negative,
+    meaning the file server can't tell, the given process is then made to capture a new template,
+    and captureOut is set.
+
+    @param tl The template cache.
+    @param name The binary's file path.
+    @param pid The PID of the selfloader loading it.
+    @param generation The file's current content generation.
+    @param captureOut Output flag, whether the selfloader should capture a template.
+    @return The ready template (No ownership), or NULL if there is no template for this generation.
+*/
+struct proc_template *proc_template_validate(struct proc_template_list *tl, const char *name,
+                                             uint32_t pid, int generation, bool *captureOut);
+
+/*! @brief Map a template's segments into a process's vspace as copy-on-write clones, with zero
+           windows for any uninitialised remainder of each segment.
+    @param t The template. (No ownership)
+    @param pcb The process to map into. (No ownership)
+    @return ESUCCESS on success, refos_err_t otherwise.
+*/
+int proc_template_instantiate(struct proc_template *t, struct proc_pcb *pcb);
+
+/*! @brief Copy a loaded ELF segment into the template a process is capturing.
+    @param tl The template cache.
+    @param pid The PID of the capturing selfloader.
+    @param source The loaded segment's dataspace. Every page must have been content-initialised.
+                  (No ownership)
+    @param vaddr The segment's vaddr, as in the ELF header.
+    @param fileSize The segment's file size, as in the ELF header.
+    @param segmentSize The segment's memory size, as in the ELF header.
+    @return ESUCCESS on success, refos_err_t otherwise. On error, the capture is abandoned.
+*/
+int proc_template_add_segment(struct proc_template_list *tl, uint32_t pid,
+                              struct ram_dspace *source, seL4_Word vaddr, seL4_Word fileSize,
+                              seL4_Word segmentSize);
+
+/*! @brief Finish capturing a template, making it ready for use, and evict older templates as
+           needed to stay within budget.
+    @param tl The template cache.
+    @param pid The PID of the capturing selfloader.
+    @param entryPoint The ELF entry point.
+    @param endOfProgram The end of the last ELF segment.
+    @param generation The content generation of the file the segments were loaded from. The
+                      capture is abandoned if this is negative.
+    @return ESUCCESS on success, refos_err_t otherwise.
+*/
+int proc_template_commit(struct proc_template_list *tl, uint32_t pid, seL4_Word entryPoint,
+                         seL4_Word endOfProgram, int generation);
+
+/*! @brief Abandon any template capture the given process was doing. Called when the process
+           exits.
+    @param tl The template cache.
+    @param pid The PID of the exiting process.
+*/
+void proc_template_purge_pid(struct proc_template_list *tl, uint32_t pid);
+
+#endif /* _REFOS_PROCESS_SERVER_SYSTEM_PROCESS_TEMPLATE_H_ */
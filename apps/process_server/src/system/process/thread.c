@@ -14,10 +14,11 @@
 #include "../../state.h"
 #include "../../common.h"
 #include "../addrspace/vspace.h"
+#include <refos/vmlayout.h>
 
 int
-thread_config(struct proc_tcb *thread, uint8_t priority, vaddr_t entryPoint,
-                   struct vs_vspace *vspace)
+thread_config(struct proc_tcb *thread, uint8_t priority, uint8_t maxPriority, uint32_t budgetUS,
+              uint32_t periodUS, vaddr_t entryPoint, struct vs_vspace *vspace)
 {
     assert(thread);
     if (!entryPoint || !vspace) {
@@ -34,12 +35,30 @@ thread_config(struct proc_tcb *thread, uint8_t priority, vaddr_t entryPoint,
     thread->vspaceRef = vspace;
     vs_ref(vspace);
 
-    /* Configure the thread object. */
-    int error = sel4utils_configure_thread(
-            &procServ.vka, &procServ.vspace, &vspace->vspace, REFOS_PROCSERV_EP,
-            priority, vspace->cspace.capPtr, vspace->cspaceGuardData,
-            &thread->sel4utilsThread
-    );
+    /* Place the thread on a core. Its faults go to that core's fault endpoint, so they are
+       handled by the process server worker pinned to the same core. */
+    thread->core = worker_next_core(&procServ.workers);
+
+    /* Configure the thread object. Its maximum controlled priority is its process' priority
+       ceiling. */
+    sel4utils_thread_config_t config = thread_config_new(&procServ.simpleEnv);
+    config = thread_config_cspace(config, vspace->cspace.capPtr, vspace->cspaceGuardData);
+    config = thread_config_fault_endpoint(config, PROCCSPACE_FAULT_EP_START + thread->core);
+    config = thread_config_priority(config, priority);
+    config = thread_config_mcp(config, maxPriority);
+#ifdef CONFIG_KERNEL_MCS
+    /* Each thread runs on its own scheduling context, so that its process' budget holds it back
+       from starving the system servers. */
+    config = thread_config_create_reply(config);
+    config.sched_params = sched_params_periodic(config.sched_params, &procServ.simpleEnv,
+                                                thread->core, periodUS, budgetUS, 0, 0);
+#else
+    (void) budgetUS;
+    (void) periodUS;
+#endif
+    int error = sel4utils_configure_thread_config(&procServ.vka, &procServ.vspace,
+                                                  &vspace->vspace, config,
+                                                  &thread->sel4utilsThread);
     if (error) {
         ROS_ERROR("Failed to configure thread for new process, error: %d.\n", error);
         memset(thread, 0, sizeof(struct proc_tcb));
@@ -47,6 +66,13 @@ thread_config(struct proc_tcb *thread, uint8_t priority, vaddr_t entryPoint,
         return EINVALID;
     }
 
+#if CONFIG_MAX_NUM_NODES > 1
+    error = seL4_TCB_SetAffinity(thread_tcb_obj(thread), thread->core);
+    if (error) {
+        ROS_WARNING("Failed to set thread affinity to core %u.", thread->core);
+    }
+#endif
+
     return ESUCCESS;
 }
 
@@ -78,6 +104,65 @@ thread_start(struct proc_tcb *thread, void *arg0, void *arg1)
     return ESUCCESS;
 }
 
+int
+thread_set_priority(struct proc_tcb *thread, uint8_t priority, uint8_t maxPriority)
+{
+    assert(thread && thread->magic == REFOS_PROCESS_THREAD_MAGIC);
+    seL4_CPtr authority = simple_get_tcb(&procServ.simpleEnv);
+#ifdef CONFIG_KERNEL_MCS
+    int error = seL4_TCB_SetMCPriority(thread_tcb_obj(thread), authority, maxPriority);
+    if (error == seL4_NoError) {
+        error = seL4_TCB_SetPriority(thread_tcb_obj(thread), authority, priority);
+    }
+#else
+    int error = seL4_TCB_SetSchedParams(thread_tcb_obj(thread), authority, maxPriority, priority);
+#endif
+    if (error != seL4_NoError) {
+        ROS_WARNING("Failed to set thread priority, error: %d.", error);
+        return EINVALIDPARAM;
+    }
+    thread->priority = priority;
+    return ESUCCESS;
+}
+
+int
+thread_set_sched_params(struct proc_tcb *thread, uint32_t budgetUS, uint32_t periodUS)
+{
+    assert(thread && thread->magic == REFOS_PROCESS_THREAD_MAGIC);
+#ifdef CONFIG_KERNEL_MCS
+    /* Bank the time used under the old parameters first. */
+    thread_cpu_time(thread);
+    int error = seL4_SchedControl_Configure(
+            simple_get_sched_ctrl(&procServ.simpleEnv, thread->core),
+            thread->sel4utilsThread.sched_context.cptr, budgetUS, periodUS, 0, 0
+    );
+    if (error != seL4_NoError) {
+        ROS_WARNING("Failed to configure scheduling context, error: %d.", error);
+        return EINVALIDPARAM;
+    }
+    return ESUCCESS;
+#else
+    (void) budgetUS;
+    (void) periodUS;
+    return EUNIMPLEMENTED;
+#endif
+}
+
+uint64_t
+thread_cpu_time(struct proc_tcb *thread)
+{
+    assert(thread && thread->magic == REFOS_PROCESS_THREAD_MAGIC);
+#ifdef CONFIG_KERNEL_MCS
+    /* Consumed returns the time used since it was last called, so keep a running total. */
+    seL4_SchedContext_Consumed_t consumed =
+            seL4_SchedContext_Consumed(thread->sel4utilsThread.sched_context.cptr);
+    if (consumed.error == seL4_NoError) {
+        thread->cpuTimeUS += consumed.consumed;
+    }
+#endif
+    return thread->cpuTimeUS;
+}
+
 void
 thread_release(struct proc_tcb *thread)
 {
@@ -87,6 +172,9 @@ thread_release(struct proc_tcb *thread)
     vka_cspace_make_path(&procServ.vka, thread_tcb_obj(thread), &path);
     vka_cnode_revoke(&path);
     sel4utils_clean_up_thread(&procServ.vka, &thread->vspaceRef->vspace, &thread->sel4utilsThread);
+    if (thread->notification.cptr) {
+        vka_free_object(&procServ.vka, &thread->notification);
+    }
     vs_unref(thread->vspaceRef);
     memset(thread, 0, sizeof(struct proc_tcb));
 }
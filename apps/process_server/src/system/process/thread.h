@@ -22,6 +22,13 @@
 
 #define REFOS_PROCESS_THREAD_MAGIC 0x1003C44C
 
+/* On MCS kernels every thread also holds a scheduling context and a reply object. */
+#ifdef CONFIG_KERNEL_MCS
+    #define THREAD_SCHED_KERNEL_OBJECTS 2
+#else
+    #define THREAD_SCHED_KERNEL_OBJECTS 0
+#endif
+
 struct vs_vspace;
 
 /*! @brief Process thread control block structure.
@@ -32,9 +39,13 @@ struct vs_vspace;
 struct proc_tcb {
     uint32_t magic;
     uint8_t priority;
+    uint32_t core; /* The CPU core this thread is pinned to. */
+    uint64_t cpuTimeUS; /* CPU time consumed so far, as of the last thread_cpu_time(). */
+    uint64_t profileTime; /* CPU usage last seen by the profiler; see profile.h. */
     struct vs_vspace *vspaceRef; /* Shared ownership. */
     sel4utils_thread_t sel4utilsThread;
     vaddr_t entryPoint;
+    vka_object_t notification; /* Cloned threads only; see PROCCSPACE_THREAD_NOTIFY_START. */
 };
 
 /*! @brief Helper function to get the underlying kernel TCB object that a procserv TCB
@@ -51,13 +62,41 @@ thread_tcb_obj(struct proc_tcb *thread)
 /*! @brief Configure a thread, and set it up for use.
     @param thread The TCB structure to set up and configure. (No ownership transfer).
     @param priority Priority of the thread.
+    @param maxPriority Maximum controlled priority of the thread.
+    @param budgetUS The budget of the thread's scheduling context, in microseconds. Ignored on
+                    non-MCS kernels.
+    @param periodUS The period of the thread's scheduling context, in microseconds. Ignored on
+                    non-MCS kernels.
     @param entryPoint The entry point of the thread, in the thread's vspace.
     @param vspace The thread's new vspace.
     @return ESUCCESS on success, refos_err_t otherwise.
 */
-int thread_config(struct proc_tcb *thread, uint8_t priority, vaddr_t entryPoint,
+int thread_config(struct proc_tcb *thread, uint8_t priority, uint8_t maxPriority,
+                  uint32_t budgetUS, uint32_t periodUS, vaddr_t entryPoint,
                   struct vs_vspace *vspace);
 
+/*! @brief Change the priority and maximum controlled priority of a thread.
+    @param thread The TCB of the thread. (No ownership transfer)
+    @param priority The new priority. Must be no higher than maxPriority.
+    @param maxPriority The new maximum controlled priority.
+    @return ESUCCESS on success, refos_err_t otherwise.
+*/
+int thread_set_priority(struct proc_tcb *thread, uint8_t priority, uint8_t maxPriority);
+
+/*! @brief Change the budget and period of a thread's scheduling context.
+    @param thread The TCB of the thread. (No ownership transfer)
+    @param budgetUS The new budget, in microseconds.
+    @param periodUS The new period, in microseconds.
+    @return ESUCCESS on success, EUNIMPLEMENTED on non-MCS kernels, refos_err_t otherwise.
+*/
+int thread_set_sched_params(struct proc_tcb *thread, uint32_t budgetUS, uint32_t periodUS);
+
+/*! @brief Get the CPU time a thread has consumed since it was created.
+    @param thread The TCB of the thread. (No ownership transfer)
+    @return The CPU time consumed in microseconds. Always 0 on non-MCS kernels.
+*/
+uint64_t thread_cpu_time(struct proc_tcb *thread);
+
 /*! @brief Start a thread running.
     @param thread The TCB of the thread to start.
     @param arg0 The first argument. 
@@ -66,7 +105,8 @@ int thread_config(struct proc_tcb *thread, uint8_t priority, vaddr_t entryPoint,
 */
 int thread_start(struct proc_tcb *thread, void *arg0, void *arg1);
 
-/*! @brief Release a thread and all the resources it owns. Does not free the struct itself.
+/*! @brief Release a thread and all the resources it owns, including its notification. Does not
+           free the struct itself.
     @param thread The TCB of the thread to remove. (No ownership transfer)
 */
 void thread_release(struct proc_tcb *thread);
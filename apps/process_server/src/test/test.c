@@ -18,6 +18,7 @@
 #include <data_struct/cqueue.h>
 #include <data_struct/chash.h>
 #include <data_struct/cbpool.h>
+#include <cpio/cpio.h>
 #include <refos/test.h>
 #include <refos-util/nameserv.h>
 #include "test_addrspace.h"
@@ -283,6 +284,46 @@ test_nameserv_lib(void)
     return test_success();
 }
 
+/* -------------------------------------- CPIO index test --------------------------------------- */
+
+static int
+test_cpio_index(void)
+{
+    test_start("cpio index");
+    unsigned long len = _cpio_archive_end - _cpio_archive;
+    struct cpio_info info;
+    int error = cpio_info(_cpio_archive, len, &info);
+    test_assert(!error);
+    test_assert(procServ.cpioIndex.file_count > 0);
+    test_assert(procServ.cpioIndex.file_count <= info.file_count);
+
+    /* Test that every archive entry resolves to the same file through both lookup paths. */
+    for (unsigned int i = 0; i < info.file_count; i++) {
+        const char *name = NULL;
+        unsigned long entrySize = 0, linearSize = 0, indexSize = 0;
+        void *entry = cpio_get_entry(_cpio_archive, len, i, &name, &entrySize);
+        test_assert(entry != NULL && name != NULL);
+        void *linear = cpio_get_file(_cpio_archive, len, name, &linearSize);
+        void *indexed = cpio_index_get_file(&procServ.cpioIndex, name, &indexSize);
+        test_assert(linear != NULL);
+        test_assert(linear == indexed);
+        test_assert(linearSize == indexSize);
+        const struct cpio_index_entry *e = cpio_index_lookup(&procServ.cpioIndex, name);
+        test_assert(e != NULL && e->data == linear && e->size == linearSize);
+    }
+
+    /* Test that missing files are missing through both lookup paths. */
+    const char *missing[] = {"", "file_server_", "_file_server", "selfloader/", "no_such_file"};
+    for (unsigned int i = 0; i < sizeof(missing) / sizeof(missing[0]); i++) {
+        unsigned long size = 0x1234;
+        test_assert(cpio_get_file(_cpio_archive, len, missing[i], &size) == NULL);
+        test_assert(cpio_index_get_file(&procServ.cpioIndex, missing[i], &size) == NULL);
+        test_assert(size == 0x1234);
+    }
+
+    return test_success();
+}
+
 /* ------------------------------------ ProcServ Unit tests ------------------------------------- */
 
 void
@@ -297,10 +338,13 @@ test_run_all(void)
     test_chash();
     test_cpool();
     test_cbpool();
+    test_cpio_index();
     test_pid();
     test_pd();
     test_vspace(0);
     test_vspace_mapping();
+    test_vspace_reservations();
+    test_vspace_teardown();
     test_vspace(1);
     test_thread();
     test_window_list();
@@ -308,7 +352,9 @@ test_run_all(void)
     test_ram_dspace_list();
     test_ram_dspace_read_write();
     test_proc_client_watch();
+    test_proc_watch_index();
     test_ram_dspace_content_init();
+    test_ram_dspace_cow();
     test_nameserv_lib();
 
     test_print_log();
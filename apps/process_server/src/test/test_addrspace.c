@@ -29,21 +29,30 @@ int
 test_pd(void)
 {
     test_start("page directory");
-    seL4_CPtr p[PD_MAX];
-    for (int i = 0; i < PD_MAX; i++) {
-        p[i] = pd_assign(&procServ.PDList).kpdObject;
-        test_assert(p[i] != 0);
+    /* Assign more than the pool keeps spare, so both the reserve and on-demand paths are hit. */
+    const int numTestPD = PD_RESERVE_MAX + 2;
+    struct pd_info p[numTestPD];
+    for (int i = 0; i < numTestPD; i++) {
+        p[i] = pd_assign(&procServ.PDList);
+        test_assert(p[i].kpdObject != 0);
+        test_assert(p[i].kcnodeObject != 0);
+        test_assert(p[i].entry != NULL);
     }
-    for (int i = 0; i < PD_MAX; i++) {
-        pd_free(&procServ.PDList, p[i]);
+    for (int i = 0; i < numTestPD; i++) {
+        pd_free(&procServ.PDList, p[i].entry);
     }
+    test_assert(procServ.PDList.numFree <= PD_RESERVE_MAX);
     for (int i = 0; i < 2; i++) {
-        p[i] = pd_assign(&procServ.PDList).kpdObject;
-        test_assert(p[i] != 0);
+        p[i] = pd_assign(&procServ.PDList);
+        test_assert(p[i].kpdObject != 0);
     }
     for (int i = 0; i < 2; i++) {
-        pd_free(&procServ.PDList, p[i]);
+        pd_free(&procServ.PDList, p[i].entry);
     }
+    for (int i = 0; i < PD_RESERVE_MAX; i++) {
+        pd_replenish(&procServ.PDList);
+    }
+    test_assert(procServ.PDList.numFree >= PD_RESERVE);
     return test_success();
 }
 
@@ -53,7 +62,7 @@ int
 test_vspace(int run)
 {
     test_start(run == 0 ? "vspace (run 1)" : "vspace (run 2)");
-    const int numTestVS = MIN(8, MIN((PID_MAX - 1), PD_MAX));
+    const int numTestVS = MIN(8, (PID_MAX - 1));
     int error = -1;
 
     struct vs_vspace vs[numTestVS];
@@ -184,4 +193,103 @@ test_vspace_mapping(void)
     return test_success();
 }
 
+int
+test_vspace_reservations(void)
+{
+    test_start("vspace reservations");
+    const int numWindows = 2000;
+    const vaddr_t base = 0x10000000;
+    const vaddr_t stride = 2 * REFOS_PAGE_SIZE;
+    static int windowID[2000];
+
+    struct vs_vspace vs;
+    int error = vs_initialise(&vs, 31338);
+    test_assert(error == ESUCCESS);
+
+    vka_object_t frame;
+    error = vka_alloc_frame(&procServ.vka, seL4_PageBits, &frame);
+    test_assert(error == ESUCCESS);
+
+    /* Create one page windows, with a page gap between each, in a scattered order. Each window
+       is a vspace reservation. */
+    for (int i = 0; i < numWindows; i++) {
+        int j = (i * 1237) % numWindows;
+        error = vs_create_window(&vs, base + j * stride, REFOS_PAGE_SIZE,
+                W_PERMISSION_WRITE | W_PERMISSION_READ, true, &windowID[j]);
+        test_assert(error == ESUCCESS);
+    }
+
+    /* The gaps between windows must still be free, and every window must be mappable. Unmapping
+       looks up the reservation covering the address. */
+    error = vs_create_window(&vs, base + REFOS_PAGE_SIZE / 2, REFOS_PAGE_SIZE,
+            W_PERMISSION_READ, true, &windowID[0]);
+    test_assert(error == EINVALIDWINDOW);
+    for (int i = 0; i < numWindows; i++) {
+        error = vs_map(&vs, base + i * stride, &frame.cptr, 1);
+        test_assert(error == ESUCCESS);
+        error = vs_unmap(&vs, base + i * stride, 1);
+        test_assert(error == ESUCCESS);
+        error = vs_map(&vs, base + i * stride + REFOS_PAGE_SIZE, &frame.cptr, 1);
+        test_assert(error == EINVALIDWINDOW);
+    }
+
+    /* Delete every other window, then check the rest still work and the freed space is usable. */
+    for (int i = 0; i < numWindows; i += 2) {
+        vs_delete_window(&vs, windowID[i]);
+    }
+    for (int i = 1; i < numWindows; i += 2) {
+        error = vs_map(&vs, base + i * stride, &frame.cptr, 1);
+        test_assert(error == ESUCCESS);
+        error = vs_unmap(&vs, base + i * stride, 1);
+        test_assert(error == ESUCCESS);
+    }
+    for (int i = 0; i < numWindows; i += 2) {
+        error = vs_create_window(&vs, base + i * stride, REFOS_PAGE_SIZE + REFOS_PAGE_SIZE,
+                W_PERMISSION_WRITE | W_PERMISSION_READ, true, &windowID[i]);
+        test_assert(error == ESUCCESS);
+    }
+
+    /* Clean up. Deleting the vspace frees every remaining reservation. */
+    vs_unref(&vs);
+    test_assert(vs.magic != REFOS_VSPACE_MAGIC);
+    vka_free_object(&procServ.vka, &frame);
+    return test_success();
+}
+
+int
+test_vspace_teardown(void)
+{
+    test_start("vspace teardown");
+    const vaddr_t window = 0x20000000;
+    const vaddr_t windowSize = 0x4000000;
+    const vaddr_t stride = 0x40000;
+
+    vka_object_t frame;
+    int error = vka_alloc_frame(&procServ.vka, seL4_PageBits, &frame);
+    test_assert(error == ESUCCESS);
+
+    /* Map a frame sparsely across a large window, and tear the vspace down with it all still
+       mapped. Do it twice, so the second vspace gets a page directory back from the pool and
+       has to find it clean. */
+    for (int round = 0; round < 2; round++) {
+        struct vs_vspace vs;
+        int windowID;
+        error = vs_initialise(&vs, 31339);
+        test_assert(error == ESUCCESS);
+        error = vs_create_window(&vs, window, windowSize, W_PERMISSION_WRITE | W_PERMISSION_READ,
+                true, &windowID);
+        test_assert(error == ESUCCESS);
+        for (vaddr_t waddr = window; waddr < window + windowSize; waddr += stride) {
+            test_assert(vs_get_frame(&vs, waddr).capPtr == 0);
+            error = vs_map(&vs, waddr, &frame.cptr, 1);
+            test_assert(error == ESUCCESS);
+        }
+        vs_unref(&vs);
+        test_assert(vs.magic != REFOS_VSPACE_MAGIC);
+    }
+
+    vka_free_object(&procServ.vka, &frame);
+    return test_success();
+}
+
 #endif /* CONFIG_REFOS_RUN_TESTS */
\ No newline at end of file
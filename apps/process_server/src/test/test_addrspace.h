@@ -24,6 +24,10 @@ int test_vspace(int run);
 
 int test_vspace_mapping(void);
 
+int test_vspace_reservations(void);
+
+int test_vspace_teardown(void);
+
 #endif /* CONFIG_REFOS_RUN_TESTS */
 
 #endif /* _REFOS_PROCESS_SERVER_TEST_ADDRSPACE_H_ */
\ No newline at end of file
@@ -394,6 +394,72 @@ test_ram_dspace_content_init(void)
     return test_success();
 }
 
+int
+test_ram_dspace_cow(void)
+{
+    test_start("ram dataspace copy-on-write clone");
+    struct ram_dspace_list rlist;
+    ram_dspace_init(&rlist);
+    const int npages = 3;
+    char *buf = kmalloc(REFOS_PAGE_SIZE);
+    char *outbuf = kmalloc(REFOS_PAGE_SIZE);
+    test_assert(buf && outbuf);
+
+    /* Create a source dataspace, with content in the first two pages only. */
+    struct ram_dspace *source = ram_dspace_create(&rlist, npages * REFOS_PAGE_SIZE);
+    test_assert(source && source->magic == RAM_DATASPACE_MAGIC);
+    for (int i = 0; i < REFOS_PAGE_SIZE; i++) {
+        buf[i] = (char) (i % 251);
+    }
+    int error = ram_dspace_write(buf, REFOS_PAGE_SIZE, source, 0);
+    test_assert(error == ESUCCESS);
+    error = ram_dspace_write(buf, REFOS_PAGE_SIZE, source, REFOS_PAGE_SIZE);
+    test_assert(error == ESUCCESS);
+
+    /* Clone it, and make sure the clone holds a reference to the source. */
+    struct ram_dspace *clone = ram_dspace_clone(&rlist, source);
+    test_assert(clone && clone->magic == RAM_DATASPACE_MAGIC);
+    test_assert(clone->cowSource == source);
+    test_assert(clone->npages == source->npages);
+    test_assert(source->ref == 2);
+
+    /* Reading shares the source's pages, until the source doesn't have one. */
+    bool shared = false;
+    seL4_CPtr frame = ram_dspace_get_page_shared(clone, 0, &shared);
+    test_assert(shared && frame == ram_dspace_check_page(source, 0));
+    test_assert(ram_dspace_check_page(clone, 0) == 0);
+    frame = ram_dspace_get_page_shared(clone, REFOS_PAGE_SIZE * 2, &shared);
+    test_assert(!shared && frame && frame == ram_dspace_check_page(clone, REFOS_PAGE_SIZE * 2));
+
+    /* Writing to the clone copies the page, and leaves the source alone. */
+    char val = 'x';
+    error = ram_dspace_write(&val, 1, clone, REFOS_PAGE_SIZE + 5);
+    test_assert(error == ESUCCESS);
+    test_assert(ram_dspace_check_page(clone, REFOS_PAGE_SIZE) != 0);
+    test_assert(ram_dspace_check_page(clone, REFOS_PAGE_SIZE) !=
+                ram_dspace_check_page(source, REFOS_PAGE_SIZE));
+    error = ram_dspace_read(outbuf, REFOS_PAGE_SIZE, clone, REFOS_PAGE_SIZE);
+    test_assert(error == ESUCCESS);
+    for (int i = 0; i < REFOS_PAGE_SIZE; i++) {
+        test_assert(outbuf[i] == (i == 5 ? 'x' : buf[i]));
+    }
+    error = ram_dspace_read(outbuf, REFOS_PAGE_SIZE, source, REFOS_PAGE_SIZE);
+    test_assert(error == ESUCCESS);
+    test_assert(outbuf[5] == buf[5]);
+
+    /* The source lives on until the clone lets go of it. */
+    int sourceID = source->ID;
+    ram_dspace_unref(&rlist, sourceID);
+    test_assert(ram_dspace_get(&rlist, sourceID) == source);
+    test_assert(source->ref == 1);
+    ram_dspace_unref(&rlist, clone->ID);
+    test_assert(ram_dspace_get(&rlist, sourceID) == NULL);
+
+    kfree(buf);
+    kfree(outbuf);
+    ram_dspace_deinit(&rlist);
+    return test_success();
+}
 
 /* ------------------------------- Ring buffer module test ------------------------------- */
 
@@ -28,6 +28,8 @@ int test_ram_dspace_read_write(void);
 
 int test_ram_dspace_content_init(void);
 
+int test_ram_dspace_cow(void);
+
 int test_ringbuffer(void);
 
 #endif /* CONFIG_REFOS_RUN_TESTS */
@@ -22,6 +22,8 @@
 #include "../system/process/pid.h"
 #include "../system/process/thread.h"
 #include "../system/process/proc_client_watch.h"
+#include "../system/process/process.h"
+#include "../system/memserv/ringbuffer.h"
 #include "../state.h"
 #include "../common.h"
 
@@ -128,12 +130,14 @@ test_thread(void)
 
     /* Create the threads. */
     for (int i = 0; i < numTestThreads; i++) {
-        int error = thread_config(&thr[i], 12, 1337, &vs);
+        int error = thread_config(&thr[i], 12, 12, CONFIG_PROCSERV_SCHED_BUDGET_US,
+                                 CONFIG_PROCSERV_SCHED_PERIOD_US, 1337, &vs);
         test_assert(error == ESUCCESS);
         test_assert(thr[i].magic == REFOS_PROCESS_THREAD_MAGIC);
         test_assert(thr[i].priority == 12);
         test_assert(thr[i].vspaceRef == &vs);
         test_assert(thr[i].entryPoint == 1337);
+        test_assert(thr[i].cpuTimeUS == 0);
 
         /* Test that the vspace has been referenced. */
         test_assert(vs.magic == REFOS_VSPACE_MAGIC);
@@ -197,10 +201,10 @@ test_proc_client_watch(void)
     seL4_CPtr cpInvalid = client_watch_get(&wl, 0x2FF);
     test_assert(cpInvalid == 0);
 
-    /* Get our PIDs and see if we get out EPs back. */
+    /* Get our PIDs and see if we get our first EP back; the later ones were released. */
     for (int i = 0; i < 4; i++) {
         seL4_CPtr cp = client_watch_get(&wl, dummyPIDs[i]);
-        test_assert(cp == dummyEPMinted[i].capPtr);
+        test_assert(cp == dummyEPMinted[0].capPtr);
         /* Unwatch the client and see if we still get it. */
         client_unwatch(&wl, dummyPIDs[i]);
         cp = client_watch_get(&wl, dummyPIDs[i]);
@@ -209,6 +213,7 @@ test_proc_client_watch(void)
 
     /* Release all allocated endpoints. Note that the client_watch call takes ownership of the
        minted caps along with their cslots, so we do NOT need to free those here. */
+    client_watch_release(&wl);
     for (int i = 0; i < 4; i++) {
         cspacepath_t path;
         vka_cspace_make_path(&procServ.vka, dummyEP[i].cptr, &path);
@@ -217,7 +222,144 @@ test_proc_client_watch(void)
         vka_free_object(&procServ.vka, &dummyEP[i]);
     }
 
-    client_watch_release(&wl);
+    return test_success();
+}
+
+/* ------------------------------ Watcher reverse index test ------------------------------------ */
+
+#define TEST_WATCH_SERVERS 4
+#define TEST_WATCH_CLIENTS 64
+#define TEST_WATCH_ROUNDS 4
+#define TEST_WATCH_BADGE 0x42
+
+static struct proc_watch_index testWatchIndex;
+
+int
+test_proc_watch_index(void)
+{
+    test_start("client watch index");
+    struct proc_watch_index *wi = &testWatchIndex;
+    client_watch_index_init(wi);
+    struct ram_dspace_list rlist;
+    ram_dspace_init(&rlist);
+
+    /* Set up some fake servers, each with a notification buffer and a notify EP. */
+    uint32_t serverPID[TEST_WATCH_SERVERS];
+    vka_object_t serverEP[TEST_WATCH_SERVERS];
+    for (int s = 0; s < TEST_WATCH_SERVERS; s++) {
+        serverPID[s] = pid_alloc(&procServ.PIDList);
+        test_assert(serverPID[s] != PID_NULL);
+        struct proc_pcb *pcb = pid_get_pcb(&procServ.PIDList, serverPID[s]);
+        test_assert(pcb);
+        pcb->magic = REFOS_PCB_MAGIC;
+        pcb->pid = serverPID[s];
+        client_watch_init(&pcb->clientWatchList);
+        client_watch_index_attach(wi, &pcb->clientWatchList, pcb->pid);
+
+        struct ram_dspace *ds = ram_dspace_create(&rlist, RINGBUFFER_METADATA_SIZE +
+                (TEST_WATCH_ROUNDS * TEST_WATCH_CLIENTS + 1) * sizeof(struct proc_notification));
+        test_assert(ds);
+        pcb->notificationBuffer = rb_create(ds, RB_WRITEONLY);
+        test_assert(pcb->notificationBuffer);
+
+        int error = vka_alloc_notification(&procServ.vka, &serverEP[s]);
+        test_assert(!error);
+    }
+
+    for (int round = 0; round < TEST_WATCH_ROUNDS; round++) {
+        /* Create a batch of clients, and have every server watch them, except that the first
+           server unwatches the odd ones again. */
+        uint32_t clientPID[TEST_WATCH_CLIENTS];
+        uint32_t expected = 0;
+        for (int c = 0; c < TEST_WATCH_CLIENTS; c++) {
+            clientPID[c] = pid_alloc(&procServ.PIDList);
+            test_assert(clientPID[c] != PID_NULL);
+            for (int s = 0; s < TEST_WATCH_SERVERS; s++) {
+                struct proc_pcb *pcb = pid_get_pcb(&procServ.PIDList, serverPID[s]);
+                cspacepath_t srcPath, destPath;
+                vka_cspace_make_path(&procServ.vka, serverEP[s].cptr, &srcPath);
+                int error = vka_cspace_alloc_path(&procServ.vka, &destPath);
+                test_assert(!error);
+                error = vka_cnode_mint(&destPath, &srcPath, seL4_AllRights,
+                                       seL4_CapData_Badge_new(TEST_WATCH_BADGE));
+                test_assert(!error);
+                error = client_watch(&pcb->clientWatchList, clientPID[c], destPath.capPtr);
+                test_assert(error == ESUCCESS);
+                expected++;
+            }
+            test_assert(cvector_count(&wi->watchers[clientPID[c]]) == TEST_WATCH_SERVERS);
+            if (c % 2) {
+                struct proc_pcb *pcb = pid_get_pcb(&procServ.PIDList, serverPID[0]);
+                client_unwatch(&pcb->clientWatchList, clientPID[c]);
+                test_assert(cvector_count(&wi->watchers[clientPID[c]]) == TEST_WATCH_SERVERS - 1);
+                expected--;
+            }
+        }
+
+        /* Kill all the clients, flushing after each half. Every server is signalled exactly once
+           per flush, however many of its clients died. */
+        uint32_t notifications = wi->numNotifications;
+        uint32_t signals = wi->numSignals;
+        for (int c = 0; c < TEST_WATCH_CLIENTS; c++) {
+            client_watch_notify_death(wi, clientPID[c]);
+            test_assert(cvector_count(&wi->watchers[clientPID[c]]) == 0);
+            pid_free(&procServ.PIDList, clientPID[c]);
+            if (c != TEST_WATCH_CLIENTS / 2 - 1 && c != TEST_WATCH_CLIENTS - 1) {
+                continue;
+            }
+            client_watch_flush(wi);
+            for (int s = 0; s < TEST_WATCH_SERVERS; s++) {
+                seL4_Word badge = 0;
+                seL4_Poll(serverEP[s].cptr, &badge);
+                test_assert(badge == TEST_WATCH_BADGE);
+                badge = 0;
+                seL4_Poll(serverEP[s].cptr, &badge);
+                test_assert(badge == 0);
+            }
+        }
+        test_assert(wi->numNotifications - notifications == expected);
+        test_assert(wi->numSignals - signals == 2 * TEST_WATCH_SERVERS);
+        for (int s = 0; s < TEST_WATCH_SERVERS; s++) {
+            struct proc_pcb *pcb = pid_get_pcb(&procServ.PIDList, serverPID[s]);
+            test_assert(cvector_count(&pcb->clientWatchList.clientList) == 0);
+        }
+    }
+
+    /* A dying server drops out of the index, along with the watches it made. */
+    uint32_t clientPID = pid_alloc(&procServ.PIDList);
+    test_assert(clientPID != PID_NULL);
+    struct proc_pcb *pcb = pid_get_pcb(&procServ.PIDList, serverPID[0]);
+    cspacepath_t srcPath, destPath;
+    vka_cspace_make_path(&procServ.vka, serverEP[0].cptr, &srcPath);
+    int error = vka_cspace_alloc_path(&procServ.vka, &destPath);
+    test_assert(!error);
+    error = vka_cnode_copy(&destPath, &srcPath, seL4_AllRights);
+    test_assert(!error);
+    error = client_watch(&pcb->clientWatchList, clientPID, destPath.capPtr);
+    test_assert(error == ESUCCESS);
+    test_assert(cvector_count(&wi->watchers[clientPID]) == 1);
+    client_watch_release(&pcb->clientWatchList);
+    test_assert(cvector_count(&wi->watchers[clientPID]) == 0);
+    pid_free(&procServ.PIDList, clientPID);
+
+    /* Clean up the fake servers. */
+    for (int s = 0; s < TEST_WATCH_SERVERS; s++) {
+        pcb = pid_get_pcb(&procServ.PIDList, serverPID[s]);
+        if (s != 0) {
+            client_watch_release(&pcb->clientWatchList);
+        }
+        rb_delete(pcb->notificationBuffer);
+        pcb->notificationBuffer = NULL;
+        pcb->magic = 0;
+        pid_free(&procServ.PIDList, serverPID[s]);
+
+        cspacepath_t path;
+        vka_cspace_make_path(&procServ.vka, serverEP[s].cptr, &path);
+        vka_cnode_revoke(&path);
+        vka_cnode_delete(&path);
+        vka_free_object(&procServ.vka, &serverEP[s]);
+    }
+    ram_dspace_deinit(&rlist);
     return test_success();
 }
 
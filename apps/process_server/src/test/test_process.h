@@ -24,6 +24,8 @@ int test_thread(void);
 
 int test_proc_client_watch(void);
 
+int test_proc_watch_index(void);
+
 #endif /* CONFIG_REFOS_RUN_TESTS */
 
 #endif /* _REFOS_PROCESS_SERVER_TEST_PROCESS_MODULE_H_ */
\ No newline at end of file
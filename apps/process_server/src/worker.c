@@ -0,0 +1,124 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+#include <string.h>
+#include <refos-rpc/rpc.h>
+#include "worker.h"
+#include "state.h"
+#include "common.h"
+
+/*! @file
+    @brief Per-core worker threads for the process server. */
+
+/*! @brief Configure one worker.
+    @param w The worker to configure.
+    @param core The core the worker is pinned to.
+    @param endpoint The endpoint the worker receives on. (No ownership)
+    @param createThread Whether to create a new thread for the worker.
+*/
+static void
+worker_config(struct procserv_worker *w, uint32_t core, seL4_CPtr endpoint, bool createThread)
+{
+    assert(w);
+    memset(w, 0, sizeof(struct procserv_worker));
+    w->magic = PROCSERV_WORKER_MAGIC;
+    w->core = core;
+    w->endpoint = endpoint;
+
+    if (!createThread) {
+        /* The initial thread uses the receive slot set up in initialise(). */
+        w->IPCCapRecv = procServ.IPCCapRecv;
+        return;
+    }
+
+    int error = vka_cspace_alloc_path(&procServ.vka, &w->IPCCapRecv);
+    assert(!error);
+
+    error = sel4utils_configure_thread(
+            &procServ.vka, &procServ.vspace, &procServ.vspace, 0, seL4_MaxPrio,
+            seL4_CapInitThreadCNode, seL4_NilData, &w->thread
+    );
+    assert(!error);
+    w->hasThread = true;
+
+#if CONFIG_MAX_NUM_NODES > 1
+    error = seL4_TCB_SetAffinity(w->thread.tcb.cptr, core);
+    assert(!error);
+#endif
+    (void) error;
+}
+
+void
+worker_init(struct procserv_worker_list *wl)
+{
+    assert(wl);
+    memset(wl, 0, sizeof(struct procserv_worker_list));
+    int error = 0;
+
+    /* The initial thread is the syscall worker of the boot core. */
+    worker_config(&wl->syscall[0], 0, procServ.endpoint.cptr, false);
+    if (PROCSERV_NUM_CORES == 1) {
+        /* Uniprocessor. Faults go to the process server endpoint, as syscalls do. */
+        wl->faultEndpoint[0] = procServ.endpoint;
+        return;
+    }
+
+    for (uint32_t core = 0; core < PROCSERV_NUM_CORES; core++) {
+        error = vka_alloc_endpoint(&procServ.vka, &wl->faultEndpoint[core]);
+        assert(!error);
+        worker_config(&wl->fault[core], core, wl->faultEndpoint[core].cptr, true);
+        if (core > 0) {
+            worker_config(&wl->syscall[core], core, procServ.endpoint.cptr, true);
+        }
+    }
+    (void) error;
+}
+
+void
+worker_start(struct procserv_worker_list *wl, sel4utils_thread_entry_fn entry)
+{
+    assert(wl && entry);
+    for (uint32_t core = 0; core < PROCSERV_NUM_CORES; core++) {
+        struct procserv_worker *w[2] = { &wl->syscall[core], &wl->fault[core] };
+        for (int i = 0; i < 2; i++) {
+            if (w[i]->magic != PROCSERV_WORKER_MAGIC || !w[i]->hasThread) {
+                continue;
+            }
+            int error = sel4utils_start_thread(&w[i]->thread, entry, (void*) w[i], NULL, 1);
+            if (error) {
+                ROS_ERROR("worker_start failed to start worker on core %u.", core);
+                assert(!"worker_start failed.");
+            }
+        }
+    }
+}
+
+void
+worker_thread_init(struct procserv_worker *w)
+{
+    assert(w && w->magic == PROCSERV_WORKER_MAGIC);
+    rpc_setup_recv_cspace(w->IPCCapRecv.root, w->IPCCapRecv.capPtr, w->IPCCapRecv.capDepth);
+}
+
+uint32_t
+worker_next_core(struct procserv_worker_list *wl)
+{
+    assert(wl);
+    return __sync_fetch_and_add(&wl->nextCore, 1) % PROCSERV_NUM_CORES;
+}
+
+seL4_CPtr
+worker_fault_endpoint(struct procserv_worker_list *wl, uint32_t core)
+{
+    assert(wl && core < PROCSERV_NUM_CORES);
+    return wl->faultEndpoint[core].cptr;
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+#ifndef _REFOS_PROCESS_SERVER_WORKER_H_
+#define _REFOS_PROCESS_SERVER_WORKER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <autoconf.h>
+#include <sel4/sel4.h>
+#include <vka/object.h>
+#include <vka/cspacepath_t.h>
+#include <sel4utils/thread.h>
+
+/*! @file
+    @brief Per-core worker threads for the process server.
+
+    On a multi-core kernel, the process server runs a pair of worker threads pinned to every core.
+    The syscall workers all wait on the shared process server endpoint, so any idle core may pick
+    up a syscall, and badged caps minted from that endpoint (liveness, window and dataspace caps)
+    unwrap no matter which worker receives them. The fault workers each wait on a per-core fault
+    endpoint. Client threads are spread round-robin across cores and pinned there, and each
+    thread's fault endpoint is the one belonging to its core, so a VM fault is received and
+    replied to on the core the faulting thread runs on, without an IPI.
+
+    Before dispatching a message, a worker takes only the locks that message needs (see lock.h).
+    Faults and the common per-client syscalls take the tables they use for reading plus their
+    client's lock, so messages from different clients are handled in parallel; anything else
+    holds every table for writing and runs alone. The RPC library's marshalling state is
+    thread-local, and each worker has its own cap receive slot.
+
+    On a single-core kernel there are no extra threads: the initial thread is the only worker, and
+    the per-core fault endpoint is the process server endpoint itself.
+*/
+
+#ifndef CONFIG_MAX_NUM_NODES
+    #define CONFIG_MAX_NUM_NODES 1
+#endif
+
+#define PROCSERV_NUM_CORES CONFIG_MAX_NUM_NODES
+#define PROCSERV_WORKER_MAGIC 0x3C0A5E41
+
+/*! @brief A single process server worker thread. */
+struct procserv_worker {
+    uint32_t magic;
+    uint32_t core;
+    seL4_CPtr endpoint;                /*!< The EP this worker receives on. (No ownership) */
+    cspacepath_t IPCCapRecv;           /*!< This worker's cap receive slot. */
+    bool hasThread;                    /*!< False for the process server initial thread. */
+    sel4utils_thread_t thread;
+    uint32_t nMessages;
+};
+
+/*! @brief The list of all process server workers. */
+struct procserv_worker_list {
+    struct procserv_worker syscall[PROCSERV_NUM_CORES];
+    struct procserv_worker fault[PROCSERV_NUM_CORES];
+    vka_object_t faultEndpoint[PROCSERV_NUM_CORES];
+    uint32_t nextCore;
+};
+
+/*! @brief Initialise the process server workers, creating the per-core fault endpoints and the
+           worker threads (without starting them). Must be called after the process server
+           endpoint and initial receive slot are set up.
+    @param wl The worker list to initialise.
+*/
+void worker_init(struct procserv_worker_list *wl);
+
+/*! @brief Start every worker thread other than the initial thread.
+    @param wl The worker list.
+    @param entry The worker entry point. arg0 is the struct procserv_worker.
+*/
+void worker_start(struct procserv_worker_list *wl, sel4utils_thread_entry_fn entry);
+
+/*! @brief Set up the calling worker thread: make its receive slot the one the RPC library reads
+           received caps from. Must be called by each worker before it receives any message.
+    @param w The calling worker.
+*/
+void worker_thread_init(struct procserv_worker *w);
+
+/*! @brief Pick the core to place a new client thread on, round-robin.
+    @param wl The worker list.
+    @return The core ID.
+*/
+uint32_t worker_next_core(struct procserv_worker_list *wl);
+
+/*! @brief Get the fault endpoint for a given core.
+    @param wl The worker list.
+    @param core The core ID.
+    @return CPtr to the unbadged fault endpoint of that core. (No ownership)
+*/
+seL4_CPtr worker_fault_endpoint(struct procserv_worker_list *wl, uint32_t core);
+
+#endif /* _REFOS_PROCESS_SERVER_WORKER_H_ */
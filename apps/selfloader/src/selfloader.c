@@ -81,9 +81,42 @@ sl_setup_elf_header(serv_connection_t* fsSession)
         ROS_ERROR("sl_setup_elf_header failed to open file.");
         return selfloaderState.elfFileHeader.err;
     }
+
+    /* Shared segments are only valid for the version of the file they were loaded from. */
+    selfloaderState.elfFileGeneration = data_ioctl(fsSession->serverSession,
+            selfloaderState.elfFileHeader.dataspace, REFOS_IOCTL_GET_GENERATION, 0);
     return ESUCCESS;
 }
 
+/*! @brief Ask the process server to load the program from its process template.
+
+   The template is only good if it was captured from the file as it is now, so we look up the
+   file's content generation first. The process server gives us the program's stack and heap caps
+   in the first cslots of our region, so every cap we allocated here is released before asking.
+
+   @param filePath The program's file path.
+   @return ESUCCESS if the program was loaded, refos_err_t otherwise.
+ */
+static int
+sl_template_load(char *filePath)
+{
+    serv_connection_t conn = serv_connect(filePath);
+    if (conn.error != ESUCCESS) {
+        return conn.error;
+    }
+    int generation = -EINVALID;
+    int error = EINVALID;
+    seL4_CPtr dspace = data_open(conn.serverSession, conn.serverMountPoint.dspaceName, 0, 0, 0,
+                                 &error);
+    if (error == ESUCCESS && dspace) {
+        generation = data_ioctl(conn.serverSession, dspace, REFOS_IOCTL_GET_GENERATION, 0);
+        data_close(conn.serverSession, dspace);
+        csfree_delete(dspace);
+    }
+    serv_disconnect(&conn);
+    return proc_template_load(generation);
+}
+
 /*! @brief Helper function to map out a zero vspace segment. Simply opens an anonymous dataspace
           and maps it at the right vaddr.
    @param start The start / base of the zero segment region window.
@@ -148,6 +181,69 @@ sl_create_zero_segment(seL4_Word start, seL4_Word size, seL4_Word windowSize, sl
     return ESUCCESS;
 }
 
+/*! @brief Hand a loaded ELF segment over to the process server's template capture.
+
+   Touches every file-initialised page of the segment first, so that all of it has been content
+   initialised from the file server. A failed capture is not fatal; the process server abandons
+   the template, and we carry on loading as normal.
+
+   @param si The ELF segment info structure, read from the ELF header.
+   @param dataspace The segment's loaded anon dataspace.
+*/
+static void
+sl_template_capture_segment(struct sl_elf_segment_info si, seL4_CPtr dataspace)
+{
+    volatile char *page = (volatile char *) REFOS_PAGE_ALIGN(si.vaddr);
+    for (seL4_Word i = 0; i < si.fileSize; i += REFOS_PAGE_SIZE) {
+        (void) page[i];
+    }
+
+    int error = proc_template_add_segment(dataspace, si.vaddr, si.fileSize, si.segmentSize);
+    if (error != ESUCCESS) {
+        dprintf("    Template capture abandoned (%s).\n", refos_error_str(error));
+        selfloaderState.captureTemplate = false;
+    }
+}
+
+/*! @brief Open the process server's shared dataspace for a read-only ELF segment.
+
+   Every instance of a program maps the same dataspace for each of its read-only segments, so
+   their text is only loaded and held once. The first selfloader to get the dataspace must
+   content-initialise it; later ones find it already initialised. Any failure simply means the
+   segment gets loaded privately.
+
+   @param si The ELF segment info structure, read from the ELF header.
+   @param initContent Output flag, whether the dataspace still needs content initialising.
+   @return true if selfloaderState.elfSegment.dataspace is now the shared dataspace, false if
+           the segment must be loaded privately.
+*/
+static bool
+sl_open_shared_segment(struct sl_elf_segment_info si, bool *initContent)
+{
+    sl_dataspace_t *elfSegment = &selfloaderState.elfSegment;
+    refos_err_t error = EINVALID;
+    int create = 0;
+
+    /* Without a generation, we couldn't tell if the file changed since others loaded it. */
+    if (selfloaderState.elfFileGeneration < 0) {
+        dvprintf("    Not sharing segment (no file generation).\n");
+        return false;
+    }
+
+    elfSegment->dataspace = proc_shared_segment_open(refos_static_param(),
+                                                     (uint32_t) selfloaderState.elfFileGeneration,
+                                                     si.source, si.vaddr, si.fileSize, &create,
+                                                     &error);
+    if (!elfSegment->dataspace || error != ESUCCESS) {
+        dvprintf("    Not sharing segment (%s).\n", refos_error_str(error));
+        elfSegment->dataspace = 0;
+        return false;
+    }
+    dvprintf("    Sharing segment%s.\n", create ? ", first instance" : "");
+    *initContent = (create != 0);
+    return true;
+}
+
 /*! @brief Load an ELF segment region into current vspace.
    @param si The ELF segment infor structure, read from the ELF header.
    @param fsSession The dataserver session containing ELF file contents.
@@ -174,21 +270,33 @@ sl_elf_load_region(struct sl_elf_segment_info si, serv_connection_t* fsSession)
         return EINVALID;
     }
 
-    /* Open an anon ram dataspace on procserv. */
-    dvprintf("    Opening dataspace...\n");
-    elfSegment->dataspace = data_open(REFOS_PROCSERV_EP, "anon", 0, 0, si.fileSize, &error);
-    if (error != ESUCCESS) {
-        ROS_ERROR("Failed to open ELF segment anon dataspace.");
-        return error;
+    /* Read-only segments are shared with every other instance of the program, unless we're
+       capturing a template, which needs segments of our own. */
+    bool shared = false;
+    bool initContent = true;
+    if (!(si.flags & PF_W) && !selfloaderState.captureTemplate) {
+        shared = sl_open_shared_segment(si, &initContent);
+    }
+
+    /* Otherwise open an anon ram dataspace on procserv. */
+    if (!shared) {
+        dvprintf("    Opening dataspace...\n");
+        elfSegment->dataspace = data_open(REFOS_PROCSERV_EP, "anon", 0, 0, si.fileSize, &error);
+        if (error != ESUCCESS) {
+            ROS_ERROR("Failed to open ELF segment anon dataspace.");
+            return error;
+        }
     }
 
     /* Initialise segment content with ELF content. */
-    dvprintf("    Initialising dataspace contents...\n");
-    error = data_init_data(fsSession->serverSession, elfSegment->dataspace, elfFile->dataspace,
-                           si.source - alignCorrectionOffset);
-    if (error) {
-        ROS_ERROR("Failed to init data for ELF segment.");
-        return error;
+    if (initContent) {
+        dvprintf("    Initialising dataspace contents...\n");
+        error = data_init_data(fsSession->serverSession, elfSegment->dataspace,
+                               elfFile->dataspace, si.source - alignCorrectionOffset);
+        if (error) {
+            ROS_ERROR("Failed to init data for ELF segment.");
+            return error;
+        }
     }
 
     /* Calculate the page-aligned window end position. */
@@ -199,7 +307,8 @@ sl_elf_load_region(struct sl_elf_segment_info si, serv_connection_t* fsSession)
 
     /* Create the file-initialised window for this data initialised segment anon dspace. */
     dvprintf("    Creating memory window ...");
-    elfSegment->window = proc_create_mem_window(REFOS_PAGE_ALIGN(si.vaddr), windowSize);
+    elfSegment->window = proc_create_mem_window_ext(REFOS_PAGE_ALIGN(si.vaddr), windowSize,
+            shared ? PROC_WINDOW_PERMISSION_READ : PROC_WINDOW_PERMISSION_READWRITE, 0x0);
     if (!elfSegment->window || ROS_ERRNO() != ESUCCESS) {
         ROS_ERROR("Failed to create ELF segment window.");
         return ROS_ERRNO();
@@ -213,6 +322,11 @@ sl_elf_load_region(struct sl_elf_segment_info si, serv_connection_t* fsSession)
         return error;
     }
 
+    /* If we're capturing a template, load in every page and hand the segment over. */
+    if (selfloaderState.captureTemplate) {
+        sl_template_capture_segment(si, elfSegment->dataspace);
+    }
+
     /* Clean up the capabilities to this segment so we can re-use the structure. */
     csfree_delete(elfSegment->window);
     csfree_delete(elfSegment->dataspace);
@@ -282,6 +396,16 @@ sl_elf_load(char *file, serv_connection_t* fsSession)
 
     /* Save the end of the program. */
     selfloaderState.endOfProgram = si.vaddr + si.segmentSize;
+    return ESUCCESS;
+}
+
+/*! @brief Create the stack and heap segments, after the end of the loaded program.
+    @return ESUCCESS on success, refos_err_t otherwise.
+*/
+static int
+sl_create_stack_heap(void)
+{
+    int error;
     selfloaderState.heapRegionStart = REFOS_PAGE_ALIGN(selfloaderState.endOfProgram + 0x2800);
 
     /* Create and map zeroed stack segment. */
@@ -314,6 +438,8 @@ sl_setup_bootinfo_buffer(void)
     procInfo->elfSegmentEnd = (uint32_t) selfloaderState.endOfProgram;
     procInfo->heapRegion = selfloaderState.heapRegion;
     procInfo->stackRegion = selfloaderState.stackRegion;
+    procInfo->templateEntry = 0;
+    procInfo->templateCapture = 0;
 }
 
 /*! @brief Push onto the stack.
@@ -355,6 +481,26 @@ static uintptr_t stack_copy_args(uintptr_t stack_top, int data_len, char *data[]
     return new_stack_top;
 }
 
+/*! @brief Split the arguments given to proc_new_proc() into argv, after the program path.
+   @param argBuffer Scratch space for the arguments, PROCESS_STATICPARAM_STR_SIZE bytes long.
+   @param argv Output argument vector, SELFLOADER_MAX_ARGS entries long.
+   @return The argument count.
+*/
+static int sl_split_args(char *argBuffer, char *argv[])
+{
+    int argc = 0;
+    argv[argc++] = refos_static_param();
+
+    strncpy(argBuffer, refos_static_param_args(), PROCESS_STATICPARAM_STR_SIZE - 1);
+    argBuffer[PROCESS_STATICPARAM_STR_SIZE - 1] = '\0';
+    char *save = NULL;
+    for (char *arg = strtok_r(argBuffer, " ", &save); arg && argc < SELFLOADER_MAX_ARGS;
+            arg = strtok_r(NULL, " ", &save)) {
+        argv[argc++] = arg;
+    }
+    return argc;
+}
+
 /*! @brief Initialise the stack for how musllibc expects it.
    @param elf The mapped ELF header containing entry point to jump into.
    @param stack_top The current top of the stack.
@@ -386,9 +532,16 @@ static uintptr_t system_v_init(char *elf, uintptr_t stack_top)
     uintptr_t dest_envp[envc];
     Elf_auxv_t auxv[] = { {.a_type = AT_SYSINFO, .a_un = {sysinfo} } };
 
+    char argBuffer[PROCESS_STATICPARAM_STR_SIZE];
+    char *argv[SELFLOADER_MAX_ARGS];
+    int argc = sl_split_args(argBuffer, argv);
+    uintptr_t dest_argv[argc];
+
     stack_top = stack_copy_args(stack_top, envc, envp, dest_envp);
+    stack_top = stack_copy_args(stack_top, argc, argv, dest_argv);
 
     size_t stack_size = 5 * sizeof(seL4_Word) + /* constants */
+                        sizeof(dest_argv) + /* args */
                         sizeof(dest_envp) + /* aux */
                         sizeof(auxv[0]); /* env */
 
@@ -410,22 +563,24 @@ static uintptr_t system_v_init(char *elf, uintptr_t stack_top)
     /* Write env */
     stack_top = stack_write(stack_top, dest_envp, sizeof(dest_envp));
 
-    /* NULL terimnate args (we don't have any) */
+    /* NULL terimnate args */
     stack_top = stack_write_constant(stack_top, 0);
 
-    /* Write argument count (we don't have any args) */
-    stack_top = stack_write_constant(stack_top, 0);
+    /* Write args: the program path, then whatever was passed to proc_new_proc(). */
+    stack_top = stack_write(stack_top, dest_argv, sizeof(dest_argv));
+
+    /* Write argument count */
+    stack_top = stack_write_constant(stack_top, argc);
 
     return stack_top;
 }
 
 /*! @brief Jumps into loaded ELF program in current vspace.
-   @param file The mapped ELF header containing entry point to jump into.
+   @param entryPoint The ELF entry point to jump into.
  */
 static inline void
-sl_elf_start(char *file)
+sl_elf_start(seL4_Word entryPoint)
 {
-    seL4_Word entryPoint = elf_getEntryPoint(file);
     seL4_Word stackPointer = PROCESS_STACK_BOT + PROCESS_RLIMIT_STACK;
 
     /* Future Work 3:
@@ -438,7 +593,16 @@ sl_elf_start(char *file)
        variables. Ideally, user processes would use their own system call table.
     */
 
-    stackPointer = system_v_init(file, stackPointer);
+    stackPointer = system_v_init(NULL, stackPointer);
+
+    /* The program must not inherit our template and shared segment privileges. The process
+       server already dropped them for a preloaded selfloader. */
+    if (!selfloaderState.preloaded) {
+        int error = proc_selfload_done();
+        if (error != ESUCCESS) {
+            ROS_WARNING("Failed to drop selfloader privileges (%s).", refos_error_str(error));
+        }
+    }
 
     dprintf("=============== Jumping into ELF program ==================\n");
 
@@ -487,7 +651,6 @@ main(void)
     refos_seL4_debug_override_stdout();
     dprintf(COLOUR_C "--- Starting RefOS process selfloader ---\n" COLOUR_RESET);
     refosio_setup_morecore_override(slMiniMorecoreRegion, SELFLOADER_MINI_MORECORE_REGION_SIZE);
-    refos_initialise_selfloader();
     int error = 0;
 
     /* Sanity check the given ELF file path. */
@@ -497,6 +660,25 @@ main(void)
         return EINVALIDPARAM;
     }
 
+    refos_initialise_selfloader();
+
+    /* If there is a process template for the program, and the process server loads the program
+       from it, along with its stack, heap and boot info, all that's left is to jump in. */
+    struct sl_procinfo_s *procInfo = refos_static_param_procinfo();
+    if (procInfo->templateReady) {
+        error = sl_template_load(filePath);
+        if (error == ESUCCESS && procInfo->magic == SELFLOADER_PROCINFO_MAGIC &&
+                procInfo->templateEntry) {
+            dprintf("    Loaded [%s] from template.\n", filePath);
+            selfloaderState.preloaded = true;
+            sl_elf_start(procInfo->templateEntry);
+            ROS_ERROR("ERROR: Should not ever be here!\n");
+            while(1);
+        }
+        dprintf("    Template for [%s] not used (%s).\n", filePath, refos_error_str(error));
+    }
+    selfloaderState.captureTemplate = (procInfo->templateCapture != 0);
+
     /* Connect to the file server. */
     dprintf("    Connect to the server for [%s]\n", filePath);
     selfloaderState.fileservConnection = serv_connect(filePath);
@@ -518,13 +700,25 @@ main(void)
     if (error) {
         return error;
     }
+    seL4_Word entryPoint = elf_getEntryPoint(selfloaderState.elfFileHeader.vaddr);
+    if (selfloaderState.captureTemplate) {
+        error = proc_template_commit(entryPoint, selfloaderState.endOfProgram,
+                                     selfloaderState.elfFileGeneration);
+        if (error != ESUCCESS) {
+            dprintf("    Template commit failed (%s).\n", refos_error_str(error));
+        }
+    }
+    error = sl_create_stack_heap();
+    if (error) {
+        return error;
+    }
 
     /* We don't need the file server session any more. */
     serv_disconnect(&selfloaderState.fileservConnection);
 
     /* Set up bootinfo and jump into ELF entry! */
     sl_setup_bootinfo_buffer();
-    sl_elf_start(selfloaderState.elfFileHeader.vaddr);
+    sl_elf_start(entryPoint);
 
     ROS_ERROR("ERROR: Should not ever be here!\n");
     assert(!"Something is wrong. Should not be here.");
@@ -46,6 +46,7 @@
 #endif /* CONFIG_WORD_SIZE */
 
 #define ENV_STR_SIZE 128
+#define SELFLOADER_MAX_ARGS 16
 
 #define AT_SYSINFO 32
 
@@ -83,8 +84,12 @@ struct sl_state {
     serv_connection_t fileservConnection;
 
     data_mapping_t elfFileHeader;
+    int elfFileGeneration; /*!< Content generation of the ELF file, negative if unknown. */
     sl_dataspace_t elfSegment;
 
+    bool captureTemplate; /*!< Hand the loaded segments to the process server as a template. */
+    bool preloaded; /*!< The process server loaded the program from a template. */
+
     unsigned int endOfProgram;
     unsigned int heapRegionStart;
     sl_dataspace_t stackRegion;
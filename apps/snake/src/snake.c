@@ -16,6 +16,10 @@
     This simple port of the classic game Snake serves as an demo app for the high-level RefOS
     userland environment. It uses a UNIX-line environment, showing serial input / output
     functionality and timer functionality.
+
+    Rather than spinning on refos_async_getc() and sleeping, the game blocks in poll() on stdin
+    with the time left until the next frame. A key press wakes it straight away, and an idle frame
+    costs a single timer alarm. Frame and CPU statistics are printed on exit.
 */
 
 #include <stdio.h>
@@ -23,8 +27,10 @@
 #include <string.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <stdint.h>
 #include <time.h>
 #include <unistd.h>
+#include <poll.h>
 
 #include <refos/refos.h>
 #include <refos-io/stdio.h>
@@ -56,8 +62,37 @@ int snakeLen;
 int snakeDir;
 int appleX, appleY;
 
+/* Statistics. */
+uint64_t numFrames;
+uint64_t numInputFrames;
+uint64_t inputLatencySumUS;
+uint64_t inputLatencyMaxUS;
+bool gameRestarted;
+
 void newGame(void);
 
+/*! @brief Read the given clock in microseconds, or 0 if it is not available. */
+static uint64_t
+timeNowUS(clockid_t clock)
+{
+    struct timespec ts;
+    if (clock_gettime(clock, &ts) != 0) {
+        return 0;
+    }
+    return ((uint64_t) ts.tv_sec) * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/*! @brief Block until there is input on stdin, or the timeout runs out.
+    @param timeoutMS The timeout in milliseconds, or negative to wait forever.
+    @return true if there is input waiting, false on timeout.
+*/
+static bool
+waitInput(int timeoutMS)
+{
+    struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN, .revents = 0 };
+    return poll(&pfd, 1, timeoutMS) > 0 && (pfd.revents & POLLIN);
+}
+
 /*! @brief Pick another random apple location. */
 void
 newApple(void)
@@ -151,12 +186,16 @@ newGame(void)
     /* Display new game message. */
     printf("      Press the space bar to continue...\n");
     while (1) {
+        waitInput(-1);
         int c = refos_async_getc();
-        rand();
         if (c == ' ') break;
     }
 
+    /* How long the player took stands in for the rand() calls the old busy loop used to make. */
+    srand(rand() ^ (unsigned int) timeNowUS(CLOCK_MONOTONIC));
+
     /* Start the game. */
+    gameRestarted = true;
     clrscr();
     snakeLen = INITIAL_SNAKE_LENGTH;
     for (int i = 1; i < snakeLen; i++) {
@@ -218,16 +257,76 @@ main()
     print_welcome_message();
     newGame();
 
-    while (true) {
-        int c = refos_async_getc();
-        if (c == 'q') {
+    uint64_t startUS = timeNowUS(CLOCK_MONOTONIC);
+    uint64_t startCPUUS = timeNowUS(CLOCK_PROCESS_CPUTIME_ID);
+    /* Idle frames don't read the clock; they assume they woke on time. */
+    uint64_t frameUS = startUS;
+    int timeoutMS = DELAY_AMOUNT;
+    bool quit = false;
+
+    while (!quit) {
+        if (!waitInput(timeoutMS)) {
+            gameRestarted = false;
+            stepGame();
+            renderGame();
+            numFrames++;
+            frameUS = gameRestarted ? timeNowUS(CLOCK_MONOTONIC) : frameUS + DELAY_AMOUNT * 1000;
+            timeoutMS = DELAY_AMOUNT;
+            continue;
+        }
+
+        uint64_t wakeUS = timeNowUS(CLOCK_MONOTONIC);
+        int lastDir = snakeDir;
+        int c;
+        while ((c = refos_async_getc()) != -1) {
+            if (c == 'q') {
+                quit = true;
+            }
+            handleInput(c);
+        }
+        if (quit) {
             break;
         }
-        handleInput(c);
+        if (snakeDir == lastDir) {
+            /* Nothing changed; keep waiting for the frame that was due. */
+            uint64_t dueUS = frameUS + DELAY_AMOUNT * 1000;
+            timeoutMS = (dueUS > wakeUS) ? (int) ((dueUS - wakeUS + 999) / 1000) : 0;
+            continue;
+        }
+
+        /* Turn straight away rather than on the next tick. */
+        gameRestarted = false;
         stepGame();
         renderGame();
-        usleep(DELAY_AMOUNT * 1000);
+        frameUS = timeNowUS(CLOCK_MONOTONIC);
+        numFrames++;
+        timeoutMS = DELAY_AMOUNT;
+        if (gameRestarted) {
+            /* The frame waited on the player to restart; that isn't input latency. */
+            continue;
+        }
+        numInputFrames++;
+        uint64_t latencyUS = frameUS - wakeUS;
+        inputLatencySumUS += latencyUS;
+        if (latencyUS > inputLatencyMaxUS) {
+            inputLatencyMaxUS = latencyUS;
+        }
     }
 
+    uint64_t wallUS = timeNowUS(CLOCK_MONOTONIC) - startUS;
+    uint64_t endCPUUS = timeNowUS(CLOCK_PROCESS_CPUTIME_ID);
     showcursor();
+    gotoxy(0, NUM_ROWS + 1);
+    printf("%llu frames (%llu on input) in %llu ms.\n", (unsigned long long) numFrames,
+           (unsigned long long) numInputFrames, (unsigned long long) (wallUS / 1000));
+    if (endCPUUS) {
+        printf("CPU time %llu ms.\n", (unsigned long long) ((endCPUUS - startCPUUS) / 1000));
+    } else {
+        printf("CPU time n/a.\n");
+    }
+    if (numInputFrames) {
+        printf("Input wake to frame latency: avg %llu us, max %llu us.\n",
+               (unsigned long long) (inputLatencySumUS / numInputFrames),
+               (unsigned long long) inputLatencyMaxUS);
+    }
 }
@@ -21,6 +21,8 @@
 #include <refos-rpc/proc_client.h>
 #include <refos-rpc/proc_client_helper.h>
 #include <unistd.h>
+#include <termios.h>
+#include <stdbool.h>
 #include <autoconf.h>
 
 #include "print_time.h"
@@ -37,9 +39,9 @@
 #define TERMINAL_INPUT_ARG_LENGTH 10
 #define TERMINAL_INPUT_ARG_COUNT 10
 #define TERMINAL_INPUT_BUFFER_SIZE 512
-#define TERMINAL_NEW_LINE_CHAR '\r'
-#define TERMINAL_DELETE_CHAR 127
 #define TERMINAL_CLEAR_SCREEN "\e[2J\e[1;1H"
+#define TERMINAL_TOP_MAX_ROWS 20
+#define TERMINAL_TOP_DEFAULT_COUNT 10
 
 static char *args[TERMINAL_INPUT_ARG_COUNT];
 static char exitProgram = 0;
@@ -80,8 +82,14 @@ terminal_printhelp(void)
            #if CONFIG_APP_TEST_USER
            "    exec fileserv/test_user - Run RefOS userland tests.\n"
            #endif
+           #if CONFIG_APP_BENCH_OS
+           "    exec fileserv/bench_os - Run RefOS benchmarks.\n"
+           #endif
            "    exec fileserv/terminal - Run another instance of RefOS terminal.\n"
            "    cd /fileserv/ - Change current working directory.\n"
+           "    ps - List processes and their memory usage.\n"
+           "    top [interval_ms] [count] - Show the CPU usage of processes.\n"
+           "    profile start|stop|dump <pid> - Sample a process' program counters.\n"
            "    printenv - Print all environment variables.\n"
            "    setenv - Set an environment variable.\n"
            "    time - Display the current system time.\n"
@@ -106,6 +114,188 @@ terminal_exec(void)
     }
 }
 
+/*! @brief List every process and its memory usage. */
+static void
+terminal_ps(void)
+{
+    refos_mem_stats_t stats;
+    printf("  PID  PPID  THR  RSS(KB)  WIN  MAPPED  KOBJ  NAME\n");
+    for (int pid = 1; pid < PROCSERV_MAX_PROCESSES; pid++) {
+        if (proc_get_mem_stats(pid, &stats) != ESUCCESS) {
+            continue;
+        }
+        printf("%5u %5u %4u %8u %4u %7u %5u  %s\n", stats.pid, stats.parentPID, stats.threads,
+               stats.residentFrames * (REFOS_PAGE_SIZE / 1024), stats.windows,
+               stats.mappedWindows, stats.kernelObjects, stats.name);
+    }
+}
+
+/*! @brief Return part as a percentage of total, in tenths of a percent. */
+static unsigned int
+terminal_top_permille(uint64_t part, uint64_t total)
+{
+    if (!total) {
+        return 0;
+    }
+    if (part > total) {
+        part = total;
+    }
+    return (unsigned int) ((part * 1000) / total);
+}
+
+/*! @brief Take a CPU utilisation sample and print the busiest processes over its interval.
+    @return ESUCCESS on success, refos_err_t otherwise.
+*/
+static refos_err_t
+terminal_top_refresh(int refresh, int count, uint32_t intervalMS)
+{
+    static refos_cpu_usage_t rows[TERMINAL_TOP_MAX_ROWS];
+    refos_cpu_sample_t sample;
+    refos_cpu_usage_t usage;
+    int nrows = 0;
+
+    refos_err_t error = proc_cpu_sample(&sample);
+    if (error != ESUCCESS) {
+        return error;
+    }
+
+    /* Keep the busiest processes, sorted by cycles. */
+    for (int32_t pid = 1; proc_get_cpu_usage(pid, &usage) == ESUCCESS; pid = usage.pid + 1) {
+        int i = nrows < TERMINAL_TOP_MAX_ROWS ? nrows++ : TERMINAL_TOP_MAX_ROWS;
+        for (; i > 0 && rows[i - 1].cycles < usage.cycles; i--) {
+            if (i < TERMINAL_TOP_MAX_ROWS) {
+                rows[i] = rows[i - 1];
+            }
+        }
+        if (i < TERMINAL_TOP_MAX_ROWS) {
+            rows[i] = usage;
+        }
+    }
+
+    uint64_t total = sample.totalCycles;
+    unsigned int idle = terminal_top_permille(sample.idleCycles, total);
+    unsigned int kernel = terminal_top_permille(sample.kernelCycles, total);
+    unsigned int procserv = terminal_top_permille(sample.procservCycles, total);
+    printf("%s", TERMINAL_CLEAR_SCREEN);
+    printf("top - sample %u (%d/%d), every %u ms, %u processes\n", sample.sequence, refresh + 1,
+           count, intervalMS, sample.processes);
+    printf("CPU: %3u.%u%% busy, %3u.%u%% idle, %3u.%u%% kernel, %3u.%u%% procserv\n",
+           (1000 - idle) / 10, (1000 - idle) % 10, idle / 10, idle % 10, kernel / 10, kernel % 10,
+           procserv / 10, procserv % 10);
+    printf("     %llu cycles, %llu schedules, %llu kernel entries\n\n", sample.totalCycles,
+           sample.schedules, sample.kernelEntries);
+    printf("  PID  PPID  THR   %%CPU  SCHED  BUSIEST  NAME\n");
+    for (int i = 0; i < nrows; i++) {
+        unsigned int cpu = terminal_top_permille(rows[i].cycles, total);
+        printf("%5u %5u %4u %4u.%u %6llu %8u  %s\n", rows[i].pid, rows[i].parentPID,
+               rows[i].threads, cpu / 10, cpu % 10, rows[i].schedules, rows[i].busiestThread,
+               rows[i].name);
+    }
+    return ESUCCESS;
+}
+
+/*! @brief Periodically show the CPU usage of processes, as sampled by the kernel. */
+static void
+terminal_top(void)
+{
+    uint32_t intervalMS = CONFIG_TERMINAL_TOP_INTERVAL_MS;
+    int count = TERMINAL_TOP_DEFAULT_COUNT;
+    if (args[1]) {
+        intervalMS = (uint32_t) atoi(args[1]);
+    }
+    if (args[2]) {
+        count = atoi(args[2]);
+    }
+    if (!intervalMS || count <= 0) {
+        printf("top: usage: top [interval_ms] [count]\n");
+        return;
+    }
+
+    /* Start a fresh interval, so the first refresh doesn't cover the time since the last one. */
+    refos_cpu_sample_t sample;
+    if (proc_cpu_sample(&sample) == EUNIMPLEMENTED) {
+        printf("top: CPU usage needs a kernel built with CONFIG_BENCHMARK_TRACK_UTILISATION, "
+               "as in ia32_debug_defconfig.\n");
+        return;
+    }
+    for (int refresh = 0; refresh < count; refresh++) {
+        struct timespec interval = {
+            .tv_sec = intervalMS / 1000,
+            .tv_nsec = (intervalMS % 1000) * 1000000
+        };
+        nanosleep(&interval, NULL);
+        if (terminal_top_refresh(refresh, count, intervalMS) != ESUCCESS) {
+            printf("top: could not sample CPU usage.\n");
+            return;
+        }
+    }
+}
+
+/*! @brief Dump the program counter histogram of a profiled process. Each line is a program counter
+           and its hit count; pipe the addresses through addr2line -f -e <ELF file> on the host to
+           symbolise them. */
+static void
+terminal_profile_dump(int32_t pid)
+{
+    refos_profile_chunk_t chunk;
+    refos_mem_stats_t stats;
+    uint32_t start = 0;
+    bool first = true;
+
+    do {
+        refos_err_t error = proc_profile_read(pid, start, &chunk);
+        if (error != ESUCCESS) {
+            printf("profile: no profile for PID %d (%s).\n", pid, refos_error_str(error));
+            return;
+        }
+        if (first) {
+            bool named = (proc_get_mem_stats(pid, &stats) == ESUCCESS);
+            printf("# refos-profile pid=%u name=%s samples=%u dropped=%u entries=%u%s\n",
+                   chunk.pid, named ? stats.name : "?", chunk.samples, chunk.dropped,
+                   chunk.entries, chunk.active ? "" : " stopped");
+            first = false;
+        }
+        for (uint32_t i = 0; i < chunk.count; i++) {
+            printf("0x%08lx %u\n", (unsigned long) chunk.pc[i], chunk.hits[i]);
+        }
+        start = chunk.next;
+    } while (start);
+}
+
+/*! @brief Start, stop or dump the sampling profiler of a process. */
+static void
+terminal_profile(void)
+{
+    if (!args[1] || !args[2]) {
+        printf("profile: usage: profile start|stop|dump <pid>\n");
+        return;
+    }
+    int32_t pid = atoi(args[2]);
+    if (pid <= 0) {
+        printf("profile: invalid PID %s.\n", args[2]);
+        return;
+    }
+
+    refos_err_t error = ESUCCESS;
+    if (!strcmp(args[1], "start")) {
+        error = proc_profile_start(pid);
+    } else if (!strcmp(args[1], "stop")) {
+        error = proc_profile_stop(pid);
+    } else if (!strcmp(args[1], "dump")) {
+        terminal_profile_dump(pid);
+        return;
+    } else {
+        printf("profile: usage: profile start|stop|dump <pid>\n");
+        return;
+    }
+
+    if (error == EUNIMPLEMENTED) {
+        printf("profile: the process server was built without CONFIG_PROCSERV_PROFILER.\n");
+    } else if (error != ESUCCESS) {
+        printf("profile: %s %d failed (%s).\n", args[1], pid, refos_error_str(error));
+    }
+}
+
 /*! @brief Evaluate a command. */
 static void
 terminal_evaluate_command(char *inputBuffer)
@@ -128,6 +318,12 @@ terminal_evaluate_command(char *inputBuffer)
         printf("Raw epoch time is %llu\n", (uint64_t) rawTime);
         printf("Current GMT time is %s", refos_print_time(gmtTime));
         printf("Current local time (%s) is %s", getenv("TZ"), refos_print_time(localTime));
+    } else if (!strcmp(args[0], "ps")) {
+        terminal_ps();
+    } else if (!strcmp(args[0], "top")) {
+        terminal_top();
+    } else if (!strcmp(args[0], "profile")) {
+        terminal_profile();
     } else if (!strcmp(args[0], "printenv")) {
         for (int i = 0; __environ[i]; i++) {
             printf("%s\n", __environ[i]);
@@ -153,27 +349,27 @@ terminal_get_input(char *inputBuffer)
     printf("refos:%s$ ", getenv("PWD"));
     fflush(stdout);
 
-    int i = 0; inputBuffer[0] = '\0';
-    for (i = 0; i < TERMINAL_INPUT_BUFFER_SIZE;) {
-        inputBuffer[i] = getchar();
-        if (inputBuffer[i] == TERMINAL_NEW_LINE_CHAR) {
-            printf("\n");
-            inputBuffer[i] = '\0';
-            return;
-        } else if (inputBuffer[i] == TERMINAL_DELETE_CHAR) {
-            if (i > 0) {
-                printf("\b \b");
-                fflush(stdout);
-                inputBuffer[--i] = '\0';
-            }
-        } else {
-            printf("%c", inputBuffer[i]);
-            fflush(stdout);
-            i++;
-        }
+    /* Let the console server line discipline do the line editing and echo, so the whole command
+       arrives in one read. Restore the previous mode afterwards, as the programs we run may want
+       raw input. */
+    struct termios oldMode, lineMode;
+    bool restore = (tcgetattr(STDIN_FILENO, &oldMode) == 0);
+    if (restore) {
+        lineMode = oldMode;
+        lineMode.c_lflag |= ICANON | ECHO;
+        tcsetattr(STDIN_FILENO, TCSANOW, &lineMode);
+    }
+
+    inputBuffer[0] = '\0';
+    if (fgets(inputBuffer, TERMINAL_INPUT_BUFFER_SIZE + 1, stdin) == NULL) {
+        inputBuffer[0] = '\0';
+        clearerr(stdin);
+    }
+    inputBuffer[strcspn(inputBuffer, "\r\n")] = '\0';
+
+    if (restore) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &oldMode);
     }
-    inputBuffer[TERMINAL_INPUT_BUFFER_SIZE] = '\0';
-    printf("\n");
 }
 
 /*! @brief Reset the input buffer. */
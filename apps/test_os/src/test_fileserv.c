@@ -17,6 +17,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <unistd.h>
 #include "test_fileserv.h"
 #include <refos-util/walloc.h>
 #include <refos-rpc/serv_client.h>
@@ -142,6 +143,94 @@ test_file_server_dataspace()
     return test_success();
 }
 
+static int
+test_file_server_ramfs()
+{
+    test_start("fs ramfs dspace");
+    int error;
+    char buf[32];
+
+    /* Find the file server. */
+    nsv_mountpoint_t mp = nsv_resolve("fileserv/*");
+    test_assert(mp.success == true);
+    test_assert(mp.serverAnon != 0);
+    seL4_CPtr fileservSession = serv_connect_direct(mp.serverAnon, REFOS_LIVENESS, &error);
+    test_assert(fileservSession && error == ESUCCESS);
+
+    /* Create a new RamFS file. */
+    seL4_CPtr dspace = data_open(fileservSession, "ramfs_test.txt", O_CREAT | O_RDWR, O_RDWR, 0,
+                                 &error);
+    test_assert(dspace && error == ESUCCESS);
+    test_assert(data_get_size(fileservSession, dspace) == 0);
+
+    /* Test that a write past the end of file leaves a zero filled hole. */
+    const uint32_t sparseOffset = REFOS_PAGE_SIZE * 3 + 100;
+    int n = data_write(fileservSession, dspace, sparseOffset, "hello", 5);
+    test_assert(n == 5);
+    test_assert(data_get_size(fileservSession, dspace) == sparseOffset + 5);
+    memset(buf, 0xFF, sizeof(buf));
+    n = data_read(fileservSession, dspace, REFOS_PAGE_SIZE, buf, sizeof(buf));
+    test_assert(n == (int) sizeof(buf));
+    for (int i = 0; i < (int) sizeof(buf); i++) {
+        test_assert(buf[i] == 0);
+    }
+    n = data_read(fileservSession, dspace, sparseOffset, buf, sizeof(buf));
+    test_assert(n == 5);
+    test_assert(strncmp(buf, "hello", 5) == 0);
+
+    /* Test lseek. */
+    test_assert(data_lseek(fileservSession, dspace, 0, SEEK_END) == sparseOffset + 5);
+    test_assert(data_lseek(fileservSession, dspace, 10, SEEK_SET) == 10);
+    test_assert(data_lseek(fileservSession, dspace, 5, SEEK_CUR) == 15);
+    test_assert(data_lseek(fileservSession, dspace, -100, SEEK_SET) < 0);
+
+    /* Test expand. */
+    error = data_expand(fileservSession, dspace, REFOS_PAGE_SIZE * 5);
+    test_assert(error == ESUCCESS);
+    test_assert(data_get_size(fileservSession, dspace) == REFOS_PAGE_SIZE * 5);
+    error = data_expand(fileservSession, dspace, REFOS_PAGE_SIZE);
+    test_assert(error == EINVALIDPARAM);
+    n = data_read(fileservSession, dspace, sparseOffset + 5, buf, sizeof(buf));
+    test_assert(n == (int) sizeof(buf) && buf[0] == 0);
+
+    /* Test that the file can be mapped, and that writes through the mapping land in the file. */
+    seL4_CPtr tempWindow = 0;
+    seL4_Word tempWindowVaddr = walloc(5, &tempWindow);
+    test_assert(tempWindowVaddr && tempWindow);
+    error = data_datamap(fileservSession, dspace, tempWindow, 0);
+    test_assert(error == ESUCCESS);
+    test_assert(strncmp((char*) (tempWindowVaddr + sparseOffset), "hello", 5) == 0);
+    test_assert(*((char*) tempWindowVaddr) == 0);
+    strcpy((char*) (tempWindowVaddr + REFOS_PAGE_SIZE * 4), "mapped");
+    n = data_read(fileservSession, dspace, REFOS_PAGE_SIZE * 4, buf, sizeof(buf));
+    test_assert(n == (int) sizeof(buf));
+    test_assert(strcmp(buf, "mapped") == 0);
+    data_dataunmap(fileservSession, tempWindow);
+    walloc_free(tempWindowVaddr, 5);
+
+    /* Test that the file outlives its dataspace, and that O_TRUNC truncates it. */
+    data_close(fileservSession, dspace);
+    csfree_delete(dspace);
+    dspace = data_open(fileservSession, "ramfs_test.txt", O_RDWR, O_RDWR, 0, &error);
+    test_assert(dspace && error == ESUCCESS);
+    test_assert(data_get_size(fileservSession, dspace) == REFOS_PAGE_SIZE * 5);
+    data_close(fileservSession, dspace);
+    csfree_delete(dspace);
+    dspace = data_open(fileservSession, "ramfs_test.txt", O_RDWR | O_TRUNC, O_RDWR, 0, &error);
+    test_assert(dspace && error == ESUCCESS);
+    test_assert(data_get_size(fileservSession, dspace) == 0);
+    data_close(fileservSession, dspace);
+    csfree_delete(dspace);
+
+    /* Clean up. */
+    serv_disconnect_direct(fileservSession);
+    seL4_CNode_Delete(REFOS_CSPACE, fileservSession, REFOS_CDEPTH);
+    csfree(fileservSession);
+    nsv_mountpoint_release(&mp);
+
+    return test_success();
+}
+
 static int
 test_file_server_serv_connect()
 {
@@ -161,6 +250,7 @@ test_file_server(void)
 {
     test_file_server_connect();
     test_file_server_dataspace();
+    test_file_server_ramfs();
     test_file_server_serv_connect();
 }
 
@@ -52,6 +52,7 @@ extern uintptr_t __vsyscall_ptr;
 #define BSS_ARRAY_SIZE 0x20000
 #define TEST_KERNEL_VM_RESERVED_START 0xE0000000
 #define TEST_USERLAND_TEST_APP "/fileserv/test_user"
+#define TEST_BENCHMARK_APP "/fileserv/bench_os"
 
 char bssArray[BSS_ARRAY_SIZE];
 int bssVar = BSS_MAGIC;
@@ -339,6 +340,19 @@ test_start_userland_test(void)
     return 0;
 }
 
+#ifdef CONFIG_REFOS_RUN_BENCHMARKS
+static int
+test_start_benchmarks(void)
+{
+    tprintf("TEST_OS | Starting RefOS benchmarks...\n");
+    int status = EINVALID;
+    int error = proc_new_proc(TEST_BENCHMARK_APP, "", true, 70, &status);
+    if (error != ESUCCESS || status != 0) {
+        ROS_WARNING("RefOS benchmarks failed to run.");
+    }
+    return 0;
+}
+#endif
 
 static void
 test_process_server(void)
@@ -513,6 +527,9 @@ main()
     test_start_userland_test();
     tprintf("OS_TESTS | Back to Refos OS-level. Running userland second time.\n");
     test_start_userland_test();
+#ifdef CONFIG_REFOS_RUN_BENCHMARKS
+    test_start_benchmarks();
+#endif
     tprintf("OS_TESTS | Back to Refos OS-level. Quitting.\n");
 #endif /* CONFIG_REFOS_RUN_TESTS */
 
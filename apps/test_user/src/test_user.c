@@ -20,6 +20,12 @@
 #include <math.h>
 #include <time.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
 
 #include <refos/test.h>
 #include <refos-io/stdio.h>
@@ -31,15 +37,49 @@
 
 #include <refos-rpc/proc_client.h>
 #include <refos-rpc/proc_client_helper.h>
+#include <refos-rpc/data_client.h>
+#include <refos-rpc/data_client_helper.h>
 #include <refos/vmlayout.h>
 #include <data_struct/cvector.h>
+#ifdef CONFIG_LIB_VTERM
+#include <vterm/vterm.h>
+#endif
 
 #define BSS_MAGIC 0xBA13DD37
 #define BSS_ARRAY_SIZE 0x20000
 #define TEST_USER_TEST_APPNAME "/fileserv/test_user"
 #define TEST_NUMTHREADS 8
+#define TEST_NUMPTHREADS 4
+#define TEST_PTHREAD_ITERATIONS 5000
+#define TEST_SYNC_ITERATIONS 2000
+#define TEST_FAULT_BENCH_PROCS 4
+#define TEST_FAULT_BENCH_PAGES 64
+#define TEST_FAULT_BENCH_ARG "--fault-bench"
+#define TEST_FAULT_BENCH_FILE "fileserv/test_fault_bench_%d"
+#define TEST_FAULT_BENCH_DELAY_NS 200000000ULL
+#define TEST_FAULT_BENCH_POLL_NS 1000000ULL
+#define TEST_FAULT_BENCH_POLL_TRIES 5000
+#define TEST_MEM_STATS_PAGES 4
+#define TEST_MEMOPS_BUFFER_SIZE 0x2200
+#define TEST_MEMOPS_GUARD 16
+#define TEST_MEMOPS_GUARD_BYTE 0xA5
+#define TEST_NET_DGRAM_PORT 7100
+#define TEST_NET_STREAM_PORT 7101
+#define TEST_NET_STREAM_SIZE 0x4000
+#define TEST_VTERM_ROWS 25
+#define TEST_VTERM_COLS 80
+#define TEST_VTERM_TEXT_SIZE 0x8000
+#define TEST_VTERM_FRAGMENT_MAX 256
+
+/* Generated at build time; see the file server CPIO archive rule in the top level Makefile. */
+#define TEST_MMAP_BENCH_FILE "fileserv/bench_4mb"
+#define TEST_MMAP_BENCH_FILE_SIZE 0x400000
+#define TEST_MMAP_BENCH_PATTERN \
+        "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ-\n"
+#define TEST_MMAP_BENCH_PATTERN_LEN 64
 
 char bssArray[BSS_ARRAY_SIZE];
+char faultBenchArray[TEST_FAULT_BENCH_PAGES * REFOS_PAGE_SIZE];
 int bssVar = BSS_MAGIC;
 int bssVar2;
 
@@ -162,11 +202,110 @@ test_libc_string(void)
     return test_success();
 }
 
+/* Sizes around the block sizes and page fast paths of the optimised memcpy, memmove and memset.
+   Offsets give every source and destination alignment that they treat differently, and both
+   directions of overlap for memmove. */
+static const size_t testMemopsSizes[] = {
+    0, 1, 7, 8, 15, 16, 17, 31, 48, 63, 64, 65, 79, 127, 128, 129, 255, 1000,
+    4095, 4096, 4097, 4096 + 77, 8191
+};
+static const size_t testMemopsOffsets[] = { 0, 1, 3, 4, 8, 15, 33, 100 };
+#define TEST_MEMOPS_NSIZES (sizeof(testMemopsSizes) / sizeof(testMemopsSizes[0]))
+#define TEST_MEMOPS_NOFFSETS (sizeof(testMemopsOffsets) / sizeof(testMemopsOffsets[0]))
+
+static unsigned char testMemopsSrc[TEST_MEMOPS_BUFFER_SIZE];
+static unsigned char testMemopsDest[TEST_MEMOPS_BUFFER_SIZE];
+static unsigned char testMemopsRef[TEST_MEMOPS_BUFFER_SIZE];
+
+static void
+test_memops_fill(unsigned char *buf, int seed)
+{
+    for (int i = 0; i < TEST_MEMOPS_BUFFER_SIZE; i++) {
+        buf[i] = (unsigned char) (i * 7 + seed);
+    }
+}
+
+/*! @brief Reference memmove. Volatile so that the compiler can't turn it back into memmove. */
+static void
+test_memops_move_bytes(unsigned char *dest, const unsigned char *src, size_t n)
+{
+    volatile unsigned char *d = dest;
+    const volatile unsigned char *s = src;
+    if (d < s) {
+        for (size_t i = 0; i < n; i++) {
+            d[i] = s[i];
+        }
+    } else {
+        for (size_t i = n; i > 0; i--) {
+            d[i - 1] = s[i - 1];
+        }
+    }
+}
+
+/*! @brief Check that only [off, off + n) of the destination buffer was written to, and that it
+           holds what the reference buffer holds there. */
+static bool
+test_memops_check(size_t off, size_t n, const unsigned char *ref)
+{
+    for (size_t i = off - TEST_MEMOPS_GUARD; i < off; i++) {
+        if (testMemopsDest[i] != TEST_MEMOPS_GUARD_BYTE) {
+            return false;
+        }
+    }
+    for (size_t i = off + n; i < off + n + TEST_MEMOPS_GUARD; i++) {
+        if (testMemopsDest[i] != TEST_MEMOPS_GUARD_BYTE) {
+            return false;
+        }
+    }
+    return memcmp(testMemopsDest + off, ref, n) == 0;
+}
+
+static int
+test_libc_memops(void)
+{
+    test_start("libc memcpy memmove memset");
+    test_memops_fill(testMemopsSrc, 0);
+
+    for (size_t i = 0; i < TEST_MEMOPS_NSIZES; i++) {
+        size_t n = testMemopsSizes[i];
+        for (size_t j = 0; j < TEST_MEMOPS_NOFFSETS; j++) {
+            size_t d = TEST_MEMOPS_GUARD + testMemopsOffsets[j];
+
+            /* memset, with a fill byte that tests it uses only the low byte. */
+            memset(testMemopsDest, TEST_MEMOPS_GUARD_BYTE, TEST_MEMOPS_BUFFER_SIZE);
+            memset(testMemopsRef, 0x5A, n);
+            test_assert(memset(testMemopsDest + d, 0x1005A, n) == testMemopsDest + d);
+            test_assert(test_memops_check(d, n, testMemopsRef));
+
+            for (size_t k = 0; k < TEST_MEMOPS_NOFFSETS; k++) {
+                size_t s = testMemopsOffsets[k];
+
+                /* memcpy between separate buffers. */
+                memset(testMemopsDest, TEST_MEMOPS_GUARD_BYTE, TEST_MEMOPS_BUFFER_SIZE);
+                test_assert(memcpy(testMemopsDest + d, testMemopsSrc + s, n) ==
+                            testMemopsDest + d);
+                test_assert(test_memops_check(d, n, testMemopsSrc + s));
+
+                /* memmove within one buffer, against a byte at a time move. */
+                size_t ms = TEST_MEMOPS_GUARD + s;
+                test_memops_fill(testMemopsDest, 1);
+                test_memops_fill(testMemopsRef, 1);
+                test_memops_move_bytes(testMemopsRef + d, testMemopsRef + ms, n);
+                test_assert(memmove(testMemopsDest + d, testMemopsDest + ms, n) ==
+                            testMemopsDest + d);
+                test_assert(!memcmp(testMemopsDest, testMemopsRef, TEST_MEMOPS_BUFFER_SIZE));
+            }
+        }
+    }
+    return test_success();
+}
+
 static void
 test_libc(void)
 {
     test_libc_maths();
     test_libc_string();
+    test_libc_memops();
 }
 
 static seL4_CPtr testThreadEP;
@@ -243,6 +382,290 @@ test_threads(void)
     return test_success();
 }
 
+static pthread_mutex_t testPthreadMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t testPthreadCond = PTHREAD_COND_INITIALIZER;
+static uint32_t testPthreadCount;
+static int testPthreadStarted;
+
+static void *
+test_pthreads_func(void *arg)
+{
+    /* Check in with the main thread. */
+    pthread_mutex_lock(&testPthreadMutex);
+    testPthreadStarted++;
+    pthread_cond_signal(&testPthreadCond);
+    pthread_mutex_unlock(&testPthreadMutex);
+
+    for (int i = 0; i < TEST_PTHREAD_ITERATIONS; i++) {
+        pthread_mutex_lock(&testPthreadMutex);
+        testPthreadCount++;
+        if (i % 64 == 0) {
+            /* Yield while holding the lock, so other threads have to wait on the futex. */
+            sched_yield();
+        }
+        pthread_mutex_unlock(&testPthreadMutex);
+    }
+    return arg;
+}
+
+static int
+test_pthreads(void)
+{
+    test_start("pthreads");
+    pthread_t thread[TEST_NUMPTHREADS];
+    testPthreadCount = 0;
+    testPthreadStarted = 0;
+
+    for (int i = 0; i < TEST_NUMPTHREADS; i++) {
+        tvprintf("test_pthreads creating thread %d...\n", i);
+        int error = pthread_create(&thread[i], NULL, test_pthreads_func, (void*) (uintptr_t) i);
+        test_assert(error == 0);
+    }
+
+    /* Wait for every thread to have started. */
+    pthread_mutex_lock(&testPthreadMutex);
+    while (testPthreadStarted < TEST_NUMPTHREADS) {
+        pthread_cond_wait(&testPthreadCond, &testPthreadMutex);
+    }
+    pthread_mutex_unlock(&testPthreadMutex);
+
+    /* Contend with them. */
+    for (int i = 0; i < TEST_PTHREAD_ITERATIONS; i++) {
+        pthread_mutex_lock(&testPthreadMutex);
+        testPthreadCount++;
+        pthread_mutex_unlock(&testPthreadMutex);
+    }
+
+    for (int i = 0; i < TEST_NUMPTHREADS; i++) {
+        tvprintf("test_pthreads joining thread %d...\n", i);
+        void *result = NULL;
+        test_assert(pthread_join(thread[i], &result) == 0);
+        test_assert(result == (void*) (uintptr_t) i);
+    }
+
+    /* Test that were no race conditions on mutexed variable. */
+    test_assert(testPthreadCount == TEST_PTHREAD_ITERATIONS * (TEST_NUMPTHREADS + 1));
+    return test_success();
+}
+
+static sync_mutex_t testSyncMutex;
+static sync_cond_t testSyncCond;
+static sync_sem_t testSyncSem;
+static sync_sem_t testSyncDone;
+static int testSyncGo;
+static uint32_t testSyncCount;
+
+static void *
+test_sync_func(void *arg)
+{
+    /* Wait for the main thread to let everyone go at once. */
+    sync_acquire(testSyncMutex);
+    while (!testSyncGo) {
+        sync_cond_wait(testSyncCond, testSyncMutex);
+    }
+    sync_release(testSyncMutex);
+
+    for (int i = 0; i < TEST_SYNC_ITERATIONS; i++) {
+        sync_sem_wait(testSyncSem);
+        sync_acquire(testSyncMutex);
+        testSyncCount++;
+        if (i % 64 == 0) {
+            /* Yield while holding the lock, so other threads have to block on it. */
+            sched_yield();
+        }
+        sync_release(testSyncMutex);
+    }
+    sync_sem_post(testSyncDone);
+    return arg;
+}
+
+static int
+test_sync(void)
+{
+    test_start("sync mutex semaphore condvar");
+    pthread_t thread[TEST_NUMPTHREADS];
+    testSyncGo = 0;
+    testSyncCount = 0;
+
+    testSyncMutex = sync_create_mutex();
+    testSyncCond = sync_create_cond();
+    testSyncSem = sync_create_sem(0);
+    testSyncDone = sync_create_sem(0);
+    test_assert(testSyncMutex && testSyncCond && testSyncSem && testSyncDone);
+
+    /* Uncontended fast paths. */
+    test_assert(sync_try_acquire(testSyncMutex));
+    test_assert(!sync_try_acquire(testSyncMutex));
+    sync_release(testSyncMutex);
+    test_assert(!sync_sem_try_wait(testSyncSem));
+    sync_sem_post(testSyncSem);
+    test_assert(sync_sem_try_wait(testSyncSem));
+    test_assert(!sync_sem_try_wait(testSyncSem));
+
+    for (int i = 0; i < TEST_NUMPTHREADS; i++) {
+        int error = pthread_create(&thread[i], NULL, test_sync_func, (void*) (uintptr_t) i);
+        test_assert(error == 0);
+    }
+
+    /* Let every thread go, then hand out the semaphore counts. Some of these posts happen before
+       anyone waits, some wake blocked threads. */
+    sync_acquire(testSyncMutex);
+    testSyncGo = 1;
+    sync_cond_broadcast(testSyncCond);
+    sync_release(testSyncMutex);
+    for (int i = 0; i < TEST_SYNC_ITERATIONS * TEST_NUMPTHREADS; i++) {
+        sync_sem_post(testSyncSem);
+    }
+
+    for (int i = 0; i < TEST_NUMPTHREADS; i++) {
+        sync_sem_wait(testSyncDone);
+    }
+    for (int i = 0; i < TEST_NUMPTHREADS; i++) {
+        test_assert(pthread_join(thread[i], NULL) == 0);
+    }
+
+    /* Test that were no race conditions on mutexed variable, and no lost posts. */
+    test_assert(testSyncCount == TEST_SYNC_ITERATIONS * TEST_NUMPTHREADS);
+    test_assert(!sync_sem_try_wait(testSyncSem));
+
+    sync_destroy_sem(testSyncDone);
+    sync_destroy_sem(testSyncSem);
+    sync_destroy_cond(testSyncCond);
+    sync_destroy_mutex(testSyncMutex);
+    return test_success();
+}
+
+static uint64_t
+test_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec * 1000000000ULL) + (uint64_t) ts.tv_nsec;
+}
+
+/*! @brief Fault benchmark child process. Waits until the given start time, so that every child
+           faults at once, then faults in its own BSS and writes its start and end times to its
+           result file.
+    @param startNS The time to start faulting at.
+    @param index The child's index, naming its result file.
+*/
+static void
+test_fault_bench_child(uint64_t startNS, int index)
+{
+    uint64_t now = test_time_ns();
+    if (startNS > now) {
+        struct timespec req = {
+            .tv_sec = (startNS - now) / 1000000000ULL,
+            .tv_nsec = (startNS - now) % 1000000000ULL
+        };
+        nanosleep(&req, NULL);
+    }
+
+    uint64_t start = test_time_ns();
+    for (int i = 0; i < TEST_FAULT_BENCH_PAGES; i++) {
+        faultBenchArray[i * REFOS_PAGE_SIZE] = (char) i;
+    }
+    uint64_t end = test_time_ns();
+
+    char path[64];
+    char buf[64];
+    snprintf(path, sizeof(path), TEST_FAULT_BENCH_FILE, index);
+    snprintf(buf, sizeof(buf), "%llu %llu", start, end);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC);
+    if (fd >= 0) {
+        write(fd, buf, strlen(buf));
+        close(fd);
+    }
+}
+
+/*! @brief Read a fault benchmark child's start and end times.
+    @return true if the child has written its result, false otherwise.
+*/
+static bool
+test_fault_bench_result(int index, uint64_t *start, uint64_t *end)
+{
+    char path[64];
+    char buf[64];
+    snprintf(path, sizeof(path), TEST_FAULT_BENCH_FILE, index);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    int n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    buf[(n > 0) ? n : 0] = '\0';
+    char *next;
+    *start = strtoull(buf, &next, 10);
+    *end = strtoull(next, NULL, 10);
+    return *start != 0 && *end >= *start;
+}
+
+/*! @brief Clear a fault benchmark child's result file. */
+static void
+test_fault_bench_clear(int index)
+{
+    char path[64];
+    snprintf(path, sizeof(path), TEST_FAULT_BENCH_FILE, index);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC);
+    if (fd >= 0) {
+        write(fd, "0", 1);
+        close(fd);
+    }
+}
+
+static int
+test_fault_throughput(void)
+{
+    test_start("fault throughput");
+    char args[64];
+    int32_t status;
+    uint64_t start, end;
+
+    /* Fault in one child's BSS alone, as the baseline. */
+    test_fault_bench_clear(0);
+    snprintf(args, sizeof(args), TEST_FAULT_BENCH_ARG " %llu 0", test_time_ns());
+    int error = proc_new_proc(TEST_USER_TEST_APPNAME, args, true, 70, &status);
+    test_assert(error == ESUCCESS);
+    test_assert(test_fault_bench_result(0, &start, &end));
+    uint64_t singleTime = end - start;
+
+    /* Fault in the BSS of several child processes at once. Each is a separate client of the
+       process server, so their faults may be handled in parallel; the process server places
+       each new thread on the next core round-robin. */
+    for (int i = 0; i < TEST_FAULT_BENCH_PROCS; i++) {
+        test_fault_bench_clear(i);
+    }
+    uint64_t multiStart = test_time_ns() + TEST_FAULT_BENCH_DELAY_NS;
+    for (int i = 0; i < TEST_FAULT_BENCH_PROCS; i++) {
+        snprintf(args, sizeof(args), TEST_FAULT_BENCH_ARG " %llu %d", multiStart, i);
+        error = proc_new_proc(TEST_USER_TEST_APPNAME, args, false, 70, &status);
+        test_assert(error == ESUCCESS);
+    }
+
+    uint64_t multiEnd = 0, sumTime = 0;
+    struct timespec req = { .tv_sec = 0, .tv_nsec = TEST_FAULT_BENCH_POLL_NS };
+    for (int i = 0; i < TEST_FAULT_BENCH_PROCS; i++) {
+        int tries;
+        for (tries = 0; tries < TEST_FAULT_BENCH_POLL_TRIES; tries++) {
+            if (test_fault_bench_result(i, &start, &end)) {
+                break;
+            }
+            nanosleep(&req, NULL);
+        }
+        test_assert(tries < TEST_FAULT_BENCH_POLL_TRIES);
+        sumTime += end - start;
+        if (end > multiEnd) {
+            multiEnd = end;
+        }
+    }
+    uint64_t multiTime = multiEnd - multiStart;
+
+    tprintf("USER_TEST | bench fault_throughput pages %d single_ns %llu procs %d wall_ns %llu "
+            "sum_ns %llu\n", TEST_FAULT_BENCH_PAGES, singleTime, TEST_FAULT_BENCH_PROCS,
+            multiTime, sumTime);
+    return test_success();
+}
+
 static int
 test_cvector(void)
 {
@@ -354,6 +777,77 @@ test_filetable_write(void)
     return test_success();
 }
 
+static int
+test_filetable_mmap(void)
+{
+    test_start("filetable mmap");
+
+    int fd = open(TEST_MMAP_BENCH_FILE, O_RDONLY);
+    test_assert(fd >= 0);
+
+    /* Map the whole file and check every page against the generated pattern. */
+    uint64_t mmapStart = test_time_ns();
+    char *data = mmap(NULL, TEST_MMAP_BENCH_FILE_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+    test_assert(data != MAP_FAILED);
+    uint32_t sum = 0;
+    for (int i = 0; i < TEST_MMAP_BENCH_FILE_SIZE; i += REFOS_PAGE_SIZE) {
+        test_assert(data[i] == TEST_MMAP_BENCH_PATTERN[i % TEST_MMAP_BENCH_PATTERN_LEN]);
+        sum += data[i];
+    }
+    uint64_t mmapTime = test_time_ns() - mmapStart;
+    test_assert(data[TEST_MMAP_BENCH_FILE_SIZE - 1] == '\n');
+
+    /* The mapping should stay valid after closing its file, while the fd itself is gone at once
+       and its slot free for the next open. */
+    close(fd);
+    test_assert(data[100] == TEST_MMAP_BENCH_PATTERN[100 % TEST_MMAP_BENCH_PATTERN_LEN]);
+    char c;
+    test_assert(read(fd, &c, 1) < 0);
+    int fdReused = open(TEST_MMAP_BENCH_FILE, O_RDONLY);
+    test_assert(fdReused == fd);
+    close(fdReused);
+    test_assert(munmap(data, TEST_MMAP_BENCH_FILE_SIZE) == 0);
+
+    /* A non-zero offset should map from the middle of the file. */
+    fd = open(TEST_MMAP_BENCH_FILE, O_RDONLY);
+    test_assert(fd >= 0);
+    data = mmap(NULL, REFOS_PAGE_SIZE * 2, PROT_READ, MAP_SHARED, fd, REFOS_PAGE_SIZE * 3);
+    test_assert(data != MAP_FAILED);
+    test_assert(data[5] == TEST_MMAP_BENCH_PATTERN[(REFOS_PAGE_SIZE * 3 + 5) %
+            TEST_MMAP_BENCH_PATTERN_LEN]);
+    test_assert(munmap(data, REFOS_PAGE_SIZE * 2) == 0);
+
+    /* Writable file mappings are unsupported. */
+    data = mmap(NULL, REFOS_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    test_assert(data == MAP_FAILED);
+    close(fd);
+
+    /* Compare against reading the whole file into a malloced buffer. */
+    fd = open(TEST_MMAP_BENCH_FILE, O_RDONLY);
+    test_assert(fd >= 0);
+    uint64_t readStart = test_time_ns();
+    char *buffer = malloc(TEST_MMAP_BENCH_FILE_SIZE);
+    test_assert(buffer);
+    int nr = 0;
+    while (nr < TEST_MMAP_BENCH_FILE_SIZE) {
+        int n = read(fd, buffer + nr, TEST_MMAP_BENCH_FILE_SIZE - nr);
+        test_assert(n > 0);
+        nr += n;
+    }
+    uint32_t sumRead = 0;
+    for (int i = 0; i < TEST_MMAP_BENCH_FILE_SIZE; i += REFOS_PAGE_SIZE) {
+        sumRead += buffer[i];
+    }
+    uint64_t readTime = test_time_ns() - readStart;
+    test_assert(sum == sumRead);
+    free(buffer);
+    close(fd);
+
+    tprintf("USER_TEST | bench mmap_vs_read size %d mmap_ns %llu read_ns %llu\n",
+            TEST_MMAP_BENCH_FILE_SIZE, mmapTime, readTime);
+    return test_success();
+}
+
 static int
 test_gettime(void)
 {
@@ -368,10 +862,411 @@ test_gettime(void)
     return test_success();
 }
 
+static int
+test_mem_stats(void)
+{
+    test_start("memory accounting");
+    refos_mem_stats_t before, after;
+    refos_err_t error = proc_get_mem_stats(0, &before);
+    test_assert(error == ESUCCESS);
+    test_assert(before.pid != 0);
+    test_assert(before.threads >= 1);
+    tvprintf("pid %u [%s] frames %u windows %u kobjs %u\n", before.pid, before.name,
+             before.residentFrames, before.windows, before.kernelObjects);
+
+    /* Touching anonymous memory should be charged to us. */
+    data_mapping_t anon = data_open_map(REFOS_PROCSERV_EP, "anon", 0x0, 0,
+            TEST_MEM_STATS_PAGES * REFOS_PAGE_SIZE, -1);
+    test_assert(anon.err == ESUCCESS);
+    for (int i = 0; i < TEST_MEM_STATS_PAGES; i++) {
+        anon.vaddr[i * REFOS_PAGE_SIZE] = (char) i;
+    }
+    seL4_CPtr ep = proc_new_endpoint();
+    test_assert(ep != 0);
+    error = proc_get_mem_stats(0, &after);
+    test_assert(error == ESUCCESS);
+    test_assert(after.residentFrames >= before.residentFrames + TEST_MEM_STATS_PAGES);
+    test_assert(after.windows >= before.windows + 1);
+    test_assert(after.mappedWindows >= before.mappedWindows + 1);
+    test_assert(after.kernelObjects >= before.kernelObjects + 1);
+
+    /* We must not be able to set limits on a process which is not our child. */
+    error = proc_set_mem_limits(after.parentPID, 0, 0, 0);
+    test_assert(error == EACCESSDENIED);
+
+    /* Tighten our own limits to what we currently use, and check that they are enforced. */
+    error = proc_set_mem_limits(0, 0, after.windows, after.kernelObjects);
+    test_assert(error == ESUCCESS);
+    test_assert(proc_new_endpoint() == 0);
+    test_assert(ROS_ERRNO() == ENOMEM);
+    seL4_CPtr window = proc_create_mem_window(PROCESS_WALLOC_END - REFOS_PAGE_SIZE,
+                                              REFOS_PAGE_SIZE);
+    test_assert(window == 0);
+    test_assert(ROS_ERRNO() == ENOMEM);
+
+    /* We must not be able to loosen our own limits. */
+    error = proc_set_mem_limits(0, 0, 0, 0);
+    test_assert(error == EACCESSDENIED);
+    error = proc_get_mem_stats(0, &after);
+    test_assert(error == ESUCCESS);
+    test_assert(after.maxKernelObjects != 0);
+
+    proc_del_endpoint(ep);
+    error = data_mapping_release(anon);
+    test_assert(error == ESUCCESS);
+    return test_success();
+}
+
+static int
+test_cpu_time(void)
+{
+    test_start("cpu time");
+    refos_cpu_stats_t stats;
+    refos_err_t error = proc_get_cpu_stats(0, 0, &stats);
+#ifndef CONFIG_KERNEL_MCS
+    /* CPU time is only accounted on MCS kernels. */
+    test_assert(error == EUNIMPLEMENTED);
+    return test_success();
+#endif
+    test_assert(error == ESUCCESS);
+    test_assert(stats.budgetUS > 0 && stats.budgetUS <= stats.periodUS);
+    test_assert(stats.threadTimeUS <= stats.processTimeUS);
+
+    /* Burn some CPU, and check that the CPU time clocks moved. */
+    struct timespec start, end;
+    test_assert(clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start) == 0);
+    for (volatile int delay = 0; delay < 10000000; delay++);
+    test_assert(clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end) == 0);
+    test_assert(end.tv_sec > start.tv_sec ||
+                (end.tv_sec == start.tv_sec && end.tv_nsec > start.tv_nsec));
+    test_assert(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end) == 0);
+
+    /* A process may lower its own budget, but not raise it again. */
+    error = proc_set_sched_params(0, stats.budgetUS / 2, stats.periodUS);
+    test_assert(error == ESUCCESS);
+    error = proc_set_sched_params(0, stats.budgetUS, stats.periodUS);
+    test_assert(error == EACCESSDENIED);
+    error = proc_set_sched_params(0, stats.periodUS + 1, stats.periodUS);
+    test_assert(error == EACCESSDENIED || error == EINVALIDPARAM);
+    return test_success();
+}
+
+static int
+test_priority_ceiling(void)
+{
+    test_start("priority ceiling");
+    /* User processes may not raise a thread, or start a child, above the ceiling. */
+    refos_err_t error = proc_nice(0, CONFIG_PROCSERV_USER_MAX_PRIO + 1);
+    test_assert(error == EINVALIDPARAM);
+    error = proc_nice(-1, 0);
+    test_assert(error == EINVALIDPARAM);
+    int32_t status = 0;
+    error = proc_new_proc(TEST_USER_TEST_APPNAME, "", true, CONFIG_PROCSERV_USER_MAX_PRIO + 1,
+                          &status);
+    test_assert(error == EINVALIDPARAM);
+    return test_success();
+}
+
+static int
+test_cpu_usage(void)
+{
+    test_start("cpu usage");
+    refos_cpu_sample_t sample;
+    refos_cpu_usage_t usage;
+    refos_err_t error = proc_cpu_sample(&sample);
+#ifndef CONFIG_BENCHMARK_TRACK_UTILISATION
+    /* CPU usage is sampled from the kernel utilisation tracker. */
+    test_assert(error == EUNIMPLEMENTED);
+    return test_success();
+#endif
+    test_assert(error == ESUCCESS);
+
+    /* Burn some CPU, and check that the next sample charges it to us. */
+    for (volatile int delay = 0; delay < 10000000; delay++);
+    refos_cpu_sample_t next;
+    error = proc_cpu_sample(&next);
+    test_assert(error == ESUCCESS);
+    test_assert(next.sequence == sample.sequence + 1);
+    test_assert(next.processes > 0);
+    test_assert(next.idleCycles <= next.totalCycles);
+
+    int count = 0;
+    bool found = false;
+    uint64_t cycles = 0;
+    for (int32_t pid = 1; proc_get_cpu_usage(pid, &usage) == ESUCCESS; pid = usage.pid + 1) {
+        test_assert(usage.busiestThreadCycles <= usage.cycles);
+        cycles += usage.cycles;
+        count++;
+        if (strstr(usage.name, "test_user")) {
+            test_assert(usage.cycles > 0);
+            test_assert(usage.busiestThread < usage.threads);
+            found = true;
+        }
+    }
+    test_assert(found);
+    test_assert(count == next.processes);
+    test_assert(cycles <= next.totalCycles);
+    return test_success();
+}
+
+static int
+test_profile(void)
+{
+    test_start("sampling profiler");
+    refos_err_t error = proc_profile_start(0);
+#ifndef CONFIG_PROCSERV_PROFILER
+    test_assert(error == EUNIMPLEMENTED);
+    return test_success();
+#endif
+    test_assert(error == ESUCCESS);
+
+    /* Stay busy for long enough that the timer server notices and samples us a few times. */
+    struct timespec start, now;
+    test_assert(clock_gettime(CLOCK_MONOTONIC, &start) == 0);
+    do {
+        for (volatile int delay = 0; delay < 100000; delay++);
+        test_assert(clock_gettime(CLOCK_MONOTONIC, &now) == 0);
+    } while (now.tv_sec - start.tv_sec < 2);
+    error = proc_profile_stop(0);
+    test_assert(error == ESUCCESS);
+    test_assert(proc_profile_stop(0) == EINVALIDPARAM);
+
+    /* The histogram adds up to the samples which weren't dropped. */
+    refos_profile_chunk_t chunk;
+    uint32_t hits = 0, entries = 0, next = 0;
+    do {
+        error = proc_profile_read(0, next, &chunk);
+        test_assert(error == ESUCCESS);
+        test_assert(!chunk.active);
+        for (uint32_t i = 0; i < chunk.count; i++) {
+            test_assert(chunk.pc[i] != 0 && chunk.hits[i] > 0);
+            hits += chunk.hits[i];
+        }
+        entries += chunk.count;
+        next = chunk.next;
+    } while (next);
+    test_assert(chunk.samples > 0);
+    test_assert(entries == chunk.entries);
+    test_assert(hits + chunk.dropped == chunk.samples);
+    return test_success();
+}
+
+#ifdef CONFIG_APP_NET_SERVER
+
+static void
+test_net_addr(struct sockaddr_in *sin, uint16_t port)
+{
+    memset(sin, 0, sizeof(struct sockaddr_in));
+    sin->sin_family = AF_INET;
+    sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sin->sin_port = htons(port);
+}
+
+static int
+test_net_dgram(void)
+{
+    test_start("net loopback datagram");
+    struct sockaddr_in addr, from;
+    socklen_t fromLen = sizeof(from);
+    test_net_addr(&addr, TEST_NET_DGRAM_PORT);
+
+    int rx = socket(AF_INET, SOCK_DGRAM, 0);
+    test_assert(rx >= 0);
+    test_assert(bind(rx, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+    int tx = socket(AF_INET, SOCK_DGRAM, 0);
+    test_assert(tx >= 0);
+
+    /* Datagrams keep their boundaries. */
+    test_assert(sendto(tx, "ping", 4, 0, (struct sockaddr *) &addr, sizeof(addr)) == 4);
+    test_assert(sendto(tx, "pong!", 5, 0, (struct sockaddr *) &addr, sizeof(addr)) == 5);
+    char buf[32];
+    test_assert(recvfrom(rx, buf, sizeof(buf), 0, (struct sockaddr *) &from, &fromLen) == 4);
+    test_assert(!memcmp(buf, "ping", 4));
+    test_assert(from.sin_family == AF_INET);
+    test_assert(from.sin_addr.s_addr == htonl(INADDR_LOOPBACK));
+    test_assert(ntohs(from.sin_port) != 0);
+    test_assert(recv(rx, buf, sizeof(buf), 0) == 5);
+    test_assert(!memcmp(buf, "pong!", 5));
+
+    /* Reply to where it came from. */
+    test_assert(sendto(rx, "back", 4, 0, (struct sockaddr *) &from, fromLen) == 4);
+    test_assert(recv(tx, buf, sizeof(buf), 0) == 4);
+    test_assert(!memcmp(buf, "back", 4));
+
+    close(tx);
+    close(rx);
+    return test_success();
+}
+
+static int
+test_net_stream(void)
+{
+    test_start("net loopback stream");
+    struct sockaddr_in addr, peer;
+    socklen_t peerLen = sizeof(peer);
+    test_net_addr(&addr, TEST_NET_STREAM_PORT);
+
+    int ls = socket(AF_INET, SOCK_STREAM, 0);
+    test_assert(ls >= 0);
+    test_assert(bind(ls, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+    test_assert(listen(ls, 4) == 0);
+
+    /* Connecting completes straight away, so this thread can then accept its own connection. */
+    int cs = socket(AF_INET, SOCK_STREAM, 0);
+    test_assert(cs >= 0);
+    test_assert(connect(cs, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+    int as = accept(ls, (struct sockaddr *) &peer, &peerLen);
+    test_assert(as >= 0);
+    test_assert(peer.sin_addr.s_addr == htonl(INADDR_LOOPBACK));
+
+    struct sockaddr_in local;
+    socklen_t localLen = sizeof(local);
+    test_assert(getsockname(cs, (struct sockaddr *) &local, &localLen) == 0);
+    test_assert(local.sin_port == peer.sin_port);
+
+    /* Less than fits in the rings, so a single thread can't deadlock itself. */
+    static char out[TEST_NET_STREAM_SIZE], in[TEST_NET_STREAM_SIZE];
+    for (int i = 0; i < TEST_NET_STREAM_SIZE; i++) {
+        out[i] = (char) (i * 31 + (i >> 8));
+    }
+    test_assert(write(cs, out, TEST_NET_STREAM_SIZE) == TEST_NET_STREAM_SIZE);
+    int nr = 0;
+    while (nr < TEST_NET_STREAM_SIZE) {
+        int n = read(as, in + nr, TEST_NET_STREAM_SIZE - nr);
+        test_assert(n > 0);
+        nr += n;
+    }
+    test_assert(!memcmp(in, out, TEST_NET_STREAM_SIZE));
+
+    /* The other way, then end of stream. */
+    test_assert(send(as, "done", 4, 0) == 4);
+    test_assert(shutdown(as, SHUT_WR) == 0);
+    char buf[16];
+    test_assert(recv(cs, buf, sizeof(buf), 0) == 4);
+    test_assert(!memcmp(buf, "done", 4));
+    test_assert(recv(cs, buf, sizeof(buf), 0) == 0);
+
+    close(as);
+    close(cs);
+    close(ls);
+    return test_success();
+}
+
+#endif /* CONFIG_APP_NET_SERVER */
+
+#ifdef CONFIG_LIB_VTERM
+
+/* Escapes and awkward text mixed in between runs of plain ASCII. Insert mode and scroll regions
+   are left out, as libvterm mishandles some of their corner cases the same way on either path. */
+static const char *testVTermEscapes[] = {
+    "\x1b[31m", "\x1b[1;44m", "\x1b[0m", "\x1b[H", "\x1b[5;10H", "\x1b[79G", "\x1b[K",
+    "\x1b[2J", "\x1b[?7l", "\x1b[?7h", "\x1b(0", "\x1b(B", "\x1b[1\"q", "\x1b[0\"q", "\r\n",
+    "\n", "\t", "\b", "\x7f", "\xc3\xa9", "e\xcc\x81", "\xcc\x81"
+};
+
+static uint32_t
+test_vterm_rand(uint32_t *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 16;
+}
+
+static VTerm *
+test_vterm_new(bool fastPath)
+{
+    VTerm *vt = vterm_new(TEST_VTERM_ROWS, TEST_VTERM_COLS);
+    if (!vt) {
+        return NULL;
+    }
+    vterm_parser_set_utf8(vt, true);
+    VTermScreen *vts = vterm_obtain_screen(vt);
+    vterm_state_set_text_fastpath(vterm_obtain_state(vt), fastPath);
+    vterm_screen_reset(vts, 1);
+    return vt;
+}
+
+static bool
+test_vterm_same(VTerm *a, VTerm *b)
+{
+    VTermPos posA, posB;
+    vterm_state_get_cursorpos(vterm_obtain_state(a), &posA);
+    vterm_state_get_cursorpos(vterm_obtain_state(b), &posB);
+    if (posA.row != posB.row || posA.col != posB.col) {
+        return false;
+    }
+    for (int row = 0; row < TEST_VTERM_ROWS; row++) {
+        for (int col = 0; col < TEST_VTERM_COLS; col++) {
+            VTermPos pos = { .row = row, .col = col };
+            VTermScreenCell cellA, cellB;
+            memset(&cellA, 0, sizeof(cellA));
+            memset(&cellB, 0, sizeof(cellB));
+            vterm_screen_get_cell(vterm_obtain_screen(a), pos, &cellA);
+            vterm_screen_get_cell(vterm_obtain_screen(b), pos, &cellB);
+            if (memcmp(&cellA, &cellB, sizeof(VTermScreenCell))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static int
+test_vterm_text_fastpath(void)
+{
+    test_start("vterm text fast path");
+    static char text[TEST_VTERM_TEXT_SIZE];
+    uint32_t seed = 1;
+    int len = 0;
+
+    while (len < TEST_VTERM_TEXT_SIZE) {
+        if (test_vterm_rand(&seed) % 3) {
+            int n = test_vterm_rand(&seed) % (TEST_VTERM_COLS * 2);
+            for (int i = 0; i < n && len < TEST_VTERM_TEXT_SIZE; i++) {
+                text[len++] = 0x20 + test_vterm_rand(&seed) % 95;
+            }
+            continue;
+        }
+        const char *esc = testVTermEscapes[test_vterm_rand(&seed) %
+                (sizeof(testVTermEscapes) / sizeof(testVTermEscapes[0]))];
+        int n = strlen(esc);
+        if (len + n > TEST_VTERM_TEXT_SIZE) {
+            break;
+        }
+        memcpy(text + len, esc, n);
+        len += n;
+    }
+
+    VTerm *slow = test_vterm_new(false);
+    VTerm *fast = test_vterm_new(true);
+    test_assert(slow && fast);
+
+    /* Both get the same fragments, so that text and escapes are split at the same places. */
+    for (int pos = 0; pos < len;) {
+        int n = 1 + test_vterm_rand(&seed) % TEST_VTERM_FRAGMENT_MAX;
+        if (n > len - pos) {
+            n = len - pos;
+        }
+        while (pos + n < len && (text[pos + n] & 0xC0) == 0x80) {
+            /* Don't split UTF-8 sequences. */
+            n++;
+        }
+        vterm_push_bytes(slow, text + pos, n);
+        vterm_push_bytes(fast, text + pos, n);
+        pos += n;
+        test_assert(test_vterm_same(slow, fast));
+    }
+
+    vterm_free(slow);
+    vterm_free(fast);
+    return test_success();
+}
+
+#endif /* CONFIG_LIB_VTERM */
+
 #endif /* CONFIG_REFOS_RUN_TESTS */
 
 int
-main()
+main(int argc, char **argv)
 {
 #ifdef CONFIG_REFOS_RUN_TESTS
 
@@ -388,6 +1283,12 @@ main()
     uintptr_t address = strtoll(getenv("SYSTABLE"), NULL, 16);
     refos_init_selfload_child(address);
     refos_initialise();
+
+    if (argc > 3 && !strcmp(argv[1], TEST_FAULT_BENCH_ARG)) {
+        test_fault_bench_child(strtoull(argv[2], NULL, 10), atoi(argv[3]));
+        return 0;
+    }
+
     printf("USER_TEST | Hello world!\n");
     printf("USER_TEST | Running RefOS User-level tests.\n");
     test_title = "USER_TEST";
@@ -396,10 +1297,26 @@ main()
     test_param();
     test_libc();
     test_threads();
+    test_pthreads();
+    test_sync();
+    test_fault_throughput();
     test_cvector();
     test_filetable_read();
     test_filetable_write();
+    test_filetable_mmap();
     test_gettime();
+    test_mem_stats();
+    test_cpu_time();
+    test_priority_ceiling();
+    test_cpu_usage();
+    test_profile();
+#ifdef CONFIG_APP_NET_SERVER
+    test_net_dgram();
+    test_net_stream();
+#endif
+#ifdef CONFIG_LIB_VTERM
+    test_vterm_text_fastpath();
+#endif
 
     test_print_log();
 #endif
@@ -21,6 +21,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <poll.h>
 
 #include <refos/refos.h>
 #include <refos-io/stdio.h>
@@ -95,4 +98,14 @@ io_nonblock_getkey(void)
     return refos_async_getc();
 }
 
+/*! @brief Block until a key is waiting, for at most timeoutMS (negative to wait forever).
+    @return true if there is a key to read, false on timeout.
+*/
+static inline bool
+io_wait_key(int timeoutMS)
+{
+    struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN, .revents = 0 };
+    return poll(&pfd, 1, timeoutMS) > 0 && (pfd.revents & POLLIN);
+}
+
 #endif /* _TETRIS_IO_H_ */
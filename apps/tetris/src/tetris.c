@@ -36,11 +36,17 @@
     Website about Micro Tetris:
     http://freecode.com/projects/micro-tetris 
     http://troglobit.com/tetris.html
+
+    The game blocks in poll() on stdin between gravity ticks, so key presses are handled as soon as
+    they arrive and an idle frame costs a single timer alarm. Frame and CPU statistics are printed
+    when the game ends.
 */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "io.h"
@@ -319,6 +325,17 @@ game_frame(int c)
     place(shape, pos, RESETATTR);
 }
 
+/*! @brief Read the given clock in microseconds, or 0 if it is not available. */
+static uint64_t
+time_now_us(clockid_t clock)
+{
+    struct timespec ts;
+    if (clock_gettime(clock, &ts) != 0) {
+        return 0;
+    }
+    return ((uint64_t) ts.tv_sec) * 1000000ULL + ts.tv_nsec / 1000;
+}
+
 static void
 print_welcome_message(void)
 {
@@ -368,26 +385,64 @@ main()
     show_online_help();
 
     while (1) {
+        io_wait_key(-1);
         c = io_nonblock_getkey();
-        rand();
         if (c == ' ') break;
     }
+    /* How long the player took stands in for the rand() calls the old busy loop used to make. */
+    srand((unsigned int) RANDOM_SEED ^ (unsigned int) time_now_us(CLOCK_MONOTONIC));
     clrscr();
     show_online_help();
 
-    /* Main game loop. */
+    /* Main game loop. Gravity ticks on a fixed period; keys are handled in between as they come,
+       and only they read the clock. */
+    uint64_t numFrames = 0, numKeyFrames = 0, latencySumUS = 0, latencyMaxUS = 0;
+    uint64_t startUS = time_now_us(CLOCK_MONOTONIC);
+    uint64_t startCPUUS = time_now_us(CLOCK_PROCESS_CPUTIME_ID);
+    uint64_t tickUS = startUS;
+    int period = delay - level * LEVEL_DECREASE_DELAY_MS;
+    int timeoutMS = period;
     shape = next_shape();
     while (!exitGame) {
-        c = io_nonblock_getkey();
-        rand();
-        if (c >= 0) {
-            game_frame(c);
-        } else {
+        if (!io_wait_key(timeoutMS)) {
             game_frame(0);
-            usleep((delay - level * LEVEL_DECREASE_DELAY_MS) * 1000);
+            numFrames++;
+            tickUS += period * 1000;
+            period = delay - level * LEVEL_DECREASE_DELAY_MS;
+            timeoutMS = period;
+            continue;
+        }
+
+        uint64_t wakeUS = time_now_us(CLOCK_MONOTONIC);
+        while (!exitGame && (c = io_nonblock_getkey()) >= 0) {
+            game_frame(c);
+            numFrames++;
         }
+        uint64_t frameUS = time_now_us(CLOCK_MONOTONIC);
+        numKeyFrames++;
+        latencySumUS += frameUS - wakeUS;
+        if (frameUS - wakeUS > latencyMaxUS) {
+            latencyMaxUS = frameUS - wakeUS;
+        }
+
+        uint64_t dueUS = tickUS + period * 1000;
+        timeoutMS = (dueUS > frameUS) ? (int) ((dueUS - frameUS + 999) / 1000) : 0;
     }
 
+    uint64_t wallUS = time_now_us(CLOCK_MONOTONIC) - startUS;
+    uint64_t endCPUUS = time_now_us(CLOCK_PROCESS_CPUTIME_ID);
     gotoxy (0, 25);
     printf("Game over! You reached %d points.\n", points);
+    printf("%llu frames in %llu ms.\n", (unsigned long long) numFrames,
+           (unsigned long long) (wallUS / 1000));
+    if (endCPUUS) {
+        printf("CPU time %llu ms.\n", (unsigned long long) ((endCPUUS - startCPUUS) / 1000));
+    } else {
+        printf("CPU time n/a.\n");
+    }
+    if (numKeyFrames) {
+        printf("Key wake to frame latency: avg %llu us, max %llu us.\n",
+               (unsigned long long) (latencySumUS / numKeyFrames),
+               (unsigned long long) latencyMaxUS);
+    }
 }
@@ -35,6 +35,9 @@
     to save its reply cap and reply to it when on the timer IRQ when its sleep period has expired.
     The timer module sets up frequent periodic timer IRQs in order to do this.
 
+    Clients which poll the timer rather than sleeping on it set an alarm instead, which signals
+    their notification endpoint on the first tick after it expires.
+
     This approach is relatively inefficient as it results in a lot of IRQs and wasted time
     processing them. A better approach would be to set up one-shot IRQs at the exact time of the
     next waking client, allowing less IRQ overhead and much better sleep accuracy. This may be
@@ -86,6 +89,7 @@
 typedef void (*timeserv_irq_callback_fn_t)(void *cookie, uint32_t irq);
 int timeserv_handle_irq(uint32_t irq, timeserv_irq_callback_fn_t callback, void *cookie);
 void reply_data_write(void *rpc_userptr, int rpc___ret__);
+void timeserv_profile_tick(void);
 
 /*! @brief Look at sleeper list and reply to any sleppers that have had their time requirements
            met.
@@ -127,6 +131,61 @@ device_timer_update_sleepers(struct device_timer_state *s)
     }
 }
 
+/*! @brief Release an alarm, deleting its notification endpoint. */
+static void
+device_timer_alarm_release(struct device_timer_alarm *alarm)
+{
+    assert(alarm && alarm->magic == TIMESERV_DEVICE_TIMER_ALARM_MAGIC);
+    csfree_delete(alarm->notifyEP);
+    alarm->magic = 0x0;
+    free(alarm);
+}
+
+/*! @brief Remove any of the given client's alarms from the alarm list.
+    @param s The timer global state structure.
+    @param deathID The death ID of the client whose alarms to remove.
+*/
+static void
+device_timer_remove_alarms(struct device_timer_state *s, int32_t deathID)
+{
+    for (int i = 0; i < cvector_count(&s->alarmList); i++) {
+        struct device_timer_alarm *alarm = (struct device_timer_alarm*)
+                cvector_get(&s->alarmList, i);
+        assert(alarm && alarm->magic == TIMESERV_DEVICE_TIMER_ALARM_MAGIC);
+        if (alarm->client->deathID != deathID) {
+            continue;
+        }
+        device_timer_alarm_release(alarm);
+        cvector_delete(&s->alarmList, i);
+        i--;
+    }
+}
+
+/*! @brief Look at the alarm list and signal any alarms which have gone off.
+    @param s The timer global state structure.
+*/
+static void
+device_timer_update_alarms(struct device_timer_state *s)
+{
+    if (cvector_count(&s->alarmList) == 0) {
+        return;
+    }
+    uint64_t time = device_timer_get_time(s);
+    for (int i = 0; i < cvector_count(&s->alarmList); i++) {
+        struct device_timer_alarm *alarm = (struct device_timer_alarm*)
+                cvector_get(&s->alarmList, i);
+        assert(alarm && alarm->magic == TIMESERV_DEVICE_TIMER_ALARM_MAGIC);
+        if (alarm->time > time) {
+            /* Not yet. */
+            continue;
+        }
+        seL4_Signal(alarm->notifyEP);
+        device_timer_alarm_release(alarm);
+        cvector_delete(&s->alarmList, i);
+        i--;
+    }
+}
+
 /*! @brief Callback function to handle GPT timer IRQs.
 
     GPT timer IRQs happen on GPT timer overflow. Note that the GPT device (used to get the actual
@@ -145,6 +204,10 @@ device_timer_handle_irq(void *cookie, uint32_t irq)
     s->cumulativeTime += s->timerIRQPeriod;
     timer_handle_irq(s->timerDev, irq);
     device_timer_update_sleepers(s);
+    device_timer_update_alarms(s);
+    if (s->tickDev == s->timerDev) {
+        timeserv_profile_tick();
+    }
 }
 
 /*! @brief Callback function to handle waiter timer IRQs.
@@ -162,6 +225,8 @@ device_tick_handle_irq(void *cookie, uint32_t irq)
     assert(s && s->magic == TIMESERV_DEVICE_TIMER_MAGIC);
     timer_handle_irq(s->tickDev, irq);
     device_timer_update_sleepers(s);
+    device_timer_update_alarms(s);
+    timeserv_profile_tick();
 }
 
 static void
@@ -331,8 +396,9 @@ device_timer_init(struct device_timer_state *s, dev_io_ops_t *io)
         }
     }
 
-    /* Initialise the sleep timer waiter list. */
+    /* Initialise the sleep timer waiter and alarm lists. */
     cvector_init(&s->waiterList);
+    cvector_init(&s->alarmList);
 
     s->initialised = true;
 }
@@ -399,8 +465,51 @@ exit1:
     return error;
 }
 
+int
+device_timer_set_alarm(struct device_timer_state *s, struct srv_client *c, seL4_CPtr notifyEP,
+                       uint64_t waitTime)
+{
+    assert(s && s->magic == TIMESERV_DEVICE_TIMER_MAGIC);
+    assert(c && c->magic == TIMESERV_CLIENT_MAGIC);
+
+    device_timer_remove_alarms(s, c->deathID);
+    if (!notifyEP) {
+        return ESUCCESS;
+    }
+
+    /* Allocate and fill out alarm structure. */
+    struct device_timer_alarm *alarm = malloc(sizeof(struct device_timer_alarm));
+    if (!alarm) {
+        ROS_ERROR("device_timer_set_alarm failed to alloc alarm struct.");
+        csfree_delete(notifyEP);
+        return ENOMEM;
+    }
+    alarm->magic = TIMESERV_DEVICE_TIMER_ALARM_MAGIC;
+    alarm->client = c;
+    alarm->notifyEP = notifyEP;
+    alarm->time = (waitTime / TICK_TIMER_SCALE_NS) + device_timer_get_time(s);
+
+    /* Add to alarm list. (Takes ownership) */
+    cvector_add(&s->alarmList, (cvector_item_t) alarm);
+    return ESUCCESS;
+}
+
 void
-device_timer_purge_client(struct device_timer_state *client)
+device_timer_purge_client(struct device_timer_state *s, int32_t deathID)
 {
-    assert(!"not implemented.");
+    assert(s && s->magic == TIMESERV_DEVICE_TIMER_MAGIC);
+    for (int i = 0; i < cvector_count(&s->waiterList); i++) {
+        struct device_timer_waiter *waiter = (struct device_timer_waiter*)
+                cvector_get(&s->waiterList, i);
+        assert(waiter && waiter->magic == TIMESERV_DEVICE_TIMER_WAITER_MAGIC);
+        if (waiter->client->deathID != deathID) {
+            continue;
+        }
+        csfree_delete(waiter->reply);
+        waiter->magic = 0x0;
+        free(waiter);
+        cvector_delete(&s->waiterList, i);
+        i--;
+    }
+    device_timer_remove_alarms(s, deathID);
 }
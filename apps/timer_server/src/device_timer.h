@@ -27,6 +27,7 @@
 
 #define TIMESERV_DEVICE_TIMER_MAGIC 0x54F1A770
 #define TIMESERV_DEVICE_TIMER_WAITER_MAGIC 0x2F4401A9
+#define TIMESERV_DEVICE_TIMER_ALARM_MAGIC 0x2F44A1A3
 
 /*! @brief Timer device waiter structure. */
 struct device_timer_waiter {
@@ -36,6 +37,14 @@ struct device_timer_waiter {
     struct srv_client *client; /* No ownership. */
 };
 
+/*! @brief Timer device alarm structure, for clients polling the timer rather than sleeping. */
+struct device_timer_alarm {
+    uint32_t magic;
+    uint64_t time;
+    seL4_CPtr notifyEP; /* Has ownership. */
+    struct srv_client *client; /* No ownership. */
+};
+
 /*! @brief Timer device state structure. */
 struct device_timer_state {
     uint32_t magic;
@@ -50,6 +59,7 @@ struct device_timer_state {
     pstimer_t *tickDev; /* No ownership. Weak ref to static. */
 
     cvector_t waiterList; /* struct device_timer_waiter */
+    cvector_t alarmList; /* struct device_timer_alarm */
     uint64_t cumulativeTime; /*!< Current cumulative time. */
     uint64_t timerIRQPeriod;
 };
@@ -77,9 +87,22 @@ uint64_t device_timer_get_time(struct device_timer_state *s);
 int device_timer_save_caller_as_waiter(struct device_timer_state *s, struct srv_client *c,
         uint64_t waitTime);
 
-/*! @brief Purge all weak references to client form waiting list. Used when client dies.
-    @param client The dying client to be purged.
+/*! @brief Set an alarm which signals the given notification endpoint once the given time has
+           passed. Replaces the client's earlier alarm, if any.
+    @param s The global timer device state structure (No ownership).
+    @param c The client structure of the polling client.
+    @param notifyEP The async endpoint to signal, or 0 to only cancel the client's earlier alarm.
+                    (Takes ownership)
+    @param waitTime The amount of time in nanoseconds until the alarm goes off, relative to now.
+    @return ESUCCESS if success, refos_err_t otherwise.
+*/
+int device_timer_set_alarm(struct device_timer_state *s, struct srv_client *c, seL4_CPtr notifyEP,
+                           uint64_t waitTime);
+
+/*! @brief Purge all weak references to client form waiting and alarm lists. Used when client dies.
+    @param s The global timer device state structure (No ownership).
+    @param deathID The death ID of the dying client to be purged.
 */
-void device_timer_purge_client(struct device_timer_state *client);
+void device_timer_purge_client(struct device_timer_state *s, int32_t deathID);
 
 #endif /* _TIMER_SERVER_DEVICE_TIMER_H_ */
\ No newline at end of file
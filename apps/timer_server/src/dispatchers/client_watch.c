@@ -34,6 +34,9 @@ handle_timeserver_death_notification(struct proc_notification *notification)
     dprintf("     Label: PROCSERV_NOTIFY_DEATH\n");
     dprintf("     deathID: %d\n", notification->arg[0]);
 
+    /* Drop the client's sleeps and alarms, if any. */
+    device_timer_purge_client(&timeServ.devTimer, notification->arg[0]);
+
     /* Find the client and queue it for deletion. */
     int error = client_queue_delete_deathID(&timeServCommon->clientTable, notification->arg[0]);
 
@@ -117,6 +117,13 @@ data_putc_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , int rpc_c)
     return EUNIMPLEMENTED;
 }
 
+int
+data_ioctl_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , int rpc_request ,
+                   uint32_t rpc_arg)
+{
+    return -EUNIMPLEMENTED;
+}
+
 off_t
 data_lseek_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , off_t rpc_offset , int rpc_whence)
 {
@@ -176,6 +183,39 @@ data_provide_data_from_parambuffer_handler(void *rpc_userptr , seL4_CPtr rpc_dsp
     return EUNIMPLEMENTED;
 }
 
+int
+data_poll_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , seL4_CPtr rpc_notifyEP ,
+                  int rpc_events , uint32_t rpc_arg)
+{
+    struct srv_client *c = (struct srv_client *) rpc_userptr;
+    srv_msg_t *m = (srv_msg_t *) c->rpcClient.userptr;
+    assert(c && (c->magic == TIMESERV_DISPATCH_ANON_CLIENT_MAGIC || c->magic == TIMESERV_CLIENT_MAGIC));
+
+    if (!srv_check_dispatch_caps(m, 0x00000001, 2)) {
+        return -EINVALIDPARAM;
+    }
+
+    /* Copyout the notification EP. Do not printf before the copyout. */
+    seL4_CPtr notifyEP = rpc_copyout_cptr(rpc_notifyEP);
+    if (!notifyEP) {
+        return -EINVALIDPARAM;
+    }
+
+    /* Anonymous clients can't be tracked, so they can't be notified. */
+    if (c->magic == TIMESERV_DISPATCH_ANON_CLIENT_MAGIC) {
+        csfree_delete(notifyEP);
+        return -EINVALIDPARAM;
+    }
+
+    /* Handle polling timer dataspaces. */
+    if (rpc_dspace_fd == TIMESERV_DSPACE_BADGE_TIMER) {
+        return timer_poll_handler(rpc_userptr, rpc_dspace_fd, notifyEP, rpc_events, rpc_arg);
+    }
+
+    csfree_delete(notifyEP);
+    return -EFILENOTFOUND;
+}
+
 int
 check_dispatch_data(srv_msg_t *m, void **userptr)
 {
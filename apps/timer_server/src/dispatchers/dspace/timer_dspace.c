@@ -79,4 +79,25 @@ timer_read_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , uint32_t rpc_of
     uint64_t time = device_timer_get_time(&timeServ.devTimer);
     memcpy(rpc_buf.data, &time, sizeof(uint64_t));
     return sizeof(uint64_t);
-}
\ No newline at end of file
+}
+
+int
+timer_poll_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , seL4_CPtr notifyEP ,
+                   int rpc_events , uint32_t rpc_arg)
+{
+    struct srv_client *c = (struct srv_client *) rpc_userptr;
+    assert(c && c->magic == TIMESERV_CLIENT_MAGIC);
+    assert(rpc_dspace_fd == TIMESERV_DSPACE_BADGE_TIMER);
+
+    /* No time to wait means ready straight away, and no reading means no alarm. */
+    if (!(rpc_events & REFOS_POLL_READ) || rpc_arg == 0) {
+        csfree_delete(notifyEP);
+        device_timer_set_alarm(&timeServ.devTimer, c, 0, 0);
+        return rpc_events & REFOS_POLL_READ;
+    }
+
+    dvprintf("timer_poll_handler client alarm in %u microseconds.\n", rpc_arg);
+    int error = device_timer_set_alarm(&timeServ.devTimer, c, notifyEP,
+                                       (uint64_t) rpc_arg * 1000ULL);
+    return error == ESUCCESS ? 0 : -error;
+}
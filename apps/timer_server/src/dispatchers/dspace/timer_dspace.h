@@ -38,4 +38,13 @@ int timer_write_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , uint32_t r
 int timer_read_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , uint32_t rpc_offset ,
                         rpc_buffer_t rpc_buf , uint32_t rpc_count);
 
+/*! @brief Similar to data_poll_handler, for timer dataspaces. Takes ownership of the already
+           copied out notifyEP.
+
+    Polling the timer dspace for reading sets an alarm, which makes it readable once rpc_arg
+    microseconds have passed.
+*/
+int timer_poll_handler(void *rpc_userptr , seL4_CPtr rpc_dspace_fd , seL4_CPtr notifyEP ,
+                       int rpc_events , uint32_t rpc_arg);
+
 #endif /* _TIMER_SERVER_DISPATCHER_DSPACE_TIMER_H_ */
\ No newline at end of file
@@ -13,6 +13,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <autoconf.h>
 #include <refos-util/cspace.h>
 #include <refos/vmlayout.h>
 #include <refos/refos.h>
@@ -32,12 +33,35 @@ srv_common_t *timeServCommon;
 const char* dprintfServerName = "TIMESERV";
 int dprintfServerColour = 34;
 
+#ifdef CONFIG_PROCSERV_PROFILER
+/*! @brief Ticks to wait between asking the process server whether anything is being profiled. */
+#define TIMESERV_PROFILE_IDLE_TICKS 250
+
+/*! @brief Ticks left until the next profiler sample. */
+static uint32_t timeservProfileCountdown;
+#endif
+
 static seL4_CPtr
 timeserv_get_irq_handler_endpoint(void *cookie, int irq)
 {
     return proc_get_irq_handler(irq);
 }
 
+void
+timeserv_profile_tick(void)
+{
+#ifdef CONFIG_PROCSERV_PROFILER
+    if (timeservProfileCountdown && --timeservProfileCountdown) {
+        return;
+    }
+    /* Sample every few ticks while anything is being profiled, and only poll every now and then
+       otherwise, so an idle profiler costs next to nothing. */
+    int active = proc_profile_tick();
+    timeservProfileCountdown = (active > 0) ? CONFIG_PROCSERV_PROFILER_TICKS :
+                                              TIMESERV_PROFILE_IDLE_TICKS;
+#endif
+}
+
 void
 timeserv_init(void)
 {
@@ -67,4 +67,8 @@ extern srv_common_t *timeServCommon;
 /*! @brief Initialise timer server state. */
 void timeserv_init(void);
 
+/*! @brief Called on every timer tick. Has the process server take a profiler sample every
+           CONFIG_PROCSERV_PROFILER_TICKS ticks while any process is being profiled. */
+void timeserv_profile_tick(void);
+
 #endif /* _TIMER_SERVER_STATE_H_ */
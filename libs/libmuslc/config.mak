@@ -39,6 +39,11 @@ ifeq (${CONFIG_ARCH_ARM},y)
 	ASMSUBARCH =
 endif
 
+# NEON memcpy, memmove and memset, from src/string/arm_sel4neon. Other targets use the C versions.
+ifeq (${CONFIG_LIB_MUSL_C_NEON_MEMOPS},y)
+	ASMSUBARCH = neon
+endif
+
 ifeq (${CONFIG_LINK_TIME_OPTIMISATIONS},y)
 	CFLAGS += -flto
 endif
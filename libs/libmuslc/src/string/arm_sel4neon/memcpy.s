@@ -0,0 +1,94 @@
+/*
+ * NEON memcpy() for ARMv7-A.
+ *
+ * Copies through the NEON register file, 64 bytes at a time with the
+ * destination aligned to 16 bytes, and 128 bytes at a time with deeper
+ * preloading for copies of a page or more. Loads use byte elements, so
+ * the source may have any alignment. Only caller-saved NEON registers
+ * (d0-d7, d16-d23) are used.
+ *
+ * memcpy() always returns the destination pointer, so r0 is preserved.
+ */
+
+.syntax unified
+.arch armv7-a
+.fpu neon
+.arm
+
+.global memcpy
+.type memcpy,%function
+.align 4
+memcpy:
+	push	{r0, r4, lr}
+	cmp	r2, #64
+	blo	.Lcpy_16
+
+	/* Align the destination to 16 bytes. */
+	ands	ip, r0, #15
+	beq	.Lcpy_aligned
+	rsb	ip, ip, #16
+	sub	r2, r2, ip
+1:	ldrb	r4, [r1], #1
+	subs	ip, ip, #1
+	strb	r4, [r0], #1
+	bne	1b
+
+.Lcpy_aligned:
+	cmp	r2, #4096
+	blo	.Lcpy_64
+
+	/* Page sized and larger copies. */
+	pld	[r1, #0]
+	pld	[r1, #64]
+	pld	[r1, #128]
+	pld	[r1, #192]
+1:	pld	[r1, #256]
+	pld	[r1, #320]
+	vld1.8	{d0-d3}, [r1]!
+	vld1.8	{d4-d7}, [r1]!
+	vld1.8	{d16-d19}, [r1]!
+	vld1.8	{d20-d23}, [r1]!
+	sub	r2, r2, #128
+	vst1.8	{d0-d3}, [r0 :128]!
+	vst1.8	{d4-d7}, [r0 :128]!
+	vst1.8	{d16-d19}, [r0 :128]!
+	vst1.8	{d20-d23}, [r0 :128]!
+	cmp	r2, #128
+	bhs	1b
+
+.Lcpy_64:
+	cmp	r2, #64
+	blo	.Lcpy_16
+1:	pld	[r1, #192]
+	vld1.8	{d0-d3}, [r1]!
+	vld1.8	{d4-d7}, [r1]!
+	sub	r2, r2, #64
+	vst1.8	{d0-d3}, [r0 :128]!
+	vst1.8	{d4-d7}, [r0 :128]!
+	cmp	r2, #64
+	bhs	1b
+
+	/* From here on the destination may be unaligned. */
+.Lcpy_16:
+	cmp	r2, #16
+	blo	.Lcpy_8
+1:	vld1.8	{d0-d1}, [r1]!
+	sub	r2, r2, #16
+	vst1.8	{d0-d1}, [r0]!
+	cmp	r2, #16
+	bhs	1b
+
+.Lcpy_8:
+	tst	r2, #8
+	beq	1f
+	vld1.8	{d0}, [r1]!
+	vst1.8	{d0}, [r0]!
+1:	ands	r2, r2, #7
+	beq	2f
+1:	ldrb	r4, [r1], #1
+	subs	r2, r2, #1
+	strb	r4, [r0], #1
+	bne	1b
+2:	pop	{r0, r4, pc}
+
+.size memcpy, .-memcpy
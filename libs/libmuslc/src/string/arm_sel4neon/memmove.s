@@ -0,0 +1,80 @@
+/*
+ * NEON memmove() for ARMv7-A.
+ *
+ * Forward moves, and moves between buffers that do not overlap, are
+ * handed to memcpy(), which copies front to back. Otherwise the buffers
+ * overlap with the destination above the source, and this copies back
+ * to front, 64 bytes at a time with the end of the destination aligned
+ * to 16 bytes. Each 64 byte block is loaded in full before any of it is
+ * stored.
+ *
+ * memmove() always returns the destination pointer, so r0 is preserved.
+ */
+
+.syntax unified
+.arch armv7-a
+.fpu neon
+.arm
+
+.global memmove
+.type memmove,%function
+.align 4
+memmove:
+	sub	ip, r0, r1
+	cmp	ip, r2
+	bhs	memcpy
+
+	push	{r0, r4, lr}
+	add	r0, r0, r2
+	add	r1, r1, r2
+	cmp	r2, #64
+	blo	.Lmove_16
+
+	/* Align the end of the destination to 16 bytes. */
+	ands	ip, r0, #15
+	beq	.Lmove_aligned
+	sub	r2, r2, ip
+1:	ldrb	r4, [r1, #-1]!
+	subs	ip, ip, #1
+	strb	r4, [r0, #-1]!
+	bne	1b
+
+.Lmove_aligned:
+	cmp	r2, #64
+	blo	.Lmove_16
+	sub	r1, r1, #32
+	sub	r0, r0, #32
+	mov	ip, #-32
+1:	pld	[r1, #-192]
+	vld1.8	{d4-d7}, [r1], ip
+	vld1.8	{d0-d3}, [r1], ip
+	sub	r2, r2, #64
+	vst1.8	{d4-d7}, [r0 :128], ip
+	vst1.8	{d0-d3}, [r0 :128], ip
+	cmp	r2, #64
+	bhs	1b
+	add	r1, r1, #32
+	add	r0, r0, #32
+
+	/* From here on the destination may be unaligned. */
+.Lmove_16:
+	cmp	r2, #16
+	blo	.Lmove_1
+1:	sub	r1, r1, #16
+	sub	r0, r0, #16
+	vld1.8	{d0-d1}, [r1]
+	sub	r2, r2, #16
+	vst1.8	{d0-d1}, [r0]
+	cmp	r2, #16
+	bhs	1b
+
+.Lmove_1:
+	cmp	r2, #0
+	beq	2f
+1:	ldrb	r4, [r1, #-1]!
+	subs	r2, r2, #1
+	strb	r4, [r0, #-1]!
+	bne	1b
+2:	pop	{r0, r4, pc}
+
+.size memmove, .-memmove
@@ -0,0 +1,65 @@
+/*
+ * NEON memset() for ARMv7-A.
+ *
+ * Fills through the NEON register file, 64 bytes at a time with the
+ * destination aligned to 16 bytes. Zeroing whole frames is the common
+ * large case, and is bound by store bandwidth, so no preloading is done.
+ * Only caller-saved NEON registers (d0-d3) are used.
+ *
+ * memset() always returns the destination pointer, so r0 is preserved.
+ */
+
+.syntax unified
+.arch armv7-a
+.fpu neon
+.arm
+
+.global memset
+.type memset,%function
+.align 4
+memset:
+	mov	r3, r0
+	vdup.8	q0, r1
+	vmov	q1, q0
+	cmp	r2, #64
+	blo	.Lset_16
+
+	/* Align the destination to 16 bytes. */
+	ands	ip, r3, #15
+	beq	.Lset_aligned
+	rsb	ip, ip, #16
+	sub	r2, r2, ip
+1:	strb	r1, [r3], #1
+	subs	ip, ip, #1
+	bne	1b
+
+.Lset_aligned:
+	cmp	r2, #64
+	blo	.Lset_16
+1:	vst1.8	{d0-d3}, [r3 :128]!
+	vst1.8	{d0-d3}, [r3 :128]!
+	sub	r2, r2, #64
+	cmp	r2, #64
+	bhs	1b
+
+	/* From here on the destination may be unaligned. */
+.Lset_16:
+	cmp	r2, #16
+	blo	.Lset_8
+1:	vst1.8	{d0-d1}, [r3]!
+	sub	r2, r2, #16
+	cmp	r2, #16
+	bhs	1b
+
+.Lset_8:
+	tst	r2, #8
+	beq	1f
+	vst1.8	{d0}, [r3]!
+1:	ands	r2, r2, #7
+	beq	2f
+1:	strb	r1, [r3], #1
+	subs	r2, r2, #1
+	bne	1b
+2:	bx	lr
+
+.size memset, .-memset
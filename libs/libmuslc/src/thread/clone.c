@@ -1,7 +1,28 @@
 #include <errno.h>
+#include <stdarg.h>
+#include <stdint.h>
 #include "pthread_impl.h"
+#include "syscall.h"
 
+/* seL4 threads cannot return from the clone syscall on their new stack the way Linux ones do, so
+ * instead hand func and arg over at the top of the child stack, and let the syscall layer start
+ * the child running func directly. */
 int __clone(int (*func)(void *), void *stack, int flags, void *arg, ...)
 {
-	return -ENOSYS;
+	va_list ap;
+	pid_t *ptid;
+	void *tls;
+	pid_t *ctid;
+	void **sp;
+
+	va_start(ap, arg);
+	ptid = va_arg(ap, pid_t *);
+	tls = va_arg(ap, void *);
+	ctid = va_arg(ap, pid_t *);
+	va_end(ap);
+
+	sp = (void **)(((uintptr_t)stack & -16) - 16);
+	sp[0] = (void *)func;
+	sp[1] = arg;
+	return __syscall(SYS_clone, flags, sp, ptid, tls, ctid);
 }
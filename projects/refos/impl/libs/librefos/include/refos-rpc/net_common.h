@@ -0,0 +1,82 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+/*! @file
+    @brief Common interface for the network server.
+
+    Common definitions shared between the network server and its clients. Every socket has a
+    dataspace of NETSERV_SOCKET_BUFFER_SIZE bytes, provided by the client and mapped by both sides,
+    laid out as:
+
+        [ struct net_socket_control ][ rx ring ][ tx ring ]
+
+    Both rings use the refos/share.h ring format. The server is the only writer of the rx ring and
+    the client the only writer of the tx ring. Stream sockets carry a raw byte stream; datagram
+    sockets carry records of a struct net_dgram_header followed by the payload.
+*/
+
+#ifndef NET_COMMON_H_
+#define NET_COMMON_H_
+
+#include <stdint.h>
+#include <refos/refos.h>
+
+#define NETSERV_SOCKET_CONTROL_MAGIC 0x5E7C0A7D
+
+/*! @brief Socket types. */
+#define NETSERV_SOCK_STREAM 1
+#define NETSERV_SOCK_DGRAM 2
+
+/*! @brief Socket event bits, as returned by net_notify() and net_wait(). */
+#define NETSERV_EVENT_READ (1 << 0)
+#define NETSERV_EVENT_WRITE (1 << 1)
+#define NETSERV_EVENT_HUP (1 << 2)
+
+/*! @brief Interface addresses, in host byte order. */
+#define NETSERV_ADDR_ANY 0x00000000
+#define NETSERV_ADDR_LOOPBACK 0x7F000001 /* 127.0.0.1 */
+#define NETSERV_ADDR_VNIC 0x0A00020F /* 10.0.2.15 */
+
+/*! @brief Shared socket buffer layout. */
+#define NETSERV_SOCKET_CONTROL_SIZE REFOS_PAGE_SIZE
+#define NETSERV_RING_SIZE 0x8000
+#define NETSERV_SOCKET_BUFFER_SIZE (NETSERV_SOCKET_CONTROL_SIZE + NETSERV_RING_SIZE * 2)
+#define NETSERV_SOCKET_RX_RING(buf) (((char*) (buf)) + NETSERV_SOCKET_CONTROL_SIZE)
+#define NETSERV_SOCKET_TX_RING(buf) (NETSERV_SOCKET_RX_RING(buf) + NETSERV_RING_SIZE)
+
+/*! @brief The largest datagram payload a socket may send. */
+#define NETSERV_DGRAM_MAX 8192
+
+/*! @brief Control block at the start of every shared socket buffer. Written by the server. */
+struct net_socket_control {
+    seL4_Word magic;
+
+    /*! Set when the server has data for the rx ring but no space to put it in. The client clears
+        it and calls net_notify() once it has read from the rx ring. */
+    seL4_Word rxBlocked;
+
+    /*! Set once no more data will ever arrive in the rx ring. */
+    seL4_Word hangup;
+
+    /*! Set once the peer has gone away entirely, and anything sent would be dropped. */
+    seL4_Word peerClosed;
+};
+
+/*! @brief Header preceding each datagram in the rings. On the tx ring the address is the
+           destination (0 meaning the connected peer); on the rx ring it is the source. */
+struct net_dgram_header {
+    uint32_t len;
+    uint32_t addr;
+    uint32_t port;
+};
+
+#endif /* NET_COMMON_H_ */
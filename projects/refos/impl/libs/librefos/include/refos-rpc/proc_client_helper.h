@@ -150,7 +150,7 @@ proc_create_mem_window(uint32_t vaddr, uint32_t size)
     @param func The entry point function of the new thread.
     @param childStack The stack vaddr of the new thread.
     @param flags Unused, must be 0.
-    @param arg Unused, must be 0.
+    @param arg The argument to pass to func.
     @return threadID if success, negative if error occured (errno will be set).
 */
 static inline int
@@ -159,7 +159,7 @@ proc_clone(int (*func)(void *), void *childStack, int flags, void *arg)
     (void) flags;
     refos_err_t errnoRetVal = EINVALID;
     int threadID = proc_clone_internal((seL4_Word) func, (seL4_Word) childStack, flags,
-            (seL4_Word) arg, &errnoRetVal);
+            (seL4_Word) arg, 0, &errnoRetVal);
     REFOS_SET_ERRNO(errnoRetVal);
     return threadID;
 }
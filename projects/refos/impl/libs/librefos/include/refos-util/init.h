@@ -53,6 +53,11 @@ typedef struct sl_procinfo_s {
 
     sl_dataspace_t heapRegion;
     sl_dataspace_t stackRegion;
+
+    /* Selfloader only. Set by the process server before the selfloader starts. */
+    uint32_t templateEntry;   /*!< Program already loaded from a template; its ELF entry point. */
+    uint32_t templateCapture; /*!< Capture a template while loading the program. */
+    uint32_t templateReady;   /*!< A template exists; ask for it with proc_template_load(). */
 } sl_procinfo_t;
 
 /*! @brief Point the selfloaded process to the parent's system call table. */
@@ -84,6 +89,15 @@ void refos_initialise(void);
  */
 char *refos_static_param(void);
 
+/*! @brief Returns the arguments passed to proc_new_proc() for this process.
+
+    They are stored in the static parameter buffer, straight after the NUL terminating the static
+    parameter itself.
+
+    @return Pointer to the space separated argument string, which is empty if there are none.
+ */
+char *refos_static_param_args(void);
+
 /*! @brief Returns pointer to the contents of the static procinfo structure.
     @return Pointer to static procinfo structure. (See sl_procinfo_s).
 */
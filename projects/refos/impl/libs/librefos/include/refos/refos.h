@@ -58,10 +58,142 @@
 #define MEMSERV_METHODS_BASE    0x1300
 #define SERV_METHODS_BASE       0x1400
 #define DEVICE_METHODS_BASE     0x1500
+#define NETSERV_METHODS_BASE    0x1600
 
 #define PROCSERV_NOTIFY_TAG 0xA82D2
 #define PROCSERV_MAX_PROCESSES 2048
 
+/*! @brief The most frames a single proc_window_map_batch() call may map. */
+#define PROCSERV_WINDOW_MAP_BATCH_MAX 16
+
+/* ------------------------------ Process memory statistics ------------------------------------- */
+
+#define REFOS_MEM_STATS_NAME_LEN 32
+
+/*! @brief Memory usage statistics of a single process, as returned by proc_get_mem_stats().
+
+    Resident frames are the anonymous RAM frames the process server has allocated for dataspaces
+    the process opened. Kernel objects are the page directory and CNode, page tables, TCBs, IPC
+    buffer and stack frames and endpoints held on the process's behalf. A limit of 0 means no limit.
+*/
+typedef struct refos_mem_stats {
+    uint32_t pid;
+    uint32_t parentPID;
+    uint32_t residentFrames;
+    uint32_t windows;
+    uint32_t mappedWindows;
+    uint32_t kernelObjects;
+    uint32_t threads;
+    uint32_t maxFrames;
+    uint32_t maxWindows;
+    uint32_t maxKernelObjects;
+    char name[REFOS_MEM_STATS_NAME_LEN];
+} refos_mem_stats_t;
+
+/* ------------------------------- Process CPU time statistics ---------------------------------- */
+
+/*! @brief CPU time statistics of a single process, as returned by proc_get_cpu_stats().
+
+    CPU time is only tracked on MCS kernels, where every thread runs on its own scheduling
+    context. A process' CPU time is the sum over all of its threads. The budget and period are
+    those of each of the process' scheduling contexts.
+*/
+typedef struct refos_cpu_stats {
+    uint32_t pid;
+    uint32_t threads;
+    uint64_t processTimeUS;
+    uint64_t threadTimeUS;
+    uint32_t budgetUS;
+    uint32_t periodUS;
+} refos_cpu_stats_t;
+
+/* ------------------------------- System CPU utilisation --------------------------------------- */
+
+/*! @brief A system CPU utilisation sample, as returned by proc_cpu_sample().
+
+    Sampled from the kernel's utilisation tracker, which counts the cycles every thread spends
+    scheduled on the process server's core. All cycle counts cover the interval between this
+    sample and the one before it. Idle cycles are those of the kernel idle thread, and kernel cycles
+    are those spent in the kernel by any thread. Process server cycles are those of the process
+    server's own threads, which are not part of any process. Cycles of threads that were deleted
+    during the interval are not attributed to anyone.
+*/
+typedef struct refos_cpu_sample {
+    uint32_t sequence;
+    uint32_t processes;
+    uint64_t totalCycles;
+    uint64_t idleCycles;
+    uint64_t kernelCycles;
+    uint64_t procservCycles;
+    uint64_t kernelEntries;
+    uint64_t schedules;
+} refos_cpu_sample_t;
+
+/*! @brief CPU utilisation of a single process over the latest sample interval, as returned by
+           proc_get_cpu_usage(). The busiest thread is the index of the thread which used the most
+           cycles. */
+typedef struct refos_cpu_usage {
+    uint32_t pid;
+    uint32_t parentPID;
+    uint32_t threads;
+    uint32_t busiestThread;
+    uint64_t cycles;
+    uint64_t busiestThreadCycles;
+    uint64_t schedules;
+    char name[REFOS_MEM_STATS_NAME_LEN];
+} refos_cpu_usage_t;
+
+/* ---------------------------------- Sampling profiler ----------------------------------------- */
+
+/*! @brief The most histogram entries a single proc_profile_read() call returns. */
+#define REFOS_PROFILE_CHUNK_ENTRIES 24
+
+/*! @brief A chunk of the program counter histogram of a profiled process, as returned by
+           proc_profile_read().
+
+    Samples is the number of samples taken, of which dropped were not recorded because the
+    histogram was full, and entries is the number of distinct program counters in the histogram.
+    Pass next as the start of the following read; it is 0 after the last chunk.
+*/
+typedef struct refos_profile_chunk {
+    uint32_t pid;
+    uint32_t active;
+    uint32_t samples;
+    uint32_t dropped;
+    uint32_t entries;
+    uint32_t next;
+    uint32_t count;
+    seL4_Word pc[REFOS_PROFILE_CHUNK_ENTRIES];
+    uint32_t hits[REFOS_PROFILE_CHUNK_ENTRIES];
+} refos_profile_chunk_t;
+
+/* ------------------------------- Terminal line discipline ------------------------------------- */
+
+/*! @brief data_ioctl() requests for terminal dataspaces. */
+#define REFOS_IOCTL_GET_LFLAG 0x1
+#define REFOS_IOCTL_SET_LFLAG 0x2
+
+/*! @brief Terminal line discipline flags; the subset of termios c_lflag the console server
+           supports. With REFOS_LFLAG_ICANON set, input is line buffered and edited (backspace) by the
+           console server, and each read returns at most one whole line. Otherwise every character
+           is passed through as soon as it is typed. REFOS_LFLAG_ECHO echoes input back. */
+#define REFOS_LFLAG_ICANON (1 << 0)
+#define REFOS_LFLAG_ECHO (1 << 1)
+
+/* -------------------------------- File content generation ------------------------------------- */
+
+/*! @brief data_ioctl() request for file dataspaces. Returns the file's content generation, which
+           changes whenever the file is written, truncated or unmapped by a writer. Files which
+           never change, such as those in the boot image, are always generation 0. */
+#define REFOS_IOCTL_GET_GENERATION 0x3
+
+/* ----------------------------------- Readiness notification ----------------------------------- */
+
+/*! @brief data_poll() events. A dataspace is readable when a read or getc would return data without
+           blocking, and writable when a write would not block. */
+#define REFOS_POLL_READ (1 << 0)
+#define REFOS_POLL_WRITE (1 << 1)
+
 /* ----------------------------------- Helper functions ----------------------------------------- */
 
 /*! @brief The RefOS system small-page size. Should be 4k on most platforms. */
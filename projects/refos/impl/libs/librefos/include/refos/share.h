@@ -51,5 +51,20 @@ int refos_share_read(char *dest, size_t len, char *bufVaddr, size_t bufSize,
 int refos_share_write(char *src, size_t len, char *bufVaddr, size_t bufSize,
         unsigned int *end);
 
+/*! @brief Get the number of bytes waiting to be read from a shared buffer.
+    @param bufVaddr The shared ringbuffer address. (input, no ownership)
+    @param bufSize The shared ringbuffer size.
+    @return The number of bytes that may be read.
+ */
+size_t refos_share_read_available(char *bufVaddr, size_t bufSize);
+
+/*! @brief Get the number of bytes that may be written into a shared buffer without overrunning
+           the reader.
+    @param bufVaddr The shared ringbuffer address. (input, no ownership)
+    @param bufSize The shared ringbuffer size.
+    @return The number of bytes that may be written.
+ */
+size_t refos_share_write_available(char *bufVaddr, size_t bufSize);
+
 #endif /* _REFOS_SHARE_H_ */
 
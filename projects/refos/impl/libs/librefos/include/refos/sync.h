@@ -16,11 +16,16 @@
 /*! @file
     @brief Basic kernel synchronisation library.
 
-    Basic mutex functionality using a kernel lock. Based on Anna Lyons' sync library. Implemented
-    using a kernel async endpoint. Slow!
+    Mutexes, counting semaphores and condition variables. Based on Anna Lyons' sync library.
+    Uncontended operations are a single atomic instruction in userspace; a kernel endpoint is only
+    used to block and wake threads when there is contention.
 */
 
 typedef struct sync_mutex_* sync_mutex_t;
+typedef struct sync_sem_* sync_sem_t;
+typedef struct sync_cond_* sync_cond_t;
+
+/* ---------------------------------------- Mutex ----------------------------------------------- */
 
 /*! @brief Create a mutex object.
     @return The created mutex object. (Gives ownership. Must call sync_destroy_mutex on given obj)
@@ -48,4 +53,66 @@ void sync_release(sync_mutex_t mutex);
 */
 int sync_try_acquire(sync_mutex_t mutex);
 
+/* ---------------------------------------- Semaphore ------------------------------------------- */
+
+/*! @brief Create a counting semaphore object.
+    @param value The initial count. Must not be negative.
+    @return The created semaphore object. (Gives ownership. Must call sync_destroy_sem on given obj)
+*/
+sync_sem_t sync_create_sem(int value);
+
+/*! @brief Destroy a semaphore object.
+    @param sem The semaphore object to destroy. (Takes ownership)
+*/
+void sync_destroy_sem(sync_sem_t sem);
+
+/*! @brief Take one from a semaphore's count. Blocks current program while the count is zero.
+    @param sem The semaphore to wait on. (No ownership)
+*/
+void sync_sem_wait(sync_sem_t sem);
+
+/*! @brief Add one to a semaphore's count, waking up a waiting thread if there is one. If a
+           thread is about to block on the semaphore, waits briefly for it to do so.
+    @param sem The semaphore to post. (No ownership)
+*/
+void sync_sem_post(sync_sem_t sem);
+
+/*! @brief Take one from a semaphore's count if it is not zero, without blocking.
+    @param sem The semaphore to poll. (No ownership)
+    @return True if the count was taken from, false otherwise.
+*/
+int sync_sem_try_wait(sync_sem_t sem);
+
+/* ---------------------------------------- Condition variable ---------------------------------- */
+
+/*! @brief Create a condition variable object.
+    @return The created condition object. (Gives ownership. Must call sync_destroy_cond on given
+            obj)
+*/
+sync_cond_t sync_create_cond();
+
+/*! @brief Destroy a condition variable object. Nobody may be waiting on it.
+    @param cond The condition object to destroy. (Takes ownership)
+*/
+void sync_destroy_cond(sync_cond_t cond);
+
+/*! @brief Release a mutex and wait for a condition to be signalled, then take the mutex again.
+           The condition should be re-checked on return.
+    @param cond The condition to wait on. (No ownership)
+    @param mutex The mutex protecting the condition, which the caller must hold. (No ownership)
+*/
+void sync_cond_wait(sync_cond_t cond, sync_mutex_t mutex);
+
+/*! @brief Wake up one thread waiting on a condition, if any. The caller must hold the mutex the
+           waiters used.
+    @param cond The condition to signal. (No ownership)
+*/
+void sync_cond_signal(sync_cond_t cond);
+
+/*! @brief Wake up every thread waiting on a condition. The caller must hold the mutex the
+           waiters used.
+    @param cond The condition to broadcast. (No ownership)
+*/
+void sync_cond_broadcast(sync_cond_t cond);
+
 #endif /* _REFOS_SYNC_H_ */
@@ -41,6 +41,7 @@
 #define PROCESS_STATICPARAM_ADDR 0xDFF30000
 #define PROCESS_STATICPARAM_SIZE 0x1000
 #define PROCESS_STATICPARAM_PROCINFO_ADDR (PROCESS_STATICPARAM_ADDR + 0x800)
+#define PROCESS_STATICPARAM_STR_SIZE (PROCESS_STATICPARAM_PROCINFO_ADDR - PROCESS_STATICPARAM_ADDR)
 
 #define PROCESS_PARAM_DEFAULTSIZE 0x8000
 #define PROCESS_PARAM_DEFAULTSIZE_NPAGES 8
@@ -79,9 +80,20 @@
    likely needs a selfloader to act as a device server. */
 #define PROCCSPACE_DEVICE_SERV_RESERVED 35
 
+/* Per-thread capabilities of threads created with proc_clone, indexed by thread ID: the thread's
+   notification, placed there by the process server, and the slot the thread receives RPC caps in.
+   The process server empties both slots when the thread exits. */
+#define PROCCSPACE_THREAD_NOTIFY_START 1024
+#define PROCCSPACE_THREAD_RECV_START (PROCCSPACE_THREAD_NOTIFY_START + PROCESS_MAX_THREADS)
+
 #define PROCCSPACE_ALLOC_REGION_START 61000
 #define PROCCSPACE_ALLOC_REGION_END 65000
 #define PROCCSPACE_ALLOC_REGION_SIZE (PROCCSPACE_ALLOC_REGION_END - PROCCSPACE_ALLOC_REGION_START)
 
+/* Process server per-core fault endpoints, one slot per CPU core. Each thread's fault endpoint is
+   the slot of the core it is pinned to. */
+#define PROCCSPACE_FAULT_EP_START 65024
+#define PROCCSPACE_FAULT_EP_END 65280
+
 
 #endif /* _REFOS_VIRTUAL_MEMORY_LAYOUT_H_ */
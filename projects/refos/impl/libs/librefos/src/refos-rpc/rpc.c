@@ -24,16 +24,18 @@
 static char _rpc_static_mempool[RPC_MAX_TRACKED_OBJS][RPC_STATIC_MEMPOOL_OBJ_SIZE];
 static bool _rpc_static_mempool_table[RPC_MAX_TRACKED_OBJS];
 
-// Current global MR and cap index, used for setmr and getmr.
-uint32_t _rpc_mr;
-uint32_t _rpc_cp;
-
-// Other global rpc state.
-static seL4_CPtr _rpc_recv_cslot;
-ENDPT _rpc_dest_ep;
-seL4_MessageInfo_t _rpc_minfo;
-uint32_t _rpc_label;
-const char* _rpc_name;
+// Current MR and cap index, used for setmr and getmr. The RPC state belongs to the call in
+// progress, so it is thread-local; threads of a multi-threaded server may make or serve calls
+// at the same time.
+__thread uint32_t _rpc_mr;
+__thread uint32_t _rpc_cp;
+
+// Other per-thread rpc state.
+static __thread seL4_CPtr _rpc_recv_cslot;
+__thread ENDPT _rpc_dest_ep;
+__thread seL4_MessageInfo_t _rpc_minfo;
+__thread uint32_t _rpc_label;
+__thread const char* _rpc_name;
 
 // ------------------------------------------- RPC Helper ------------------------------------------
 
@@ -43,15 +45,15 @@ rpc_malloc(size_t sz)
     // Minimal static buffer pool allocation.
     // Note that we cannot malloc here, as malloc could call mmap which could call us back,
     // resulting in a cyclic dependency.
+    // The pool is shared between threads, so each slot is claimed atomically.
     assert(sz <= RPC_STATIC_MEMPOOL_OBJ_SIZE);
     int i;
     for (i = 0; i < RPC_MAX_TRACKED_OBJS; i++) {
-        if (!_rpc_static_mempool_table[i]) {
+        if (!__sync_lock_test_and_set(&_rpc_static_mempool_table[i], true)) {
             break;
         }
     }
     assert(i < RPC_MAX_TRACKED_OBJS);
-    _rpc_static_mempool_table[i] = true;
     return _rpc_static_mempool[i];
 }
 
@@ -61,7 +63,7 @@ rpc_free(void *addr)
     int i = (((char*)addr) - (&_rpc_static_mempool[0][0])) / RPC_STATIC_MEMPOOL_OBJ_SIZE;
     assert(i >= 0 && i < RPC_MAX_TRACKED_OBJS);
     assert(_rpc_static_mempool_table[i]);
-    _rpc_static_mempool_table[i] = false;
+    __sync_lock_release(&_rpc_static_mempool_table[i]);
 }
 
 uint32_t
@@ -14,6 +14,7 @@
 #include <syscall.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <sel4/sel4.h>
 #include <refos-util/init.h>
@@ -389,6 +390,9 @@ long sys_recvmmsg(va_list ap);
 long sys_fanotify_init(va_list ap);
 long sys_fanotify_mark(va_list ap);
 #endif /* CONFIG_ARCH_ARM */
+#ifdef CONFIG_ARCH_IA32
+long sys_socketcall(va_list ap);
+#endif /* CONFIG_ARCH_IA32 */
 
 void
 refos_init_selfload_child(uintptr_t parent_syscall_table_address)
@@ -730,6 +734,9 @@ refos_init_selfload_child(uintptr_t parent_syscall_table_address)
     syscall_table[__NR_fanotify_init] = sys_fanotify_init;
     syscall_table[__NR_fanotify_mark] = sys_fanotify_mark;
 #endif /* CONFIG_ARCH_ARM */
+#ifdef CONFIG_ARCH_IA32
+    syscall_table[__NR_socketcall] = sys_socketcall;
+#endif /* CONFIG_ARCH_IA32 */
 }
 
 void
@@ -827,6 +834,13 @@ refos_static_param(void)
     return (char*)(PROCESS_STATICPARAM_ADDR);
 }
 
+char *
+refos_static_param_args(void)
+{
+    char *param = refos_static_param();
+    return param + strnlen(param, PROCESS_STATICPARAM_STR_SIZE - 1) + 1;
+}
+
 struct sl_procinfo_s *
 refos_static_param_procinfo(void)
 {
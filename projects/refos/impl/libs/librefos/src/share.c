@@ -132,3 +132,30 @@ refos_share_write(char *src, size_t len, char *bufVaddr, size_t bufSize,
 
     return 0;
 }
+
+size_t
+refos_share_read_available(char *bufVaddr, size_t bufSize)
+{
+    assert(bufVaddr != NULL);
+    unsigned int start = refos_share_get_start(bufVaddr);
+    unsigned int end = refos_share_get_end(bufVaddr);
+    unsigned int ringBufSize = bufSize - SHARE_METADATA_SIZE;
+
+    if (refos_share_validate_params(bufSize, start, end)) {
+        return 0;
+    }
+    return start <= end ? (end - start) : (ringBufSize - start) + end;
+}
+
+size_t
+refos_share_write_available(char *bufVaddr, size_t bufSize)
+{
+    assert(bufVaddr != NULL);
+    unsigned int start = refos_share_get_start(bufVaddr);
+    unsigned int end = refos_share_get_end(bufVaddr);
+
+    if (refos_share_validate_params(bufSize, start, end)) {
+        return 0;
+    }
+    return refos_share_write_remaining_size(start, end, bufSize - SHARE_METADATA_SIZE);
+}
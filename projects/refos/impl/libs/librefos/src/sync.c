@@ -22,14 +22,53 @@
 #include <refos-rpc/proc_client_helper.h>
 
 /*! @file
-    @brief Basic kernel synchronisation library. */
+    @brief Basic kernel synchronisation library.
+
+    Every object keeps its count in an atomic word, and only makes a kernel call when a thread has
+    to block or wake a blocked thread. Mutexes block on a notification: the lock is handed
+    directly to a single waiter on release, so at most one signal is ever outstanding and none
+    can be lost. Counting semaphores may have several posts outstanding at once, which a
+    notification would merge into one, so they block on a sync endpoint instead; a post which
+    has to wake a waiter rendezvouses with it. */
 
 #define SYNC_ASYNC_BADGE_MAGIC 0x4188A
 
 struct sync_mutex_ {
     seL4_CPtr mapping;
+    /* 1 if free, 0 if held, -n if held with n threads blocked or about to block. */
+    volatile int32_t value;
+};
+
+struct sync_sem_ {
+    seL4_CPtr ep;
+    /* The count if not negative, otherwise -n with n threads blocked or about to block. */
+    volatile int32_t value;
+};
+
+struct sync_cond_ {
+    sync_sem_t sem;
+    uint32_t waiters; /* Protected by the mutex the condition is used with. */
 };
 
+/*! @brief Atomically take one from a positive counter, without ever blocking.
+    @return True if the counter was positive and has been decremented, false otherwise.
+*/
+static int
+sync_try_decrement(volatile int32_t *value)
+{
+    int32_t v = *value;
+    while (v > 0) {
+        int32_t old = __sync_val_compare_and_swap(value, v, v - 1);
+        if (old == v) {
+            return 1;
+        }
+        v = old;
+    }
+    return 0;
+}
+
+/* ------------------------------------ Mutex --------------------------------------------------- */
+
 sync_mutex_t
 sync_create_mutex()
 {
@@ -47,8 +86,7 @@ sync_create_mutex()
         return NULL;
     }
 
-    /* Prime the endpoint. */
-    seL4_Signal(mutex->mapping);
+    mutex->value = 1;
     return mutex;
 }
 
@@ -62,26 +100,144 @@ sync_destroy_mutex(sync_mutex_t mutex)
 void
 sync_acquire(sync_mutex_t mutex)
 {
-    seL4_Word badge;
     assert(mutex);
-    seL4_MessageInfo_t msginfo = seL4_Recv(mutex->mapping, &badge);
-    assert(badge == SYNC_ASYNC_BADGE_MAGIC);
-    (void) msginfo;
+    if (__sync_fetch_and_sub(&mutex->value, 1) > 0) {
+        /* Uncontended. */
+        return;
+    }
 
+    /* Held by someone else; wait for them to hand the lock over. */
+    seL4_Word badge = 0;
+    seL4_Wait(mutex->mapping, &badge);
+    assert(badge == SYNC_ASYNC_BADGE_MAGIC);
 }
 
 void
 sync_release(sync_mutex_t mutex)
 {
-    /* Release the lock and wake the next thread up. */
-    seL4_Signal(mutex->mapping);
+    assert(mutex);
+    if (__sync_fetch_and_add(&mutex->value, 1) < 0) {
+        /* Hand the lock over to the next thread and wake it up. */
+        seL4_Signal(mutex->mapping);
+    }
 }
 
 int
 sync_try_acquire(sync_mutex_t mutex)
 {
+    assert(mutex);
+    return sync_try_decrement(&mutex->value);
+}
+
+/* ------------------------------------ Semaphore ----------------------------------------------- */
+
+sync_sem_t
+sync_create_sem(int value)
+{
+    assert(value >= 0);
+    sync_sem_t sem = (sync_sem_t) malloc(sizeof(struct sync_sem_));
+    if (!sem) {
+        return NULL;
+    }
+
+    sem->ep = proc_new_endpoint();
+    if (REFOS_GET_ERRNO() != ESUCCESS || sem->ep == 0) {
+        free(sem);
+        return NULL;
+    }
+
+    sem->value = value;
+    return sem;
+}
+
+void
+sync_destroy_sem(sync_sem_t sem)
+{
+    proc_del_endpoint(sem->ep);
+    free(sem);
+}
+
+void
+sync_sem_wait(sync_sem_t sem)
+{
+    assert(sem);
+    if (__sync_fetch_and_sub(&sem->value, 1) > 0) {
+        return;
+    }
     seL4_Word badge = 0;
-    seL4_MessageInfo_t info = seL4_Poll(mutex->mapping, &badge);
-    (void) info;
-    return badge == SYNC_ASYNC_BADGE_MAGIC;
+    seL4_Recv(sem->ep, &badge);
+}
+
+void
+sync_sem_post(sync_sem_t sem)
+{
+    assert(sem);
+    if (__sync_fetch_and_add(&sem->value, 1) < 0) {
+        /* Somebody is blocked or about to block; this waits for them to get there. */
+        seL4_Send(sem->ep, seL4_MessageInfo_new(0, 0, 0, 0));
+    }
+}
+
+int
+sync_sem_try_wait(sync_sem_t sem)
+{
+    assert(sem);
+    return sync_try_decrement(&sem->value);
+}
+
+/* ------------------------------------ Condition variable -------------------------------------- */
+
+sync_cond_t
+sync_create_cond()
+{
+    sync_cond_t cond = (sync_cond_t) malloc(sizeof(struct sync_cond_));
+    if (!cond) {
+        return NULL;
+    }
+    cond->sem = sync_create_sem(0);
+    if (!cond->sem) {
+        free(cond);
+        return NULL;
+    }
+    cond->waiters = 0;
+    return cond;
+}
+
+void
+sync_destroy_cond(sync_cond_t cond)
+{
+    sync_destroy_sem(cond->sem);
+    free(cond);
+}
+
+void
+sync_cond_wait(sync_cond_t cond, sync_mutex_t mutex)
+{
+    assert(cond && mutex);
+    /* Registering as a waiter under the mutex means a signal sent after we drop the mutex is
+       counted by the semaphore, even if it arrives before we block. */
+    cond->waiters++;
+    sync_release(mutex);
+    sync_sem_wait(cond->sem);
+    sync_acquire(mutex);
+}
+
+void
+sync_cond_signal(sync_cond_t cond)
+{
+    assert(cond);
+    if (cond->waiters > 0) {
+        cond->waiters--;
+        sync_sem_post(cond->sem);
+    }
+}
+
+void
+sync_cond_broadcast(sync_cond_t cond)
+{
+    assert(cond);
+    while (cond->waiters > 0) {
+        cond->waiters--;
+        sync_sem_post(cond->sem);
+    }
 }
@@ -17,6 +17,8 @@
 #include <refos/refos.h>
 #include <refos/error.h>
 #include <data_struct/coat.h>
+#include <refos-io/socket.h>
+#include <refos-rpc/serv_client_helper.h>
 
 #define FD_TABLE_MAGIC 0xA6B1063F
 #define FD_TABLE_BASE 3 /* 0, 1 and 2 are stdin, stdout and stderr. */
@@ -27,6 +29,17 @@ typedef struct fd_table_s {
     uint32_t magic;
 } fd_table_t;
 
+#define FD_TABLE_DSPACE_MAGIC 0x2D5A7E31
+
+/*! @brief An open dataspace and the session it was opened on. Shared by the fd which opened it
+           and any mmap mappings of it, and closed once the last of those lets go. */
+typedef struct fd_table_dspace_s {
+    serv_connection_t connection;
+    seL4_CPtr dspace;
+    int refCount;
+    uint32_t magic;
+} fd_table_dspace_t;
+
 void filetable_init(fd_table_t *fdt, uint32_t tableSize);
 
 void filetable_release(fd_table_t *fdt);
@@ -43,6 +56,21 @@ int filetable_write(fd_table_t *fdt, int fd, char *bufferSrc, int bufferLen);
 
 seL4_CPtr filetable_dspace_get(fd_table_t *fdt, int fd);
 
+seL4_CPtr filetable_dspace_get_session(fd_table_t *fdt, int fd);
+
+/*! @brief Take a reference to the dataspace behind an fd, which stays open after the fd is closed
+           until the reference is dropped with filetable_dspace_unref().
+    @return The dataspace, with a new reference (Has ownership), NULL if fd isn't a dataspace.
+*/
+fd_table_dspace_t *filetable_dspace_ref(fd_table_t *fdt, int fd);
+
+/*! @brief Drop a reference to a dataspace, closing it if it was the last one. */
+void filetable_dspace_unref(fd_table_dspace_t *ds);
+
+int filetable_socket_alloc(fd_table_t *fdt, refos_socket_t **sock);
+
+refos_socket_t *filetable_socket_get(fd_table_t *fdt, int fd);
+
 void filetable_init_default(void);
 
 void filetable_deinit_default(void);
@@ -20,6 +20,7 @@
 #include "morecore.h"
 #include "mmap_segment.h"
 #include "filetable.h"
+#include "poll.h"
 
 #include <refos-util/walloc.h>
 #include <refos-rpc/serv_client.h>
@@ -60,6 +61,12 @@ typedef struct refos_io_internal_state {
 
     /*! Timer state. */
     FILE * timerFD;
+
+    /*! Network server session, connected when the first socket is created. */
+    serv_connection_t netSession;
+
+    /*! Readiness notification state for poll and select. */
+    refos_io_poll_state_t pollState;
 } refos_io_internal_state_t;
 
 extern refos_io_internal_state_t refosIOState;
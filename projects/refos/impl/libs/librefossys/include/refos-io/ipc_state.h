@@ -17,9 +17,10 @@
 #include <sel4/sel4.h>
 #include <stdlib.h>
 
+/* Each thread has its own IPC buffer, so each has its own save stack too. Defined in stdio.c. */
 #define IPC_SAVESTACK_MAXLEVELS 4
-static seL4_IPCBuffer _refosioIPCBufferBackup[IPC_SAVESTACK_MAXLEVELS];
-static uint32_t _refosioIPCBufferBackupStack = 0;
+extern __thread seL4_IPCBuffer _refosioIPCBufferBackup[IPC_SAVESTACK_MAXLEVELS];
+extern __thread uint32_t _refosioIPCBufferBackupStack;
 
 static inline void
 refosio_internal_save_IPC_buffer(void)
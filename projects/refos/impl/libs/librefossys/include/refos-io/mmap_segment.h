@@ -17,8 +17,10 @@
 #include <sel4/sel4.h>
 #include <stdlib.h>
 #include <data_struct/cbpool.h>
+#include <data_struct/cvector.h>
 #include <refos/refos.h>
 #include <refos/vmlayout.h>
+#include <refos-io/filetable.h>
 
 #define PROCESS_MMAP_LIMIT_SIZE_NPAGES (PROCESS_MMAP_LIMIT_SIZE / REFOS_PAGE_SIZE)
 #define PROCESS_MMAP_SEGMENT_SIZE_NPAGES (128UL)
@@ -48,11 +50,27 @@
     Note that we do not book-keep the dataspace and window caps here. We reply on the get functions
     from process server to book keep them, to avoid the inefficient double book-keeping.
 
+    File-backed mappings are different, as their dataspace lives on an external dataserver and
+    isn't known to the process server. A file mapping is allocated a run of whole segments, all of
+    whose page bits are set to 1, and the file dataspace is datamapped directly into a single
+    window spanning them. Faults in this window are then delegated to the dataserver to page in,
+    without any copying through IPC. These few mappings are book-kept in a small list, each holding
+    a reference to the file's dataspace so that the fd may be closed while it is still mapped.
+
     ref: http://gcc.gnu.org/onlinedocs/libstdc++/manual/bitmap_allocator.html
          http://en.wikipedia.org/wiki/Free_space_bitmap
 
 */
 
+/*! @brief Book-keeping for a single file-backed mmap region. */
+typedef struct refos_io_mmap_file {
+    uint32_t vaddr;
+    uint32_t segmentID;
+    uint32_t nsegments;
+    seL4_CPtr window;
+    fd_table_dspace_t *ds; /* Has ownership of one reference. */
+} refos_io_mmap_file_t;
+
 typedef struct refos_io_mmap_segment_state {
 
     /*! 524288 page bitmap. Not much memory, only 16384 bytes. */
@@ -61,6 +79,9 @@ typedef struct refos_io_mmap_segment_state {
     /*! 4096 segment bitmap. Negligible memory, only 128 bytes. */
     cbpool_t mmapRegionSegmentStatus;
 
+    /*! List of file-backed mappings. (refos_io_mmap_file_t*) */
+    cvector_t fileMappings;
+
 } refos_io_mmap_segment_state_t;
 
 void refosio_mmap_init(refos_io_mmap_segment_state_t *s);
@@ -73,4 +94,26 @@ int refosio_mmap_anon(refos_io_mmap_segment_state_t *s, int npages, uint32_t *va
 
 int refosio_munmap_anon(refos_io_mmap_segment_state_t *s, uint32_t vaddr, int npages);
 
+/*! @brief Map a file dataspace read-only into the mmap region.
+    @param s The mmap state.
+    @param npages The size of the mapping in pages.
+    @param ds Reference to the file dataspace to map. (Takes ownership on success)
+    @param offset The offset into the dataspace to map from.
+    @param[out] vaddrDest Output base vaddr of the mapping.
+    @return ESUCCESS on success, refos_err_t otherwise.
+*/
+int refosio_mmap_file(refos_io_mmap_segment_state_t *s, int npages, fd_table_dspace_t *ds,
+                      uint32_t offset, uint32_t *vaddrDest);
+
+/*! @brief Unmap a file mapping previously created by refosio_mmap_file().
+
+    Partial unmapping of a file mapping is not supported; the whole mapping containing the given
+    vaddr is unmapped, and its reference to the file dataspace dropped.
+
+    @param s The mmap state.
+    @param vaddr Any vaddr inside the file mapping.
+    @return ESUCCESS on success, EFILENOTFOUND if there is no file mapping at the given vaddr.
+*/
+int refosio_munmap_file(refos_io_mmap_segment_state_t *s, uint32_t vaddr);
+
 #endif /* _REFOS_IO_MMAP_SEGMENT_H_ */
\ No newline at end of file
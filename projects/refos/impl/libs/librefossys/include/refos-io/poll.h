@@ -0,0 +1,69 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+#ifndef _REFOS_IO_POLL_H_
+#define _REFOS_IO_POLL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sel4/sel4.h>
+#include <refos/refos.h>
+
+/*! @file
+    @brief Waiting on several file descriptors at once.
+
+    Every dataspace being waited on is armed at its dataserver with data_poll(), handing over a
+    badged copy of a single per-process notification; the timeout is an alarm on the timer
+    dataspace, signalling the same notification. The process then blocks on that notification
+    alone. Arming is one-shot, and a dataspace stays armed between calls until it fires, so
+    polling an idle descriptor again costs no RPC.
+
+    Each descriptor gets badge bit (fd % REFOS_POLL_FD_BITS); descriptors sharing a bit are simply
+    all checked again when it fires. The timer alternates between two bits, so a stale alarm from
+    an earlier call can never be mistaken for the current one.
+*/
+
+#define REFOS_POLL_FD_BITS 24
+#define REFOS_POLL_TIMER_BIT(gen) (REFOS_POLL_FD_BITS + ((gen) & 1))
+#define REFOS_POLL_NUM_BITS (REFOS_POLL_FD_BITS + 2)
+
+/*! @brief Client side only poll event, for descriptors which can't be polled. */
+#define REFOS_POLL_NVAL (1 << 8)
+
+typedef struct refos_io_poll_state_s {
+    seL4_CPtr notify; /* Has ownership. */
+    seL4_CPtr sourceEP[REFOS_POLL_NUM_BITS]; /* Badged copies of notify, minted lazily. */
+    int armedFd[REFOS_POLL_FD_BITS]; /* fd + 1 armed on each bit, 0 if none. */
+    int armedEvents[REFOS_POLL_FD_BITS];
+    int timerGeneration;
+} refos_io_poll_state_t;
+
+typedef struct refos_poll_source_s {
+    int fd;
+    int events; /* REFOS_POLL_READ and / or REFOS_POLL_WRITE. */
+    int revents; /* Output. */
+} refos_poll_source_t;
+
+/*! @brief Wait until any of the given file descriptors is ready.
+    @param src The descriptors to wait on, and their events. revents is filled in. (No ownership)
+    @param n The number of descriptors in src.
+    @param timeoutUS Timeout in microseconds; 0 to only check, negative to wait forever.
+    @return The number of ready descriptors, 0 on timeout, negative errno value otherwise.
+*/
+int refos_poll(refos_poll_source_t *src, int n, int64_t timeoutUS);
+
+/*! @brief Forget any notification armed on a descriptor, as it is being closed.
+    @param fd The descriptor being closed.
+*/
+void refos_poll_forget(int fd);
+
+#endif /* _REFOS_IO_POLL_H_ */
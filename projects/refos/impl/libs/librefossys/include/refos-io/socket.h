@@ -0,0 +1,121 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+#ifndef _REFOS_IO_SOCKET_H_
+#define _REFOS_IO_SOCKET_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <refos-rpc/net_common.h>
+#include <refos-rpc/data_client_helper.h>
+
+/*! @file
+    @brief Client side of network server sockets.
+
+    Socket payload is moved through the rings in the socket's shared buffer; the network server is
+    only called to set sockets up, to ring the doorbell after touching the rings, and to block.
+    All functions here return negative POSIX errno values on failure.
+*/
+
+#define REFOS_SOCKET_MAGIC 0x50C3E7C1
+#define REFOS_SOCKET_SERVER_PATH "/net/sock"
+
+typedef struct refos_socket_s {
+    uint32_t magic;
+    int id;
+    int type;
+    bool connected;
+    bool txShutdown;
+    bool nonBlock; /* O_NONBLOCK, for the syscall layer. */
+
+    data_mapping_t buffer; /* Has ownership. */
+    struct net_socket_control *ctrl;
+    char *rx;
+    char *tx;
+    unsigned int rxStart;
+    unsigned int txEnd;
+} refos_socket_t;
+
+/*! @brief Create a new socket at the network server.
+    @param s The socket structure to fill in. (No ownership)
+    @param type NETSERV_SOCK_STREAM or NETSERV_SOCK_DGRAM.
+    @return 0 on success, negative errno value otherwise.
+*/
+int refos_socket_create(refos_socket_t *s, int type);
+
+int refos_socket_bind(refos_socket_t *s, uint32_t addr, uint32_t port);
+
+int refos_socket_listen(refos_socket_t *s, int backlog);
+
+/*! @brief Accept a connection on a listening socket.
+    @param s The listening socket.
+    @param newSock The socket structure to fill in with the new connection. (No ownership)
+    @param addr Optional output address of the connecting peer.
+    @param port Optional output port of the connecting peer.
+    @param nonBlock Return -EAGAIN rather than wait if no connection is pending.
+    @return 0 on success, negative errno value otherwise.
+*/
+int refos_socket_accept(refos_socket_t *s, refos_socket_t *newSock, uint32_t *addr,
+                        uint32_t *port, bool nonBlock);
+
+int refos_socket_connect(refos_socket_t *s, uint32_t addr, uint32_t port);
+
+int refos_socket_getname(refos_socket_t *s, bool peer, uint32_t *addr, uint32_t *port);
+
+/*! @brief Send data on a socket.
+
+    Stream sockets send as much as they can, waiting for ring space unless nonBlock is set.
+    Datagram sockets send the whole of buf as one datagram or nothing.
+
+    @param s The socket to send on.
+    @param buf The data to send. (No ownership)
+    @param len The length of the data.
+    @param addr Destination address for datagram sockets, or 0 for the connected peer.
+    @param port Destination port for datagram sockets.
+    @param nonBlock Return -EAGAIN rather than wait for ring space.
+    @return The number of bytes sent, negative errno value otherwise.
+*/
+int refos_socket_send(refos_socket_t *s, const char *buf, size_t len, uint32_t addr,
+                      uint32_t port, bool nonBlock);
+
+/*! @brief Receive data from a socket.
+
+    Stream sockets return whatever is in the receive ring, up to len, and 0 at end of stream.
+    Datagram sockets return one datagram, truncated to len if it is larger.
+
+    @param s The socket to receive from.
+    @param buf The buffer to receive into. (No ownership)
+    @param len The size of buf.
+    @param addr Optional output source address for datagram sockets.
+    @param port Optional output source port for datagram sockets.
+    @param nonBlock Return -EAGAIN rather than wait for data.
+    @return The number of bytes received, negative errno value otherwise.
+*/
+int refos_socket_recv(refos_socket_t *s, char *buf, size_t len, uint32_t *addr, uint32_t *port,
+                      bool nonBlock);
+
+int refos_socket_shutdown(refos_socket_t *s);
+
+/*! @brief Check a socket's rings for readiness, without calling the network server.
+    @param s The socket to check.
+    @return The ready REFOS_POLL_* events. Listening and unconnected stream sockets never show as
+            ready.
+*/
+int refos_socket_ready(refos_socket_t *s);
+
+/*! @brief Close a socket and release its shared buffer.
+    @param s The socket to close. The structure itself is not freed.
+*/
+void refos_socket_close(refos_socket_t *s);
+
+#endif /* _REFOS_IO_SOCKET_H_ */
@@ -20,6 +20,7 @@
 */
 
 #include <stdio.h>
+#include <stdint.h>
 #include <stdbool.h>
 #include <stdlib.h>
 
@@ -40,4 +41,15 @@ int refos_async_getc(void);
 
 int refos_getc(void);
 
+/*! @brief Blocking read from stdin. Returns as soon as anything can be read; with the console in
+           canonical mode, that is a whole line. Returns the number of bytes read, or a negative
+           refos_err_t on error. */
+int refos_read(char *buf, size_t count);
+
+/*! @brief Get the stdin line discipline flags (REFOS_LFLAG_*). Returns a negative value on error. */
+int refos_stdio_get_lflag(void);
+
+/*! @brief Set the stdin line discipline flags (REFOS_LFLAG_*). Returns a negative value on error. */
+int refos_stdio_set_lflag(uint32_t lflag);
+
 #endif /* _REFOS_IO_STDIO_H_ */
@@ -0,0 +1,48 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+#ifndef _REFOS_IO_THREAD_H_
+#define _REFOS_IO_THREAD_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sel4/sel4.h>
+
+/*! @file
+    @brief Thread state shared between the clone and futex syscalls. */
+
+/*! @brief Get the calling thread's process server thread ID. The main thread is thread 0. */
+int refosio_thread_id(void);
+
+/*! @brief Get the calling thread's notification, which futex waits block on.
+    @return The notification cap, or 0 if the thread doesn't have one. Only processes which have
+            created threads have notifications.
+*/
+seL4_CPtr refosio_thread_notify(void);
+
+/*! @brief Check whether a futex word is the TID word of a thread created by this process. The
+           process server clears these when the thread exits, without waking anybody, so waiters
+           on them have to poll.
+    @param uaddr The futex word.
+    @return true if uaddr is a thread's TID word, false otherwise.
+*/
+bool refosio_thread_is_clear_tid(volatile int *uaddr);
+
+/*! @brief Wake up threads waiting on a futex word.
+    @param uaddr The futex word.
+    @param count The maximum number of waiters to wake.
+    @return The number of waiters woken.
+*/
+int refosio_futex_wake(volatile int *uaddr, int count);
+
+#endif /* _REFOS_IO_THREAD_H_ */
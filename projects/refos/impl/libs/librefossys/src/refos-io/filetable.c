@@ -21,6 +21,7 @@
 #include <refos/error.h>
 #include <refos-io/filetable.h>
 #include <refos-io/internal_state.h>
+#include <refos-io/poll.h>
 #include <refos-rpc/serv_client.h>
 #include <refos-rpc/serv_client_helper.h>
 #include <refos-util/dprintf.h>
@@ -28,6 +29,7 @@
 #define FD_TABLE_DEFAULT_SIZE 1024
 #define FD_TABLE_ENTRY_TYPE_NONE 0
 #define FD_TABLE_ENTRY_TYPE_DATASPACE 1
+#define FD_TABLE_ENTRY_TYPE_SOCKET 2
 
 #define FD_TABLE_ENTRY_DATASPACE_MAGIC 0x4E6CC517
 #define FD_TABLE_DATASPACE_IPC_MAXLEN 32
@@ -37,12 +39,21 @@ typedef struct fd_table_entry_dataspace_s {
     int magic;
     int fd;
 
-    serv_connection_t connection;
-    seL4_CPtr dspace;
+    fd_table_dspace_t *ds; /* Has ownership of one reference. */
     int32_t dspacePos;
     uint32_t dspaceSize;
 } fd_table_entry_dataspace_t;
 
+#define FD_TABLE_ENTRY_SOCKET_MAGIC 0x50C3E7F0
+
+typedef struct fd_table_entry_socket_s {
+    char type; /* FD_TABLE_ENTRY_TYPE. Inherited, must be first. */
+    int magic;
+    int fd;
+
+    refos_socket_t sock;
+} fd_table_entry_socket_t;
+
 /* ----------------------------- Filetable OAT functions ---------------------------------------- */
 
 static cvector_item_t
@@ -52,6 +63,7 @@ filetable_oat_create(coat_t *oat, int id, uint32_t arg[COAT_ARGS])
     cvector_item_t item = NULL;
 
     fd_table_entry_dataspace_t *e = NULL;
+    fd_table_entry_socket_t *se = NULL;
 
     switch (type) {
         case FD_TABLE_ENTRY_TYPE_DATASPACE:
@@ -65,6 +77,17 @@ filetable_oat_create(coat_t *oat, int id, uint32_t arg[COAT_ARGS])
             }
             item = (cvector_item_t) e;
             break;
+        case FD_TABLE_ENTRY_TYPE_SOCKET:
+            /* Allocate a socket FD entry struct. The socket itself is created by the caller. */
+            se = (fd_table_entry_socket_t*) malloc(sizeof(fd_table_entry_socket_t));
+            if (se) {
+                memset(se, 0, sizeof(fd_table_entry_socket_t));
+                se->type = type;
+                se->magic = FD_TABLE_ENTRY_SOCKET_MAGIC;
+                se->fd = id;
+            }
+            item = (cvector_item_t) se;
+            break;
         default:
             printf("filetable_oat_create error: Unknown type.\n");
             break;
@@ -83,6 +106,7 @@ filetable_oat_delete(coat_t *oat, cvector_item_t *obj)
 {
     char type = *((char*) obj);
     fd_table_entry_dataspace_t *e = NULL;
+    fd_table_entry_socket_t *se = NULL;
 
     switch(type) {
         case FD_TABLE_ENTRY_TYPE_DATASPACE:
@@ -90,26 +114,27 @@ filetable_oat_delete(coat_t *oat, cvector_item_t *obj)
             assert(e->type == FD_TABLE_ENTRY_TYPE_DATASPACE);
             assert(e->magic == FD_TABLE_ENTRY_DATASPACE_MAGIC);
 
-            /* Delete dataspace. */
-            if (e->connection.serverSession && e->dspace) {
-                refos_err_t error = data_close(e->connection.serverSession, e->dspace);
-                if (error != ESUCCESS) {
-                    printf("filetable_oat_delete error: couldn't close dspace.\n");
-                    return;
-                }
-                csfree_delete(e->dspace);
-                e->dspace = 0;
-            }
-
-            /* Disconnect from server. */
-            if (e->connection.serverSession) {
-                serv_disconnect(&e->connection);
-                e->connection.serverSession = 0;
+            /* Drop the dataspace. It is only closed here if no mmap mapping still holds it. */
+            if (e->ds) {
+                filetable_dspace_unref(e->ds);
+                e->ds = NULL;
             }
 
             e->magic = 0x0;
             free(e);
             break;
+        case FD_TABLE_ENTRY_TYPE_SOCKET:
+            se = (fd_table_entry_socket_t*) obj;
+            assert(se->magic == FD_TABLE_ENTRY_SOCKET_MAGIC);
+
+            /* Close the socket, if it got as far as being created. */
+            if (se->sock.magic == REFOS_SOCKET_MAGIC) {
+                refos_socket_close(&se->sock);
+            }
+
+            se->magic = 0x0;
+            free(se);
+            break;
         default:
             printf("filetable_oat_delete error: Unknown type.\n");
             break;
@@ -162,29 +187,44 @@ filetable_dspace_open(fd_table_t *fdt, char* filePath, int flags, int mode, int
         return -ENOMEM;
     }
 
-    /* Connect to the dataspace server. */
+    /* Allocate the shared dataspace structure. */
     assert(e->magic == FD_TABLE_ENTRY_DATASPACE_MAGIC);
-    e->connection = serv_connect_no_pbuffer(filePath);
-    if (e->connection.error != ESUCCESS || !e->connection.serverSession) {
-        error = -ESERVERNOTFOUND;
+    fd_table_dspace_t *ds = (fd_table_dspace_t*) malloc(sizeof(fd_table_dspace_t));
+    if (!ds) {
+        printf("filetable_open out of memory.\n");
+        error = -ENOMEM;
         goto exit1;
     }
+    memset(ds, 0, sizeof(fd_table_dspace_t));
+    ds->magic = FD_TABLE_DSPACE_MAGIC;
+    ds->refCount = 1;
+
+    /* Connect to the dataspace server. */
+    ds->connection = serv_connect_no_pbuffer(filePath);
+    if (ds->connection.error != ESUCCESS || !ds->connection.serverSession) {
+        error = -ESERVERNOTFOUND;
+        goto exit2;
+    }
 
     /* Open the dataspace on the server. */
-    e->dspace = data_open(e->connection.serverSession,
-            e->connection.serverMountPoint.dspaceName, flags, mode, size, &error);
-    if (error || !e->dspace) {
+    ds->dspace = data_open(ds->connection.serverSession,
+            ds->connection.serverMountPoint.dspaceName, flags, mode, size, &error);
+    if (error || !ds->dspace) {
         error = -EFILENOTFOUND;
-        goto exit2;
+        goto exit3;
     }
 
-    e->dspaceSize = data_get_size(e->connection.serverSession, e->dspace);
+    e->ds = ds;
+    e->dspaceSize = data_get_size(ds->connection.serverSession, ds->dspace);
     e->dspacePos = 0;
     return e->fd;
 
     /* Exit stack. */
+exit3:
+    serv_disconnect(&ds->connection);
 exit2:
-    serv_disconnect(&e->connection);
+    ds->magic = 0x0;
+    free(ds);
 exit1:
     assert(e && e->fd);
     coat_free(&fdt->table, e->fd);
@@ -192,6 +232,22 @@ exit1:
     return error;
 }
 
+/*! @brief Helper function to retrieve a dataspace FD entry. Returns NULL if not found. */
+static fd_table_entry_dataspace_t *
+filetable_get_dspace_entry(fd_table_t *fdt, int fd)
+{
+    if (fd < FD_TABLE_BASE || fd >= fdt->tableSize) {
+        return NULL;
+    }
+    cvector_item_t entry = coat_get(&fdt->table, fd);
+    if (!entry || *((char*) entry) != FD_TABLE_ENTRY_TYPE_DATASPACE) {
+        return NULL;
+    }
+    fd_table_entry_dataspace_t *fdEntry = (fd_table_entry_dataspace_t*) entry;
+    assert(fdEntry->magic == FD_TABLE_ENTRY_DATASPACE_MAGIC);
+    return fdEntry;
+}
+
 int
 filetable_close(fd_table_t *fdt, int fd)
 {
@@ -199,6 +255,7 @@ filetable_close(fd_table_t *fdt, int fd)
     if (fd < FD_TABLE_BASE || fd >= fdt->tableSize) {
         return -EFILENOTFOUND;
     }
+    refos_poll_forget(fd);
     coat_free(&fdt->table, fd);
     return ESUCCESS;
 }
@@ -247,12 +304,10 @@ filetable_lseek(fd_table_t *fdt, int fd, int *offset, int whence)
             return EINVALIDPARAM;  
     }
 
+    /* Seeking past the end is allowed; a later write there leaves a hole. */
     if (fdEntry->dspacePos < 0) {
         fdEntry->dspacePos = 0;
     }
-    if (fdEntry->dspacePos > fdEntry->dspaceSize) {
-        fdEntry->dspacePos = fdEntry->dspaceSize;
-    }
 
     (*offset) = fdEntry->dspacePos;
     return ESUCCESS;
@@ -298,13 +353,14 @@ filetable_internal_read_write(fd_table_t *fdt, int fd, char *buffer, int bufferL
     }
 
     /* Perform the actual dataspace read / write operation. */
-    assert(fdEntry->dspace);
+    fd_table_dspace_t *ds = fdEntry->ds;
+    assert(ds && ds->dspace);
     int nr = -EINVALID;
     if (read) {
-        nr = data_read(fdEntry->connection.serverSession, fdEntry->dspace, fdEntry->dspacePos,
+        nr = data_read(ds->connection.serverSession, ds->dspace, fdEntry->dspacePos,
                        buffer, bufferLen);
     } else {
-        nr = data_write(fdEntry->connection.serverSession, fdEntry->dspace, fdEntry->dspacePos,
+        nr = data_write(ds->connection.serverSession, ds->dspace, fdEntry->dspacePos,
                        buffer, bufferLen);
     }
     if (nr < 0) {
@@ -322,7 +378,7 @@ filetable_internal_read_write(fd_table_t *fdt, int fd, char *buffer, int bufferL
             fdEntry->dspacePos = fdEntry->dspaceSize;
         }
     } else {
-        fdEntry->dspaceSize = data_get_size(fdEntry->connection.serverSession, fdEntry->dspace);
+        fdEntry->dspaceSize = data_get_size(ds->connection.serverSession, ds->dspace);
     }
 
     ROS_SET_ERRNO(ESUCCESS);
@@ -367,7 +423,96 @@ filetable_dspace_get(fd_table_t *fdt, int fd)
 
     fd_table_entry_dataspace_t *fdEntry = (fd_table_entry_dataspace_t*) entry;
     assert(fdEntry->magic == FD_TABLE_ENTRY_DATASPACE_MAGIC);
-    return fdEntry->dspace;
+    return fdEntry->ds ? fdEntry->ds->dspace : 0;
+}
+
+seL4_CPtr
+filetable_dspace_get_session(fd_table_t *fdt, int fd)
+{
+    assert(fdt && fdt->magic == FD_TABLE_MAGIC);
+    fd_table_entry_dataspace_t *fdEntry = filetable_get_dspace_entry(fdt, fd);
+    if (!fdEntry || !fdEntry->ds) {
+        ROS_SET_ERRNO(EFILENOTFOUND);
+        return 0;
+    }
+    ROS_SET_ERRNO(ESUCCESS);
+    return fdEntry->ds->connection.serverSession;
+}
+
+fd_table_dspace_t *
+filetable_dspace_ref(fd_table_t *fdt, int fd)
+{
+    assert(fdt && fdt->magic == FD_TABLE_MAGIC);
+    fd_table_entry_dataspace_t *fdEntry = filetable_get_dspace_entry(fdt, fd);
+    if (!fdEntry || !fdEntry->ds) {
+        return NULL;
+    }
+    assert(fdEntry->ds->magic == FD_TABLE_DSPACE_MAGIC);
+    fdEntry->ds->refCount++;
+    return fdEntry->ds;
+}
+
+void
+filetable_dspace_unref(fd_table_dspace_t *ds)
+{
+    assert(ds && ds->magic == FD_TABLE_DSPACE_MAGIC);
+    assert(ds->refCount > 0);
+    if (--ds->refCount > 0) {
+        return;
+    }
+
+    /* Last reference gone; close the dataspace and disconnect from its server. */
+    if (ds->connection.serverSession && ds->dspace) {
+        refos_err_t error = data_close(ds->connection.serverSession, ds->dspace);
+        if (error != ESUCCESS) {
+            printf("filetable_dspace_unref error: couldn't close dspace.\n");
+            return;
+        }
+        csfree_delete(ds->dspace);
+        ds->dspace = 0;
+    }
+    if (ds->connection.serverSession) {
+        serv_disconnect(&ds->connection);
+        ds->connection.serverSession = 0;
+    }
+    ds->magic = 0x0;
+    free(ds);
+}
+
+int
+filetable_socket_alloc(fd_table_t *fdt, refos_socket_t **sock)
+{
+    assert(fdt && fdt->magic == FD_TABLE_MAGIC);
+    assert(sock);
+
+    fd_table_entry_socket_t *e = NULL;
+    uint32_t arg[COAT_ARGS];
+    arg[0] = FD_TABLE_ENTRY_TYPE_SOCKET;
+
+    coat_alloc(&fdt->table, arg, (cvector_item_t *) &e);
+    if (!e) {
+        printf("filetable_socket_alloc out of memory.\n");
+        return -ENOMEM;
+    }
+    assert(e->magic == FD_TABLE_ENTRY_SOCKET_MAGIC);
+    (*sock) = &e->sock;
+    return e->fd;
+}
+
+refos_socket_t *
+filetable_socket_get(fd_table_t *fdt, int fd)
+{
+    assert(fdt && fdt->magic == FD_TABLE_MAGIC);
+    if (fd < FD_TABLE_BASE || fd >= fdt->tableSize) {
+        return NULL;
+    }
+    cvector_item_t entry = coat_get(&fdt->table, fd);
+    if (!entry || *((char*) entry) != FD_TABLE_ENTRY_TYPE_SOCKET) {
+        return NULL;
+    }
+    fd_table_entry_socket_t *fdEntry = (fd_table_entry_socket_t*) entry;
+    assert(fdEntry->magic == FD_TABLE_ENTRY_SOCKET_MAGIC);
+    return &fdEntry->sock;
 }
 
 /* ----------------------- Refos IO default filetable functions --------------------------------- */
@@ -19,6 +19,8 @@
 #include <refos-util/init.h>
 #include <refos-rpc/proc_client.h>
 #include <refos-rpc/proc_client_helper.h>
+#include <refos-rpc/data_client.h>
+#include <refos-rpc/data_client_helper.h>
 
 #define REFOS_IO_INTERNAL_MMAP_PAGE_STATUS_BUFFER_SIZE 0x11000
 static char _refosioMMapPageStatusBuffer[REFOS_IO_INTERNAL_MMAP_PAGE_STATUS_BUFFER_SIZE];
@@ -26,6 +28,17 @@ static char _refosioMMapPageStatusBuffer[REFOS_IO_INTERNAL_MMAP_PAGE_STATUS_BUFF
 #define REFOS_IO_INTERNAL_MMAP_SEGMENT_BUFFER_SIZE 0x1000
 static char _refosioMMapSegmentStatusBuffer[REFOS_IO_INTERNAL_MMAP_SEGMENT_BUFFER_SIZE];
 
+#define REFOS_IO_MMAP_SEGMENT_SIZE (PROCESS_MMAP_SEGMENT_SIZE_NPAGES * REFOS_PAGE_SIZE)
+
+/*! @brief Helper function to find the segment which contains the given page vaddr. Segment n
+           covers vaddrs [TOP - (n + 1) * SEGMENT_SIZE, TOP - n * SEGMENT_SIZE). */
+static inline uint32_t
+refosio_mmap_segment_id(uint32_t vaddr)
+{
+    assert(vaddr >= PROCESS_MMAP_BOT && vaddr < PROCESS_MMAP_TOP);
+    return (PROCESS_MMAP_TOP - 1 - vaddr) / REFOS_IO_MMAP_SEGMENT_SIZE;
+}
+
 void
 refosio_mmap_init(refos_io_mmap_segment_state_t *s)
 {
@@ -33,15 +46,14 @@ refosio_mmap_init(refos_io_mmap_segment_state_t *s)
             _refosioMMapPageStatusBuffer, REFOS_IO_INTERNAL_MMAP_PAGE_STATUS_BUFFER_SIZE);
     cbpool_init_static(&s->mmapRegionSegmentStatus, PROCESS_MMAP_SEGMENTS,
             _refosioMMapSegmentStatusBuffer, REFOS_IO_INTERNAL_MMAP_SEGMENT_BUFFER_SIZE);
+    cvector_init(&s->fileMappings);
 }
 
 int
 refosio_mmap_segment_fill(refos_io_mmap_segment_state_t *s, uint32_t vaddrOffsetPage)
 {
     int error = EINVALID;
-    assert(vaddrOffsetPage >= PROCESS_MMAP_BOT && vaddrOffsetPage < PROCESS_MMAP_TOP);
-    uint32_t segmentID = (PROCESS_MMAP_TOP - vaddrOffsetPage) /
-        (PROCESS_MMAP_SEGMENT_SIZE_NPAGES * REFOS_PAGE_SIZE);
+    uint32_t segmentID = refosio_mmap_segment_id(vaddrOffsetPage);
     assert(segmentID < PROCESS_MMAP_SEGMENTS);
 
     if (cbpool_check_single(&s->mmapRegionSegmentStatus, segmentID)) {
@@ -97,9 +109,7 @@ exit1:
 int
 refosio_mmap_segment_release(refos_io_mmap_segment_state_t *s, uint32_t vaddrOffsetPage)
 {
-    assert(vaddrOffsetPage >= PROCESS_MMAP_BOT && vaddrOffsetPage < PROCESS_MMAP_TOP);
-    uint32_t segmentID = (PROCESS_MMAP_TOP - vaddrOffsetPage) /
-        (PROCESS_MMAP_SEGMENT_SIZE_NPAGES * REFOS_PAGE_SIZE);
+    uint32_t segmentID = refosio_mmap_segment_id(vaddrOffsetPage);
     assert(segmentID < PROCESS_MMAP_SEGMENTS);
 
     if (!cbpool_check_single(&s->mmapRegionSegmentStatus, segmentID)) {
@@ -109,7 +119,7 @@ refosio_mmap_segment_release(refos_io_mmap_segment_state_t *s, uint32_t vaddrOff
 
     /* Check that every page associated has neem release. Otherwise we don't unmap yet. */
     for (int i = 0; i < PROCESS_MMAP_SEGMENT_SIZE_NPAGES; i++) {
-        uint32_t page = ( (PROCESS_MMAP_TOP - vaddrOffsetPage) / REFOS_PAGE_SIZE ) + i;
+        uint32_t page = (segmentID * PROCESS_MMAP_SEGMENT_SIZE_NPAGES) + i;
         if (cbpool_check_single(&s->mmapRegionPageStatus, page)) {
             /* A page is still mapped here. */
             return EUNMAPFIRST;
@@ -117,7 +127,8 @@ refosio_mmap_segment_release(refos_io_mmap_segment_state_t *s, uint32_t vaddrOff
     }
 
     /* Get the window. */
-    seL4_CPtr window = proc_get_mem_window(vaddrOffsetPage);
+    uint32_t vaddr = PROCESS_MMAP_TOP - ((segmentID + 1) * REFOS_IO_MMAP_SEGMENT_SIZE);
+    seL4_CPtr window = proc_get_mem_window(vaddr);
     if (!window) {
         /* Nothing mapped here. Nothing to do. */
         seL4_DebugPrintf("mmap_segment_release: No window to release. Doing nothing.\n");
@@ -207,8 +218,14 @@ refosio_munmap_anon(refos_io_mmap_segment_state_t *s, uint32_t vaddr, int npages
         return EINVALIDPARAM;
     }
 
-    /* Free every page in the range. */
+    /* Free every page in the range. Pages are allocated downwards from the top of the mmap
+       region, so the page at the given (lowest) vaddr has the highest page offset. */
     uint32_t vaddrOffsetPage = (PROCESS_MMAP_TOP - vaddr) / REFOS_PAGE_SIZE;
+    if (vaddrOffsetPage < npages) {
+        seL4_DebugPrintf("unmap_anon: invalid size, too large.");
+        return EINVALIDPARAM;
+    }
+    vaddrOffsetPage -= npages;
     assert(vaddrOffsetPage < PROCESS_MMAP_LIMIT_SIZE_NPAGES);
     cbpool_free(&s->mmapRegionPageStatus, vaddrOffsetPage, npages);
 
@@ -223,4 +240,124 @@ refosio_munmap_anon(refos_io_mmap_segment_state_t *s, uint32_t vaddr, int npages
     }
 
     return ESUCCESS;
-}
\ No newline at end of file
+}
+
+/* ------------------------------- File-backed mmap functions ----------------------------------- */
+
+int
+refosio_mmap_file(refos_io_mmap_segment_state_t *s, int npages, fd_table_dspace_t *ds,
+                  uint32_t offset, uint32_t *vaddrDest)
+{
+    assert(s);
+    if (npages <= 0 || !ds || !ds->connection.serverSession || !ds->dspace) {
+        return EINVALIDPARAM;
+    }
+
+    refos_io_mmap_file_t *m = malloc(sizeof(refos_io_mmap_file_t));
+    if (!m) {
+        seL4_DebugPrintf("mmap_file: Could not allocate mapping structure.\n");
+        return ENOMEM;
+    }
+
+    /* Allocate a run of whole segments, so the file window never overlaps an anon segment. */
+    m->nsegments = (npages + PROCESS_MMAP_SEGMENT_SIZE_NPAGES - 1) /
+            PROCESS_MMAP_SEGMENT_SIZE_NPAGES;
+    m->segmentID = cbpool_alloc(&s->mmapRegionSegmentStatus, m->nsegments);
+    if (m->segmentID == CBPOOL_INVALID) {
+        seL4_DebugPrintf("mmap_file: Could not allocate segments. Out of virtual memory.\n");
+        free(m);
+        return ENOMEM;
+    }
+    m->vaddr = PROCESS_MMAP_TOP - ((m->segmentID + m->nsegments) * REFOS_IO_MMAP_SEGMENT_SIZE);
+    m->ds = ds;
+
+    /* Set every page bit in the segment run, so the anon page allocator never hands these out.
+       A segment with its bit cleared never has any allocated pages. */
+    uint32_t pageStart = m->segmentID * PROCESS_MMAP_SEGMENT_SIZE_NPAGES;
+    for (int i = 0; i < m->nsegments * PROCESS_MMAP_SEGMENT_SIZE_NPAGES; i++) {
+        assert(!cbpool_check_single(&s->mmapRegionPageStatus, pageStart + i));
+        cbpool_set_single(&s->mmapRegionPageStatus, pageStart + i, true);
+    }
+
+    /* Create a read-only window covering the mapping. */
+    int error = EINVALID;
+    m->window = proc_create_mem_window_ext(m->vaddr, npages * REFOS_PAGE_SIZE,
+            PROC_WINDOW_PERMISSION_READ, 0x0);
+    if (!m->window || REFOS_GET_ERRNO() != ESUCCESS) {
+        seL4_DebugPrintf("mmap_file: Could not create window.\n");
+        error = EINVALIDWINDOW;
+        goto exit1;
+    }
+
+    /* Map the file dataspace straight into the window. The dataserver becomes its pager. */
+    error = data_datamap(ds->connection.serverSession, ds->dspace, m->window, offset);
+    if (error != ESUCCESS) {
+        seL4_DebugPrintf("mmap_file: Could not datamap file dspace.\n");
+        goto exit2;
+    }
+
+    cvector_add(&s->fileMappings, (cvector_item_t) m);
+    if (vaddrDest) {
+        (*vaddrDest) = m->vaddr;
+    }
+    return ESUCCESS;
+
+    /* Exit stack. */
+exit2:
+    proc_delete_mem_window(m->window);
+    csfree_delete(m->window);
+exit1:
+    cbpool_free(&s->mmapRegionPageStatus, pageStart,
+            m->nsegments * PROCESS_MMAP_SEGMENT_SIZE_NPAGES);
+    cbpool_free(&s->mmapRegionSegmentStatus, m->segmentID, m->nsegments);
+    free(m);
+    return error;
+}
+
+int
+refosio_munmap_file(refos_io_mmap_segment_state_t *s, uint32_t vaddr)
+{
+    assert(s);
+    if (vaddr < PROCESS_MMAP_BOT || vaddr >= PROCESS_MMAP_TOP) {
+        return EFILENOTFOUND;
+    }
+
+    /* Find the file mapping containing this vaddr. */
+    int c = cvector_count(&s->fileMappings);
+    refos_io_mmap_file_t *m = NULL;
+    int i;
+    for (i = 0; i < c; i++) {
+        refos_io_mmap_file_t *mi = (refos_io_mmap_file_t *) cvector_get(&s->fileMappings, i);
+        assert(mi);
+        if (vaddr >= mi->vaddr &&
+                vaddr < mi->vaddr + (mi->nsegments * REFOS_IO_MMAP_SEGMENT_SIZE)) {
+            m = mi;
+            break;
+        }
+    }
+    if (!m) {
+        return EFILENOTFOUND;
+    }
+    cvector_delete(&s->fileMappings, i);
+
+    /* Unmap the dataspace, which also releases the dataserver's pager frames, then delete the
+       window itself. */
+    int error = data_dataunmap(m->ds->connection.serverSession, m->window);
+    if (error != ESUCCESS) {
+        seL4_DebugPrintf("munmap_file: Failed to dataunmap window.\n");
+    }
+    error = proc_delete_mem_window(m->window);
+    if (error != ESUCCESS) {
+        seL4_DebugPrintf("munmap_file: Failed to delete window.\n");
+    }
+    csfree_delete(m->window);
+
+    /* Return the segment run to the allocator. */
+    cbpool_free(&s->mmapRegionPageStatus, m->segmentID * PROCESS_MMAP_SEGMENT_SIZE_NPAGES,
+            m->nsegments * PROCESS_MMAP_SEGMENT_SIZE_NPAGES);
+    cbpool_free(&s->mmapRegionSegmentStatus, m->segmentID, m->nsegments);
+
+    filetable_dspace_unref(m->ds);
+    free(m);
+    return ESUCCESS;
+}
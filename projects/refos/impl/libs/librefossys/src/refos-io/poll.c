@@ -0,0 +1,259 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <utils/arith.h>
+#include <refos/refos.h>
+#include <refos/error.h>
+#include <refos-io/poll.h>
+#include <refos-io/internal_state.h>
+#include <refos-io/filetable.h>
+#include <refos-io/socket.h>
+#include <refos-rpc/data_client.h>
+#include <refos-rpc/proc_client.h>
+#include <refos-rpc/proc_client_helper.h>
+#include <refos-util/cspace.h>
+
+/* Included last, as its error macros would clash with the refos_error enum. */
+#include <errno.h>
+
+/*! @file
+    @brief Waiting on several file descriptors at once. */
+
+/*! @brief Sockets have no readiness notification yet, so while waiting on one that isn't ready
+           the wait is cut into ticks of this many microseconds, and the rings checked each tick. */
+#define REFOS_POLL_SOCKET_TICK_US 10000
+
+/* ----------------------------------------- Helpers -------------------------------------------- */
+
+/*! @brief Get the badged notification cap for a badge bit, allocating it on first use. */
+static seL4_CPtr
+refos_poll_source_ep(refos_io_poll_state_t *ps, int bit)
+{
+    assert(bit >= 0 && bit < REFOS_POLL_NUM_BITS);
+    if (ps->sourceEP[bit]) {
+        return ps->sourceEP[bit];
+    }
+    if (!ps->notify) {
+        ps->notify = proc_new_async_endpoint();
+        if (!ps->notify) {
+            return 0;
+        }
+    }
+    seL4_CPtr ep = csalloc();
+    if (!ep) {
+        return 0;
+    }
+    int error = seL4_CNode_Mint (
+        REFOS_CSPACE, ep, REFOS_CDEPTH,
+        REFOS_CSPACE, ps->notify, REFOS_CDEPTH,
+        seL4_AllRights, seL4_CapData_Badge_new(1 << bit)
+    );
+    if (error != seL4_NoError) {
+        csfree(ep);
+        return 0;
+    }
+    ps->sourceEP[bit] = ep;
+    return ep;
+}
+
+/*! @brief Descriptors whose bit is set in a received badge are no longer armed. */
+static void
+refos_poll_fired(refos_io_poll_state_t *ps, seL4_Word badge)
+{
+    for (int i = 0; i < REFOS_POLL_FD_BITS; i++) {
+        if (badge & (1 << i)) {
+            ps->armedFd[i] = 0;
+        }
+    }
+}
+
+/*! @brief Find the dataspace behind a descriptor. Returns false if there isn't one. */
+static bool
+refos_poll_dspace(int fd, seL4_CPtr *session, seL4_CPtr *dspace)
+{
+    if (fd == STDIN_FILENO) {
+        (*session) = refosIOState.stdioSession.serverSession;
+        (*dspace) = refosIOState.stdioDataspace;
+    } else {
+        (*session) = filetable_dspace_get_session(&refosIOState.fdTable, fd);
+        (*dspace) = (*session) ? filetable_dspace_get(&refosIOState.fdTable, fd) : 0;
+    }
+    return (*session) && (*dspace);
+}
+
+/*! @brief Check whether a source is ready, arming its notification if it is not.
+    @param ps The poll state.
+    @param s The source to check.
+    @param tick Set if the source is not ready and can't be armed, so has to be checked again.
+    @return The ready events, negative errno value on failure.
+*/
+static int
+refos_poll_check(refos_io_poll_state_t *ps, refos_poll_source_t *s, bool *tick)
+{
+    if (s->fd < 0) {
+        return 0;
+    }
+    if (s->fd == STDOUT_FILENO || s->fd == STDERR_FILENO) {
+        /* Console output never blocks. */
+        return s->events & REFOS_POLL_WRITE;
+    }
+
+    refos_socket_t *sock = filetable_socket_get(&refosIOState.fdTable, s->fd);
+    if (sock) {
+        int ready = refos_socket_ready(sock) & s->events;
+        if (!ready) {
+            (*tick) = true;
+        }
+        return ready;
+    }
+
+    seL4_CPtr session, dspace;
+    if (!refos_poll_dspace(s->fd, &session, &dspace)) {
+        return REFOS_POLL_NVAL;
+    }
+
+    int bit = s->fd % REFOS_POLL_FD_BITS;
+    if (ps->armedFd[bit] == s->fd + 1 && (s->events & ~ps->armedEvents[bit]) == 0) {
+        /* Still armed from an earlier call, and it hasn't fired. */
+        return 0;
+    }
+    seL4_CPtr ep = refos_poll_source_ep(ps, bit);
+    if (!ep) {
+        return -ENOMEM;
+    }
+    int ready = data_poll(session, dspace, ep, s->events, 0);
+    if (ready < 0) {
+        return REFOS_POLL_NVAL;
+    }
+    if (!ready) {
+        ps->armedFd[bit] = s->fd + 1;
+        ps->armedEvents[bit] = s->events;
+    }
+    return ready & s->events;
+}
+
+/*! @brief Arm a timer alarm on a fresh generation's badge bit.
+    @param ps The poll state.
+    @param us The alarm timeout in microseconds.
+    @return 0 on success, negative errno value otherwise.
+*/
+static int
+refos_poll_arm_timer(refos_io_poll_state_t *ps, uint32_t us)
+{
+    if (!refosIOState.timerFD) {
+        return -ENOSYS;
+    }
+    int fd = fileno(refosIOState.timerFD);
+    seL4_CPtr session, dspace;
+    if (!refos_poll_dspace(fd, &session, &dspace)) {
+        return -ENOSYS;
+    }
+
+    ps->timerGeneration = !ps->timerGeneration;
+    seL4_CPtr ep = refos_poll_source_ep(ps, REFOS_POLL_TIMER_BIT(ps->timerGeneration));
+    if (!ep) {
+        return -ENOMEM;
+    }
+    int ready = data_poll(session, dspace, ep, REFOS_POLL_READ, us);
+    if (ready < 0) {
+        return -EIO;
+    }
+    if (ready) {
+        /* Already expired; take the same path as if the alarm had fired. */
+        seL4_Signal(ep);
+    }
+    return 0;
+}
+
+/* ------------------------------------- Poll functions ----------------------------------------- */
+
+int
+refos_poll(refos_poll_source_t *src, int n, int64_t timeoutUS)
+{
+    assert(src || n == 0);
+    refos_io_poll_state_t *ps = &refosIOState.pollState;
+    seL4_Word badge = 0;
+
+    if (ps->notify) {
+        /* Pick up whatever fired since the last call. Stale timer bits are dropped here. */
+        seL4_Poll(ps->notify, &badge);
+        refos_poll_fired(ps, badge);
+    }
+
+    int64_t remaining = timeoutUS;
+    int64_t chunk = 0;
+    bool timerArmed = false;
+    while (true) {
+        int count = 0;
+        bool tick = false;
+        for (int i = 0; i < n; i++) {
+            int ready = refos_poll_check(ps, &src[i], &tick);
+            if (ready < 0) {
+                return ready;
+            }
+            src[i].revents = ready;
+            if (ready) {
+                count++;
+            }
+        }
+        if (count > 0 || remaining == 0) {
+            return count;
+        }
+
+        if (!timerArmed && (remaining > 0 || tick)) {
+            chunk = (remaining > 0) ? remaining : REFOS_POLL_SOCKET_TICK_US;
+            if (tick) {
+                chunk = MIN(chunk, REFOS_POLL_SOCKET_TICK_US);
+            }
+            chunk = MIN(chunk, (int64_t) UINT32_MAX);
+            int error = refos_poll_arm_timer(ps, (uint32_t) chunk);
+            if (error) {
+                return error;
+            }
+            timerArmed = true;
+        }
+
+        if (!ps->notify && !refos_poll_source_ep(ps, 0)) {
+            /* Waiting forever on nothing; still needs something to block on. */
+            return -ENOMEM;
+        }
+        seL4_Wait(ps->notify, &badge);
+        refos_poll_fired(ps, badge);
+
+        /* Only the alarm armed by this call counts; earlier ones have the other generation bit,
+           or weren't armed here at all. */
+        if (timerArmed && (badge & (1 << REFOS_POLL_TIMER_BIT(ps->timerGeneration)))) {
+            timerArmed = false;
+            if (remaining > 0) {
+                remaining -= chunk;
+            }
+        }
+    }
+}
+
+void
+refos_poll_forget(int fd)
+{
+    if (fd < 0) {
+        return;
+    }
+    refos_io_poll_state_t *ps = &refosIOState.pollState;
+    int bit = fd % REFOS_POLL_FD_BITS;
+    if (ps->armedFd[bit] == fd + 1) {
+        /* If this descriptor number is reused, the new dataspace has to be armed afresh. Anything
+           still armed on the old one can at worst cause a spurious wakeup. */
+        ps->armedFd[bit] = 0;
+    }
+}
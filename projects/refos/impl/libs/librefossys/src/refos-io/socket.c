@@ -0,0 +1,436 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utils/arith.h>
+#include <refos/refos.h>
+#include <refos/error.h>
+#include <refos/share.h>
+#include <refos-io/socket.h>
+#include <refos-io/internal_state.h>
+#include <refos-rpc/net_client.h>
+#include <refos-rpc/serv_client_helper.h>
+
+/* Included last, as its error macros would clash with the refos_error enum. */
+#include <errno.h>
+
+/*! @file
+    @brief Client side of network server sockets. */
+
+#define REFOS_SOCKET_DGRAM_RECORD_MAX (sizeof(struct net_dgram_header) + NETSERV_DGRAM_MAX)
+
+/*! @brief Staging buffer for datagram records, which have to go into the tx ring in one write. */
+static char refosSocketScratch[REFOS_SOCKET_DGRAM_RECORD_MAX];
+
+/* ----------------------------------------- Helpers -------------------------------------------- */
+
+/*! @brief Get the session to the network server, connecting on first use. Returns 0 if there is no
+           network server. */
+static seL4_CPtr
+refos_socket_session(void)
+{
+    if (refosIOState.netSession.serverSession) {
+        return refosIOState.netSession.serverSession;
+    }
+    refosIOState.netSession = serv_connect_no_pbuffer(REFOS_SOCKET_SERVER_PATH);
+    if (refosIOState.netSession.error != ESUCCESS || !refosIOState.netSession.serverSession) {
+        memset(&refosIOState.netSession, 0, sizeof(serv_connection_t));
+        return 0;
+    }
+    return refosIOState.netSession.serverSession;
+}
+
+/*! @brief Allocate and map the shared buffer of a new socket. */
+static int
+refos_socket_buffer_init(refos_socket_t *s, int type)
+{
+    memset(s, 0, sizeof(refos_socket_t));
+    s->buffer = data_open_map(REFOS_PROCSERV_EP, "anon", 0, 0, NETSERV_SOCKET_BUFFER_SIZE, -1);
+    if (s->buffer.err != ESUCCESS) {
+        return -ENOMEM;
+    }
+    s->magic = REFOS_SOCKET_MAGIC;
+    s->id = -1;
+    s->type = type;
+    s->ctrl = (struct net_socket_control *) s->buffer.vaddr;
+    s->rx = NETSERV_SOCKET_RX_RING(s->buffer.vaddr);
+    s->tx = NETSERV_SOCKET_TX_RING(s->buffer.vaddr);
+    return 0;
+}
+
+static void
+refos_socket_buffer_release(refos_socket_t *s)
+{
+    data_mapping_release(s->buffer);
+    memset(s, 0, sizeof(refos_socket_t));
+}
+
+static int
+refos_socket_wait(refos_socket_t *s, int events)
+{
+    return net_wait(refos_socket_session(), s->id, events);
+}
+
+/*! @brief Called after reading from the rx ring. If the server was held back by a full rx ring,
+           let it know there is room now. */
+static void
+refos_socket_rx_drained(refos_socket_t *s)
+{
+    __sync_synchronize();
+    if (s->ctrl->rxBlocked) {
+        s->ctrl->rxBlocked = 0;
+        net_notify(refos_socket_session(), s->id);
+    }
+}
+
+static inline size_t
+refos_socket_rx_pending(refos_socket_t *s)
+{
+    return refos_share_read_available(s->rx, NETSERV_RING_SIZE);
+}
+
+static inline void
+refos_socket_rx_read(refos_socket_t *s, char *dest, size_t len)
+{
+    unsigned int nr = 0;
+    int error = refos_share_read(dest, len, s->rx, NETSERV_RING_SIZE, &s->rxStart, &nr);
+    assert(!error && nr == len);
+    (void) error;
+}
+
+/* ------------------------------------ Socket functions ---------------------------------------- */
+
+int
+refos_socket_create(refos_socket_t *s, int type)
+{
+    assert(s);
+    seL4_CPtr session = refos_socket_session();
+    if (!session) {
+        return -EAFNOSUPPORT;
+    }
+
+    int error = refos_socket_buffer_init(s, type);
+    if (error) {
+        return error;
+    }
+    int id = net_socket(session, type, s->buffer.dataspace, NETSERV_SOCKET_BUFFER_SIZE);
+    if (id < 0) {
+        refos_socket_buffer_release(s);
+        return id;
+    }
+    s->id = id;
+    return 0;
+}
+
+int
+refos_socket_bind(refos_socket_t *s, uint32_t addr, uint32_t port)
+{
+    assert(s && s->magic == REFOS_SOCKET_MAGIC);
+    return net_bind(refos_socket_session(), s->id, addr, port);
+}
+
+int
+refos_socket_listen(refos_socket_t *s, int backlog)
+{
+    assert(s && s->magic == REFOS_SOCKET_MAGIC);
+    return net_listen(refos_socket_session(), s->id, backlog);
+}
+
+int
+refos_socket_accept(refos_socket_t *s, refos_socket_t *newSock, uint32_t *addr,
+                    uint32_t *port, bool nonBlock)
+{
+    assert(s && s->magic == REFOS_SOCKET_MAGIC);
+    assert(newSock);
+
+    /* Set up the new socket's buffer once, and keep offering it until a connection turns up. */
+    int error = refos_socket_buffer_init(newSock, s->type);
+    if (error) {
+        return error;
+    }
+
+    uint32_t peerAddr = 0, peerPort = 0;
+    int id;
+    while (true) {
+        id = net_accept(refos_socket_session(), s->id, newSock->buffer.dataspace,
+                        NETSERV_SOCKET_BUFFER_SIZE, &peerAddr, &peerPort);
+        if (id != -EAGAIN || nonBlock) {
+            break;
+        }
+        int events = refos_socket_wait(s, NETSERV_EVENT_READ);
+        if (events < 0) {
+            id = events;
+            break;
+        }
+    }
+    if (id < 0) {
+        refos_socket_buffer_release(newSock);
+        return id;
+    }
+
+    newSock->id = id;
+    newSock->connected = true;
+    if (addr) {
+        (*addr) = peerAddr;
+    }
+    if (port) {
+        (*port) = peerPort;
+    }
+    return 0;
+}
+
+int
+refos_socket_connect(refos_socket_t *s, uint32_t addr, uint32_t port)
+{
+    assert(s && s->magic == REFOS_SOCKET_MAGIC);
+    int error = net_connect(refos_socket_session(), s->id, addr, port);
+    if (error) {
+        return error;
+    }
+    s->connected = true;
+    return 0;
+}
+
+int
+refos_socket_getname(refos_socket_t *s, bool peer, uint32_t *addr, uint32_t *port)
+{
+    assert(s && s->magic == REFOS_SOCKET_MAGIC);
+    assert(addr && port);
+    return net_getname(refos_socket_session(), s->id, peer ? 1 : 0, addr, port);
+}
+
+static int
+refos_socket_send_stream(refos_socket_t *s, const char *buf, size_t len, bool nonBlock)
+{
+    if (!s->connected) {
+        return -ENOTCONN;
+    }
+    if (s->txShutdown) {
+        return -EPIPE;
+    }
+
+    size_t sent = 0;
+    while (sent < len) {
+        if (s->ctrl->peerClosed) {
+            return sent > 0 ? sent : -EPIPE;
+        }
+        size_t space = refos_share_write_available(s->tx, NETSERV_RING_SIZE);
+        if (space == 0) {
+            if (nonBlock) {
+                return sent > 0 ? sent : -EAGAIN;
+            }
+            int events = refos_socket_wait(s, NETSERV_EVENT_WRITE);
+            if (events < 0) {
+                return sent > 0 ? sent : events;
+            }
+            continue;
+        }
+
+        size_t n = MIN(space, len - sent);
+        int error = refos_share_write((char*) buf + sent, n, s->tx, NETSERV_RING_SIZE, &s->txEnd);
+        assert(!error);
+        (void) error;
+        sent += n;
+
+        /* Ring the doorbell. The server moves what it can before replying, so by the time this
+           returns the ring has usually been emptied again. */
+        net_notify(refos_socket_session(), s->id);
+    }
+    return sent;
+}
+
+static int
+refos_socket_send_dgram(refos_socket_t *s, const char *buf, size_t len, uint32_t addr,
+                        uint32_t port, bool nonBlock)
+{
+    if (len > NETSERV_DGRAM_MAX) {
+        return -EMSGSIZE;
+    }
+    if (!addr && !s->connected) {
+        return -EDESTADDRREQ;
+    }
+
+    struct net_dgram_header hdr = {
+        .len = len,
+        .addr = addr,
+        .port = port
+    };
+    size_t recordLen = sizeof(hdr) + len;
+    while (refos_share_write_available(s->tx, NETSERV_RING_SIZE) < recordLen) {
+        if (nonBlock) {
+            return -EAGAIN;
+        }
+        int events = refos_socket_wait(s, NETSERV_EVENT_WRITE);
+        if (events < 0) {
+            return events;
+        }
+    }
+
+    /* The server treats a header without its payload as a broken ring, so both have to appear
+       in one write. */
+    memcpy(refosSocketScratch, &hdr, sizeof(hdr));
+    if (len > 0) {
+        memcpy(refosSocketScratch + sizeof(hdr), buf, len);
+    }
+    int error = refos_share_write(refosSocketScratch, recordLen, s->tx, NETSERV_RING_SIZE,
+                                  &s->txEnd);
+    assert(!error);
+    (void) error;
+
+    net_notify(refos_socket_session(), s->id);
+    return len;
+}
+
+int
+refos_socket_send(refos_socket_t *s, const char *buf, size_t len, uint32_t addr,
+                  uint32_t port, bool nonBlock)
+{
+    assert(s && s->magic == REFOS_SOCKET_MAGIC);
+    if (!buf && len > 0) {
+        return -EFAULT;
+    }
+    if (s->type == NETSERV_SOCK_STREAM) {
+        return refos_socket_send_stream(s, buf, len, nonBlock);
+    }
+    return refos_socket_send_dgram(s, buf, len, addr, port, nonBlock);
+}
+
+static int
+refos_socket_recv_stream(refos_socket_t *s, char *buf, size_t len, bool nonBlock)
+{
+    if (!s->connected) {
+        return -ENOTCONN;
+    }
+
+    while (true) {
+        size_t pending = refos_socket_rx_pending(s);
+        if (pending > 0) {
+            size_t n = MIN(pending, len);
+            refos_socket_rx_read(s, buf, n);
+            refos_socket_rx_drained(s);
+            return n;
+        }
+        if (s->ctrl->hangup) {
+            /* The server writes the last of the data before it sets hangup, so look again. */
+            __sync_synchronize();
+            if (refos_socket_rx_pending(s) > 0) {
+                continue;
+            }
+            return 0;
+        }
+        if (nonBlock) {
+            return -EAGAIN;
+        }
+        int events = refos_socket_wait(s, NETSERV_EVENT_READ);
+        if (events < 0) {
+            return events;
+        }
+    }
+}
+
+static int
+refos_socket_recv_dgram(refos_socket_t *s, char *buf, size_t len, uint32_t *addr,
+                        uint32_t *port, bool nonBlock)
+{
+    struct net_dgram_header hdr;
+
+    while (refos_socket_rx_pending(s) < sizeof(hdr)) {
+        if (nonBlock) {
+            return -EAGAIN;
+        }
+        int events = refos_socket_wait(s, NETSERV_EVENT_READ);
+        if (events < 0) {
+            return events;
+        }
+    }
+
+    /* The server writes whole records, so the payload is all there too. */
+    refos_socket_rx_read(s, (char*) &hdr, sizeof(hdr));
+    assert(hdr.len <= NETSERV_DGRAM_MAX);
+    size_t n = MIN(hdr.len, len);
+    if (n > 0) {
+        refos_socket_rx_read(s, buf, n);
+    }
+    if (hdr.len > n) {
+        /* Truncated, throw away the rest. */
+        refos_socket_rx_read(s, refosSocketScratch, hdr.len - n);
+    }
+    refos_socket_rx_drained(s);
+
+    if (addr) {
+        (*addr) = hdr.addr;
+    }
+    if (port) {
+        (*port) = hdr.port;
+    }
+    return n;
+}
+
+int
+refos_socket_recv(refos_socket_t *s, char *buf, size_t len, uint32_t *addr, uint32_t *port,
+                  bool nonBlock)
+{
+    assert(s && s->magic == REFOS_SOCKET_MAGIC);
+    if (!buf && len > 0) {
+        return -EFAULT;
+    }
+    if (s->type == NETSERV_SOCK_STREAM) {
+        return refos_socket_recv_stream(s, buf, len, nonBlock);
+    }
+    return refos_socket_recv_dgram(s, buf, len, addr, port, nonBlock);
+}
+
+int
+refos_socket_shutdown(refos_socket_t *s)
+{
+    assert(s && s->magic == REFOS_SOCKET_MAGIC);
+    int error = net_shutdown(refos_socket_session(), s->id);
+    if (error) {
+        return error;
+    }
+    s->txShutdown = true;
+    return 0;
+}
+
+int
+refos_socket_ready(refos_socket_t *s)
+{
+    assert(s && s->magic == REFOS_SOCKET_MAGIC);
+    if (s->type == NETSERV_SOCK_STREAM && !s->connected) {
+        /* Pending connections aren't visible in the rings. */
+        return 0;
+    }
+    __sync_synchronize();
+    int ready = 0;
+    if (refos_socket_rx_pending(s) > 0 || s->ctrl->hangup) {
+        ready |= REFOS_POLL_READ;
+    }
+    if (refos_share_write_available(s->tx, NETSERV_RING_SIZE) > 0 || s->ctrl->peerClosed) {
+        ready |= REFOS_POLL_WRITE;
+    }
+    return ready;
+}
+
+void
+refos_socket_close(refos_socket_t *s)
+{
+    assert(s && s->magic == REFOS_SOCKET_MAGIC);
+
+    /* The server has to unmap the buffer before we let go of it. */
+    int error = net_close(refos_socket_session(), s->id);
+    if (error) {
+        seL4_DebugPrintf("refos_socket_close: net_close failed (%d).\n", error);
+    }
+    refos_socket_buffer_release(s);
+}
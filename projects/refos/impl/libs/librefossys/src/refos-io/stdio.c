@@ -14,12 +14,19 @@
 #include <refos-io/internal_state.h>
 #include <refos-io/ipc_state.h>
 #include <autoconf.h>
+#include <utils/arith.h>
+#include <refos/refos.h>
+#include <refos/error.h>
+#include <refos-rpc/data_client.h>
+#include <refos-util/init.h>
 
 #define DPRINTF_SERVER_NAME ""
 #include <refos-util/dprintf.h>
 
 refos_io_internal_state_t refosIOState;
 bool refos_stdio_translate_stdin_cr;
+__thread seL4_IPCBuffer _refosioIPCBufferBackup[IPC_SAVESTACK_MAXLEVELS];
+__thread uint32_t _refosioIPCBufferBackupStack;
 
 static size_t
 refos_seL4_debug_override_writev(void *data, size_t count)
@@ -103,4 +110,46 @@ refos_getc(void)
         c = '\n';
     }
     return c;
-}
\ No newline at end of file
+}
+
+int
+refos_read(char *buf, size_t count)
+{
+    if (!refosIOState.stdioDataspace || !refosIOState.stdioSession.serverSession) {
+        seL4_DebugPrintf("refos_read used without setting up stdin.\n");
+        return -EINVALID;
+    }
+    int n = data_read(refosIOState.stdioSession.serverSession, refosIOState.stdioDataspace, 0,
+                      buf, MIN(count, REFOS_DEFAULT_DSPACE_IPC_MAXLEN));
+    if (n <= 0) {
+        return n;
+    }
+    if (refos_stdio_translate_stdin_cr) {
+        for (int i = 0; i < n; i++) {
+            if (buf[i] == '\r') {
+                buf[i] = '\n';
+            }
+        }
+    }
+    return n;
+}
+
+int
+refos_stdio_get_lflag(void)
+{
+    if (!refosIOState.stdioDataspace || !refosIOState.stdioSession.serverSession) {
+        return -EINVALID;
+    }
+    return data_ioctl(refosIOState.stdioSession.serverSession, refosIOState.stdioDataspace,
+                      REFOS_IOCTL_GET_LFLAG, 0);
+}
+
+int
+refos_stdio_set_lflag(uint32_t lflag)
+{
+    if (!refosIOState.stdioDataspace || !refosIOState.stdioSession.serverSession) {
+        return -EINVALID;
+    }
+    return data_ioctl(refosIOState.stdioSession.serverSession, refosIOState.stdioDataspace,
+                      REFOS_IOCTL_SET_LFLAG, lflag);
+}
@@ -17,14 +17,7 @@
 #include <refos-rpc/proc_client.h>
 #include <refos-rpc/proc_client_helper.h>
 
-long
-sys_exit(va_list ap)
-{
-    int status = va_arg(ap, int);
-    proc_exit(status);
-    while (1); /* We don't return after this */
-    return 0;
-}
+/* sys_exit lives in sys_thread.c, as it only ends the calling thread. */
 
 long
 sys_exit_group(va_list ap)
@@ -0,0 +1,232 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+#include <refos-io/thread.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <sel4/sel4.h>
+
+/*! @file
+    @brief Futexes, built on per-thread seL4 notifications.
+
+    Waiters queue themselves on a hash bucket for the futex word, using a node on their own stack,
+    then block on their thread's notification until a waker unlinks them and sets their woken flag.
+    A single spinlock protects every bucket; the critical sections are a handful of list
+    operations long. Futexes are always process private here, so the private flag is ignored.
+
+    Timed waits poll with seL4_Yield until the deadline, as there's no way to block on a
+    notification with a timeout. So do waits on a thread's TID word, which the process server
+    clears when the thread exits, without going through the futex table.
+*/
+
+#define REFOSIO_FUTEX_WAIT 0
+#define REFOSIO_FUTEX_WAKE 1
+#define REFOSIO_FUTEX_REQUEUE 3
+#define REFOSIO_FUTEX_PRIVATE_FLAG 128
+#define REFOSIO_FUTEX_CLOCK_REALTIME 256
+
+#define REFOSIO_FUTEX_HASH_SIZE 32
+#define REFOSIO_FUTEX_HASH(x) ((((uintptr_t) (x)) >> 2) % REFOSIO_FUTEX_HASH_SIZE)
+
+/*! @brief A thread waiting on a futex. Lives on the waiting thread's stack. */
+struct refosio_futex_waiter {
+    volatile int *uaddr;
+    seL4_CPtr notify;
+    volatile bool woken;
+    struct refosio_futex_waiter *next;
+};
+
+static struct refosio_futex_waiter *refosioFutexBucket[REFOSIO_FUTEX_HASH_SIZE];
+static volatile int refosioFutexLock;
+
+static void
+refosio_futex_lock(void)
+{
+    while (__sync_lock_test_and_set(&refosioFutexLock, 1)) {
+        seL4_Yield();
+    }
+}
+
+static void
+refosio_futex_unlock(void)
+{
+    __sync_lock_release(&refosioFutexLock);
+}
+
+static void
+refosio_futex_enqueue(struct refosio_futex_waiter *w)
+{
+    struct refosio_futex_waiter **p = &refosioFutexBucket[REFOSIO_FUTEX_HASH(w->uaddr)];
+    while (*p) {
+        p = &(*p)->next;
+    }
+    w->next = NULL;
+    *p = w;
+}
+
+/*! @return true if the waiter was queued, false if it has already been dequeued. */
+static bool
+refosio_futex_dequeue(struct refosio_futex_waiter *w)
+{
+    struct refosio_futex_waiter **p = &refosioFutexBucket[REFOSIO_FUTEX_HASH(w->uaddr)];
+    for (; *p; p = &(*p)->next) {
+        if (*p == w) {
+            *p = w->next;
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint64_t
+refosio_futex_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static long
+refosio_futex_wait(volatile int *uaddr, int val, const struct timespec *timeout)
+{
+    struct refosio_futex_waiter w;
+    w.uaddr = uaddr;
+    w.notify = refosio_thread_notify();
+    w.woken = false;
+
+    refosio_futex_lock();
+    if (*uaddr != val) {
+        refosio_futex_unlock();
+        return -EAGAIN;
+    }
+    refosio_futex_enqueue(&w);
+    refosio_futex_unlock();
+
+    if (!timeout && w.notify && !refosio_thread_is_clear_tid(uaddr)) {
+        while (!w.woken) {
+            seL4_Wait(w.notify, NULL);
+        }
+        return 0;
+    }
+
+    /* Timed wait, or a thread without a notification. */
+    uint64_t deadline = timeout ? refosio_futex_time_ns() +
+            (uint64_t) timeout->tv_sec * 1000000000ULL + timeout->tv_nsec : 0;
+    while (!w.woken) {
+        if (timeout && refosio_futex_time_ns() >= deadline) {
+            refosio_futex_lock();
+            bool queued = !w.woken && refosio_futex_dequeue(&w);
+            refosio_futex_unlock();
+            if (queued) {
+                return -ETIMEDOUT;
+            }
+            break;
+        }
+        seL4_Yield();
+    }
+    return 0;
+}
+
+/*! @brief Wake up to count waiters on uaddr. Must hold the futex lock. */
+static int
+refosio_futex_wake_locked(volatile int *uaddr, int count)
+{
+    int nwoken = 0;
+    struct refosio_futex_waiter **p = &refosioFutexBucket[REFOSIO_FUTEX_HASH(uaddr)];
+    while (*p && nwoken < count) {
+        struct refosio_futex_waiter *w = *p;
+        if (w->uaddr != uaddr) {
+            p = &w->next;
+            continue;
+        }
+        *p = w->next;
+
+        /* The waiter may return and reuse its stack as soon as it sees woken, so read everything
+           we need out of the node first. */
+        seL4_CPtr notify = w->notify;
+        __sync_synchronize();
+        w->woken = true;
+        if (notify) {
+            seL4_Signal(notify);
+        }
+        nwoken++;
+    }
+    return nwoken;
+}
+
+int
+refosio_futex_wake(volatile int *uaddr, int count)
+{
+    refosio_futex_lock();
+    int nwoken = refosio_futex_wake_locked(uaddr, count);
+    refosio_futex_unlock();
+    return nwoken;
+}
+
+static long
+refosio_futex_requeue(volatile int *uaddr, int count, int requeueCount, volatile int *uaddr2)
+{
+    refosio_futex_lock();
+    int nwoken = refosio_futex_wake_locked(uaddr, count);
+
+    /* Move the rest of the waiters across to the other futex word. */
+    struct refosio_futex_waiter **p = &refosioFutexBucket[REFOSIO_FUTEX_HASH(uaddr)];
+    while (*p && requeueCount > 0) {
+        struct refosio_futex_waiter *w = *p;
+        if (w->uaddr != uaddr) {
+            p = &w->next;
+            continue;
+        }
+        *p = w->next;
+        w->uaddr = uaddr2;
+        refosio_futex_enqueue(w);
+        requeueCount--;
+    }
+    refosio_futex_unlock();
+    return nwoken;
+}
+
+long
+sys_futex(va_list ap)
+{
+    volatile int *uaddr = va_arg(ap, volatile int *);
+    int op = va_arg(ap, int);
+    int val = va_arg(ap, int);
+    /* For requeue this argument is the number of waiters to requeue, rather than a timeout. */
+    void *timeoutArg = va_arg(ap, void *);
+    volatile int *uaddr2 = va_arg(ap, volatile int *);
+
+    if (!uaddr) {
+        return -EFAULT;
+    }
+    switch (op & ~(REFOSIO_FUTEX_PRIVATE_FLAG | REFOSIO_FUTEX_CLOCK_REALTIME)) {
+        case REFOSIO_FUTEX_WAIT:
+            return refosio_futex_wait(uaddr, val, (const struct timespec *) timeoutArg);
+        case REFOSIO_FUTEX_WAKE:
+            return refosio_futex_wake(uaddr, val);
+        case REFOSIO_FUTEX_REQUEUE:
+            if (!uaddr2) {
+                return -EFAULT;
+            }
+            return refosio_futex_requeue(uaddr, val, (int) (uintptr_t) timeoutArg, uaddr2);
+        default:
+            break;
+    }
+    seL4_DebugPrintf("WARNING: sys_futex op %d not supported.\n", op);
+    return -ENOSYS;
+}
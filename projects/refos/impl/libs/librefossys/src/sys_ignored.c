@@ -34,4 +34,15 @@ long sys_rt_sigaction(va_list ap) {
 long sys_fcntl64(va_list ap) {
     /* Ignored stub. */
     return 0;
-}
\ No newline at end of file
+}
+
+long sys_rt_sigprocmask(va_list ap) {
+    /* Ignored stub. RefOS has no signals to mask. */
+    return 0;
+}
+
+long sys_mprotect(va_list ap) {
+    /* Ignored stub. Anonymous mappings are always read / write, so musl's thread stack guard
+       pages are not enforced. */
+    return 0;
+}
@@ -14,6 +14,8 @@
 #include <refos-io/internal_state.h>
 #include <refos-io/ipc_state.h>
 #include <refos-io/filetable.h>
+#include <refos-io/stdio.h>
+#include <refos-io/socket.h>
 #include <refos-util/init.h>
 #include <refos-rpc/data_client.h>
 #include <refos-rpc/data_client_helper.h>
@@ -21,12 +23,15 @@
 #include <autoconf.h>
 
 #include <stdio.h>
+#include <string.h>
 #include <sys/uio.h>
 #include <limits.h>
 #include <errno.h>
 #include <sel4/sel4.h>
 #include <stdarg.h>
 #include <fcntl.h>
+#include <termios.h>
+#include <sys/ioctl.h>
 #include <refos-util/dprintf.h>
 
 #define STDIN_FD 0
@@ -74,17 +79,57 @@ sys_platform_stdout_write(void *data, size_t count)
     return count;
 }
 
-static size_t
+static long
 sys_platform_stdin_read(void *data, size_t count)
 {
     assert(data && count);
-    int c = refos_getc();
-    if (c < 0) {
-        return 0;
+    /* Read whatever the console server has for us in one go, rather than a character at a
+       time. In canonical mode this is a whole line. */
+    int n = refos_read((char*) data, count);
+    return (n < 0) ? -EIO : n;
+}
+
+/*! @brief Write to a socket fd. Stream sockets stop at the first short write; each buffer of a
+           datagram socket goes out as its own datagram. */
+static long
+sys_socket_writev(refos_socket_t *sock, struct iovec *iov, int iovcnt)
+{
+    long ret = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len == 0) continue;
+        /* Only the first write may block, so a partial writev returns what got through. */
+        int nc = refos_socket_send(sock, iov[i].iov_base, iov[i].iov_len, 0, 0,
+                                   sock->nonBlock || ret > 0);
+        if (nc < 0) {
+            return ret > 0 ? ret : nc;
+        }
+        ret += nc;
+        if (nc < iov[i].iov_len) {
+            break;
+        }
     }
-    char cc = (char) c;
-    memcpy(data, &cc, sizeof(char));
-    return sizeof(char);
+    return ret;
+}
+
+/*! @brief Read from a socket fd. Blocks for the first buffer only, then takes whatever else is
+           already waiting. */
+static long
+sys_socket_readv(refos_socket_t *sock, struct iovec *iov, int iovcnt)
+{
+    long ret = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len == 0) continue;
+        int nc = refos_socket_recv(sock, iov[i].iov_base, iov[i].iov_len, NULL, NULL,
+                                   sock->nonBlock || ret > 0);
+        if (nc < 0) {
+            return ret > 0 ? ret : nc;
+        }
+        ret += nc;
+        if (nc < iov[i].iov_len || sock->type == NETSERV_SOCK_DGRAM) {
+            break;
+        }
+    }
+    return ret;
 }
 
 /* Writev syscall implementation for muslc. Only implemented for stdin and stdout. */
@@ -93,6 +138,7 @@ _sys_writev(int fildes, struct iovec *iov, int iovcnt)
 {
     long long sum = 0;
     ssize_t ret = 0;
+    refos_socket_t *sock = NULL;
 
     /* The iovcnt argument is valid if greater than 0 and less than or equal to IOV_MAX. */
     if (iovcnt <= 0 || iovcnt > IOV_MAX)
@@ -122,6 +168,8 @@ _sys_writev(int fildes, struct iovec *iov, int iovcnt)
         /* Can't write to stdin. */
         assert(!"Can't write to stdin.");
         return -EACCES;
+    } else if ((sock = filetable_socket_get(&refosIOState.fdTable, fildes)) != NULL) {
+        return sys_socket_writev(sock, iov, iovcnt);
     } else {
         for (int i = 0; i < iovcnt; i++) {
             if (iov[i].iov_len == 0) continue;
@@ -202,12 +250,22 @@ _sys_readv(int fildes, struct iovec *iov, int iovcnt)
         /* Read from STDIN. */
         for (int i = 0; i < iovcnt; i++) {
             if (iov[i].iov_len == 0) continue;
-            ret += sys_platform_stdin_read(iov[i].iov_base, iov[i].iov_len);
+            long n = sys_platform_stdin_read(iov[i].iov_base, iov[i].iov_len);
+            if (n < 0) {
+                return n;
+            }
+            ret += n;
             break;
         }
         return ret;
     } 
 
+    /* Read from socket. */
+    refos_socket_t *sock = filetable_socket_get(&refosIOState.fdTable, fildes);
+    if (sock) {
+        return sys_socket_readv(sock, iov, iovcnt);
+    }
+
     /* Read from dataspace file. */
     for (int i = 0; i < iovcnt; i++) {
         if (iov[i].iov_len == 0) continue;
@@ -331,10 +389,65 @@ sys__llseek(va_list ap)
     return 0;
 }
 
+/*! @brief The subset of termios the console server line discipline supports. */
+static uint32_t
+sys_termios_to_lflag(const struct termios *t)
+{
+    return ((t->c_lflag & ICANON) ? REFOS_LFLAG_ICANON : 0) |
+           ((t->c_lflag & ECHO) ? REFOS_LFLAG_ECHO : 0);
+}
+
+static long
+sys_stdio_ioctl(int request, void *arg)
+{
+    struct termios *t = (struct termios *) arg;
+    int lflag;
+
+    switch (request) {
+    case TCGETS:
+        if (!t) {
+            return -EFAULT;
+        }
+        lflag = refos_stdio_get_lflag();
+        if (lflag < 0) {
+            return -ENOTTY;
+        }
+        memset(t, 0, sizeof(struct termios));
+        t->c_iflag = ICRNL;
+        t->c_oflag = OPOST | ONLCR;
+        t->c_cflag = CS8 | CREAD;
+        t->c_lflag = ((lflag & REFOS_LFLAG_ICANON) ? ICANON : 0) |
+                     ((lflag & REFOS_LFLAG_ECHO) ? (ECHO | ECHOE) : 0);
+        t->c_cc[VMIN] = 1;
+        t->c_cc[VERASE] = 0x7F;
+        return 0;
+    case TCSETS:
+    case TCSETSW:
+    case TCSETSF:
+        if (!t) {
+            return -EFAULT;
+        }
+        if (refos_stdio_set_lflag(sys_termios_to_lflag(t)) < 0) {
+            return -ENOTTY;
+        }
+        return 0;
+    default:
+        /* muslc does some ioctl to stdout, so just allow these to silently go through */
+        return 0;
+    }
+}
+
 long
 sys_ioctl(va_list ap)
 {
-    /* muslc does some ioctl to stdout, so just allow these to silently go through */
+    int fildes = va_arg(ap, int);
+    int request = va_arg(ap, int);
+    void *arg = va_arg(ap, void*);
+
+    if (fildes == STDOUT_FD || fildes == STDERR_FD || fildes == STDIN_FD) {
+        /* Terminal modes of stdio are the console server's line discipline. */
+        return sys_stdio_ioctl(request, arg);
+    }
     return 0;
 }
 
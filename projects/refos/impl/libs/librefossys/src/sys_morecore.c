@@ -24,7 +24,10 @@
 #include <refos-util/dprintf.h>
 #include <refos-util/init.h>
 
+#define _EBADF 9
 #define _ENOMEM 12
+#define _EACCES 13
+#define _EINVAL 22
 
 /*! How many pages of memory to expand the heap every increment.
     Too small and this leads to many many expensive resizing operations, too large and we allocate
@@ -118,9 +121,6 @@ sys_mmap2(va_list ap)
     int fd = va_arg(ap, int);
     off_t offset = va_arg(ap, int);
     
-    (void) prot;
-    (void) offset;
-    (void) fd;
     (void) addr;
 
     /* Static more-core override mode. */
@@ -135,7 +135,7 @@ sys_mmap2(va_list ap)
             refosIOState.staticMoreCoreOverrideTop = base;
             return base;
         }
-        assert(!"File mapping not implemented.");
+        seL4_DebugPrintf("File mapping not available with static morecore override.\n");
         return -_ENOMEM;
     }
 
@@ -162,9 +162,38 @@ sys_mmap2(va_list ap)
         return vaddr;
     }
 
-    seL4_DebugPrintf("File mapping not implemented.\n");
-    assert(!"File mapping not implemented.");
-    return -_ENOMEM;
+    /* File-backed mmap. Only read-only mappings are supported, for which MAP_PRIVATE and
+       MAP_SHARED behave identically. */
+    if (prot & PROT_WRITE) {
+        seL4_DebugPrintf("Writable file mapping not implemented.\n");
+        return -_EACCES;
+    }
+    if (!(flags & (MAP_PRIVATE | MAP_SHARED)) || (flags & MAP_FIXED)) {
+        return -_EINVAL;
+    }
+    if (!length) {
+        return -_EINVAL;
+    }
+
+    /* Take a reference to the file's dataspace, which keeps it open for as long as it is mapped,
+       even after fd is closed. Note that mmap2 offsets are in units of pages. */
+    fd_table_dspace_t *ds = filetable_dspace_ref(&refosIOState.fdTable, fd);
+    if (!ds) {
+        return -_EBADF;
+    }
+
+    uint32_t vaddr = 0;
+    refosio_internal_save_IPC_buffer();
+    int error = refosio_mmap_file(&refosIOState.mmapState, refos_round_up_npages(length),
+            ds, (uint32_t) offset * REFOS_PAGE_SIZE, &vaddr);
+    if (error != ESUCCESS || !vaddr) {
+        filetable_dspace_unref(ds);
+        refosio_internal_restore_IPC_buffer();
+        seL4_DebugPrintf("refosio_mmap_file mapping failed.\n");
+        return -_ENOMEM;
+    }
+    refosio_internal_restore_IPC_buffer();
+    return vaddr;
 }
 
 long
@@ -189,8 +218,16 @@ sys_munmap(va_list ap)
     }
 
     if ((uint32_t)addr >= PROCESS_MMAP_BOT && (uint32_t)addr < PROCESS_MMAP_TOP) {
+        /* Try file mappings first. */
+        refosio_internal_save_IPC_buffer();
+        int error = refosio_munmap_file(&refosIOState.mmapState, (uint32_t) addr);
+        refosio_internal_restore_IPC_buffer();
+        if (error == ESUCCESS) {
+            return 0;
+        }
+
         uint32_t sizeNPages = refos_round_up_npages(length);
-        int error = refosio_munmap_anon(&refosIOState.mmapState, (uint32_t) addr, sizeNPages);
+        error = refosio_munmap_anon(&refosIOState.mmapState, (uint32_t) addr, sizeNPages);
         if (error  != ESUCCESS) {
             seL4_DebugPrintf("refosio_munmap_anon mapping failed. Ignoring unmap.\n");
             return -1;
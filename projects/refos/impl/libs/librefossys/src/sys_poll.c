@@ -0,0 +1,198 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+#include <refos/refos.h>
+#include <refos/error.h>
+#include <refos-io/poll.h>
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/select.h>
+
+/* Included last, as its error macros would clash with the refos_error enum. */
+#include <errno.h>
+
+/*! @file
+    @brief poll and select syscalls, implemented on refos_poll().
+
+    Signal masks are ignored, as RefOS has no signals. select doesn't write back the time left.
+*/
+
+#define SYS_POLL_STACK_SOURCES 16
+
+/* ----------------------------------------- Helpers -------------------------------------------- */
+
+/*! @brief Get space for n poll sources, off the stack if there are only a few. */
+static refos_poll_source_t *
+sys_poll_sources(refos_poll_source_t *stackSrc, int n)
+{
+    if (n <= SYS_POLL_STACK_SOURCES) {
+        return stackSrc;
+    }
+    return malloc(sizeof(refos_poll_source_t) * n);
+}
+
+static void
+sys_poll_sources_free(refos_poll_source_t *stackSrc, refos_poll_source_t *src)
+{
+    if (src != stackSrc) {
+        free(src);
+    }
+}
+
+static int64_t
+sys_poll_timespec_us(const struct timespec *ts)
+{
+    if (!ts) {
+        return -1;
+    }
+    return ((int64_t) ts->tv_sec) * 1000000 + ts->tv_nsec / 1000;
+}
+
+/* --------------------------------- Poll syscall internals ------------------------------------- */
+
+static long
+_sys_poll(struct pollfd *fds, nfds_t n, int64_t timeoutUS)
+{
+    if (n && !fds) {
+        return -EFAULT;
+    }
+    refos_poll_source_t stackSrc[SYS_POLL_STACK_SOURCES];
+    refos_poll_source_t *src = sys_poll_sources(stackSrc, n);
+    if (!src) {
+        return -ENOMEM;
+    }
+    for (nfds_t i = 0; i < n; i++) {
+        src[i].fd = fds[i].fd;
+        src[i].events = ((fds[i].events & POLLIN) ? REFOS_POLL_READ : 0) |
+                        ((fds[i].events & POLLOUT) ? REFOS_POLL_WRITE : 0);
+        src[i].revents = 0;
+    }
+
+    int count = refos_poll(src, n, timeoutUS);
+    if (count >= 0) {
+        for (nfds_t i = 0; i < n; i++) {
+            fds[i].revents = ((src[i].revents & REFOS_POLL_READ) ? POLLIN : 0) |
+                             ((src[i].revents & REFOS_POLL_WRITE) ? POLLOUT : 0) |
+                             ((src[i].revents & REFOS_POLL_NVAL) ? POLLNVAL : 0);
+        }
+    }
+    sys_poll_sources_free(stackSrc, src);
+    return count;
+}
+
+static long
+_sys_select(int n, fd_set *rfds, fd_set *wfds, fd_set *efds, int64_t timeoutUS)
+{
+    if (n < 0 || n > FD_SETSIZE) {
+        return -EINVAL;
+    }
+    refos_poll_source_t stackSrc[SYS_POLL_STACK_SOURCES];
+    refos_poll_source_t *src = sys_poll_sources(stackSrc, n);
+    if (!src) {
+        return -ENOMEM;
+    }
+    int nsrc = 0;
+    for (int fd = 0; fd < n; fd++) {
+        int events = ((rfds && FD_ISSET(fd, rfds)) ? REFOS_POLL_READ : 0) |
+                     ((wfds && FD_ISSET(fd, wfds)) ? REFOS_POLL_WRITE : 0);
+        if (!events) {
+            continue;
+        }
+        src[nsrc].fd = fd;
+        src[nsrc].events = events;
+        src[nsrc++].revents = 0;
+    }
+
+    int count = refos_poll(src, nsrc, timeoutUS);
+    if (count < 0) {
+        sys_poll_sources_free(stackSrc, src);
+        return count;
+    }
+    for (int i = 0; i < nsrc; i++) {
+        if (src[i].revents & REFOS_POLL_NVAL) {
+            sys_poll_sources_free(stackSrc, src);
+            return -EBADF;
+        }
+    }
+
+    /* select counts ready bits, not ready descriptors. Nothing has exceptional conditions. */
+    count = 0;
+    if (rfds) {
+        FD_ZERO(rfds);
+    }
+    if (wfds) {
+        FD_ZERO(wfds);
+    }
+    if (efds) {
+        FD_ZERO(efds);
+    }
+    for (int i = 0; i < nsrc; i++) {
+        if (src[i].revents & REFOS_POLL_READ) {
+            FD_SET(src[i].fd, rfds);
+            count++;
+        }
+        if (src[i].revents & REFOS_POLL_WRITE) {
+            FD_SET(src[i].fd, wfds);
+            count++;
+        }
+    }
+    sys_poll_sources_free(stackSrc, src);
+    return count;
+}
+
+/* ------------------------------------- Poll syscalls ------------------------------------------ */
+
+long
+sys_poll(va_list ap)
+{
+    struct pollfd *fds = va_arg(ap, struct pollfd *);
+    nfds_t n = va_arg(ap, nfds_t);
+    int timeoutMS = va_arg(ap, int);
+    return _sys_poll(fds, n, timeoutMS < 0 ? -1 : ((int64_t) timeoutMS) * 1000);
+}
+
+long
+sys_ppoll(va_list ap)
+{
+    struct pollfd *fds = va_arg(ap, struct pollfd *);
+    nfds_t n = va_arg(ap, nfds_t);
+    const struct timespec *ts = va_arg(ap, const struct timespec *);
+    return _sys_poll(fds, n, sys_poll_timespec_us(ts));
+}
+
+long
+sys__newselect(va_list ap)
+{
+    int n = va_arg(ap, int);
+    fd_set *rfds = va_arg(ap, fd_set *);
+    fd_set *wfds = va_arg(ap, fd_set *);
+    fd_set *efds = va_arg(ap, fd_set *);
+    struct timeval *tv = va_arg(ap, struct timeval *);
+    int64_t timeoutUS = tv ? ((int64_t) tv->tv_sec) * 1000000 + tv->tv_usec : -1;
+    return _sys_select(n, rfds, wfds, efds, timeoutUS);
+}
+
+long
+sys_pselect6(va_list ap)
+{
+    int n = va_arg(ap, int);
+    fd_set *rfds = va_arg(ap, fd_set *);
+    fd_set *wfds = va_arg(ap, fd_set *);
+    fd_set *efds = va_arg(ap, fd_set *);
+    const struct timespec *ts = va_arg(ap, const struct timespec *);
+    return _sys_select(n, rfds, wfds, efds, sys_poll_timespec_us(ts));
+}
@@ -0,0 +1,500 @@
+/*
+ * Copyright 2016, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(D61_BSD)
+ */
+
+#include <refos/error.h>
+#include <refos-io/internal_state.h>
+#include <refos-io/filetable.h>
+#include <refos-io/socket.h>
+#include <utils/arith.h>
+
+#include <stdarg.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+/* Included last, as its error macros would clash with the refos_error enum. */
+#include <errno.h>
+
+/*! @file
+    @brief Socket syscalls, implemented on the RefOS network server.
+
+    Only AF_INET is supported. Addresses are converted to host byte order here, which is what
+    the network server works in. The network server has no TCP/IP stack; its sockets only carry
+    data between local processes (see net_server.c). socketpair, sendmsg, recvmsg, sendmmsg and
+    recvmmsg remain unimplemented: through socketcall() on IA32 they fail with ENOSYS, and
+    elsewhere they are the asserting stubs in sys_stubs.c.
+*/
+
+#define SYS_SOCKET_DEFAULT_BACKLOG 16
+
+/* ----------------------------------------- Helpers -------------------------------------------- */
+
+static refos_socket_t *
+sys_socket_get(int fd)
+{
+    return filetable_socket_get(&refosIOState.fdTable, fd);
+}
+
+static int
+sys_socket_addr_in(const struct sockaddr *addr, socklen_t addrlen, uint32_t *a, uint32_t *p)
+{
+    if (!addr || addrlen < sizeof(struct sockaddr_in)) {
+        return -EINVAL;
+    }
+    const struct sockaddr_in *sin = (const struct sockaddr_in *) addr;
+    if (sin->sin_family != AF_INET) {
+        return -EAFNOSUPPORT;
+    }
+    (*a) = ntohl(sin->sin_addr.s_addr);
+    (*p) = ntohs(sin->sin_port);
+    return 0;
+}
+
+static void
+sys_socket_addr_out(uint32_t a, uint32_t p, struct sockaddr *addr, socklen_t *addrlen)
+{
+    if (!addr || !addrlen) {
+        return;
+    }
+    struct sockaddr_in sin;
+    memset(&sin, 0, sizeof(struct sockaddr_in));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(a);
+    sin.sin_port = htons(p);
+    memcpy(addr, &sin, MIN(*addrlen, sizeof(struct sockaddr_in)));
+    (*addrlen) = sizeof(struct sockaddr_in);
+}
+
+/* -------------------------------- Socket syscall internals ------------------------------------ */
+
+static long
+_sys_socket(int domain, int type, int protocol)
+{
+    if (domain != AF_INET) {
+        return -EAFNOSUPPORT;
+    }
+    bool nonBlock = (type & SOCK_NONBLOCK) != 0;
+    int netType;
+    switch (type & ~(SOCK_NONBLOCK | SOCK_CLOEXEC)) {
+    case SOCK_STREAM:
+        if (protocol != 0 && protocol != IPPROTO_TCP) {
+            return -EPROTONOSUPPORT;
+        }
+        netType = NETSERV_SOCK_STREAM;
+        break;
+    case SOCK_DGRAM:
+        if (protocol != 0 && protocol != IPPROTO_UDP) {
+            return -EPROTONOSUPPORT;
+        }
+        netType = NETSERV_SOCK_DGRAM;
+        break;
+    default:
+        return -EPROTONOSUPPORT;
+    }
+
+    refos_socket_t *sock = NULL;
+    int fd = filetable_socket_alloc(&refosIOState.fdTable, &sock);
+    if (fd < 0) {
+        return -EMFILE;
+    }
+    int error = refos_socket_create(sock, netType);
+    if (error) {
+        filetable_close(&refosIOState.fdTable, fd);
+        return error;
+    }
+    sock->nonBlock = nonBlock;
+    return fd;
+}
+
+static long
+_sys_bind(int fd, const struct sockaddr *addr, socklen_t addrlen)
+{
+    refos_socket_t *sock = sys_socket_get(fd);
+    if (!sock) {
+        return -EBADF;
+    }
+    uint32_t a, p;
+    int error = sys_socket_addr_in(addr, addrlen, &a, &p);
+    if (error) {
+        return error;
+    }
+    return refos_socket_bind(sock, a, p);
+}
+
+static long
+_sys_connect(int fd, const struct sockaddr *addr, socklen_t addrlen)
+{
+    refos_socket_t *sock = sys_socket_get(fd);
+    if (!sock) {
+        return -EBADF;
+    }
+    uint32_t a, p;
+    int error = sys_socket_addr_in(addr, addrlen, &a, &p);
+    if (error) {
+        return error;
+    }
+    return refos_socket_connect(sock, a, p);
+}
+
+static long
+_sys_listen(int fd, int backlog)
+{
+    refos_socket_t *sock = sys_socket_get(fd);
+    if (!sock) {
+        return -EBADF;
+    }
+    if (backlog <= 0) {
+        backlog = SYS_SOCKET_DEFAULT_BACKLOG;
+    }
+    return refos_socket_listen(sock, backlog);
+}
+
+static long
+_sys_accept4(int fd, struct sockaddr *addr, socklen_t *addrlen, int flags)
+{
+    refos_socket_t *sock = sys_socket_get(fd);
+    if (!sock) {
+        return -EBADF;
+    }
+
+    refos_socket_t *newSock = NULL;
+    int newFd = filetable_socket_alloc(&refosIOState.fdTable, &newSock);
+    if (newFd < 0) {
+        return -EMFILE;
+    }
+    uint32_t a = 0, p = 0;
+    int error = refos_socket_accept(sock, newSock, &a, &p, sock->nonBlock);
+    if (error) {
+        filetable_close(&refosIOState.fdTable, newFd);
+        return error;
+    }
+    newSock->nonBlock = (flags & SOCK_NONBLOCK) != 0;
+    sys_socket_addr_out(a, p, addr, addrlen);
+    return newFd;
+}
+
+static long
+_sys_getname(int fd, struct sockaddr *addr, socklen_t *addrlen, bool peer)
+{
+    refos_socket_t *sock = sys_socket_get(fd);
+    if (!sock) {
+        return -EBADF;
+    }
+    if (!addr || !addrlen) {
+        return -EFAULT;
+    }
+    uint32_t a = 0, p = 0;
+    int error = refos_socket_getname(sock, peer, &a, &p);
+    if (error) {
+        return error;
+    }
+    sys_socket_addr_out(a, p, addr, addrlen);
+    return 0;
+}
+
+static long
+_sys_sendto(int fd, const void *buf, size_t len, int flags, const struct sockaddr *addr,
+            socklen_t addrlen)
+{
+    refos_socket_t *sock = sys_socket_get(fd);
+    if (!sock) {
+        return -EBADF;
+    }
+    uint32_t a = 0, p = 0;
+    if (addr && sock->type == NETSERV_SOCK_DGRAM) {
+        int error = sys_socket_addr_in(addr, addrlen, &a, &p);
+        if (error) {
+            return error;
+        }
+    }
+    bool nonBlock = sock->nonBlock || (flags & MSG_DONTWAIT);
+    return refos_socket_send(sock, buf, len, a, p, nonBlock);
+}
+
+static long
+_sys_recvfrom(int fd, void *buf, size_t len, int flags, struct sockaddr *addr,
+              socklen_t *addrlen)
+{
+    refos_socket_t *sock = sys_socket_get(fd);
+    if (!sock) {
+        return -EBADF;
+    }
+    uint32_t a = 0, p = 0;
+    bool nonBlock = sock->nonBlock || (flags & MSG_DONTWAIT);
+    int n = refos_socket_recv(sock, buf, len, &a, &p, nonBlock);
+    if (n < 0) {
+        return n;
+    }
+    if (sock->type == NETSERV_SOCK_DGRAM) {
+        sys_socket_addr_out(a, p, addr, addrlen);
+    }
+    return n;
+}
+
+static long
+_sys_shutdown(int fd, int how)
+{
+    refos_socket_t *sock = sys_socket_get(fd);
+    if (!sock) {
+        return -EBADF;
+    }
+    if (how == SHUT_RD) {
+        /* Nothing to do; the receive ring is simply never read again. */
+        return 0;
+    }
+    return refos_socket_shutdown(sock);
+}
+
+static long
+_sys_setsockopt(int fd, int level, int optname, const void *optval, socklen_t optlen)
+{
+    if (!sys_socket_get(fd)) {
+        return -EBADF;
+    }
+    /* There are no options to set. Accept them all, so that programs setting the usual
+       SO_REUSEADDR and friends carry on. */
+    return 0;
+}
+
+static long
+_sys_getsockopt(int fd, int level, int optname, void *optval, socklen_t *optlen)
+{
+    if (!sys_socket_get(fd)) {
+        return -EBADF;
+    }
+    if (!optval || !optlen || *optlen < sizeof(int)) {
+        return -EINVAL;
+    }
+    if (level == SOL_SOCKET && optname == SO_ERROR) {
+        /* Connections complete (or fail) synchronously, so there is never a pending error. */
+        *((int*) optval) = 0;
+        (*optlen) = sizeof(int);
+        return 0;
+    }
+    return -ENOPROTOOPT;
+}
+
+/* ------------------------------------- Socket syscalls ---------------------------------------- */
+
+long
+sys_socket(va_list ap)
+{
+    int domain = va_arg(ap, int);
+    int type = va_arg(ap, int);
+    int protocol = va_arg(ap, int);
+    return _sys_socket(domain, type, protocol);
+}
+
+long
+sys_bind(va_list ap)
+{
+    int fd = va_arg(ap, int);
+    const struct sockaddr *addr = va_arg(ap, const struct sockaddr *);
+    socklen_t addrlen = va_arg(ap, socklen_t);
+    return _sys_bind(fd, addr, addrlen);
+}
+
+long
+sys_connect(va_list ap)
+{
+    int fd = va_arg(ap, int);
+    const struct sockaddr *addr = va_arg(ap, const struct sockaddr *);
+    socklen_t addrlen = va_arg(ap, socklen_t);
+    return _sys_connect(fd, addr, addrlen);
+}
+
+long
+sys_listen(va_list ap)
+{
+    int fd = va_arg(ap, int);
+    int backlog = va_arg(ap, int);
+    return _sys_listen(fd, backlog);
+}
+
+long
+sys_accept(va_list ap)
+{
+    int fd = va_arg(ap, int);
+    struct sockaddr *addr = va_arg(ap, struct sockaddr *);
+    socklen_t *addrlen = va_arg(ap, socklen_t *);
+    return _sys_accept4(fd, addr, addrlen, 0);
+}
+
+long
+sys_accept4(va_list ap)
+{
+    int fd = va_arg(ap, int);
+    struct sockaddr *addr = va_arg(ap, struct sockaddr *);
+    socklen_t *addrlen = va_arg(ap, socklen_t *);
+    int flags = va_arg(ap, int);
+    return _sys_accept4(fd, addr, addrlen, flags);
+}
+
+long
+sys_getsockname(va_list ap)
+{
+    int fd = va_arg(ap, int);
+    struct sockaddr *addr = va_arg(ap, struct sockaddr *);
+    socklen_t *addrlen = va_arg(ap, socklen_t *);
+    return _sys_getname(fd, addr, addrlen, false);
+}
+
+long
+sys_getpeername(va_list ap)
+{
+    int fd = va_arg(ap, int);
+    struct sockaddr *addr = va_arg(ap, struct sockaddr *);
+    socklen_t *addrlen = va_arg(ap, socklen_t *);
+    return _sys_getname(fd, addr, addrlen, true);
+}
+
+long
+sys_send(va_list ap)
+{
+    int fd = va_arg(ap, int);
+    const void *buf = va_arg(ap, const void *);
+    size_t len = va_arg(ap, size_t);
+    int flags = va_arg(ap, int);
+    return _sys_sendto(fd, buf, len, flags, NULL, 0);
+}
+
+long
+sys_sendto(va_list ap)
+{
+    int fd = va_arg(ap, int);
+    const void *buf = va_arg(ap, const void *);
+    size_t len = va_arg(ap, size_t);
+    int flags = va_arg(ap, int);
+    const struct sockaddr *addr = va_arg(ap, const struct sockaddr *);
+    socklen_t addrlen = va_arg(ap, socklen_t);
+    return _sys_sendto(fd, buf, len, flags, addr, addrlen);
+}
+
+long
+sys_recv(va_list ap)
+{
+    int fd = va_arg(ap, int);
+    void *buf = va_arg(ap, void *);
+    size_t len = va_arg(ap, size_t);
+    int flags = va_arg(ap, int);
+    return _sys_recvfrom(fd, buf, len, flags, NULL, NULL);
+}
+
+long
+sys_recvfrom(va_list ap)
+{
+    int fd = va_arg(ap, int);
+    void *buf = va_arg(ap, void *);
+    size_t len = va_arg(ap, size_t);
+    int flags = va_arg(ap, int);
+    struct sockaddr *addr = va_arg(ap, struct sockaddr *);
+    socklen_t *addrlen = va_arg(ap, socklen_t *);
+    return _sys_recvfrom(fd, buf, len, flags, addr, addrlen);
+}
+
+long
+sys_shutdown(va_list ap)
+{
+    int fd = va_arg(ap, int);
+    int how = va_arg(ap, int);
+    return _sys_shutdown(fd, how);
+}
+
+long
+sys_setsockopt(va_list ap)
+{
+    int fd = va_arg(ap, int);
+    int level = va_arg(ap, int);
+    int optname = va_arg(ap, int);
+    const void *optval = va_arg(ap, const void *);
+    socklen_t optlen = va_arg(ap, socklen_t);
+    return _sys_setsockopt(fd, level, optname, optval, optlen);
+}
+
+long
+sys_getsockopt(va_list ap)
+{
+    int fd = va_arg(ap, int);
+    int level = va_arg(ap, int);
+    int optname = va_arg(ap, int);
+    void *optval = va_arg(ap, void *);
+    socklen_t *optlen = va_arg(ap, socklen_t *);
+    return _sys_getsockopt(fd, level, optname, optval, optlen);
+}
+
+#ifdef ARCH_IA32
+
+/* socketcall() call numbers, from linux/net.h. */
+#define SYS_SOCKETCALL_SOCKET 1
+#define SYS_SOCKETCALL_BIND 2
+#define SYS_SOCKETCALL_CONNECT 3
+#define SYS_SOCKETCALL_LISTEN 4
+#define SYS_SOCKETCALL_ACCEPT 5
+#define SYS_SOCKETCALL_GETSOCKNAME 6
+#define SYS_SOCKETCALL_GETPEERNAME 7
+#define SYS_SOCKETCALL_SEND 9
+#define SYS_SOCKETCALL_RECV 10
+#define SYS_SOCKETCALL_SENDTO 11
+#define SYS_SOCKETCALL_RECVFROM 12
+#define SYS_SOCKETCALL_SHUTDOWN 13
+#define SYS_SOCKETCALL_SETSOCKOPT 14
+#define SYS_SOCKETCALL_GETSOCKOPT 15
+#define SYS_SOCKETCALL_ACCEPT4 18
+
+/*! @brief IA32 multiplexes all of the socket syscalls through socketcall(). */
+long
+sys_socketcall(va_list ap)
+{
+    int call = va_arg(ap, int);
+    unsigned long *a = va_arg(ap, unsigned long *);
+
+    switch (call) {
+    case SYS_SOCKETCALL_SOCKET:
+        return _sys_socket(a[0], a[1], a[2]);
+    case SYS_SOCKETCALL_BIND:
+        return _sys_bind(a[0], (const struct sockaddr *) a[1], a[2]);
+    case SYS_SOCKETCALL_CONNECT:
+        return _sys_connect(a[0], (const struct sockaddr *) a[1], a[2]);
+    case SYS_SOCKETCALL_LISTEN:
+        return _sys_listen(a[0], a[1]);
+    case SYS_SOCKETCALL_ACCEPT:
+        return _sys_accept4(a[0], (struct sockaddr *) a[1], (socklen_t *) a[2], 0);
+    case SYS_SOCKETCALL_ACCEPT4:
+        return _sys_accept4(a[0], (struct sockaddr *) a[1], (socklen_t *) a[2], a[3]);
+    case SYS_SOCKETCALL_GETSOCKNAME:
+        return _sys_getname(a[0], (struct sockaddr *) a[1], (socklen_t *) a[2], false);
+    case SYS_SOCKETCALL_GETPEERNAME:
+        return _sys_getname(a[0], (struct sockaddr *) a[1], (socklen_t *) a[2], true);
+    case SYS_SOCKETCALL_SEND:
+        return _sys_sendto(a[0], (const void *) a[1], a[2], a[3], NULL, 0);
+    case SYS_SOCKETCALL_SENDTO:
+        return _sys_sendto(a[0], (const void *) a[1], a[2], a[3],
+                           (const struct sockaddr *) a[4], a[5]);
+    case SYS_SOCKETCALL_RECV:
+        return _sys_recvfrom(a[0], (void *) a[1], a[2], a[3], NULL, NULL);
+    case SYS_SOCKETCALL_RECVFROM:
+        return _sys_recvfrom(a[0], (void *) a[1], a[2], a[3], (struct sockaddr *) a[4],
+                             (socklen_t *) a[5]);
+    case SYS_SOCKETCALL_SHUTDOWN:
+        return _sys_shutdown(a[0], a[1]);
+    case SYS_SOCKETCALL_SETSOCKOPT:
+        return _sys_setsockopt(a[0], a[1], a[2], (const void *) a[3], a[4]);
+    case SYS_SOCKETCALL_GETSOCKOPT:
+        return _sys_getsockopt(a[0], a[1], a[2], (void *) a[3], (socklen_t *) a[4]);
+    default:
+        /* SOCKETPAIR (8), SENDMSG (16), RECVMSG (17), RECVMMSG (19) and SENDMMSG (20). */
+        break;
+    }
+    return -ENOSYS;
+}
+
+#endif /* ARCH_IA32 */
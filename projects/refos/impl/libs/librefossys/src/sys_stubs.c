@@ -298,10 +298,10 @@ long sys_getrlimit(va_list ap) {
 	assert(!"sys_getrlimit not implemented");
 	return 0;
 }
-long sys_getrusage(va_list ap) {
+/*long sys_getrusage(va_list ap) {
 	assert(!"sys_getrusage not implemented");
 	return 0;
-}
+}*/
 long sys_gettimeofday(va_list ap) {
 	assert(!"sys_gettimeofday not implemented");
 	return 0;
@@ -394,10 +394,6 @@ long sys_ioperm(va_list ap) {
 	assert(!"sys_ioperm not implemented");
 	return 0;
 }
-long sys_socketcall(va_list ap) {
-	assert(!"sys_socketcall not implemented");
-	return 0;
-}
 long sys_syslog(va_list ap) {
 	assert(!"sys_syslog not implemented");
 	return 0;
@@ -466,10 +462,10 @@ long sys_sigreturn(va_list ap) {
 	assert(!"sys_sigreturn not implemented");
 	return 0;
 }
-long sys_clone(va_list ap) {
+/*long sys_clone(va_list ap) {
 	assert(!"sys_clone not implemented");
 	return 0;
-}
+}*/
 long sys_setdomainname(va_list ap) {
 	assert(!"sys_setdomainname not implemented");
 	return 0;
@@ -486,10 +482,10 @@ long sys_adjtimex(va_list ap) {
 	assert(!"sys_adjtimex not implemented");
 	return 0;
 }
-long sys_mprotect(va_list ap) {
+/*long sys_mprotect(va_list ap) {
 	assert(!"sys_mprotect not implemented");
 	return 0;
-}
+}*/
 long sys_sigprocmask(va_list ap) {
 	assert(!"sys_sigprocmask not implemented");
 	return 0;
@@ -554,10 +550,6 @@ long sys_getdents(va_list ap) {
 	assert(!"sys_getdents not implemented");
 	return 0;
 }
-long sys__newselect(va_list ap) {
-	assert(!"sys__newselect not implemented");
-	return 0;
-}
 long sys_flock(va_list ap) {
 	assert(!"sys_flock not implemented");
 	return 0;
@@ -650,10 +642,6 @@ long sys_query_module(va_list ap) {
 	assert(!"sys_query_module not implemented");
 	return 0;
 }
-long sys_poll(va_list ap) {
-	assert(!"sys_poll not implemented");
-	return 0;
-}
 long sys_nfsservctl(va_list ap) {
 	assert(!"sys_nfsservctl not implemented");
 	return 0;
@@ -674,10 +662,10 @@ long sys_rt_sigreturn(va_list ap) {
 	assert(!"sys_rt_sigreturn not implemented");
 	return 0;
 }
-long sys_rt_sigprocmask(va_list ap) {
+/*long sys_rt_sigprocmask(va_list ap) {
 	assert(!"sys_rt_sigprocmask not implemented");
 	return 0;
-}
+}*/
 long sys_rt_sigpending(va_list ap) {
 	assert(!"sys_rt_sigpending not implemented");
 	return 0;
@@ -862,10 +850,10 @@ long sys_getdents64(va_list ap) {
 	assert(!"sys_getdents64 not implemented");
 	return 0;
 }
-long sys_gettid(va_list ap) {
+/*long sys_gettid(va_list ap) {
 	assert(!"sys_gettid not implemented");
 	return 0;
-}
+}*/
 long sys_readahead(va_list ap) {
 	assert(!"sys_readahead not implemented");
 	return 0;
@@ -926,10 +914,10 @@ long sys_sendfile64(va_list ap) {
 	assert(!"sys_sendfile64 not implemented");
 	return 0;
 }
-long sys_futex(va_list ap) {
+/*long sys_futex(va_list ap) {
 	assert(!"sys_futex not implemented");
 	return 0;
-}
+}*/
 long sys_sched_setaffinity(va_list ap) {
 	assert(!"sys_sched_setaffinity not implemented");
 	return 0;
@@ -1174,14 +1162,6 @@ long sys_faccessat(va_list ap) {
 	assert(!"sys_faccessat not implemented");
 	return 0;
 }
-long sys_pselect6(va_list ap) {
-	assert(!"sys_pselect6 not implemented");
-	return 0;
-}
-long sys_ppoll(va_list ap) {
-	assert(!"sys_ppoll not implemented");
-	return 0;
-}
 long sys_unshare(va_list ap) {
 	assert(!"sys_unshare not implemented");
 	return 0;
@@ -1534,10 +1514,10 @@ long sys_setrlimit(va_list ap) {
     assert(!"sys_setrlimit not implemented");
     return 0;
 }
-long sys_getrusage(va_list ap) {
+/*long sys_getrusage(va_list ap) {
     assert(!"sys_getrusage not implemented");
     return 0;
-}
+}*/
 long sys_gettimeofday(va_list ap) {
     assert(!"sys_gettimeofday not implemented");
     return 0;
@@ -1654,10 +1634,10 @@ long sys_sigreturn(va_list ap) {
     assert(!"sys_sigreturn not implemented");
     return 0;
 }
-long sys_clone(va_list ap) {
+/*long sys_clone(va_list ap) {
     assert(!"sys_clone not implemented");
     return 0;
-}
+}*/
 long sys_setdomainname(va_list ap) {
     assert(!"sys_setdomainname not implemented");
     return 0;
@@ -1670,10 +1650,10 @@ long sys_adjtimex(va_list ap) {
     assert(!"sys_adjtimex not implemented");
     return 0;
 }
-long sys_mprotect(va_list ap) {
+/*long sys_mprotect(va_list ap) {
     assert(!"sys_mprotect not implemented");
     return 0;
-}
+}*/
 long sys_sigprocmask(va_list ap) {
     assert(!"sys_sigprocmask not implemented");
     return 0;
@@ -1722,10 +1702,6 @@ long sys_getdents(va_list ap) {
     assert(!"sys_getdents not implemented");
     return 0;
 }
-long sys__newselect(va_list ap) {
-    assert(!"sys__newselect not implemented");
-    return 0;
-}
 long sys_flock(va_list ap) {
     assert(!"sys_flock not implemented");
     return 0;
@@ -1810,10 +1786,6 @@ long sys_getresuid(va_list ap) {
     assert(!"sys_getresuid not implemented");
     return 0;
 }
-long sys_poll(va_list ap) {
-    assert(!"sys_poll not implemented");
-    return 0;
-}
 long sys_nfsservctl(va_list ap) {
     assert(!"sys_nfsservctl not implemented");
     return 0;
@@ -1834,10 +1806,10 @@ long sys_rt_sigreturn(va_list ap) {
     assert(!"sys_rt_sigreturn not implemented");
     return 0;
 }
-long sys_rt_sigprocmask(va_list ap) {
+/*long sys_rt_sigprocmask(va_list ap) {
     assert(!"sys_rt_sigprocmask not implemented");
     return 0;
-}
+}*/
 long sys_rt_sigpending(va_list ap) {
     assert(!"sys_rt_sigpending not implemented");
     return 0;
@@ -2010,10 +1982,10 @@ long sys_madvise(va_list ap) {
     assert(!"sys_madvise not implemented");
     return 0;
 }
-long sys_gettid(va_list ap) {
+/*long sys_gettid(va_list ap) {
     assert(!"sys_gettid not implemented");
     return 0;
-}
+}*/
 long sys_readahead(va_list ap) {
     assert(!"sys_readahead not implemented");
     return 0;
@@ -2074,10 +2046,10 @@ long sys_sendfile64(va_list ap) {
     assert(!"sys_sendfile64 not implemented");
     return 0;
 }
-long sys_futex(va_list ap) {
+/*long sys_futex(va_list ap) {
     assert(!"sys_futex not implemented");
     return 0;
-}
+}*/
 long sys_sched_setaffinity(va_list ap) {
     assert(!"sys_sched_setaffinity not implemented");
     return 0;
@@ -2218,66 +2190,10 @@ long sys_waitid(va_list ap) {
     assert(!"sys_waitid not implemented");
     return 0;
 }
-long sys_socket(va_list ap) {
-    assert(!"sys_socket not implemented");
-    return 0;
-}
-long sys_bind(va_list ap) {
-    assert(!"sys_bind not implemented");
-    return 0;
-}
-long sys_connect(va_list ap) {
-    assert(!"sys_connect not implemented");
-    return 0;
-}
-long sys_listen(va_list ap) {
-    assert(!"sys_listen not implemented");
-    return 0;
-}
-long sys_accept(va_list ap) {
-    assert(!"sys_accept not implemented");
-    return 0;
-}
-long sys_getsockname(va_list ap) {
-    assert(!"sys_getsockname not implemented");
-    return 0;
-}
-long sys_getpeername(va_list ap) {
-    assert(!"sys_getpeername not implemented");
-    return 0;
-}
 long sys_socketpair(va_list ap) {
     assert(!"sys_socketpair not implemented");
     return 0;
 }
-long sys_send(va_list ap) {
-    assert(!"sys_send not implemented");
-    return 0;
-}
-long sys_sendto(va_list ap) {
-    assert(!"sys_sendto not implemented");
-    return 0;
-}
-long sys_recv(va_list ap) {
-    assert(!"sys_recv not implemented");
-    return 0;
-}
-long sys_recvfrom(va_list ap) {
-    assert(!"sys_recvfrom not implemented");
-    return 0;
-}
-long sys_shutdown(va_list ap) {
-    assert(!"sys_shutdown not implemented");
-    return 0;
-}
-long sys_setsockopt(va_list ap) {
-    assert(!"sys_setsockopt not implemented");
-    return 0;
-}
-long sys_getsockopt(va_list ap) {
-    assert(!"sys_getsockopt not implemented");
-    return 0;
-}
 long sys_sendmsg(va_list ap) {
     assert(!"sys_sendmsg not implemented");
     return 0;
@@ -2434,14 +2350,6 @@ long sys_faccessat(va_list ap) {
     assert(!"sys_faccessat not implemented");
     return 0;
 }
-long sys_pselect6(va_list ap) {
-    assert(!"sys_pselect6 not implemented");
-    return 0;
-}
-long sys_ppoll(va_list ap) {
-    assert(!"sys_ppoll not implemented");
-    return 0;
-}
 long sys_unshare(va_list ap) {
     assert(!"sys_unshare not implemented");
     return 0;
@@ -2558,10 +2466,6 @@ long sys_recvmmsg(va_list ap) {
     assert(!"sys_recvmmsg not implemented");
     return 0;
 }
-long sys_accept4(va_list ap) {
-    assert(!"sys_accept4 not implemented");
-    return 0;
-}
 long sys_fanotify_init(va_list ap) {
     assert(!"sys_fanotify_init not implemented");
     return 0;
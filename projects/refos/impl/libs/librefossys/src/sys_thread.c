@@ -10,7 +10,40 @@
  * @TAG(D61_BSD)
  */
 
+#define _GNU_SOURCE
+#include <refos/refos.h>
+#include <refos/vmlayout.h>
+#include <refos-io/thread.h>
+#include <refos-rpc/rpc.h>
+#include <refos-rpc/proc_client.h>
+#include <refos-rpc/proc_client_helper.h>
+
+#include <stdio.h>
+#include <stdint.h>
 #include <stdarg.h>
+#include <limits.h>
+#include <errno.h>
+#include <sched.h>
+#include <sel4/sel4.h>
+
+/*! @file
+    @brief Thread creation, TLS and thread exit syscalls.
+
+    Threads are created through the process server's proc_clone, sharing the vspace of the
+    process. musl's __clone hands us the thread function and its argument at the top of the child
+    stack; we build a small start block below it, which a trampoline running on the new thread
+    picks up. Linux thread IDs are the process server's thread IDs plus one, so that the main
+    thread (thread 0) has a non-zero TID.
+
+    Each created thread has its own notification and RPC receive slot, at the cslots for its
+    thread ID. An exiting thread asks the process server to release it, passing its TID word. The
+    process server clears the TID word once the thread is gone, so a joiner can't free the
+    thread's stack and TLS while the thread is still running on them. As nobody wakes the joiner,
+    futex waits on TID words poll.
+
+    The main thread can't exit on its own; it clears its TID and parks on its notification, until
+    the last thread exits the process.
+*/
 
 /* Future Work 2:
    Find out why calls to assert_fail() call printf() and result
@@ -19,9 +52,200 @@
    calls assert_fail() which results in infinite recursion. Calls to
    printf() work fine in other parts of RefOS.
 */
-long sys_set_thread_area(va_list ap) {
-	return 0;
+
+#define REFOSIO_THREAD_REQUIRED_FLAGS (CLONE_VM | CLONE_SETTLS)
+
+/*! @brief Start block for a new thread, placed on its stack by the parent. */
+struct refosio_thread_start {
+    int (*func)(void *);
+    void *arg;
+    volatile int *clearTID;
+    volatile int *parentTID;
+    volatile int *childTID;
+};
+
+static __thread int refosioThreadID;
+static __thread seL4_CPtr refosioThreadNotify;
+
+/*! The number of live threads created by this process, not including the main thread. */
+static volatile int refosioThreadCount;
+
+/*! The TID word of every thread, indexed by thread ID, and the highest thread ID handed out. */
+static volatile int * volatile refosioThreadClearTID[PROCESS_MAX_THREADS];
+static volatile int refosioThreadMaxID;
+
+int
+refosio_thread_id(void)
+{
+    return refosioThreadID;
+}
+
+seL4_CPtr
+refosio_thread_notify(void)
+{
+    return refosioThreadNotify;
+}
+
+bool
+refosio_thread_is_clear_tid(volatile int *uaddr)
+{
+    /* The main thread's TID word is cleared through the futex table. */
+    for (int i = 1; i <= refosioThreadMaxID; i++) {
+        if (refosioThreadClearTID[i] == uaddr) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void
+refosio_thread_exit(void)
+{
+    int threadID = refosioThreadID;
+    volatile int *clearTID = refosioThreadClearTID[threadID];
+    if (threadID != 0) {
+        __sync_fetch_and_sub(&refosioThreadCount, 1);
+        int error = proc_thread_exit(threadID, (seL4_Word) clearTID);
+
+        /* We only get here if the process server couldn't release us. Our TID word stays set, as
+           we are still on our stack. */
+        seL4_DebugPrintf("WARNING: thread %d failed to exit (%d).\n", threadID, error);
+    } else if (clearTID) {
+        *clearTID = 0;
+        refosio_futex_wake(clearTID, INT_MAX);
+    }
+    while (1) {
+        /* Spurious futex wakeups may still land here. */
+        if (refosioThreadNotify) {
+            seL4_Wait(refosioThreadNotify, NULL);
+        } else {
+            seL4_Yield();
+        }
+    }
 }
-long sys_set_tid_address(va_list ap) {
-	return 0;
+
+static void
+refosio_thread_entry(struct refosio_thread_start *start, void *ipcBuffer, int threadID)
+{
+    int (*func)(void *) = start->func;
+    void *arg = start->arg;
+
+    /* Our TLS block was copied from the initial image, so it still needs our own IPC buffer, and
+       our own slot to receive RPC caps in. */
+    seL4_SetIPCBuffer((seL4_IPCBuffer *) ipcBuffer);
+    rpc_setup_recv(PROCCSPACE_THREAD_RECV_START + threadID);
+    refosioThreadID = threadID;
+    refosioThreadNotify = PROCCSPACE_THREAD_NOTIFY_START + threadID;
+    refosioThreadClearTID[threadID] = start->clearTID;
+    if (start->childTID) {
+        *start->childTID = threadID + 1;
+    }
+    if (start->parentTID) {
+        __sync_val_compare_and_swap(start->parentTID, -1, threadID + 1);
+    }
+
+    func(arg);
+    refosio_thread_exit();
+}
+
+long
+sys_clone(va_list ap)
+{
+    unsigned long flags = va_arg(ap, unsigned long);
+    void **stack = va_arg(ap, void **);
+    volatile int *ptid = va_arg(ap, volatile int *);
+    void *tls = va_arg(ap, void *);
+    volatile int *ctid = va_arg(ap, volatile int *);
+
+    if ((flags & REFOSIO_THREAD_REQUIRED_FLAGS) != REFOSIO_THREAD_REQUIRED_FLAGS) {
+        seL4_DebugPrintf("WARNING: sys_clone only supports creating threads.\n");
+        return -ENOSYS;
+    }
+    if (!stack) {
+        return -EINVAL;
+    }
+
+    /* The main thread gets its notification the first time it creates a thread. Doing this here
+       means futex waits never need to allocate one. Created threads are given theirs by the
+       process server. */
+    if (!refosioThreadNotify) {
+        refosioThreadNotify = proc_new_async_endpoint();
+        if (!refosioThreadNotify) {
+            return -EAGAIN;
+        }
+    }
+
+    struct refosio_thread_start *start = (struct refosio_thread_start *)
+            (((uintptr_t) stack - sizeof(struct refosio_thread_start)) & ~((uintptr_t) 15));
+    start->func = (int (*)(void *)) stack[0];
+    start->arg = stack[1];
+    start->clearTID = (flags & CLONE_CHILD_CLEARTID) ? ctid : NULL;
+    start->parentTID = (flags & CLONE_PARENT_SETTID) ? ptid : NULL;
+    start->childTID = (flags & CLONE_CHILD_SETTID) ? ctid : NULL;
+    if (start->parentTID) {
+        /* Whichever of us learns the thread ID first writes it. */
+        *start->parentTID = -1;
+    }
+
+    refos_err_t error = EINVALID;
+    int threadID = proc_clone_internal((seL4_Word) refosio_thread_entry, (seL4_Word) start, 0,
+            (seL4_Word) start, (seL4_Word) tls, &error);
+    if (error != ESUCCESS || threadID < 0) {
+        seL4_DebugPrintf("WARNING: sys_clone failed to create thread (%d).\n", error);
+        return -EAGAIN;
+    }
+
+    /* The thread may have been given the ID of one which has exited, whose TID word is stale. */
+    refosioThreadClearTID[threadID] = start->clearTID;
+    int maxID;
+    do {
+        maxID = refosioThreadMaxID;
+    } while (threadID > maxID &&
+             !__sync_bool_compare_and_swap(&refosioThreadMaxID, maxID, threadID));
+    __sync_fetch_and_add(&refosioThreadCount, 1);
+    if (flags & CLONE_PARENT_SETTID) {
+        __sync_val_compare_and_swap(ptid, -1, threadID + 1);
+    }
+    return threadID + 1;
+}
+
+long
+sys_set_thread_area(va_list ap)
+{
+    /* musl only calls this from __init_tp, on the main thread. New threads get their TLS base
+       from sys_clone. */
+    void *tp = va_arg(ap, void *);
+    int error = seL4_TCB_SetTLSBase(REFOS_THREAD_TCB, (seL4_Word) tp);
+    if (error != seL4_NoError) {
+        /* A positive return tells musl we have a thread pointer, but can't do threads. */
+        seL4_DebugPrintf("WARNING: sys_set_thread_area failed to set TLS base (%d).\n", error);
+        return 1;
+    }
+    return 0;
+}
+
+long
+sys_set_tid_address(va_list ap)
+{
+    refosioThreadClearTID[refosioThreadID] = va_arg(ap, volatile int *);
+    return refosioThreadID + 1;
+}
+
+long
+sys_gettid(va_list ap)
+{
+    return refosioThreadID + 1;
+}
+
+long
+sys_exit(va_list ap)
+{
+    int status = va_arg(ap, int);
+    if (refosioThreadCount == 0) {
+        /* Never had any threads; this is the whole process exiting. */
+        proc_exit(status);
+        while (1); /* We don't return after this */
+    }
+    refosio_thread_exit();
+    return 0;
 }
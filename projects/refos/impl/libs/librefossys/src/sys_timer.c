@@ -10,16 +10,22 @@
  * @TAG(D61_BSD)
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <sel4/sel4.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
 #include <time.h>
+#include <sys/resource.h>
 #include <refos-io/timer.h>
 #include <refos-io/internal_state.h>
 #include <refos-io/ipc_state.h>
 #include <refos-io/filetable.h>
+#include <refos-io/thread.h>
+#include <refos-rpc/proc_client.h>
 #include <refos-util/dprintf.h>
+#include <errno.h>
 
 void
 refos_init_timer(char *dspacePath)
@@ -50,8 +56,8 @@ sys_nanosleep(va_list ap)
         return -1;
     }
 
-    uint64_t ns = (uint64_t) rem->tv_nsec;
-    ns += rem->tv_sec * 1000000000UL;
+    uint64_t ns = (uint64_t) req->tv_nsec;
+    ns += (uint64_t) req->tv_sec * 1000000000ULL;
 
     int res = fwrite(&ns, sizeof(uint64_t), 1, refosIOState.timerFD);
     fflush(refosIOState.timerFD);
@@ -64,6 +70,25 @@ sys_nanosleep(va_list ap)
     return res < 0 ? -1 : 0;
 }
 
+/*! @brief Get the CPU time used by the calling process, or by the calling thread.
+    @param thread Whether to get the time of the calling thread, rather than the whole process.
+    @param us Output CPU time, in microseconds.
+    @return 0 on success, -1 if CPU time is not available (non-MCS kernels).
+*/
+static int
+sys_cpu_time(bool thread, uint64_t *us)
+{
+    refos_cpu_stats_t stats;
+    refosio_internal_save_IPC_buffer();
+    refos_err_t error = proc_get_cpu_stats(0, thread ? refosio_thread_id() : -1, &stats);
+    refosio_internal_restore_IPC_buffer();
+    if (error != ESUCCESS) {
+        return -1;
+    }
+    (*us) = thread ? stats.threadTimeUS : stats.processTimeUS;
+    return 0;
+}
+
 long
 sys_clock_gettime(va_list ap)
 {
@@ -73,8 +98,14 @@ sys_clock_gettime(va_list ap)
         return -1;
     }
     if (clk_id == CLOCK_PROCESS_CPUTIME_ID || clk_id == CLOCK_THREAD_CPUTIME_ID) {
-        seL4_DebugPrintf("WARNING: sys_clock_gettime CPU time feature not supported.\n");
-        return -1;
+        uint64_t us = 0;
+        if (sys_cpu_time(clk_id == CLOCK_THREAD_CPUTIME_ID, &us) != 0) {
+            seL4_DebugPrintf("WARNING: sys_clock_gettime CPU time feature not supported.\n");
+            return -1;
+        }
+        tp->tv_sec = us / 1000000UL;
+        tp->tv_nsec = (us % 1000000UL) * 1000UL;
+        return 0;
     }
     if (!refosIOState.timerFD) {
         assert(!"sys_clock_gettime not supported");
@@ -100,3 +131,26 @@ sys_clock_gettime(va_list ap)
 
     return res > 0 ? 0 : -1;
 }
+
+long
+sys_getrusage(va_list ap)
+{
+    int who = va_arg(ap, int);
+    struct rusage *usage = va_arg(ap, struct rusage *);
+    if (!usage) {
+        return -EFAULT;
+    }
+    memset(usage, 0, sizeof(struct rusage));
+    if (who == RUSAGE_CHILDREN) {
+        /* The CPU time of exited children is not kept. */
+        return 0;
+    }
+
+    /* All time is counted as user time, as the kernel doesn't split it. Without CPU time
+       accounting, report no time used rather than failing. */
+    uint64_t us = 0;
+    sys_cpu_time(who == RUSAGE_THREAD, &us);
+    usage->ru_utime.tv_sec = us / 1000000UL;
+    usage->ru_utime.tv_usec = us % 1000000UL;
+    return 0;
+}
@@ -144,6 +144,9 @@ typedef struct {
   int (*setmousefunc)(VTermMouseFunc func, void *data, void *user);
   int (*bell)(void *user);
   int (*resize)(int rows, int cols, void *user);
+  /* Optional. A run of single-width ASCII glyphs, all on pos.row starting at pos.col. If this is
+   * missing or returns 0, putglyph is called for each of them instead. */
+  int (*puttext)(const char bytes[], size_t len, int protected_cell, VTermPos pos, void *user);
 } VTermStateCallbacks;
 
 typedef struct {
@@ -180,6 +183,7 @@ void vterm_state_set_callbacks(VTermState *state, const VTermStateCallbacks *cal
 void vterm_state_get_cursorpos(VTermState *state, VTermPos *cursorpos);
 void vterm_state_set_default_colors(VTermState *state, VTermColor *default_fg, VTermColor *default_bg);
 void vterm_state_set_bold_highbright(VTermState *state, int bold_is_highbright);
+void vterm_state_set_text_fastpath(VTermState *state, int enabled);
 int  vterm_state_get_penattr(VTermState *state, VTermAttr attr, VTermValue *val);
 int  vterm_state_set_termprop(VTermState *state, VTermProp prop, VTermValue *val);
 
@@ -209,6 +209,17 @@ encodings[] = {
   { 0, 0 },
 };
 
+/* True if the instance, in its current state, would decode printable ASCII to the same
+ * codepoints one for one */
+int vterm_encoding_passes_ascii(const VTermEncodingInstance *inst)
+{
+  if(inst->enc == &encoding_usascii)
+    return 1;
+  if(inst->enc == &encoding_utf8)
+    return !((const struct UTF8DecoderData *)inst->data)->bytes_remaining;
+  return 0;
+}
+
 VTermEncoding *vterm_lookup_encoding(VTermEncodingType type, char designation)
 {
   for(int i = 0; encodings[i].designation; i++)
@@ -195,6 +195,38 @@ static int putglyph(VTermGlyphInfo *info, VTermPos pos, void *user)
   return 1;
 }
 
+static int puttext(const char bytes[], size_t len, int protected_cell, VTermPos pos, void *user)
+{
+  VTermScreen *screen = user;
+  ScreenCell *cell = getcell(screen, pos.row, pos.col);
+
+  if(!cell || pos.col + len > screen->cols)
+    return 0;
+
+  for(size_t i = 0; i < len; i++, cell++) {
+    cell->chars[0] = (unsigned char)bytes[i];
+    cell->chars[1] = 0;
+    cell->pen = screen->pen;
+    cell->pen.protected_cell = protected_cell;
+  }
+
+  VTermRect rect = {
+    .start_row = pos.row,
+    .end_row   = pos.row+1,
+    .start_col = pos.col,
+    .end_col   = pos.col+len,
+  };
+
+  if(screen->damage_merge == VTERM_DAMAGE_CELL && screen->callbacks && screen->callbacks->damage) {
+    for(rect.end_col = rect.start_col + 1; rect.start_col < pos.col + len; rect.start_col++, rect.end_col++)
+      damagerect(screen, rect);
+  }
+  else
+    damagerect(screen, rect);
+
+  return 1;
+}
+
 static int moverect_internal(VTermRect dest, VTermRect src, void *user)
 {
   VTermScreen *screen = user;
@@ -546,6 +578,7 @@ static VTermStateCallbacks state_cbs = {
   .setmousefunc = &setmousefunc,
   .bell         = &bell,
   .resize       = &resize,
+  .puttext      = &puttext,
 };
 
 static VTermScreen *screen_new(VTerm *vt)
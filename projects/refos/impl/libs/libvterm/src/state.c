@@ -146,12 +146,91 @@ static void tab(VTermState *state, int count, int direction)
     }
 }
 
+/* Fast path for runs of plain printable ASCII. Each byte is its own single-width glyph with
+ * nothing to combine, so whole row segments go to the puttext callback at once (or straight to
+ * putglyph if there isn't one), without decoding into codepoints first. Returns the number of
+ * bytes written, or 0 if the slow path must handle this text.
+ */
+static size_t on_text_ascii(VTermState *state, const char bytes[], size_t len)
+{
+  if(!state->text_fastpath || state->mode.insert ||
+     !vterm_encoding_passes_ascii(&state->encoding[state->gl_set]))
+    return 0;
+
+  /* The decoders give DEL a width of -1, so leave that to the slow path */
+  size_t eaten;
+  for(eaten = 0; eaten < len; eaten++) {
+    unsigned char c = bytes[eaten];
+    if(c < 0x20 || c >= 0x80)
+      break;
+    if(c == 0x7f)
+      return 0;
+  }
+
+  /* UTF-8 decoding would carry on into a following non-ASCII byte, which may start a combining
+   * char. The slow path needs to see that together with the glyph before it. */
+  if(eaten && eaten < len && (unsigned char)bytes[eaten] >= 0x80 &&
+     state->encoding[state->gl_set].enc == state->encoding_utf8.enc)
+    eaten--;
+  if(!eaten)
+    return 0;
+
+  for(size_t done = 0; done < eaten; ) {
+    if(state->at_phantom) {
+      linefeed(state);
+      state->pos.col = 0;
+      state->at_phantom = 0;
+    }
+
+    size_t n = eaten - done;
+    if(n > (size_t)(state->cols - state->pos.col))
+      n = state->cols - state->pos.col;
+
+    if(!state->callbacks || !state->callbacks->puttext ||
+       !(*state->callbacks->puttext)(bytes + done, n, state->protected_cell, state->pos, state->cbdata)) {
+      uint32_t chars[2] = { 0, 0 };
+      VTermPos pos = state->pos;
+      for(size_t i = 0; i < n; i++, pos.col++) {
+        chars[0] = (unsigned char)bytes[done + i];
+        putglyph(state, chars, 1, pos);
+      }
+    }
+    done += n;
+
+    if(done == eaten) {
+      /* Keep the last glyph in case the next call starts with combining chars */
+      state->combine_chars[0] = (unsigned char)bytes[done - 1];
+      state->combine_chars[1] = 0;
+      state->combine_width = 1;
+      state->combine_pos.row = state->pos.row;
+      state->combine_pos.col = state->pos.col + n - 1;
+    }
+
+    if(state->pos.col + n >= state->cols) {
+      state->pos.col = state->cols - 1;
+      if(state->mode.autowrap)
+        state->at_phantom = 1;
+    }
+    else {
+      state->pos.col += n;
+    }
+  }
+
+  return eaten;
+}
+
 static int on_text(const char bytes[], size_t len, void *user)
 {
   VTermState *state = user;
 
   VTermPos oldpos = state->pos;
 
+  size_t fast = on_text_ascii(state, bytes, len);
+  if(fast) {
+    updatecursor(state, &oldpos, 0);
+    return fast;
+  }
+
   // We'll have at most len codepoints
   uint32_t codepoints[len];
   int npoints = 0;
@@ -1434,6 +1513,8 @@ VTermState *vterm_obtain_state(VTerm *vt)
 
   state->tabstops = vterm_allocator_malloc(state->vt, (state->cols + 7) / 8);
 
+  state->text_fastpath = 1;
+
   state->encoding_utf8.enc = vterm_lookup_encoding(ENC_UTF8, 'u');
   if(*state->encoding_utf8.enc->init)
     (*state->encoding_utf8.enc->init)(state->encoding_utf8.enc, state->encoding_utf8.data);
@@ -1502,6 +1583,11 @@ void vterm_state_reset(VTermState *state, int hard)
   }
 }
 
+void vterm_state_set_text_fastpath(VTermState *state, int enabled)
+{
+  state->text_fastpath = enabled;
+}
+
 void vterm_state_get_cursorpos(VTermState *state, VTermPos *cursorpos)
 {
   *cursorpos = state->pos;
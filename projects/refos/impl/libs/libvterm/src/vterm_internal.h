@@ -92,6 +92,9 @@ struct VTermState
 
   int protected_cell;
 
+  /* Write runs of plain ASCII text without decoding them first */
+  int text_fastpath;
+
   /* Saved state under DEC mode 1048/1049 */
   struct {
     VTermPos pos;
@@ -181,6 +184,7 @@ void vterm_state_push_output_sprintf_CSI(VTermState *vts, const char *format, ..
 void vterm_screen_free(VTermScreen *screen);
 
 VTermEncoding *vterm_lookup_encoding(VTermEncodingType type, char designation);
+int vterm_encoding_passes_ascii(const VTermEncodingInstance *inst);
 
 int vterm_unicode_width(int codepoint);
 int vterm_unicode_is_combining(int codepoint);
@@ -66,7 +66,15 @@ struct sel4utils_res {
     int cacheable;
     int malloced;
     bool rights_deferred;
-    struct sel4utils_res *next;
+    /* AVL tree of reservations, ordered by start address. Each node also keeps the lowest start,
+     * highest end and largest gap between neighbouring reservations of its subtree, so that
+     * free ranges can be found without visiting every reservation */
+    struct sel4utils_res *left;
+    struct sel4utils_res *right;
+    int height;
+    uintptr_t subtree_start;
+    uintptr_t subtree_end;
+    uintptr_t max_gap;
 };
 
 typedef struct sel4utils_res sel4utils_res_t;
@@ -79,7 +87,7 @@ typedef struct sel4utils_alloc_data {
     uintptr_t last_allocated;
     vspace_t *bootstrap;
     sel4utils_map_page_fn map_page;
-    sel4utils_res_t *reservation_head;
+    sel4utils_res_t *reservation_tree;
     bool is_empty;
 } sel4utils_alloc_data_t;
 
@@ -353,3 +361,26 @@ void sel4utils_get_image_region(uintptr_t *va_start, uintptr_t *va_end);
  */
 uintptr_t sel4utils_get_paddr(vspace_t *vspace, void *vaddr, seL4_Word type, seL4_Word size_bits);
 
+
+/**
+ * Called by sel4utils_walk_mappings for each mapped page.
+ *
+ * @param arg the argument given to sel4utils_walk_mappings.
+ * @param vaddr the virtual address the page is mapped at.
+ * @param cap the cap the page was mapped with.
+ * @param cookie the cookie the page was mapped with, 0 if it was not allocated by the vspace.
+ * @param bytes the size of the page.
+ */
+typedef void (*sel4utils_mapping_fn)(void *arg, uintptr_t vaddr, seL4_CPtr cap, uintptr_t cookie,
+                                     size_t bytes);
+
+/**
+ * Visit every page mapped in a vspace, in address order. Only the book keeping tables that have
+ * been populated are visited, so this costs time in what is mapped rather than in the size of the
+ * address space. The callback must not change the vspace.
+ *
+ * @param vspace the vspace to walk.
+ * @param fn called once for each mapped page. Large pages are reported once, with their full size.
+ * @param arg passed to fn.
+ */
+void sel4utils_walk_mappings(vspace_t *vspace, sel4utils_mapping_fn fn, void *arg);
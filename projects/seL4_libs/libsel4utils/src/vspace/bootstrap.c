@@ -45,7 +45,7 @@ static int common_init(vspace_t *vspace, vka_t *vka, seL4_CPtr vspace_root,
     sel4utils_alloc_data_t *data = get_alloc_data(vspace);
     data->vka = vka;
     data->last_allocated = 0x10000000;
-    data->reservation_head = NULL;
+    data->reservation_tree = NULL;
     data->is_empty = false;
 
     data->vspace_root = vspace_root;
@@ -62,66 +62,187 @@ static int check_reservation(vspace_mid_level_t *top_level, sel4utils_res_t *res
            is_reserved_range(top_level, start, end);
 }
 
-static void insert_reservation(sel4utils_alloc_data_t *data, sel4utils_res_t *reservation)
+/* Reservations never overlap, so ordering them by start address orders them completely. The
+ * tree is an AVL tree, augmented with the largest gap between neighbouring reservations in each
+ * subtree */
+static int res_height(sel4utils_res_t *node)
 {
+    return node == NULL ? 0 : node->height;
+}
 
-    assert(data != NULL);
-    assert(reservation != NULL);
+/* recompute a node's height and subtree summary from its children */
+static void res_update(sel4utils_res_t *node)
+{
+    node->height = 1 + MAX(res_height(node->left), res_height(node->right));
+    node->subtree_start = node->start;
+    node->subtree_end = node->end;
+    node->max_gap = 0;
+    if (node->left != NULL) {
+        node->subtree_start = node->left->subtree_start;
+        node->max_gap = MAX(node->left->max_gap, node->start - node->left->subtree_end);
+    }
+    if (node->right != NULL) {
+        node->subtree_end = node->right->subtree_end;
+        node->max_gap = MAX(node->max_gap, node->right->max_gap);
+        node->max_gap = MAX(node->max_gap, node->right->subtree_start - node->end);
+    }
+}
 
-    reservation->next = NULL;
+static sel4utils_res_t *res_rotate_right(sel4utils_res_t *node)
+{
+    sel4utils_res_t *left = node->left;
+    node->left = left->right;
+    left->right = node;
+    res_update(node);
+    res_update(left);
+    return left;
+}
 
-    /* insert at head */
-    if (data->reservation_head == NULL || reservation->start > data->reservation_head->start) {
-        reservation->next = data->reservation_head;
-        data->reservation_head = reservation;
-        return;
+static sel4utils_res_t *res_rotate_left(sel4utils_res_t *node)
+{
+    sel4utils_res_t *right = node->right;
+    node->right = right->left;
+    right->left = node;
+    res_update(node);
+    res_update(right);
+    return right;
+}
+
+/* update a node whose children may have changed, and rotate it back into balance */
+static sel4utils_res_t *res_balance(sel4utils_res_t *node)
+{
+    res_update(node);
+    int balance = res_height(node->left) - res_height(node->right);
+    if (balance > 1) {
+        if (res_height(node->left->left) < res_height(node->left->right)) {
+            node->left = res_rotate_left(node->left);
+        }
+        return res_rotate_right(node);
     }
+    if (balance < -1) {
+        if (res_height(node->right->right) < res_height(node->right->left)) {
+            node->right = res_rotate_right(node->right);
+        }
+        return res_rotate_left(node);
+    }
+    return node;
+}
 
-    /* insert elsewhere */
-    sel4utils_res_t *prev = data->reservation_head;
-    sel4utils_res_t *current = prev->next;
+static sel4utils_res_t *res_insert(sel4utils_res_t *node, sel4utils_res_t *reservation)
+{
+    if (node == NULL) {
+        reservation->left = NULL;
+        reservation->right = NULL;
+        res_update(reservation);
+        return reservation;
+    }
+    if (reservation->start < node->start) {
+        node->left = res_insert(node->left, reservation);
+    } else {
+        node->right = res_insert(node->right, reservation);
+    }
+    return res_balance(node);
+}
 
-    while (current != NULL) {
-        /* insert in the middle */
-        if (reservation->start > current->start) {
-            reservation->next = current;
-            prev->next = reservation;
-            return;
+static sel4utils_res_t *res_remove_min(sel4utils_res_t *node, sel4utils_res_t **min)
+{
+    if (node->left == NULL) {
+        *min = node;
+        return node->right;
+    }
+    node->left = res_remove_min(node->left, min);
+    return res_balance(node);
+}
+
+static sel4utils_res_t *res_remove(sel4utils_res_t *node, sel4utils_res_t *reservation)
+{
+    assert(node != NULL);
+    if (reservation->start < node->start) {
+        node->left = res_remove(node->left, reservation);
+    } else if (reservation->start > node->start) {
+        node->right = res_remove(node->right, reservation);
+    } else {
+        assert(node == reservation);
+        if (node->right == NULL) {
+            return node->left;
         }
-        prev = current;
-        current = current->next;
+        sel4utils_res_t *successor;
+        sel4utils_res_t *right = res_remove_min(node->right, &successor);
+        successor->left = node->left;
+        successor->right = right;
+        node = successor;
     }
+    return res_balance(node);
+}
 
-    /* insert at the end */
-    prev->next = reservation;
+static void insert_reservation(sel4utils_alloc_data_t *data, sel4utils_res_t *reservation)
+{
+    assert(data != NULL);
+    assert(reservation != NULL);
+
+    data->reservation_tree = res_insert(data->reservation_tree, reservation);
 }
 
 static void remove_reservation(sel4utils_alloc_data_t *data, sel4utils_res_t *reservation)
 {
-    /* remove head */
-    if (reservation == data->reservation_head) {
-        data->reservation_head = data->reservation_head->next;
-        reservation->next = NULL;
-        return;
-    }
+    assert(data != NULL);
+    assert(reservation != NULL);
 
-    sel4utils_res_t *prev = data->reservation_head;
-    sel4utils_res_t *current = prev->next;
+    /* the tree is searched and summarised by start and end address, so this must happen before
+     * either changes */
+    data->reservation_tree = res_remove(data->reservation_tree, reservation);
+    reservation->left = NULL;
+    reservation->right = NULL;
+}
 
-    while (current != NULL) {
-        /* remove middle */
-        if (current == reservation) {
-            prev->next = reservation->next;
-            reservation->next = NULL;
-            return;
-        }
-        prev = current;
-        current = current->next;
+/* does [*vaddr, *vaddr + bytes), aligned and at or above from, fit in the gap [gap_start, gap_end) */
+static bool gap_fits(uintptr_t gap_start, uintptr_t gap_end, uintptr_t from, size_t bytes,
+                     size_t align, uintptr_t *vaddr)
+{
+    uintptr_t start = ALIGN_UP(MAX(gap_start, from), align);
+    if (start < gap_start || start >= gap_end || gap_end - start < bytes) {
+        return false;
+    }
+    *vaddr = start;
+    return true;
+}
+
+/* first fit over the gaps before each reservation of a subtree, in address order. prev_end is
+ * the end of the reservation before the subtree, and is moved to the end of the subtree when
+ * nothing fits. Subtrees which end before from, or whose gaps are all too small, are skipped
+ * whole */
+static bool res_first_fit(sel4utils_res_t *node, uintptr_t *prev_end, uintptr_t from, size_t bytes,
+                          size_t align, uintptr_t *vaddr)
+{
+    if (node == NULL) {
+        return false;
+    }
+    if (node->subtree_end <= from ||
+            MAX(node->max_gap, node->subtree_start - *prev_end) < bytes) {
+        *prev_end = node->subtree_end;
+        return false;
+    }
+    if (res_first_fit(node->left, prev_end, from, bytes, align, vaddr)) {
+        return true;
     }
+    if (gap_fits(*prev_end, node->start, from, bytes, align, vaddr)) {
+        return true;
+    }
+    *prev_end = node->end;
+    return res_first_fit(node->right, prev_end, from, bytes, align, vaddr);
+}
 
-    /* remove tail */
-    prev->next = NULL;
-    reservation->next = NULL;
+/* find the lowest aligned range of bytes at or above from that overlaps no reservation */
+static bool find_free_gap(sel4utils_alloc_data_t *data, uintptr_t from, size_t bytes, size_t align,
+                          uintptr_t *vaddr)
+{
+    uintptr_t prev_end = 0;
+    if (!res_first_fit(data->reservation_tree, &prev_end, from, bytes, align, vaddr) &&
+            !gap_fits(prev_end, KERNEL_RESERVED_START, from, bytes, align, vaddr)) {
+        return false;
+    }
+    /* the gap found may be between reservations above the kernel */
+    return *vaddr < KERNEL_RESERVED_START && KERNEL_RESERVED_START - *vaddr >= bytes;
 }
 
 static void perform_reservation(vspace_t *vspace, sel4utils_res_t *reservation, uintptr_t vaddr, size_t bytes,
@@ -235,15 +356,16 @@ static int map_page(vspace_t *vspace, seL4_CPtr cap, void *vaddr, seL4_CapRights
 
 static sel4utils_res_t *find_reserve(sel4utils_alloc_data_t *data, uintptr_t vaddr)
 {
-
-    sel4utils_res_t *current = data->reservation_head;
+    sel4utils_res_t *current = data->reservation_tree;
 
     while (current != NULL) {
-        if (vaddr >= current->start && vaddr < current->end) {
+        if (vaddr < current->start) {
+            current = current->left;
+        } else if (vaddr >= current->end) {
+            current = current->right;
+        } else {
             return current;
         }
-
-        current = current->next;
     }
 
     return NULL;
@@ -254,35 +376,30 @@ static void *find_range(sel4utils_alloc_data_t *data, size_t num_pages, size_t s
     /* look for a contiguous range that is free.
      * We use first-fit with the optimisation that we store
      * a pointer to the last thing we freed/allocated */
-    size_t contiguous = 0;
-    uintptr_t start = ALIGN_UP(data->last_allocated, SIZE_BITS_TO_BYTES(size_bits));
-    uintptr_t current = start;
-
-    assert(IS_ALIGNED(start, size_bits));
-    while (contiguous < num_pages) {
-
-        bool available = is_available(data->top_level, current, size_bits);
-        current += SIZE_BITS_TO_BYTES(size_bits);
-
-        if (available) {
-            /* keep going! */
-            contiguous++;
-        } else {
-            /* reset start and try again */
-            start = current;
-            contiguous = 0;
+    size_t page_size = SIZE_BITS_TO_BYTES(size_bits);
+    size_t bytes = num_pages * page_size;
+    uintptr_t from = ALIGN_UP(data->last_allocated, page_size);
+    uintptr_t start;
+
+    assert(IS_ALIGNED(from, size_bits));
+    while (find_free_gap(data, from, bytes, page_size, &start)) {
+        /* pages can be mapped without a reservation, so check the gap in the page tables too */
+        uintptr_t current = start;
+        while (current < start + bytes && is_available(data->top_level, current, size_bits)) {
+            current += page_size;
         }
 
-        if (current >= KERNEL_RESERVED_START) {
-            ZF_LOGE("Out of virtual memory");
-            return NULL;
+        if (current == start + bytes) {
+            data->last_allocated = current;
+            return (void *) start;
         }
 
+        /* try again after the page that is in the way */
+        from = current + page_size;
     }
 
-    data->last_allocated = current;
-
-    return (void *) start;
+    ZF_LOGE("Out of virtual memory");
+    return NULL;
 }
 
 static int map_pages_at_vaddr(vspace_t *vspace, seL4_CPtr caps[], uintptr_t cookies[],
@@ -704,17 +821,18 @@ int sel4utils_move_resize_reservation(vspace_t *vspace, reservation_t reservatio
         }
     }
 
+    /* The tree is keyed by the start and summarises the end, so the reservation has to come out
+     * of the tree while either changes. */
     bool need_reinsert = false;
-    if (res->start != new_start) {
+    if (res->start != new_start || res->end != new_end) {
         need_reinsert = true;
+        remove_reservation(data, res);
     }
 
     res->start = new_start;
     res->end = new_end;
 
-    /* We may need to re-insert the reservation into the list to keep it sorted by start address. */
     if (need_reinsert) {
-        remove_reservation(data, res);
         insert_reservation(data, res);
     }
 
@@ -727,67 +845,113 @@ seL4_CPtr sel4utils_get_root(vspace_t *vspace)
     return data->vspace_root;
 }
 
-static void free_page(vspace_t *vspace, vka_t *vka, uintptr_t vaddr)
+/* state for a walk over the mapped pages of a vspace. Consecutive entries holding the same cap
+ * are one (large) page, and are reported together */
+typedef struct mapping_walk {
+    sel4utils_mapping_fn fn;
+    void *arg;
+    uintptr_t vaddr;
+    seL4_CPtr cap;
+    uintptr_t cookie;
+    size_t bytes;
+} mapping_walk_t;
+
+static void walk_flush(mapping_walk_t *walk)
 {
-    sel4utils_alloc_data_t *data = get_alloc_data(vspace);
-    vspace_mid_level_t *level = data->top_level;
-    /* see if we should free the thing here or not */
-    uintptr_t cookie = get_cookie(level, vaddr);
-    int num_4k_entries = 1;
-    if (cookie != 0) {
-        /* walk along and see just how big this page is */
-        uintptr_t test_vaddr = vaddr + PAGE_SIZE_4K;
-        while (get_cookie(level, test_vaddr) == cookie) {
-            test_vaddr += PAGE_SIZE_4K;
-            num_4k_entries++;
-        }
-        sel4utils_unmap_pages(vspace, (void *)vaddr, 1, PAGE_BITS_4K * num_4k_entries, vka);
+    if (walk->bytes != 0) {
+        walk->fn(walk->arg, walk->vaddr, walk->cap, walk->cookie, walk->bytes);
+        walk->bytes = 0;
     }
 }
 
-static void free_pages_at_level(vspace_t *vspace, vka_t *vka, int table_level, uintptr_t vaddr)
+static void walk_entry(mapping_walk_t *walk, uintptr_t vaddr, seL4_CPtr cap, uintptr_t cookie)
 {
-    sel4utils_alloc_data_t *data = get_alloc_data(vspace);
-    vspace_mid_level_t *level = data->top_level;
-    /* walk down to the level that we want */
-    for (int i = VSPACE_NUM_LEVELS - 1; i > table_level && i > 1; i--) {
-        int index = INDEX_FOR_LEVEL(vaddr, i);
-        switch (level->table[index]) {
-        case RESERVED:
-        case EMPTY:
-            return;
-        }
-        level = (vspace_mid_level_t *)level->table[index];
-    }
-    if (table_level == 0) {
-        int index = INDEX_FOR_LEVEL(vaddr, 1);
-        switch (level->table[index]) {
-        case RESERVED:
-        case EMPTY:
-            return;
+    if (walk->bytes != 0 && cap == walk->cap && vaddr == walk->vaddr + walk->bytes) {
+        walk->bytes += BYTES_FOR_LEVEL(0);
+        return;
+    }
+    walk_flush(walk);
+    walk->vaddr = vaddr;
+    walk->cap = cap;
+    walk->cookie = cookie;
+    walk->bytes = BYTES_FOR_LEVEL(0);
+}
+
+/* walk a table and any tables below it, skipping entries that are empty or only reserved */
+static void walk_level(mapping_walk_t *walk, uintptr_t table, int level_num, uintptr_t vaddr)
+{
+    if (level_num == 0) {
+        vspace_bottom_level_t *bottom = (vspace_bottom_level_t *)table;
+        for (int i = 0; i < VSPACE_LEVEL_SIZE; i++) {
+            seL4_CPtr cap = bottom->cap[i];
+            if (cap != EMPTY && cap != RESERVED) {
+                walk_entry(walk, vaddr + i * BYTES_FOR_LEVEL(0), cap, bottom->cookie[i]);
+            }
         }
-        vspace_bottom_level_t *bottom = (vspace_bottom_level_t *)level->table[index];
-        index = INDEX_FOR_LEVEL(vaddr, 0);
-        if (bottom->cap[index] != EMPTY && bottom->cap[index] != RESERVED) {
-            free_page(vspace, vka, vaddr);
+        return;
+    }
+
+    vspace_mid_level_t *level = (vspace_mid_level_t *)table;
+    for (int i = 0; i < VSPACE_LEVEL_SIZE; i++) {
+        uintptr_t next_table = level->table[i];
+        if (next_table != EMPTY && next_table != RESERVED) {
+            walk_level(walk, next_table, level_num - 1, vaddr + i * BYTES_FOR_LEVEL(level_num));
         }
-    } else {
-        int index = INDEX_FOR_LEVEL(vaddr, table_level);
-        switch (level->table[index]) {
-        case RESERVED:
-        case EMPTY:
-            return;
+    }
+}
+
+void sel4utils_walk_mappings(vspace_t *vspace, sel4utils_mapping_fn fn, void *arg)
+{
+    sel4utils_alloc_data_t *data = get_alloc_data(vspace);
+    mapping_walk_t walk = { .fn = fn, .arg = arg, .bytes = 0 };
+
+    if (data->top_level == NULL) {
+        return;
+    }
+    walk_level(&walk, (uintptr_t) data->top_level, VSPACE_NUM_LEVELS - 1, 0);
+    walk_flush(&walk);
+}
+
+/* free a page that this vspace allocated itself. Pages without a cookie were mapped in by the
+ * user of the vspace, who is responsible for them */
+static void free_mapping(void *arg, uintptr_t vaddr, seL4_CPtr cap, uintptr_t cookie, size_t bytes)
+{
+    vka_t *vka = arg;
+    if (cookie == 0) {
+        return;
+    }
+    if (vka == VSPACE_PRESERVE) {
+        int error = seL4_ARCH_Page_Unmap(cap);
+        if (error != seL4_NoError) {
+            ZF_LOGE("Failed to unmap page at vaddr %p", (void *) vaddr);
         }
-        /* recurse to the sub level */
-        for (int j = 0; j < VSPACE_LEVEL_SIZE; j++) {
-            free_pages_at_level(vspace, vka,
-                                table_level - 1,
-                                vaddr + j * BYTES_FOR_LEVEL(table_level - 1));
+        return;
+    }
+
+    /* deleting the cap removes its mapping as well, so there is no need to unmap first */
+    cspacepath_t path;
+    vka_cspace_make_path(vka, cap, &path);
+    vka_cnode_delete(&path);
+    vka_cspace_free(vka, cap);
+    size_t size_bits = BYTES_TO_SIZE_BITS(bytes);
+    vka_utspace_free(vka, kobject_get_type(KOBJECT_FRAME, size_bits), size_bits, cookie);
+}
+
+/* free a book keeping table and the populated tables below it */
+static void free_level(vspace_t *bootstrap, uintptr_t table, int level_num)
+{
+    size_t size = sizeof(vspace_bottom_level_t);
+    if (level_num > 0) {
+        vspace_mid_level_t *level = (vspace_mid_level_t *)table;
+        for (int i = 0; i < VSPACE_LEVEL_SIZE; i++) {
+            uintptr_t next_table = level->table[i];
+            if (next_table != EMPTY && next_table != RESERVED) {
+                free_level(bootstrap, next_table, level_num - 1);
+            }
         }
-        vspace_unmap_pages(data->bootstrap, (void *)level->table[index],
-                           (table_level == 1 ? sizeof(vspace_bottom_level_t) : sizeof(vspace_mid_level_t)) / PAGE_SIZE_4K, PAGE_BITS_4K,
-                           VSPACE_FREE);
+        size = sizeof(vspace_mid_level_t);
     }
+    vspace_unmap_pages(bootstrap, (void *)table, size / PAGE_SIZE_4K, PAGE_BITS_4K, VSPACE_FREE);
 }
 
 void sel4utils_tear_down(vspace_t *vspace, vka_t *vka)
@@ -804,19 +968,23 @@ void sel4utils_tear_down(vspace_t *vspace, vka_t *vka)
         vka = data->vka;
     }
 
-    /* free all the reservations */
-    while (data->reservation_head != NULL) {
-        reservation_t res = { .res = data->reservation_head };
-        sel4utils_free_reservation(vspace, res);
+    /* free all the reservations. Their entries go away with the book keeping below, so they are
+     * not cleared page by page */
+    while (data->reservation_tree != NULL) {
+        sel4utils_res_t *res = data->reservation_tree;
+        remove_reservation(data, res);
+        if (res->malloced) {
+            free(res);
+        }
     }
 
-    /* walk each level and find any pages / large pages */
+    /* free any pages / large pages we allocated, then the book keeping itself. Both only visit
+     * tables that were populated, so this scales with what was mapped rather than with the size of
+     * the address space */
     if (data->top_level) {
-        for (int i = 0; i < BIT(VSPACE_LEVEL_BITS); i++) {
-            free_pages_at_level(vspace, vka, VSPACE_NUM_LEVELS - 1, BYTES_FOR_LEVEL(VSPACE_NUM_LEVELS - 1) * i);
-        }
-        vspace_unmap_pages(data->bootstrap, data->top_level, sizeof(vspace_mid_level_t) / PAGE_SIZE_4K, PAGE_BITS_4K,
-                           VSPACE_FREE);
+        sel4utils_walk_mappings(vspace, free_mapping, vka);
+        free_level(data->bootstrap, (uintptr_t) data->top_level, VSPACE_NUM_LEVELS - 1);
+        data->top_level = NULL;
     }
 }
 
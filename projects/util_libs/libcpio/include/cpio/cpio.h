@@ -44,6 +44,35 @@ struct cpio_info {
     unsigned int max_path_sz;
 };
 
+/**
+ * A single file in a CPIO name index.
+ */
+struct cpio_index_entry {
+    /// The NULL terminated file name inside the archive; NULL for an empty slot
+    const char *name;
+    /// Hash of the file name
+    unsigned long hash;
+    /// The location of the file in memory
+    void *data;
+    /// The size of the file
+    unsigned long size;
+    /// The file mode bits as stored in the CPIO header
+    unsigned long mode;
+};
+
+/**
+ * A hash table from file name to file location, built once from an archive so
+ * that later lookups do not have to walk every header.
+ */
+struct cpio_index {
+    /// Open addressed table of entries, provided by the caller
+    struct cpio_index_entry *table;
+    /// Number of slots in the table; always a power of two
+    unsigned long table_size;
+    /// The number of files stored in the index
+    unsigned int file_count;
+};
+
 /**
  * Retrieve file information from a provided CPIO list index
  * @param[in] archive  The location of the CPIO archive
@@ -84,3 +113,45 @@ int cpio_info(void *archive, unsigned long len, struct cpio_info *info);
  */
 void cpio_ls(void *archive, unsigned long len, char **buf, unsigned long buf_len);
 
+/**
+ * Calculate the number of table slots needed to index an archive
+ * @param[in] file_count  The number of files in the archive, as reported by
+ *                        cpio_info
+ * @return                The number of struct cpio_index_entry slots that
+ *                        should be passed to cpio_index_build
+ */
+unsigned long cpio_index_table_size(unsigned int file_count);
+
+/**
+ * Parse a CPIO archive once and build a name index over its files
+ * @param[in] archive     The location of the CPIO archive
+ * @param[in] len         The length of the CPIO archive
+ * @param[out] index      The index structure to initialise
+ * @param[in] table       Storage for the hash table, which must outlive the
+ *                        index
+ * @param[in] table_size  The number of slots in table; must be a power of two
+ *                        larger than the number of files in the archive
+ * @return                Non-zero on error.
+ */
+int cpio_index_build(void *archive, unsigned long len, struct cpio_index *index,
+                     struct cpio_index_entry *table, unsigned long table_size);
+
+/**
+ * Look up a file in a CPIO name index
+ * @param[in] index  An index built by cpio_index_build
+ * @param[in] name   The name of the file in question
+ * @return           The index entry of the file; NULL if the file does not
+ *                   exist.
+ */
+const struct cpio_index_entry *cpio_index_lookup(const struct cpio_index *index, const char *name);
+
+/**
+ * Retrieve file information from a provided file name using a name index.
+ * Behaves the same as cpio_get_file on the archive the index was built from.
+ * @param[in] index  An index built by cpio_index_build
+ * @param[in] name   The name of the file in question.
+ * @param[out] size  The retrieved size of the file in question
+ * @return           The location of the file in memory; NULL if the file
+ *                   does not exist.
+ */
+void *cpio_index_get_file(const struct cpio_index *index, const char *name, unsigned long *size);
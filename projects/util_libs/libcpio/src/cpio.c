@@ -19,6 +19,7 @@
 struct cpio_header_info {
     const char *filename;
     unsigned long filesize;
+    unsigned long mode;
     void *data;
     struct cpio_header *next;
 };
@@ -153,6 +154,7 @@ int cpio_parse_header(struct cpio_header *archive, unsigned long len,
     if (info) {
         info->filename = filename;
         info->filesize = filesize;
+        info->mode = parse_hex_str(archive->c_mode, sizeof(archive->c_mode));
         info->data = data;
         info->next = next;
     }
@@ -270,3 +272,125 @@ void cpio_ls(void *archive, unsigned long len, char **buf, unsigned long buf_len
         header = header_info.next;
     }
 }
+
+/* FNV-1a hash of a NUL terminated file name. */
+static unsigned long cpio_hash_name(const char *name)
+{
+    unsigned long h = 2166136261ul;
+    while (*name) {
+        h ^= (unsigned char) *name++;
+        h *= 16777619ul;
+    }
+    return h;
+}
+
+unsigned long cpio_index_table_size(unsigned int file_count)
+{
+    /* Keep the load factor at or below one half so probe chains stay short. */
+    unsigned long size = 1;
+    while (size < 2 * (unsigned long) file_count + 1) {
+        size <<= 1;
+    }
+    return size;
+}
+
+/*
+ * Walk the archive once and insert every file into an open addressed hash
+ * table. If the archive holds a name more than once only the first copy is
+ * kept, matching the linear search in cpio_get_file.
+ *
+ * Runs in O(n) time.
+ */
+int cpio_index_build(void *archive, unsigned long len, struct cpio_index *index,
+                     struct cpio_index_entry *table, unsigned long table_size)
+{
+    struct cpio_header *header = archive;
+    struct cpio_header_info header_info;
+
+    if (index == NULL || table == NULL || table_size == 0 ||
+            (table_size & (table_size - 1)) != 0) {
+        return -1;
+    }
+
+    for (unsigned long i = 0; i < table_size; i++) {
+        table[i].name = NULL;
+    }
+    index->table = table;
+    index->table_size = table_size;
+    index->file_count = 0;
+
+    while (1) {
+        int error = cpio_parse_header(header, len, &header_info);
+        if (error == -1) {
+            return error;
+        } else if (error == 1) {
+            /* EOF */
+            return 0;
+        }
+
+        unsigned long hash = cpio_hash_name(header_info.filename);
+        unsigned long slot = hash & (table_size - 1);
+        while (table[slot].name != NULL) {
+            if (table[slot].hash == hash &&
+                    cpio_strncmp(table[slot].name, header_info.filename, -1) == 0) {
+                break;
+            }
+            slot = (slot + 1) & (table_size - 1);
+        }
+
+        if (table[slot].name == NULL) {
+            /* Always leave one slot empty so lookups of missing names terminate. */
+            if (index->file_count + 1 >= table_size) {
+                return -1;
+            }
+            table[slot].name = header_info.filename;
+            table[slot].hash = hash;
+            table[slot].data = header_info.data;
+            table[slot].size = header_info.filesize;
+            table[slot].mode = header_info.mode;
+            index->file_count++;
+        }
+
+        len = cpio_len_next(len, header, header_info.next);
+        header = header_info.next;
+    }
+
+    return 0;
+}
+
+/*
+ * Find the index entry for the file named "name".
+ *
+ * Return NULL if the entry doesn't exist.
+ *
+ * Runs in O(1) expected time.
+ */
+const struct cpio_index_entry *cpio_index_lookup(const struct cpio_index *index, const char *name)
+{
+    if (index == NULL || index->table == NULL || name == NULL) {
+        return NULL;
+    }
+
+    unsigned long hash = cpio_hash_name(name);
+    unsigned long slot = hash & (index->table_size - 1);
+    while (index->table[slot].name != NULL) {
+        if (index->table[slot].hash == hash &&
+                cpio_strncmp(index->table[slot].name, name, -1) == 0) {
+            return &index->table[slot];
+        }
+        slot = (slot + 1) & (index->table_size - 1);
+    }
+    return NULL;
+}
+
+void *cpio_index_get_file(const struct cpio_index *index, const char *name, unsigned long *size)
+{
+    const struct cpio_index_entry *entry = cpio_index_lookup(index, name);
+    if (entry == NULL) {
+        return NULL;
+    }
+    if (size) {
+        *size = entry->size;
+    }
+    return entry->data;
+}
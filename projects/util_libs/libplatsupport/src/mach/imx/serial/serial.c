@@ -29,6 +29,7 @@
 /* CR1 */
 #define UART_CR1_UARTEN        BIT( 0)
 #define UART_CR1_RRDYEN        BIT( 9)
+#define UART_CR1_TRDYEN        BIT(13)
 /* CR2 */
 #define UART_CR2_SRST          BIT( 0)
 #define UART_CR2_RXEN          BIT( 1)
@@ -57,6 +58,8 @@
 #define UART_SR2_TXFIFO_EMPTY  BIT(14)
 /* RXD */
 #define UART_URXD_READY_MASK   BIT(15)
+/* UTS */
+#define UART_UTS_TXFULL        BIT( 4)
 #define UART_BYTE_MASK         0xFF
 
 struct imx_uart_regs {
@@ -149,9 +152,92 @@ int uart_putchar(
     return c;
 }
 
-static void uart_handle_irq(ps_chardevice_t *d UNUSED)
+/* Fill the TX FIFO from data until it is full. Returns the number of bytes of data consumed. */
+static int uart_fill_fifo(
+    ps_chardevice_t *d,
+    const char *data,
+    size_t len)
+{
+    imx_uart_regs_t *regs = imx_uart_get_priv(d);
+    int i;
+    for (i = 0; i < len; i++) {
+        if (regs->ts & UART_UTS_TXFULL) {
+            break;
+        }
+        if (data[i] == '\n' && (d->flags & SERIAL_AUTO_CR)) {
+            regs->txd = '\r';
+            /* As in uart_putchar(), CR+LF is an atom. Worst case we spin for one byte time. */
+            while (regs->ts & UART_UTS_TXFULL) {
+                /* busy loop */
+            }
+        }
+        regs->txd = data[i];
+    }
+    return i;
+}
+
+static void uart_handle_tx_irq(
+    ps_chardevice_t *d)
+{
+    imx_uart_regs_t *regs = imx_uart_get_priv(d);
+    struct chardev_xmit_descriptor *wd = &d->write_descriptor;
+    size_t to_send = wd->bytes_requested - wd->bytes_transfered;
+    int sent = uart_fill_fifo(d, wd->data, to_send);
+    wd->bytes_transfered += sent;
+    wd->data += sent;
+
+    if (wd->bytes_transfered == wd->bytes_requested) {
+        /* Transaction complete. Stop TX ready interrupts and signal completion. */
+        regs->cr1 &= ~UART_CR1_TRDYEN;
+        wd->data = NULL;
+        wd->callback(d, CHARDEV_STAT_COMPLETE, wd->bytes_transfered, wd->token);
+    }
+}
+
+static ssize_t imx_uart_write(
+    ps_chardevice_t *d,
+    const void *vdata,
+    size_t count,
+    chardev_callback_t wcb,
+    void *token)
 {
-    /* TODO */
+    imx_uart_regs_t *regs = imx_uart_get_priv(d);
+    const char *data = (const char *)vdata;
+
+    /* Make what progress we can on any transaction in flight, so polled writers which spin on
+     * this function cannot starve it while IRQs are not being handled. */
+    if (d->write_descriptor.data) {
+        uart_handle_tx_irq(d);
+    }
+    if (d->write_descriptor.data) {
+        /* Transaction is already in progress */
+        return -1;
+    }
+
+    if (!wcb) {
+        return uart_write(d, vdata, count, NULL, NULL);
+    }
+
+    int sent = uart_fill_fifo(d, data, count);
+    d->write_descriptor.callback = wcb;
+    d->write_descriptor.token = token;
+    d->write_descriptor.bytes_transfered = sent;
+    d->write_descriptor.bytes_requested = count;
+    d->write_descriptor.data = (void *)data + sent;
+
+    /* TRDY is raised while the TX FIFO is below its trigger level, so completion (and any
+     * remaining data) is always handled from the IRQ. */
+    regs->cr1 |= UART_CR1_TRDYEN;
+    return sent;
+}
+
+static void uart_handle_irq(
+    ps_chardevice_t *d)
+{
+    /* RX is drained through getchar. TRDY clears itself once the FIFO is refilled. */
+    if (d->write_descriptor.data) {
+        uart_handle_tx_irq(d);
+    }
 }
 
 /*
@@ -238,7 +324,7 @@ int uart_init(
     dev->id         = defn->id;
     dev->vaddr      = (void *)vaddr;
     dev->read       = &uart_read;
-    dev->write      = &uart_write;
+    dev->write      = &imx_uart_write;
     dev->handle_irq = &uart_handle_irq;
     dev->irqs       = defn->irqs;
     dev->ioops      = *ops;
@@ -263,6 +349,7 @@ int uart_init(
     regs->fcr &= ~UART_FCR_RXTL_MASK;            /* Clear the rx trigger level value. */
     regs->fcr |= UART_FCR_RXTL(1);               /* Set the rx tigger level to 1.     */
     regs->cr1 |= UART_CR1_RRDYEN;                /* Enable recv interrupt.            */
+    regs->cr1 &= ~UART_CR1_TRDYEN;               /* TX ready only while writing.      */
 
 
 #ifdef CONFIG_PLAT_IMX6
@@ -40,6 +40,14 @@
 #define SERIAL_DLAB BIT(7)
 #define SERIAL_LSR_DATA_READY BIT(0)
 #define SERIAL_LSR_TRANSMITTER_EMPTY BIT(5)
+#define SERIAL_IER_RX BIT(0)
+#define SERIAL_IER_TX BIT(1)
+#define SERIAL_IIR_FIFO_ENABLED (BIT(6) | BIT(7))
+/* Enable and clear both FIFOs, RX trigger level of 1 byte. */
+#define SERIAL_FCR_ENABLE_FIFO 0x07
+#define SERIAL_FIFO_SIZE 16
+/* Device specific flag: the UART is a 16550A or later, with a working TX FIFO. */
+#define SERIAL_FLAG_FIFO BIT(8)
 
 int uart_getchar(ps_chardevice_t *device)
 {
@@ -97,9 +105,101 @@ int uart_putchar(ps_chardevice_t* device, int c)
     return c;
 }
 
-static void uart_handle_irq(ps_chardevice_t* device UNUSED)
+static void uart_set_ier(ps_chardevice_t* device, uint32_t ier)
 {
-    /* No IRQ handling required here. */
+    uint32_t io_port = (uint32_t) (uintptr_t)device->vaddr;
+    ps_io_port_out(&device->ioops.io_port_ops, CONSOLE(io_port, IER), 1, ier);
+}
+
+/* Fill the TX FIFO from data, chasing each '\n' with a '\r'. Only writes anything when the FIFO
+ * is completely empty, as THRE is the only fill level a 16550 reports. Returns the number of bytes
+ * of data consumed. */
+static int uart_fill_fifo(ps_chardevice_t* device, const char* data, size_t len)
+{
+    uint32_t io_port = (uint32_t) (uintptr_t)device->vaddr;
+    int room = (device->flags & SERIAL_FLAG_FIFO) ? SERIAL_FIFO_SIZE : 1;
+    int i;
+
+    if (!serial_ready(device)) {
+        return 0;
+    }
+    for (i = 0; i < len; i++) {
+        int needed = (data[i] == '\n') ? 2 : 1;
+        if (needed > room) {
+            if (room == 1 && i == 0) {
+                /* No FIFO: spin for the '\r', as uart_putchar() does. */
+                uart_putchar(device, data[i]);
+                i++;
+            }
+            break;
+        }
+        ps_io_port_out(&device->ioops.io_port_ops, CONSOLE(io_port, THR), 1, data[i]);
+        if (data[i] == '\n') {
+            ps_io_port_out(&device->ioops.io_port_ops, CONSOLE(io_port, THR), 1, '\r');
+        }
+        room -= needed;
+    }
+    return i;
+}
+
+static void uart_handle_tx_irq(ps_chardevice_t* device)
+{
+    struct chardev_xmit_descriptor* wd = &device->write_descriptor;
+    size_t to_send = wd->bytes_requested - wd->bytes_transfered;
+    int sent = uart_fill_fifo(device, wd->data, to_send);
+    wd->bytes_transfered += sent;
+    wd->data += sent;
+
+    if (wd->bytes_transfered == wd->bytes_requested) {
+        /* Transaction complete. Stop THRE interrupts and signal completion. */
+        uart_set_ier(device, SERIAL_IER_RX);
+        wd->data = NULL;
+        wd->callback(device, CHARDEV_STAT_COMPLETE, wd->bytes_transfered, wd->token);
+    }
+}
+
+static ssize_t uart_write_fifo(ps_chardevice_t* device, const void* vdata, size_t count,
+                               chardev_callback_t wcb, void* token)
+{
+    const char* data = (const char*) vdata;
+
+    /* Make what progress we can on any transaction in flight, so polled writers which spin on
+     * this function (ps_cdev_putchar) cannot starve it while IRQs are not being handled. */
+    if (device->write_descriptor.data) {
+        uart_handle_tx_irq(device);
+    }
+    if (device->write_descriptor.data) {
+        /* Transaction is already in progress. */
+        return -1;
+    }
+
+    if (!wcb) {
+        return uart_write(device, vdata, count, NULL, NULL);
+    }
+
+    int sent = uart_fill_fifo(device, data, count);
+    device->write_descriptor.callback = wcb;
+    device->write_descriptor.token = token;
+    device->write_descriptor.bytes_transfered = sent;
+    device->write_descriptor.bytes_requested = count;
+    device->write_descriptor.data = (void*) data + sent;
+
+    /* THRE fires as soon as it is enabled if the FIFO is already empty, so completion (and any
+     * remaining data) is always handled from the IRQ. */
+    uart_set_ier(device, SERIAL_IER_RX | SERIAL_IER_TX);
+    return sent;
+}
+
+static void uart_handle_irq(ps_chardevice_t* device)
+{
+    uint32_t io_port = (uint32_t) (uintptr_t)device->vaddr;
+    uint32_t iir;
+
+    /* Reading IIR acknowledges a pending THRE interrupt. RX is drained through getchar. */
+    ps_io_port_in(&device->ioops.io_port_ops, CONSOLE(io_port, IIR), 1, &iir);
+    if (device->write_descriptor.data) {
+        uart_handle_tx_irq(device);
+    }
 }
 
 int
@@ -110,7 +210,7 @@ uart_init(const struct dev_defn* defn, const ps_io_ops_t* ops, ps_chardevice_t*
     dev->id         = defn->id;
     dev->vaddr      = (void*) defn->paddr; /* Save the IO port base number. */
     dev->read       = &uart_read;
-    dev->write      = &uart_write;
+    dev->write      = &uart_write_fifo;
     dev->handle_irq = &uart_handle_irq;
     dev->irqs       = defn->irqs;
     dev->ioops      = *ops;
@@ -164,8 +264,21 @@ uart_init(const struct dev_defn* defn, const ps_io_ops_t* ops, ps_chardevice_t*
         return -1;
     }
 
-    /* Enable the receiver interrupt. */
-    if (ps_io_port_out(&dev->ioops.io_port_ops, CONSOLE(io_port, IER), 1, 0x01) != 0) {
+    /* Enable the FIFOs, and check whether this UART actually has them. */
+    if (ps_io_port_out(&dev->ioops.io_port_ops, CONSOLE(io_port, FCR), 1,
+                       SERIAL_FCR_ENABLE_FIFO) != 0) {
+        return -1;
+    }
+    if (ps_io_port_in(&dev->ioops.io_port_ops, CONSOLE(io_port, IIR), 1, &temp) != 0) {
+        return -1;
+    }
+    if ((temp & SERIAL_IIR_FIFO_ENABLED) == SERIAL_IIR_FIFO_ENABLED) {
+        dev->flags |= SERIAL_FLAG_FIFO;
+    }
+
+    /* Enable the receiver interrupt. The transmitter interrupt is only enabled while an
+     * asynchronous write is in progress. */
+    if (ps_io_port_out(&dev->ioops.io_port_ops, CONSOLE(io_port, IER), 1, SERIAL_IER_RX) != 0) {
         return -1;
     }
 
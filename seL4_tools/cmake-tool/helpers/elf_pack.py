@@ -0,0 +1,261 @@
+#!/usr/bin/env python3
+#
+# Copyright 2020, Data61, CSIRO (ABN 41 687 119 230)
+#
+# SPDX-License-Identifier: GPL-2.0-only
+#
+"""
+Pack ELF files for the ELF-loader's payload, compressing the file data of each
+loadable segment as a separate LZ4 block so that the ELF-loader can decompress
+it straight to its load address.  See elfloader-tool/include/binaries/elf/
+elf_pack.h for the format.
+
+THIS IS NOT A STABLE API.  Use as a script, not a module.
+"""
+
+import argparse
+import io
+import struct
+import sys
+
+from typing import BinaryIO, List, Tuple
+
+ELF_PACK_MAGIC = 0x345a4c45  # "ELZ4"
+HEADER_FORMAT = '<IIII'
+CHUNK_FORMAT = '<IIII'
+
+ELF_HEADER_FORMAT = {1: '<16sHHIIIIIHHHHHH', 2: '<16sHHIQQQIHHHHHH'}
+PROGRAM_HEADER_FORMAT = {1: '<IIIIIIII', 2: '<IIQQQQQQ'}
+PT_LOAD = 1
+
+# LZ4 block format limits.  A match is at least 4 bytes, the last match must
+# start at least 12 bytes before the end of the block, and the last 5 bytes
+# are always literals.
+LZ4_MIN_MATCH = 4
+LZ4_MF_LIMIT = 12
+LZ4_LAST_LITERALS = 5
+LZ4_MAX_OFFSET = 65535
+
+
+def is_packed(data: bytes) -> bool:
+    return len(data) >= 4 and struct.unpack_from('<I', data)[0] == ELF_PACK_MAGIC
+
+
+def _lz4_write_length(out: bytearray, n: int):
+    while n >= 255:
+        out.append(255)
+        n -= 255
+    out.append(n)
+
+
+def _lz4_write_sequence(out: bytearray, literals: bytes, offset: int, match_len: int):
+    lit_len = len(literals)
+    token = min(lit_len, 15) << 4
+    if offset:
+        token |= min(match_len - LZ4_MIN_MATCH, 15)
+    out.append(token)
+    if lit_len >= 15:
+        _lz4_write_length(out, lit_len - 15)
+    out.extend(literals)
+    if offset:
+        out.extend(struct.pack('<H', offset))
+        if match_len - LZ4_MIN_MATCH >= 15:
+            _lz4_write_length(out, match_len - LZ4_MIN_MATCH - 15)
+
+
+def lz4_compress_block(data: bytes) -> bytes:
+    """
+    Compress `data` as a raw LZ4 block.  The `lz4` module is used if it is
+    installed; otherwise a simple greedy compressor does the job, more slowly
+    and less tightly.
+    """
+    try:
+        import lz4.block
+        return lz4.block.compress(data, mode='high_compression', store_size=False)
+    except ImportError:
+        pass
+
+    out = bytearray()
+    table = {}
+    anchor = 0
+    i = 0
+    misses = 0
+    limit = len(data) - LZ4_MF_LIMIT
+    match_limit = len(data) - LZ4_LAST_LITERALS
+    while i < limit:
+        key = data[i:i + LZ4_MIN_MATCH]
+        candidate = table.get(key)
+        table[key] = i
+        if candidate is None or i - candidate > LZ4_MAX_OFFSET:
+            # Skip ahead faster through data that doesn't compress.
+            misses += 1
+            i += 1 + (misses >> 6)
+            continue
+        misses = 0
+        match_len = LZ4_MIN_MATCH
+        while i + match_len < match_limit and data[candidate + match_len] == data[i + match_len]:
+            match_len += 1
+        _lz4_write_sequence(out, data[anchor:i], i - candidate, match_len)
+        i += match_len
+        anchor = i
+    _lz4_write_sequence(out, data[anchor:], 0, 0)
+    return bytes(out)
+
+
+def lz4_decompress_block(block: bytes, size: int) -> bytes:
+    """
+    Decompress the raw LZ4 block `block`, which must unpack to `size` bytes.
+    """
+    out = bytearray()
+    i = 0
+
+    def read_length(n: int) -> int:
+        nonlocal i
+        if n == 15:
+            while True:
+                b = block[i]
+                i += 1
+                n += b
+                if b != 255:
+                    break
+        return n
+
+    while i < len(block):
+        token = block[i]
+        i += 1
+        lit_len = read_length(token >> 4)
+        out.extend(block[i:i + lit_len])
+        i += lit_len
+        if i >= len(block):
+            break
+        offset = struct.unpack_from('<H', block, i)[0]
+        i += 2
+        match_len = read_length(token & 15) + LZ4_MIN_MATCH
+        start = len(out) - offset
+        for j in range(match_len):
+            out.append(out[start + j])
+    if len(out) != size:
+        raise ValueError('LZ4 block unpacked to {} bytes, expected {}'.format(len(out), size))
+    return bytes(out)
+
+
+def get_segments(data: bytes) -> Tuple[int, int, List[Tuple[int, int]]]:
+    """
+    Return the ELF class, the size of the ELF and program headers, and the
+    (offset, size) of the file data of each loadable segment of the ELF file
+    `data`.
+    """
+    if data[:4] != b'\x7fELF':
+        raise ValueError('not an ELF file')
+    elf_class = data[4]
+    if elf_class not in ELF_HEADER_FORMAT or data[5] != 1:
+        raise ValueError('only little-endian 32 and 64-bit ELF files are supported')
+    (_, _, _, _, _, phoff, _, _, ehsize, phentsize, phnum, _, _, _) = \
+        struct.unpack_from(ELF_HEADER_FORMAT[elf_class], data)
+
+    segments = []
+    for i in range(phnum):
+        fields = struct.unpack_from(PROGRAM_HEADER_FORMAT[elf_class], data, phoff + i * phentsize)
+        if elf_class == 1:
+            (p_type, p_offset, _, _, p_filesz, _, _, _) = fields
+        else:
+            (p_type, _, p_offset, _, _, p_filesz, _, _) = fields
+        if p_type == PT_LOAD and p_filesz > 0:
+            segments.append((p_offset, p_filesz))
+    return elf_class, max(ehsize, phoff + phnum * phentsize), segments
+
+
+def pack(data: bytes) -> bytes:
+    """
+    Return the packed form of the ELF file `data`.
+    """
+    elf_class, headers_size, segments = get_segments(data)
+
+    # Nothing outside the loadable segments survives, so clear the section
+    # header fields: e_shoff, e_shnum and e_shstrndx.
+    headers = bytearray(data[:headers_size])
+    if elf_class == 1:
+        struct.pack_into('<I', headers, 0x20, 0)
+        struct.pack_into('<HH', headers, 0x30, 0, 0)
+    else:
+        struct.pack_into('<Q', headers, 0x28, 0)
+        struct.pack_into('<HH', headers, 0x3c, 0, 0)
+    headers.extend(bytes(-len(headers) % 4))
+
+    table_size = struct.calcsize(HEADER_FORMAT) + len(segments) * struct.calcsize(CHUNK_FORMAT)
+    packed_offset = table_size + len(headers)
+    chunks = bytearray()
+    blocks = bytearray()
+    for (offset, size) in segments:
+        block = lz4_compress_block(data[offset:offset + size])
+        chunks.extend(struct.pack(CHUNK_FORMAT, offset, size, packed_offset + len(blocks),
+                                  len(block)))
+        blocks.extend(block)
+
+    if packed_offset + len(blocks) > 0xffffffff:
+        raise ValueError('packed file too large')
+    return struct.pack(HEADER_FORMAT, ELF_PACK_MAGIC, headers_size, len(segments), 0) + \
+        bytes(chunks) + bytes(headers) + bytes(blocks)
+
+
+def unpack(data: bytes) -> bytes:
+    """
+    Rebuild an ELF file from the packed file `data`, as far as the ELF-loader
+    would see it: the headers and the loadable segments.  Files that aren't
+    packed are returned as they are.
+    """
+    if not is_packed(data):
+        return data
+    (_, headers_size, num_chunks, _) = struct.unpack_from(HEADER_FORMAT, data)
+    headers_offset = struct.calcsize(HEADER_FORMAT) + num_chunks * struct.calcsize(CHUNK_FORMAT)
+    chunks = [struct.unpack_from(CHUNK_FORMAT, data,
+                                 struct.calcsize(HEADER_FORMAT) + i * struct.calcsize(CHUNK_FORMAT))
+              for i in range(num_chunks)]
+
+    size = max([headers_size] + [offset + size for (offset, size, _, _) in chunks])
+    elf = bytearray(size)
+    for (offset, size, packed_offset, packed_size) in chunks:
+        elf[offset:offset + size] = \
+            lz4_decompress_block(data[packed_offset:packed_offset + packed_size], size)
+    elf[:headers_size] = data[headers_offset:headers_offset + headers_size]
+    return bytes(elf)
+
+
+def unpack_file(elf_file: BinaryIO) -> BinaryIO:
+    """
+    Return a file object for the unpacked form of `elf_file`.
+    """
+    return io.BytesIO(unpack(elf_file.read()))
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(
+        formatter_class=argparse.RawDescriptionHelpFormatter,
+        description="""
+Pack the ELF file `input` into `output` for the ELF-loader's payload.  The ELF
+and program headers are kept as they are, and the file data of each loadable
+segment is compressed as a separate LZ4 block.  Everything else, such as
+section headers and symbols, is dropped.
+
+With "--unpack", rebuild the headers and loadable segments of the packed file
+`input` into `output` instead.
+""")
+    parser.add_argument('input', type=str, help='file to read')
+    parser.add_argument('output', type=str, help='file to write')
+    parser.add_argument('--unpack', action='store_true',
+                        help='unpack rather than pack')
+    args = parser.parse_args()
+
+    with open(args.input, 'rb') as f:
+        data = f.read()
+    result = unpack(data) if args.unpack else pack(data)
+    with open(args.output, 'wb') as f:
+        f.write(result)
+
+    if not args.unpack:
+        print('elf_pack: {}: {} -> {} bytes'.format(args.input, len(data), len(result)))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -24,6 +24,7 @@ import sys
 
 import libarchive
 
+import elf_pack
 import elf_sift
 import platform_sift
 
@@ -148,8 +149,10 @@ sufficiently-large memory region.
             name = entry.name
             debug('encountered CPIO entry name: {}'.format(name))
 
+            # ELF files may have been packed by elf_pack; what matters here is
+            # the memory they will occupy once the ELF-loader unpacks them.
             if name == 'kernel.elf':
-                kernel_elf = get_bytes(entry)
+                kernel_elf = elf_pack.unpack_file(get_bytes(entry))
             elif name == 'kernel.dtb':
                 # The ELF-loader loads the entire DTB into memory.
                 is_dtb_present = True
@@ -158,7 +161,7 @@ sufficiently-large memory region.
                 # Skip checksum entries.
                 notice('skipping checkum entry "{}"'.format(name))
             else:
-                rootservers.append(get_bytes(entry))
+                rootservers.append(elf_pack.unpack_file(get_bytes(entry)))
 
     # Enumerate the regions as we encounter them for diagnostic purposes.
     region_counter = -1
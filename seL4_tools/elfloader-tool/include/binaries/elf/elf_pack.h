@@ -0,0 +1,41 @@
+/*
+ * Copyright 2020, Data61, CSIRO (ABN 41 687 119 230)
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#pragma once
+
+#include <types.h>
+
+/*
+ * ELF files packed by cmake-tool/helpers/elf_pack.py.
+ *
+ *   [ struct elf_pack_header ][ struct elf_pack_chunk, num_chunks times ]
+ *   [ ELF and program headers, headers_size bytes ][ LZ4 blocks ]
+ *
+ * The ELF and program headers are kept uncompressed, at their original
+ * offsets, so the usual ELF accessors work on them in place. The file data
+ * of each PT_LOAD segment is a separate LZ4 block, so it can be
+ * decompressed straight to its load address. Anything outside the loadable
+ * segments, such as section headers and symbols, is dropped, and the ELF
+ * header's section header fields are cleared to match.
+ *
+ * All fields are little-endian.
+ */
+
+#define ELF_PACK_MAGIC 0x345a4c45 /* "ELZ4" */
+
+struct elf_pack_header {
+    uint32_t magic;
+    uint32_t headers_size;
+    uint32_t num_chunks;
+    uint32_t reserved;
+};
+
+struct elf_pack_chunk {
+    uint32_t offset;        /* Offset of the data in the original ELF file. */
+    uint32_t size;          /* Size of the data. */
+    uint32_t packed_offset; /* Offset of the LZ4 block from the start of the packed file. */
+    uint32_t packed_size;
+};
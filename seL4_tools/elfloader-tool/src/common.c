@@ -12,6 +12,7 @@
 #include <abort.h>
 #include <strops.h>
 #include <binaries/elf/elf.h>
+#include <binaries/elf/elf_pack.h>
 #include <cpio/cpio.h>
 
 #include <elfloader.h>
@@ -24,6 +25,7 @@
 #endif
 
 #include "hash.h"
+#include "lz4.h"
 
 #ifdef CONFIG_ELFLOADER_ROOTSERVERS_LAST
 #include <platform_info.h> // this provides memory_region
@@ -43,6 +45,10 @@ void clear_bss(void)
 
 #define KEEP_HEADERS_SIZE BIT(PAGE_BITS)
 
+/* Payload statistics, reported once everything has been loaded. */
+static size_t payload_packed_bytes;
+static size_t payload_unpacked_bytes;
+
 /* Determine if two intervals overlap. */
 static int regions_overlap(uintptr_t startA, uintptr_t endA,
                            uintptr_t startB, uintptr_t endB)
@@ -75,16 +81,91 @@ static void ensure_phys_range_valid(char const *const name, paddr_t paddr_min,
     }
 }
 
+/*
+ * Return the packed file header if the archive file `file` of `size` bytes
+ * was packed by elf_pack.py, or NULL if it is a plain ELF file.
+ */
+static struct elf_pack_header *elf_pack_get_header(void *file, unsigned long size)
+{
+    struct elf_pack_header *header = file;
+    if (size < sizeof(struct elf_pack_header) || header->magic != ELF_PACK_MAGIC) {
+        return NULL;
+    }
+    if (header->num_chunks > (size - sizeof(struct elf_pack_header)) / sizeof(struct elf_pack_chunk)) {
+        printf("Packed ELF file has a truncated chunk table!\n");
+        abort();
+    }
+    unsigned long headers_offset = sizeof(struct elf_pack_header) +
+                                   header->num_chunks * sizeof(struct elf_pack_chunk);
+    if (header->headers_size > size - headers_offset) {
+        printf("Packed ELF file has truncated ELF headers!\n");
+        abort();
+    }
+    return header;
+}
+
+static struct elf_pack_chunk *elf_pack_get_chunks(struct elf_pack_header *header)
+{
+    return (struct elf_pack_chunk *)(header + 1);
+}
+
+/*
+ * Return the ELF headers of an archive file, packed or not. Packed files keep
+ * them uncompressed, straight after the chunk table.
+ */
+static void *elf_headers(void *file, unsigned long size)
+{
+    struct elf_pack_header *header = elf_pack_get_header(file, size);
+    if (!header) {
+        return file;
+    }
+    return (void *)(elf_pack_get_chunks(header) + header->num_chunks);
+}
+
+/*
+ * Decompress the packed file data at `data_offset` in the original ELF file
+ * straight to `dest`.
+ */
+static void elf_pack_unpack_data(struct elf_pack_header *header, unsigned long size,
+                                 size_t data_offset, size_t data_size, void *dest)
+{
+    if (data_size == 0) {
+        return;
+    }
+    struct elf_pack_chunk *chunk = elf_pack_get_chunks(header);
+    for (uint32_t i = 0; i < header->num_chunks; i++, chunk++) {
+        if (chunk->offset != data_offset || chunk->size != data_size) {
+            continue;
+        }
+        if (chunk->packed_offset > size || chunk->packed_size > size - chunk->packed_offset) {
+            break;
+        }
+        if (lz4_decompress_block((char *)header + chunk->packed_offset, chunk->packed_size,
+                                 dest, data_size) != 0) {
+            printf("Corrupt LZ4 block in packed ELF file!\n");
+            abort();
+        }
+        payload_packed_bytes += chunk->packed_size;
+        return;
+    }
+    printf("Packed ELF file is missing the data for a loadable segment!\n");
+    abort();
+}
+
 /*
  * Unpack an ELF file to the given physical address.
+ *
+ * `file` is the file in the archive, and `elf` its ELF headers; they are the
+ * same unless the file is packed.
  */
-static void unpack_elf_to_paddr(void *elf, paddr_t dest_paddr)
+static void unpack_elf_to_paddr(void *file, unsigned long size, void *elf, paddr_t dest_paddr)
 {
     uint16_t i;
     uint64_t min_vaddr, max_vaddr;
     size_t image_size;
 
     word_t phys_virt_offset;
+    struct elf_pack_header *pack = elf_pack_get_header(file, size);
 
     /* Get size of the image. */
     elf_getMemoryBounds(elf, 0, &min_vaddr, &max_vaddr);
@@ -110,8 +191,15 @@ static void unpack_elf_to_paddr(void *elf, paddr_t dest_paddr)
         data_offset = elf_getProgramHeaderOffset(elf, i);
 
         /* Load data into memory. */
-        memcpy((char *)dest_vaddr + phys_virt_offset,
-               (char *)elf + data_offset, data_size);
+        if (pack) {
+            elf_pack_unpack_data(pack, size, data_offset, data_size,
+                                 (char *)dest_vaddr + phys_virt_offset);
+        } else {
+            memcpy((char *)dest_vaddr + phys_virt_offset,
+                   (char *)elf + data_offset, data_size);
+            payload_packed_bytes += data_size;
+        }
+        payload_unpacked_bytes += data_size;
     }
 }
 
@@ -125,13 +213,16 @@ static size_t rounded_image_size(void *elf, uint64_t *min_vaddr, uint64_t *max_v
 /*
  * Load an ELF file into physical memory at the given physical address.
  *
+ * `file` is the file in the archive, of `size` bytes, which may be packed.
+ *
  * Return the byte past the last byte of the physical address used.
  */
-static paddr_t load_elf(const char *name, void *elf, paddr_t dest_paddr,
+static paddr_t load_elf(const char *name, void *file, paddr_t dest_paddr,
                         struct image_info *info, int keep_headers,
-                        __attribute__((unused)) unsigned long size,
+                        unsigned long size,
                         __attribute__((unused)) const char *hash)
 {
+    void *elf = elf_headers(file, size);
     uint64_t min_vaddr, max_vaddr;
     /* Fetch image info. */
     size_t image_size = rounded_image_size(elf, &min_vaddr, &max_vaddr);
@@ -179,7 +270,7 @@ static paddr_t load_elf(const char *name, void *elf, paddr_t dest_paddr,
         printf("Hash from ELF File: ");
         print_hash(print_hash_pointer, hash_len);
 
-        get_hash(hashes, elf, size, calculated_hash);
+        get_hash(hashes, file, size, calculated_hash);
 
         /* Print the hash so the user can see they're the same or different */
         printf("Hash for ELF Input: ");
@@ -216,7 +307,7 @@ static paddr_t load_elf(const char *name, void *elf, paddr_t dest_paddr,
     ensure_phys_range_valid(name, dest_paddr, dest_paddr + image_size);
 
     /* Copy the data. */
-    unpack_elf_to_paddr(elf, dest_paddr);
+    unpack_elf_to_paddr(file, size, elf, dest_paddr);
 
     /* Record information about the placement of the image. */
     info->phys_region_start = dest_paddr;
@@ -261,7 +352,9 @@ static paddr_t load_elf(const char *name, void *elf, paddr_t dest_paddr,
  * kernel and one or more ELF files for the userspace image. (Typically there
  * will only be one userspace ELF file, though if we are running a multi-core
  * CPU, we may have multiple userspace images; one per CPU.) These ELF files
- * are packed into an 'ar' archive.
+ * are packed into an 'ar' archive. Each may also have been packed by
+ * elf_pack.py, in which case its segments are decompressed straight to
+ * their load addresses instead of being copied.
  *
  * The kernel ELF file indicates what physical address it wants to be loaded
  * at, while userspace images run out of virtual memory, so don't have any
@@ -297,11 +390,12 @@ void load_images(struct image_info *kernel_info, struct image_info *user_info,
 
     /* Load kernel. */
     unsigned long cpio_len = _archive_start_end - _archive_start;
-    void *kernel_elf = cpio_get_file(_archive_start, cpio_len, "kernel.elf", &kernel_filesize);
-    if (kernel_elf == NULL) {
+    void *kernel_file = cpio_get_file(_archive_start, cpio_len, "kernel.elf", &kernel_filesize);
+    if (kernel_file == NULL) {
         printf("No kernel image present in archive!\n");
         abort();
     }
+    void *kernel_elf = elf_headers(kernel_file, kernel_filesize);
     if (elf_checkFile(kernel_elf)) {
         printf("Kernel image not a valid ELF file!\n");
         abort();
@@ -363,7 +457,7 @@ void load_images(struct image_info *kernel_info, struct image_info *user_info,
     } else {
         next_phys_addr = ROUND_UP(kernel_phys_end, PAGE_BITS);
     }
-    load_elf("kernel", kernel_elf,
+    load_elf("kernel", kernel_file,
              (paddr_t)kernel_phys_start, kernel_info, 0, kernel_filesize, "kernel.bin");
 
     /*
@@ -393,10 +487,11 @@ void load_images(struct image_info *kernel_info, struct image_info *user_info,
      * load_elf uses */
     int total_user_image_size = 0;
     for (i = 0; i < max_user_images; i++) {
-        void *user_elf = cpio_get_entry(_archive_start, cpio_len, i + user_elf_offset,
-                                        &elf_filename, &unused);
+        void *user_file = cpio_get_entry(_archive_start, cpio_len, i + user_elf_offset,
+                                         &elf_filename, &unused);
         uint64_t min_vaddr, max_vaddr;
-        total_user_image_size += rounded_image_size(user_elf, &min_vaddr, &max_vaddr);
+        total_user_image_size += rounded_image_size(elf_headers(user_file, unused),
+                                                    &min_vaddr, &max_vaddr);
 
         total_user_image_size += KEEP_HEADERS_SIZE;
     }
@@ -409,17 +504,20 @@ void load_images(struct image_info *kernel_info, struct image_info *user_info,
     *num_images = 0;
     for (i = 0; i < max_user_images; i++) {
         /* Fetch info about the next ELF file in the archive. */
-        void *user_elf = cpio_get_entry(_archive_start, cpio_len, i + user_elf_offset,
-                                        &elf_filename, &unused);
-        if (user_elf == NULL) {
+        void *user_file = cpio_get_entry(_archive_start, cpio_len, i + user_elf_offset,
+                                         &elf_filename, &unused);
+        if (user_file == NULL) {
             break;
         }
 
         /* Load the file into memory. */
-        next_phys_addr = load_elf(elf_filename, user_elf,
+        next_phys_addr = load_elf(elf_filename, user_file,
                                   next_phys_addr, &user_info[*num_images], 1, unused, "app.bin");
         *num_images = i + 1;
     }
+
+    printf("Payload: %lu byte archive, %lu bytes of segment data unpacked from %lu\n",
+           cpio_len, (unsigned long)payload_unpacked_bytes, (unsigned long)payload_packed_bytes);
 }
 
 void __attribute__((weak)) platform_init(void) {}
@@ -0,0 +1,20 @@
+/*
+ * Copyright 2020, Data61, CSIRO (ABN 41 687 119 230)
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#pragma once
+
+#include <types.h>
+
+/*
+ * Decompress a raw LZ4 block (no frame header) into `dst`.
+ *
+ * Every length and match offset is checked against the input and output
+ * buffers, so a corrupt block cannot write outside `dst`.
+ *
+ * Returns 0 if the block decompressed to exactly `dst_size` bytes, and
+ * non-zero otherwise.
+ */
+int lz4_decompress_block(const void *src, size_t src_size, void *dst, size_t dst_size);
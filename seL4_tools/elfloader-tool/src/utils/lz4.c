@@ -0,0 +1,91 @@
+/*
+ * Copyright 2020, Data61, CSIRO (ABN 41 687 119 230)
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/*
+ * Freestanding LZ4 block decompressor.
+ *
+ * A block is a series of sequences, each a token byte, literal length
+ * extension bytes, the literals, a two byte little-endian match offset and
+ * match length extension bytes. The last sequence has literals only. See
+ * the LZ4 block format description for details.
+ */
+#include <strops.h>
+#include <types.h>
+#include "../lz4.h"
+
+#define LZ4_MIN_MATCH 4
+
+/* Read the extension bytes of a length whose token nibble was 15. */
+static int lz4_read_length(const uint8_t **ip, const uint8_t *iend, size_t *len)
+{
+    uint8_t b;
+    do {
+        if (*ip >= iend) {
+            return -1;
+        }
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return 0;
+}
+
+int lz4_decompress_block(const void *src, size_t src_size, void *dst, size_t dst_size)
+{
+    const uint8_t *ip = src;
+    const uint8_t *iend = ip + src_size;
+    uint8_t *op = dst;
+    uint8_t *oend = op + dst_size;
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+
+        /* Literals. */
+        size_t len = token >> 4;
+        if (len == 15 && lz4_read_length(&ip, iend, &len)) {
+            return -1;
+        }
+        if (len > (size_t)(iend - ip) || len > (size_t)(oend - op)) {
+            return -1;
+        }
+        memcpy(op, ip, len);
+        ip += len;
+        op += len;
+        if (ip == iend) {
+            /* The last sequence ends after its literals. */
+            break;
+        }
+
+        /* Match. */
+        if (iend - ip < 2) {
+            return -1;
+        }
+        size_t offset = ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - (uint8_t *)dst)) {
+            return -1;
+        }
+        len = token & 15;
+        if (len == 15 && lz4_read_length(&ip, iend, &len)) {
+            return -1;
+        }
+        len += LZ4_MIN_MATCH;
+        if (len > (size_t)(oend - op)) {
+            return -1;
+        }
+        const uint8_t *match = op - offset;
+        if (offset >= len) {
+            memcpy(op, match, len);
+            op += len;
+        } else {
+            /* Overlapping match, e.g. a run: copy forwards a byte at a time. */
+            while (len--) {
+                *op++ = *match++;
+            }
+        }
+    }
+
+    return op == oend ? 0 : -1;
+}